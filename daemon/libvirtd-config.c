@@ -152,8 +152,16 @@ daemonConfigNew(bool privileged ATTRIBUTE_UNUSED)
     data->max_anonymous_clients = 20;
 
     data->prio_workers = 5;
+    data->target_latency = 0;
+    data->reply_cache_timeout = 60;
+
+    data->client_weight = 1;
+    data->readonly_client_weight = 1;
 
     data->max_client_requests = 5;
+    data->max_client_tx_messages = 0;
+    data->max_client_tx_bytes = 0;
+    data->max_volume_streams = 0;
 
     data->audit_level = 1;
     data->audit_logging = 0;
@@ -332,6 +340,9 @@ daemonConfigLoadOptions(struct daemonConfig *data,
 
     if (virConfGetValueString(conf, "tls_priority", &data->tls_priority) < 0)
         goto error;
+    if (virConfGetValueUInt(conf, "tls_session_ticket_lifetime",
+                            &data->tls_session_ticket_lifetime) < 0)
+        goto error;
 
     if (virConfGetValueUInt(conf, "min_workers", &data->min_workers) < 0)
         goto error;
@@ -346,9 +357,41 @@ daemonConfigLoadOptions(struct daemonConfig *data,
 
     if (virConfGetValueUInt(conf, "prio_workers", &data->prio_workers) < 0)
         goto error;
+    if (virConfGetValueUInt(conf, "target_latency", &data->target_latency) < 0)
+        goto error;
+
+    if (virConfGetValueUInt(conf, "io_loops", &data->io_loops) < 0)
+        goto error;
+
+    if (virConfGetValueUInt(conf, "compression_threshold",
+                            &data->compression_threshold) < 0)
+        goto error;
+
+    if (virConfGetValueUInt(conf, "shm_transport_size",
+                            &data->shm_transport_size) < 0)
+        goto error;
+
+    if (virConfGetValueUInt(conf, "reply_cache_timeout",
+                            &data->reply_cache_timeout) < 0)
+        goto error;
+
+    if (virConfGetValueUInt(conf, "client_weight", &data->client_weight) < 0)
+        goto error;
+    if (virConfGetValueUInt(conf, "readonly_client_weight",
+                            &data->readonly_client_weight) < 0)
+        goto error;
 
     if (virConfGetValueUInt(conf, "max_client_requests", &data->max_client_requests) < 0)
         goto error;
+    if (virConfGetValueUInt(conf, "max_client_tx_messages",
+                            &data->max_client_tx_messages) < 0)
+        goto error;
+    if (virConfGetValueUInt(conf, "max_client_tx_bytes",
+                            &data->max_client_tx_bytes) < 0)
+        goto error;
+    if (virConfGetValueUInt(conf, "max_volume_streams",
+                            &data->max_volume_streams) < 0)
+        goto error;
 
     if (virConfGetValueUInt(conf, "admin_min_workers", &data->admin_min_workers) < 0)
         goto error;
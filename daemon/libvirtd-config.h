@@ -57,6 +57,7 @@ struct daemonConfig {
     char **tls_allowed_dn_list;
     char **sasl_allowed_username_list;
     char *tls_priority;
+    unsigned int tls_session_ticket_lifetime;
 
     char *key_file;
     char *cert_file;
@@ -70,8 +71,23 @@ struct daemonConfig {
     unsigned int max_anonymous_clients;
 
     unsigned int prio_workers;
+    unsigned int target_latency;
+
+    unsigned int io_loops;
+
+    unsigned int compression_threshold;
+
+    unsigned int shm_transport_size;
+
+    unsigned int reply_cache_timeout;
+
+    unsigned int client_weight;
+    unsigned int readonly_client_weight;
 
     unsigned int max_client_requests;
+    unsigned int max_client_tx_messages;
+    unsigned int max_client_tx_bytes;
+    unsigned int max_volume_streams;
 
     unsigned int log_level;
     char *log_filters;
@@ -33,6 +33,7 @@
 
 #include "libvirt_internal.h"
 #include "virerror.h"
+#include "vireventpoll.h"
 #include "virfile.h"
 #include "virlog.h"
 #include "virpidfile.h"
@@ -51,12 +52,14 @@
 #include "virnetlink.h"
 #include "virnetdaemon.h"
 #include "remote.h"
+#include "stream.h"
 #include "virhook.h"
 #include "viraudit.h"
 #include "virstring.h"
 #include "locking/lock_manager.h"
 #include "viraccessmanager.h"
 #include "virutil.h"
+#include "capabilities.h"
 #include "virgettext.h"
 #include "util/virnetdevopenvswitch.h"
 
@@ -528,6 +531,9 @@ daemonSetupNetworking(virNetServerPtr srv,
                     goto cleanup;
             }
 
+            virNetTLSContextSetSessionTickets(ctxt,
+                                              config->tls_session_ticket_lifetime);
+
             VIR_DEBUG("Registering TLS socket %s:%s",
                       config->listen_addr, config->tls_port);
             if (!(svcTLS =
@@ -723,6 +729,9 @@ static void daemonReloadHandler(virNetDaemonPtr dmn ATTRIBUTE_UNUSED,
                 VIR_HOOK_DAEMON_OP_RELOAD, SIGHUP, "SIGHUP", NULL, NULL);
     if (virStateReload() < 0)
         VIR_WARN("Error while reloading drivers");
+
+    /* Reloaded drivers may describe the host differently */
+    virCapabilitiesInvalidate();
 }
 
 static int daemonSetupSignals(virNetDaemonPtr dmn)
@@ -1302,6 +1311,14 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
+    if (virEventPollSetIOLoops(config->io_loops) < 0) {
+        ret = VIR_DAEMON_ERR_INIT;
+        goto cleanup;
+    }
+
+    virNetMessageCompressionSetThreshold(config->compression_threshold);
+    virNetShmChannelSetDefaultSize(config->shm_transport_size);
+
     if (!(srv = virNetServerNew("libvirtd", 1,
                                 config->min_workers,
                                 config->max_workers,
@@ -1319,6 +1336,24 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
+    if (config->target_latency &&
+        virNetServerSetThreadPoolParameters(srv, -1, -1, -1,
+                                            config->target_latency) < 0) {
+        ret = VIR_DAEMON_ERR_CONFIG;
+        goto cleanup;
+    }
+
+    if (virNetServerSetClientWeights(srv, config->client_weight,
+                                     config->readonly_client_weight) < 0) {
+        ret = VIR_DAEMON_ERR_CONFIG;
+        goto cleanup;
+    }
+
+    virNetServerSetClientTxLimits(srv, config->max_client_tx_messages,
+                                  config->max_client_tx_bytes);
+
+    daemonSetMaxVolumeStreams(config->max_volume_streams);
+
     if (virNetDaemonAddServer(dmn, srv) < 0) {
         ret = VIR_DAEMON_ERR_INIT;
         goto cleanup;
@@ -1347,6 +1382,16 @@ int main(int argc, char **argv) {
         ret = VIR_DAEMON_ERR_INIT;
         goto cleanup;
     }
+    if (config->reply_cache_timeout > 0) {
+        virNetServerReplyCachePtr replyCache;
+
+        if (!(replyCache = remoteReplyCacheNew(config->reply_cache_timeout))) {
+            ret = VIR_DAEMON_ERR_INIT;
+            goto cleanup;
+        }
+        virNetServerProgramSetReplyCache(remoteProgram, replyCache);
+        virObjectUnref(replyCache);
+    }
     if (virNetServerAddProgram(srv, remoteProgram) < 0) {
         ret = VIR_DAEMON_ERR_INIT;
         goto cleanup;
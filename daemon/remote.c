@@ -52,6 +52,8 @@
 #include "viraccessapicheckqemu.h"
 #include "virpolkit.h"
 #include "virthreadjob.h"
+#include "viruri.h"
+#include "capabilities.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -120,6 +122,13 @@ remoteDispatchObjectEventSend(virNetServerClientPtr client,
                               int procnr,
                               xdrproc_t proc,
                               void *data);
+static void
+remoteDispatchObjectEventSendFull(virNetServerClientPtr client,
+                                  virNetServerProgramPtr program,
+                                  int procnr,
+                                  xdrproc_t proc,
+                                  void *data,
+                                  const char *coalesceKey);
 
 static void
 remoteEventCallbackFree(void *opaque)
@@ -132,6 +141,27 @@ remoteEventCallbackFree(void *opaque)
 }
 
 
+/*
+ * Events reporting the latest value of something, rather than a change,
+ * are keyed so that a client falling behind only gets the last one for
+ * each domain, callback and @dev. Returns NULL if that can't be done.
+ */
+static char *
+remoteRelayDomainEventCoalesceKey(int procnr,
+                                  int callbackID,
+                                  virDomainPtr dom,
+                                  const char *dev)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    char *key = NULL;
+
+    virUUIDFormat(dom->uuid, uuidstr);
+    ignore_value(virAsprintfQuiet(&key, "%d:%d:%s:%s", procnr, callbackID,
+                                  uuidstr, dev ? dev : ""));
+    return key;
+}
+
+
 static bool
 remoteRelayDomainEventCheckACL(virNetServerClientPtr client,
                                virConnectPtr conn, virDomainPtr dom)
@@ -895,6 +925,7 @@ remoteRelayDomainEventBalloonChange(virConnectPtr conn,
 {
     daemonClientEventCallbackPtr callback = opaque;
     remote_domain_event_balloon_change_msg data;
+    char *key = NULL;
 
     if (callback->callbackID < 0 ||
         !remoteRelayDomainEventCheckACL(callback->client, conn, dom))
@@ -909,18 +940,25 @@ remoteRelayDomainEventBalloonChange(virConnectPtr conn,
     data.actual = actual;
 
     if (callback->legacy) {
-        remoteDispatchObjectEventSend(callback->client, remoteProgram,
-                                      REMOTE_PROC_DOMAIN_EVENT_BALLOON_CHANGE,
-                                      (xdrproc_t)xdr_remote_domain_event_balloon_change_msg, &data);
+        key = remoteRelayDomainEventCoalesceKey(REMOTE_PROC_DOMAIN_EVENT_BALLOON_CHANGE,
+                                                callback->callbackID, dom, NULL);
+        remoteDispatchObjectEventSendFull(callback->client, remoteProgram,
+                                          REMOTE_PROC_DOMAIN_EVENT_BALLOON_CHANGE,
+                                          (xdrproc_t)xdr_remote_domain_event_balloon_change_msg,
+                                          &data, key);
     } else {
         remote_domain_event_callback_balloon_change_msg msg = { callback->callbackID,
                                                                 data };
 
-        remoteDispatchObjectEventSend(callback->client, remoteProgram,
-                                      REMOTE_PROC_DOMAIN_EVENT_CALLBACK_BALLOON_CHANGE,
-                                      (xdrproc_t)xdr_remote_domain_event_callback_balloon_change_msg, &msg);
+        key = remoteRelayDomainEventCoalesceKey(REMOTE_PROC_DOMAIN_EVENT_CALLBACK_BALLOON_CHANGE,
+                                                callback->callbackID, dom, NULL);
+        remoteDispatchObjectEventSendFull(callback->client, remoteProgram,
+                                          REMOTE_PROC_DOMAIN_EVENT_CALLBACK_BALLOON_CHANGE,
+                                          (xdrproc_t)xdr_remote_domain_event_callback_balloon_change_msg,
+                                          &msg, key);
     }
 
+    VIR_FREE(key);
     return 0;
 }
 
@@ -1155,6 +1193,7 @@ remoteRelayDomainEventMigrationIteration(virConnectPtr conn,
 {
     daemonClientEventCallbackPtr callback = opaque;
     remote_domain_event_callback_migration_iteration_msg data;
+    char *key;
 
     if (callback->callbackID < 0 ||
         !remoteRelayDomainEventCheckACL(callback->client, conn, dom))
@@ -1171,11 +1210,14 @@ remoteRelayDomainEventMigrationIteration(virConnectPtr conn,
 
     data.iteration = iteration;
 
-    remoteDispatchObjectEventSend(callback->client, remoteProgram,
-                                  REMOTE_PROC_DOMAIN_EVENT_CALLBACK_MIGRATION_ITERATION,
-                                  (xdrproc_t)xdr_remote_domain_event_callback_migration_iteration_msg,
-                                  &data);
+    key = remoteRelayDomainEventCoalesceKey(REMOTE_PROC_DOMAIN_EVENT_CALLBACK_MIGRATION_ITERATION,
+                                            callback->callbackID, dom, NULL);
+    remoteDispatchObjectEventSendFull(callback->client, remoteProgram,
+                                      REMOTE_PROC_DOMAIN_EVENT_CALLBACK_MIGRATION_ITERATION,
+                                      (xdrproc_t)xdr_remote_domain_event_callback_migration_iteration_msg,
+                                      &data, key);
 
+    VIR_FREE(key);
     return 0;
 }
 
@@ -1308,6 +1350,7 @@ remoteRelayDomainEventBlockThreshold(virConnectPtr conn,
 {
     daemonClientEventCallbackPtr callback = opaque;
     remote_domain_event_block_threshold_msg data;
+    char *key;
 
     if (callback->callbackID < 0 ||
         !remoteRelayDomainEventCheckACL(callback->client, conn, dom))
@@ -1331,10 +1374,14 @@ remoteRelayDomainEventBlockThreshold(virConnectPtr conn,
     data.excess = excess;
     make_nonnull_domain(&data.dom, dom);
 
-    remoteDispatchObjectEventSend(callback->client, remoteProgram,
-                                  REMOTE_PROC_DOMAIN_EVENT_BLOCK_THRESHOLD,
-                                  (xdrproc_t)xdr_remote_domain_event_block_threshold_msg, &data);
+    key = remoteRelayDomainEventCoalesceKey(REMOTE_PROC_DOMAIN_EVENT_BLOCK_THRESHOLD,
+                                            callback->callbackID, dom, dev);
+    remoteDispatchObjectEventSendFull(callback->client, remoteProgram,
+                                      REMOTE_PROC_DOMAIN_EVENT_BLOCK_THRESHOLD,
+                                      (xdrproc_t)xdr_remote_domain_event_block_threshold_msg,
+                                      &data, key);
 
+    VIR_FREE(key);
     return 0;
  error:
     VIR_FREE(data.dev);
@@ -1775,6 +1822,64 @@ void *remoteClientNew(virNetServerClientPtr client,
     return priv;
 }
 
+
+/* Upper limit on the number of distinct replies kept in the cache */
+#define REMOTE_REPLY_CACHE_MAX 128
+
+/*
+ * Decide whether a reply may come from the reply cache. Replies are
+ * shared by all connections to the same driver and URI, and the
+ * capabilities generation tells when they are out of date. The
+ * procedure's access control check must happen here, as a cached
+ * reply never gets to the driver.
+ */
+static int
+remoteReplyCacheScope(virNetServerClientPtr client,
+                      int procedure,
+                      char **scope,
+                      unsigned long long *generation,
+                      void *opaque ATTRIBUTE_UNUSED)
+{
+    struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
+    char *uri = NULL;
+    int ret;
+
+    /* Let the dispatcher report the error */
+    if (!priv->conn)
+        return 0;
+
+    switch ((remote_procedure) procedure) {
+    case REMOTE_PROC_CONNECT_GET_CAPABILITIES:
+        if (virConnectGetCapabilitiesEnsureACL(priv->conn) < 0)
+            return -1;
+        break;
+
+    case REMOTE_PROC_CONNECT_GET_DOMAIN_CAPABILITIES:
+        if (virConnectGetDomainCapabilitiesEnsureACL(priv->conn) < 0)
+            return -1;
+        break;
+
+    default:
+        return 0;
+    }
+
+    if (priv->conn->uri &&
+        !(uri = virURIFormat(priv->conn->uri)))
+        return -1;
+
+    *generation = virCapabilitiesGetGeneration();
+    ret = virAsprintf(scope, "%s:%s", priv->conn->driver->name, NULLSTR(uri));
+    VIR_FREE(uri);
+    return ret < 0 ? -1 : 1;
+}
+
+
+virNetServerReplyCachePtr remoteReplyCacheNew(unsigned int timeout)
+{
+    return virNetServerReplyCacheNew(REMOTE_REPLY_CACHE_MAX, timeout,
+                                     remoteReplyCacheScope, NULL, NULL);
+}
+
 /*----- Functions. -----*/
 
 static int
@@ -3982,18 +4087,29 @@ remoteDispatchConnectDomainEventDeregister(virNetServerPtr server ATTRIBUTE_UNUS
     return rv;
 }
 
+/*
+ * @coalesceKey: identifies events superseding each other, or NULL
+ *
+ * Queue an event for @client. When the client falls behind, a queued
+ * event with the same @coalesceKey may be replaced by this one, or this
+ * one dropped, see virNetServerClientSendMessage.
+ */
 static void
-remoteDispatchObjectEventSend(virNetServerClientPtr client,
-                              virNetServerProgramPtr program,
-                              int procnr,
-                              xdrproc_t proc,
-                              void *data)
+remoteDispatchObjectEventSendFull(virNetServerClientPtr client,
+                                  virNetServerProgramPtr program,
+                                  int procnr,
+                                  xdrproc_t proc,
+                                  void *data,
+                                  const char *coalesceKey)
 {
     virNetMessagePtr msg;
 
     if (!(msg = virNetMessageNew(false)))
         goto cleanup;
 
+    if (VIR_STRDUP(msg->coalesceKey, coalesceKey) < 0)
+        goto cleanup;
+
     msg->header.prog = virNetServerProgramGetID(program);
     msg->header.vers = virNetServerProgramGetVersion(program);
     msg->header.proc = procnr;
@@ -4008,7 +4124,8 @@ remoteDispatchObjectEventSend(virNetServerClientPtr client,
         goto cleanup;
 
     VIR_DEBUG("Queue event %d %zu", procnr, msg->bufferLength);
-    virNetServerClientSendMessage(client, msg);
+    if (virNetServerClientSendMessage(client, msg) < 0)
+        goto cleanup;
 
     xdr_free(proc, data);
     return;
@@ -4018,6 +4135,17 @@ remoteDispatchObjectEventSend(virNetServerClientPtr client,
     xdr_free(proc, data);
 }
 
+static void
+remoteDispatchObjectEventSend(virNetServerClientPtr client,
+                              virNetServerProgramPtr program,
+                              int procnr,
+                              xdrproc_t proc,
+                              void *data)
+{
+    remoteDispatchObjectEventSendFull(client, program, procnr,
+                                      proc, data, NULL);
+}
+
 static int
 remoteDispatchSecretGetValue(virNetServerPtr server ATTRIBUTE_UNUSED,
                              virNetServerClientPtr client ATTRIBUTE_UNUSED,
@@ -4658,6 +4786,21 @@ static int remoteDispatchConnectSupportsFeature(virNetServerPtr server ATTRIBUTE
         goto done;
     }
 
+    /* Also queried before opening the connection. The client only asks
+     * for it if it can handle compressed replies.
+     */
+    if (args->feature == VIR_DRV_FEATURE_PROGRAM_COMPRESSION) {
+        supported = virNetServerClientEnableCompression(client);
+        goto done;
+    }
+
+    /* Likewise, as the switch must happen before anything else */
+    if (args->feature == VIR_DRV_FEATURE_PROGRAM_SHM_TRANSPORT) {
+        supported = virNetShmChannelGetDefaultSize() > 0 &&
+            virNetServerClientCanUseShm(client);
+        goto done;
+    }
+
     if (!priv->conn) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
         goto cleanup;
@@ -4687,6 +4830,45 @@ static int remoteDispatchConnectSupportsFeature(virNetServerPtr server ATTRIBUTE
 }
 
 
+static int
+remoteDispatchConnectOpenShmChannel(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                    virNetServerClientPtr client,
+                                    virNetMessagePtr msg,
+                                    virNetMessageErrorPtr rerr,
+                                    remote_connect_open_shm_channel_args *args)
+{
+    virNetShmChannelPtr chan = NULL;
+    unsigned int flags = args->flags;
+    size_t size = virNetShmChannelGetDefaultSize();
+    int rv = -1;
+
+    virCheckFlagsGoto(0, cleanup);
+
+    if (size == 0) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("shared memory transport is disabled"));
+        goto cleanup;
+    }
+
+    if (!(chan = virNetShmChannelNew(size)))
+        goto cleanup;
+
+    if (virNetMessageAddFD(msg, virNetShmChannelGetFD(chan)) < 0 ||
+        virNetServerClientSetShmChannel(client, msg, chan) < 0)
+        goto cleanup;
+
+    /* return 1 here to let virNetServerProgramDispatchCall know
+     * we are passing a FD */
+    rv = 1;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virObjectUnref(chan);
+    return rv;
+}
+
+
 static int
 remoteDispatchDomainOpenGraphics(virNetServerPtr server ATTRIBUTE_UNUSED,
                                  virNetServerClientPtr client ATTRIBUTE_UNUSED,
@@ -6587,6 +6769,161 @@ remoteDispatchConnectGetAllDomainStats(virNetServerPtr server ATTRIBUTE_UNUSED,
 }
 
 
+static int
+remoteDispatchConnectListDomainChanges(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                       virNetServerClientPtr client,
+                                       virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                       virNetMessageErrorPtr rerr,
+                                       remote_connect_list_domain_changes_args *args,
+                                       remote_connect_list_domain_changes_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
+    unsigned long long generation = args->generation;
+    unsigned int maxitems = args->maxitems;
+    virDomainPtr *doms = NULL;
+    char **removed = NULL;
+    size_t nremoved = 0;
+    int ndoms = 0;
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    /* Larger requests are paged by the client */
+    if (maxitems == 0 || maxitems > REMOTE_DOMAIN_LIST_MAX)
+        maxitems = REMOTE_DOMAIN_LIST_MAX;
+
+    if ((ndoms = virConnectListDomainChanges(priv->conn, &generation,
+                                             maxitems, &doms, &removed,
+                                             args->flags)) < 0)
+        goto cleanup;
+
+    nremoved = virStringListLength((const char * const *) removed);
+
+    if (ndoms) {
+        if (VIR_ALLOC_N(ret->domains.domains_val, ndoms) < 0)
+            goto cleanup;
+        ret->domains.domains_len = ndoms;
+        for (i = 0; i < ndoms; i++)
+            make_nonnull_domain(ret->domains.domains_val + i, doms[i]);
+    }
+
+    if (nremoved) {
+        ret->removed.removed_val = removed;
+        ret->removed.removed_len = nremoved;
+        removed = NULL;
+    }
+
+    ret->generation = generation;
+    ret->ret = ndoms;
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virObjectListFreeCount(doms, ndoms);
+    virStringListFree(removed);
+    return rv;
+}
+
+
+struct remoteBatchData {
+    virNetServerPtr server;
+    virNetServerClientPtr client;
+    remote_connect_batch_call *calls;
+    remote_connect_batch_reply *replies;
+};
+
+static void
+remoteDispatchConnectBatchSubmitCall(size_t item,
+                                     void *opaque)
+{
+    struct remoteBatchData *data = opaque;
+    remote_connect_batch_call *call = data->calls + item;
+    remote_connect_batch_reply *reply = data->replies + item;
+    char *buf = NULL;
+    size_t len = 0;
+
+    reply->status = virNetServerProgramDispatchBatchCall(remoteProgram,
+                                                         data->server,
+                                                         data->client,
+                                                         call->proc,
+                                                         call->args.args_val,
+                                                         call->args.args_len,
+                                                         REMOTE_CONNECT_BATCH_DATA_MAX,
+                                                         &buf, &len);
+    reply->data.data_val = buf;
+    reply->data.data_len = len;
+}
+
+
+static int
+remoteDispatchConnectBatchSubmit(virNetServerPtr server,
+                                 virNetServerClientPtr client,
+                                 virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                 virNetMessageErrorPtr rerr,
+                                 remote_connect_batch_submit_args *args,
+                                 remote_connect_batch_submit_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    unsigned int flags = args->flags;
+    struct remoteBatchData data;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    virCheckFlagsGoto(0, cleanup);
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    if (args->calls.calls_len == 0) {
+        rv = 0;
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(ret->replies.replies_val, args->calls.calls_len) < 0)
+        goto cleanup;
+    ret->replies.replies_len = args->calls.calls_len;
+
+    data.server = server;
+    data.client = client;
+    data.calls = args->calls.calls_val;
+    data.replies = ret->replies.replies_val;
+
+    /* Each call takes care of its own access control checks
+     * and errors, just like it would when called on its own */
+    if (virNetServerRunParallel(server, client, args->calls.calls_len,
+                                remoteDispatchConnectBatchSubmitCall,
+                                &data) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ret->replies.replies_len; i++) {
+        if (ret->replies.replies_val[i].status < 0) {
+            virReportError(VIR_ERR_RPC,
+                           _("unable to encode result of call %zu in batch"),
+                           i);
+            goto cleanup;
+        }
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0) {
+        virNetMessageSaveError(rerr);
+        xdr_free((xdrproc_t)xdr_remote_connect_batch_submit_ret, (char *)ret);
+        memset(ret, 0, sizeof(*ret));
+    }
+    return rv;
+}
+
+
 static int
 remoteDispatchNodeAllocPages(virNetServerPtr server ATTRIBUTE_UNUSED,
                              virNetServerClientPtr client,
@@ -6904,6 +7241,120 @@ remoteDispatchStorageVolGetInfoFlags(virNetServerPtr server ATTRIBUTE_UNUSED,
 }
 
 
+static int
+remoteDispatchStorageVolDownload(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                 virNetServerClientPtr client,
+                                 virNetMessagePtr msg,
+                                 virNetMessageErrorPtr rerr,
+                                 remote_storage_vol_download_args *args)
+{
+    int rv = -1;
+    virStorageVolPtr vol = NULL;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+    virStreamPtr st = NULL;
+    daemonClientStreamPtr stream = NULL;
+    const bool sparse = args->flags & VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM;
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    if (!(vol = get_nonnull_storage_vol(priv->conn, args->vol)))
+        goto cleanup;
+
+    if (!(st = virStreamNew(priv->conn, VIR_STREAM_NONBLOCK)))
+        goto cleanup;
+
+    if (!(stream = daemonCreateClientStream(client, st, remoteProgram,
+                                            &msg->header, sparse)))
+        goto cleanup;
+
+    if (daemonReserveVolumeStream(stream) < 0)
+        goto cleanup;
+
+    if (virStorageVolDownload(vol, st, args->offset, args->length,
+                              args->flags) < 0)
+        goto cleanup;
+
+    if (daemonAddClientStream(client, stream, true) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0) {
+        virNetMessageSaveError(rerr);
+        if (stream) {
+            virStreamAbort(st);
+            daemonFreeClientStream(client, stream);
+        } else {
+            virObjectUnref(st);
+        }
+    }
+    virObjectUnref(vol);
+    return rv;
+}
+
+
+static int
+remoteDispatchStorageVolUpload(virNetServerPtr server ATTRIBUTE_UNUSED,
+                               virNetServerClientPtr client,
+                               virNetMessagePtr msg,
+                               virNetMessageErrorPtr rerr,
+                               remote_storage_vol_upload_args *args)
+{
+    int rv = -1;
+    virStorageVolPtr vol = NULL;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+    virStreamPtr st = NULL;
+    daemonClientStreamPtr stream = NULL;
+    const bool sparse = args->flags & VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM;
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    if (!(vol = get_nonnull_storage_vol(priv->conn, args->vol)))
+        goto cleanup;
+
+    if (!(st = virStreamNew(priv->conn, VIR_STREAM_NONBLOCK)))
+        goto cleanup;
+
+    if (!(stream = daemonCreateClientStream(client, st, remoteProgram,
+                                            &msg->header, sparse)))
+        goto cleanup;
+
+    if (daemonReserveVolumeStream(stream) < 0)
+        goto cleanup;
+
+    if (virStorageVolUpload(vol, st, args->offset, args->length,
+                            args->flags) < 0)
+        goto cleanup;
+
+    if (daemonAddClientStream(client, stream, false) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0) {
+        virNetMessageSaveError(rerr);
+        if (stream) {
+            virStreamAbort(st);
+            daemonFreeClientStream(client, stream);
+        } else {
+            virObjectUnref(st);
+        }
+    }
+    virObjectUnref(vol);
+    return rv;
+}
+
+
 /*----- Helpers. -----*/
 
 /* get_nonnull_domain and get_nonnull_network turn an on-wire
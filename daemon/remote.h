@@ -42,4 +42,6 @@ void remoteClientFree(void *data);
 void *remoteClientNew(virNetServerClientPtr client,
                       void *opaque);
 
+virNetServerReplyCachePtr remoteReplyCacheNew(unsigned int timeout);
+
 #endif /* __LIBVIRTD_REMOTE_H__ */
@@ -56,9 +56,17 @@ struct daemonClientStream {
     bool allowSkip;
     size_t dataLen; /* How much data is there remaining until we see a hole */
 
+    bool volume; /* Counted against max_volume_streams */
+
     daemonClientStreamPtr next;
 };
 
+/* Every storage volume transfer has an I/O thread and a file
+ * descriptor of its own, so they are bounded across all clients */
+static virMutex daemonVolumeStreamLock = VIR_MUTEX_INITIALIZER;
+static unsigned int daemonVolumeStreamMax;
+static unsigned int daemonVolumeStreamCount;
+
 static int
 daemonStreamHandleWrite(virNetServerClientPtr client,
                         daemonClientStream *stream);
@@ -356,6 +364,52 @@ daemonCreateClientStream(virNetServerClientPtr client,
     return stream;
 }
 
+/*
+ * @max: the new limit, or 0 for none
+ *
+ * Sets how many storage volume transfers may run at the same time
+ */
+void
+daemonSetMaxVolumeStreams(unsigned int max)
+{
+    virMutexLock(&daemonVolumeStreamLock);
+    daemonVolumeStreamMax = max;
+    virMutexUnlock(&daemonVolumeStreamLock);
+}
+
+
+/*
+ * @stream: a client stream which is not running yet
+ *
+ * Counts @stream as a storage volume transfer until it is freed
+ *
+ * Returns 0 on success, -1 with an error reported if there are too
+ * many volume transfers running already
+ */
+int
+daemonReserveVolumeStream(daemonClientStream *stream)
+{
+    int ret = -1;
+
+    virMutexLock(&daemonVolumeStreamLock);
+    if (daemonVolumeStreamMax &&
+        daemonVolumeStreamCount >= daemonVolumeStreamMax) {
+        virReportError(VIR_ERR_RESOURCE_BUSY,
+                       _("too many storage volume streams, limit is %u"),
+                       daemonVolumeStreamMax);
+        goto cleanup;
+    }
+
+    daemonVolumeStreamCount++;
+    stream->volume = true;
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&daemonVolumeStreamLock);
+    return ret;
+}
+
+
 /*
  * @stream: an unused client stream
  *
@@ -380,6 +434,12 @@ int daemonFreeClientStream(virNetServerClientPtr client,
 
     virObjectUnref(stream->prog);
 
+    if (stream->volume) {
+        virMutexLock(&daemonVolumeStreamLock);
+        daemonVolumeStreamCount--;
+        virMutexUnlock(&daemonVolumeStreamLock);
+    }
+
     msg = stream->rx;
     while (msg) {
         virNetMessagePtr tmp = msg->next;
@@ -906,12 +966,12 @@ daemonStreamHandleRead(virNetServerClientPtr client,
         msg->cb = daemonStreamMessageFinished;
         msg->opaque = stream;
         stream->refs++;
-        if (virNetServerProgramSendStreamData(remoteProgram,
-                                              client,
-                                              msg,
-                                              stream->procedure,
-                                              stream->serial,
-                                              buffer, rv) < 0)
+        if (virNetServerProgramSendStreamBuffer(remoteProgram,
+                                                client,
+                                                msg,
+                                                stream->procedure,
+                                                stream->serial,
+                                                &buffer, rv) < 0)
             goto cleanup;
         msg = NULL;
     }
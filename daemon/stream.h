@@ -36,6 +36,10 @@ daemonCreateClientStream(virNetServerClientPtr client,
 int daemonFreeClientStream(virNetServerClientPtr client,
                            daemonClientStream *stream);
 
+void daemonSetMaxVolumeStreams(unsigned int max);
+
+int daemonReserveVolumeStream(daemonClientStream *stream);
+
 int daemonAddClientStream(virNetServerClientPtr client,
                           daemonClientStream *stream,
                           bool transmit);
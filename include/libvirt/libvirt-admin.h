@@ -189,6 +189,53 @@ virAdmServerPtr virAdmConnectLookupServer(virAdmConnectPtr conn,
 
 # define VIR_THREADPOOL_JOB_QUEUE_DEPTH "jobQueueDepth"
 
+/**
+ * VIR_THREADPOOL_TARGET_LATENCY:
+ * Macro for the threadpool targetLatency attribute: represents how long in
+ * microseconds jobs may wait for a worker before the threadpool adds
+ * workers, as VIR_TYPED_PARAM_UINT. Idle workers are removed again once jobs
+ * wait less than half of that. When set to 0, a worker is added whenever
+ * a job arrives with no worker free, and workers are never removed.
+ */
+
+# define VIR_THREADPOOL_TARGET_LATENCY "targetLatency"
+
+/**
+ * VIR_THREADPOOL_QUEUE_LATENCY:
+ * Macro for the threadpool queueLatency attribute: represents the average
+ * time in microseconds recent jobs waited for a worker, as
+ * VIR_TYPED_PARAM_UINT.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_QUEUE_LATENCY "queueLatency"
+
+/**
+ * VIR_THREADPOOL_WORKERS_ADDED:
+ * Macro for the threadpool workersAdded attribute: represents the number of
+ * workers added because jobs waited longer than VIR_THREADPOOL_TARGET_LATENCY,
+ * as VIR_TYPED_PARAM_UINT.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_WORKERS_ADDED "workersAdded"
+
+/**
+ * VIR_THREADPOOL_WORKERS_REMOVED:
+ * Macro for the threadpool workersRemoved attribute: represents the number of
+ * idle workers removed while VIR_THREADPOOL_TARGET_LATENCY was set, as
+ * VIR_TYPED_PARAM_UINT.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_WORKERS_REMOVED "workersRemoved"
+
 /* Tunables for a server workerpool */
 int virAdmServerGetThreadPoolParameters(virAdmServerPtr srv,
                                         virTypedParameterPtr *params,
@@ -345,6 +392,107 @@ virAdmServerLookupClient(virAdmServerPtr srv,
 
 # define VIR_CLIENT_INFO_SELINUX_CONTEXT "selinux_context"
 
+/**
+ * VIR_CLIENT_INFO_JOBS_WEIGHT:
+ * Macro represents the client's share of the server's worker threads
+ * relative to other clients with calls waiting for a worker,
+ * as VIR_TYPED_PARAM_UINT.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_JOBS_WEIGHT "jobs_weight"
+
+/**
+ * VIR_CLIENT_INFO_JOBS_QUEUED:
+ * Macro represents the number of the client's calls currently waiting for
+ * a worker thread, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_JOBS_QUEUED "jobs_queued"
+
+/**
+ * VIR_CLIENT_INFO_JOBS_RUNNING:
+ * Macro represents the number of the client's calls currently being
+ * processed by a worker thread, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_JOBS_RUNNING "jobs_running"
+
+/**
+ * VIR_CLIENT_INFO_JOBS_TOTAL:
+ * Macro represents the number of the client's calls picked up by a worker
+ * thread so far, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_JOBS_TOTAL "jobs_total"
+
+/**
+ * VIR_CLIENT_INFO_JOBS_WAIT_TIME:
+ * Macro represents the total time in microseconds the client's calls spent
+ * waiting for a worker thread, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_JOBS_WAIT_TIME "jobs_wait_time"
+
+/**
+ * VIR_CLIENT_INFO_TX_MESSAGES:
+ * Macro represents the number of messages currently waiting to be sent to
+ * the client, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_TX_MESSAGES "tx_messages"
+
+/**
+ * VIR_CLIENT_INFO_TX_BYTES:
+ * Macro represents the size in bytes of the messages currently waiting to
+ * be sent to the client, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_TX_BYTES "tx_bytes"
+
+/**
+ * VIR_CLIENT_INFO_TX_COALESCED:
+ * Macro represents the number of events which replaced an older event of
+ * the same kind still waiting to be sent to the client, because the client
+ * reached its transmit limits, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_TX_COALESCED "tx_coalesced"
+
+/**
+ * VIR_CLIENT_INFO_TX_DROPPED:
+ * Macro represents the number of events not sent to the client because it
+ * reached its transmit limits, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_TX_DROPPED "tx_dropped"
+
 int virAdmClientGetInfo(virAdmClientPtr client,
                         virTypedParameterPtr *params,
                         int *nparams,
@@ -394,6 +542,53 @@ int virAdmClientClose(virAdmClientPtr client, unsigned int flags);
 
 # define VIR_SERVER_CLIENTS_UNAUTH_CURRENT "nclients_unauth"
 
+/**
+ * VIR_SERVER_CLIENTS_TX_MESSAGES_MAX:
+ * Macro for per-server tx_messages_max limit: represents the upper limit to
+ * number of messages waiting to be sent to each client, 0 if unlimited, as
+ * VIR_TYPED_PARAM_UINT. A client reaching it gets high rate events, such as
+ * balloon changes, coalesced or dropped, and is disconnected if that is not
+ * enough.
+ */
+
+# define VIR_SERVER_CLIENTS_TX_MESSAGES_MAX "tx_messages_max"
+
+/**
+ * VIR_SERVER_CLIENTS_TX_BYTES_MAX:
+ * Macro for per-server tx_bytes_max limit: represents the upper limit to
+ * size in bytes of messages waiting to be sent to each client, 0 if
+ * unlimited, as VIR_TYPED_PARAM_UINT. It is enforced the same way as
+ * VIR_SERVER_CLIENTS_TX_MESSAGES_MAX.
+ */
+
+# define VIR_SERVER_CLIENTS_TX_BYTES_MAX "tx_bytes_max"
+
+/**
+ * VIR_SERVER_CLIENTS_TLS_HANDSHAKES_FULL:
+ * Macro for per-server tls_handshakes_full attribute: represents the number
+ * of TLS handshakes completed by clients which had to go through the whole
+ * key exchange and certificate verification, as VIR_TYPED_PARAM_ULLONG.
+ * Only reported by servers accepting TLS connections.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_SERVER_CLIENTS_TLS_HANDSHAKES_FULL "tls_handshakes_full"
+
+/**
+ * VIR_SERVER_CLIENTS_TLS_HANDSHAKES_RESUMED:
+ * Macro for per-server tls_handshakes_resumed attribute: represents the
+ * number of TLS handshakes completed by clients resuming an earlier session
+ * with a session ticket, as VIR_TYPED_PARAM_ULLONG. Only reported by servers
+ * accepting TLS connections.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_SERVER_CLIENTS_TLS_HANDSHAKES_RESUMED "tls_handshakes_resumed"
+
 int virAdmServerGetClientLimits(virAdmServerPtr srv,
                                 virTypedParameterPtr *params,
                                 int *nparams,
@@ -404,6 +599,211 @@ int virAdmServerSetClientLimits(virAdmServerPtr srv,
                                 int nparams,
                                 unsigned int flags);
 
+/* Manage the RPC message pool */
+
+/**
+ * VIR_MESSAGE_POOL_BYTES_MAX:
+ * Macro for the message pool maxBytes limit: represents the upper limit to
+ * memory held by cached message buffers, as VIR_TYPED_PARAM_ULLONG.
+ */
+
+# define VIR_MESSAGE_POOL_BYTES_MAX "maxBytes"
+
+/**
+ * VIR_MESSAGE_POOL_BYTES_CURRENT:
+ * Macro for the message pool bytes attribute: represents the memory currently
+ * held by cached message buffers, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_MESSAGE_POOL_BYTES_CURRENT "bytes"
+
+/**
+ * VIR_MESSAGE_POOL_MESSAGES_MAX:
+ * Macro for the message pool maxMessages limit: represents the upper limit to
+ * number of cached message objects, as VIR_TYPED_PARAM_UINT.
+ */
+
+# define VIR_MESSAGE_POOL_MESSAGES_MAX "maxMessages"
+
+/**
+ * VIR_MESSAGE_POOL_MESSAGES_CURRENT:
+ * Macro for the message pool messages attribute: represents the current
+ * number of cached message objects, as VIR_TYPED_PARAM_UINT.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_MESSAGE_POOL_MESSAGES_CURRENT "messages"
+
+/**
+ * VIR_MESSAGE_POOL_BUFFER_HITS:
+ * Macro for the message pool bufferHits counter: represents the number of
+ * message buffers served from the pool, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_MESSAGE_POOL_BUFFER_HITS "bufferHits"
+
+/**
+ * VIR_MESSAGE_POOL_BUFFER_MISSES:
+ * Macro for the message pool bufferMisses counter: represents the number of
+ * pool sized message buffers which had to be allocated, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_MESSAGE_POOL_BUFFER_MISSES "bufferMisses"
+
+/**
+ * VIR_MESSAGE_POOL_MESSAGE_HITS:
+ * Macro for the message pool messageHits counter: represents the number of
+ * message objects served from the pool, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_MESSAGE_POOL_MESSAGE_HITS "messageHits"
+
+/**
+ * VIR_MESSAGE_POOL_MESSAGE_MISSES:
+ * Macro for the message pool messageMisses counter: represents the number of
+ * message objects which had to be allocated, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_MESSAGE_POOL_MESSAGE_MISSES "messageMisses"
+
+int virAdmServerGetMessagePoolParameters(virAdmServerPtr srv,
+                                         virTypedParameterPtr *params,
+                                         int *nparams,
+                                         unsigned int flags);
+
+int virAdmServerSetMessagePoolParameters(virAdmServerPtr srv,
+                                         virTypedParameterPtr params,
+                                         int nparams,
+                                         unsigned int flags);
+
+/* Manage compression of RPC replies */
+
+/**
+ * VIR_COMPRESSION_THRESHOLD:
+ * Macro for the compression threshold: represents the smallest reply payload
+ * in bytes which is sent compressed to clients supporting it, 0 meaning
+ * compression is disabled, as VIR_TYPED_PARAM_UINT.
+ */
+
+# define VIR_COMPRESSION_THRESHOLD "threshold"
+
+/**
+ * VIR_COMPRESSION_MESSAGES:
+ * Macro for the compression messages counter: represents the number of
+ * replies sent compressed, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_COMPRESSION_MESSAGES "messages"
+
+/**
+ * VIR_COMPRESSION_SKIPPED:
+ * Macro for the compression skipped counter: represents the number of
+ * replies above the threshold which were sent uncompressed because they did
+ * not compress well enough, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_COMPRESSION_SKIPPED "skipped"
+
+/**
+ * VIR_COMPRESSION_BYTES_IN:
+ * Macro for the compression bytesIn counter: represents the total size of
+ * reply payloads sent compressed, before compression, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_COMPRESSION_BYTES_IN "bytesIn"
+
+/**
+ * VIR_COMPRESSION_BYTES_OUT:
+ * Macro for the compression bytesOut counter: represents the total size of
+ * reply payloads sent compressed, after compression, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_COMPRESSION_BYTES_OUT "bytesOut"
+
+/**
+ * VIR_COMPRESSION_TIME:
+ * Macro for the compression time counter: represents the CPU time spent
+ * compressing replies in nanoseconds, including replies which ended up being
+ * sent uncompressed, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_COMPRESSION_TIME "time"
+
+int virAdmServerGetCompressionParameters(virAdmServerPtr srv,
+                                         virTypedParameterPtr *params,
+                                         int *nparams,
+                                         unsigned int flags);
+
+int virAdmServerSetCompressionParameters(virAdmServerPtr srv,
+                                         virTypedParameterPtr params,
+                                         int nparams,
+                                         unsigned int flags);
+
+/* Statistics of RPC calls */
+
+/**
+ * VIR_CALL_STATS_COUNT:
+ * Macro for the number of procedures reported by
+ * virAdmServerGetCallStats, as VIR_TYPED_PARAM_UINT. The statistics of
+ * each of them are reported under the "call.<num>." prefix, where <num>
+ * counts from 0 to this value - 1.
+ */
+
+# define VIR_CALL_STATS_COUNT "call.count"
+
+/**
+ * VIR_CALL_STATS_BUCKETS:
+ * Macro for the number of buckets of the latency histograms reported by
+ * virAdmServerGetCallStats, as VIR_TYPED_PARAM_UINT.
+ */
+
+# define VIR_CALL_STATS_BUCKETS "bucket.count"
+
+typedef enum {
+    VIR_ADMIN_SERVER_CALL_STATS_RESET = (1 << 0), /* clear the statistics
+                                                     after reading them */
+} virAdmServerGetCallStatsFlags;
+
+int virAdmServerGetCallStats(virAdmServerPtr srv,
+                             virTypedParameterPtr *params,
+                             int *nparams,
+                             unsigned int flags);
+
 int virAdmConnectGetLoggingOutputs(virAdmConnectPtr conn,
                                    char **outputs,
                                    unsigned int flags);
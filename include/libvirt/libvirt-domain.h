@@ -1789,6 +1789,12 @@ typedef enum {
 int                     virConnectListAllDomains (virConnectPtr conn,
                                                   virDomainPtr **domains,
                                                   unsigned int flags);
+int                     virConnectListDomainChanges(virConnectPtr conn,
+                                                    unsigned long long *generation,
+                                                    unsigned int maxitems,
+                                                    virDomainPtr **domains,
+                                                    char ***removed,
+                                                    unsigned int flags);
 int                     virDomainCreate         (virDomainPtr domain);
 int                     virDomainCreateWithFlags (virDomainPtr domain,
                                                   unsigned int flags);
@@ -4756,4 +4762,112 @@ int virDomainSetLifecycleAction(virDomainPtr domain,
                                 unsigned int action,
                                 unsigned int flags);
 
+/**
+ * virConnectBatch:
+ *
+ * a virConnectBatch is a private structure representing a list of
+ * read-only calls which are submitted to the hypervisor together.
+ */
+typedef struct _virConnectBatch virConnectBatch;
+
+/**
+ * virConnectBatchPtr:
+ *
+ * a virConnectBatchPtr is pointer to a virConnectBatch private structure,
+ * this is the type used to reference a batch of calls in the API.
+ */
+typedef virConnectBatch *virConnectBatchPtr;
+
+virConnectBatchPtr virConnectBatchNew(virConnectPtr conn,
+                                      unsigned int flags);
+int virConnectBatchFree(virConnectBatchPtr batch);
+
+int virConnectBatchAddDomainGetInfo(virConnectBatchPtr batch,
+                                    virDomainPtr domain,
+                                    virDomainInfoPtr info);
+int virConnectBatchAddDomainGetState(virConnectBatchPtr batch,
+                                     virDomainPtr domain,
+                                     int *state,
+                                     int *reason,
+                                     unsigned int flags);
+int virConnectBatchAddDomainGetBlockInfo(virConnectBatchPtr batch,
+                                         virDomainPtr domain,
+                                         const char *disk,
+                                         virDomainBlockInfoPtr info,
+                                         unsigned int flags);
+
+int virConnectBatchSubmit(virConnectBatchPtr batch,
+                          unsigned int flags);
+int virConnectBatchGetResult(virConnectBatchPtr batch,
+                             int call);
+
+/**
+ * virDomainGetInfoCallback:
+ * @domain: the domain the call was made for
+ * @ret: 0 on success, -1 on failure
+ * @info: the domain information, only valid if @ret is 0
+ * @opaque: user data registered with the call
+ *
+ * Callback invoked when a call submitted by virDomainGetInfoAsync
+ * completes. On failure, the error can be obtained with
+ * virGetLastError(). @info is only valid during the callback.
+ */
+typedef void (*virDomainGetInfoCallback)(virDomainPtr domain,
+                                         int ret,
+                                         virDomainInfoPtr info,
+                                         void *opaque);
+
+int virDomainGetInfoAsync(virDomainPtr domain,
+                          virDomainGetInfoCallback cb,
+                          void *opaque,
+                          virFreeCallback freecb,
+                          unsigned int flags);
+
+/**
+ * virDomainMemoryStatsCallback:
+ * @domain: the domain the call was made for
+ * @nr_stats: the number of statistics, or -1 on failure
+ * @stats: the statistics, only valid if @nr_stats is not -1
+ * @opaque: user data registered with the call
+ *
+ * Callback invoked when a call submitted by virDomainMemoryStatsAsync
+ * completes. On failure, the error can be obtained with
+ * virGetLastError(). @stats is only valid during the callback.
+ */
+typedef void (*virDomainMemoryStatsCallback)(virDomainPtr domain,
+                                             int nr_stats,
+                                             virDomainMemoryStatPtr stats,
+                                             void *opaque);
+
+int virDomainMemoryStatsAsync(virDomainPtr domain,
+                              unsigned int nr_stats,
+                              virDomainMemoryStatsCallback cb,
+                              void *opaque,
+                              virFreeCallback freecb,
+                              unsigned int flags);
+
+/**
+ * virDomainListGetStatsCallback:
+ * @conn: the connection the call was made on
+ * @nrecords: the number of records, or -1 on failure
+ * @records: NULL terminated array of statistics records
+ * @opaque: user data registered with the call
+ *
+ * Callback invoked when a call submitted by virDomainListGetStatsAsync
+ * completes. On failure, the error can be obtained with
+ * virGetLastError(). The callback owns @records and must free them
+ * with virDomainStatsRecordListFree.
+ */
+typedef void (*virDomainListGetStatsCallback)(virConnectPtr conn,
+                                              int nrecords,
+                                              virDomainStatsRecordPtr *records,
+                                              void *opaque);
+
+int virDomainListGetStatsAsync(virDomainPtr *doms,
+                               unsigned int stats,
+                               virDomainListGetStatsCallback cb,
+                               void *opaque,
+                               virFreeCallback freecb,
+                               unsigned int flags);
+
 #endif /* __VIR_LIBVIRT_DOMAIN_H__ */
@@ -358,8 +358,16 @@ int                     virStorageVolDownload           (virStorageVolPtr vol,
                                                          unsigned long long offset,
                                                          unsigned long long length,
                                                          unsigned int flags);
+int                     virStorageVolDownloadRanges     (virStorageVolPtr vol,
+                                                         unsigned int nranges,
+                                                         virStreamPtr *streams,
+                                                         const unsigned long long *offsets,
+                                                         const unsigned long long *lengths,
+                                                         unsigned int flags);
 typedef enum {
     VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM = 1 << 0,  /* Use sparse stream */
+    VIR_STORAGE_VOL_UPLOAD_RANGE = 1 << 1,  /* Leave the rest of the
+                                               volume untouched */
 } virStorageVolUploadFlags;
 
 int                     virStorageVolUpload             (virStorageVolPtr vol,
@@ -367,6 +375,12 @@ int                     virStorageVolUpload             (virStorageVolPtr vol,
                                                          unsigned long long offset,
                                                          unsigned long long length,
                                                          unsigned int flags);
+int                     virStorageVolUploadRanges       (virStorageVolPtr vol,
+                                                         unsigned int nranges,
+                                                         virStreamPtr *streams,
+                                                         const unsigned long long *offsets,
+                                                         const unsigned long long *lengths,
+                                                         unsigned int flags);
 int                     virStorageVolDelete             (virStorageVolPtr vol,
                                                          unsigned int flags);
 int                     virStorageVolWipe               (virStorageVolPtr vol,
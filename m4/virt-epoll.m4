@@ -0,0 +1,46 @@
+dnl The epoll event loop backend
+dnl
+dnl Copyright (C) 2018 Red Hat, Inc.
+dnl
+dnl This library is free software; you can redistribute it and/or
+dnl modify it under the terms of the GNU Lesser General Public
+dnl License as published by the Free Software Foundation; either
+dnl version 2.1 of the License, or (at your option) any later version.
+dnl
+dnl This library is distributed in the hope that it will be useful,
+dnl but WITHOUT ANY WARRANTY; without even the implied warranty of
+dnl MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+dnl Lesser General Public License for more details.
+dnl
+dnl You should have received a copy of the GNU Lesser General Public
+dnl License along with this library.  If not, see
+dnl <http://www.gnu.org/licenses/>.
+dnl
+
+AC_DEFUN([LIBVIRT_ARG_EPOLL], [
+  LIBVIRT_ARG_WITH([EPOLL], [use epoll for the default event loop], [check])
+])
+
+AC_DEFUN([LIBVIRT_CHECK_EPOLL], [
+  AC_MSG_CHECKING([whether to compile with epoll event loop support])
+  if test "$with_epoll" != "no" ; then
+    AC_TRY_COMPILE([ #include <sys/epoll.h> ],
+                   [ int fd = epoll_create1(EPOLL_CLOEXEC);
+                     struct epoll_event ev = { .events = EPOLLIN };
+                     return epoll_ctl(fd, EPOLL_CTL_ADD, 0, &ev); ],
+                   [ with_epoll=yes ],
+                   [ if test "$with_epoll" = "yes" ; then
+                       AC_MSG_ERROR([epoll is not available on this platform])
+                     fi
+                     with_epoll=no ])
+    if test "$with_epoll" = "yes" ; then
+      AC_DEFINE_UNQUOTED([WITH_EPOLL], 1, [whether epoll event loop support is enabled])
+    fi
+  fi
+  AM_CONDITIONAL([WITH_EPOLL], [test "$with_epoll" = "yes"])
+  AC_MSG_RESULT([$with_epoll])
+])
+
+AC_DEFUN([LIBVIRT_RESULT_EPOLL], [
+  LIBVIRT_RESULT([epoll], [$with_epoll])
+])
@@ -48,6 +48,15 @@ const ADMIN_CLIENT_INFO_PARAMETERS_MAX = 64;
 /* Upper limit on number of client processing controls */
 const ADMIN_SERVER_CLIENT_LIMITS_MAX = 32;
 
+/* Upper limit on number of message pool parameters */
+const ADMIN_SERVER_MESSAGE_POOL_PARAMETERS_MAX = 32;
+
+/* Upper limit on number of compression parameters */
+const ADMIN_SERVER_COMPRESSION_PARAMETERS_MAX = 32;
+
+/* Upper limit on number of call statistics parameters */
+const ADMIN_SERVER_CALL_STATS_MAX = 65536;
+
 /* A long string, which may NOT be NULL. */
 typedef string admin_nonnull_string<ADMIN_STRING_MAX>;
 
@@ -183,6 +192,45 @@ struct admin_server_set_client_limits_args {
     unsigned int flags;
 };
 
+struct admin_server_get_message_pool_parameters_args {
+    admin_nonnull_server srv;
+    unsigned int flags;
+};
+
+struct admin_server_get_message_pool_parameters_ret {
+    admin_typed_param params<ADMIN_SERVER_MESSAGE_POOL_PARAMETERS_MAX>;
+};
+
+struct admin_server_set_message_pool_parameters_args {
+    admin_nonnull_server srv;
+    admin_typed_param params<ADMIN_SERVER_MESSAGE_POOL_PARAMETERS_MAX>;
+    unsigned int flags;
+};
+
+struct admin_server_get_compression_parameters_args {
+    admin_nonnull_server srv;
+    unsigned int flags;
+};
+
+struct admin_server_get_compression_parameters_ret {
+    admin_typed_param params<ADMIN_SERVER_COMPRESSION_PARAMETERS_MAX>;
+};
+
+struct admin_server_set_compression_parameters_args {
+    admin_nonnull_server srv;
+    admin_typed_param params<ADMIN_SERVER_COMPRESSION_PARAMETERS_MAX>;
+    unsigned int flags;
+};
+
+struct admin_server_get_call_stats_args {
+    admin_nonnull_server srv;
+    unsigned int flags;
+};
+
+struct admin_server_get_call_stats_ret {
+    admin_typed_param params<ADMIN_SERVER_CALL_STATS_MAX>;
+};
+
 struct admin_connect_get_logging_outputs_args {
     unsigned int flags;
 };
@@ -316,5 +364,30 @@ enum admin_procedure {
     /**
      * @generate: both
      */
-    ADMIN_PROC_CONNECT_SET_LOGGING_FILTERS = 17
+    ADMIN_PROC_CONNECT_SET_LOGGING_FILTERS = 17,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_SERVER_GET_MESSAGE_POOL_PARAMETERS = 18,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_SERVER_SET_MESSAGE_POOL_PARAMETERS = 19,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_SERVER_GET_COMPRESSION_PARAMETERS = 20,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_SERVER_SET_COMPRESSION_PARAMETERS = 21,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_SERVER_GET_CALL_STATS = 22
 };
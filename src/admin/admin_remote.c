@@ -426,6 +426,193 @@ remoteAdminServerSetClientLimits(virAdmServerPtr srv,
     return rv;
 }
 
+static int
+remoteAdminServerGetMessagePoolParameters(virAdmServerPtr srv,
+                                          virTypedParameterPtr *params,
+                                          int *nparams,
+                                          unsigned int flags)
+{
+    int rv = -1;
+    admin_server_get_message_pool_parameters_args args;
+    admin_server_get_message_pool_parameters_ret ret;
+    remoteAdminPrivPtr priv = srv->conn->privateData;
+    args.flags = flags;
+    make_nonnull_server(&args.srv, srv);
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(srv->conn, 0, ADMIN_PROC_SERVER_GET_MESSAGE_POOL_PARAMETERS,
+             (xdrproc_t) xdr_admin_server_get_message_pool_parameters_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_server_get_message_pool_parameters_ret,
+             (char *) &ret) == -1)
+        goto cleanup;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_SERVER_MESSAGE_POOL_PARAMETERS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+    xdr_free((xdrproc_t) xdr_admin_server_get_message_pool_parameters_ret,
+             (char *) &ret);
+
+ cleanup:
+    virObjectUnlock(priv);
+    return rv;
+}
+
+static int
+remoteAdminServerSetMessagePoolParameters(virAdmServerPtr srv,
+                                          virTypedParameterPtr params,
+                                          int nparams,
+                                          unsigned int flags)
+{
+    int rv = -1;
+    admin_server_set_message_pool_parameters_args args;
+    remoteAdminPrivPtr priv = srv->conn->privateData;
+
+    args.flags = flags;
+    make_nonnull_server(&args.srv, srv);
+
+    virObjectLock(priv);
+
+    if (virTypedParamsSerialize(params, nparams,
+                                (virTypedParameterRemotePtr *) &args.params.params_val,
+                                &args.params.params_len,
+                                0) < 0)
+        goto cleanup;
+
+    if (call(srv->conn, 0, ADMIN_PROC_SERVER_SET_MESSAGE_POOL_PARAMETERS,
+             (xdrproc_t) xdr_admin_server_set_message_pool_parameters_args,
+             (char *) &args,
+             (xdrproc_t) xdr_void, (char *) NULL) == -1)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    virTypedParamsRemoteFree((virTypedParameterRemotePtr) args.params.params_val,
+                             args.params.params_len);
+    virObjectUnlock(priv);
+    return rv;
+}
+
+static int
+remoteAdminServerGetCompressionParameters(virAdmServerPtr srv,
+                                          virTypedParameterPtr *params,
+                                          int *nparams,
+                                          unsigned int flags)
+{
+    int rv = -1;
+    admin_server_get_compression_parameters_args args;
+    admin_server_get_compression_parameters_ret ret;
+    remoteAdminPrivPtr priv = srv->conn->privateData;
+    args.flags = flags;
+    make_nonnull_server(&args.srv, srv);
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(srv->conn, 0, ADMIN_PROC_SERVER_GET_COMPRESSION_PARAMETERS,
+             (xdrproc_t) xdr_admin_server_get_compression_parameters_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_server_get_compression_parameters_ret,
+             (char *) &ret) == -1)
+        goto cleanup;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_SERVER_COMPRESSION_PARAMETERS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+    xdr_free((xdrproc_t) xdr_admin_server_get_compression_parameters_ret,
+             (char *) &ret);
+
+ cleanup:
+    virObjectUnlock(priv);
+    return rv;
+}
+
+static int
+remoteAdminServerSetCompressionParameters(virAdmServerPtr srv,
+                                          virTypedParameterPtr params,
+                                          int nparams,
+                                          unsigned int flags)
+{
+    int rv = -1;
+    admin_server_set_compression_parameters_args args;
+    remoteAdminPrivPtr priv = srv->conn->privateData;
+
+    args.flags = flags;
+    make_nonnull_server(&args.srv, srv);
+
+    virObjectLock(priv);
+
+    if (virTypedParamsSerialize(params, nparams,
+                                (virTypedParameterRemotePtr *) &args.params.params_val,
+                                &args.params.params_len,
+                                0) < 0)
+        goto cleanup;
+
+    if (call(srv->conn, 0, ADMIN_PROC_SERVER_SET_COMPRESSION_PARAMETERS,
+             (xdrproc_t) xdr_admin_server_set_compression_parameters_args,
+             (char *) &args,
+             (xdrproc_t) xdr_void, (char *) NULL) == -1)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    virTypedParamsRemoteFree((virTypedParameterRemotePtr) args.params.params_val,
+                             args.params.params_len);
+    virObjectUnlock(priv);
+    return rv;
+}
+
+static int
+remoteAdminServerGetCallStats(virAdmServerPtr srv,
+                              virTypedParameterPtr *params,
+                              int *nparams,
+                              unsigned int flags)
+{
+    int rv = -1;
+    admin_server_get_call_stats_args args;
+    admin_server_get_call_stats_ret ret;
+    remoteAdminPrivPtr priv = srv->conn->privateData;
+    args.flags = flags;
+    make_nonnull_server(&args.srv, srv);
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(srv->conn, 0, ADMIN_PROC_SERVER_GET_CALL_STATS,
+             (xdrproc_t) xdr_admin_server_get_call_stats_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_server_get_call_stats_ret,
+             (char *) &ret) == -1)
+        goto cleanup;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_SERVER_CALL_STATS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+    xdr_free((xdrproc_t) xdr_admin_server_get_call_stats_ret,
+             (char *) &ret);
+
+ cleanup:
+    virObjectUnlock(priv);
+    return rv;
+}
+
 static int
 remoteAdminConnectGetLoggingOutputs(virAdmConnectPtr conn,
                                     char **outputs,
@@ -30,6 +30,7 @@
 #include "viridentity.h"
 #include "virlog.h"
 #include "rpc/virnetdaemon.h"
+#include "rpc/virnetmessage.h"
 #include "rpc/virnetserver.h"
 #include "virstring.h"
 #include "virthreadpool.h"
@@ -86,6 +87,10 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
     size_t freeWorkers;
     size_t nPrioWorkers;
     size_t jobQueueDepth;
+    unsigned long long targetLatency;
+    unsigned long long latency;
+    size_t workersAdded;
+    size_t workersRemoved;
     virTypedParameterPtr tmpparams = NULL;
 
     virCheckFlags(0, -1);
@@ -93,7 +98,10 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
     if (virNetServerGetThreadPoolParameters(srv, &minWorkers, &maxWorkers,
                                             &nWorkers, &freeWorkers,
                                             &nPrioWorkers,
-                                            &jobQueueDepth) < 0) {
+                                            &jobQueueDepth,
+                                            &targetLatency, &latency,
+                                            &workersAdded,
+                                            &workersRemoved) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Unable to retrieve threadpool parameters"));
         goto cleanup;
@@ -129,6 +137,26 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
                               jobQueueDepth) < 0)
         goto cleanup;
 
+    if (virTypedParamsAddUInt(&tmpparams, nparams,
+                              &maxparams, VIR_THREADPOOL_TARGET_LATENCY,
+                              targetLatency) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams,
+                              &maxparams, VIR_THREADPOOL_QUEUE_LATENCY,
+                              MIN(latency, UINT_MAX)) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams,
+                              &maxparams, VIR_THREADPOOL_WORKERS_ADDED,
+                              workersAdded) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams,
+                              &maxparams, VIR_THREADPOOL_WORKERS_REMOVED,
+                              workersRemoved) < 0)
+        goto cleanup;
+
     *params = tmpparams;
     tmpparams = NULL;
     ret = 0;
@@ -147,6 +175,7 @@ adminServerSetThreadPoolParameters(virNetServerPtr srv,
     long long int minWorkers = -1;
     long long int maxWorkers = -1;
     long long int prioWorkers = -1;
+    long long int targetLatency = -1;
     virTypedParameterPtr param = NULL;
 
     virCheckFlags(0, -1);
@@ -158,6 +187,8 @@ adminServerSetThreadPoolParameters(virNetServerPtr srv,
                                VIR_TYPED_PARAM_UINT,
                                VIR_THREADPOOL_WORKERS_PRIORITY,
                                VIR_TYPED_PARAM_UINT,
+                               VIR_THREADPOOL_TARGET_LATENCY,
+                               VIR_TYPED_PARAM_UINT,
                                NULL) < 0)
         return -1;
 
@@ -173,8 +204,13 @@ adminServerSetThreadPoolParameters(virNetServerPtr srv,
                                    VIR_THREADPOOL_WORKERS_PRIORITY)))
         prioWorkers = param->value.ui;
 
+    if ((param = virTypedParamsGet(params, nparams,
+                                   VIR_THREADPOOL_TARGET_LATENCY)))
+        targetLatency = param->value.ui;
+
     if (virNetServerSetThreadPoolParameters(srv, minWorkers,
-                                            maxWorkers, prioWorkers) < 0)
+                                            maxWorkers, prioWorkers,
+                                            targetLatency) < 0)
         return -1;
 
     return 0;
@@ -213,7 +249,8 @@ adminServerLookupClient(virNetServerPtr srv,
 }
 
 int
-adminClientGetInfo(virNetServerClientPtr client,
+adminClientGetInfo(virNetServerPtr srv,
+                   virNetServerClientPtr client,
                    virTypedParameterPtr *params,
                    int *nparams,
                    unsigned int flags)
@@ -221,6 +258,8 @@ adminClientGetInfo(virNetServerClientPtr client,
     int ret = -1;
     int maxparams = 0;
     bool readonly;
+    virThreadPoolOwnerStats jobs;
+    virNetServerClientTxStats tx;
     char *sock_addr = NULL;
     const char *attr = NULL;
     virTypedParameterPtr tmpparams = NULL;
@@ -294,6 +333,41 @@ adminClientGetInfo(virNetServerClientPtr client,
                                 VIR_CLIENT_INFO_SELINUX_CONTEXT, attr) < 0))
         goto cleanup;
 
+    virNetServerGetClientJobStats(srv, client, &jobs);
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams, &maxparams,
+                              VIR_CLIENT_INFO_JOBS_WEIGHT,
+                              jobs.weight) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_CLIENT_INFO_JOBS_QUEUED,
+                                jobs.queued) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_CLIENT_INFO_JOBS_RUNNING,
+                                jobs.running) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_CLIENT_INFO_JOBS_TOTAL,
+                                jobs.jobs) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_CLIENT_INFO_JOBS_WAIT_TIME,
+                                jobs.waitTime) < 0)
+        goto cleanup;
+
+    virNetServerClientGetTxStats(client, &tx);
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_CLIENT_INFO_TX_MESSAGES,
+                                tx.messages) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_CLIENT_INFO_TX_BYTES,
+                                tx.bytes) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_CLIENT_INFO_TX_COALESCED,
+                                tx.coalesced) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_CLIENT_INFO_TX_DROPPED,
+                                tx.dropped) < 0)
+        goto cleanup;
+
     *params = tmpparams;
     tmpparams = NULL;
     ret = 0;
@@ -322,6 +396,12 @@ adminServerGetClientLimits(virNetServerPtr srv,
     int ret = -1;
     int maxparams = 0;
     virTypedParameterPtr tmpparams = NULL;
+    size_t txMaxMessages;
+    size_t txMaxBytes;
+#ifdef WITH_GNUTLS
+    unsigned long long tlsFull;
+    unsigned long long tlsResumed;
+#endif
 
     virCheckFlags(0, -1);
 
@@ -345,6 +425,29 @@ adminServerGetClientLimits(virNetServerPtr srv,
                               virNetServerGetCurrentUnauthClients(srv)) < 0)
         goto cleanup;
 
+    virNetServerGetClientTxLimits(srv, &txMaxMessages, &txMaxBytes);
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams, &maxparams,
+                              VIR_SERVER_CLIENTS_TX_MESSAGES_MAX,
+                              txMaxMessages) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams, &maxparams,
+                              VIR_SERVER_CLIENTS_TX_BYTES_MAX,
+                              txMaxBytes) < 0)
+        goto cleanup;
+
+#ifdef WITH_GNUTLS
+    if (virNetServerGetTLSHandshakeStats(srv, &tlsFull, &tlsResumed) &&
+        (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                 VIR_SERVER_CLIENTS_TLS_HANDSHAKES_FULL,
+                                 tlsFull) < 0 ||
+         virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                 VIR_SERVER_CLIENTS_TLS_HANDSHAKES_RESUMED,
+                                 tlsResumed) < 0))
+        goto cleanup;
+#endif
+
     *params = tmpparams;
     tmpparams = NULL;
     ret = 0;
@@ -362,6 +465,8 @@ adminServerSetClientLimits(virNetServerPtr srv,
 {
     long long int maxClients = -1;
     long long int maxClientsUnauth = -1;
+    long long int txMaxMessages = -1;
+    long long int txMaxBytes = -1;
     virTypedParameterPtr param = NULL;
 
     virCheckFlags(0, -1);
@@ -371,6 +476,10 @@ adminServerSetClientLimits(virNetServerPtr srv,
                                VIR_TYPED_PARAM_UINT,
                                VIR_SERVER_CLIENTS_UNAUTH_MAX,
                                VIR_TYPED_PARAM_UINT,
+                               VIR_SERVER_CLIENTS_TX_MESSAGES_MAX,
+                               VIR_TYPED_PARAM_UINT,
+                               VIR_SERVER_CLIENTS_TX_BYTES_MAX,
+                               VIR_TYPED_PARAM_UINT,
                                NULL) < 0)
         return -1;
 
@@ -382,9 +491,312 @@ adminServerSetClientLimits(virNetServerPtr srv,
                                    VIR_SERVER_CLIENTS_UNAUTH_MAX)))
         maxClientsUnauth = param->value.ui;
 
+    if ((param = virTypedParamsGet(params, nparams,
+                                   VIR_SERVER_CLIENTS_TX_MESSAGES_MAX)))
+        txMaxMessages = param->value.ui;
+
+    if ((param = virTypedParamsGet(params, nparams,
+                                   VIR_SERVER_CLIENTS_TX_BYTES_MAX)))
+        txMaxBytes = param->value.ui;
+
     if (virNetServerSetClientLimits(srv, maxClients,
                                     maxClientsUnauth) < 0)
         return -1;
 
+    virNetServerSetClientTxLimits(srv, txMaxMessages, txMaxBytes);
+
     return 0;
 }
+
+int
+adminServerGetMessagePoolParameters(virNetServerPtr srv ATTRIBUTE_UNUSED,
+                                    virTypedParameterPtr *params,
+                                    int *nparams,
+                                    unsigned int flags)
+{
+    int ret = -1;
+    int maxparams = 0;
+    virTypedParameterPtr tmpparams = NULL;
+    virNetMessagePoolStats stats;
+
+    virCheckFlags(0, -1);
+
+    /* The pool is shared by all servers of the daemon */
+    virNetMessagePoolGetStats(&stats);
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_MESSAGE_POOL_BYTES_MAX,
+                                stats.maxBytes) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_MESSAGE_POOL_BYTES_CURRENT,
+                                stats.bytes) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams, &maxparams,
+                              VIR_MESSAGE_POOL_MESSAGES_MAX,
+                              stats.maxMessages) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams, &maxparams,
+                              VIR_MESSAGE_POOL_MESSAGES_CURRENT,
+                              stats.messages) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_MESSAGE_POOL_BUFFER_HITS,
+                                stats.bufferHits) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_MESSAGE_POOL_BUFFER_MISSES,
+                                stats.bufferMisses) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_MESSAGE_POOL_MESSAGE_HITS,
+                                stats.messageHits) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_MESSAGE_POOL_MESSAGE_MISSES,
+                                stats.messageMisses) < 0)
+        goto cleanup;
+
+    *params = tmpparams;
+    tmpparams = NULL;
+    ret = 0;
+
+ cleanup:
+    virTypedParamsFree(tmpparams, *nparams);
+    return ret;
+}
+
+int
+adminServerSetMessagePoolParameters(virNetServerPtr srv ATTRIBUTE_UNUSED,
+                                    virTypedParameterPtr params,
+                                    int nparams,
+                                    unsigned int flags)
+{
+    virNetMessagePoolStats stats;
+    virTypedParameterPtr param = NULL;
+
+    virCheckFlags(0, -1);
+
+    if (virTypedParamsValidate(params, nparams,
+                               VIR_MESSAGE_POOL_BYTES_MAX,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_MESSAGE_POOL_MESSAGES_MAX,
+                               VIR_TYPED_PARAM_UINT,
+                               NULL) < 0)
+        return -1;
+
+    virNetMessagePoolGetStats(&stats);
+
+    if ((param = virTypedParamsGet(params, nparams,
+                                   VIR_MESSAGE_POOL_BYTES_MAX)))
+        stats.maxBytes = param->value.ul;
+
+    if ((param = virTypedParamsGet(params, nparams,
+                                   VIR_MESSAGE_POOL_MESSAGES_MAX)))
+        stats.maxMessages = param->value.ui;
+
+    virNetMessagePoolSetLimits(stats.maxBytes, stats.maxMessages);
+    return 0;
+}
+
+int
+adminServerGetCompressionParameters(virNetServerPtr srv ATTRIBUTE_UNUSED,
+                                    virTypedParameterPtr *params,
+                                    int *nparams,
+                                    unsigned int flags)
+{
+    int ret = -1;
+    int maxparams = 0;
+    virTypedParameterPtr tmpparams = NULL;
+    virNetMessageCompressionStats stats;
+
+    virCheckFlags(0, -1);
+
+    /* Compression is configured for the whole daemon */
+    virNetMessageCompressionGetStats(&stats);
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams, &maxparams,
+                              VIR_COMPRESSION_THRESHOLD,
+                              stats.threshold) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_COMPRESSION_MESSAGES,
+                                stats.messages) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_COMPRESSION_SKIPPED,
+                                stats.skipped) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_COMPRESSION_BYTES_IN,
+                                stats.bytesIn) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_COMPRESSION_BYTES_OUT,
+                                stats.bytesOut) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_COMPRESSION_TIME,
+                                stats.time) < 0)
+        goto cleanup;
+
+    *params = tmpparams;
+    tmpparams = NULL;
+    ret = 0;
+
+ cleanup:
+    virTypedParamsFree(tmpparams, *nparams);
+    return ret;
+}
+
+int
+adminServerSetCompressionParameters(virNetServerPtr srv ATTRIBUTE_UNUSED,
+                                    virTypedParameterPtr params,
+                                    int nparams,
+                                    unsigned int flags)
+{
+    virTypedParameterPtr param = NULL;
+
+    virCheckFlags(0, -1);
+
+    if (virTypedParamsValidate(params, nparams,
+                               VIR_COMPRESSION_THRESHOLD,
+                               VIR_TYPED_PARAM_UINT,
+                               NULL) < 0)
+        return -1;
+
+    if ((param = virTypedParamsGet(params, nparams,
+                                   VIR_COMPRESSION_THRESHOLD))) {
+        if (!virNetMessageCompressionIsSupported() && param->value.ui) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                           _("compression is not supported by this build "
+                             "of the daemon"));
+            return -1;
+        }
+        virNetMessageCompressionSetThreshold(param->value.ui);
+    }
+
+    return 0;
+}
+
+static int
+adminServerAddCallHistogram(virTypedParameterPtr *params,
+                            int *nparams,
+                            int *maxparams,
+                            size_t num,
+                            const char *kind,
+                            unsigned long long total,
+                            const unsigned long long *buckets)
+{
+    char name[VIR_TYPED_PARAM_FIELD_LENGTH];
+    size_t i;
+
+    snprintf(name, sizeof(name), "call.%zu.%s.total", num, kind);
+    if (virTypedParamsAddULLong(params, nparams, maxparams, name, total) < 0)
+        return -1;
+
+    for (i = 0; i < VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS; i++) {
+        if (!buckets[i])
+            continue;
+
+        snprintf(name, sizeof(name), "call.%zu.%s.bucket.%zu", num, kind, i);
+        if (virTypedParamsAddULLong(params, nparams, maxparams,
+                                    name, buckets[i]) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Fill @params with the call statistics of @srv, and @stats with
+ * what they were built from. The statistics are never reset here, it
+ * is up to the caller to pass @stats to virNetServerResetProcStats()
+ * once the reply was built, so that they aren't lost on failure.
+ */
+int
+adminServerGetCallStats(virNetServerPtr srv,
+                        virTypedParameterPtr *params,
+                        int *nparams,
+                        virNetServerProgramProcStatsPtr *stats,
+                        size_t *nstats,
+                        unsigned int flags)
+{
+    int ret = -1;
+    int maxparams = 0;
+    virTypedParameterPtr tmpparams = NULL;
+    char name[VIR_TYPED_PARAM_FIELD_LENGTH];
+    size_t i;
+
+    virCheckFlags(VIR_ADMIN_SERVER_CALL_STATS_RESET, -1);
+
+    if (virNetServerGetProcStats(srv, stats, nstats) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams, &maxparams,
+                              VIR_CALL_STATS_COUNT, *nstats) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams, &maxparams,
+                              VIR_CALL_STATS_BUCKETS,
+                              VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS) < 0)
+        goto cleanup;
+
+    for (i = 0; i < *nstats; i++) {
+        virNetServerProgramProcStatsPtr cur = &(*stats)[i];
+
+        snprintf(name, sizeof(name), "call.%zu.program", i);
+        if (virTypedParamsAddUInt(&tmpparams, nparams, &maxparams,
+                                  name, cur->program) < 0)
+            goto cleanup;
+
+        snprintf(name, sizeof(name), "call.%zu.procedure", i);
+        if (virTypedParamsAddUInt(&tmpparams, nparams, &maxparams,
+                                  name, cur->procedure) < 0)
+            goto cleanup;
+
+        if (cur->name) {
+            snprintf(name, sizeof(name), "call.%zu.name", i);
+            if (virTypedParamsAddString(&tmpparams, nparams, &maxparams,
+                                        name, cur->name) < 0)
+                goto cleanup;
+        }
+
+        snprintf(name, sizeof(name), "call.%zu.calls", i);
+        if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                    name, cur->calls) < 0)
+            goto cleanup;
+
+        if (adminServerAddCallHistogram(&tmpparams, nparams, &maxparams, i,
+                                        "wait", cur->waitTotal,
+                                        cur->wait) < 0 ||
+            adminServerAddCallHistogram(&tmpparams, nparams, &maxparams, i,
+                                        "exec", cur->execTotal,
+                                        cur->exec) < 0)
+            goto cleanup;
+    }
+
+    *params = tmpparams;
+    tmpparams = NULL;
+    ret = 0;
+
+ cleanup:
+    virTypedParamsFree(tmpparams, *nparams);
+    if (ret < 0) {
+        VIR_FREE(*stats);
+        *nstats = 0;
+    }
+    return ret;
+}
@@ -54,7 +54,8 @@ virNetServerClientPtr adminServerLookupClient(virNetServerPtr srv,
                                               unsigned long long id,
                                               unsigned int flags);
 
-int adminClientGetInfo(virNetServerClientPtr client,
+int adminClientGetInfo(virNetServerPtr srv,
+                       virNetServerClientPtr client,
                        virTypedParameterPtr *params,
                        int *nparams,
                        unsigned int flags);
@@ -72,4 +73,31 @@ int adminServerSetClientLimits(virNetServerPtr srv,
                                int nparams,
                                unsigned int flags);
 
+int adminServerGetMessagePoolParameters(virNetServerPtr srv,
+                                        virTypedParameterPtr *params,
+                                        int *nparams,
+                                        unsigned int flags);
+
+int adminServerSetMessagePoolParameters(virNetServerPtr srv,
+                                        virTypedParameterPtr params,
+                                        int nparams,
+                                        unsigned int flags);
+
+int adminServerGetCompressionParameters(virNetServerPtr srv,
+                                        virTypedParameterPtr *params,
+                                        int *nparams,
+                                        unsigned int flags);
+
+int adminServerSetCompressionParameters(virNetServerPtr srv,
+                                        virTypedParameterPtr params,
+                                        int nparams,
+                                        unsigned int flags);
+
+int adminServerGetCallStats(virNetServerPtr srv,
+                            virTypedParameterPtr *params,
+                            int *nparams,
+                            virNetServerProgramProcStatsPtr *stats,
+                            size_t *nstats,
+                            unsigned int flags);
+
 #endif /* __ADMIN_SERVER_H__ */
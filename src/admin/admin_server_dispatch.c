@@ -301,7 +301,7 @@ adminDispatchClientGetInfo(virNetServerPtr server ATTRIBUTE_UNUSED,
         goto cleanup;
     }
 
-    if (adminClientGetInfo(clnt, &params, &nparams, args->flags) < 0)
+    if (adminClientGetInfo(srv, clnt, &params, &nparams, args->flags) < 0)
         goto cleanup;
 
     if (nparams > ADMIN_CLIENT_INFO_PARAMETERS_MAX) {
@@ -412,6 +412,227 @@ adminDispatchServerSetClientLimits(virNetServerPtr server ATTRIBUTE_UNUSED,
     return rv;
 }
 
+static int
+adminDispatchServerGetMessagePoolParameters(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                            virNetServerClientPtr client,
+                                            virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                            virNetMessageErrorPtr rerr ATTRIBUTE_UNUSED,
+                                            admin_server_get_message_pool_parameters_args *args,
+                                            admin_server_get_message_pool_parameters_ret *ret)
+{
+    int rv = -1;
+    virNetServerPtr srv = NULL;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    struct daemonAdmClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!(srv = virNetDaemonGetServer(priv->dmn, args->srv.name)))
+        goto cleanup;
+
+    if (adminServerGetMessagePoolParameters(srv, &params, &nparams,
+                                            args->flags) < 0)
+        goto cleanup;
+
+    if (nparams > ADMIN_SERVER_MESSAGE_POOL_PARAMETERS_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of message pool parameters %d exceeds "
+                         "max allowed limit: %d"), nparams,
+                       ADMIN_SERVER_MESSAGE_POOL_PARAMETERS_MAX);
+        goto cleanup;
+    }
+
+    if (virTypedParamsSerialize(params, nparams,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    virObjectUnref(srv);
+    return rv;
+}
+
+static int
+adminDispatchServerSetMessagePoolParameters(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                            virNetServerClientPtr client,
+                                            virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                            virNetMessageErrorPtr rerr ATTRIBUTE_UNUSED,
+                                            admin_server_set_message_pool_parameters_args *args)
+{
+    int rv = -1;
+    virNetServerPtr srv = NULL;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    struct daemonAdmClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!(srv = virNetDaemonGetServer(priv->dmn, args->srv.name))) {
+        virReportError(VIR_ERR_NO_SERVER,
+                       _("no server with matching name '%s' found"),
+                       args->srv.name);
+        goto cleanup;
+    }
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) args->params.params_val,
+        args->params.params_len,
+        ADMIN_SERVER_MESSAGE_POOL_PARAMETERS_MAX, &params, &nparams) < 0)
+        goto cleanup;
+
+    if (adminServerSetMessagePoolParameters(srv, params, nparams,
+                                            args->flags) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virTypedParamsFree(params, nparams);
+    virObjectUnref(srv);
+    return rv;
+}
+
+static int
+adminDispatchServerGetCompressionParameters(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                            virNetServerClientPtr client,
+                                            virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                            virNetMessageErrorPtr rerr ATTRIBUTE_UNUSED,
+                                            admin_server_get_compression_parameters_args *args,
+                                            admin_server_get_compression_parameters_ret *ret)
+{
+    int rv = -1;
+    virNetServerPtr srv = NULL;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    struct daemonAdmClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!(srv = virNetDaemonGetServer(priv->dmn, args->srv.name)))
+        goto cleanup;
+
+    if (adminServerGetCompressionParameters(srv, &params, &nparams,
+                                            args->flags) < 0)
+        goto cleanup;
+
+    if (nparams > ADMIN_SERVER_COMPRESSION_PARAMETERS_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of compression parameters %d exceeds "
+                         "max allowed limit: %d"), nparams,
+                       ADMIN_SERVER_COMPRESSION_PARAMETERS_MAX);
+        goto cleanup;
+    }
+
+    if (virTypedParamsSerialize(params, nparams,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    virObjectUnref(srv);
+    return rv;
+}
+
+static int
+adminDispatchServerSetCompressionParameters(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                            virNetServerClientPtr client,
+                                            virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                            virNetMessageErrorPtr rerr ATTRIBUTE_UNUSED,
+                                            admin_server_set_compression_parameters_args *args)
+{
+    int rv = -1;
+    virNetServerPtr srv = NULL;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    struct daemonAdmClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!(srv = virNetDaemonGetServer(priv->dmn, args->srv.name))) {
+        virReportError(VIR_ERR_NO_SERVER,
+                       _("no server with matching name '%s' found"),
+                       args->srv.name);
+        goto cleanup;
+    }
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) args->params.params_val,
+        args->params.params_len,
+        ADMIN_SERVER_COMPRESSION_PARAMETERS_MAX, &params, &nparams) < 0)
+        goto cleanup;
+
+    if (adminServerSetCompressionParameters(srv, params, nparams,
+                                            args->flags) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virTypedParamsFree(params, nparams);
+    virObjectUnref(srv);
+    return rv;
+}
+
+static int
+adminDispatchServerGetCallStats(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                virNetServerClientPtr client,
+                                virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                virNetMessageErrorPtr rerr ATTRIBUTE_UNUSED,
+                                admin_server_get_call_stats_args *args,
+                                admin_server_get_call_stats_ret *ret)
+{
+    int rv = -1;
+    virNetServerPtr srv = NULL;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    virNetServerProgramProcStatsPtr stats = NULL;
+    size_t nstats = 0;
+    struct daemonAdmClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!(srv = virNetDaemonGetServer(priv->dmn, args->srv.name)))
+        goto cleanup;
+
+    if (adminServerGetCallStats(srv, &params, &nparams,
+                                &stats, &nstats, args->flags) < 0)
+        goto cleanup;
+
+    if (nparams > ADMIN_SERVER_CALL_STATS_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of call statistics parameters %d exceeds "
+                         "max allowed limit: %d"), nparams,
+                       ADMIN_SERVER_CALL_STATS_MAX);
+        goto cleanup;
+    }
+
+    if (virTypedParamsSerialize(params, nparams,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    /* Only clear the statistics once nothing can fail anymore,
+     * so that they aren't lost if building the reply fails */
+    if (args->flags & VIR_ADMIN_SERVER_CALL_STATS_RESET)
+        virNetServerResetProcStats(srv, stats, nstats);
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    VIR_FREE(stats);
+    virObjectUnref(srv);
+    return rv;
+}
+
 /* Returns the number of outputs stored in @outputs */
 static int
 adminConnectGetLoggingOutputs(char **outputs, unsigned int flags)
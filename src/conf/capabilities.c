@@ -36,6 +36,7 @@
 #include "physmem.h"
 #include "viralloc.h"
 #include "virarch.h"
+#include "viratomic.h"
 #include "virbuffer.h"
 #include "virerror.h"
 #include "virfile.h"
@@ -1745,3 +1746,34 @@ virCapabilitiesInitCaches(virCapsPtr caps)
     virBitmapFree(cpus);
     return ret;
 }
+
+
+static int virCapabilitiesGeneration;
+
+/**
+ * virCapabilitiesInvalidate:
+ *
+ * Record that the host capabilities, or the capabilities of any
+ * hypervisor, might have changed. Anyone keeping data derived from
+ * them around, e.g. formatted capabilities XML, is expected to compare
+ * virCapabilitiesGetGeneration() against the value it saw when the
+ * data was built.
+ */
+void
+virCapabilitiesInvalidate(void)
+{
+    virAtomicIntInc(&virCapabilitiesGeneration);
+}
+
+
+/**
+ * virCapabilitiesGetGeneration:
+ *
+ * Returns a counter which is bumped by every virCapabilitiesInvalidate
+ * call.
+ */
+unsigned int
+virCapabilitiesGetGeneration(void)
+{
+    return virAtomicIntGet(&virCapabilitiesGeneration);
+}
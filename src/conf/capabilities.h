@@ -327,4 +327,7 @@ void virCapsHostCacheBankFree(virCapsHostCacheBankPtr ptr);
 
 int virCapabilitiesInitCaches(virCapsPtr caps);
 
+void virCapabilitiesInvalidate(void);
+unsigned int virCapabilitiesGetGeneration(void);
+
 #endif /* __VIR_CAPABILITIES_H */
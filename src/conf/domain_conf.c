@@ -59,6 +59,7 @@
 #include "virnetdevmacvlan.h"
 #include "virhostdev.h"
 #include "virmdev.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_DOMAIN
 
@@ -3097,6 +3098,9 @@ static void virDomainObjDispose(void *obj)
         (dom->privateDataFreeFunc)(dom->privateData);
 
     virDomainSnapshotObjListFree(dom->snapshots);
+
+    virDomainObjSummaryClear(&dom->summary);
+    virMutexDestroy(&dom->summaryLock);
 }
 
 virDomainObjPtr
@@ -3116,6 +3120,12 @@ virDomainObjNew(virDomainXMLOptionPtr xmlopt)
         goto error;
     }
 
+    if (virMutexInit(&domain->summaryLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("failed to initialize domain summary mutex"));
+        goto error;
+    }
+
     if (xmlopt->privateData.alloc) {
         domain->privateData = (xmlopt->privateData.alloc)(xmlopt->config.priv);
         if (!domain->privateData)
@@ -3213,6 +3223,8 @@ void virDomainObjAssignDef(virDomainObjPtr domain,
             domain->def = def;
         }
     }
+
+    virDomainObjMarkChanged(domain);
 }
 
 
@@ -3233,12 +3245,238 @@ virDomainObjEndAPI(virDomainObjPtr *vm)
     if (!*vm)
         return;
 
+    virDomainObjUpdateSummary(*vm);
     virObjectUnlock(*vm);
     virObjectUnref(*vm);
     *vm = NULL;
 }
 
 
+/* Generations order changes of all domain objects. The counter starts
+ * at the time of its first use, scaled so that an earlier instance of
+ * the daemon would have needed a million changes per millisecond of its
+ * life to hand out generations as new as any of this one. */
+static virMutex virDomainObjGenerationLock = VIR_MUTEX_INITIALIZER;
+static unsigned long long virDomainObjGeneration;
+
+
+static unsigned long long
+virDomainObjGenerationAdvance(unsigned int count)
+{
+    unsigned long long generation;
+
+    virMutexLock(&virDomainObjGenerationLock);
+    if (virDomainObjGeneration == 0) {
+        if (virTimeMillisNow(&virDomainObjGeneration) < 0)
+            virDomainObjGeneration = 1;
+        virDomainObjGeneration *= 1000 * 1000;
+    }
+    virDomainObjGeneration += count;
+    generation = virDomainObjGeneration;
+    virMutexUnlock(&virDomainObjGenerationLock);
+
+    return generation;
+}
+
+
+/**
+ * virDomainObjNextGeneration:
+ *
+ * Returns a new generation, which is newer than any change of a domain
+ * object so far.
+ */
+unsigned long long
+virDomainObjNextGeneration(void)
+{
+    return virDomainObjGenerationAdvance(1);
+}
+
+
+/**
+ * virDomainObjCurrentGeneration:
+ *
+ * Returns the generation of the latest change of any domain object.
+ */
+unsigned long long
+virDomainObjCurrentGeneration(void)
+{
+    return virDomainObjGenerationAdvance(0);
+}
+
+
+static void
+virDomainObjUpdateSummaryInternal(virDomainObjPtr vm,
+                                  bool changed)
+{
+    virDomainObjSummaryPtr summary = &vm->summary;
+    virDomainDefPtr def = NULL;
+    virDomainDefPtr tmp;
+
+    /* The name is the only part of the identity which is not copied in
+     * place, so a new one is only needed after a rename */
+    if (vm->def &&
+        (!summary->def || STRNEQ(summary->def->name, vm->def->name)))
+        def = virDomainDefNewFull(vm->def->name, vm->def->uuid, vm->def->id);
+
+    virMutexLock(&vm->summaryLock);
+    if (def) {
+        tmp = summary->def;
+        summary->def = def;
+        def = tmp;
+        changed = true;
+    }
+    if (summary->state.state != vm->state.state ||
+        summary->state.reason != vm->state.reason ||
+        summary->persistent != vm->persistent)
+        changed = true;
+    if (vm->def && summary->def) {
+        if (summary->def->id != vm->def->id)
+            changed = true;
+        memcpy(summary->def->uuid, vm->def->uuid, VIR_UUID_BUFLEN);
+        summary->def->id = vm->def->id;
+        summary->maxMem = virDomainDefGetMemoryTotal(vm->def);
+        summary->memory = vm->def->mem.cur_balloon;
+        summary->vcpus = virDomainDefGetVcpus(vm->def);
+    }
+    summary->pid = vm->pid;
+    summary->state = vm->state;
+    summary->persistent = vm->persistent;
+    /* Taken with the summary lock held, so that no change older than
+     * the current generation can be missing from the summaries */
+    if (changed)
+        summary->generation = virDomainObjNextGeneration();
+    virMutexUnlock(&vm->summaryLock);
+
+    virDomainDefFree(def);
+}
+
+
+/**
+ * virDomainObjUpdateSummary:
+ * @vm: locked domain object
+ *
+ * Refresh the copy of frequently read fields of @vm, which is what
+ * virDomainObjGetSummary() returns. It is done automatically when the
+ * state of @vm changes, when its definition is replaced, and in
+ * virDomainObjEndAPI(); code which changes any of those fields and then
+ * unlocks @vm for a long time should call it before doing so.
+ *
+ * A change of the name, ID, state or persistence moves @vm to a new
+ * generation.
+ */
+void
+virDomainObjUpdateSummary(virDomainObjPtr vm)
+{
+    virDomainObjUpdateSummaryInternal(vm, false);
+}
+
+
+/**
+ * virDomainObjMarkChanged:
+ * @vm: locked domain object
+ *
+ * Like virDomainObjUpdateSummary(), but moves @vm to a new generation
+ * even if none of the summarized fields changed, e.g. after its
+ * definition was replaced.
+ */
+void
+virDomainObjMarkChanged(virDomainObjPtr vm)
+{
+    virDomainObjUpdateSummaryInternal(vm, true);
+}
+
+
+/**
+ * virDomainObjGetSummary:
+ * @vm: domain object, which does not need to be locked
+ * @summary: filled with a copy of the summary of @vm
+ *
+ * Get the frequently read fields of @vm as of the last time the domain
+ * object was updated, without waiting for jobs which hold the domain
+ * object lock. The caller must hold a reference on @vm and has to free
+ * the returned copy with virDomainObjSummaryClear().
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virDomainObjGetSummary(virDomainObjPtr vm,
+                       virDomainObjSummaryPtr summary)
+{
+    int ret = -1;
+
+    memset(summary, 0, sizeof(*summary));
+
+    virMutexLock(&vm->summaryLock);
+    if (!vm->summary.def) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("domain object has no definition"));
+        goto cleanup;
+    }
+
+    *summary = vm->summary;
+    if (!(summary->def = virDomainDefNewFull(vm->summary.def->name,
+                                             vm->summary.def->uuid,
+                                             vm->summary.def->id)))
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virMutexUnlock(&vm->summaryLock);
+    return ret;
+}
+
+
+/**
+ * virDomainObjGetSummaryID:
+ * @vm: domain object, which does not need to be locked
+ *
+ * Returns the ID of @vm as of the last update of its summary, or -1 if
+ * it is not running.
+ */
+int
+virDomainObjGetSummaryID(virDomainObjPtr vm)
+{
+    int id = -1;
+
+    virMutexLock(&vm->summaryLock);
+    if (vm->summary.def)
+        id = vm->summary.def->id;
+    virMutexUnlock(&vm->summaryLock);
+
+    return id;
+}
+
+
+/**
+ * virDomainObjGetSummaryGeneration:
+ * @vm: domain object, which does not need to be locked
+ *
+ * Returns the generation of the latest change of @vm.
+ */
+unsigned long long
+virDomainObjGetSummaryGeneration(virDomainObjPtr vm)
+{
+    unsigned long long generation;
+
+    virMutexLock(&vm->summaryLock);
+    generation = vm->summary.generation;
+    virMutexUnlock(&vm->summaryLock);
+
+    return generation;
+}
+
+
+void
+virDomainObjSummaryClear(virDomainObjSummaryPtr summary)
+{
+    if (!summary)
+        return;
+
+    virDomainDefFree(summary->def);
+    memset(summary, 0, sizeof(*summary));
+}
+
+
 void
 virDomainObjBroadcast(virDomainObjPtr vm)
 {
@@ -3335,6 +3573,8 @@ virDomainObjRemoveTransientDef(virDomainObjPtr domain)
     domain->def = domain->newDef;
     domain->def->id = -1;
     domain->newDef = NULL;
+
+    virDomainObjUpdateSummary(domain);
 }
 
 
@@ -26486,9 +26726,12 @@ virDomainDefFormatInternal(virDomainDefPtr def,
     if (def->id == -1)
         flags |= VIR_DOMAIN_DEF_FORMAT_INACTIVE;
 
-    virBufferAsprintf(buf, "<domain type='%s'", type);
-    if (!(flags & VIR_DOMAIN_DEF_FORMAT_INACTIVE))
-        virBufferAsprintf(buf, " id='%d'", def->id);
+    virBufferStrcat(buf, "<domain type='", type, "'", NULL);
+    if (!(flags & VIR_DOMAIN_DEF_FORMAT_INACTIVE)) {
+        virBufferAddLit(buf, " id='");
+        virBufferAddInt(buf, def->id);
+        virBufferAddLit(buf, "'");
+    }
     if (def->namespaceData && def->ns.href)
         virBufferAsprintf(buf, " %s", (def->ns.href)());
     virBufferAddLit(buf, ">\n");
@@ -26498,7 +26741,7 @@ virDomainDefFormatInternal(virDomainDefPtr def,
 
     uuid = def->uuid;
     virUUIDFormat(uuid, uuidstr);
-    virBufferAsprintf(buf, "<uuid>%s</uuid>\n", uuidstr);
+    virBufferStrcat(buf, "<uuid>", uuidstr, "</uuid>\n", NULL);
 
     virBufferEscapeString(buf, "<title>%s</title>\n", def->title);
 
@@ -26529,20 +26772,25 @@ virDomainDefFormatInternal(virDomainDefPtr def,
     }
 
     if (virDomainDefHasMemoryHotplug(def)) {
-        virBufferAsprintf(buf,
-                          "<maxMemory slots='%u' unit='KiB'>%llu</maxMemory>\n",
-                          def->mem.memory_slots, def->mem.max_memory);
+        virBufferAddLit(buf, "<maxMemory slots='");
+        virBufferAddUInt(buf, def->mem.memory_slots);
+        virBufferAddLit(buf, "' unit='KiB'>");
+        virBufferAddUInt(buf, def->mem.max_memory);
+        virBufferAddLit(buf, "</maxMemory>\n");
     }
 
     virBufferAddLit(buf, "<memory");
     if (def->mem.dump_core)
-        virBufferAsprintf(buf, " dumpCore='%s'",
-                          virTristateSwitchTypeToString(def->mem.dump_core));
-    virBufferAsprintf(buf, " unit='KiB'>%llu</memory>\n",
-                      virDomainDefGetMemoryTotal(def));
+        virBufferStrcat(buf, " dumpCore='",
+                        virTristateSwitchTypeToString(def->mem.dump_core),
+                        "'", NULL);
+    virBufferAddLit(buf, " unit='KiB'>");
+    virBufferAddUInt(buf, virDomainDefGetMemoryTotal(def));
+    virBufferAddLit(buf, "</memory>\n");
 
-    virBufferAsprintf(buf, "<currentMemory unit='KiB'>%llu</currentMemory>\n",
-                      def->mem.cur_balloon);
+    virBufferAddLit(buf, "<currentMemory unit='KiB'>");
+    virBufferAddUInt(buf, def->mem.cur_balloon);
+    virBufferAddLit(buf, "</currentMemory>\n");
 
     /* start format blkiotune */
     virBufferSetChildIndent(&childrenBuf, buf);
@@ -26645,14 +26893,16 @@ virDomainDefFormatInternal(virDomainDefPtr def,
         goto error;
 
     if (def->niothreadids > 0) {
-        virBufferAsprintf(buf, "<iothreads>%zu</iothreads>\n",
-                          def->niothreadids);
+        virBufferAddLit(buf, "<iothreads>");
+        virBufferAddUInt(buf, def->niothreadids);
+        virBufferAddLit(buf, "</iothreads>\n");
         if (virDomainDefIothreadShouldFormat(def)) {
             virBufferAddLit(buf, "<iothreadids>\n");
             virBufferAdjustIndent(buf, 2);
             for (i = 0; i < def->niothreadids; i++) {
-                virBufferAsprintf(buf, "<iothread id='%u'/>\n",
-                                  def->iothreadids[i]->iothread_id);
+                virBufferAddLit(buf, "<iothread id='");
+                virBufferAddUInt(buf, def->iothreadids[i]->iothread_id);
+                virBufferAddLit(buf, "'/>\n");
             }
             virBufferAdjustIndent(buf, -2);
             virBufferAddLit(buf, "</iothreadids>\n");
@@ -26693,11 +26943,12 @@ virDomainDefFormatInternal(virDomainDefPtr def,
      */
     if (def->virtType == VIR_DOMAIN_VIRT_XEN &&
         def->os.type == VIR_DOMAIN_OSTYPE_XEN)
-        virBufferAsprintf(buf, ">%s</type>\n",
-                          virDomainOSTypeToString(VIR_DOMAIN_OSTYPE_LINUX));
+        virBufferStrcat(buf, ">",
+                        virDomainOSTypeToString(VIR_DOMAIN_OSTYPE_LINUX),
+                        "</type>\n", NULL);
     else
-        virBufferAsprintf(buf, ">%s</type>\n",
-                          virDomainOSTypeToString(def->os.type));
+        virBufferStrcat(buf, ">", virDomainOSTypeToString(def->os.type),
+                        "</type>\n", NULL);
 
     virBufferEscapeString(buf, "<init>%s</init>\n",
                           def->os.init);
@@ -26746,7 +26997,7 @@ virDomainDefFormatInternal(virDomainDefPtr def,
                                def->os.bootDevs[n]);
                 goto error;
             }
-            virBufferAsprintf(buf, "<boot dev='%s'/>\n", boottype);
+            virBufferStrcat(buf, "<boot dev='", boottype, "'/>\n", NULL);
         }
 
         if (def->os.bootmenu) {
@@ -26837,7 +27088,7 @@ virDomainDefFormatInternal(virDomainDefPtr def,
                     break;
 
                 case VIR_TRISTATE_SWITCH_ON:
-                   virBufferAsprintf(buf, "<%s/>\n", name);
+                   virBufferStrcat(buf, "<", name, "/>\n", NULL);
                    break;
 
                 case VIR_TRISTATE_SWITCH_LAST:
@@ -26862,11 +27113,11 @@ virDomainDefFormatInternal(virDomainDefPtr def,
                     break;
 
                 case VIR_TRISTATE_SWITCH_ON:
-                   virBufferAsprintf(buf, "<%s state='on'/>\n", name);
+                   virBufferStrcat(buf, "<", name, " state='on'/>\n", NULL);
                    break;
 
                 case VIR_TRISTATE_SWITCH_OFF:
-                   virBufferAsprintf(buf, "<%s state='off'/>\n", name);
+                   virBufferStrcat(buf, "<", name, " state='off'/>\n", NULL);
                    break;
                 }
 
@@ -27017,8 +27268,9 @@ virDomainDefFormatInternal(virDomainDefPtr def,
     if (virCPUDefFormatBufFull(buf, def->cpu, def->numa) < 0)
         goto error;
 
-    virBufferAsprintf(buf, "<clock offset='%s'",
-                      virDomainClockOffsetTypeToString(def->clock.offset));
+    virBufferStrcat(buf, "<clock offset='",
+                    virDomainClockOffsetTypeToString(def->clock.offset),
+                    "'", NULL);
     switch (def->clock.offset) {
     case VIR_DOMAIN_CLOCK_OFFSET_LOCALTIME:
     case VIR_DOMAIN_CLOCK_OFFSET_UTC:
@@ -27275,12 +27527,29 @@ unsigned int virDomainDefFormatConvertXMLFlags(unsigned int flags)
 }
 
 
+/* Rough estimate of the formatted size of @def, a few hundred bytes
+ * per device on top of the fixed part, used to size the buffer up
+ * front. */
+static unsigned int
+virDomainDefFormatSizeHint(virDomainDefPtr def)
+{
+    size_t ndevs = def->ndisks + def->ncontrollers + def->nnets +
+        def->nserials + def->nparallels + def->nconsoles + def->nchannels +
+        def->ninputs + def->ngraphics + def->nsounds + def->nvideos +
+        def->nhostdevs + def->nredirdevs + def->nhubs + def->nrngs +
+        def->nmems + def->nshmems + def->nfss;
+
+    return 2048 + MIN(ndevs, 4096) * 384;
+}
+
+
 char *
 virDomainDefFormat(virDomainDefPtr def, virCapsPtr caps, unsigned int flags)
 {
     virBuffer buf = VIR_BUFFER_INITIALIZER;
 
     virCheckFlags(VIR_DOMAIN_DEF_FORMAT_COMMON_FLAGS, NULL);
+    virBufferSizeHint(&buf, virDomainDefFormatSizeHint(def));
     if (virDomainDefFormatInternal(def, caps, flags, &buf, NULL) < 0)
         return NULL;
 
@@ -27299,17 +27568,23 @@ virDomainObjFormat(virDomainXMLOptionPtr xmlopt,
     int reason;
     size_t i;
 
+    /* the status XML carries the private data on top of the definition */
+    virBufferSizeHint(&buf, virDomainDefFormatSizeHint(obj->def) + 4096);
+
     state = virDomainObjGetState(obj, &reason);
-    virBufferAsprintf(&buf, "<domstatus state='%s' reason='%s' pid='%lld'>\n",
-                      virDomainStateTypeToString(state),
-                      virDomainStateReasonToString(state, reason),
-                      (long long)obj->pid);
+    virBufferStrcat(&buf, "<domstatus state='",
+                    NULLSTR(virDomainStateTypeToString(state)),
+                    "' reason='",
+                    NULLSTR(virDomainStateReasonToString(state, reason)),
+                    "' pid='", NULL);
+    virBufferAddInt(&buf, obj->pid);
+    virBufferAddLit(&buf, "'>\n");
     virBufferAdjustIndent(&buf, 2);
 
     for (i = 0; i < VIR_DOMAIN_TAINT_LAST; i++) {
         if (obj->taint & (1 << i))
-            virBufferAsprintf(&buf, "<taint flag='%s'/>\n",
-                              virDomainTaintTypeToString(i));
+            virBufferStrcat(&buf, "<taint flag='",
+                            virDomainTaintTypeToString(i), "'/>\n", NULL);
     }
 
     if (xmlopt->privateData.format &&
@@ -27823,102 +28098,1285 @@ virDomainDiskDefForeachPath(virDomainDiskDefPtr disk,
 }
 
 
-/* Copy src into a new definition; with the quality of the copy
- * depending on the migratable flag (false for transitions between
- * persistent and active, true for transitions across save files or
- * snapshots).  */
-virDomainDefPtr
-virDomainDefCopy(virDomainDefPtr src,
-                 virCapsPtr caps,
-                 virDomainXMLOptionPtr xmlopt,
-                 void *parseOpaque,
-                 bool migratable)
-{
-    char *xml;
-    virDomainDefPtr ret;
-    unsigned int format_flags = VIR_DOMAIN_DEF_FORMAT_SECURE;
-    unsigned int parse_flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
-                               VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
+/*
+ * Copying a definition through virDomainDefFormat() and
+ * virDomainDefParseString() is by far the most expensive part of
+ * many APIs for large domains. The helpers below copy the structures
+ * directly instead. Each of them starts with a shallow copy of the
+ * whole structure, drops every pointer it owns so that the result
+ * can be freed at any time, and only then copies the pointed-to
+ * data. Whatever they don't know about makes
+ * virDomainDefCopyNativeSupported() return false and the caller
+ * falls back to the XML round trip.
+ */
 
-    if (migratable)
-        format_flags |= VIR_DOMAIN_DEF_FORMAT_INACTIVE | VIR_DOMAIN_DEF_FORMAT_MIGRATABLE;
+/*
+ * Each structure handled below is copied either shallowly or member
+ * by member, so a member added to any of them has to be added to its
+ * copy helper too, or it ends up shared between both copies or lost.
+ * Make the build fail until that is done and the size here updated.
+ * Checking 64-bit hosts only is enough to notice. Note that members
+ * embedded from other structures, like virDomainDeviceInfo, count.
+ */
+#define VIR_DOMAIN_COPY_VERIFY_SIZE(type, size) \
+    verify(sizeof(void *) != 8 || sizeof(type) == (size))
+
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainDef, 1496);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virBlkioDevice, 40);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainHugePage, 16);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainResourceDef, 8);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainIdMapEntry, 12);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainLoaderDef, 40);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainVcpuDef, 40);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainIOThreadIDDef, 32);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainTimerDef, 64);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainChrSourceDef, 96);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainChrDef, 128);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainDiskDef, 448);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainControllerDef, 176);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainNetDef, 520);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virNetDevVPortProfile, 92);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virNetDevCoalesce, 88);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainGraphicsDef, 160);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainInputDef, 112);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainSoundDef, 112);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainSoundCodecDef, 8);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainVideoDef, 144);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainVideoAccelDef, 8);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainVideoDriverDef, 4);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainLeaseDef, 32);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainHubDef, 96);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainRNGDef, 120);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainPanicDef, 96);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainWatchdogDef, 96);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainMemballoonDef, 112);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainVirtioOptions, 8);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainIOMMUDef, 20);
+VIR_DOMAIN_COPY_VERIFY_SIZE(virDomainKeyWrapDef, 8);
+
+#undef VIR_DOMAIN_COPY_VERIFY_SIZE
+
+/* Copy a structure which doesn't contain any pointers, @src may be NULL */
+#define VIR_DOMAIN_COPY_PLAIN(dst, src) \
+    virDomainCopyPlain((void **) &(dst), (src), sizeof(*(src)))
 
-    /* Easiest to clone via a round-trip through XML.  */
-    if (!(xml = virDomainDefFormat(src, caps, format_flags)))
-        return NULL;
+static int
+virDomainCopyPlain(void **dst,
+                   const void *src,
+                   size_t size)
+{
+    char *tmp;
 
-    ret = virDomainDefParseString(xml, caps, xmlopt, parseOpaque, parse_flags);
+    *dst = NULL;
+    if (!src)
+        return 0;
 
-    VIR_FREE(xml);
-    return ret;
+    if (VIR_ALLOC_N(tmp, size) < 0)
+        return -1;
+
+    memcpy(tmp, src, size);
+    *dst = tmp;
+    return 0;
 }
 
-virDomainDefPtr
-virDomainObjCopyPersistentDef(virDomainObjPtr dom,
-                              virCapsPtr caps,
-                              virDomainXMLOptionPtr xmlopt)
+
+static int
+virDomainBitmapCopy(virBitmapPtr *dst,
+                    virBitmapPtr src)
 {
-    virDomainDefPtr cur;
+    *dst = NULL;
+    if (src && !(*dst = virBitmapNewCopy(src)))
+        return -1;
 
-    cur = virDomainObjGetPersistentDef(caps, xmlopt, dom);
-    return virDomainDefCopy(cur, caps, xmlopt, NULL, false);
+    return 0;
 }
 
 
-virDomainState
-virDomainObjGetState(virDomainObjPtr dom, int *reason)
+static int
+virDomainDeviceLabelsCopy(virSecurityDeviceLabelDefPtr **dst,
+                          size_t *ndst,
+                          virSecurityDeviceLabelDefPtr *src,
+                          size_t nsrc)
 {
-    if (reason)
-        *reason = dom->state.reason;
+    size_t i;
 
-    return dom->state.state;
+    *dst = NULL;
+    *ndst = 0;
+    if (!nsrc)
+        return 0;
+
+    if (VIR_ALLOC_N(*dst, nsrc) < 0)
+        return -1;
+    *ndst = nsrc;
+
+    for (i = 0; i < nsrc; i++) {
+        if (!((*dst)[i] = virSecurityDeviceLabelDefCopy(src[i])))
+            return -1;
+    }
+
+    return 0;
 }
 
 
-void
-virDomainObjSetState(virDomainObjPtr dom, virDomainState state, int reason)
+static virDomainChrSourceDefPtr
+virDomainChrSourceDefCopyNative(virDomainChrSourceDefPtr src,
+                                virDomainXMLOptionPtr xmlopt)
 {
-    int last = -1;
+    virDomainChrSourceDefPtr def;
+    virObjectPtr priv;
 
-    switch (state) {
-    case VIR_DOMAIN_NOSTATE:
-        last = VIR_DOMAIN_NOSTATE_LAST;
-        break;
-    case VIR_DOMAIN_RUNNING:
-        last = VIR_DOMAIN_RUNNING_LAST;
+    if (!(def = virDomainChrSourceDefNew(xmlopt)))
+        return NULL;
+
+    priv = def->privateData;
+    *def = *src;
+    def->privateData = priv;
+    def->logfile = NULL;
+    def->seclabels = NULL;
+    def->nseclabels = 0;
+
+    switch ((virDomainChrType) def->type) {
+    case VIR_DOMAIN_CHR_TYPE_PTY:
+    case VIR_DOMAIN_CHR_TYPE_DEV:
+    case VIR_DOMAIN_CHR_TYPE_FILE:
+    case VIR_DOMAIN_CHR_TYPE_PIPE:
+        def->data.file.path = NULL;
+        if (VIR_STRDUP(def->data.file.path, src->data.file.path) < 0)
+            goto error;
         break;
-    case VIR_DOMAIN_BLOCKED:
-        last = VIR_DOMAIN_BLOCKED_LAST;
+
+    case VIR_DOMAIN_CHR_TYPE_NMDM:
+        def->data.nmdm.master = NULL;
+        def->data.nmdm.slave = NULL;
+        if (VIR_STRDUP(def->data.nmdm.master, src->data.nmdm.master) < 0 ||
+            VIR_STRDUP(def->data.nmdm.slave, src->data.nmdm.slave) < 0)
+            goto error;
         break;
-    case VIR_DOMAIN_PAUSED:
-        last = VIR_DOMAIN_PAUSED_LAST;
+
+    case VIR_DOMAIN_CHR_TYPE_UDP:
+        def->data.udp.bindHost = NULL;
+        def->data.udp.bindService = NULL;
+        def->data.udp.connectHost = NULL;
+        def->data.udp.connectService = NULL;
+        if (VIR_STRDUP(def->data.udp.bindHost, src->data.udp.bindHost) < 0 ||
+            VIR_STRDUP(def->data.udp.bindService, src->data.udp.bindService) < 0 ||
+            VIR_STRDUP(def->data.udp.connectHost, src->data.udp.connectHost) < 0 ||
+            VIR_STRDUP(def->data.udp.connectService, src->data.udp.connectService) < 0)
+            goto error;
         break;
-    case VIR_DOMAIN_SHUTDOWN:
-        last = VIR_DOMAIN_SHUTDOWN_LAST;
+
+    case VIR_DOMAIN_CHR_TYPE_TCP:
+        def->data.tcp.host = NULL;
+        def->data.tcp.service = NULL;
+        if (VIR_STRDUP(def->data.tcp.host, src->data.tcp.host) < 0 ||
+            VIR_STRDUP(def->data.tcp.service, src->data.tcp.service) < 0)
+            goto error;
         break;
-    case VIR_DOMAIN_SHUTOFF:
-        last = VIR_DOMAIN_SHUTOFF_LAST;
+
+    case VIR_DOMAIN_CHR_TYPE_UNIX:
+        def->data.nix.path = NULL;
+        if (VIR_STRDUP(def->data.nix.path, src->data.nix.path) < 0)
+            goto error;
         break;
-    case VIR_DOMAIN_CRASHED:
-        last = VIR_DOMAIN_CRASHED_LAST;
+
+    case VIR_DOMAIN_CHR_TYPE_SPICEPORT:
+        def->data.spiceport.channel = NULL;
+        if (VIR_STRDUP(def->data.spiceport.channel,
+                       src->data.spiceport.channel) < 0)
+            goto error;
         break;
-    case VIR_DOMAIN_PMSUSPENDED:
-        last = VIR_DOMAIN_PMSUSPENDED_LAST;
+
+    case VIR_DOMAIN_CHR_TYPE_NULL:
+    case VIR_DOMAIN_CHR_TYPE_VC:
+    case VIR_DOMAIN_CHR_TYPE_STDIO:
+    case VIR_DOMAIN_CHR_TYPE_SPICEVMC:
+    case VIR_DOMAIN_CHR_TYPE_LAST:
         break;
-    default:
-        last = -1;
     }
 
-    if (last < 0) {
-        VIR_ERROR(_("invalid domain state: %d"), state);
-        return;
-    }
+    if (VIR_STRDUP(def->logfile, src->logfile) < 0 ||
+        virDomainDeviceLabelsCopy(&def->seclabels, &def->nseclabels,
+                                  src->seclabels, src->nseclabels) < 0)
+        goto error;
 
-    dom->state.state = state;
-    if (reason > 0 && reason < last)
-        dom->state.reason = reason;
-    else
-        dom->state.reason = 0;
+    return def;
+
+ error:
+    virDomainChrSourceDefFree(def);
+    return NULL;
+}
+
+
+static virDomainChrDefPtr
+virDomainChrDefCopyNative(virDomainChrDefPtr src,
+                          virDomainXMLOptionPtr xmlopt)
+{
+    virDomainChrDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->deviceType = src->deviceType;
+    def->targetType = src->targetType;
+    def->targetModel = src->targetModel;
+    def->state = src->state;
+    def->target.port = src->target.port;
+
+    if (def->deviceType == VIR_DOMAIN_CHR_DEVICE_TYPE_CHANNEL) {
+        switch ((virDomainChrChannelTargetType) def->targetType) {
+        case VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_GUESTFWD:
+            if (VIR_DOMAIN_COPY_PLAIN(def->target.addr, src->target.addr) < 0)
+                goto error;
+            break;
+
+        case VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_XEN:
+        case VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_VIRTIO:
+            def->target.name = NULL;
+            if (VIR_STRDUP(def->target.name, src->target.name) < 0)
+                goto error;
+            break;
+
+        case VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_NONE:
+        case VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_LAST:
+            break;
+        }
+    }
+
+    if (virDomainDeviceInfoCopy(&def->info, &src->info) < 0 ||
+        !(def->source = virDomainChrSourceDefCopyNative(src->source, xmlopt)))
+        goto error;
+
+    return def;
+
+ error:
+    virDomainChrDefFree(def);
+    return NULL;
+}
+
+
+static virDomainDiskDefPtr
+virDomainDiskDefCopyNative(virDomainDiskDefPtr src,
+                           virDomainXMLOptionPtr xmlopt)
+{
+    virDomainDiskDefPtr def;
+    virObjectPtr priv;
+
+    if (!(def = virDomainDiskDefNew(xmlopt)))
+        return NULL;
+
+    virStorageSourceFree(def->src);
+    priv = def->privateData;
+    *def = *src;
+    def->privateData = priv;
+    def->src = NULL;
+    def->mirror = NULL;
+    def->dst = NULL;
+    def->serial = NULL;
+    def->wwn = NULL;
+    def->vendor = NULL;
+    def->product = NULL;
+    def->domain_name = NULL;
+    def->blkdeviotune.group_name = NULL;
+    def->virtio = NULL;
+
+    if (virDomainDeviceInfoCopy(&def->info, &src->info) < 0 ||
+        !(def->src = virStorageSourceCopy(src->src, true)) ||
+        VIR_STRDUP(def->dst, src->dst) < 0 ||
+        VIR_STRDUP(def->serial, src->serial) < 0 ||
+        VIR_STRDUP(def->wwn, src->wwn) < 0 ||
+        VIR_STRDUP(def->vendor, src->vendor) < 0 ||
+        VIR_STRDUP(def->product, src->product) < 0 ||
+        VIR_STRDUP(def->domain_name, src->domain_name) < 0 ||
+        VIR_STRDUP(def->blkdeviotune.group_name,
+                   src->blkdeviotune.group_name) < 0 ||
+        VIR_DOMAIN_COPY_PLAIN(def->virtio, src->virtio) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainDiskDefFree(def);
+    return NULL;
+}
+
+
+static virDomainControllerDefPtr
+virDomainControllerDefCopyNative(virDomainControllerDefPtr src,
+                                 virDomainXMLOptionPtr xmlopt ATTRIBUTE_UNUSED)
+{
+    virDomainControllerDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    def->virtio = NULL;
+
+    if (virDomainDeviceInfoCopy(&def->info, &src->info) < 0 ||
+        VIR_DOMAIN_COPY_PLAIN(def->virtio, src->virtio) < 0) {
+        virDomainControllerDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static int
+virDomainNetIPInfoCopyNative(virNetDevIPInfoPtr dst,
+                             const virNetDevIPInfo *src)
+{
+    size_t i;
+
+    if (!src->nips)
+        return 0;
+
+    if (VIR_ALLOC_N(dst->ips, src->nips) < 0)
+        return -1;
+    dst->nips = src->nips;
+
+    for (i = 0; i < src->nips; i++) {
+        if (VIR_DOMAIN_COPY_PLAIN(dst->ips[i], src->ips[i]) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static virDomainNetDefPtr
+virDomainNetDefCopyNative(virDomainNetDefPtr src,
+                          virDomainXMLOptionPtr xmlopt)
+{
+    virDomainNetDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    def->model = NULL;
+    def->backend.tap = NULL;
+    def->backend.vhost = NULL;
+    def->virtPortProfile = NULL;
+    def->script = NULL;
+    def->domain_name = NULL;
+    def->ifname = NULL;
+    def->ifname_guest = NULL;
+    def->ifname_guest_actual = NULL;
+    memset(&def->hostIP, 0, sizeof(def->hostIP));
+    memset(&def->guestIP, 0, sizeof(def->guestIP));
+    def->filter = NULL;
+    def->filterparams = NULL;
+    def->bandwidth = NULL;
+    memset(&def->vlan, 0, sizeof(def->vlan));
+    def->coalesce = NULL;
+    def->virtio = NULL;
+    if (virDomainDeviceInfoCopy(&def->info, &src->info) < 0)
+        goto error_type;
+
+    switch (def->type) {
+    case VIR_DOMAIN_NET_TYPE_VHOSTUSER:
+        if (!(def->data.vhostuser =
+              virDomainChrSourceDefCopyNative(src->data.vhostuser, xmlopt)))
+            goto error_type;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_SERVER:
+    case VIR_DOMAIN_NET_TYPE_CLIENT:
+    case VIR_DOMAIN_NET_TYPE_MCAST:
+    case VIR_DOMAIN_NET_TYPE_UDP:
+        def->data.socket.address = NULL;
+        def->data.socket.localaddr = NULL;
+        if (VIR_STRDUP(def->data.socket.address,
+                       src->data.socket.address) < 0 ||
+            VIR_STRDUP(def->data.socket.localaddr,
+                       src->data.socket.localaddr) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_NETWORK:
+        def->data.network.name = NULL;
+        def->data.network.portgroup = NULL;
+        def->data.network.actual = NULL;
+        if (VIR_STRDUP(def->data.network.name, src->data.network.name) < 0 ||
+            VIR_STRDUP(def->data.network.portgroup,
+                       src->data.network.portgroup) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_BRIDGE:
+        def->data.bridge.brname = NULL;
+        if (VIR_STRDUP(def->data.bridge.brname, src->data.bridge.brname) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_INTERNAL:
+        def->data.internal.name = NULL;
+        if (VIR_STRDUP(def->data.internal.name, src->data.internal.name) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_DIRECT:
+        def->data.direct.linkdev = NULL;
+        if (VIR_STRDUP(def->data.direct.linkdev, src->data.direct.linkdev) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_NET_TYPE_HOSTDEV:
+        /* Refused by virDomainDefCopyNativeSupported() */
+        goto error_type;
+
+    case VIR_DOMAIN_NET_TYPE_ETHERNET:
+    case VIR_DOMAIN_NET_TYPE_USER:
+    case VIR_DOMAIN_NET_TYPE_LAST:
+        break;
+    }
+
+    if (VIR_STRDUP(def->model, src->model) < 0 ||
+        VIR_STRDUP(def->backend.tap, src->backend.tap) < 0 ||
+        VIR_STRDUP(def->backend.vhost, src->backend.vhost) < 0 ||
+        VIR_DOMAIN_COPY_PLAIN(def->virtPortProfile, src->virtPortProfile) < 0 ||
+        VIR_STRDUP(def->script, src->script) < 0 ||
+        VIR_STRDUP(def->domain_name, src->domain_name) < 0 ||
+        VIR_STRDUP(def->ifname, src->ifname) < 0 ||
+        VIR_STRDUP(def->ifname_guest, src->ifname_guest) < 0 ||
+        VIR_STRDUP(def->ifname_guest_actual, src->ifname_guest_actual) < 0 ||
+        virDomainNetIPInfoCopyNative(&def->hostIP, &src->hostIP) < 0 ||
+        virDomainNetIPInfoCopyNative(&def->guestIP, &src->guestIP) < 0 ||
+        VIR_STRDUP(def->filter, src->filter) < 0 ||
+        virNetDevBandwidthCopy(&def->bandwidth, src->bandwidth) < 0 ||
+        virNetDevVlanCopy(&def->vlan, &src->vlan) < 0 ||
+        VIR_DOMAIN_COPY_PLAIN(def->coalesce, src->coalesce) < 0 ||
+        VIR_DOMAIN_COPY_PLAIN(def->virtio, src->virtio) < 0)
+        goto error;
+
+    if (src->filterparams &&
+        (!(def->filterparams = virNWFilterHashTableCreate(0)) ||
+         virNWFilterHashTablePutAll(src->filterparams, def->filterparams) < 0))
+        goto error;
+
+    return def;
+
+ error_type:
+    /* The type specific data still belongs to @src */
+    memset(&def->data, 0, sizeof(def->data));
+    def->type = VIR_DOMAIN_NET_TYPE_USER;
+ error:
+    virDomainNetDefFree(def);
+    return NULL;
+}
+
+
+static virDomainGraphicsDefPtr
+virDomainGraphicsDefCopyNative(virDomainGraphicsDefPtr src,
+                               virDomainXMLOptionPtr xmlopt ATTRIBUTE_UNUSED)
+{
+    virDomainGraphicsDefPtr def;
+    size_t i;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    def->listens = NULL;
+    def->nListens = 0;
+
+    switch (def->type) {
+    case VIR_DOMAIN_GRAPHICS_TYPE_VNC:
+        def->data.vnc.keymap = NULL;
+        def->data.vnc.auth.passwd = NULL;
+        if (VIR_STRDUP(def->data.vnc.keymap, src->data.vnc.keymap) < 0 ||
+            VIR_STRDUP(def->data.vnc.auth.passwd,
+                       src->data.vnc.auth.passwd) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_SDL:
+        def->data.sdl.display = NULL;
+        def->data.sdl.xauth = NULL;
+        if (VIR_STRDUP(def->data.sdl.display, src->data.sdl.display) < 0 ||
+            VIR_STRDUP(def->data.sdl.xauth, src->data.sdl.xauth) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_DESKTOP:
+        def->data.desktop.display = NULL;
+        if (VIR_STRDUP(def->data.desktop.display,
+                       src->data.desktop.display) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_SPICE:
+        def->data.spice.keymap = NULL;
+        def->data.spice.auth.passwd = NULL;
+        def->data.spice.rendernode = NULL;
+        if (VIR_STRDUP(def->data.spice.keymap, src->data.spice.keymap) < 0 ||
+            VIR_STRDUP(def->data.spice.auth.passwd,
+                       src->data.spice.auth.passwd) < 0 ||
+            VIR_STRDUP(def->data.spice.rendernode,
+                       src->data.spice.rendernode) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_GRAPHICS_TYPE_RDP:
+    case VIR_DOMAIN_GRAPHICS_TYPE_LAST:
+        break;
+    }
+
+    if (src->nListens) {
+        if (VIR_ALLOC_N(def->listens, src->nListens) < 0)
+            goto error;
+        def->nListens = src->nListens;
+    }
+
+    for (i = 0; i < src->nListens; i++) {
+        virDomainGraphicsListenDefPtr listen = &def->listens[i];
+
+        listen->type = src->listens[i].type;
+        listen->fromConfig = src->listens[i].fromConfig;
+        listen->autoGenerated = src->listens[i].autoGenerated;
+
+        if (VIR_STRDUP(listen->address, src->listens[i].address) < 0 ||
+            VIR_STRDUP(listen->network, src->listens[i].network) < 0 ||
+            VIR_STRDUP(listen->socket, src->listens[i].socket) < 0)
+            goto error;
+    }
+
+    return def;
+
+ error:
+    virDomainGraphicsDefFree(def);
+    return NULL;
+}
+
+
+static virDomainInputDefPtr
+virDomainInputDefCopyNative(virDomainInputDefPtr src,
+                            virDomainXMLOptionPtr xmlopt ATTRIBUTE_UNUSED)
+{
+    virDomainInputDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    def->source.evdev = NULL;
+    def->virtio = NULL;
+
+    if (virDomainDeviceInfoCopy(&def->info, &src->info) < 0 ||
+        VIR_STRDUP(def->source.evdev, src->source.evdev) < 0 ||
+        VIR_DOMAIN_COPY_PLAIN(def->virtio, src->virtio) < 0) {
+        virDomainInputDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainSoundDefPtr
+virDomainSoundDefCopyNative(virDomainSoundDefPtr src,
+                            virDomainXMLOptionPtr xmlopt ATTRIBUTE_UNUSED)
+{
+    virDomainSoundDefPtr def;
+    size_t i;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    def->codecs = NULL;
+    def->ncodecs = 0;
+
+    if (virDomainDeviceInfoCopy(&def->info, &src->info) < 0)
+        goto error;
+
+    if (src->ncodecs) {
+        if (VIR_ALLOC_N(def->codecs, src->ncodecs) < 0)
+            goto error;
+        def->ncodecs = src->ncodecs;
+    }
+
+    for (i = 0; i < src->ncodecs; i++) {
+        if (VIR_DOMAIN_COPY_PLAIN(def->codecs[i], src->codecs[i]) < 0)
+            goto error;
+    }
+
+    return def;
+
+ error:
+    virDomainSoundDefFree(def);
+    return NULL;
+}
+
+
+static virDomainVideoDefPtr
+virDomainVideoDefCopyNative(virDomainVideoDefPtr src,
+                            virDomainXMLOptionPtr xmlopt ATTRIBUTE_UNUSED)
+{
+    virDomainVideoDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    def->accel = NULL;
+    def->driver = NULL;
+    def->virtio = NULL;
+
+    if (virDomainDeviceInfoCopy(&def->info, &src->info) < 0 ||
+        VIR_DOMAIN_COPY_PLAIN(def->accel, src->accel) < 0 ||
+        VIR_DOMAIN_COPY_PLAIN(def->driver, src->driver) < 0 ||
+        VIR_DOMAIN_COPY_PLAIN(def->virtio, src->virtio) < 0) {
+        virDomainVideoDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainHubDefPtr
+virDomainHubDefCopyNative(virDomainHubDefPtr src,
+                          virDomainXMLOptionPtr xmlopt ATTRIBUTE_UNUSED)
+{
+    virDomainHubDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+
+    if (virDomainDeviceInfoCopy(&def->info, &src->info) < 0) {
+        virDomainHubDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainRNGDefPtr
+virDomainRNGDefCopyNative(virDomainRNGDefPtr src,
+                          virDomainXMLOptionPtr xmlopt)
+{
+    virDomainRNGDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+    memset(&def->source, 0, sizeof(def->source));
+    def->virtio = NULL;
+
+    if (virDomainDeviceInfoCopy(&def->info, &src->info) < 0 ||
+        VIR_DOMAIN_COPY_PLAIN(def->virtio, src->virtio) < 0)
+        goto error;
+
+    switch ((virDomainRNGBackend) def->backend) {
+    case VIR_DOMAIN_RNG_BACKEND_RANDOM:
+        if (VIR_STRDUP(def->source.file, src->source.file) < 0)
+            goto error;
+        break;
+
+    case VIR_DOMAIN_RNG_BACKEND_EGD:
+        if (!(def->source.chardev =
+              virDomainChrSourceDefCopyNative(src->source.chardev, xmlopt)))
+            goto error;
+        break;
+
+    case VIR_DOMAIN_RNG_BACKEND_LAST:
+        break;
+    }
+
+    return def;
+
+ error:
+    virDomainRNGDefFree(def);
+    return NULL;
+}
+
+
+static virDomainPanicDefPtr
+virDomainPanicDefCopyNative(virDomainPanicDefPtr src,
+                            virDomainXMLOptionPtr xmlopt ATTRIBUTE_UNUSED)
+{
+    virDomainPanicDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+
+    if (virDomainDeviceInfoCopy(&def->info, &src->info) < 0) {
+        virDomainPanicDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainLeaseDefPtr
+virDomainLeaseDefCopyNative(virDomainLeaseDefPtr src,
+                            virDomainXMLOptionPtr xmlopt ATTRIBUTE_UNUSED)
+{
+    virDomainLeaseDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    def->offset = src->offset;
+
+    if (VIR_STRDUP(def->lockspace, src->lockspace) < 0 ||
+        VIR_STRDUP(def->key, src->key) < 0 ||
+        VIR_STRDUP(def->path, src->path) < 0) {
+        virDomainLeaseDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainVcpuDefPtr
+virDomainVcpuDefCopyNative(virDomainVcpuDefPtr src,
+                           virDomainXMLOptionPtr xmlopt)
+{
+    virDomainVcpuDefPtr def;
+
+    if (!(def = virDomainVcpuDefNew(xmlopt)))
+        return NULL;
+
+    def->online = src->online;
+    def->hotpluggable = src->hotpluggable;
+    def->order = src->order;
+    def->sched = src->sched;
+
+    if (virDomainBitmapCopy(&def->cpumask, src->cpumask) < 0) {
+        virDomainVcpuDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virDomainIOThreadIDDefPtr
+virDomainIOThreadIDDefCopyNative(virDomainIOThreadIDDefPtr src,
+                                 virDomainXMLOptionPtr xmlopt ATTRIBUTE_UNUSED)
+{
+    virDomainIOThreadIDDefPtr def;
+
+    if (VIR_ALLOC(def) < 0)
+        return NULL;
+
+    *def = *src;
+
+    if (virDomainBitmapCopy(&def->cpumask, src->cpumask) < 0) {
+        virDomainIOThreadIDDefFree(def);
+        return NULL;
+    }
+
+    return def;
+}
+
+
+static virSecurityLabelDefPtr
+virDomainSeclabelDefCopyNative(virSecurityLabelDefPtr src,
+                               virDomainXMLOptionPtr xmlopt ATTRIBUTE_UNUSED)
+{
+    return virSecurityLabelDefCopy(src);
+}
+
+
+static virDomainTimerDefPtr
+virDomainTimerDefCopyNative(virDomainTimerDefPtr src,
+                            virDomainXMLOptionPtr xmlopt ATTRIBUTE_UNUSED)
+{
+    virDomainTimerDefPtr def = NULL;
+
+    ignore_value(VIR_DOMAIN_COPY_PLAIN(def, src));
+    return def;
+}
+
+
+static bool
+virDomainDefCopyNativeSupported(const virDomainDef *def)
+{
+    size_t i;
+
+    /* Live definitions carry runtime state the formatter decides
+     * about, and devices below own data there's no copy code for */
+    if (def->id != -1 ||
+        def->postParseFailed ||
+        def->namespaceData ||
+        def->ncachetunes ||
+        def->nfss ||
+        def->nhostdevs ||
+        def->nredirdevs ||
+        def->nsmartcards ||
+        def->nshmems ||
+        def->nmems ||
+        def->nvram ||
+        def->tpm ||
+        def->sysinfo ||
+        def->redirfilter)
+        return false;
+
+    for (i = 0; i < def->ndisks; i++) {
+        if (def->disks[i]->mirror)
+            return false;
+    }
+
+    for (i = 0; i < def->nnets; i++) {
+        virDomainNetDefPtr net = def->nets[i];
+
+        if (net->type == VIR_DOMAIN_NET_TYPE_HOSTDEV ||
+            (net->type == VIR_DOMAIN_NET_TYPE_NETWORK &&
+             net->data.network.actual) ||
+            net->hostIP.nroutes ||
+            net->guestIP.nroutes)
+            return false;
+    }
+
+    return true;
+}
+
+
+#define VIR_DOMAIN_DEF_COPY_ARRAY(field, nfield, copyFunc) \
+    do { \
+        if (src->nfield) { \
+            if (VIR_ALLOC_N(def->field, src->nfield) < 0) \
+                goto error; \
+            def->nfield = src->nfield; \
+        } \
+        for (i = 0; i < src->nfield; i++) { \
+            if (!(def->field[i] = copyFunc(src->field[i], xmlopt))) \
+                goto error; \
+        } \
+    } while (0)
+
+
+/**
+ * virDomainDefCopyNative:
+ * @src: definition to copy
+ * @xmlopt: XML parser configuration object
+ * @copy: filled in with the copy
+ *
+ * Copies @src without formatting it to XML and parsing it back. The
+ * post parse callbacks are not run again as @src went through them
+ * already. Only inactive definitions made of devices this function
+ * knows how to copy are supported; for anything else the caller has
+ * to use virDomainDefCopy().
+ *
+ * Returns 1 if @copy was filled in, 0 if @src is not supported and -1
+ * on error.
+ */
+int
+virDomainDefCopyNative(virDomainDefPtr src,
+                       virDomainXMLOptionPtr xmlopt,
+                       virDomainDefPtr *copy)
+{
+    virDomainDefPtr def = NULL;
+    size_t i;
+
+    *copy = NULL;
+
+    if (!virDomainDefCopyNativeSupported(src))
+        return 0;
+
+    if (VIR_ALLOC(def) < 0)
+        return -1;
+
+    /* first a shallow copy of *everything* */
+    *def = *src;
+
+    /* then forget whatever still points into @src */
+    def->name = NULL;
+    def->title = NULL;
+    def->description = NULL;
+    def->blkio.devices = NULL;
+    def->blkio.ndevices = 0;
+    def->mem.hugepages = NULL;
+    def->mem.nhugepages = 0;
+    def->vcpus = NULL;
+    def->maxvcpus = 0;
+    def->cpumask = NULL;
+    def->iothreadids = NULL;
+    def->niothreadids = 0;
+    def->cputune.emulatorpin = NULL;
+    def->numa = NULL;
+    def->resource = NULL;
+    memset(&def->idmap, 0, sizeof(def->idmap));
+    def->os.machine = NULL;
+    def->os.init = NULL;
+    def->os.initargv = NULL;
+    def->os.initenv = NULL;
+    def->os.initdir = NULL;
+    def->os.inituser = NULL;
+    def->os.initgroup = NULL;
+    def->os.kernel = NULL;
+    def->os.initrd = NULL;
+    def->os.cmdline = NULL;
+    def->os.dtb = NULL;
+    def->os.root = NULL;
+    def->os.slic_table = NULL;
+    def->os.loader = NULL;
+    def->os.bootloader = NULL;
+    def->os.bootloaderArgs = NULL;
+    def->emulator = NULL;
+    def->hyperv_vendor_id = NULL;
+    if (def->clock.offset == VIR_DOMAIN_CLOCK_OFFSET_TIMEZONE)
+        def->clock.data.timezone = NULL;
+    def->clock.timers = NULL;
+    def->clock.ntimers = 0;
+    def->graphics = NULL;
+    def->ngraphics = 0;
+    def->disks = NULL;
+    def->ndisks = 0;
+    def->controllers = NULL;
+    def->ncontrollers = 0;
+    def->nets = NULL;
+    def->nnets = 0;
+    def->inputs = NULL;
+    def->ninputs = 0;
+    def->sounds = NULL;
+    def->nsounds = 0;
+    def->videos = NULL;
+    def->nvideos = 0;
+    def->serials = NULL;
+    def->nserials = 0;
+    def->parallels = NULL;
+    def->nparallels = 0;
+    def->channels = NULL;
+    def->nchannels = 0;
+    def->consoles = NULL;
+    def->nconsoles = 0;
+    def->leases = NULL;
+    def->nleases = 0;
+    def->hubs = NULL;
+    def->nhubs = 0;
+    def->seclabels = NULL;
+    def->nseclabels = 0;
+    def->rngs = NULL;
+    def->nrngs = 0;
+    def->panics = NULL;
+    def->npanics = 0;
+    /* These are empty, but may still hold an emptied array */
+    def->cachetunes = NULL;
+    def->fss = NULL;
+    def->hostdevs = NULL;
+    def->redirdevs = NULL;
+    def->smartcards = NULL;
+    def->shmems = NULL;
+    def->mems = NULL;
+    def->watchdog = NULL;
+    def->memballoon = NULL;
+    def->cpu = NULL;
+    def->iommu = NULL;
+    def->keywrap = NULL;
+    def->metadata = NULL;
+
+    if (VIR_STRDUP(def->name, src->name) < 0 ||
+        VIR_STRDUP(def->title, src->title) < 0 ||
+        VIR_STRDUP(def->description, src->description) < 0)
+        goto error;
+
+    if (src->blkio.ndevices) {
+        if (VIR_ALLOC_N(def->blkio.devices, src->blkio.ndevices) < 0)
+            goto error;
+        def->blkio.ndevices = src->blkio.ndevices;
+    }
+    for (i = 0; i < src->blkio.ndevices; i++) {
+        def->blkio.devices[i] = src->blkio.devices[i];
+        def->blkio.devices[i].path = NULL;
+        if (VIR_STRDUP(def->blkio.devices[i].path,
+                       src->blkio.devices[i].path) < 0)
+            goto error;
+    }
+
+    if (src->mem.nhugepages) {
+        if (VIR_ALLOC_N(def->mem.hugepages, src->mem.nhugepages) < 0)
+            goto error;
+        def->mem.nhugepages = src->mem.nhugepages;
+    }
+    for (i = 0; i < src->mem.nhugepages; i++) {
+        def->mem.hugepages[i].size = src->mem.hugepages[i].size;
+        if (virDomainBitmapCopy(&def->mem.hugepages[i].nodemask,
+                                src->mem.hugepages[i].nodemask) < 0)
+            goto error;
+    }
+
+    VIR_DOMAIN_DEF_COPY_ARRAY(vcpus, maxvcpus, virDomainVcpuDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(iothreadids, niothreadids,
+                              virDomainIOThreadIDDefCopyNative);
+
+    if (virDomainBitmapCopy(&def->cpumask, src->cpumask) < 0 ||
+        virDomainBitmapCopy(&def->cputune.emulatorpin,
+                            src->cputune.emulatorpin) < 0)
+        goto error;
+
+    if (src->numa && !(def->numa = virDomainNumaCopy(src->numa)))
+        goto error;
+
+    if (src->resource) {
+        if (VIR_ALLOC(def->resource) < 0 ||
+            VIR_STRDUP(def->resource->partition, src->resource->partition) < 0)
+            goto error;
+    }
+
+    if (src->idmap.nuidmap) {
+        if (VIR_ALLOC_N(def->idmap.uidmap, src->idmap.nuidmap) < 0)
+            goto error;
+        memcpy(def->idmap.uidmap, src->idmap.uidmap,
+               src->idmap.nuidmap * sizeof(*def->idmap.uidmap));
+        def->idmap.nuidmap = src->idmap.nuidmap;
+    }
+    if (src->idmap.ngidmap) {
+        if (VIR_ALLOC_N(def->idmap.gidmap, src->idmap.ngidmap) < 0)
+            goto error;
+        memcpy(def->idmap.gidmap, src->idmap.gidmap,
+               src->idmap.ngidmap * sizeof(*def->idmap.gidmap));
+        def->idmap.ngidmap = src->idmap.ngidmap;
+    }
+
+    if (VIR_STRDUP(def->os.machine, src->os.machine) < 0 ||
+        VIR_STRDUP(def->os.init, src->os.init) < 0 ||
+        VIR_STRDUP(def->os.initdir, src->os.initdir) < 0 ||
+        VIR_STRDUP(def->os.inituser, src->os.inituser) < 0 ||
+        VIR_STRDUP(def->os.initgroup, src->os.initgroup) < 0 ||
+        VIR_STRDUP(def->os.kernel, src->os.kernel) < 0 ||
+        VIR_STRDUP(def->os.initrd, src->os.initrd) < 0 ||
+        VIR_STRDUP(def->os.cmdline, src->os.cmdline) < 0 ||
+        VIR_STRDUP(def->os.dtb, src->os.dtb) < 0 ||
+        VIR_STRDUP(def->os.root, src->os.root) < 0 ||
+        VIR_STRDUP(def->os.slic_table, src->os.slic_table) < 0 ||
+        VIR_STRDUP(def->os.bootloader, src->os.bootloader) < 0 ||
+        VIR_STRDUP(def->os.bootloaderArgs, src->os.bootloaderArgs) < 0)
+        goto error;
+
+    if (src->os.initargv &&
+        virStringListCopy(&def->os.initargv,
+                          (const char **) src->os.initargv) < 0)
+        goto error;
+
+    if (src->os.initenv) {
+        size_t n = 0;
+
+        while (src->os.initenv[n])
+            n++;
+
+        if (VIR_ALLOC_N(def->os.initenv, n + 1) < 0)
+            goto error;
+
+        for (i = 0; i < n; i++) {
+            if (VIR_ALLOC(def->os.initenv[i]) < 0 ||
+                VIR_STRDUP(def->os.initenv[i]->name,
+                           src->os.initenv[i]->name) < 0 ||
+                VIR_STRDUP(def->os.initenv[i]->value,
+                           src->os.initenv[i]->value) < 0)
+                goto error;
+        }
+    }
+
+    if (src->os.loader) {
+        if (VIR_ALLOC(def->os.loader) < 0)
+            goto error;
+        def->os.loader->readonly = src->os.loader->readonly;
+        def->os.loader->type = src->os.loader->type;
+        def->os.loader->secure = src->os.loader->secure;
+        if (VIR_STRDUP(def->os.loader->path, src->os.loader->path) < 0 ||
+            VIR_STRDUP(def->os.loader->nvram, src->os.loader->nvram) < 0 ||
+            VIR_STRDUP(def->os.loader->templt, src->os.loader->templt) < 0)
+            goto error;
+    }
+
+    if (VIR_STRDUP(def->emulator, src->emulator) < 0 ||
+        VIR_STRDUP(def->hyperv_vendor_id, src->hyperv_vendor_id) < 0)
+        goto error;
+
+    if (src->clock.offset == VIR_DOMAIN_CLOCK_OFFSET_TIMEZONE &&
+        VIR_STRDUP(def->clock.data.timezone, src->clock.data.timezone) < 0)
+        goto error;
+
+    VIR_DOMAIN_DEF_COPY_ARRAY(clock.timers, clock.ntimers,
+                              virDomainTimerDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(graphics, ngraphics,
+                              virDomainGraphicsDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(disks, ndisks, virDomainDiskDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(controllers, ncontrollers,
+                              virDomainControllerDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(nets, nnets, virDomainNetDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(inputs, ninputs, virDomainInputDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(sounds, nsounds, virDomainSoundDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(videos, nvideos, virDomainVideoDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(serials, nserials, virDomainChrDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(parallels, nparallels, virDomainChrDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(channels, nchannels, virDomainChrDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(consoles, nconsoles, virDomainChrDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(leases, nleases, virDomainLeaseDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(hubs, nhubs, virDomainHubDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(seclabels, nseclabels,
+                              virDomainSeclabelDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(rngs, nrngs, virDomainRNGDefCopyNative);
+    VIR_DOMAIN_DEF_COPY_ARRAY(panics, npanics, virDomainPanicDefCopyNative);
+
+    if (src->watchdog) {
+        if (VIR_ALLOC(def->watchdog) < 0)
+            goto error;
+        *def->watchdog = *src->watchdog;
+        if (virDomainDeviceInfoCopy(&def->watchdog->info,
+                                    &src->watchdog->info) < 0)
+            goto error;
+    }
+
+    if (src->memballoon) {
+        if (VIR_ALLOC(def->memballoon) < 0)
+            goto error;
+        *def->memballoon = *src->memballoon;
+        def->memballoon->virtio = NULL;
+        if (virDomainDeviceInfoCopy(&def->memballoon->info,
+                                    &src->memballoon->info) < 0 ||
+            VIR_DOMAIN_COPY_PLAIN(def->memballoon->virtio,
+                                  src->memballoon->virtio) < 0)
+            goto error;
+    }
+
+    if (src->cpu && !(def->cpu = virCPUDefCopy(src->cpu)))
+        goto error;
+
+    if (VIR_DOMAIN_COPY_PLAIN(def->iommu, src->iommu) < 0 ||
+        VIR_DOMAIN_COPY_PLAIN(def->keywrap, src->keywrap) < 0)
+        goto error;
+
+    if (src->metadata &&
+        !(def->metadata = xmlCopyNode(src->metadata, 1))) {
+        virReportOOMError();
+        goto error;
+    }
+
+    *copy = def;
+    return 1;
+
+ error:
+    virDomainDefFree(def);
+    return -1;
+}
+
+#undef VIR_DOMAIN_DEF_COPY_ARRAY
+
+
+/* Copy src into a new definition; with the quality of the copy
+ * depending on the migratable flag (false for transitions between
+ * persistent and active, true for transitions across save files or
+ * snapshots).  */
+virDomainDefPtr
+virDomainDefCopy(virDomainDefPtr src,
+                 virCapsPtr caps,
+                 virDomainXMLOptionPtr xmlopt,
+                 void *parseOpaque,
+                 bool migratable)
+{
+    char *xml;
+    virDomainDefPtr ret;
+    unsigned int format_flags = VIR_DOMAIN_DEF_FORMAT_SECURE;
+    unsigned int parse_flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                               VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
+
+    if (migratable) {
+        format_flags |= VIR_DOMAIN_DEF_FORMAT_INACTIVE | VIR_DOMAIN_DEF_FORMAT_MIGRATABLE;
+    } else {
+        /* Try a direct copy first, the migratable flavour has to go
+         * through the formatter to drop what it's asked to */
+        switch (virDomainDefCopyNative(src, xmlopt, &ret)) {
+        case 1:
+            return ret;
+        case 0:
+            break;
+        default:
+            return NULL;
+        }
+    }
+
+    /* Otherwise clone via a round-trip through XML.  */
+    if (!(xml = virDomainDefFormat(src, caps, format_flags)))
+        return NULL;
+
+    ret = virDomainDefParseString(xml, caps, xmlopt, parseOpaque, parse_flags);
+
+    VIR_FREE(xml);
+    return ret;
+}
+
+virDomainDefPtr
+virDomainObjCopyPersistentDef(virDomainObjPtr dom,
+                              virCapsPtr caps,
+                              virDomainXMLOptionPtr xmlopt)
+{
+    virDomainDefPtr cur;
+
+    cur = virDomainObjGetPersistentDef(caps, xmlopt, dom);
+    return virDomainDefCopy(cur, caps, xmlopt, NULL, false);
+}
+
+
+virDomainState
+virDomainObjGetState(virDomainObjPtr dom, int *reason)
+{
+    if (reason)
+        *reason = dom->state.reason;
+
+    return dom->state.state;
+}
+
+
+void
+virDomainObjSetState(virDomainObjPtr dom, virDomainState state, int reason)
+{
+    int last = -1;
+
+    switch (state) {
+    case VIR_DOMAIN_NOSTATE:
+        last = VIR_DOMAIN_NOSTATE_LAST;
+        break;
+    case VIR_DOMAIN_RUNNING:
+        last = VIR_DOMAIN_RUNNING_LAST;
+        break;
+    case VIR_DOMAIN_BLOCKED:
+        last = VIR_DOMAIN_BLOCKED_LAST;
+        break;
+    case VIR_DOMAIN_PAUSED:
+        last = VIR_DOMAIN_PAUSED_LAST;
+        break;
+    case VIR_DOMAIN_SHUTDOWN:
+        last = VIR_DOMAIN_SHUTDOWN_LAST;
+        break;
+    case VIR_DOMAIN_SHUTOFF:
+        last = VIR_DOMAIN_SHUTOFF_LAST;
+        break;
+    case VIR_DOMAIN_CRASHED:
+        last = VIR_DOMAIN_CRASHED_LAST;
+        break;
+    case VIR_DOMAIN_PMSUSPENDED:
+        last = VIR_DOMAIN_PMSUSPENDED_LAST;
+        break;
+    default:
+        last = -1;
+    }
+
+    if (last < 0) {
+        VIR_ERROR(_("invalid domain state: %d"), state);
+        return;
+    }
+
+    dom->state.state = state;
+    if (reason > 0 && reason < last)
+        dom->state.reason = reason;
+    else
+        dom->state.reason = 0;
+
+    virDomainObjUpdateSummary(dom);
 }
 
 
@@ -2500,6 +2500,23 @@ struct _virDomainStateReason {
     int reason;
 };
 
+/* Copy of the frequently read parts of a domain object, which can be
+ * obtained without waiting for the domain object lock */
+typedef struct _virDomainObjSummary virDomainObjSummary;
+typedef virDomainObjSummary *virDomainObjSummaryPtr;
+struct _virDomainObjSummary {
+    virDomainDefPtr def; /* only name, uuid and id are filled in */
+    pid_t pid;
+    virDomainStateReason state;
+    bool persistent;
+
+    unsigned long long maxMem; /* in KiB */
+    unsigned long long memory; /* in KiB */
+    unsigned int vcpus;
+
+    unsigned long long generation; /* of the latest change */
+};
+
 typedef struct _virDomainObj virDomainObj;
 typedef virDomainObj *virDomainObjPtr;
 struct _virDomainObj {
@@ -2529,6 +2546,12 @@ struct _virDomainObj {
 
     unsigned long long original_memlock; /* Original RLIMIT_MEMLOCK, zero if no
                                           * restore will be required later */
+
+    /* Updated from the fields above whenever the object lock is about
+     * to be released or the state changes. Guarded by @summaryLock,
+     * which is never held for longer than it takes to copy it. */
+    virMutex summaryLock;
+    virDomainObjSummary summary;
 };
 
 typedef bool (*virDomainObjListACLFilter)(virConnectPtr conn,
@@ -2737,6 +2760,22 @@ virDomainObjPtr virDomainObjNew(virDomainXMLOptionPtr caps)
 
 void virDomainObjEndAPI(virDomainObjPtr *vm);
 
+unsigned long long virDomainObjNextGeneration(void);
+unsigned long long virDomainObjCurrentGeneration(void);
+
+void virDomainObjUpdateSummary(virDomainObjPtr vm)
+    ATTRIBUTE_NONNULL(1);
+void virDomainObjMarkChanged(virDomainObjPtr vm)
+    ATTRIBUTE_NONNULL(1);
+int virDomainObjGetSummary(virDomainObjPtr vm,
+                           virDomainObjSummaryPtr summary)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+int virDomainObjGetSummaryID(virDomainObjPtr vm)
+    ATTRIBUTE_NONNULL(1);
+unsigned long long virDomainObjGetSummaryGeneration(virDomainObjPtr vm)
+    ATTRIBUTE_NONNULL(1);
+void virDomainObjSummaryClear(virDomainObjSummaryPtr summary);
+
 bool virDomainObjTaint(virDomainObjPtr obj,
                        virDomainTaintFlags taint);
 
@@ -2861,6 +2900,10 @@ virDomainDefPtr virDomainDefCopy(virDomainDefPtr src,
                                  virDomainXMLOptionPtr xmlopt,
                                  void *parseOpaque,
                                  bool migratable);
+int virDomainDefCopyNative(virDomainDefPtr src,
+                           virDomainXMLOptionPtr xmlopt,
+                           virDomainDefPtr *copy)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(3);
 virDomainDefPtr virDomainObjCopyPersistentDef(virDomainObjPtr dom,
                                               virCapsPtr caps,
                                               virDomainXMLOptionPtr xmlopt);
@@ -1069,6 +1069,73 @@ virDomainNumaNew(void)
 }
 
 
+static int
+virDomainNumaBitmapCopy(virBitmapPtr *dst,
+                        virBitmapPtr src)
+{
+    if (src && !(*dst = virBitmapNewCopy(src)))
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * virDomainNumaCopy:
+ * @src: NUMA definition to copy
+ *
+ * Returns a deep copy of @src or NULL on error.
+ */
+virDomainNumaPtr
+virDomainNumaCopy(virDomainNumaPtr src)
+{
+    virDomainNumaPtr ret = NULL;
+    size_t i;
+
+    if (!(ret = virDomainNumaNew()))
+        return NULL;
+
+    ret->memory = src->memory;
+    ret->memory.nodeset = NULL;
+    if (virDomainNumaBitmapCopy(&ret->memory.nodeset, src->memory.nodeset) < 0)
+        goto error;
+
+    if (src->nmem_nodes) {
+        if (VIR_ALLOC_N(ret->mem_nodes, src->nmem_nodes) < 0)
+            goto error;
+        ret->nmem_nodes = src->nmem_nodes;
+    }
+
+    for (i = 0; i < src->nmem_nodes; i++) {
+        struct _virDomainNumaNode *node = &ret->mem_nodes[i];
+
+        node->mem = src->mem_nodes[i].mem;
+        node->mode = src->mem_nodes[i].mode;
+        node->memAccess = src->mem_nodes[i].memAccess;
+
+        if (virDomainNumaBitmapCopy(&node->cpumask,
+                                    src->mem_nodes[i].cpumask) < 0 ||
+            virDomainNumaBitmapCopy(&node->nodeset,
+                                    src->mem_nodes[i].nodeset) < 0)
+            goto error;
+
+        if (src->mem_nodes[i].ndistances) {
+            if (VIR_ALLOC_N(node->distances, src->mem_nodes[i].ndistances) < 0)
+                goto error;
+            memcpy(node->distances, src->mem_nodes[i].distances,
+                   src->mem_nodes[i].ndistances * sizeof(*node->distances));
+            node->ndistances = src->mem_nodes[i].ndistances;
+        }
+    }
+
+    return ret;
+
+ error:
+    virDomainNumaFree(ret);
+    return NULL;
+}
+
+
 bool
 virDomainNumaCheckABIStability(virDomainNumaPtr src,
                                virDomainNumaPtr tgt)
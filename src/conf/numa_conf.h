@@ -56,6 +56,8 @@ VIR_ENUM_DECL(virDomainMemoryAccess)
 
 
 virDomainNumaPtr virDomainNumaNew(void);
+virDomainNumaPtr virDomainNumaCopy(virDomainNumaPtr src)
+    ATTRIBUTE_NONNULL(1);
 void virDomainNumaFree(virDomainNumaPtr numa);
 
 /*
@@ -30,8 +30,12 @@
 #include "snapshot_conf.h"
 #include "viralloc.h"
 #include "virfile.h"
+#include "virhostcpu.h"
 #include "virlog.h"
+#include "virshardedhash.h"
 #include "virstring.h"
+#include "virthreadpool.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_DOMAIN
 
@@ -41,16 +45,37 @@ static virClassPtr virDomainObjListClass;
 static void virDomainObjListDispose(void *obj);
 
 
+/* Removed domains are remembered for virDomainObjListExportChanges()
+ * up to this number */
+#define VIR_DOMAIN_OBJ_LIST_REMOVED_MAX 4096
+
+typedef struct _virDomainObjListRemoved virDomainObjListRemoved;
+typedef virDomainObjListRemoved *virDomainObjListRemovedPtr;
+struct _virDomainObjListRemoved {
+    virDomainDefPtr def; /* only name and uuid are filled in */
+    unsigned long long generation;
+};
+
+/* The tables are changed only with the list lock held for writing,
+ * which keeps the pair of them consistent, while lookups in them take
+ * neither the list lock nor any lock of the tables. */
 struct _virDomainObjList {
     virObjectRWLockable parent;
 
     /* uuid string -> virDomainObj  mapping
      * for O(1), lockless lookup-by-uuid */
-    virHashTable *objs;
+    virShardedHashPtr objs;
 
     /* name -> virDomainObj mapping for O(1),
      * lockless lookup-by-name */
-    virHashTable *objsName;
+    virShardedHashPtr objsName;
+
+    /* Recently removed domains, oldest first */
+    virDomainObjListRemovedPtr removed;
+    size_t nremoved;
+
+    /* Removals up to this generation may have been forgotten */
+    unsigned long long removedHorizon;
 };
 
 
@@ -77,12 +102,14 @@ virDomainObjListPtr virDomainObjListNew(void)
     if (!(doms = virObjectRWLockableNew(virDomainObjListClass)))
         return NULL;
 
-    if (!(doms->objs = virHashCreate(50, virObjectFreeHashData)) ||
-        !(doms->objsName = virHashCreate(50, virObjectFreeHashData))) {
+    if (!(doms->objs = virShardedHashNew()) ||
+        !(doms->objsName = virShardedHashNew())) {
         virObjectUnref(doms);
         return NULL;
     }
 
+    doms->removedHorizon = virDomainObjCurrentGeneration();
+
     return doms;
 }
 
@@ -91,25 +118,158 @@ static void virDomainObjListDispose(void *obj)
 {
     virDomainObjListPtr doms = obj;
 
-    virHashFree(doms->objs);
-    virHashFree(doms->objsName);
+    size_t i;
+
+    virShardedHashFree(doms->objs);
+    virShardedHashFree(doms->objsName);
+
+    for (i = 0; i < doms->nremoved; i++)
+        virDomainDefFree(doms->removed[i].def);
+    VIR_FREE(doms->removed);
+}
+
+
+/*
+ * Look up @key in the uuid table, or the name table if @byName is
+ * true, while holding the list lock, which keeps the domain object
+ * found in the tables.
+ */
+static virDomainObjPtr
+virDomainObjListLookupLocked(virDomainObjListPtr doms,
+                             const char *key,
+                             bool byName)
+{
+    virDomainObjPtr obj;
+
+    obj = virShardedHashLookupRef(byName ? doms->objsName : doms->objs, key);
+    virObjectUnref(obj);
+    return obj;
+}
+
+
+/*
+ * Add @dom to both tables of @doms, which the caller must hold the
+ * write lock on. The tables take their own references on @dom.
+ */
+static int
+virDomainObjListAddTables(virDomainObjListPtr doms,
+                          virDomainObjPtr dom)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    virUUIDFormat(dom->def->uuid, uuidstr);
+
+    if (virShardedHashAdd(doms->objs, uuidstr, dom) < 0)
+        return -1;
+
+    if (virShardedHashAdd(doms->objsName, dom->def->name, dom) < 0) {
+        virShardedHashRemove(doms->objs, uuidstr);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Remember that @dom was removed from @doms, which the caller must hold
+ * the write lock on.
+ */
+static void
+virDomainObjListRecordRemoval(virDomainObjListPtr doms,
+                              virDomainObjPtr dom)
+{
+    virDomainObjListRemoved removed = { NULL, 0 };
+
+    if (doms->nremoved == VIR_DOMAIN_OBJ_LIST_REMOVED_MAX) {
+        doms->removedHorizon = doms->removed[0].generation;
+        virDomainDefFree(doms->removed[0].def);
+        VIR_DELETE_ELEMENT(doms->removed, 0, doms->nremoved);
+    }
+
+    removed.generation = virDomainObjNextGeneration();
+
+    if (!(removed.def = virDomainDefNewFull(dom->def->name,
+                                            dom->def->uuid, -1)) ||
+        VIR_APPEND_ELEMENT(doms->removed, doms->nremoved, removed) < 0) {
+        /* Make listings of changes since before now fail rather than
+         * miss this removal */
+        VIR_WARN("Forgetting removal of domain '%s'", dom->def->name);
+        virDomainDefFree(removed.def);
+        doms->removedHorizon = removed.generation;
+    }
+}
+
+
+/*
+ * Forget any removal of the domain with @uuid, which is being added
+ * to @doms again. The caller must hold the write lock on @doms.
+ */
+static void
+virDomainObjListForgetRemoval(virDomainObjListPtr doms,
+                              const unsigned char *uuid)
+{
+    size_t i;
+
+    for (i = 0; i < doms->nremoved; i++) {
+        if (memcmp(doms->removed[i].def->uuid, uuid, VIR_UUID_BUFLEN) == 0) {
+            virDomainDefFree(doms->removed[i].def);
+            VIR_DELETE_ELEMENT(doms->removed, i, doms->nremoved);
+            break;
+        }
+    }
+}
+
+
+/*
+ * Look up @key in the uuid table, or the name table if @byName is
+ * true, and return a new reference on the matching domain object,
+ * which is not locked. This neither takes the list lock nor the
+ * domain object lock.
+ */
+static virDomainObjPtr
+virDomainObjListLookupRef(virDomainObjListPtr doms,
+                          const char *key,
+                          bool byName)
+{
+    return virShardedHashLookupRef(byName ? doms->objsName : doms->objs, key);
+}
+
+
+/*
+ * Lock @obj found by one of the lookups above, which returned it with
+ * a reference, unless it is being removed. If @ref is false, the
+ * reference is dropped again once @obj is locked, which is safe as
+ * the tables keep their own references until @obj is removed, which
+ * needs its lock.
+ */
+static virDomainObjPtr
+virDomainObjListLockFound(virDomainObjPtr obj,
+                          bool ref)
+{
+    if (obj) {
+        virObjectLock(obj);
+        if (obj->removing) {
+            virObjectUnlock(obj);
+            virObjectUnref(obj);
+            obj = NULL;
+        } else if (!ref) {
+            virObjectUnref(obj);
+        }
+    }
+    return obj;
 }
 
 
 static int virDomainObjListSearchID(const void *payload,
-                                    const void *name ATTRIBUTE_UNUSED,
                                     const void *data)
 {
     virDomainObjPtr obj = (virDomainObjPtr)payload;
     const int *id = data;
-    int want = 0;
 
-    virObjectLock(obj);
-    if (virDomainObjIsActive(obj) &&
-        obj->def->id == *id)
-        want = 1;
-    virObjectUnlock(obj);
-    return want;
+    /* Inactive domains have no ID, and the summary keeps us from
+     * waiting for every domain object busy with a job */
+    return *id >= 0 && virDomainObjGetSummaryID(obj) == *id;
 }
 
 static virDomainObjPtr
@@ -118,23 +278,21 @@ virDomainObjListFindByIDInternal(virDomainObjListPtr doms,
                                  bool ref)
 {
     virDomainObjPtr obj;
-    virObjectRWLockRead(doms);
-    obj = virHashSearch(doms->objs, virDomainObjListSearchID, &id, NULL);
-    if (ref) {
-        virObjectRef(obj);
-        virObjectRWUnlock(doms);
-    }
-    if (obj) {
-        virObjectLock(obj);
-        if (obj->removing) {
-            virObjectUnlock(obj);
-            if (ref)
-                virObjectUnref(obj);
-            obj = NULL;
-        }
+
+    obj = virShardedHashSearchRef(doms->objs, virDomainObjListSearchID, &id);
+    if (!(obj = virDomainObjListLockFound(obj, true)))
+        return NULL;
+
+    /* The summary was read without the lock, so the domain may have
+     * stopped, or even been started again with another ID since */
+    if (!virDomainObjIsActive(obj) || obj->def->id != id) {
+        virObjectUnlock(obj);
+        virObjectUnref(obj);
+        return NULL;
     }
+
     if (!ref)
-        virObjectRWUnlock(doms);
+        virObjectUnref(obj);
     return obj;
 }
 
@@ -158,28 +316,13 @@ virDomainObjListFindByUUIDInternal(virDomainObjListPtr doms,
                                    bool ref)
 {
     char uuidstr[VIR_UUID_STRING_BUFLEN];
-    virDomainObjPtr obj;
 
-    virObjectRWLockRead(doms);
     virUUIDFormat(uuid, uuidstr);
 
-    obj = virHashLookup(doms->objs, uuidstr);
-    if (ref) {
-        virObjectRef(obj);
-        virObjectRWUnlock(doms);
-    }
-    if (obj) {
-        virObjectLock(obj);
-        if (obj->removing) {
-            virObjectUnlock(obj);
-            if (ref)
-                virObjectUnref(obj);
-            obj = NULL;
-        }
-    }
-    if (!ref)
-        virObjectRWUnlock(doms);
-    return obj;
+    return virDomainObjListLockFound(virDomainObjListLookupRef(doms,
+                                                               uuidstr,
+                                                               false),
+                                     ref);
 }
 
 
@@ -202,21 +345,45 @@ virDomainObjListFindByUUIDRef(virDomainObjListPtr doms,
 virDomainObjPtr virDomainObjListFindByName(virDomainObjListPtr doms,
                                            const char *name)
 {
+    return virDomainObjListLockFound(virDomainObjListLookupRef(doms,
+                                                               name,
+                                                               true),
+                                     true);
+}
+
+
+/**
+ * virDomainObjListGetSummary:
+ * @doms: domain object list
+ * @uuid: UUID of the domain
+ * @summary: filled with the summary of the domain
+ *
+ * Get a copy of the frequently read fields of the domain with @uuid
+ * without waiting for the list lock, nor for jobs holding the domain
+ * object lock. This is meant for APIs like virDomainGetState which
+ * only need those fields. The caller has to free the copy with
+ * virDomainObjSummaryClear().
+ *
+ * Returns 1 if the domain was found, 0 if it was not (without
+ * reporting an error), and -1 on error.
+ */
+int
+virDomainObjListGetSummary(virDomainObjListPtr doms,
+                           const unsigned char *uuid,
+                           virDomainObjSummaryPtr summary)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
     virDomainObjPtr obj;
+    int ret;
 
-    virObjectRWLockRead(doms);
-    obj = virHashLookup(doms->objsName, name);
-    virObjectRef(obj);
-    virObjectRWUnlock(doms);
-    if (obj) {
-        virObjectLock(obj);
-        if (obj->removing) {
-            virObjectUnlock(obj);
-            virObjectUnref(obj);
-            obj = NULL;
-        }
-    }
-    return obj;
+    virUUIDFormat(uuid, uuidstr);
+
+    if (!(obj = virDomainObjListLookupRef(doms, uuidstr, false)))
+        return 0;
+
+    ret = virDomainObjGetSummary(obj, summary) < 0 ? -1 : 1;
+    virObjectUnref(obj);
+    return ret;
 }
 
 
@@ -248,7 +415,7 @@ virDomainObjListAddLocked(virDomainObjListPtr doms,
     virUUIDFormat(def->uuid, uuidstr);
 
     /* See if a VM with matching UUID already exists */
-    if ((vm = virHashLookup(doms->objs, uuidstr))) {
+    if ((vm = virDomainObjListLookupLocked(doms, uuidstr, false))) {
         virObjectLock(vm);
         /* UUID matches, but if names don't match, refuse it */
         if (STRNEQ(vm->def->name, def->name)) {
@@ -281,7 +448,7 @@ virDomainObjListAddLocked(virDomainObjListPtr doms,
                               oldDef);
     } else {
         /* UUID does not match, but if a name matches, refuse it */
-        if ((vm = virHashLookup(doms->objsName, def->name))) {
+        if ((vm = virDomainObjListLookupLocked(doms, def->name, true))) {
             virObjectLock(vm);
             virUUIDFormat(vm->def->uuid, uuidstr);
             virReportError(VIR_ERR_OPERATION_FAILED,
@@ -294,20 +461,18 @@ virDomainObjListAddLocked(virDomainObjListPtr doms,
             goto cleanup;
         vm->def = def;
 
-        virUUIDFormat(def->uuid, uuidstr);
-        if (virHashAddEntry(doms->objs, uuidstr, vm) < 0) {
-            virObjectUnref(vm);
-            return NULL;
-        }
+        /* Lookups find the domain as soon as it is in the tables,
+         * so its summary has to be filled in before */
+        virDomainObjMarkChanged(vm);
 
-        if (virHashAddEntry(doms->objsName, def->name, vm) < 0) {
-            virHashRemoveEntry(doms->objs, uuidstr);
+        if (virDomainObjListAddTables(doms, vm) < 0) {
+            virObjectUnref(vm);
             return NULL;
         }
 
-        /* Since domain is in two hash tables, increment the
-         * reference counter */
-        virObjectRef(vm);
+        /* The tables hold their own references */
+        virObjectUnref(vm);
+        virDomainObjListForgetRemoval(doms, def->uuid);
     }
  cleanup:
     return vm;
@@ -351,8 +516,9 @@ void virDomainObjListRemove(virDomainObjListPtr doms,
 
     virObjectRWLockWrite(doms);
     virObjectLock(dom);
-    virHashRemoveEntry(doms->objs, uuidstr);
-    virHashRemoveEntry(doms->objsName, dom->def->name);
+    virShardedHashRemove(doms->objs, uuidstr);
+    virShardedHashRemove(doms->objsName, dom->def->name);
+    virDomainObjListRecordRemoval(doms, dom);
     virObjectUnlock(dom);
     virObjectUnref(dom);
     virObjectRWUnlock(doms);
@@ -398,23 +564,18 @@ virDomainObjListRename(virDomainObjListPtr doms,
     virObjectLock(dom);
     virObjectUnref(dom);
 
-    if (virHashLookup(doms->objsName, new_name) != NULL) {
+    if (virDomainObjListLookupLocked(doms, new_name, true)) {
         virReportError(VIR_ERR_OPERATION_INVALID,
                        _("domain with name '%s' already exists"),
                        new_name);
         goto cleanup;
     }
 
-    if (virHashAddEntry(doms->objsName, new_name, dom) < 0)
+    if (virShardedHashAdd(doms->objsName, new_name, dom) < 0)
         goto cleanup;
 
-    /* Okay, this is crazy. virHashAddEntry() does not increment
-     * the refcounter of @dom, but virHashRemoveEntry() does
-     * decrement it. We need to work around it. */
-    virObjectRef(dom);
-
     rc = callback(dom, new_name, flags, opaque);
-    virHashRemoveEntry(doms->objsName, rc < 0 ? new_name : old_name);
+    virShardedHashRemove(doms->objsName, rc < 0 ? new_name : old_name);
     if (rc < 0)
         goto cleanup;
 
@@ -438,119 +599,281 @@ void virDomainObjListRemoveLocked(virDomainObjListPtr doms,
 
     virUUIDFormat(dom->def->uuid, uuidstr);
 
-    virHashRemoveEntry(doms->objs, uuidstr);
-    virHashRemoveEntry(doms->objsName, dom->def->name);
+    virShardedHashRemove(doms->objs, uuidstr);
+    virShardedHashRemove(doms->objsName, dom->def->name);
+    virDomainObjListRecordRemoval(doms, dom);
     virObjectUnlock(dom);
 }
 
 
+/* Upper bound on the number of threads parsing configs at startup */
+#define VIR_DOMAIN_OBJ_LIST_LOAD_WORKERS_MAX 16
+
+/* Configs are parsed by a pool of workers, each filling in its own
+ * item, and only then added to the list one by one, in the order of
+ * their names, by the thread which holds the list lock. */
+typedef struct _virDomainObjListLoadItem virDomainObjListLoadItem;
+typedef virDomainObjListLoadItem *virDomainObjListLoadItemPtr;
+struct _virDomainObjListLoadItem {
+    char *name;
+
+    virDomainDefPtr def;        /* persistent config */
+    int autostart;
+    virDomainObjPtr obj;        /* live status, unlocked */
+};
+
+struct virDomainObjListLoadData {
+    const char *configDir;
+    const char *autostartDir;
+    bool liveStatus;
+    virCapsPtr caps;
+    virDomainXMLOptionPtr xmlopt;
+
+    virMutex lock;
+    virCond cond;
+    size_t pending;
+};
+
+
+static void
+virDomainObjListLoadItemClear(virDomainObjListLoadItemPtr item)
+{
+    VIR_FREE(item->name);
+    virDomainDefFree(item->def);
+    item->def = NULL;
+    virObjectUnref(item->obj);
+    item->obj = NULL;
+}
+
+
+static int
+virDomainObjListLoadItemCompare(const void *a,
+                                const void *b)
+{
+    const virDomainObjListLoadItem *itemA = a;
+    const virDomainObjListLoadItem *itemB = b;
+
+    return strcmp(itemA->name, itemB->name);
+}
+
+
+static int
+virDomainObjListParseConfig(virDomainObjListLoadItemPtr item,
+                            virCapsPtr caps,
+                            virDomainXMLOptionPtr xmlopt,
+                            const char *configDir,
+                            const char *autostartDir)
+{
+    char *configFile = NULL, *autostartLink = NULL;
+    int ret = -1;
+
+    if ((configFile = virDomainConfigFile(configDir, item->name)) == NULL)
+        goto cleanup;
+    if (!(item->def = virDomainDefParseFile(configFile, caps, xmlopt, NULL,
+                                            VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                                            VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
+                                            VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
+                                            VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
+        goto cleanup;
+
+    if ((autostartLink = virDomainConfigFile(autostartDir, item->name)) == NULL)
+        goto cleanup;
+
+    if ((item->autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    if (ret < 0) {
+        virDomainDefFree(item->def);
+        item->def = NULL;
+    }
+    VIR_FREE(configFile);
+    VIR_FREE(autostartLink);
+    return ret;
+}
+
+
+static int
+virDomainObjListParseStatus(virDomainObjListLoadItemPtr item,
+                            const char *statusDir,
+                            virCapsPtr caps,
+                            virDomainXMLOptionPtr xmlopt)
+{
+    char *statusFile = NULL;
+
+    if ((statusFile = virDomainConfigFile(statusDir, item->name)) == NULL)
+        return -1;
+
+    item->obj = virDomainObjParseFile(statusFile, caps, xmlopt,
+                                      VIR_DOMAIN_DEF_PARSE_STATUS |
+                                      VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
+                                      VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
+                                      VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
+                                      VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
+                                      VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL);
+    VIR_FREE(statusFile);
+    if (!item->obj)
+        return -1;
+
+    /* The object is locked again by whoever adds it to the list, which
+     * may be a different thread */
+    virObjectUnlock(item->obj);
+    return 0;
+}
+
+
+static void
+virDomainObjListParseItem(virDomainObjListLoadItemPtr item,
+                          struct virDomainObjListLoadData *data)
+{
+    /* Errors are reported when the item is added to the list */
+    if (data->liveStatus)
+        ignore_value(virDomainObjListParseStatus(item, data->configDir,
+                                                 data->caps, data->xmlopt));
+    else
+        ignore_value(virDomainObjListParseConfig(item, data->caps,
+                                                 data->xmlopt,
+                                                 data->configDir,
+                                                 data->autostartDir));
+}
+
+
+static void
+virDomainObjListParseWorker(void *jobdata,
+                            void *opaque)
+{
+    struct virDomainObjListLoadData *data = opaque;
+
+    virDomainObjListParseItem(jobdata, data);
+
+    virMutexLock(&data->lock);
+    if (--data->pending == 0)
+        virCondSignal(&data->cond);
+    virMutexUnlock(&data->lock);
+}
+
+
+/*
+ * Parse all @items, in parallel if there is more than one of them.
+ * Returns the number of workers used.
+ */
+static size_t
+virDomainObjListParseAll(virDomainObjListLoadItemPtr items,
+                         size_t nitems,
+                         struct virDomainObjListLoadData *data)
+{
+    virThreadPoolPtr pool = NULL;
+    size_t nworkers;
+    size_t i;
+    int ncpus;
+
+    if ((ncpus = virHostCPUGetCount()) < 1) {
+        virResetLastError();
+        ncpus = 1;
+    }
+    nworkers = MIN(MIN(ncpus, VIR_DOMAIN_OBJ_LIST_LOAD_WORKERS_MAX), nitems);
+
+    if (nworkers > 1 &&
+        virMutexInit(&data->lock) == 0) {
+        if (virCondInit(&data->cond) == 0) {
+            pool = virThreadPoolNew(nworkers, nworkers, 0,
+                                    virDomainObjListParseWorker, data);
+            if (!pool)
+                virCondDestroy(&data->cond);
+        }
+        if (!pool)
+            virMutexDestroy(&data->lock);
+    }
+
+    if (!pool) {
+        if (nworkers > 1)
+            VIR_WARN("Unable to start config parsing workers, "
+                     "parsing sequentially");
+        for (i = 0; i < nitems; i++)
+            virDomainObjListParseItem(&items[i], data);
+        return 1;
+    }
+
+    virMutexLock(&data->lock);
+    for (i = 0; i < nitems; i++) {
+        data->pending++;
+        if (virThreadPoolSendJob(pool, 0, &items[i]) < 0) {
+            data->pending--;
+            virDomainObjListParseItem(&items[i], data);
+        }
+    }
+    while (data->pending)
+        ignore_value(virCondWait(&data->cond, &data->lock));
+    virMutexUnlock(&data->lock);
+
+    virThreadPoolFree(pool);
+    virCondDestroy(&data->cond);
+    virMutexDestroy(&data->lock);
+    return nworkers;
+}
+
+
 static virDomainObjPtr
 virDomainObjListLoadConfig(virDomainObjListPtr doms,
-                           virCapsPtr caps,
+                           virDomainObjListLoadItemPtr item,
                            virDomainXMLOptionPtr xmlopt,
-                           const char *configDir,
-                           const char *autostartDir,
-                           const char *name,
                            virDomainLoadConfigNotify notify,
                            void *opaque)
 {
-    char *configFile = NULL, *autostartLink = NULL;
-    virDomainDefPtr def = NULL;
     virDomainObjPtr dom;
-    int autostart;
     virDomainDefPtr oldDef = NULL;
 
-    if ((configFile = virDomainConfigFile(configDir, name)) == NULL)
-        goto error;
-    if (!(def = virDomainDefParseFile(configFile, caps, xmlopt, NULL,
-                                      VIR_DOMAIN_DEF_PARSE_INACTIVE |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
-                                      VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
-        goto error;
-
-    if ((autostartLink = virDomainConfigFile(autostartDir, name)) == NULL)
-        goto error;
-
-    if ((autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
-        goto error;
-
-    if (!(dom = virDomainObjListAddLocked(doms, def, xmlopt, 0, &oldDef)))
-        goto error;
+    if (!(dom = virDomainObjListAddLocked(doms, item->def, xmlopt, 0, &oldDef)))
+        return NULL;
+    item->def = NULL;
 
-    dom->autostart = autostart;
+    dom->autostart = item->autostart;
 
     if (notify)
         (*notify)(dom, oldDef == NULL, opaque);
 
     virDomainDefFree(oldDef);
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
     return dom;
-
- error:
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
-    virDomainDefFree(def);
-    return NULL;
 }
 
 
 static virDomainObjPtr
 virDomainObjListLoadStatus(virDomainObjListPtr doms,
-                           const char *statusDir,
-                           const char *name,
-                           virCapsPtr caps,
-                           virDomainXMLOptionPtr xmlopt,
+                           virDomainObjListLoadItemPtr item,
                            virDomainLoadConfigNotify notify,
                            void *opaque)
 {
-    char *statusFile = NULL;
-    virDomainObjPtr obj = NULL;
+    virDomainObjPtr obj = item->obj;
     char uuidstr[VIR_UUID_STRING_BUFLEN];
 
-    if ((statusFile = virDomainConfigFile(statusDir, name)) == NULL)
-        goto error;
-
-    if (!(obj = virDomainObjParseFile(statusFile, caps, xmlopt,
-                                      VIR_DOMAIN_DEF_PARSE_STATUS |
-                                      VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
-                                      VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
-                                      VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
-        goto error;
-
+    virObjectLock(obj);
     virUUIDFormat(obj->def->uuid, uuidstr);
 
-    if (virHashLookup(doms->objs, uuidstr) != NULL) {
+    if (virDomainObjListLookupLocked(doms, uuidstr, false)) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("unexpected domain %s already exists"),
                        obj->def->name);
         goto error;
     }
 
-    if (virHashAddEntry(doms->objs, uuidstr, obj) < 0)
-        goto error;
+    virDomainObjMarkChanged(obj);
 
-    if (virHashAddEntry(doms->objsName, obj->def->name, obj) < 0) {
-        virHashRemoveEntry(doms->objs, uuidstr);
+    if (virDomainObjListAddTables(doms, obj) < 0)
         goto error;
-    }
 
-    /* Since domain is in two hash tables, increment the
-     * reference counter */
-    virObjectRef(obj);
+    /* The tables hold their own references */
+    item->obj = NULL;
+    virObjectUnref(obj);
+    virDomainObjListForgetRemoval(doms, obj->def->uuid);
 
     if (notify)
         (*notify)(obj, 1, opaque);
 
-    VIR_FREE(statusFile);
     return obj;
 
  error:
-    virObjectUnref(obj);
-    VIR_FREE(statusFile);
+    virObjectUnlock(obj);
     return NULL;
 }
 
@@ -565,8 +888,18 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                virDomainLoadConfigNotify notify,
                                void *opaque)
 {
+    struct virDomainObjListLoadData data = {
+        .configDir = configDir, .autostartDir = autostartDir,
+        .liveStatus = liveStatus, .caps = caps, .xmlopt = xmlopt,
+    };
+    virDomainObjListLoadItemPtr items = NULL;
+    size_t nitems = 0;
+    size_t nloaded = 0;
+    size_t nworkers;
+    unsigned long long start = 0, scanned = 0, parsed = 0, done = 0;
     DIR *dir;
     struct dirent *entry;
+    size_t i;
     int ret = -1;
     int rc;
 
@@ -575,45 +908,77 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
     if ((rc = virDirOpenIfExists(&dir, configDir)) <= 0)
         return rc;
 
-    virObjectRWLockWrite(doms);
+    ignore_value(virTimeMillisNow(&start));
 
-    while ((ret = virDirRead(dir, &entry, configDir)) > 0) {
-        virDomainObjPtr dom;
+    while ((rc = virDirRead(dir, &entry, configDir)) > 0) {
+        virDomainObjListLoadItem item = { NULL };
 
         if (!virFileStripSuffix(entry->d_name, ".xml"))
             continue;
 
+        if (VIR_STRDUP(item.name, entry->d_name) < 0 ||
+            VIR_APPEND_ELEMENT(items, nitems, item) < 0) {
+            VIR_FREE(item.name);
+            goto cleanup;
+        }
+    }
+    if (rc < 0)
+        goto cleanup;
+
+    /* Domains are added, and drivers notified, in a stable order */
+    qsort(items, nitems, sizeof(*items), virDomainObjListLoadItemCompare);
+
+    ignore_value(virTimeMillisNow(&scanned));
+
+    /* Parsing is done without holding the list lock, it only needs
+     * the files, @caps and @xmlopt */
+    nworkers = virDomainObjListParseAll(items, nitems, &data);
+
+    ignore_value(virTimeMillisNow(&parsed));
+
+    virObjectRWLockWrite(doms);
+
+    for (i = 0; i < nitems; i++) {
+        virDomainObjPtr dom = NULL;
+
         /* NB: ignoring errors, so one malformed config doesn't
            kill the whole process */
-        VIR_INFO("Loading config file '%s.xml'", entry->d_name);
-        if (liveStatus)
-            dom = virDomainObjListLoadStatus(doms,
-                                             configDir,
-                                             entry->d_name,
-                                             caps,
-                                             xmlopt,
-                                             notify,
-                                             opaque);
-        else
-            dom = virDomainObjListLoadConfig(doms,
-                                             caps,
-                                             xmlopt,
-                                             configDir,
-                                             autostartDir,
-                                             entry->d_name,
-                                             notify,
-                                             opaque);
+        VIR_INFO("Loading config file '%s.xml'", items[i].name);
+        if (liveStatus) {
+            if (items[i].obj)
+                dom = virDomainObjListLoadStatus(doms, &items[i],
+                                                 notify, opaque);
+        } else {
+            if (items[i].def)
+                dom = virDomainObjListLoadConfig(doms, &items[i], xmlopt,
+                                                 notify, opaque);
+        }
         if (dom) {
             if (!liveStatus)
                 dom->persistent = 1;
+            virDomainObjUpdateSummary(dom);
             virObjectUnlock(dom);
+            nloaded++;
         } else {
-            VIR_ERROR(_("Failed to load config for domain '%s'"), entry->d_name);
+            VIR_ERROR(_("Failed to load config for domain '%s'"), items[i].name);
         }
     }
 
-    VIR_DIR_CLOSE(dir);
     virObjectRWUnlock(doms);
+
+    ignore_value(virTimeMillisNow(&done));
+
+    VIR_INFO("Loaded %zu of %zu configs from %s using %zu workers: "
+             "scan %llums, parse %llums, insert %llums",
+             nloaded, nitems, configDir, nworkers,
+             scanned - start, parsed - scanned, done - parsed);
+
+    ret = 0;
+ cleanup:
+    for (i = 0; i < nitems; i++)
+        virDomainObjListLoadItemClear(&items[i]);
+    VIR_FREE(items);
+    VIR_DIR_CLOSE(dir);
     return ret;
 }
 
@@ -628,7 +993,6 @@ struct virDomainObjListData {
 
 static int
 virDomainObjListCount(void *payload,
-                      const void *name ATTRIBUTE_UNUSED,
                       void *opaque)
 {
     virDomainObjPtr obj = payload;
@@ -657,9 +1021,7 @@ virDomainObjListNumOfDomains(virDomainObjListPtr doms,
                              virConnectPtr conn)
 {
     struct virDomainObjListData data = { filter, conn, active, 0 };
-    virObjectRWLockRead(doms);
-    virHashForEach(doms->objs, virDomainObjListCount, &data);
-    virObjectRWUnlock(doms);
+    virShardedHashForEach(doms->objs, virDomainObjListCount, &data);
     return data.count;
 }
 
@@ -675,7 +1037,6 @@ struct virDomainIDData {
 
 static int
 virDomainObjListCopyActiveIDs(void *payload,
-                              const void *name ATTRIBUTE_UNUSED,
                               void *opaque)
 {
     virDomainObjPtr obj = payload;
@@ -701,9 +1062,7 @@ virDomainObjListGetActiveIDs(virDomainObjListPtr doms,
 {
     struct virDomainIDData data = { filter, conn,
                                     0, maxids, ids };
-    virObjectRWLockRead(doms);
-    virHashForEach(doms->objs, virDomainObjListCopyActiveIDs, &data);
-    virObjectRWUnlock(doms);
+    virShardedHashForEach(doms->objs, virDomainObjListCopyActiveIDs, &data);
     return data.numids;
 }
 
@@ -720,7 +1079,6 @@ struct virDomainNameData {
 
 static int
 virDomainObjListCopyInactiveNames(void *payload,
-                                  const void *name ATTRIBUTE_UNUSED,
                                   void *opaque)
 {
     virDomainObjPtr obj = payload;
@@ -755,9 +1113,7 @@ virDomainObjListGetInactiveNames(virDomainObjListPtr doms,
     struct virDomainNameData data = { filter, conn,
                                       0, 0, maxnames, names };
     size_t i;
-    virObjectRWLockRead(doms);
-    virHashForEach(doms->objs, virDomainObjListCopyInactiveNames, &data);
-    virObjectRWUnlock(doms);
+    virShardedHashForEach(doms->objs, virDomainObjListCopyInactiveNames, &data);
     if (data.oom) {
         for (i = 0; i < data.numnames; i++)
             VIR_FREE(data.names[i]);
@@ -777,7 +1133,6 @@ struct virDomainListIterData {
 
 static int
 virDomainObjListHelper(void *payload,
-                       const void *name ATTRIBUTE_UNUSED,
                        void *opaque)
 {
     struct virDomainListIterData *data = opaque;
@@ -797,7 +1152,7 @@ virDomainObjListForEach(virDomainObjListPtr doms,
         callback, opaque, 0,
     };
     virObjectRWLockRead(doms);
-    virHashForEach(doms->objs, virDomainObjListHelper, &data);
+    virShardedHashForEach(doms->objs, virDomainObjListHelper, &data);
     virObjectRWUnlock(doms);
     return data.ret;
 }
@@ -867,24 +1222,6 @@ virDomainObjMatchFilter(virDomainObjPtr vm,
 #undef MATCH
 
 
-struct virDomainListData {
-    virDomainObjPtr *vms;
-    size_t nvms;
-};
-
-
-static int
-virDomainObjListCollectIterator(void *payload,
-                                const void *name ATTRIBUTE_UNUSED,
-                                void *opaque)
-{
-    struct virDomainListData *data = opaque;
-
-    data->vms[data->nvms++] = virObjectRef(payload);
-    return 0;
-}
-
-
 static void
 virDomainObjListFilter(virDomainObjPtr **list,
                        size_t *nvms,
@@ -927,22 +1264,16 @@ virDomainObjListCollect(virDomainObjListPtr domlist,
                         virDomainObjListACLFilter filter,
                         unsigned int flags)
 {
-    struct virDomainListData data = { NULL, 0 };
+    void **list;
+    ssize_t nlist;
 
-    virObjectRWLockRead(domlist);
-    sa_assert(domlist->objs);
-    if (VIR_ALLOC_N(data.vms, virHashSize(domlist->objs)) < 0) {
-        virObjectRWUnlock(domlist);
+    if ((nlist = virShardedHashGetValues(domlist->objs, &list)) < 0)
         return -1;
-    }
-
-    virHashForEach(domlist->objs, virDomainObjListCollectIterator, &data);
-    virObjectRWUnlock(domlist);
 
-    virDomainObjListFilter(&data.vms, &data.nvms, conn, filter, flags);
+    *vms = (virDomainObjPtr *) list;
+    *nvms = nlist;
 
-    *nvms = data.nvms;
-    *vms = data.vms;
+    virDomainObjListFilter(vms, nvms, conn, filter, flags);
 
     return 0;
 }
@@ -966,32 +1297,26 @@ virDomainObjListConvert(virDomainObjListPtr domlist,
     *nvms = 0;
     *vms = NULL;
 
-    virObjectRWLockRead(domlist);
     for (i = 0; i < ndoms; i++) {
         virDomainPtr dom = doms[i];
 
         virUUIDFormat(dom->uuid, uuidstr);
 
-        if (!(vm = virHashLookup(domlist->objs, uuidstr))) {
+        if (!(vm = virDomainObjListLookupRef(domlist, uuidstr, false))) {
             if (skip_missing)
                 continue;
 
-            virObjectRWUnlock(domlist);
             virReportError(VIR_ERR_NO_DOMAIN,
                            _("no domain with matching uuid '%s' (%s)"),
                            uuidstr, dom->name);
             goto error;
         }
 
-        virObjectRef(vm);
-
         if (VIR_APPEND_ELEMENT(*vms, *nvms, vm) < 0) {
-            virObjectRWUnlock(domlist);
             virObjectUnref(vm);
             goto error;
         }
     }
-    virObjectRWUnlock(domlist);
 
     sa_assert(*vms);
     virDomainObjListFilter(vms, nvms, conn, filter, flags);
@@ -1049,3 +1374,217 @@ virDomainObjListExport(virDomainObjListPtr domlist,
     virObjectListFreeCount(vms, nvms);
     return ret;
 }
+
+
+typedef struct _virDomainObjListChange virDomainObjListChange;
+typedef virDomainObjListChange *virDomainObjListChangePtr;
+struct _virDomainObjListChange {
+    unsigned long long generation;
+    virDomainDefPtr def; /* owned unless @removed */
+    bool removed;
+};
+
+struct virDomainObjListChangesData {
+    virConnectPtr conn;
+    virDomainObjListACLFilter filter;
+    unsigned long long since;
+    unsigned long long current;
+    virDomainObjListChangePtr changes;
+    size_t nchanges;
+    bool error;
+};
+
+
+static int
+virDomainObjListCollectChange(void *payload,
+                              void *opaque)
+{
+    struct virDomainObjListChangesData *data = opaque;
+    virDomainObjPtr vm = payload;
+    virDomainObjSummary summary;
+    virDomainObjListChange change = { 0, NULL, false };
+    unsigned long long generation = virDomainObjGetSummaryGeneration(vm);
+
+    /* Changes newer than @current are picked up by the next call */
+    if (generation <= data->since || generation > data->current)
+        return 0;
+
+    if (virDomainObjGetSummary(vm, &summary) < 0) {
+        data->error = true;
+        return -1;
+    }
+
+    if ((data->filter && !data->filter(data->conn, summary.def)) ||
+        summary.generation <= data->since ||
+        summary.generation > data->current) {
+        virDomainObjSummaryClear(&summary);
+        return 0;
+    }
+
+    change.generation = summary.generation;
+    change.def = summary.def;
+    summary.def = NULL;
+
+    if (VIR_APPEND_ELEMENT(data->changes, data->nchanges, change) < 0) {
+        virDomainDefFree(change.def);
+        data->error = true;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virDomainObjListChangeCompare(const void *a,
+                              const void *b)
+{
+    const virDomainObjListChange *ca = a;
+    const virDomainObjListChange *cb = b;
+
+    if (ca->generation < cb->generation)
+        return -1;
+    return ca->generation > cb->generation;
+}
+
+
+/**
+ * virDomainObjListExportChanges:
+ * @doms: domain object list
+ * @conn: connection the domains are exported for
+ * @generation: generation of the last change the caller knows about,
+ *              updated to the one to pass to the next call
+ * @maxitems: maximum number of changes to export, 0 for no limit
+ * @domains: filled with a NULL terminated list of changed domains
+ * @removed: filled with a NULL terminated list of UUID strings of the
+ *           removed domains
+ * @filter: ACL filter for the domains
+ *
+ * Export the domains which were added, defined, renamed or changed
+ * their state or ID since @generation, and the domains which were
+ * removed since then, in the order in which they changed. A zero
+ * @generation exports all domains and no removals.
+ *
+ * If fewer than @maxitems changes were exported in total, the caller is
+ * up to date as of the new @generation. Otherwise the next call returns
+ * more changes.
+ *
+ * Returns the number of exported domains, or -1 on error, which
+ * includes @generation being too old for the removals since then to be
+ * known.
+ */
+int
+virDomainObjListExportChanges(virDomainObjListPtr doms,
+                              virConnectPtr conn,
+                              unsigned long long *generation,
+                              unsigned int maxitems,
+                              virDomainPtr **domains,
+                              char ***removed,
+                              virDomainObjListACLFilter filter)
+{
+    struct virDomainObjListChangesData data = {
+        .conn = conn, .filter = filter, .since = *generation,
+    };
+    virDomainPtr *doms_ret = NULL;
+    char **removed_ret = NULL;
+    size_t ndoms = 0;
+    size_t nremoved = 0;
+    size_t nchanges;
+    size_t i;
+    int ret = -1;
+
+    *domains = NULL;
+    *removed = NULL;
+
+    virObjectRWLockRead(doms);
+
+    /* No object can change while we hold the lock without moving to a
+     * generation newer than this */
+    data.current = virDomainObjCurrentGeneration();
+
+    if (data.since > data.current) {
+        virObjectRWUnlock(doms);
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("unknown domain list generation %llu"), data.since);
+        return -1;
+    }
+
+    if (data.since && data.since < doms->removedHorizon) {
+        virObjectRWUnlock(doms);
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("domain list generation %llu is too old, "
+                         "all domains have to be listed again"), data.since);
+        return -1;
+    }
+
+    virShardedHashForEach(doms->objs, virDomainObjListCollectChange, &data);
+    if (data.error) {
+        virObjectRWUnlock(doms);
+        goto cleanup;
+    }
+
+    for (i = 0; data.since && i < doms->nremoved; i++) {
+        virDomainObjListChange change = { doms->removed[i].generation,
+                                          doms->removed[i].def, true };
+
+        if (change.generation <= data.since ||
+            (filter && !filter(conn, change.def)))
+            continue;
+
+        /* The name and UUID are copied before the lock is released */
+        if (!(change.def = virDomainDefNewFull(change.def->name,
+                                               change.def->uuid, -1)) ||
+            VIR_APPEND_ELEMENT(data.changes, data.nchanges, change) < 0) {
+            virDomainDefFree(change.def);
+            virObjectRWUnlock(doms);
+            goto cleanup;
+        }
+    }
+
+    virObjectRWUnlock(doms);
+
+    qsort(data.changes, data.nchanges, sizeof(*data.changes),
+          virDomainObjListChangeCompare);
+
+    nchanges = data.nchanges;
+    if (maxitems && nchanges > maxitems)
+        nchanges = maxitems;
+
+    if (VIR_ALLOC_N(doms_ret, nchanges + 1) < 0 ||
+        VIR_ALLOC_N(removed_ret, nchanges + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nchanges; i++) {
+        virDomainDefPtr def = data.changes[i].def;
+
+        if (data.changes[i].removed) {
+            if (VIR_ALLOC_N(removed_ret[nremoved], VIR_UUID_STRING_BUFLEN) < 0)
+                goto cleanup;
+            virUUIDFormat(def->uuid, removed_ret[nremoved++]);
+        } else {
+            if (!(doms_ret[ndoms] = virGetDomain(conn, def->name,
+                                                 def->uuid, def->id)))
+                goto cleanup;
+            ndoms++;
+        }
+    }
+
+    if (nchanges < data.nchanges)
+        *generation = data.changes[nchanges - 1].generation;
+    else
+        *generation = data.current;
+
+    *domains = doms_ret;
+    *removed = removed_ret;
+    doms_ret = NULL;
+    removed_ret = NULL;
+    ret = ndoms;
+
+ cleanup:
+    for (i = 0; i < data.nchanges; i++)
+        virDomainDefFree(data.changes[i].def);
+    VIR_FREE(data.changes);
+    virObjectListFreeCount(doms_ret, ndoms);
+    virStringListFreeCount(removed_ret, nremoved);
+    return ret;
+}
@@ -43,6 +43,10 @@ virDomainObjPtr virDomainObjListFindByUUIDRef(virDomainObjListPtr doms,
 virDomainObjPtr virDomainObjListFindByName(virDomainObjListPtr doms,
                                            const char *name);
 
+int virDomainObjListGetSummary(virDomainObjListPtr doms,
+                               const unsigned char *uuid,
+                               virDomainObjSummaryPtr summary);
+
 enum {
     VIR_DOMAIN_OBJ_LIST_ADD_LIVE = (1 << 0),
     VIR_DOMAIN_OBJ_LIST_ADD_CHECK_LIVE = (1 << 1),
@@ -146,6 +150,13 @@ int virDomainObjListExport(virDomainObjListPtr doms,
                            virDomainPtr **domains,
                            virDomainObjListACLFilter filter,
                            unsigned int flags);
+int virDomainObjListExportChanges(virDomainObjListPtr doms,
+                                  virConnectPtr conn,
+                                  unsigned long long *generation,
+                                  unsigned int maxitems,
+                                  virDomainPtr **domains,
+                                  char ***removed,
+                                  virDomainObjListACLFilter filter);
 int virDomainObjListConvert(virDomainObjListPtr domlist,
                             virConnectPtr conn,
                             virDomainPtr *doms,
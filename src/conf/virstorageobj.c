@@ -30,6 +30,7 @@
 #include "virhash.h"
 #include "virlog.h"
 #include "virscsihost.h"
+#include "virshardedhash.h"
 #include "virstring.h"
 #include "virvhba.h"
 
@@ -97,13 +98,16 @@ struct _virStoragePoolObj {
 struct _virStoragePoolObjList {
     virObjectRWLockable parent;
 
+    /* Both tables are only modified with the list write lock held,
+     * lookups don't need any lock at all */
+
     /* uuid string -> virStoragePoolObj mapping
      * for (1), lockless lookup-by-uuid */
-    virHashTable *objs;
+    virShardedHashPtr objs;
 
     /* name string -> virStoragePoolObj mapping
      * for (1), lockless lookup-by-name */
-    virHashTable *objsName;
+    virShardedHashPtr objsName;
 };
 
 
@@ -392,8 +396,8 @@ virStoragePoolObjListDispose(void *opaque)
 {
     virStoragePoolObjListPtr pools = opaque;
 
-    virHashFree(pools->objs);
-    virHashFree(pools->objsName);
+    virShardedHashFree(pools->objs);
+    virShardedHashFree(pools->objsName);
 }
 
 
@@ -408,8 +412,8 @@ virStoragePoolObjListNew(void)
     if (!(pools = virObjectRWLockableNew(virStoragePoolObjListClass)))
         return NULL;
 
-    if (!(pools->objs = virHashCreate(20, virObjectFreeHashData)) ||
-        !(pools->objsName = virHashCreate(20, virObjectFreeHashData))) {
+    if (!(pools->objs = virShardedHashNew()) ||
+        !(pools->objsName = virShardedHashNew())) {
         virObjectUnref(pools);
         return NULL;
     }
@@ -425,7 +429,6 @@ struct _virStoragePoolObjListForEachData {
 
 static int
 virStoragePoolObjListForEachCb(void *payload,
-                               const void *name ATTRIBUTE_UNUSED,
                                void *opaque)
 {
     virStoragePoolObjPtr obj = payload;
@@ -460,7 +463,7 @@ virStoragePoolObjListForEach(virStoragePoolObjListPtr pools,
                                                       .opaque = opaque };
 
     virObjectRWLockRead(pools);
-    virHashForEach(pools->objs, virStoragePoolObjListForEachCb, &data);
+    virShardedHashForEach(pools->objs, virStoragePoolObjListForEachCb, &data);
     virObjectRWUnlock(pools);
 }
 
@@ -473,7 +476,6 @@ struct _virStoragePoolObjListSearchData {
 
 static int
 virStoragePoolObjListSearchCb(const void *payload,
-                              const void *name ATTRIBUTE_UNUSED,
                               const void *opaque)
 {
     virStoragePoolObjPtr obj = (virStoragePoolObjPtr) payload;
@@ -510,10 +512,11 @@ virStoragePoolObjListSearch(virStoragePoolObjListPtr pools,
                                                      .opaque = opaque };
 
     virObjectRWLockRead(pools);
-    obj = virHashSearch(pools->objs, virStoragePoolObjListSearchCb, &data, NULL);
+    obj = virShardedHashSearchRef(pools->objs, virStoragePoolObjListSearchCb,
+                                  &data);
     virObjectRWUnlock(pools);
 
-    return virObjectRef(obj);
+    return obj;
 }
 
 
@@ -528,8 +531,8 @@ virStoragePoolObjRemove(virStoragePoolObjListPtr pools,
     virObjectUnlock(obj);
     virObjectRWLockWrite(pools);
     virObjectLock(obj);
-    virHashRemoveEntry(pools->objs, uuidstr);
-    virHashRemoveEntry(pools->objsName, obj->def->name);
+    virShardedHashRemove(pools->objs, uuidstr);
+    virShardedHashRemove(pools->objsName, obj->def->name);
     virObjectUnlock(obj);
     virObjectUnref(obj);
     virObjectRWUnlock(pools);
@@ -544,7 +547,7 @@ virStoragePoolObjFindByUUIDLocked(virStoragePoolObjListPtr pools,
 
     virUUIDFormat(uuid, uuidstr);
 
-    return virObjectRef(virHashLookup(pools->objs, uuidstr));
+    return virShardedHashLookupRef(pools->objs, uuidstr);
 }
 
 
@@ -553,7 +556,7 @@ virStoragePoolObjFindByUUIDLocked(virStoragePoolObjListPtr pools,
  * @pools: Storage pool object list pointer
  * @uuid: Storage object uuid to find
  *
- * Lock the @pools and lookup the object by @uuid
+ * Lookup the object by @uuid without locking @pools
  *
  * Returns: Locked and reffed storage pool object or NULL if not found
  */
@@ -563,9 +566,7 @@ virStoragePoolObjFindByUUID(virStoragePoolObjListPtr pools,
 {
     virStoragePoolObjPtr obj;
 
-    virObjectRWLockRead(pools);
     obj = virStoragePoolObjFindByUUIDLocked(pools, uuid);
-    virObjectRWUnlock(pools);
     if (obj)
         virObjectLock(obj);
 
@@ -577,7 +578,7 @@ static virStoragePoolObjPtr
 virStoragePoolObjFindByNameLocked(virStoragePoolObjListPtr pools,
                                   const char *name)
 {
-    return virObjectRef(virHashLookup(pools->objsName, name));
+    return virShardedHashLookupRef(pools->objsName, name);
 }
 
 
@@ -586,7 +587,7 @@ virStoragePoolObjFindByNameLocked(virStoragePoolObjListPtr pools,
  * @pools: Storage pool object list pointer
  * @name: Storage object name to find
  *
- * Lock the @pools and lookup the object by @name
+ * Lookup the object by @name without locking @pools
  *
  * Returns: Locked and reffed storage pool object or NULL if not found
  */
@@ -596,9 +597,7 @@ virStoragePoolObjFindByName(virStoragePoolObjListPtr pools,
 {
     virStoragePoolObjPtr obj;
 
-    virObjectRWLockRead(pools);
     obj = virStoragePoolObjFindByNameLocked(pools, name);
-    virObjectRWUnlock(pools);
     if (obj)
         virObjectLock(obj);
 
@@ -1088,21 +1087,23 @@ virStoragePoolObjAssignDef(virStoragePoolObjListPtr pools,
     if (!(obj = virStoragePoolObjNew()))
         goto error;
 
+    /* Lookups see the object as soon as it's in the tables */
+    obj->def = def;
+
     virUUIDFormat(def->uuid, uuidstr);
-    if (virHashAddEntry(pools->objs, uuidstr, obj) < 0)
+    if (virShardedHashAdd(pools->objs, uuidstr, obj) < 0)
         goto error;
-    virObjectRef(obj);
 
-    if (virHashAddEntry(pools->objsName, def->name, obj) < 0) {
-        virHashRemoveEntry(pools->objs, uuidstr);
+    if (virShardedHashAdd(pools->objsName, def->name, obj) < 0) {
+        virShardedHashRemove(pools->objs, uuidstr);
         goto error;
     }
-    virObjectRef(obj);
-    obj->def = def;
     virObjectRWUnlock(pools);
     return obj;
 
  error:
+    if (obj)
+        obj->def = NULL;
     virStoragePoolObjEndAPI(&obj);
     virObjectRWUnlock(pools);
     return NULL;
@@ -1343,7 +1344,6 @@ struct _virStoragePoolCountData {
 
 static int
 virStoragePoolObjNumOfStoragePoolsCb(void *payload,
-                                     const void *name ATTRIBUTE_UNUSED,
                                      void *opaque)
 {
     virStoragePoolObjPtr obj = payload;
@@ -1375,7 +1375,8 @@ virStoragePoolObjNumOfStoragePools(virStoragePoolObjListPtr pools,
         .conn = conn, .filter = filter, .wantActive = wantActive, .count = 0 };
 
     virObjectRWLockRead(pools);
-    virHashForEach(pools->objs, virStoragePoolObjNumOfStoragePoolsCb, &data);
+    virShardedHashForEach(pools->objs, virStoragePoolObjNumOfStoragePoolsCb,
+                          &data);
     virObjectRWUnlock(pools);
 
     return data.count;
@@ -1395,7 +1396,6 @@ struct _virStoragePoolNameData {
 
 static int
 virStoragePoolObjGetNamesCb(void *payload,
-                            const void *name ATTRIBUTE_UNUSED,
                             void *opaque)
 {
     virStoragePoolObjPtr obj = payload;
@@ -1443,7 +1443,7 @@ virStoragePoolObjGetNames(virStoragePoolObjListPtr pools,
         .error = false, .nnames = 0, .maxnames = maxnames, .names = names };
 
     virObjectRWLockRead(pools);
-    virHashForEach(pools->objs, virStoragePoolObjGetNamesCb, &data);
+    virShardedHashForEach(pools->objs, virStoragePoolObjGetNamesCb, &data);
     virObjectRWUnlock(pools);
 
     if (data.error)
@@ -1819,7 +1819,6 @@ struct _virStoragePoolObjFindDuplicateData {
 
 static int
 virStoragePoolObjSourceFindDuplicateCb(const void *payload,
-                                       const void *name ATTRIBUTE_UNUSED,
                                        const void *opaque)
 {
     virStoragePoolObjPtr obj = (virStoragePoolObjPtr) payload;
@@ -1897,14 +1896,16 @@ virStoragePoolObjSourceFindDuplicate(virConnectPtr conn,
     virStoragePoolObjPtr obj = NULL;
 
     virObjectRWLockRead(pools);
-    obj = virHashSearch(pools->objs, virStoragePoolObjSourceFindDuplicateCb,
-                        &data, NULL);
+    obj = virShardedHashSearchRef(pools->objs,
+                                  virStoragePoolObjSourceFindDuplicateCb,
+                                  &data);
     virObjectRWUnlock(pools);
 
     if (obj) {
         virReportError(VIR_ERR_OPERATION_FAILED,
                        _("Storage source conflict with pool: '%s'"),
                        obj->def->name);
+        virObjectUnref(obj);
         return -1;
     }
 
@@ -1992,7 +1993,6 @@ struct _virStoragePoolExportData {
 
 static int
 virStoragePoolObjListExportCb(void *payload,
-                              const void *name ATTRIBUTE_UNUSED,
                               void *opaque)
 {
     virStoragePoolObjPtr obj = payload;
@@ -2040,10 +2040,12 @@ virStoragePoolObjListExport(virConnectPtr conn,
 
     virObjectRWLockRead(poolobjs);
 
-    if (pools && VIR_ALLOC_N(data.pools, virHashSize(poolobjs->objs) + 1) < 0)
+    if (pools &&
+        VIR_ALLOC_N(data.pools, virShardedHashSize(poolobjs->objs) + 1) < 0)
         goto error;
 
-    virHashForEach(poolobjs->objs, virStoragePoolObjListExportCb, &data);
+    virShardedHashForEach(poolobjs->objs, virStoragePoolObjListExportCb,
+                          &data);
     virObjectRWUnlock(poolobjs);
 
     if (data.error)
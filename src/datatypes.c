@@ -34,6 +34,7 @@
 VIR_LOG_INIT("datatypes");
 
 virClassPtr virConnectClass;
+virClassPtr virConnectBatchClass;
 virClassPtr virConnectCloseCallbackDataClass;
 virClassPtr virDomainClass;
 virClassPtr virDomainSnapshotClass;
@@ -47,6 +48,7 @@ virClassPtr virStorageVolClass;
 virClassPtr virStoragePoolClass;
 
 static void virConnectDispose(void *obj);
+static void virConnectBatchDispose(void *obj);
 static void virConnectCloseCallbackDataDispose(void *obj);
 static void virDomainDispose(void *obj);
 static void virDomainSnapshotDispose(void *obj);
@@ -85,6 +87,7 @@ virDataTypesOnceInit(void)
     DECLARE_CLASS_COMMON(basename, virClassForObjectLockable())
 
     DECLARE_CLASS_LOCKABLE(virConnect);
+    DECLARE_CLASS(virConnectBatch);
     DECLARE_CLASS_LOCKABLE(virConnectCloseCallbackData);
     DECLARE_CLASS(virDomain);
     DECLARE_CLASS(virDomainSnapshot);
@@ -890,6 +893,64 @@ virDomainSnapshotDispose(void *obj)
 }
 
 
+/**
+ * virGetConnectBatch:
+ * @conn: the hypervisor connection
+ *
+ * Allocates a new, empty batch of calls. When the object is no longer
+ * needed, virObjectUnref() must be called in order to not leak data.
+ *
+ * Returns a pointer to the batch object, or NULL on error.
+ */
+virConnectBatchPtr
+virGetConnectBatch(virConnectPtr conn)
+{
+    virConnectBatchPtr ret = NULL;
+
+    if (virDataTypesInitialize() < 0)
+        return NULL;
+
+    virCheckConnectGoto(conn, error);
+
+    if (!(ret = virObjectNew(virConnectBatchClass)))
+        goto error;
+
+    ret->conn = virObjectRef(conn);
+
+    return ret;
+
+ error:
+    virObjectUnref(ret);
+    return NULL;
+}
+
+
+/**
+ * virConnectBatchDispose:
+ * @obj: the batch to release
+ *
+ * Unconditionally release all memory associated with a batch,
+ * including the references it holds on the domains of its calls.
+ * The batch object must not be used once this method returns.
+ */
+static void
+virConnectBatchDispose(void *obj)
+{
+    virConnectBatchPtr batch = obj;
+    size_t i;
+
+    VIR_DEBUG("release batch %p with %zu calls", batch, batch->ncalls);
+
+    for (i = 0; i < batch->ncalls; i++) {
+        virObjectUnref(batch->calls[i].domain);
+        VIR_FREE(batch->calls[i].disk);
+        virFreeError(batch->calls[i].error);
+    }
+    VIR_FREE(batch->calls);
+    virObjectUnref(batch->conn);
+}
+
+
 virAdmConnectPtr
 virAdmConnectNew(void)
 {
@@ -30,6 +30,7 @@
 # include "viruuid.h"
 
 extern virClassPtr virConnectClass;
+extern virClassPtr virConnectBatchClass;
 extern virClassPtr virDomainClass;
 extern virClassPtr virDomainSnapshotClass;
 extern virClassPtr virInterfaceClass;
@@ -292,6 +293,19 @@ extern virClassPtr virAdmClientClass;
         } \
     } while (0)
 
+# define virCheckConnectBatchReturn(obj, retval) \
+    do { \
+        virConnectBatchPtr _batch = (obj); \
+        if (!virObjectIsClass(_batch, virConnectBatchClass) || \
+            !virObjectIsClass(_batch->conn, virConnectClass)) { \
+            virReportErrorHelper(VIR_FROM_THIS, VIR_ERR_INVALID_ARG, \
+                                 __FILE__, __FUNCTION__, __LINE__, \
+                                 __FUNCTION__); \
+            virDispatchError(NULL); \
+            return retval; \
+        } \
+    } while (0)
+
 
 /* Helper macros to implement VIR_DOMAIN_DEBUG using just C99.  This
  * assumes you pass fewer than 15 arguments to VIR_DOMAIN_DEBUG, but
@@ -663,6 +677,55 @@ struct _virDomainSnapshot {
     virDomainPtr domain;
 };
 
+/* Upper bound of calls in a single batch, matching the limit of the
+ * remote protocol */
+# define VIR_CONNECT_BATCH_CALLS_MAX 256
+
+typedef enum {
+    VIR_CONNECT_BATCH_DOMAIN_GET_INFO,
+    VIR_CONNECT_BATCH_DOMAIN_GET_STATE,
+    VIR_CONNECT_BATCH_DOMAIN_GET_BLOCK_INFO,
+
+    VIR_CONNECT_BATCH_LAST
+} virConnectBatchCallType;
+
+typedef struct _virConnectBatchCall virConnectBatchCall;
+typedef virConnectBatchCall *virConnectBatchCallPtr;
+
+/**
+ * _virConnectBatchCall
+ *
+ * A single call queued in a batch, along with the caller provided
+ * storage its result is written to and the error it failed with.
+ */
+struct _virConnectBatchCall {
+    virConnectBatchCallType type;
+    virDomainPtr domain;
+    char *disk;
+    unsigned int flags;
+
+    virDomainInfoPtr info;
+    int *state;
+    int *reason;
+    virDomainBlockInfoPtr blockInfo;
+
+    bool done;
+    virErrorPtr error;
+};
+
+/**
+ * _virConnectBatch
+ *
+ * Internal structure associated with a batch of calls
+ */
+struct _virConnectBatch {
+    virObject object;
+    virConnectPtr conn;
+
+    size_t ncalls;
+    virConnectBatchCallPtr calls;
+};
+
 /**
 * _virNWFilter:
 *
@@ -714,6 +777,7 @@ virNWFilterPtr virGetNWFilter(virConnectPtr conn,
                               const unsigned char *uuid);
 virDomainSnapshotPtr virGetDomainSnapshot(virDomainPtr domain,
                                           const char *name);
+virConnectBatchPtr virGetConnectBatch(virConnectPtr conn);
 
 virAdmConnectPtr virAdmConnectNew(void);
 
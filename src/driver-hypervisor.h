@@ -1283,6 +1283,43 @@ typedef int
                                   unsigned int action,
                                   unsigned int flags);
 
+typedef int
+(*virDrvConnectBatchSubmit)(virConnectBatchPtr batch,
+                            unsigned int flags);
+
+typedef int
+(*virDrvDomainGetInfoAsync)(virDomainPtr domain,
+                            virDomainGetInfoCallback cb,
+                            void *opaque,
+                            virFreeCallback freecb,
+                            unsigned int flags);
+
+typedef int
+(*virDrvDomainMemoryStatsAsync)(virDomainPtr domain,
+                                unsigned int nr_stats,
+                                virDomainMemoryStatsCallback cb,
+                                void *opaque,
+                                virFreeCallback freecb,
+                                unsigned int flags);
+
+typedef int
+(*virDrvConnectGetAllDomainStatsAsync)(virConnectPtr conn,
+                                       virDomainPtr *doms,
+                                       unsigned int ndoms,
+                                       unsigned int stats,
+                                       virDomainListGetStatsCallback cb,
+                                       void *opaque,
+                                       virFreeCallback freecb,
+                                       unsigned int flags);
+
+typedef int
+(*virDrvConnectListDomainChanges)(virConnectPtr conn,
+                                  unsigned long long *generation,
+                                  unsigned int maxitems,
+                                  virDomainPtr **domains,
+                                  char ***removed,
+                                  unsigned int flags);
+
 
 typedef struct _virHypervisorDriver virHypervisorDriver;
 typedef virHypervisorDriver *virHypervisorDriverPtr;
@@ -1528,6 +1565,11 @@ struct _virHypervisorDriver {
     virDrvDomainSetVcpu domainSetVcpu;
     virDrvDomainSetBlockThreshold domainSetBlockThreshold;
     virDrvDomainSetLifecycleAction domainSetLifecycleAction;
+    virDrvConnectBatchSubmit connectBatchSubmit;
+    virDrvDomainGetInfoAsync domainGetInfoAsync;
+    virDrvDomainMemoryStatsAsync domainMemoryStatsAsync;
+    virDrvConnectGetAllDomainStatsAsync connectGetAllDomainStatsAsync;
+    virDrvConnectListDomainChanges connectListDomainChanges;
 };
 
 
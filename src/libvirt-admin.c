@@ -1096,6 +1096,254 @@ virAdmServerSetClientLimits(virAdmServerPtr srv,
     return ret;
 }
 
+/**
+ * virAdmServerGetMessagePoolParameters:
+ * @srv: a valid server object reference
+ * @params: pointer to message pool parameter object
+ *          (return value, allocated automatically)
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieve limits and statistics of the pool of RPC message objects and
+ * buffers used by the daemon which @srv belongs to. The pool is shared by
+ * all servers of the daemon. Reported values include:
+ *  - limits on memory and number of message objects kept in the pool,
+ *  - current memory and number of message objects kept in the pool,
+ *  - number of buffer and message object allocations served from the pool
+ *  and number of those which were not.
+ *
+ * Returns 0 on success, allocating @params to size returned in @nparams, or
+ * -1 in case of an error. Caller is responsible for deallocating @params.
+ */
+int
+virAdmServerGetMessagePoolParameters(virAdmServerPtr srv,
+                                     virTypedParameterPtr *params,
+                                     int *nparams,
+                                     unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("srv=%p, flags=0x%x", srv, flags);
+    virResetLastError();
+
+    virCheckAdmServerGoto(srv, error);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminServerGetMessagePoolParameters(srv, params,
+                                                         nparams, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
+/**
+ * virAdmServerSetMessagePoolParameters:
+ * @srv: a valid server object reference
+ * @params: pointer to message pool parameter object
+ * @nparams: number of parameters in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Change limits of the pool of RPC message objects and buffers used by the
+ * daemon which @srv belongs to. Lowering a limit releases cached memory
+ * immediately.
+ *
+ * Caller is responsible for allocating @params prior to calling this function.
+ * See 'Manage the RPC message pool' in libvirt-admin.h for supported
+ * parameters in @params.
+ *
+ * Returns 0 if the limits have been changed successfully or -1 in case of an
+ * error.
+ */
+int
+virAdmServerSetMessagePoolParameters(virAdmServerPtr srv,
+                                     virTypedParameterPtr params,
+                                     int nparams,
+                                     unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("srv=%p, params=%p, nparams=%d, flags=0x%x", srv, params, nparams,
+              flags);
+    VIR_TYPED_PARAMS_DEBUG(params, nparams);
+
+    virResetLastError();
+
+    virCheckAdmServerGoto(srv, error);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNegativeArgGoto(nparams, error);
+
+    if ((ret = remoteAdminServerSetMessagePoolParameters(srv, params, nparams,
+                                                         flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return ret;
+}
+
+/**
+ * virAdmServerGetCompressionParameters:
+ * @srv: a valid server object reference
+ * @params: pointer to compression parameter object
+ *          (return value, allocated automatically)
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieve the settings and statistics of compression of RPC replies in the
+ * daemon which @srv belongs to. These are shared by all servers of the
+ * daemon. Reported values include:
+ *  - the size threshold above which replies are compressed,
+ *  - the number of replies sent compressed and of those not worth it,
+ *  - the size of the compressed replies before and after compression,
+ *  from which the compression ratio follows,
+ *  - the CPU time spent compressing.
+ *
+ * Returns 0 on success, allocating @params to size returned in @nparams, or
+ * -1 in case of an error. Caller is responsible for deallocating @params.
+ */
+int
+virAdmServerGetCompressionParameters(virAdmServerPtr srv,
+                                     virTypedParameterPtr *params,
+                                     int *nparams,
+                                     unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("srv=%p, flags=0x%x", srv, flags);
+    virResetLastError();
+
+    virCheckAdmServerGoto(srv, error);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminServerGetCompressionParameters(srv, params,
+                                                         nparams, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
+/**
+ * virAdmServerSetCompressionParameters:
+ * @srv: a valid server object reference
+ * @params: pointer to compression parameter object
+ * @nparams: number of parameters in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Change the settings of compression of RPC replies in the daemon which @srv
+ * belongs to. A new threshold applies to all clients which negotiated
+ * compression, including those already connected.
+ *
+ * Caller is responsible for allocating @params prior to calling this function.
+ * See 'Manage compression of RPC replies' in libvirt-admin.h for supported
+ * parameters in @params.
+ *
+ * Returns 0 if the settings have been changed successfully or -1 in case of
+ * an error.
+ */
+int
+virAdmServerSetCompressionParameters(virAdmServerPtr srv,
+                                     virTypedParameterPtr params,
+                                     int nparams,
+                                     unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("srv=%p, params=%p, nparams=%d, flags=0x%x", srv, params, nparams,
+              flags);
+    VIR_TYPED_PARAMS_DEBUG(params, nparams);
+
+    virResetLastError();
+
+    virCheckAdmServerGoto(srv, error);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNegativeArgGoto(nparams, error);
+
+    if ((ret = remoteAdminServerSetCompressionParameters(srv, params, nparams,
+                                                         flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return ret;
+}
+
+/**
+ * virAdmServerGetCallStats:
+ * @srv: a valid server object reference
+ * @params: pointer to call statistics parameter object
+ *          (return value, allocated automatically)
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; binary-OR of virAdmServerGetCallStatsFlags
+ *
+ * Retrieve statistics of the RPC calls handled by @srv, for each
+ * procedure which has been called at least once since the daemon
+ * started or the statistics were last reset with
+ * VIR_ADMIN_SERVER_CALL_STATS_RESET. Resetting does not lose any call
+ * finishing while the statistics are read, and only happens if they
+ * are returned successfully.
+ *
+ * The number of procedures is reported as VIR_CALL_STATS_COUNT, and the
+ * statistics of each of them under the "call.<num>." prefix:
+ *
+ *     "call.<num>.program" - number of the RPC program as unsigned int.
+ *     "call.<num>.procedure" - number of the procedure as unsigned int.
+ *     "call.<num>.name" - name of the procedure as string, if known.
+ *     "call.<num>.calls" - number of finished calls as unsigned long long.
+ *     "call.<num>.wait.total" - total time calls spent queued before a
+ *                               worker thread picked them up, in
+ *                               microseconds as unsigned long long.
+ *     "call.<num>.exec.total" - total time spent executing calls, in
+ *                               microseconds as unsigned long long.
+ *     "call.<num>.wait.bucket.<b>" - number of calls whose queue wait fell
+ *                                    in bucket <b> of the histogram, as
+ *                                    unsigned long long.
+ *     "call.<num>.exec.bucket.<b>" - number of calls whose execution time
+ *                                    fell in bucket <b> of the histogram,
+ *                                    as unsigned long long.
+ *
+ * The histograms use a log scale with VIR_CALL_STATS_BUCKETS buckets.
+ * Bucket 0 counts latencies below 1 microsecond, bucket <b> latencies
+ * from 2^(<b>-1) up to 2^<b> microseconds, and the last one everything
+ * longer. Empty buckets are omitted.
+ *
+ * Returns 0 on success, allocating @params to size returned in @nparams, or
+ * -1 in case of an error. Caller is responsible for deallocating @params.
+ */
+int
+virAdmServerGetCallStats(virAdmServerPtr srv,
+                         virTypedParameterPtr *params,
+                         int *nparams,
+                         unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("srv=%p, flags=0x%x", srv, flags);
+    virResetLastError();
+
+    virCheckAdmServerGoto(srv, error);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminServerGetCallStats(srv, params,
+                                             nparams, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
 /**
  * virAdmConnectGetLoggingOutputs:
  * @conn: pointer to an active admin connection
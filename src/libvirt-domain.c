@@ -27,6 +27,7 @@
 #include "viralloc.h"
 #include "virfile.h"
 #include "virlog.h"
+#include "virstring.h"
 #include "virtypedparam.h"
 
 VIR_LOG_INIT("libvirt.domain");
@@ -6501,6 +6502,111 @@ virConnectListAllDomains(virConnectPtr conn,
 }
 
 
+/**
+ * virConnectListDomainChanges:
+ * @conn: Pointer to the hypervisor connection.
+ * @generation: Pointer to the generation the caller has seen so far
+ * @maxitems: maximum number of domains and removals to return, or 0
+ *            for no limit
+ * @domains: Pointer to a variable to store the array containing the
+ *           domain objects which changed
+ * @removed: Pointer to a variable to store the array containing UUID
+ *           strings of domains which were removed
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Collect the domains which were defined, started, stopped, renamed or
+ * otherwise changed their state since @generation, and the domains which
+ * ceased to exist since then.  Unlike virConnectListAllDomains() the cost
+ * of the call depends on the number of changes rather than on the number
+ * of domains, which makes it suitable for polling a host with many guests.
+ *
+ * Pass 0 in @generation to list all domains.  On success @generation is
+ * updated to the value to pass in the next call.  If @maxitems is not 0
+ * and there are more changes than that, only the oldest @maxitems are
+ * returned and @generation points right after them, so the call can be
+ * repeated to fetch the rest page by page.
+ *
+ * The hypervisor only remembers a limited number of removals, and the
+ * generation is reset when the management daemon restarts; if @generation
+ * is too old for the changes to be known, the call fails with
+ * VIR_ERR_OPERATION_INVALID and the caller should list all domains again
+ * by passing 0.
+ *
+ * Example of usage:
+ *
+ *   unsigned long long gen = 0;
+ *   virDomainPtr *domains;
+ *   char **removed;
+ *   size_t i;
+ *   int ret;
+ *
+ *   while (wait_for_next_poll()) {
+ *       ret = virConnectListDomainChanges(conn, &gen, 0,
+ *                                         &domains, &removed, 0);
+ *       if (ret < 0) {
+ *           gen = 0;
+ *           continue;
+ *       }
+ *       for (i = 0; i < ret; i++) {
+ *           update_cache(domains[i]);
+ *           virDomainFree(domains[i]);
+ *       }
+ *       for (i = 0; removed[i]; i++) {
+ *           drop_from_cache(removed[i]);
+ *           free(removed[i]);
+ *       }
+ *       free(domains);
+ *       free(removed);
+ *   }
+ *
+ * Returns the number of changed domains or -1 in case of error, in which
+ * case @domains and @removed are set to NULL.  On success, both arrays are
+ * guaranteed to be terminated by an extra NULL element.  The caller is
+ * responsible for calling virDomainFree() on each element of @domains and
+ * free() on each element of @removed, then calling free() on both arrays.
+ */
+int
+virConnectListDomainChanges(virConnectPtr conn,
+                            unsigned long long *generation,
+                            unsigned int maxitems,
+                            virDomainPtr **domains,
+                            char ***removed,
+                            unsigned int flags)
+{
+    VIR_DEBUG("conn=%p, generation=%p, maxitems=%u, domains=%p, "
+              "removed=%p, flags=0x%x",
+              conn, generation, maxitems, domains, removed, flags);
+
+    virResetLastError();
+
+    if (domains)
+        *domains = NULL;
+    if (removed)
+        *removed = NULL;
+
+    virCheckConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(generation, error);
+    virCheckNonNullArgGoto(domains, error);
+    virCheckNonNullArgGoto(removed, error);
+
+    if (conn->driver->connectListDomainChanges) {
+        int ret;
+        ret = conn->driver->connectListDomainChanges(conn, generation,
+                                                     maxitems, domains,
+                                                     removed, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /**
  * virDomainCreate:
  * @domain: pointer to a defined domain
@@ -12095,3 +12201,630 @@ int virDomainSetLifecycleAction(virDomainPtr domain,
     virDispatchError(domain->conn);
     return -1;
 }
+
+
+/**
+ * virConnectBatchNew:
+ * @conn: pointer to the hypervisor connection
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Creates an empty batch of calls against @conn. Calls are queued with
+ * the virConnectBatchAdd* APIs and executed together by
+ * virConnectBatchSubmit(). With drivers supporting it, the whole batch
+ * is handled in a single round trip and the calls may be executed
+ * concurrently, so a batch is only allowed to contain read-only calls
+ * which do not depend on each other.
+ *
+ * The object must be released with virConnectBatchFree().
+ *
+ * Returns a new batch object, or NULL in case of failure.
+ */
+virConnectBatchPtr
+virConnectBatchNew(virConnectPtr conn,
+                   unsigned int flags)
+{
+    virConnectBatchPtr batch;
+
+    VIR_DEBUG("conn=%p, flags=0x%x", conn, flags);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, NULL);
+    virCheckFlagsGoto(0, error);
+
+    if (!(batch = virGetConnectBatch(conn)))
+        goto error;
+
+    return batch;
+
+ error:
+    virDispatchError(conn);
+    return NULL;
+}
+
+
+/**
+ * virConnectBatchFree:
+ * @batch: a batch object
+ *
+ * Releases the batch along with the references it holds on the domains
+ * of the queued calls. Memory provided by the caller for the results
+ * is not touched.
+ *
+ * Returns 0 in case of success and -1 in case of failure.
+ */
+int
+virConnectBatchFree(virConnectBatchPtr batch)
+{
+    VIR_DEBUG("batch=%p", batch);
+
+    virResetLastError();
+
+    virCheckConnectBatchReturn(batch, -1);
+
+    virObjectUnref(batch);
+    return 0;
+}
+
+
+static int
+virConnectBatchAddCall(virConnectBatchPtr batch,
+                       virConnectBatchCallType type,
+                       virDomainPtr domain,
+                       const char *disk,
+                       unsigned int flags,
+                       virConnectBatchCallPtr *call)
+{
+    virConnectBatchCallPtr ret;
+    size_t ncalls = batch->ncalls;
+
+    if (domain->conn != batch->conn) {
+        virReportInvalidArg(domain,
+                            _("domain '%s' does not belong to the connection of the batch"),
+                            domain->name);
+        return -1;
+    }
+
+    if (batch->ncalls >= VIR_CONNECT_BATCH_CALLS_MAX) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("too many calls in a batch, maximum is %d"),
+                       VIR_CONNECT_BATCH_CALLS_MAX);
+        return -1;
+    }
+
+    if (VIR_EXPAND_N(batch->calls, ncalls, 1) < 0)
+        return -1;
+
+    ret = &batch->calls[batch->ncalls];
+    if (VIR_STRDUP(ret->disk, disk) < 0) {
+        VIR_SHRINK_N(batch->calls, ncalls, 1);
+        return -1;
+    }
+    ret->type = type;
+    ret->domain = virObjectRef(domain);
+    ret->flags = flags;
+
+    *call = ret;
+    return batch->ncalls++;
+}
+
+
+/**
+ * virConnectBatchAddDomainGetInfo:
+ * @batch: a batch object
+ * @domain: a domain object belonging to the connection of @batch
+ * @info: pointer to a virDomainInfo structure allocated by the user
+ *
+ * Queues a call equivalent to virDomainGetInfo(). @info is filled in
+ * by virConnectBatchSubmit() and must stay valid until then.
+ *
+ * Returns the index of the call within @batch to be passed to
+ * virConnectBatchGetResult(), or -1 in case of failure.
+ */
+int
+virConnectBatchAddDomainGetInfo(virConnectBatchPtr batch,
+                                virDomainPtr domain,
+                                virDomainInfoPtr info)
+{
+    virConnectBatchCallPtr call;
+    int ret;
+
+    VIR_DEBUG("batch=%p, domain=%p, info=%p", batch, domain, info);
+
+    virResetLastError();
+
+    virCheckConnectBatchReturn(batch, -1);
+    virCheckDomainGoto(domain, error);
+    virCheckNonNullArgGoto(info, error);
+
+    if ((ret = virConnectBatchAddCall(batch, VIR_CONNECT_BATCH_DOMAIN_GET_INFO,
+                                      domain, NULL, 0, &call)) < 0)
+        goto error;
+
+    call->info = info;
+    return ret;
+
+ error:
+    virDispatchError(batch->conn);
+    return -1;
+}
+
+
+/**
+ * virConnectBatchAddDomainGetState:
+ * @batch: a batch object
+ * @domain: a domain object belonging to the connection of @batch
+ * @state: returned state of the domain (one of virDomainState)
+ * @reason: returned reason which led to @state; it is allowed to be NULL
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Queues a call equivalent to virDomainGetState(). @state and @reason
+ * are filled in by virConnectBatchSubmit() and must stay valid until
+ * then.
+ *
+ * Returns the index of the call within @batch to be passed to
+ * virConnectBatchGetResult(), or -1 in case of failure.
+ */
+int
+virConnectBatchAddDomainGetState(virConnectBatchPtr batch,
+                                 virDomainPtr domain,
+                                 int *state,
+                                 int *reason,
+                                 unsigned int flags)
+{
+    virConnectBatchCallPtr call;
+    int ret;
+
+    VIR_DEBUG("batch=%p, domain=%p, state=%p, reason=%p, flags=0x%x",
+              batch, domain, state, reason, flags);
+
+    virResetLastError();
+
+    virCheckConnectBatchReturn(batch, -1);
+    virCheckDomainGoto(domain, error);
+    virCheckNonNullArgGoto(state, error);
+
+    if ((ret = virConnectBatchAddCall(batch, VIR_CONNECT_BATCH_DOMAIN_GET_STATE,
+                                      domain, NULL, flags, &call)) < 0)
+        goto error;
+
+    call->state = state;
+    call->reason = reason;
+    return ret;
+
+ error:
+    virDispatchError(batch->conn);
+    return -1;
+}
+
+
+/**
+ * virConnectBatchAddDomainGetBlockInfo:
+ * @batch: a batch object
+ * @domain: a domain object belonging to the connection of @batch
+ * @disk: path to the block device, or device shorthand
+ * @info: pointer to a virDomainBlockInfo structure allocated by the user
+ * @flags: currently unused, pass zero
+ *
+ * Queues a call equivalent to virDomainGetBlockInfo(). @info is filled
+ * in by virConnectBatchSubmit() and must stay valid until then.
+ *
+ * Returns the index of the call within @batch to be passed to
+ * virConnectBatchGetResult(), or -1 in case of failure.
+ */
+int
+virConnectBatchAddDomainGetBlockInfo(virConnectBatchPtr batch,
+                                     virDomainPtr domain,
+                                     const char *disk,
+                                     virDomainBlockInfoPtr info,
+                                     unsigned int flags)
+{
+    virConnectBatchCallPtr call;
+    int ret;
+
+    VIR_DEBUG("batch=%p, domain=%p, disk=%s, info=%p, flags=0x%x",
+              batch, domain, NULLSTR(disk), info, flags);
+
+    virResetLastError();
+
+    virCheckConnectBatchReturn(batch, -1);
+    virCheckDomainGoto(domain, error);
+    virCheckNonEmptyStringArgGoto(disk, error);
+    virCheckNonNullArgGoto(info, error);
+
+    if ((ret = virConnectBatchAddCall(batch,
+                                      VIR_CONNECT_BATCH_DOMAIN_GET_BLOCK_INFO,
+                                      domain, disk, flags, &call)) < 0)
+        goto error;
+
+    call->blockInfo = info;
+    return ret;
+
+ error:
+    virDispatchError(batch->conn);
+    return -1;
+}
+
+
+/*
+ * Execute the calls of @batch one by one, for drivers which have no
+ * native support for batches.
+ */
+static void
+virConnectBatchSubmitSequential(virConnectBatchPtr batch)
+{
+    size_t i;
+
+    for (i = 0; i < batch->ncalls; i++) {
+        virConnectBatchCallPtr call = &batch->calls[i];
+        int rc = -1;
+
+        switch (call->type) {
+        case VIR_CONNECT_BATCH_DOMAIN_GET_INFO:
+            rc = virDomainGetInfo(call->domain, call->info);
+            break;
+        case VIR_CONNECT_BATCH_DOMAIN_GET_STATE:
+            rc = virDomainGetState(call->domain, call->state,
+                                   call->reason, call->flags);
+            break;
+        case VIR_CONNECT_BATCH_DOMAIN_GET_BLOCK_INFO:
+            rc = virDomainGetBlockInfo(call->domain, call->disk,
+                                       call->blockInfo, call->flags);
+            break;
+        case VIR_CONNECT_BATCH_LAST:
+            break;
+        }
+
+        if (rc < 0)
+            call->error = virSaveLastError();
+        call->done = true;
+    }
+
+    virResetLastError();
+}
+
+
+/**
+ * virConnectBatchSubmit:
+ * @batch: a batch object
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Executes all calls queued in @batch and stores their results in the
+ * memory provided when they were added. The outcome of every single
+ * call is then available through virConnectBatchGetResult(); a failure
+ * of one call does not prevent the others from being executed.
+ *
+ * With the remote driver the batch is transferred in a single message
+ * and the daemon is free to execute the calls in parallel, which saves
+ * a round trip per call when querying many domains.
+ *
+ * A batch can be submitted repeatedly, for example to poll the same
+ * set of domains periodically.
+ *
+ * Returns 0 if the batch was executed, -1 if it could not be
+ * submitted at all.
+ */
+int
+virConnectBatchSubmit(virConnectBatchPtr batch,
+                      unsigned int flags)
+{
+    virConnectPtr conn;
+    size_t i;
+
+    VIR_DEBUG("batch=%p, flags=0x%x", batch, flags);
+
+    virResetLastError();
+
+    virCheckConnectBatchReturn(batch, -1);
+    conn = batch->conn;
+
+    virCheckFlagsGoto(0, error);
+
+    for (i = 0; i < batch->ncalls; i++) {
+        batch->calls[i].done = false;
+        virFreeError(batch->calls[i].error);
+        batch->calls[i].error = NULL;
+    }
+
+    if (batch->ncalls == 0)
+        return 0;
+
+    if (conn->driver->connectBatchSubmit) {
+        if (conn->driver->connectBatchSubmit(batch, flags) < 0)
+            goto error;
+        return 0;
+    }
+
+    virConnectBatchSubmitSequential(batch);
+    return 0;
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
+/**
+ * virConnectBatchGetResult:
+ * @batch: a batch object
+ * @call: index of the call as returned by virConnectBatchAdd*
+ *
+ * Reports the outcome of a call executed by virConnectBatchSubmit().
+ * If the call failed, its error is made the last error of the calling
+ * thread, so that it can be examined with virGetLastError().
+ *
+ * Returns 0 if the call succeeded and -1 if it failed or has not been
+ * executed.
+ */
+int
+virConnectBatchGetResult(virConnectBatchPtr batch,
+                         int call)
+{
+    virConnectBatchCallPtr c;
+
+    VIR_DEBUG("batch=%p, call=%d", batch, call);
+
+    virResetLastError();
+
+    virCheckConnectBatchReturn(batch, -1);
+
+    if (call < 0 || (size_t) call >= batch->ncalls) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("call index %d out of range"), call);
+        goto error;
+    }
+
+    c = &batch->calls[call];
+
+    if (!c->done) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("batch has not been submitted"));
+        goto error;
+    }
+
+    if (c->error) {
+        virSetError(c->error);
+        goto error;
+    }
+
+    return 0;
+
+ error:
+    virDispatchError(batch->conn);
+    return -1;
+}
+
+
+/**
+ * virDomainGetInfoAsync:
+ * @domain: a domain object
+ * @cb: callback to invoke with the result
+ * @opaque: user data to pass to @cb
+ * @freecb: optional function to free @opaque once @cb has run
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Asynchronous variant of virDomainGetInfo(). The call is submitted
+ * without waiting for its reply and @cb is invoked with the result
+ * once it arrives, followed by @freecb if it is not NULL.
+ *
+ * With the remote driver, @cb runs from the event loop, so the
+ * application must have registered one with virEventRegisterImpl()
+ * or virEventRegisterDefaultImpl() and be running it. Drivers without
+ * native support for asynchronous calls execute the call right away
+ * and invoke @cb before this function returns.
+ *
+ * If the connection is closed before the reply arrives, @cb is invoked
+ * with an error.
+ *
+ * Returns 0 if the call was submitted, in which case @cb is invoked
+ * exactly once, or -1 on error, in which case neither @cb nor @freecb
+ * are invoked.
+ */
+int
+virDomainGetInfoAsync(virDomainPtr domain,
+                      virDomainGetInfoCallback cb,
+                      void *opaque,
+                      virFreeCallback freecb,
+                      unsigned int flags)
+{
+    virConnectPtr conn;
+    virDomainInfo info;
+    int rc;
+
+    VIR_DOMAIN_DEBUG(domain, "cb=%p, opaque=%p, freecb=%p, flags=0x%x",
+                     cb, opaque, freecb, flags);
+
+    virResetLastError();
+
+    virCheckDomainReturn(domain, -1);
+    virCheckNonNullArgGoto(cb, error);
+    virCheckFlagsGoto(0, error);
+
+    conn = domain->conn;
+
+    if (conn->driver->domainGetInfoAsync) {
+        if (conn->driver->domainGetInfoAsync(domain, cb, opaque,
+                                             freecb, flags) < 0)
+            goto error;
+        return 0;
+    }
+
+    if (!conn->driver->domainGetInfo) {
+        virReportUnsupportedError();
+        goto error;
+    }
+
+    rc = virDomainGetInfo(domain, &info);
+    cb(domain, rc, rc < 0 ? NULL : &info, opaque);
+    if (freecb)
+        freecb(opaque);
+    virResetLastError();
+    return 0;
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
+/**
+ * virDomainMemoryStatsAsync:
+ * @domain: a domain object
+ * @nr_stats: maximum number of statistics to return
+ * @cb: callback to invoke with the result
+ * @opaque: user data to pass to @cb
+ * @freecb: optional function to free @opaque once @cb has run
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Asynchronous variant of virDomainMemoryStats(). The call is submitted
+ * without waiting for its reply and @cb is invoked with the statistics
+ * once they arrive, followed by @freecb if it is not NULL. See
+ * virDomainGetInfoAsync() for the requirements on the event loop.
+ *
+ * Returns 0 if the call was submitted, in which case @cb is invoked
+ * exactly once, or -1 on error, in which case neither @cb nor @freecb
+ * are invoked.
+ */
+int
+virDomainMemoryStatsAsync(virDomainPtr domain,
+                          unsigned int nr_stats,
+                          virDomainMemoryStatsCallback cb,
+                          void *opaque,
+                          virFreeCallback freecb,
+                          unsigned int flags)
+{
+    virConnectPtr conn;
+    virDomainMemoryStatStruct stats[VIR_DOMAIN_MEMORY_STAT_NR];
+    int rc;
+
+    VIR_DOMAIN_DEBUG(domain, "nr_stats=%u, cb=%p, opaque=%p, freecb=%p, "
+                     "flags=0x%x", nr_stats, cb, opaque, freecb, flags);
+
+    virResetLastError();
+
+    virCheckDomainReturn(domain, -1);
+    virCheckNonZeroArgGoto(nr_stats, error);
+    virCheckNonNullArgGoto(cb, error);
+    virCheckFlagsGoto(0, error);
+
+    if (nr_stats > VIR_DOMAIN_MEMORY_STAT_NR)
+        nr_stats = VIR_DOMAIN_MEMORY_STAT_NR;
+
+    conn = domain->conn;
+
+    if (conn->driver->domainMemoryStatsAsync) {
+        if (conn->driver->domainMemoryStatsAsync(domain, nr_stats, cb, opaque,
+                                                 freecb, flags) < 0)
+            goto error;
+        return 0;
+    }
+
+    if (!conn->driver->domainMemoryStats) {
+        virReportUnsupportedError();
+        goto error;
+    }
+
+    rc = virDomainMemoryStats(domain, stats, nr_stats, flags);
+    cb(domain, rc, rc < 0 ? NULL : stats, opaque);
+    if (freecb)
+        freecb(opaque);
+    virResetLastError();
+    return 0;
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
+/**
+ * virDomainListGetStatsAsync:
+ * @doms: NULL terminated array of domains
+ * @stats: stats to return, binary-OR of virDomainStatsTypes
+ * @cb: callback to invoke with the result
+ * @opaque: user data to pass to @cb
+ * @freecb: optional function to free @opaque once @cb has run
+ * @flags: extra flags; binary-OR of virConnectGetAllDomainStatsFlags
+ *
+ * Asynchronous variant of virDomainListGetStats(). The call is submitted
+ * without waiting for its reply and @cb is invoked with the statistics
+ * records once they arrive, followed by @freecb if it is not NULL. The
+ * records are owned by @cb. See virDomainGetInfoAsync() for the
+ * requirements on the event loop.
+ *
+ * Returns 0 if the call was submitted, in which case @cb is invoked
+ * exactly once, or -1 on error, in which case neither @cb nor @freecb
+ * are invoked.
+ */
+int
+virDomainListGetStatsAsync(virDomainPtr *doms,
+                           unsigned int stats,
+                           virDomainListGetStatsCallback cb,
+                           void *opaque,
+                           virFreeCallback freecb,
+                           unsigned int flags)
+{
+    virConnectPtr conn = NULL;
+    virDomainPtr *nextdom = doms;
+    virDomainStatsRecordPtr *records = NULL;
+    unsigned int ndoms = 0;
+    int rc;
+
+    VIR_DEBUG("doms=%p, stats=0x%x, cb=%p, opaque=%p, freecb=%p, flags=0x%x",
+              doms, stats, cb, opaque, freecb, flags);
+
+    virResetLastError();
+
+    virCheckNonNullArgGoto(doms, error);
+    virCheckNonNullArgGoto(cb, error);
+
+    if (!*doms) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("doms array in %s must contain at least one domain"),
+                       __FUNCTION__);
+        goto error;
+    }
+
+    conn = doms[0]->conn;
+    virCheckConnectReturn(conn, -1);
+
+    while (*nextdom) {
+        virDomainPtr dom = *nextdom;
+
+        virCheckDomainGoto(dom, error);
+
+        if (dom->conn != conn) {
+            virReportError(VIR_ERR_INVALID_ARG, "%s",
+                           _("domains in 'doms' array must belong to a "
+                             "single connection"));
+            goto error;
+        }
+
+        ndoms++;
+        nextdom++;
+    }
+
+    if (conn->driver->connectGetAllDomainStatsAsync) {
+        if (conn->driver->connectGetAllDomainStatsAsync(conn, doms, ndoms,
+                                                        stats, cb, opaque,
+                                                        freecb, flags) < 0)
+            goto error;
+        return 0;
+    }
+
+    if (!conn->driver->connectGetAllDomainStats) {
+        virReportUnsupportedError();
+        goto error;
+    }
+
+    rc = virDomainListGetStats(doms, stats, &records, flags);
+    cb(conn, rc, records, opaque);
+    if (freecb)
+        freecb(opaque);
+    virResetLastError();
+    return 0;
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
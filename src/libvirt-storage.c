@@ -1575,6 +1575,98 @@ virStorageVolCreateXMLFrom(virStoragePoolPtr pool,
 }
 
 
+/*
+ * Common part of virStorageVolDownloadRanges and
+ * virStorageVolUploadRanges: check the ranges are sane and disjoint,
+ * then set up a transfer of each of them over its own stream.
+ */
+static int
+virStorageVolTransferRanges(virStorageVolPtr vol,
+                            unsigned int nranges,
+                            virStreamPtr *streams,
+                            const unsigned long long *offsets,
+                            const unsigned long long *lengths,
+                            unsigned int flags,
+                            bool upload)
+{
+    virStorageDriverPtr driver;
+    virErrorPtr orig_err;
+    size_t i, j;
+
+    virCheckNonZeroArgGoto(nranges, error);
+    virCheckNonNullArgGoto(streams, error);
+    virCheckNonNullArgGoto(offsets, error);
+    virCheckNonNullArgGoto(lengths, error);
+
+    for (i = 0; i < nranges; i++) {
+        virCheckStreamGoto(streams[i], error);
+
+        if (vol->conn != streams[i]->conn) {
+            virReportInvalidArg(streams,
+                                _("stream %zu in %s must match connection "
+                                  "of volume '%s'"),
+                                i, __FUNCTION__, vol->name);
+            goto error;
+        }
+
+        if (lengths[i] == 0 ||
+            lengths[i] > ULLONG_MAX - offsets[i]) {
+            virReportInvalidArg(lengths,
+                                _("invalid length %llu of range %zu in %s"),
+                                lengths[i], i, __FUNCTION__);
+            goto error;
+        }
+
+        for (j = 0; j < i; j++) {
+            if (offsets[i] < offsets[j] + lengths[j] &&
+                offsets[j] < offsets[i] + lengths[i]) {
+                virReportInvalidArg(offsets,
+                                    _("range %zu overlaps with range %zu "
+                                      "in %s"),
+                                    i, j, __FUNCTION__);
+                goto error;
+            }
+        }
+    }
+
+    driver = vol->conn->storageDriver;
+    if (!driver ||
+        !(upload ? driver->storageVolUpload : driver->storageVolDownload)) {
+        virReportUnsupportedError();
+        goto error;
+    }
+
+    for (i = 0; i < nranges; i++) {
+        int rc;
+
+        VIR_DEBUG("range=%zu, stream=%p, offset=%llu, length=%llu",
+                  i, streams[i], offsets[i], lengths[i]);
+
+        if (upload)
+            rc = driver->storageVolUpload(vol, streams[i],
+                                          offsets[i], lengths[i], flags);
+        else
+            rc = driver->storageVolDownload(vol, streams[i],
+                                            offsets[i], lengths[i], flags);
+        if (rc < 0) {
+            orig_err = virSaveLastError();
+            for (j = 0; j < i; j++)
+                virStreamAbort(streams[j]);
+            if (orig_err) {
+                virSetError(orig_err);
+                virFreeError(orig_err);
+            }
+            goto error;
+        }
+    }
+
+    return 0;
+
+ error:
+    return -1;
+}
+
+
 /**
  * virStorageVolDownload:
  * @vol: pointer to volume to download from
@@ -1646,6 +1738,59 @@ virStorageVolDownload(virStorageVolPtr vol,
 }
 
 
+/**
+ * virStorageVolDownloadRanges:
+ * @vol: pointer to volume to download from
+ * @nranges: number of ranges to download
+ * @streams: array of @nranges streams to use as output
+ * @offsets: array of @nranges positions in @vol to start reading from
+ * @lengths: array of @nranges amounts of data to download
+ * @flags: bitwise-OR of virStorageVolDownloadFlags
+ *
+ * Download several disjoint ranges of the volume at once, the i-th
+ * of which starts at @offsets[i], is @lengths[i] bytes long and is
+ * sent over @streams[i]. Each range is transferred as if by
+ * virStorageVolDownload(), so @flags has the same meaning, but the
+ * streams are independent and may be served concurrently, by
+ * separate threads of the client if it so wishes. None of the
+ * lengths may be zero.
+ *
+ * Either all the streams are set up, or none is: if setting up one
+ * of them fails, those set up already are aborted.
+ *
+ * The server may limit the number of such streams open at the same
+ * time, in which case setting up one more fails.
+ *
+ * Returns 0, or -1 upon error.
+ */
+int
+virStorageVolDownloadRanges(virStorageVolPtr vol,
+                            unsigned int nranges,
+                            virStreamPtr *streams,
+                            const unsigned long long *offsets,
+                            const unsigned long long *lengths,
+                            unsigned int flags)
+{
+    VIR_DEBUG("vol=%p, nranges=%u, streams=%p, offsets=%p, lengths=%p, "
+              "flags=0x%x", vol, nranges, streams, offsets, lengths, flags);
+
+    virResetLastError();
+
+    virCheckStorageVolReturn(vol, -1);
+    virCheckReadOnlyGoto(vol->conn->flags, error);
+
+    if (virStorageVolTransferRanges(vol, nranges, streams,
+                                    offsets, lengths, flags, false) < 0)
+        goto error;
+
+    return 0;
+
+ error:
+    virDispatchError(vol->conn);
+    return -1;
+}
+
+
 /**
  * virStorageVolUpload:
  * @vol: pointer to volume to upload
@@ -1665,11 +1810,18 @@ virStorageVolDownload(virStorageVolPtr vol,
  * the @stream with combination of virStreamSparseSendAll() or
  * virStreamSendHole() to preserve source file sparseness.
  *
+ * If VIR_STORAGE_VOL_UPLOAD_RANGE is set in @flags, only the
+ * data between @offset and @offset + @length is modified: holes are
+ * zeroed in place rather than by truncating the volume, so that
+ * other streams may upload disjoint ranges at the same time. See
+ * also virStorageVolUploadRanges().
+ *
  * This call sets up an asynchronous stream; subsequent use of
  * stream APIs is necessary to transfer the actual data,
  * determine how much data is successfully transferred, and
  * detect any errors. The results will be unpredictable if
- * another active stream is writing to the storage volume.
+ * another active stream is writing to the same part of the
+ * storage volume.
  *
  * When the data stream is closed whether the upload is successful
  * or not an attempt will be made to refresh the target storage pool
@@ -1726,6 +1878,61 @@ virStorageVolUpload(virStorageVolPtr vol,
 }
 
 
+/**
+ * virStorageVolUploadRanges:
+ * @vol: pointer to volume to upload
+ * @nranges: number of ranges to upload
+ * @streams: array of @nranges streams to use as input
+ * @offsets: array of @nranges positions to start writing to
+ * @lengths: array of @nranges amounts of data to upload
+ * @flags: bitwise-OR of virStorageVolUploadFlags
+ *
+ * Upload new content to several disjoint ranges of the volume at
+ * once, the i-th of which starts at @offsets[i], is @lengths[i]
+ * bytes long and is read from @streams[i]. Each range is
+ * transferred as if by virStorageVolUpload() with
+ * VIR_STORAGE_VOL_UPLOAD_RANGE added to @flags, so holes sent over
+ * sparse streams are zeroed in place, and the volume is never
+ * truncated. None of the lengths may be zero.
+ *
+ * Either all the streams are set up, or none is: if setting up one
+ * of them fails, those set up already are aborted. The target
+ * storage pool is refreshed whenever one of the streams is closed.
+ *
+ * The server may limit the number of such streams open at the same
+ * time, in which case setting up one more fails.
+ *
+ * Returns 0, or -1 upon error.
+ */
+int
+virStorageVolUploadRanges(virStorageVolPtr vol,
+                          unsigned int nranges,
+                          virStreamPtr *streams,
+                          const unsigned long long *offsets,
+                          const unsigned long long *lengths,
+                          unsigned int flags)
+{
+    VIR_DEBUG("vol=%p, nranges=%u, streams=%p, offsets=%p, lengths=%p, "
+              "flags=0x%x", vol, nranges, streams, offsets, lengths, flags);
+
+    virResetLastError();
+
+    virCheckStorageVolReturn(vol, -1);
+    virCheckReadOnlyGoto(vol->conn->flags, error);
+
+    if (virStorageVolTransferRanges(vol, nranges, streams, offsets, lengths,
+                                    flags | VIR_STORAGE_VOL_UPLOAD_RANGE,
+                                    true) < 0)
+        goto error;
+
+    return 0;
+
+ error:
+    virDispatchError(vol->conn);
+    return -1;
+}
+
+
 /**
  * virStorageVolDelete:
  * @vol: pointer to storage volume
@@ -123,6 +123,17 @@ enum {
      * Support for driver close callback rpc
      */
     VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK = 15,
+
+    /*
+     * Remote party accepts compressed RPC replies.
+     */
+    VIR_DRV_FEATURE_PROGRAM_COMPRESSION = 16,
+
+    /*
+     * Remote party can hand out a shared memory channel for the
+     * rest of the RPC traffic.
+     */
+    VIR_DRV_FEATURE_PROGRAM_SHM_TRANSPORT = 17,
 };
 
 
@@ -36,6 +36,7 @@
 #include "viralloc.h"
 #include "virlog.h"
 #include "virerror.h"
+#include "virevent.h"
 #include "virjson.h"
 #include "virfile.h"
 #include "virprocess.h"
@@ -775,16 +776,16 @@ qemuAgentOpen(virDomainObjPtr vm,
         goto cleanup;
 
     virObjectRef(mon);
-    if ((mon->watch = virEventAddHandle(mon->fd,
-                                        VIR_EVENT_HANDLE_HANGUP |
-                                        VIR_EVENT_HANDLE_ERROR |
-                                        VIR_EVENT_HANDLE_READABLE |
-                                        (mon->connectPending ?
-                                         VIR_EVENT_HANDLE_WRITABLE :
-                                         0),
-                                        qemuAgentIO,
-                                        mon,
-                                        virObjectFreeCallback)) < 0) {
+    if ((mon->watch = virEventAddIOHandle(mon->fd,
+                                          VIR_EVENT_HANDLE_HANGUP |
+                                          VIR_EVENT_HANDLE_ERROR |
+                                          VIR_EVENT_HANDLE_READABLE |
+                                          (mon->connectPending ?
+                                           VIR_EVENT_HANDLE_WRITABLE :
+                                           0),
+                                          qemuAgentIO,
+                                          mon,
+                                          virObjectFreeCallback)) < 0) {
         virObjectUnref(mon);
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("unable to register monitor events"));
@@ -5337,15 +5337,23 @@ virQEMUCapsNewData(const char *binary,
                    void *privData)
 {
     virQEMUCapsCachePrivPtr priv = privData;
+    virQEMUCapsPtr qemuCaps;
+
+    qemuCaps = virQEMUCapsNewForBinaryInternal(priv->hostArch,
+                                               binary,
+                                               priv->libDir,
+                                               priv->runUid,
+                                               priv->runGid,
+                                               priv->microcodeVersion,
+                                               priv->kernelVersion,
+                                               false);
 
-    return virQEMUCapsNewForBinaryInternal(priv->hostArch,
-                                           binary,
-                                           priv->libDir,
-                                           priv->runUid,
-                                           priv->runGid,
-                                           priv->microcodeVersion,
-                                           priv->kernelVersion,
-                                           false);
+    /* The binary was (re)probed, so whatever was built from
+     * its previous capabilities is out of date now */
+    if (qemuCaps)
+        virCapabilitiesInvalidate();
+
+    return qemuCaps;
 }
 
 
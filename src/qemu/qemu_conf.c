@@ -1088,6 +1088,29 @@ virCapsPtr virQEMUDriverCreateCapabilities(virQEMUDriverPtr driver)
 }
 
 
+/*
+ * Tell whether anything visible in the capabilities XML differs
+ * between @oldcaps and @newcaps, e.g. because of a host CPU or NUMA
+ * topology change.
+ */
+static bool
+virQEMUDriverCapabilitiesChanged(virCapsPtr oldcaps,
+                                 virCapsPtr newcaps)
+{
+    char *oldxml = NULL;
+    char *newxml = NULL;
+    bool ret = true;
+
+    if ((oldxml = virCapabilitiesFormatXML(oldcaps)) &&
+        (newxml = virCapabilitiesFormatXML(newcaps)))
+        ret = STRNEQ(oldxml, newxml);
+
+    VIR_FREE(oldxml);
+    VIR_FREE(newxml);
+    return ret;
+}
+
+
 /**
  * virQEMUDriverGetCapabilities:
  *
@@ -1103,13 +1126,15 @@ virCapsPtr virQEMUDriverGetCapabilities(virQEMUDriverPtr driver,
                                         bool refresh)
 {
     virCapsPtr ret = NULL;
+    virCapsPtr oldcaps = NULL;
+
     if (refresh) {
         virCapsPtr caps = NULL;
         if ((caps = virQEMUDriverCreateCapabilities(driver)) == NULL)
             return NULL;
 
         qemuDriverLock(driver);
-        virObjectUnref(driver->caps);
+        oldcaps = driver->caps;
         driver->caps = caps;
     } else {
         qemuDriverLock(driver);
@@ -1124,6 +1149,15 @@ virCapsPtr virQEMUDriverGetCapabilities(virQEMUDriverPtr driver,
 
     ret = virObjectRef(driver->caps);
     qemuDriverUnlock(driver);
+
+    /* Let caches of formatted capabilities know about changes
+     * found by the refresh */
+    if (oldcaps) {
+        if (virQEMUDriverCapabilitiesChanged(oldcaps, ret))
+            virCapabilitiesInvalidate();
+        virObjectUnref(oldcaps);
+    }
+
     return ret;
 }
 
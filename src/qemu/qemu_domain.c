@@ -5643,6 +5643,9 @@ qemuDomainObjEnterMonitorInternal(virQEMUDriverPtr driver,
     virObjectLock(priv->mon);
     virObjectRef(priv->mon);
     ignore_value(virTimeMillisNow(&priv->monStart));
+    /* Readers of the summary must not see stale data for as long as
+     * the monitor command takes */
+    virDomainObjUpdateSummary(obj);
     virObjectUnlock(obj);
 
     return 0;
@@ -210,6 +210,27 @@ qemuDomObjFromDomain(virDomainPtr domain)
     return vm;
 }
 
+/* Looks up the summary of the domain without waiting for the domain
+ * object lock. The caller must free it with virDomainObjSummaryClear(). */
+static int
+qemuDomainSummaryFromDomain(virDomainPtr domain,
+                            virDomainObjSummaryPtr summary)
+{
+    virQEMUDriverPtr driver = domain->conn->privateData;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    int rc;
+
+    rc = virDomainObjListGetSummary(driver->domains, domain->uuid, summary);
+    if (rc == 0) {
+        virUUIDFormat(domain->uuid, uuidstr);
+        virReportError(VIR_ERR_NO_DOMAIN,
+                       _("no domain with matching uuid '%s' (%s)"),
+                       uuidstr, domain->name);
+    }
+
+    return rc > 0 ? 0 : -1;
+}
+
 /* Looks up the domain object from snapshot and unlocks the
  * driver. The returned domain object is locked and ref'd and the
  * caller must call virDomainObjEndAPI() on it. */
@@ -1556,26 +1577,30 @@ static virDomainPtr qemuDomainLookupByUUID(virConnectPtr conn,
                                            const unsigned char *uuid)
 {
     virQEMUDriverPtr driver = conn->privateData;
-    virDomainObjPtr vm;
+    virDomainObjSummary summary;
     virDomainPtr dom = NULL;
+    int rc;
 
-    vm = virDomainObjListFindByUUIDRef(driver->domains, uuid);
+    rc = virDomainObjListGetSummary(driver->domains, uuid, &summary);
+    if (rc < 0)
+        return NULL;
 
-    if (!vm) {
+    if (rc == 0) {
         char uuidstr[VIR_UUID_STRING_BUFLEN];
         virUUIDFormat(uuid, uuidstr);
         virReportError(VIR_ERR_NO_DOMAIN,
                        _("no domain with matching uuid '%s'"), uuidstr);
-        goto cleanup;
+        return NULL;
     }
 
-    if (virDomainLookupByUUIDEnsureACL(conn, vm->def) < 0)
+    if (virDomainLookupByUUIDEnsureACL(conn, summary.def) < 0)
         goto cleanup;
 
-    dom = virGetDomain(conn, vm->def->name, vm->def->uuid, vm->def->id);
+    dom = virGetDomain(conn, summary.def->name, summary.def->uuid,
+                       summary.def->id);
 
  cleanup:
-    virDomainObjEndAPI(&vm);
+    virDomainObjSummaryClear(&summary);
     return dom;
 }
 
@@ -2694,22 +2719,25 @@ qemuDomainGetState(virDomainPtr dom,
                    int *reason,
                    unsigned int flags)
 {
-    virDomainObjPtr vm;
+    virDomainObjSummary summary;
     int ret = -1;
 
     virCheckFlags(0, -1);
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        goto cleanup;
+    /* Don't wait for jobs just to report the state */
+    if (qemuDomainSummaryFromDomain(dom, &summary) < 0)
+        return -1;
 
-    if (virDomainGetStateEnsureACL(dom->conn, vm->def) < 0)
+    if (virDomainGetStateEnsureACL(dom->conn, summary.def) < 0)
         goto cleanup;
 
-    *state = virDomainObjGetState(vm, reason);
+    *state = summary.state.state;
+    if (reason)
+        *reason = summary.state.reason;
     ret = 0;
 
  cleanup:
-    virDomainObjEndAPI(&vm);
+    virDomainObjSummaryClear(&summary);
     return ret;
 }
 
@@ -18828,6 +18856,27 @@ qemuConnectListAllDomains(virConnectPtr conn,
     return ret;
 }
 
+
+static int
+qemuConnectListDomainChanges(virConnectPtr conn,
+                             unsigned long long *generation,
+                             unsigned int maxitems,
+                             virDomainPtr **domains,
+                             char ***removed,
+                             unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+
+    virCheckFlags(0, -1);
+
+    if (virConnectListDomainChangesEnsureACL(conn) < 0)
+        return -1;
+
+    return virDomainObjListExportChanges(driver->domains, conn, generation,
+                                         maxitems, domains, removed,
+                                         virConnectListDomainChangesCheckACL);
+}
+
 static char *
 qemuDomainQemuAgentCommand(virDomainPtr domain,
                            const char *cmd,
@@ -21437,6 +21486,7 @@ static virHypervisorDriver qemuHypervisorDriver = {
     .domainSetVcpu = qemuDomainSetVcpu, /* 3.1.0 */
     .domainSetBlockThreshold = qemuDomainSetBlockThreshold, /* 3.2.0 */
     .domainSetLifecycleAction = qemuDomainSetLifecycleAction, /* 3.9.0 */
+    .connectListDomainChanges = qemuConnectListDomainChanges, /* 4.1.0 */
 };
 
 
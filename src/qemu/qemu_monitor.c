@@ -35,6 +35,7 @@
 #include "qemu_domain.h"
 #include "qemu_process.h"
 #include "virerror.h"
+#include "virevent.h"
 #include "viralloc.h"
 #include "virlog.h"
 #include "virfile.h"
@@ -975,13 +976,13 @@ bool
 qemuMonitorRegister(qemuMonitorPtr mon)
 {
     virObjectRef(mon);
-    if ((mon->watch = virEventAddHandle(mon->fd,
-                                        VIR_EVENT_HANDLE_HANGUP |
-                                        VIR_EVENT_HANDLE_ERROR |
-                                        VIR_EVENT_HANDLE_READABLE,
-                                        qemuMonitorIO,
-                                        mon,
-                                        virObjectFreeCallback)) < 0) {
+    if ((mon->watch = virEventAddIOHandle(mon->fd,
+                                          VIR_EVENT_HANDLE_HANGUP |
+                                          VIR_EVENT_HANDLE_ERROR |
+                                          VIR_EVENT_HANDLE_READABLE,
+                                          qemuMonitorIO,
+                                          mon,
+                                          virObjectFreeCallback)) < 0) {
         virObjectUnref(mon);
         return false;
     }
@@ -29,6 +29,7 @@
 #include "virnetclient.h"
 #include "virnetclientprogram.h"
 #include "virnetclientstream.h"
+#include "virnetshmchannel.h"
 #include "virerror.h"
 #include "virlog.h"
 #include "datatypes.h"
@@ -98,6 +99,7 @@ struct private_data {
     bool serverKeepAlive;       /* Does server support keepalive protocol? */
     bool serverEventFilter;     /* Does server support modern event filtering */
     bool serverCloseCallback;   /* Does server support driver close callback */
+    bool serverCompression;     /* Does server send compressed replies */
 
     virObjectEventStatePtr eventState;
     virConnectCloseCallbackDataPtr closeCallback;
@@ -669,6 +671,42 @@ remoteConnectSupportsFeatureUnlocked(virConnectPtr conn,
     return rc != -1 && ret.supported;
 }
 
+/*
+ * Ask the server for a shared memory channel and move all further
+ * traffic to it.
+ */
+static int
+remoteConnectOpenShmChannelUnlocked(virConnectPtr conn,
+                                    struct private_data *priv)
+{
+    remote_connect_open_shm_channel_args args = { 0 };
+    int *fdout = NULL;
+    size_t fdoutlen = 0;
+    int rv = -1;
+
+    if (callFull(conn, priv, 0,
+                 NULL, 0,
+                 &fdout, &fdoutlen,
+                 REMOTE_PROC_CONNECT_OPEN_SHM_CHANNEL,
+                 (xdrproc_t) xdr_remote_connect_open_shm_channel_args, (char *) &args,
+                 (xdrproc_t) xdr_void, NULL) == -1)
+        goto cleanup;
+
+    if (fdoutlen != 1) {
+        virReportError(VIR_ERR_RPC, "%s",
+                       _("expected a single shared memory channel"));
+        while (fdoutlen)
+            VIR_FORCE_CLOSE(fdout[--fdoutlen]);
+        goto cleanup;
+    }
+
+    rv = virNetClientSetShmChannel(priv->client, fdout[0]);
+
+ cleanup:
+    VIR_FREE(fdout);
+    return rv;
+}
+
 /* helper macro to ease extraction of arguments from the URI */
 #define EXTRACT_URI_ARG_STR(ARG_NAME, ARG_VAR) \
     if (STRCASEEQ(var->name, ARG_NAME)) { \
@@ -1180,6 +1218,16 @@ doRemoteOpen(virConnectPtr conn,
     if (remoteAuthenticate(conn, priv, auth, authtype) == -1)
         goto failed;
 
+    /* Local clients can move their traffic off the socket. This has to
+     * come first, before anything can make the server send data on its
+     * own initiative, e.g. keepalive requests */
+    if (transport == trans_unix &&
+        virNetShmChannelIsSupported() &&
+        remoteConnectSupportsFeatureUnlocked(conn, priv,
+                                             VIR_DRV_FEATURE_PROGRAM_SHM_TRANSPORT) &&
+        remoteConnectOpenShmChannelUnlocked(conn, priv) < 0)
+        goto failed;
+
     if (virNetClientKeepAliveIsSupported(priv->client)) {
         priv->serverKeepAlive = remoteConnectSupportsFeatureUnlocked(conn,
                                     priv, VIR_DRV_FEATURE_PROGRAM_KEEPALIVE);
@@ -1189,6 +1237,16 @@ doRemoteOpen(virConnectPtr conn,
         }
     }
 
+    /* Compressing replies does not pay off on local sockets */
+    if (transport != trans_unix &&
+        virNetMessageCompressionIsSupported()) {
+        priv->serverCompression = remoteConnectSupportsFeatureUnlocked(conn,
+                                    priv, VIR_DRV_FEATURE_PROGRAM_COMPRESSION);
+        if (!priv->serverCompression)
+            VIR_INFO("Replies are sent uncompressed since compression is "
+                     "not supported by the server");
+    }
+
     /* Finally we can call the remote side's open function. */
     {
         remote_connect_open_args args = { &name, flags };
@@ -6657,6 +6715,204 @@ remoteDomainGetDiskErrors(virDomainPtr dom,
     return rv;
 }
 
+static int
+remoteConnectBatchEncodeCall(virConnectBatchCallPtr call,
+                             remote_connect_batch_call *rcall)
+{
+    size_t len;
+
+    switch (call->type) {
+    case VIR_CONNECT_BATCH_DOMAIN_GET_INFO: {
+        remote_domain_get_info_args args;
+
+        make_nonnull_domain(&args.dom, call->domain);
+        rcall->proc = REMOTE_PROC_DOMAIN_GET_INFO;
+        if (virNetMessageEncodeData((xdrproc_t) xdr_remote_domain_get_info_args,
+                                    &args, &rcall->args.args_val, &len) < 0)
+            return -1;
+        break;
+    }
+    case VIR_CONNECT_BATCH_DOMAIN_GET_STATE: {
+        remote_domain_get_state_args args;
+
+        make_nonnull_domain(&args.dom, call->domain);
+        args.flags = call->flags;
+        rcall->proc = REMOTE_PROC_DOMAIN_GET_STATE;
+        if (virNetMessageEncodeData((xdrproc_t) xdr_remote_domain_get_state_args,
+                                    &args, &rcall->args.args_val, &len) < 0)
+            return -1;
+        break;
+    }
+    case VIR_CONNECT_BATCH_DOMAIN_GET_BLOCK_INFO: {
+        remote_domain_get_block_info_args args;
+
+        make_nonnull_domain(&args.dom, call->domain);
+        args.path = call->disk;
+        args.flags = call->flags;
+        rcall->proc = REMOTE_PROC_DOMAIN_GET_BLOCK_INFO;
+        if (virNetMessageEncodeData((xdrproc_t) xdr_remote_domain_get_block_info_args,
+                                    &args, &rcall->args.args_val, &len) < 0)
+            return -1;
+        break;
+    }
+    case VIR_CONNECT_BATCH_LAST:
+    default:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unexpected batch call type %d"), call->type);
+        return -1;
+    }
+
+    rcall->args.args_len = len;
+    return 0;
+}
+
+
+static int
+remoteConnectBatchDecodeReply(virConnectBatchCallPtr call,
+                              remote_connect_batch_reply *reply)
+{
+    int rv = -1;
+
+    switch (call->type) {
+    case VIR_CONNECT_BATCH_DOMAIN_GET_INFO: {
+        remote_domain_get_info_ret ret;
+
+        memset(&ret, 0, sizeof(ret));
+        if (virNetMessageDecodeData((xdrproc_t) xdr_remote_domain_get_info_ret,
+                                    &ret, reply->data.data_val,
+                                    reply->data.data_len) < 0)
+            break;
+
+        call->info->state = ret.state;
+        call->info->maxMem = ret.maxMem;
+        call->info->memory = ret.memory;
+        call->info->nrVirtCpu = ret.nrVirtCpu;
+        call->info->cpuTime = ret.cpuTime;
+        xdr_free((xdrproc_t) xdr_remote_domain_get_info_ret, (char *) &ret);
+        rv = 0;
+        break;
+    }
+    case VIR_CONNECT_BATCH_DOMAIN_GET_STATE: {
+        remote_domain_get_state_ret ret;
+
+        memset(&ret, 0, sizeof(ret));
+        if (virNetMessageDecodeData((xdrproc_t) xdr_remote_domain_get_state_ret,
+                                    &ret, reply->data.data_val,
+                                    reply->data.data_len) < 0)
+            break;
+
+        *call->state = ret.state;
+        if (call->reason)
+            *call->reason = ret.reason;
+        xdr_free((xdrproc_t) xdr_remote_domain_get_state_ret, (char *) &ret);
+        rv = 0;
+        break;
+    }
+    case VIR_CONNECT_BATCH_DOMAIN_GET_BLOCK_INFO: {
+        remote_domain_get_block_info_ret ret;
+
+        memset(&ret, 0, sizeof(ret));
+        if (virNetMessageDecodeData((xdrproc_t) xdr_remote_domain_get_block_info_ret,
+                                    &ret, reply->data.data_val,
+                                    reply->data.data_len) < 0)
+            break;
+
+        call->blockInfo->allocation = ret.allocation;
+        call->blockInfo->capacity = ret.capacity;
+        call->blockInfo->physical = ret.physical;
+        xdr_free((xdrproc_t) xdr_remote_domain_get_block_info_ret, (char *) &ret);
+        rv = 0;
+        break;
+    }
+    case VIR_CONNECT_BATCH_LAST:
+    default:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unexpected batch call type %d"), call->type);
+        break;
+    }
+
+    return rv;
+}
+
+
+static int
+remoteConnectBatchSubmit(virConnectBatchPtr batch,
+                         unsigned int flags)
+{
+    int rv = -1;
+    size_t i;
+    remote_connect_batch_submit_args args;
+    remote_connect_batch_submit_ret ret;
+    struct private_data *priv = batch->conn->privateData;
+
+    remoteDriverLock(priv);
+
+    memset(&args, 0, sizeof(args));
+    memset(&ret, 0, sizeof(ret));
+
+    if (batch->ncalls > REMOTE_CONNECT_BATCH_CALLS_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("too many calls in a batch: %zu > %d"),
+                       batch->ncalls, REMOTE_CONNECT_BATCH_CALLS_MAX);
+        goto done;
+    }
+
+    if (VIR_ALLOC_N(args.calls.calls_val, batch->ncalls) < 0)
+        goto done;
+    args.calls.calls_len = batch->ncalls;
+    args.flags = flags;
+
+    for (i = 0; i < batch->ncalls; i++) {
+        if (remoteConnectBatchEncodeCall(&batch->calls[i],
+                                         &args.calls.calls_val[i]) < 0)
+            goto done;
+    }
+
+    if (call(batch->conn, priv, 0, REMOTE_PROC_CONNECT_BATCH_SUBMIT,
+             (xdrproc_t) xdr_remote_connect_batch_submit_args, (char *) &args,
+             (xdrproc_t) xdr_remote_connect_batch_submit_ret, (char *) &ret) == -1)
+        goto done;
+
+    if (ret.replies.replies_len != batch->ncalls) {
+        virReportError(VIR_ERR_RPC,
+                       _("unexpected number of batch replies: %u != %zu"),
+                       ret.replies.replies_len, batch->ncalls);
+        goto cleanup;
+    }
+
+    for (i = 0; i < batch->ncalls; i++) {
+        virConnectBatchCallPtr bcall = &batch->calls[i];
+        remote_connect_batch_reply *reply = &ret.replies.replies_val[i];
+
+        if (reply->status == VIR_NET_OK) {
+            if (remoteConnectBatchDecodeReply(bcall, reply) < 0)
+                bcall->error = virSaveLastError();
+        } else {
+            virNetMessageError err;
+
+            memset(&err, 0, sizeof(err));
+            if (virNetMessageDecodeData((xdrproc_t) xdr_virNetMessageError,
+                                        &err, reply->data.data_val,
+                                        reply->data.data_len) == 0)
+                virNetClientProgramRaiseError(&err);
+            bcall->error = virSaveLastError();
+            xdr_free((xdrproc_t) xdr_virNetMessageError, (char *) &err);
+        }
+        bcall->done = true;
+    }
+
+    virResetLastError();
+    rv = 0;
+
+ cleanup:
+    xdr_free((xdrproc_t) xdr_remote_connect_batch_submit_ret, (char *) &ret);
+
+ done:
+    xdr_free((xdrproc_t) xdr_remote_connect_batch_submit_args, (char *) &args);
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
 #include "remote_client_bodies.h"
 #include "lxc_client_bodies.h"
 #include "qemu_client_bodies.h"
@@ -6725,6 +6981,41 @@ call(virConnectPtr conn,
                     ret_filter, ret);
 }
 
+/*
+ * Send a call of the remote program without waiting for the reply,
+ * which is decoded into @ret before @cb is invoked from the event loop.
+ */
+static int
+callAsync(virConnectPtr conn ATTRIBUTE_UNUSED,
+          struct private_data *priv,
+          int proc_nr,
+          xdrproc_t args_filter, char *args,
+          xdrproc_t ret_filter, char *ret,
+          virNetClientProgramReplyFunc cb,
+          void *opaque)
+{
+    int rv;
+    virNetClientProgramPtr prog = priv->remoteProgram;
+    int counter = priv->counter++;
+    virNetClientPtr client = priv->client;
+    priv->localUses++;
+
+    /* Unlock for the same reason as callFull, the call might still
+     * need to process incoming messages while sending ours */
+    remoteDriverUnlock(priv);
+    rv = virNetClientProgramCallAsync(prog,
+                                      client,
+                                      counter,
+                                      proc_nr,
+                                      args_filter, args,
+                                      ret_filter, ret,
+                                      cb, opaque);
+    remoteDriverLock(priv);
+    priv->localUses--;
+
+    return rv;
+}
+
 
 static int
 remoteDomainGetInterfaceParameters(virDomainPtr domain,
@@ -7662,6 +7953,63 @@ remoteNetworkGetDHCPLeases(virNetworkPtr net,
 }
 
 
+/* Convert the records of a get_all_domain_stats reply */
+static int
+remoteDomainStatsRecordsDeserialize(virConnectPtr conn,
+                                    remote_connect_get_all_domain_stats_ret *ret,
+                                    virDomainStatsRecordPtr **retStats)
+{
+    int rv = -1;
+    size_t i;
+    virDomainStatsRecordPtr elem = NULL;
+    virDomainStatsRecordPtr *tmpret = NULL;
+
+    if (ret->retStats.retStats_len > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of stats entries is %d, which exceeds max limit: %d"),
+                       ret->retStats.retStats_len, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    *retStats = NULL;
+
+    if (VIR_ALLOC_N(tmpret, ret->retStats.retStats_len + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ret->retStats.retStats_len; i++) {
+        remote_domain_stats_record *rec = ret->retStats.retStats_val + i;
+
+        if (VIR_ALLOC(elem) < 0)
+            goto cleanup;
+
+        if (!(elem->dom = get_nonnull_domain(conn, rec->dom)))
+            goto cleanup;
+
+        if (virTypedParamsDeserialize((virTypedParameterRemotePtr) rec->params.params_val,
+                                      rec->params.params_len,
+                                      REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX,
+                                      &elem->params,
+                                      &elem->nparams))
+            goto cleanup;
+
+        tmpret[i] = elem;
+        elem = NULL;
+    }
+
+    *retStats = tmpret;
+    tmpret = NULL;
+    rv = ret->retStats.retStats_len;
+
+ cleanup:
+    if (elem) {
+        virObjectUnref(elem->dom);
+        VIR_FREE(elem);
+    }
+    virDomainStatsRecordListFree(tmpret);
+    return rv;
+}
+
+
 static int
 remoteConnectGetAllDomainStats(virConnectPtr conn,
                                virDomainPtr *doms,
@@ -7675,8 +8023,6 @@ remoteConnectGetAllDomainStats(virConnectPtr conn,
     size_t i;
     remote_connect_get_all_domain_stats_args args;
     remote_connect_get_all_domain_stats_ret ret;
-    virDomainStatsRecordPtr elem = NULL;
-    virDomainStatsRecordPtr *tmpret = NULL;
 
     memset(&args, 0, sizeof(args));
 
@@ -7703,52 +8049,407 @@ remoteConnectGetAllDomainStats(virConnectPtr conn,
     }
     remoteDriverUnlock(priv);
 
-    if (ret.retStats.retStats_len > REMOTE_DOMAIN_LIST_MAX) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Number of stats entries is %d, which exceeds max limit: %d"),
-                       ret.retStats.retStats_len, REMOTE_DOMAIN_LIST_MAX);
-        goto cleanup;
-    }
+    rv = remoteDomainStatsRecordsDeserialize(conn, &ret, retStats);
 
-    *retStats = NULL;
+ cleanup:
+    VIR_FREE(args.doms.doms_val);
+    xdr_free((xdrproc_t)xdr_remote_connect_get_all_domain_stats_ret,
+             (char *) &ret);
 
-    if (VIR_ALLOC_N(tmpret, ret.retStats.retStats_len + 1) < 0)
-        goto cleanup;
+    return rv;
+}
 
-    for (i = 0; i < ret.retStats.retStats_len; i++) {
-        remote_domain_stats_record *rec = ret.retStats.retStats_val + i;
 
-        if (VIR_ALLOC(elem) < 0)
-            goto cleanup;
+static int
+remoteConnectListDomainChanges(virConnectPtr conn,
+                               unsigned long long *generation,
+                               unsigned int maxitems,
+                               virDomainPtr **domains,
+                               char ***removed,
+                               unsigned int flags)
+{
+    struct private_data *priv = conn->privateData;
+    int rv = -1;
+    size_t i;
+    remote_connect_list_domain_changes_args args;
+    remote_connect_list_domain_changes_ret ret;
+    unsigned long long gen = *generation;
+    unsigned int remaining = maxitems;
+    virDomainPtr *doms = NULL;
+    size_t ndoms = 0;
+    size_t ndomsAlloc = 0;
+    char **uuids = NULL;
+    size_t nuuids = 0;
+    size_t nuuidsAlloc = 0;
+    unsigned int nitems;
 
-        if (!(elem->dom = get_nonnull_domain(conn, rec->dom)))
+    memset(&ret, 0, sizeof(ret));
+
+    /* The server returns at most REMOTE_DOMAIN_LIST_MAX items per call,
+     * so keep paging until a short page shows nothing is left */
+    remoteDriverLock(priv);
+    for (;;) {
+        args.generation = gen;
+        args.maxitems = REMOTE_DOMAIN_LIST_MAX;
+        if (remaining && remaining < REMOTE_DOMAIN_LIST_MAX)
+            args.maxitems = remaining;
+        args.flags = flags;
+
+        if (call(conn, priv, 0, REMOTE_PROC_CONNECT_LIST_DOMAIN_CHANGES,
+                 (xdrproc_t)xdr_remote_connect_list_domain_changes_args, (char *)&args,
+                 (xdrproc_t)xdr_remote_connect_list_domain_changes_ret, (char *)&ret) == -1)
+            goto done;
+
+        nitems = ret.domains.domains_len + ret.removed.removed_len;
+        if (ret.domains.domains_len > REMOTE_DOMAIN_LIST_MAX ||
+            ret.removed.removed_len > REMOTE_DOMAIN_LIST_MAX ||
+            nitems > args.maxitems) {
+            virReportError(VIR_ERR_RPC,
+                           _("too many remote domain changes: %u > %u"),
+                           nitems, args.maxitems);
             goto cleanup;
+        }
 
-        if (virTypedParamsDeserialize((virTypedParameterRemotePtr) rec->params.params_val,
-                                      rec->params.params_len,
-                                      REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX,
-                                      &elem->params,
-                                      &elem->nparams))
+        if (VIR_RESIZE_N(doms, ndomsAlloc, ndoms,
+                         ret.domains.domains_len + 1) < 0 ||
+            VIR_RESIZE_N(uuids, nuuidsAlloc, nuuids,
+                         ret.removed.removed_len + 1) < 0)
             goto cleanup;
 
-        tmpret[i] = elem;
-        elem = NULL;
+        for (i = 0; i < ret.domains.domains_len; i++) {
+            if (!(doms[ndoms] = get_nonnull_domain(conn,
+                                                   ret.domains.domains_val[i])))
+                goto cleanup;
+            ndoms++;
+        }
+
+        for (i = 0; i < ret.removed.removed_len; i++) {
+            if (VIR_STRDUP(uuids[nuuids], ret.removed.removed_val[i]) < 0)
+                goto cleanup;
+            nuuids++;
+        }
+
+        gen = ret.generation;
+        xdr_free((xdrproc_t)xdr_remote_connect_list_domain_changes_ret,
+                 (char *) &ret);
+        memset(&ret, 0, sizeof(ret));
+
+        if (nitems < args.maxitems)
+            break;
+        if (remaining && (remaining -= nitems) == 0)
+            break;
     }
 
-    *retStats = tmpret;
-    tmpret = NULL;
-    rv = ret.retStats.retStats_len;
+    if (!doms && VIR_ALLOC_N(doms, 1) < 0)
+        goto cleanup;
+    if (!uuids && VIR_ALLOC_N(uuids, 1) < 0)
+        goto cleanup;
+
+    *generation = gen;
+    *domains = doms;
+    *removed = uuids;
+    doms = NULL;
+    uuids = NULL;
+    rv = ndoms;
 
  cleanup:
-    if (elem) {
-        virObjectUnref(elem->dom);
-        VIR_FREE(elem);
-    }
-    virDomainStatsRecordListFree(tmpret);
-    VIR_FREE(args.doms.doms_val);
-    xdr_free((xdrproc_t)xdr_remote_connect_get_all_domain_stats_ret,
+    xdr_free((xdrproc_t)xdr_remote_connect_list_domain_changes_ret,
              (char *) &ret);
+ done:
+    remoteDriverUnlock(priv);
+    virObjectListFreeCount(doms, ndoms);
+    virStringListFreeCount(uuids, nuuids);
+    return rv;
+}
+
+
+/*
+ * The asynchronous calls below keep their state on the heap until the
+ * reply arrives. Their completion callbacks run from the event loop
+ * without the driver lock held, so the application is free to issue
+ * further calls from its own callbacks.
+ */
+typedef struct _remoteAsyncCall remoteAsyncCall;
+typedef remoteAsyncCall *remoteAsyncCallPtr;
+
+struct _remoteAsyncCall {
+    virConnectPtr conn;
+    virDomainPtr dom;
+    union {
+        remote_domain_get_info_ret info;
+        remote_domain_memory_stats_ret memoryStats;
+        remote_connect_get_all_domain_stats_ret allStats;
+    } ret;
+    union {
+        virDomainGetInfoCallback info;
+        virDomainMemoryStatsCallback memoryStats;
+        virDomainListGetStatsCallback allStats;
+    } cb;
+    void *opaque;
+    virFreeCallback freecb;
+};
+
+
+static remoteAsyncCallPtr
+remoteAsyncCallNew(virConnectPtr conn,
+                   virDomainPtr dom,
+                   void *opaque,
+                   virFreeCallback freecb)
+{
+    remoteAsyncCallPtr data;
+
+    if (VIR_ALLOC(data) < 0)
+        return NULL;
+
+    data->conn = virObjectRef(conn);
+    if (dom)
+        data->dom = virObjectRef(dom);
+    data->opaque = opaque;
+    data->freecb = freecb;
+
+    return data;
+}
+
+
+static void
+remoteAsyncCallFree(remoteAsyncCallPtr data,
+                    xdrproc_t ret_filter)
+{
+    if (!data)
+        return;
+
+    xdr_free(ret_filter, (char *) &data->ret);
+    if (data->freecb)
+        data->freecb(data->opaque);
+    virObjectUnref(data->dom);
+    virObjectUnref(data->conn);
+    VIR_FREE(data);
+}
+
+
+static void
+remoteDomainGetInfoAsyncDone(virNetClientProgramPtr prog ATTRIBUTE_UNUSED,
+                             int rv,
+                             void *opaque)
+{
+    remoteAsyncCallPtr data = opaque;
+    virDomainInfo info;
+
+    if (rv == 0) {
+        info.state = data->ret.info.state;
+        info.maxMem = data->ret.info.maxMem;
+        info.memory = data->ret.info.memory;
+        info.nrVirtCpu = data->ret.info.nrVirtCpu;
+        info.cpuTime = data->ret.info.cpuTime;
+    }
+
+    data->cb.info(data->dom, rv, rv < 0 ? NULL : &info, data->opaque);
+
+    remoteAsyncCallFree(data, (xdrproc_t) xdr_remote_domain_get_info_ret);
+}
+
+
+static int
+remoteDomainGetInfoAsync(virDomainPtr domain,
+                         virDomainGetInfoCallback cb,
+                         void *opaque,
+                         virFreeCallback freecb,
+                         unsigned int flags)
+{
+    int rv = -1;
+    remote_domain_get_info_args args;
+    remoteAsyncCallPtr data;
+    struct private_data *priv = domain->conn->privateData;
+
+    virCheckFlags(0, -1);
+
+    if (!(data = remoteAsyncCallNew(domain->conn, domain, opaque, freecb)))
+        return -1;
+    data->cb.info = cb;
+
+    remoteDriverLock(priv);
+
+    make_nonnull_domain(&args.dom, domain);
+
+    if (callAsync(domain->conn, priv, REMOTE_PROC_DOMAIN_GET_INFO,
+                  (xdrproc_t) xdr_remote_domain_get_info_args, (char *) &args,
+                  (xdrproc_t) xdr_remote_domain_get_info_ret,
+                  (char *) &data->ret.info,
+                  remoteDomainGetInfoAsyncDone, data) < 0)
+        goto done;
+
+    data = NULL;
+    rv = 0;
+
+ done:
+    remoteDriverUnlock(priv);
+    if (data) {
+        data->freecb = NULL;
+        remoteAsyncCallFree(data, (xdrproc_t) xdr_remote_domain_get_info_ret);
+    }
+    return rv;
+}
+
+
+static void
+remoteDomainMemoryStatsAsyncDone(virNetClientProgramPtr prog ATTRIBUTE_UNUSED,
+                                 int rv,
+                                 void *opaque)
+{
+    remoteAsyncCallPtr data = opaque;
+    virDomainMemoryStatStruct stats[VIR_DOMAIN_MEMORY_STAT_NR];
+    size_t i;
+
+    if (rv == 0) {
+        if (data->ret.memoryStats.stats.stats_len > VIR_DOMAIN_MEMORY_STAT_NR) {
+            virReportError(VIR_ERR_RPC,
+                           _("too many memory stats returned: %d > %d"),
+                           data->ret.memoryStats.stats.stats_len,
+                           VIR_DOMAIN_MEMORY_STAT_NR);
+            rv = -1;
+        } else {
+            for (i = 0; i < data->ret.memoryStats.stats.stats_len; i++) {
+                stats[i].tag = data->ret.memoryStats.stats.stats_val[i].tag;
+                stats[i].val = data->ret.memoryStats.stats.stats_val[i].val;
+            }
+            rv = data->ret.memoryStats.stats.stats_len;
+        }
+    }
+
+    data->cb.memoryStats(data->dom, rv, rv < 0 ? NULL : stats, data->opaque);
+
+    remoteAsyncCallFree(data, (xdrproc_t) xdr_remote_domain_memory_stats_ret);
+}
+
+
+static int
+remoteDomainMemoryStatsAsync(virDomainPtr domain,
+                             unsigned int nr_stats,
+                             virDomainMemoryStatsCallback cb,
+                             void *opaque,
+                             virFreeCallback freecb,
+                             unsigned int flags)
+{
+    int rv = -1;
+    remote_domain_memory_stats_args args;
+    remoteAsyncCallPtr data;
+    struct private_data *priv = domain->conn->privateData;
+
+    virCheckFlags(0, -1);
+
+    if (nr_stats > REMOTE_DOMAIN_MEMORY_STATS_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("too many memory stats requested: %d > %d"), nr_stats,
+                       REMOTE_DOMAIN_MEMORY_STATS_MAX);
+        return -1;
+    }
+
+    if (!(data = remoteAsyncCallNew(domain->conn, domain, opaque, freecb)))
+        return -1;
+    data->cb.memoryStats = cb;
+
+    remoteDriverLock(priv);
+
+    make_nonnull_domain(&args.dom, domain);
+    args.maxStats = nr_stats;
+    args.flags = flags;
+
+    if (callAsync(domain->conn, priv, REMOTE_PROC_DOMAIN_MEMORY_STATS,
+                  (xdrproc_t) xdr_remote_domain_memory_stats_args, (char *) &args,
+                  (xdrproc_t) xdr_remote_domain_memory_stats_ret,
+                  (char *) &data->ret.memoryStats,
+                  remoteDomainMemoryStatsAsyncDone, data) < 0)
+        goto done;
+
+    data = NULL;
+    rv = 0;
 
+ done:
+    remoteDriverUnlock(priv);
+    if (data) {
+        data->freecb = NULL;
+        remoteAsyncCallFree(data, (xdrproc_t) xdr_remote_domain_memory_stats_ret);
+    }
+    return rv;
+}
+
+
+static void
+remoteConnectGetAllDomainStatsAsyncDone(virNetClientProgramPtr prog ATTRIBUTE_UNUSED,
+                                        int rv,
+                                        void *opaque)
+{
+    remoteAsyncCallPtr data = opaque;
+    virDomainStatsRecordPtr *records = NULL;
+
+    if (rv == 0)
+        rv = remoteDomainStatsRecordsDeserialize(data->conn,
+                                                 &data->ret.allStats,
+                                                 &records);
+
+    data->cb.allStats(data->conn, rv, records, data->opaque);
+
+    remoteAsyncCallFree(data,
+                        (xdrproc_t) xdr_remote_connect_get_all_domain_stats_ret);
+}
+
+
+static int
+remoteConnectGetAllDomainStatsAsync(virConnectPtr conn,
+                                    virDomainPtr *doms,
+                                    unsigned int ndoms,
+                                    unsigned int stats,
+                                    virDomainListGetStatsCallback cb,
+                                    void *opaque,
+                                    virFreeCallback freecb,
+                                    unsigned int flags)
+{
+    struct private_data *priv = conn->privateData;
+    int rv = -1;
+    size_t i;
+    remote_connect_get_all_domain_stats_args args;
+    remoteAsyncCallPtr data;
+
+    memset(&args, 0, sizeof(args));
+
+    if (!(data = remoteAsyncCallNew(conn, NULL, opaque, freecb)))
+        return -1;
+    data->cb.allStats = cb;
+
+    if (ndoms) {
+        if (VIR_ALLOC_N(args.doms.doms_val, ndoms) < 0)
+            goto cleanup;
+
+        for (i = 0; i < ndoms; i++)
+            make_nonnull_domain(args.doms.doms_val + i, doms[i]);
+    }
+    args.doms.doms_len = ndoms;
+
+    args.stats = stats;
+    args.flags = flags;
+
+    remoteDriverLock(priv);
+    if (callAsync(conn, priv, REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS,
+                  (xdrproc_t) xdr_remote_connect_get_all_domain_stats_args,
+                  (char *) &args,
+                  (xdrproc_t) xdr_remote_connect_get_all_domain_stats_ret,
+                  (char *) &data->ret.allStats,
+                  remoteConnectGetAllDomainStatsAsyncDone, data) < 0) {
+        remoteDriverUnlock(priv);
+        goto cleanup;
+    }
+    remoteDriverUnlock(priv);
+
+    data = NULL;
+    rv = 0;
+
+ cleanup:
+    VIR_FREE(args.doms.doms_val);
+    if (data) {
+        data->freecb = NULL;
+        remoteAsyncCallFree(data,
+                            (xdrproc_t) xdr_remote_connect_get_all_domain_stats_ret);
+    }
     return rv;
 }
 
@@ -8497,7 +9198,12 @@ static virHypervisorDriver hypervisor_driver = {
     .domainSetGuestVcpus = remoteDomainSetGuestVcpus, /* 2.0.0 */
     .domainSetVcpu = remoteDomainSetVcpu, /* 3.1.0 */
     .domainSetBlockThreshold = remoteDomainSetBlockThreshold, /* 3.2.0 */
-    .domainSetLifecycleAction = remoteDomainSetLifecycleAction /* 3.9.0 */
+    .domainSetLifecycleAction = remoteDomainSetLifecycleAction, /* 3.9.0 */
+    .connectBatchSubmit = remoteConnectBatchSubmit, /* 4.1.0 */
+    .domainGetInfoAsync = remoteDomainGetInfoAsync, /* 4.1.0 */
+    .domainMemoryStatsAsync = remoteDomainMemoryStatsAsync, /* 4.1.0 */
+    .connectGetAllDomainStatsAsync = remoteConnectGetAllDomainStatsAsync, /* 4.1.0 */
+    .connectListDomainChanges = remoteConnectListDomainChanges /* 4.1.0 */
 };
 
 static virNetworkDriver network_driver = {
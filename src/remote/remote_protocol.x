@@ -253,6 +253,12 @@ const REMOTE_DOMAIN_IP_ADDR_MAX = 2048;
 /* Upper limit on number of guest vcpu information entries */
 const REMOTE_DOMAIN_GUEST_VCPU_PARAMS_MAX = 64;
 
+/* Upper limit on number of calls in a batch */
+const REMOTE_CONNECT_BATCH_CALLS_MAX = 256;
+
+/* Upper limit on encoded arguments or result of a call in a batch */
+const REMOTE_CONNECT_BATCH_DATA_MAX = 65536;
+
 /* UUID.  VIR_UUID_BUFLEN definition comes from libvirt.h */
 typedef opaque remote_uuid[VIR_UUID_BUFLEN];
 
@@ -3448,6 +3454,45 @@ struct remote_domain_set_lifecycle_action_args {
     unsigned int flags;
 };
 
+/* A call in a batch, with its XDR encoded arguments */
+struct remote_connect_batch_call {
+    int proc;
+    opaque args<REMOTE_CONNECT_BATCH_DATA_MAX>;
+};
+
+/* On VIR_NET_OK status, @data holds the XDR encoded return value of
+ * the call, on VIR_NET_ERROR an encoded virNetMessageError */
+struct remote_connect_batch_reply {
+    int status;
+    opaque data<REMOTE_CONNECT_BATCH_DATA_MAX>;
+};
+
+struct remote_connect_batch_submit_args {
+    remote_connect_batch_call calls<REMOTE_CONNECT_BATCH_CALLS_MAX>;
+    unsigned int flags;
+};
+
+struct remote_connect_batch_submit_ret {
+    remote_connect_batch_reply replies<REMOTE_CONNECT_BATCH_CALLS_MAX>;
+};
+
+struct remote_connect_open_shm_channel_args {
+    unsigned int flags;
+};
+
+struct remote_connect_list_domain_changes_args {
+    unsigned hyper generation;
+    unsigned int maxitems;
+    unsigned int flags;
+};
+
+struct remote_connect_list_domain_changes_ret {
+    remote_nonnull_domain domains<REMOTE_DOMAIN_LIST_MAX>;
+    remote_nonnull_string removed<REMOTE_DOMAIN_LIST_MAX>;
+    unsigned hyper generation;
+    unsigned int ret;
+};
+
 /*----- Protocol. -----*/
 
 /* Define the program number, protocol version and procedure numbers here. */
@@ -3498,6 +3543,22 @@ enum remote_procedure {
      *   of objects being returned by an API. This allows the returned
      *   list to be filtered to only show those the user has permissions
      *   against
+     *
+     * - @batch: yes|no
+     *
+     *   Whether the procedure can be a call in REMOTE_PROC_CONNECT_BATCH_SUBMIT.
+     *   Calls in a batch run concurrently and in no particular order, so
+     *   only procedures which don't change anything, as declared by a read
+     *   only @acl, may be batched. They are dispatched without a message of
+     *   their own, so the daemon implementation must not use it for
+     *   anything, e.g. streams or passing FDs. Defaults to no.
+     *
+     * - @cache: yes|no
+     *
+     *   Whether the daemon may answer the procedure from its reply cache.
+     *   Only suitable for procedures whose reply is fully determined by
+     *   their arguments and by state which rarely changes, such as the
+     *   capabilities. Defaults to no.
      */
 
     /**
@@ -3545,6 +3606,7 @@ enum remote_procedure {
     /**
      * @generate: both
      * @acl: connect:read
+     * @cache: yes
      */
     REMOTE_PROC_CONNECT_GET_CAPABILITIES = 7,
 
@@ -3606,6 +3668,7 @@ enum remote_procedure {
     /**
      * @generate: both
      * @acl: domain:read
+     * @batch: yes
      */
     REMOTE_PROC_DOMAIN_GET_INFO = 16,
 
@@ -4837,6 +4900,7 @@ enum remote_procedure {
     /**
      * @generate: both
      * @acl: domain:read
+     * @batch: yes
      */
     REMOTE_PROC_DOMAIN_GET_BLOCK_INFO = 194,
 
@@ -4932,7 +4996,7 @@ enum remote_procedure {
     REMOTE_PROC_DOMAIN_MIGRATE_SET_MAX_SPEED = 207,
 
     /**
-     * @generate: both
+     * @generate: client
      * @writestream: 1
      * @sparseflag: VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM
      * @acl: storage_vol:data_write
@@ -4940,7 +5004,7 @@ enum remote_procedure {
     REMOTE_PROC_STORAGE_VOL_UPLOAD = 208,
 
     /**
-     * @generate: both
+     * @generate: client
      * @readstream: 1
      * @sparseflag: VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM
      * @acl: storage_vol:data_read
@@ -4964,6 +5028,7 @@ enum remote_procedure {
      * @generate: none
      * @priority: high
      * @acl: domain:read
+     * @batch: yes
      */
     REMOTE_PROC_DOMAIN_GET_STATE = 212,
 
@@ -5815,6 +5880,7 @@ enum remote_procedure {
     /**
      * @generate: both
      * @acl: connect:write
+     * @cache: yes
      */
     REMOTE_PROC_CONNECT_GET_DOMAIN_CAPABILITIES = 342,
 
@@ -6135,5 +6201,25 @@ enum remote_procedure {
      * @priority: high
      * @acl: storage_pool:getattr
      */
-    REMOTE_PROC_STORAGE_POOL_LOOKUP_BY_TARGET_PATH = 391
+    REMOTE_PROC_STORAGE_POOL_LOOKUP_BY_TARGET_PATH = 391,
+
+    /**
+     * @generate: none
+     * @acl: none
+     */
+    REMOTE_PROC_CONNECT_BATCH_SUBMIT = 392,
+
+    /**
+     * @generate: none
+     * @acl: none
+     */
+    REMOTE_PROC_CONNECT_OPEN_SHM_CHANNEL = 393,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: connect:search_domains
+     * @aclfilter: domain:getattr
+     */
+    REMOTE_PROC_CONNECT_LIST_DOMAIN_CHANGES = 394
 };
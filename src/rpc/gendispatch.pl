@@ -306,6 +306,32 @@ while (<PROTOCOL>) {
             $calls{$name}->{priority} = 0;
         }
 
+        if (exists $opts{batch}) {
+            if ($opts{batch} !~ /^(yes|no)$/) {
+                die "\@batch annotation value '$opts{batch}' invalid for $constname"
+            }
+            if ($opts{batch} eq "yes") {
+                die "\@batch requires no stream for $constname"
+                    if $calls{$name}->{streamflag} ne "none";
+                # Calls in a batch run concurrently and in no particular
+                # order, which is only acceptable for calls not changing
+                # anything
+                die "\@batch requires a read only \@acl for $constname"
+                    if !defined $opts{acl} ||
+                       grep { !/^\w+:(read|getattr)(:|$)/ } @{$opts{acl}};
+            }
+            $calls{$name}->{batch} = $opts{batch};
+        }
+
+        if (exists $opts{cache}) {
+            if ($opts{cache} !~ /^(yes|no)$/) {
+                die "\@cache annotation value '$opts{cache}' invalid for $constname"
+            }
+            die "\@cache requires no stream for $constname"
+                if $opts{cache} eq "yes" && $calls{$name}->{streamflag} ne "none";
+            $calls{$name}->{cache} = $opts{cache};
+        }
+
         $calls[$id] = $calls{$name};
 
         $collect_args_members = 0;
@@ -1199,14 +1225,21 @@ elsif ($mode eq "server") {
     # args and return values, and the size of the args and
     # return value structs. All methods are marked as requiring
     # authentication. Methods are selectively relaxed in the
-    # daemon code which registers the program.
+    # daemon code which registers the program. Only methods
+    # annotated to allow it can run as part of a batch.
+    # Replies are only cached for methods annotated to allow it.
+    # The name of each method is kept for the call statistics.
 
     print "virNetServerProgramProc ${structprefix}Procs[] = {\n";
     for ($id = 0 ; $id <= $#calls ; $id++) {
         my ($comment, $name, $argtype, $arglen, $argfilter, $retlen, $retfilter, $priority);
+        my $batch = "false";
+        my $cache = "false";
+        my $procname = "NULL";
 
         if (defined $calls[$id] && !$calls[$id]->{msg}) {
             $comment = "/* Method $calls[$id]->{ProcName} => $id */";
+            $procname = "\"$calls[$id]->{ProcName}\"";
             $name = $structprefix . "Dispatch" . $calls[$id]->{ProcName} . "Helper";
             my $argtype = $calls[$id]->{args};
             my $rettype = $calls[$id]->{ret};
@@ -1214,6 +1247,10 @@ elsif ($mode eq "server") {
             $retlen = $rettype ne "void" ? "sizeof($rettype)" : "0";
             $argfilter = $argtype ne "void" ? "xdr_$argtype" : "xdr_void";
             $retfilter = $rettype ne "void" ? "xdr_$rettype" : "xdr_void";
+            $batch = "true" if (exists $calls[$id]->{batch} &&
+                                $calls[$id]->{batch} eq "yes");
+            $cache = "true" if (exists $calls[$id]->{cache} &&
+                                $calls[$id]->{cache} eq "yes");
         } else {
             if ($calls[$id]->{msg}) {
                 $comment = "/* Async event $calls[$id]->{ProcName} => $id */";
@@ -1228,7 +1265,7 @@ elsif ($mode eq "server") {
 
     $priority = defined $calls[$id]->{priority} ? $calls[$id]->{priority} : 0;
 
-        print "{ $comment\n   ${name},\n   $arglen,\n   (xdrproc_t)$argfilter,\n   $retlen,\n   (xdrproc_t)$retfilter,\n   true,\n   $priority\n},\n";
+        print "{ $comment\n   ${name},\n   $arglen,\n   (xdrproc_t)$argfilter,\n   $retlen,\n   (xdrproc_t)$retfilter,\n   true,\n   $priority,\n   $batch,\n   $cache,\n   $procname\n},\n";
     }
     print "};\n";
     print "size_t ${structprefix}NProcs = ARRAY_CARDINALITY(${structprefix}Procs);\n";
@@ -38,6 +38,7 @@
 #include "virerror.h"
 #include "virprobe.h"
 #include "virstring.h"
+#include "vireventpoll.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -60,6 +61,11 @@ struct _virNetClientCall {
     bool nonBlock;
     bool haveThread;
 
+    /* Set for asynchronous calls, which have no thread
+     * waiting for the reply but get it handed to replyCb */
+    virNetClientReplyFunc replyCb;
+    void *replyOpaque;
+
     virCond cond;
 
     virNetClientCallPtr next;
@@ -101,6 +107,11 @@ struct _virNetClient {
     /* True if a thread holds the buck */
     bool haveTheBuck;
 
+    /* Asynchronous calls which are done (or failed), waiting for
+     * asyncTimer to fire in the event loop and run their callbacks */
+    virNetClientCallPtr asyncDone;
+    int asyncTimer;
+
     size_t nstreams;
     virNetClientStreamPtr *streams;
 
@@ -137,6 +148,8 @@ static int virNetClientQueueNonBlocking(virNetClientPtr client,
                                         virNetMessagePtr msg);
 static void virNetClientCloseInternal(virNetClientPtr client,
                                       int reason);
+static void virNetClientAsyncCollect(virNetClientPtr client,
+                                     bool all);
 
 
 void virNetClientSetCloseCallback(virNetClientPtr client,
@@ -319,6 +332,7 @@ static virNetClientPtr virNetClientNew(virNetSocketPtr sock,
     client->wakeupReadFD = wakeupFD[0];
     client->wakeupSendFD = wakeupFD[1];
     wakeupFD[0] = wakeupFD[1] = -1;
+    client->asyncTimer = -1;
 
     if (VIR_STRDUP(client->hostname, hostname) < 0)
         goto error;
@@ -653,6 +667,17 @@ virNetClientPtr virNetClientNewExternal(const char **cmdargv)
 }
 
 
+virNetClientPtr virNetClientNewSockFD(int sockfd)
+{
+    virNetSocketPtr sock;
+
+    if (virNetSocketNewConnectSockFD(sockfd, &sock) < 0)
+        return NULL;
+
+    return virNetClientNew(sock, NULL);
+}
+
+
 int virNetClientRegisterAsyncIO(virNetClientPtr client)
 {
     if (client->asyncIO)
@@ -798,6 +823,11 @@ virNetClientCloseLocked(virNetClientPtr client)
     if (!client->sock)
         return;
 
+    /* No more replies will arrive for pending asynchronous calls */
+    virNetClientAsyncCollect(client, true);
+    if (client->asyncTimer >= 0)
+        virEventUpdateTimeout(client->asyncTimer, 0);
+
     virObjectUnref(client->sock);
     client->sock = NULL;
 #if WITH_GNUTLS
@@ -992,6 +1022,47 @@ int virNetClientSetTLSSession(virNetClientPtr client,
 }
 #endif
 
+/**
+ * virNetClientSetShmChannel:
+ * @client: the client
+ * @fd: the shared memory channel passed by the server
+ *
+ * Switch @client over to the shared memory channel the server
+ * just handed out, the call asking for it being the last one to
+ * go through the socket. The channel takes ownership of @fd.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int virNetClientSetShmChannel(virNetClientPtr client,
+                              int fd)
+{
+    virNetShmChannelPtr chan = NULL;
+    int ret = -1;
+
+    virObjectLock(client);
+
+    if (client->haveTheBuck || client->waitDispatch) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("cannot switch to a shared memory channel "
+                         "while calls are in progress"));
+        VIR_FORCE_CLOSE(fd);
+        goto cleanup;
+    }
+
+    if (!(chan = virNetShmChannelOpen(fd)))
+        goto cleanup;
+
+    if (virNetSocketSetShmChannel(client->sock, chan) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(chan);
+    virObjectUnlock(client);
+    return ret;
+}
+
+
 bool virNetClientIsEncrypted(virNetClientPtr client)
 {
     bool ret = false;
@@ -1124,13 +1195,8 @@ virNetClientCallDispatchReply(virNetClientPtr client)
         return -1;
     }
 
-    if (VIR_REALLOC_N(thecall->msg->buffer, client->msg.bufferLength) < 0)
-        return -1;
-
-    memcpy(thecall->msg->buffer, client->msg.buffer, client->msg.bufferLength);
+    virNetMessageTakeBuffer(thecall->msg, &client->msg);
     memcpy(&thecall->msg->header, &client->msg.header, sizeof(client->msg.header));
-    thecall->msg->bufferLength = client->msg.bufferLength;
-    thecall->msg->bufferOffset = client->msg.bufferOffset;
 
     thecall->msg->nfds = client->msg.nfds;
     thecall->msg->fds = client->msg.fds;
@@ -1280,6 +1346,11 @@ virNetClientCallDispatch(virNetClientPtr client)
     case VIR_NET_REPLY_WITH_FDS: /* Normal RPC replies with FDs */
         return virNetClientCallDispatchReply(client);
 
+    case VIR_NET_REPLY_COMPRESSED: /* RPC replies, compressed by server */
+        if (virNetMessageDecompressPayload(&client->msg) < 0)
+            return -1;
+        return virNetClientCallDispatchReply(client);
+
     case VIR_NET_MESSAGE: /* Async notifications */
         return virNetClientCallDispatchMessage(client);
 
@@ -1302,18 +1373,18 @@ virNetClientIOWriteMessage(virNetClientPtr client,
                            virNetClientCallPtr thecall)
 {
     ssize_t ret = 0;
+    struct iovec iov[2];
+    size_t niov;
 
-    if (thecall->msg->bufferOffset < thecall->msg->bufferLength) {
-        ret = virNetSocketWrite(client->sock,
-                                thecall->msg->buffer + thecall->msg->bufferOffset,
-                                thecall->msg->bufferLength - thecall->msg->bufferOffset);
+    if ((niov = virNetMessageGetTXIOV(thecall->msg, iov))) {
+        ret = virNetSocketWritev(client->sock, iov, niov);
         if (ret <= 0)
             return ret;
 
-        thecall->msg->bufferOffset += ret;
+        virNetMessageAdvanceTX(thecall->msg, ret);
     }
 
-    if (thecall->msg->bufferOffset == thecall->msg->bufferLength) {
+    if (virNetMessageIsTXComplete(thecall->msg)) {
         size_t i;
         for (i = thecall->msg->donefds; i < thecall->msg->nfds; i++) {
             int rv;
@@ -1371,8 +1442,7 @@ virNetClientIOReadMessage(virNetClientPtr client)
 
     /* Start by reading length word */
     if (client->msg.bufferLength == 0) {
-        client->msg.bufferLength = 4;
-        if (VIR_ALLOC_N(client->msg.buffer, client->msg.bufferLength) < 0)
+        if (virNetMessageAllocBuffer(&client->msg, 4) < 0)
             return -ENOMEM;
     }
 
@@ -1503,6 +1573,10 @@ static bool virNetClientIOEventLoopRemoveDone(virNetClientCallPtr call,
     if (call->mode != VIR_NET_CLIENT_MODE_COMPLETE)
         return false;
 
+    /* Asynchronous calls are collected by virNetClientAsyncCollect */
+    if (call->replyCb && !call->haveThread)
+        return false;
+
     /*
      * ...if the call being removed from the list
      * still has a thread, then wake that thread up,
@@ -1554,6 +1628,46 @@ virNetClientIOEventLoopRemoveAll(virNetClientCallPtr call,
 }
 
 
+/*
+ * Hand @call over to the event loop, which will run its
+ * callback without the client lock held
+ */
+static void
+virNetClientAsyncQueueDone(virNetClientPtr client,
+                           virNetClientCallPtr call)
+{
+    VIR_DEBUG("Asynchronous call %p done, mode=%d", call, call->mode);
+
+    virNetClientCallQueue(&client->asyncDone, call);
+    virEventUpdateTimeout(client->asyncTimer, 0);
+}
+
+
+/*
+ * Move asynchronous calls out of the dispatch list once they
+ * got their reply or, if @all is true, regardless of that
+ * because the connection is going away
+ */
+static void
+virNetClientAsyncCollect(virNetClientPtr client,
+                         bool all)
+{
+    virNetClientCallPtr *prev = &client->waitDispatch;
+
+    while (*prev) {
+        virNetClientCallPtr call = *prev;
+
+        if (call->replyCb && !call->haveThread &&
+            (all || call->mode == VIR_NET_CLIENT_MODE_COMPLETE)) {
+            *prev = call->next;
+            virNetClientAsyncQueueDone(client, call);
+        } else {
+            prev = &call->next;
+        }
+    }
+}
+
+
 static void
 virNetClientIOEventLoopPassTheBuck(virNetClientPtr client,
                                    virNetClientCallPtr thiscall)
@@ -1596,6 +1710,8 @@ static int virNetClientIOEventLoop(virNetClientPtr client,
     struct pollfd fds[2];
     bool error = false;
     int closeReason;
+    int events;
+    int revents;
     int ret;
 
     fds[0].fd = virNetSocketGetFD(client->sock);
@@ -1640,6 +1756,12 @@ static int virNetClientIOEventLoop(virNetClientPtr client,
         if (client->nstreams)
             fds[0].events |= POLLIN;
 
+        /* The socket may only carry doorbells for a shared
+         * memory channel, in which case it is polled differently */
+        events = virEventPollFromNativeEvents(fds[0].events);
+        fds[0].events = virEventPollToNativeEvents(
+            virNetSocketGetWireEvents(client->sock, events));
+
         /* Release lock while poll'ing so other threads
          * can stuff themselves on the queue */
         virObjectUnlock(client);
@@ -1674,6 +1796,11 @@ static int virNetClientIOEventLoop(virNetClientPtr client,
             goto error;
         }
 
+        /* Likewise, the events need translating back */
+        revents = virEventPollFromNativeEvents(fds[0].revents);
+        revents = virNetSocketGetReadyEvents(client->sock, events, revents);
+        fds[0].revents = virEventPollToNativeEvents(revents);
+
         if (virKeepAliveTrigger(client->keepalive, &msg)) {
             virNetClientMarkClose(client, VIR_CONNECT_CLOSE_REASON_KEEPALIVE);
         } else if (msg && virNetClientQueueNonBlocking(client, msg) < 0) {
@@ -1731,6 +1858,7 @@ static int virNetClientIOEventLoop(virNetClientPtr client,
         virNetClientCallRemovePredicate(&client->waitDispatch,
                                         virNetClientIOEventLoopRemoveDone,
                                         thiscall);
+        virNetClientAsyncCollect(client, false);
 
         /* Now see if *we* are done */
         if (thiscall->mode == VIR_NET_CLIENT_MODE_COMPLETE) {
@@ -2014,6 +2142,7 @@ void virNetClientIncomingEvent(virNetSocketPtr sock,
     virNetClientCallRemovePredicate(&client->waitDispatch,
                                     virNetClientIOEventLoopRemoveDone,
                                     NULL);
+    virNetClientAsyncCollect(client, false);
     virNetClientIOUpdateCallback(client, true);
 
  done:
@@ -2207,6 +2336,146 @@ int virNetClientSendNonBlock(virNetClientPtr client,
     return ret;
 }
 
+
+/*
+ * Runs in the event loop, delivering replies of asynchronous
+ * calls to their callbacks without holding the client lock, so
+ * that the callbacks are free to make further calls
+ */
+static void
+virNetClientAsyncTimer(int timer,
+                       void *opaque)
+{
+    virNetClientPtr client = opaque;
+    virNetClientCallPtr done;
+
+    virObjectRef(client);
+    virObjectLock(client);
+
+    done = client->asyncDone;
+    client->asyncDone = NULL;
+
+    if (client->sock) {
+        virEventUpdateTimeout(timer, -1);
+    } else {
+        /* Closed, nothing can be queued anymore */
+        virEventRemoveTimeout(timer);
+        client->asyncTimer = -1;
+    }
+
+    virObjectUnlock(client);
+
+    while (done) {
+        virNetClientCallPtr call = done;
+
+        done = call->next;
+        call->next = NULL;
+
+        if (call->mode == VIR_NET_CLIENT_MODE_COMPLETE) {
+            call->replyCb(client, call->msg, call->replyOpaque);
+        } else {
+            virNetMessageFree(call->msg);
+            call->replyCb(client, NULL, call->replyOpaque);
+        }
+
+        virCondDestroy(&call->cond);
+        VIR_FREE(call);
+    }
+
+    virObjectUnref(client);
+}
+
+
+/*
+ * @msg: a message allocated on the heap
+ * @cb: callback to receive the reply
+ * @opaque: data for @cb
+ *
+ * Send a message without waiting for its reply. Once the reply
+ * arrives, @cb is invoked from the event loop with @msg holding it.
+ * If the connection is closed first, @msg is freed and @cb gets
+ * NULL instead. Either way, @cb is called exactly once and
+ * without the client lock held.
+ *
+ * This requires virNetClientRegisterAsyncIO to have succeeded.
+ *
+ * Upon success @msg is owned by the client until it is passed
+ * to @cb, which is then responsible for free'ing it. Upon failure
+ * the caller keeps owning @msg and @cb is never called.
+ *
+ * Returns 0 on success, -1 on failure
+ */
+int virNetClientSendWithReplyAsync(virNetClientPtr client,
+                                   virNetMessagePtr msg,
+                                   virNetClientReplyFunc cb,
+                                   void *opaque)
+{
+    virNetClientCallPtr call = NULL;
+    int rv;
+
+    PROBE(RPC_CLIENT_MSG_TX_QUEUE,
+          "client=%p len=%zu prog=%u vers=%u proc=%u type=%u status=%u serial=%u",
+          client, msg->bufferLength,
+          msg->header.prog, msg->header.vers, msg->header.proc,
+          msg->header.type, msg->header.status, msg->header.serial);
+
+    virObjectLock(client);
+
+    if (!client->sock || client->wantClose) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("client socket is closed"));
+        goto error;
+    }
+
+    if (!client->asyncIO) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("asynchronous calls require an event loop"));
+        goto error;
+    }
+
+    if (client->asyncTimer < 0) {
+        virObjectRef(client);
+        if ((client->asyncTimer = virEventAddTimeout(-1,
+                                                     virNetClientAsyncTimer,
+                                                     client,
+                                                     virObjectFreeCallback)) < 0) {
+            virObjectUnref(client);
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Unable to register asynchronous call timer"));
+            goto error;
+        }
+    }
+
+    /* Not a plain non-blocking call, as it still expects a reply */
+    if (!(call = virNetClientCallNew(msg, true, false)))
+        goto error;
+
+    call->nonBlock = true;
+    call->haveThread = true;
+    call->replyCb = cb;
+    call->replyOpaque = opaque;
+
+    if ((rv = virNetClientIO(client, call)) < 0)
+        goto error;
+
+    /* The reply might have arrived right away */
+    if (rv == 0) {
+        call->haveThread = false;
+        virNetClientAsyncQueueDone(client, call);
+    }
+
+    virObjectUnlock(client);
+    return 0;
+
+ error:
+    if (call) {
+        virCondDestroy(&call->cond);
+        VIR_FREE(call);
+    }
+    virObjectUnlock(client);
+    return -1;
+}
+
 /*
  * @msg: a message allocated on heap or stack
  *
@@ -82,6 +82,8 @@ virNetClientPtr virNetClientNewLibssh(const char *host,
 
 virNetClientPtr virNetClientNewExternal(const char **cmdargv);
 
+virNetClientPtr virNetClientNewSockFD(int sockfd);
+
 int virNetClientRegisterAsyncIO(virNetClientPtr client);
 int virNetClientRegisterKeepAlive(virNetClientPtr client);
 
@@ -117,6 +119,15 @@ int virNetClientSendNoReply(virNetClientPtr client,
 int virNetClientSendNonBlock(virNetClientPtr client,
                              virNetMessagePtr msg);
 
+typedef void (*virNetClientReplyFunc)(virNetClientPtr client,
+                                      virNetMessagePtr msg,
+                                      void *opaque);
+
+int virNetClientSendWithReplyAsync(virNetClientPtr client,
+                                   virNetMessagePtr msg,
+                                   virNetClientReplyFunc cb,
+                                   void *opaque);
+
 int virNetClientSendWithReplyStream(virNetClientPtr client,
                                     virNetMessagePtr msg,
                                     virNetClientStreamPtr st);
@@ -131,6 +142,9 @@ int virNetClientSetTLSSession(virNetClientPtr client,
                               virNetTLSContextPtr tls);
 # endif
 
+int virNetClientSetShmChannel(virNetClientPtr client,
+                              int fd);
+
 bool virNetClientIsEncrypted(virNetClientPtr client);
 bool virNetClientIsOpen(virNetClientPtr client);
 
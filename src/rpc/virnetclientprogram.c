@@ -117,21 +117,16 @@ int virNetClientProgramMatches(virNetClientProgramPtr prog,
 }
 
 
-static int
-virNetClientProgramDispatchError(virNetClientProgramPtr prog ATTRIBUTE_UNUSED,
-                                 virNetMessagePtr msg)
+/*
+ * Report @err received from the server as the error of the
+ * current thread.
+ */
+void
+virNetClientProgramRaiseError(virNetMessageErrorPtr err)
 {
-    virNetMessageError err;
-    int ret = -1;
-
-    memset(&err, 0, sizeof(err));
-
-    if (virNetMessageDecodePayload(msg, (xdrproc_t)xdr_virNetMessageError, &err) < 0)
-        goto cleanup;
-
     /* Interop for virErrorNumber glitch in 0.8.0, if server is
      * 0.7.1 through 0.7.7; see comments in virterror.h. */
-    switch (err.code) {
+    switch (err->code) {
     case VIR_WAR_NO_NWFILTER:
         /* no way to tell old VIR_WAR_NO_SECRET apart from
          * VIR_WAR_NO_NWFILTER, but both are very similar
@@ -142,49 +137,65 @@ virNetClientProgramDispatchError(virNetClientProgramPtr prog ATTRIBUTE_UNUSED,
     case VIR_ERR_BUILD_FIREWALL:
         /* server was trying to pass VIR_ERR_INVALID_SECRET,
          * VIR_ERR_NO_SECRET, or VIR_ERR_CONFIG_UNSUPPORTED */
-        if (err.domain != VIR_FROM_NWFILTER)
-            err.code += 4;
+        if (err->domain != VIR_FROM_NWFILTER)
+            err->code += 4;
         break;
     case VIR_WAR_NO_SECRET:
-        if (err.domain == VIR_FROM_QEMU)
-            err.code = VIR_ERR_OPERATION_TIMEOUT;
+        if (err->domain == VIR_FROM_QEMU)
+            err->code = VIR_ERR_OPERATION_TIMEOUT;
         break;
     case VIR_ERR_INVALID_SECRET:
-        if (err.domain == VIR_FROM_XEN)
-            err.code = VIR_ERR_MIGRATE_PERSIST_FAILED;
+        if (err->domain == VIR_FROM_XEN)
+            err->code = VIR_ERR_MIGRATE_PERSIST_FAILED;
         break;
     default:
         /* Nothing to alter. */
         break;
     }
 
-    if ((err.domain == VIR_FROM_REMOTE || err.domain == VIR_FROM_RPC) &&
-        err.code == VIR_ERR_RPC &&
-        err.level == VIR_ERR_ERROR &&
-        err.message &&
-        STRPREFIX(*err.message, "unknown procedure")) {
+    if ((err->domain == VIR_FROM_REMOTE || err->domain == VIR_FROM_RPC) &&
+        err->code == VIR_ERR_RPC &&
+        err->level == VIR_ERR_ERROR &&
+        err->message &&
+        STRPREFIX(*err->message, "unknown procedure")) {
         virRaiseErrorFull(__FILE__, __FUNCTION__, __LINE__,
-                          err.domain,
+                          err->domain,
                           VIR_ERR_NO_SUPPORT,
-                          err.level,
-                          err.str1 ? *err.str1 : NULL,
-                          err.str2 ? *err.str2 : NULL,
-                          err.str3 ? *err.str3 : NULL,
-                          err.int1,
-                          err.int2,
-                          "%s", *err.message);
+                          err->level,
+                          err->str1 ? *err->str1 : NULL,
+                          err->str2 ? *err->str2 : NULL,
+                          err->str3 ? *err->str3 : NULL,
+                          err->int1,
+                          err->int2,
+                          "%s", *err->message);
     } else {
         virRaiseErrorFull(__FILE__, __FUNCTION__, __LINE__,
-                          err.domain,
-                          err.code,
-                          err.level,
-                          err.str1 ? *err.str1 : NULL,
-                          err.str2 ? *err.str2 : NULL,
-                          err.str3 ? *err.str3 : NULL,
-                          err.int1,
-                          err.int2,
-                          "%s", err.message ? *err.message : _("Unknown error"));
+                          err->domain,
+                          err->code,
+                          err->level,
+                          err->str1 ? *err->str1 : NULL,
+                          err->str2 ? *err->str2 : NULL,
+                          err->str3 ? *err->str3 : NULL,
+                          err->int1,
+                          err->int2,
+                          "%s", err->message ? *err->message : _("Unknown error"));
     }
+}
+
+
+static int
+virNetClientProgramDispatchError(virNetClientProgramPtr prog ATTRIBUTE_UNUSED,
+                                 virNetMessagePtr msg)
+{
+    virNetMessageError err;
+    int ret = -1;
+
+    memset(&err, 0, sizeof(err));
+
+    if (virNetMessageDecodePayload(msg, (xdrproc_t)xdr_virNetMessageError, &err) < 0)
+        goto cleanup;
+
+    virNetClientProgramRaiseError(&err);
 
     ret = 0;
 
@@ -268,6 +279,39 @@ int virNetClientProgramDispatch(virNetClientProgramPtr prog,
 }
 
 
+/*
+ * None of these 3 should ever happen, because the client
+ * should have validated the reply, but it doesn't hurt to
+ * check again.
+ */
+static int
+virNetClientProgramCheckReply(virNetMessagePtr msg,
+                              int proc,
+                              unsigned serial)
+{
+    if (msg->header.type != VIR_NET_REPLY &&
+        msg->header.type != VIR_NET_REPLY_WITH_FDS) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected message type %d"), msg->header.type);
+        return -1;
+    }
+    if (msg->header.proc != proc) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected message proc %d != %d"),
+                       msg->header.proc, proc);
+        return -1;
+    }
+    if (msg->header.serial != serial) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected message serial %d != %d"),
+                       msg->header.serial, serial);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 int virNetClientProgramCall(virNetClientProgramPtr prog,
                             virNetClientPtr client,
                             unsigned serial,
@@ -329,28 +373,8 @@ int virNetClientProgramCall(virNetClientProgramPtr prog,
     if (virNetClientSendWithReply(client, msg) < 0)
         goto error;
 
-    /* None of these 3 should ever happen here, because
-     * virNetClientSend should have validated the reply,
-     * but it doesn't hurt to check again.
-     */
-    if (msg->header.type != VIR_NET_REPLY &&
-        msg->header.type != VIR_NET_REPLY_WITH_FDS) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Unexpected message type %d"), msg->header.type);
-        goto error;
-    }
-    if (msg->header.proc != proc) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Unexpected message proc %d != %d"),
-                       msg->header.proc, proc);
+    if (virNetClientProgramCheckReply(msg, proc, serial) < 0)
         goto error;
-    }
-    if (msg->header.serial != serial) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Unexpected message serial %d != %d"),
-                       msg->header.serial, serial);
-        goto error;
-    }
 
     switch (msg->header.status) {
     case VIR_NET_OK:
@@ -402,3 +426,135 @@ int virNetClientProgramCall(virNetClientProgramPtr prog,
     }
     return -1;
 }
+
+
+struct virNetClientProgramAsyncCall {
+    virNetClientProgramPtr prog;
+    int proc;
+    unsigned serial;
+    xdrproc_t ret_filter;
+    void *ret;
+    virNetClientProgramReplyFunc cb;
+    void *opaque;
+};
+
+
+static void
+virNetClientProgramAsyncReply(virNetClientPtr client ATTRIBUTE_UNUSED,
+                              virNetMessagePtr msg,
+                              void *opaque)
+{
+    struct virNetClientProgramAsyncCall *call = opaque;
+    int rv = -1;
+
+    virResetLastError();
+
+    if (!msg) {
+        virReportError(VIR_ERR_RPC, "%s",
+                       _("connection closed before the reply arrived"));
+        goto done;
+    }
+
+    if (virNetClientProgramCheckReply(msg, call->proc, call->serial) < 0)
+        goto done;
+
+    switch (msg->header.status) {
+    case VIR_NET_OK:
+        if (virNetMessageDecodePayload(msg, call->ret_filter, call->ret) < 0)
+            goto done;
+        rv = 0;
+        break;
+
+    case VIR_NET_ERROR:
+        virNetClientProgramDispatchError(call->prog, msg);
+        break;
+
+    default:
+        virReportError(VIR_ERR_RPC,
+                       _("Unexpected message status %d"), msg->header.status);
+        break;
+    }
+
+ done:
+    virNetMessageFree(msg);
+    call->cb(call->prog, rv, call->opaque);
+    virObjectUnref(call->prog);
+    VIR_FREE(call);
+}
+
+
+/**
+ * virNetClientProgramCallAsync:
+ * @prog: the program
+ * @client: the client to send the call with
+ * @serial: the serial number of the call
+ * @proc: the procedure to call
+ * @args_filter: XDR filter for @args
+ * @args: the arguments of the call
+ * @ret_filter: XDR filter for @ret
+ * @ret: where to decode the return values
+ * @cb: callback invoked once the call finished
+ * @opaque: data for @cb
+ *
+ * Like virNetClientProgramCall, but without waiting for the reply
+ * and without support for passing FDs. When the reply arrives, it
+ * is decoded into @ret, which must stay valid until then, and @cb
+ * is invoked from the event loop with 0 or, with an error raised,
+ * -1. The latter also happens when the connection is closed before
+ * the reply arrives.
+ *
+ * Returns 0 if the call was sent, or -1 on error in which case
+ * @cb is never invoked.
+ */
+int virNetClientProgramCallAsync(virNetClientProgramPtr prog,
+                                 virNetClientPtr client,
+                                 unsigned serial,
+                                 int proc,
+                                 xdrproc_t args_filter, void *args,
+                                 xdrproc_t ret_filter, void *ret,
+                                 virNetClientProgramReplyFunc cb,
+                                 void *opaque)
+{
+    struct virNetClientProgramAsyncCall *call = NULL;
+    virNetMessagePtr msg;
+
+    if (!(msg = virNetMessageNew(false)))
+        return -1;
+
+    msg->header.prog = prog->program;
+    msg->header.vers = prog->version;
+    msg->header.status = VIR_NET_OK;
+    msg->header.type = VIR_NET_CALL;
+    msg->header.serial = serial;
+    msg->header.proc = proc;
+
+    if (virNetMessageEncodeHeader(msg) < 0 ||
+        virNetMessageEncodePayload(msg, args_filter, args) < 0)
+        goto error;
+
+    if (VIR_ALLOC(call) < 0)
+        goto error;
+
+    call->prog = virObjectRef(prog);
+    call->proc = proc;
+    call->serial = serial;
+    call->ret_filter = ret_filter;
+    call->ret = ret;
+    call->cb = cb;
+    call->opaque = opaque;
+
+    if (virNetClientSendWithReplyAsync(client, msg,
+                                       virNetClientProgramAsyncReply,
+                                       call) < 0)
+        goto error;
+
+    return 0;
+
+ error:
+    if (call) {
+        virObjectUnref(call->prog);
+        VIR_FREE(call);
+    }
+    virNetMessageFree(msg);
+    return -1;
+}
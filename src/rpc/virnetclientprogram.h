@@ -81,6 +81,21 @@ int virNetClientProgramCall(virNetClientProgramPtr prog,
                             xdrproc_t args_filter, void *args,
                             xdrproc_t ret_filter, void *ret);
 
+typedef void (*virNetClientProgramReplyFunc)(virNetClientProgramPtr prog,
+                                             int ret,
+                                             void *opaque);
+
+int virNetClientProgramCallAsync(virNetClientProgramPtr prog,
+                                 virNetClientPtr client,
+                                 unsigned serial,
+                                 int proc,
+                                 xdrproc_t args_filter, void *args,
+                                 xdrproc_t ret_filter, void *ret,
+                                 virNetClientProgramReplyFunc cb,
+                                 void *opaque);
+
+void virNetClientProgramRaiseError(virNetMessageErrorPtr err);
+
 
 
 #endif /* __VIR_NET_CLIENT_PROGRAM_H__ */
@@ -297,11 +297,7 @@ int virNetClientStreamQueuePacket(virNetClientStreamPtr st,
     memcpy(&tmp_msg->header, &msg->header, sizeof(msg->header));
 
     /* Steal message buffer */
-    tmp_msg->buffer = msg->buffer;
-    tmp_msg->bufferLength = msg->bufferLength;
-    tmp_msg->bufferOffset = msg->bufferOffset;
-    msg->buffer = NULL;
-    msg->bufferLength = msg->bufferOffset = 0;
+    virNetMessageTakeBuffer(tmp_msg, msg);
 
     virObjectLock(st);
 
@@ -346,7 +342,9 @@ int virNetClientStreamSendPacket(virNetClientStreamPtr st,
      * need a synchronous confirmation
      */
     if (status == VIR_NET_CONTINUE) {
-        if (virNetMessageEncodePayloadRaw(msg, data, nbytes) < 0)
+        /* The send below does not return before the packet is on
+         * the wire, so the caller's buffer can go out as it is */
+        if (virNetMessageEncodePayloadBorrow(msg, data, nbytes) < 0)
             goto error;
 
         if (virNetClientSendNoReply(client, msg) < 0)
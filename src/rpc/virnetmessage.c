@@ -22,6 +22,10 @@
 
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
+#if WITH_LZ4
+# include <lz4.h>
+#endif
 
 #include "virnetmessage.h"
 #include "viralloc.h"
@@ -30,16 +34,303 @@
 #include "virfile.h"
 #include "virutil.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
 VIR_LOG_INIT("rpc.netmessage");
 
+/*
+ * Every RPC call needs a message object and at least one buffer
+ * of VIR_NET_MESSAGE_INITIAL bytes, which are all released again
+ * once the reply has been sent. Keep a bounded number of them
+ * around for reuse instead of going back to the allocator.
+ *
+ * Buffers are cached in a few size classes matching the sizes
+ * virNetMessageEncodePayload grows them to. Smaller requests,
+ * like the length word every idle client waits on, and larger
+ * ones are not worth caching and go to the allocator directly.
+ */
+static const size_t virNetMessagePoolClasses[] = {
+    VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX,
+    VIR_NET_MESSAGE_INITIAL * 4 + VIR_NET_MESSAGE_LEN_MAX,
+    VIR_NET_MESSAGE_INITIAL * 16 + VIR_NET_MESSAGE_LEN_MAX,
+};
+
+#define VIR_NET_MESSAGE_POOL_CLASSES ARRAY_CARDINALITY(virNetMessagePoolClasses)
+
+/* Free buffers are chained through their first bytes */
+typedef struct _virNetMessagePoolBuffer virNetMessagePoolBuffer;
+struct _virNetMessagePoolBuffer {
+    virNetMessagePoolBuffer *next;
+};
+
+static virMutex virNetMessagePoolLock = VIR_MUTEX_INITIALIZER;
+static virNetMessagePoolBuffer *virNetMessagePoolBuffers[VIR_NET_MESSAGE_POOL_CLASSES];
+static virNetMessagePtr virNetMessagePoolMessages;
+static virNetMessagePoolStats virNetMessagePool = {
+    .maxBytes = 16 * 1024 * 1024,
+    .maxMessages = 1024,
+};
+
+
+void virNetMessagePoolSetLimits(unsigned long long maxBytes,
+                                unsigned int maxMessages)
+{
+    virNetMessagePoolBuffer *freeBuffers = NULL;
+    virNetMessagePtr freeMessages = NULL;
+    size_t i;
+
+    virMutexLock(&virNetMessagePoolLock);
+    virNetMessagePool.maxBytes = maxBytes;
+    virNetMessagePool.maxMessages = maxMessages;
+
+    /* Trim the cache down to the new limits, largest buffers first */
+    for (i = VIR_NET_MESSAGE_POOL_CLASSES; i-- > 0 &&
+         virNetMessagePool.bytes > maxBytes;) {
+        while (virNetMessagePoolBuffers[i] &&
+               virNetMessagePool.bytes > maxBytes) {
+            virNetMessagePoolBuffer *buf = virNetMessagePoolBuffers[i];
+            virNetMessagePoolBuffers[i] = buf->next;
+            buf->next = freeBuffers;
+            freeBuffers = buf;
+            virNetMessagePool.bytes -= virNetMessagePoolClasses[i];
+        }
+    }
+
+    while (virNetMessagePool.messages > maxMessages) {
+        virNetMessagePtr msg = virNetMessagePoolMessages;
+        virNetMessagePoolMessages = msg->next;
+        msg->next = freeMessages;
+        freeMessages = msg;
+        virNetMessagePool.messages--;
+    }
+    virMutexUnlock(&virNetMessagePoolLock);
+
+    while (freeBuffers) {
+        virNetMessagePoolBuffer *buf = freeBuffers;
+        freeBuffers = buf->next;
+        VIR_FREE(buf);
+    }
+
+    while (freeMessages) {
+        virNetMessagePtr msg = freeMessages;
+        freeMessages = msg->next;
+        VIR_FREE(msg);
+    }
+}
+
+
+void virNetMessagePoolGetStats(virNetMessagePoolStatsPtr stats)
+{
+    virMutexLock(&virNetMessagePoolLock);
+    *stats = virNetMessagePool;
+    virMutexUnlock(&virNetMessagePoolLock);
+}
+
+
+/*
+ * Large replies can be sent LZ4 compressed to clients which asked
+ * for it. Like the pool, the threshold and counters are process
+ * wide, so that the daemon reports a single figure for all of its
+ * servers.
+ */
+static virMutex virNetMessageCompressionLock = VIR_MUTEX_INITIALIZER;
+static virNetMessageCompressionStats virNetMessageCompression;
+
+
+bool virNetMessageCompressionIsSupported(void)
+{
+#if WITH_LZ4
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+void virNetMessageCompressionSetThreshold(unsigned int threshold)
+{
+    virMutexLock(&virNetMessageCompressionLock);
+    virNetMessageCompression.threshold = threshold;
+    virMutexUnlock(&virNetMessageCompressionLock);
+}
+
+
+void virNetMessageCompressionGetStats(virNetMessageCompressionStatsPtr stats)
+{
+    virMutexLock(&virNetMessageCompressionLock);
+    *stats = virNetMessageCompression;
+    virMutexUnlock(&virNetMessageCompressionLock);
+}
+
+
+/* Find the smallest size class that fits @len, or -1 if none does */
+static ssize_t
+virNetMessagePoolClass(size_t len)
+{
+    size_t i;
+
+    /* Not worth caching anything smaller than a page */
+    if (len < 4096)
+        return -1;
+
+    for (i = 0; i < VIR_NET_MESSAGE_POOL_CLASSES; i++) {
+        if (len <= virNetMessagePoolClasses[i])
+            return i;
+    }
+
+    return -1;
+}
+
+
+/*
+ * Obtain a buffer of at least @len bytes. Returns the buffer and
+ * fills @alloc with its actual size.
+ */
+static char *
+virNetMessagePoolGetBuffer(size_t len, size_t *alloc)
+{
+    ssize_t class = virNetMessagePoolClass(len);
+    virNetMessagePoolBuffer *buf = NULL;
+    char *ret;
+
+    if (class < 0) {
+        if (VIR_ALLOC_N(ret, len) < 0)
+            return NULL;
+        *alloc = len;
+        return ret;
+    }
+
+    virMutexLock(&virNetMessagePoolLock);
+    if ((buf = virNetMessagePoolBuffers[class])) {
+        virNetMessagePoolBuffers[class] = buf->next;
+        virNetMessagePool.bytes -= virNetMessagePoolClasses[class];
+        virNetMessagePool.bufferHits++;
+    } else {
+        virNetMessagePool.bufferMisses++;
+    }
+    virMutexUnlock(&virNetMessagePoolLock);
+
+    if (buf)
+        ret = (char *)buf;
+    else if (VIR_ALLOC_N(ret, virNetMessagePoolClasses[class]) < 0)
+        return NULL;
+
+    *alloc = virNetMessagePoolClasses[class];
+    return ret;
+}
+
+
+/* Release @buffer of @alloc bytes, caching it if it fits a size class */
+static void
+virNetMessagePoolPutBuffer(char *buffer, size_t alloc)
+{
+    ssize_t class = virNetMessagePoolClass(alloc);
+
+    if (!buffer)
+        return;
+
+    if (class >= 0 && virNetMessagePoolClasses[class] == alloc) {
+        virNetMessagePoolBuffer *buf = (virNetMessagePoolBuffer *)buffer;
+
+        virMutexLock(&virNetMessagePoolLock);
+        if (virNetMessagePool.bytes + alloc <= virNetMessagePool.maxBytes) {
+            buf->next = virNetMessagePoolBuffers[class];
+            virNetMessagePoolBuffers[class] = buf;
+            virNetMessagePool.bytes += alloc;
+            buffer = NULL;
+        }
+        virMutexUnlock(&virNetMessagePoolLock);
+    }
+
+    VIR_FREE(buffer);
+}
+
+
+/*
+ * Make room for at least @len bytes in the message buffer,
+ * preserving the first @keep bytes of its current contents.
+ */
+static int
+virNetMessageReserveBuffer(virNetMessagePtr msg,
+                           size_t len,
+                           size_t keep)
+{
+    char *buffer;
+    size_t alloc;
+
+    if (msg->buffer && len <= msg->bufferAlloc)
+        return 0;
+
+    if (!(buffer = virNetMessagePoolGetBuffer(len, &alloc)))
+        return -1;
+
+    if (msg->buffer && keep)
+        memcpy(buffer, msg->buffer, keep);
+
+    virNetMessagePoolPutBuffer(msg->buffer, msg->bufferAlloc);
+    msg->buffer = buffer;
+    msg->bufferAlloc = alloc;
+    return 0;
+}
+
+
+/*
+ * Allocate an empty buffer of @len bytes for @msg, replacing
+ * any it has already, and set bufferLength accordingly.
+ */
+int virNetMessageAllocBuffer(virNetMessagePtr msg,
+                             size_t len)
+{
+    if (virNetMessageReserveBuffer(msg, len, 0) < 0)
+        return -1;
+
+    memset(msg->buffer, 0, len);
+    msg->bufferLength = len;
+    msg->bufferOffset = 0;
+    return 0;
+}
+
+
+/*
+ * Move the buffer of @from, along with its length and offset,
+ * over to @msg instead of copying its contents.
+ */
+void virNetMessageTakeBuffer(virNetMessagePtr msg,
+                             virNetMessagePtr from)
+{
+    virNetMessagePoolPutBuffer(msg->buffer, msg->bufferAlloc);
+
+    msg->buffer = from->buffer;
+    msg->bufferLength = from->bufferLength;
+    msg->bufferOffset = from->bufferOffset;
+    msg->bufferAlloc = from->bufferAlloc;
+
+    from->buffer = NULL;
+    from->bufferLength = 0;
+    from->bufferOffset = 0;
+    from->bufferAlloc = 0;
+}
+
+
 virNetMessagePtr virNetMessageNew(bool tracked)
 {
     virNetMessagePtr msg;
 
-    if (VIR_ALLOC(msg) < 0)
+    virMutexLock(&virNetMessagePoolLock);
+    if ((msg = virNetMessagePoolMessages)) {
+        virNetMessagePoolMessages = msg->next;
+        virNetMessagePool.messages--;
+        virNetMessagePool.messageHits++;
+    } else {
+        virNetMessagePool.messageMisses++;
+    }
+    virMutexUnlock(&virNetMessagePoolLock);
+
+    if (msg)
+        memset(msg, 0, sizeof(*msg));
+    else if (VIR_ALLOC(msg) < 0)
         return NULL;
 
     msg->tracked = tracked;
@@ -63,7 +354,17 @@ virNetMessageClearPayload(virNetMessagePtr msg)
 
     msg->bufferOffset = 0;
     msg->bufferLength = 0;
-    VIR_FREE(msg->buffer);
+    virNetMessagePoolPutBuffer(msg->buffer, msg->bufferAlloc);
+    msg->buffer = NULL;
+    msg->bufferAlloc = 0;
+
+    if (msg->payloadBorrowed)
+        msg->payload = NULL;
+    else
+        VIR_FREE(msg->payload);
+    msg->payloadLength = 0;
+    msg->payloadOffset = 0;
+    msg->payloadBorrowed = false;
 }
 
 
@@ -74,6 +375,7 @@ void virNetMessageClear(virNetMessagePtr msg)
     VIR_DEBUG("msg=%p nfds=%zu", msg, msg->nfds);
 
     virNetMessageClearPayload(msg);
+    VIR_FREE(msg->coalesceKey);
     memset(msg, 0, sizeof(*msg));
     msg->tracked = tracked;
 }
@@ -90,6 +392,17 @@ void virNetMessageFree(virNetMessagePtr msg)
         msg->cb(msg, msg->opaque);
 
     virNetMessageClearPayload(msg);
+    VIR_FREE(msg->coalesceKey);
+
+    virMutexLock(&virNetMessagePoolLock);
+    if (virNetMessagePool.messages < virNetMessagePool.maxMessages) {
+        msg->next = virNetMessagePoolMessages;
+        virNetMessagePoolMessages = msg;
+        virNetMessagePool.messages++;
+        msg = NULL;
+    }
+    virMutexUnlock(&virNetMessagePoolLock);
+
     VIR_FREE(msg);
 }
 
@@ -153,9 +466,10 @@ int virNetMessageDecodeLength(virNetMessagePtr msg)
 
     /* Extend our declared buffer length and carry
        on reading the header + payload */
-    msg->bufferLength += len;
-    if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+    if (virNetMessageReserveBuffer(msg, msg->bufferLength + len,
+                                   msg->bufferLength) < 0)
         goto cleanup;
+    msg->bufferLength += len;
 
     VIR_DEBUG("Got length, now need %zu total (%u more)",
               msg->bufferLength, len);
@@ -230,9 +544,10 @@ int virNetMessageEncodeHeader(virNetMessagePtr msg)
     int ret = -1;
     unsigned int len = 0;
 
-    msg->bufferLength = VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX;
-    if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+    if (virNetMessageReserveBuffer(msg, VIR_NET_MESSAGE_INITIAL +
+                                   VIR_NET_MESSAGE_LEN_MAX, 0) < 0)
         return ret;
+    msg->bufferLength = VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX;
     msg->bufferOffset = 0;
 
     /* Format the header. */
@@ -370,10 +685,10 @@ int virNetMessageEncodePayload(virNetMessagePtr msg,
 
         xdr_destroy(&xdr);
 
-        msg->bufferLength = newlen + VIR_NET_MESSAGE_LEN_MAX;
-
-        if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+        if (virNetMessageReserveBuffer(msg, newlen + VIR_NET_MESSAGE_LEN_MAX,
+                                       msg->bufferOffset) < 0)
             goto error;
+        msg->bufferLength = newlen + VIR_NET_MESSAGE_LEN_MAX;
 
         xdrmem_create(&xdr, msg->buffer + msg->bufferOffset,
                       msg->bufferLength - msg->bufferOffset, XDR_ENCODE);
@@ -454,10 +769,10 @@ int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
             return -1;
         }
 
-        msg->bufferLength = msg->bufferOffset + len;
-
-        if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+        if (virNetMessageReserveBuffer(msg, msg->bufferOffset + len,
+                                       msg->bufferOffset) < 0)
             return -1;
+        msg->bufferLength = msg->bufferOffset + len;
 
         VIR_DEBUG("Increased message buffer length = %zu", msg->bufferLength);
     }
@@ -510,6 +825,429 @@ int virNetMessageEncodePayloadEmpty(virNetMessagePtr msg)
 }
 
 
+/*
+ * Attach @data as the message payload without copying it into
+ * the message buffer. Only the length word is re-encoded, the
+ * payload is transmitted from @data directly.
+ */
+static int
+virNetMessageEncodePayloadExternal(virNetMessagePtr msg,
+                                   char *data,
+                                   size_t len,
+                                   bool borrowed)
+{
+    XDR xdr;
+    unsigned int msglen;
+
+    if ((msg->bufferOffset + len) >
+        (VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX)) {
+        virReportError(VIR_ERR_RPC,
+                       _("Stream data too long to send "
+                         "(%zu bytes needed, %zu bytes available)"),
+                       len,
+                       VIR_NET_MESSAGE_MAX +
+                       VIR_NET_MESSAGE_LEN_MAX -
+                       msg->bufferOffset);
+        return -1;
+    }
+
+    /* Re-encode the length word. */
+    VIR_DEBUG("Encode length as %zu", msg->bufferOffset + len);
+    xdrmem_create(&xdr, msg->buffer, VIR_NET_MESSAGE_HEADER_XDR_LEN, XDR_ENCODE);
+    msglen = msg->bufferOffset + len;
+    if (!xdr_u_int(&xdr, &msglen)) {
+        virReportError(VIR_ERR_RPC, "%s", _("Unable to encode message length"));
+        goto error;
+    }
+    xdr_destroy(&xdr);
+
+    msg->bufferLength = msg->bufferOffset;
+    msg->bufferOffset = 0;
+    msg->payload = data;
+    msg->payloadLength = len;
+    msg->payloadOffset = 0;
+    msg->payloadBorrowed = borrowed;
+    return 0;
+
+ error:
+    xdr_destroy(&xdr);
+    return -1;
+}
+
+
+/*
+ * Like virNetMessageEncodePayloadRaw, but the message takes
+ * ownership of @data instead of copying it. On success @data
+ * is set to NULL.
+ */
+int virNetMessageEncodePayloadRef(virNetMessagePtr msg,
+                                  char **data,
+                                  size_t len)
+{
+    if (virNetMessageEncodePayloadExternal(msg, *data, len, false) < 0)
+        return -1;
+
+    *data = NULL;
+    return 0;
+}
+
+
+/*
+ * Like virNetMessageEncodePayloadRaw, but @data is referenced
+ * rather than copied. The caller must keep it alive until the
+ * message has been transmitted or freed.
+ */
+int virNetMessageEncodePayloadBorrow(virNetMessagePtr msg,
+                                     const char *data,
+                                     size_t len)
+{
+    return virNetMessageEncodePayloadExternal(msg, (char *)data, len, true);
+}
+
+
+/*
+ * Fill @iov, which must have room for two elements, with the
+ * parts of @msg which have not been transmitted yet.
+ *
+ * Returns the number of elements filled in
+ */
+size_t virNetMessageGetTXIOV(virNetMessagePtr msg,
+                             struct iovec *iov)
+{
+    size_t niov = 0;
+
+    if (msg->bufferOffset < msg->bufferLength) {
+        iov[niov].iov_base = msg->buffer + msg->bufferOffset;
+        iov[niov].iov_len = msg->bufferLength - msg->bufferOffset;
+        niov++;
+    }
+
+    if (msg->payloadOffset < msg->payloadLength) {
+        iov[niov].iov_base = msg->payload + msg->payloadOffset;
+        iov[niov].iov_len = msg->payloadLength - msg->payloadOffset;
+        niov++;
+    }
+
+    return niov;
+}
+
+
+/* Record that @len more bytes of @msg have been transmitted */
+void virNetMessageAdvanceTX(virNetMessagePtr msg,
+                            size_t len)
+{
+    size_t done = MIN(len, msg->bufferLength - msg->bufferOffset);
+
+    msg->bufferOffset += done;
+    msg->payloadOffset += len - done;
+}
+
+
+bool virNetMessageIsTXComplete(virNetMessagePtr msg)
+{
+    return msg->bufferOffset == msg->bufferLength &&
+        msg->payloadOffset == msg->payloadLength;
+}
+
+
+/*
+ * Serialise @data into a buffer of its own rather than into a
+ * message, so that it can be embedded as opaque data in another
+ * message. The caller must free @buf.
+ */
+int virNetMessageEncodeData(xdrproc_t filter,
+                            void *data,
+                            char **buf,
+                            size_t *buflen)
+{
+    XDR xdr;
+    char *tmp = NULL;
+    size_t len = 1024;
+
+    if (VIR_ALLOC_N(tmp, len) < 0)
+        return -1;
+    xdrmem_create(&xdr, tmp, len, XDR_ENCODE);
+
+    /* Try to encode the data. If the buffer is too small increase it. */
+    while (!(*filter)(&xdr, data, 0)) {
+        xdr_destroy(&xdr);
+
+        len *= 2;
+        if (len > VIR_NET_MESSAGE_PAYLOAD_MAX) {
+            virReportError(VIR_ERR_RPC, "%s", _("Unable to encode message data"));
+            VIR_FREE(tmp);
+            return -1;
+        }
+
+        if (VIR_REALLOC_N(tmp, len) < 0) {
+            VIR_FREE(tmp);
+            return -1;
+        }
+        xdrmem_create(&xdr, tmp, len, XDR_ENCODE);
+    }
+
+    *buflen = xdr_getpos(&xdr);
+    *buf = tmp;
+    xdr_destroy(&xdr);
+    return 0;
+}
+
+
+int virNetMessageDecodeData(xdrproc_t filter,
+                            void *data,
+                            char *buf,
+                            size_t buflen)
+{
+    XDR xdr;
+    int ret = -1;
+
+    xdrmem_create(&xdr, buf, buflen, XDR_DECODE);
+
+    if (!(*filter)(&xdr, data, 0)) {
+        virReportError(VIR_ERR_RPC, "%s", _("Unable to decode message data"));
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    xdr_destroy(&xdr);
+    return ret;
+}
+
+
+/**
+ * virNetMessageTimestamp:
+ *
+ * Cheap monotonic clock for measuring how long handling a message
+ * takes. Only differences between two timestamps are meaningful.
+ *
+ * Returns the current time in microseconds, or 0 if it is not known.
+ */
+unsigned long long
+virNetMessageTimestamp(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+#endif
+    return 0;
+}
+
+
+#if WITH_LZ4
+static unsigned long long
+virNetMessageCPUTime(void)
+{
+# ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+# endif
+    return 0;
+}
+
+
+/* Offset of the payload in a message buffer */
+# define VIR_NET_MESSAGE_PAYLOAD_OFFSET \
+    (VIR_NET_MESSAGE_LEN_MAX + VIR_NET_MESSAGE_HEADER_MAX)
+
+/* Length of the uncompressed payload in front of compressed data */
+# define VIR_NET_MESSAGE_COMPRESSED_LEN 4
+#endif
+
+
+/*
+ * @msg: a fully encoded VIR_NET_REPLY message
+ *
+ * Replaces the payload of @msg by its LZ4 compressed form and
+ * turns it into VIR_NET_REPLY_COMPRESSED if the payload is at
+ * least as large as the compression threshold and shrinks by
+ * at least an eighth. Otherwise @msg is left as it is.
+ *
+ * Returns 0 on success, -1 on error, in which case @msg is
+ * still intact and can be sent uncompressed.
+ */
+int virNetMessageCompressPayload(virNetMessagePtr msg)
+{
+#if WITH_LZ4
+    XDR xdr;
+    char *buffer = NULL;
+    size_t alloc = 0;
+    size_t inlen;
+    int bound;
+    int outlen = 0;
+    unsigned int threshold;
+    unsigned int origlen;
+    unsigned int msglen;
+    unsigned long long start;
+    bool compressed = false;
+    int ret = -1;
+
+    virMutexLock(&virNetMessageCompressionLock);
+    threshold = virNetMessageCompression.threshold;
+    virMutexUnlock(&virNetMessageCompressionLock);
+
+    if (threshold == 0 ||
+        msg->header.type != VIR_NET_REPLY ||
+        msg->payload || msg->nfds || msg->bufferOffset != 0 ||
+        msg->bufferLength < VIR_NET_MESSAGE_PAYLOAD_OFFSET + threshold)
+        return 0;
+
+    start = virNetMessageCPUTime();
+
+    inlen = msg->bufferLength - VIR_NET_MESSAGE_PAYLOAD_OFFSET;
+    bound = LZ4_compressBound(inlen);
+
+    if (!(buffer = virNetMessagePoolGetBuffer(VIR_NET_MESSAGE_PAYLOAD_OFFSET +
+                                              VIR_NET_MESSAGE_COMPRESSED_LEN +
+                                              bound, &alloc)))
+        goto cleanup;
+
+    outlen = LZ4_compress_default(msg->buffer + VIR_NET_MESSAGE_PAYLOAD_OFFSET,
+                                  buffer + VIR_NET_MESSAGE_PAYLOAD_OFFSET +
+                                  VIR_NET_MESSAGE_COMPRESSED_LEN,
+                                  inlen, bound);
+
+    if (outlen <= 0 ||
+        (size_t) outlen + VIR_NET_MESSAGE_COMPRESSED_LEN > inlen - inlen / 8) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    msg->header.type = VIR_NET_REPLY_COMPRESSED;
+    msglen = VIR_NET_MESSAGE_PAYLOAD_OFFSET + VIR_NET_MESSAGE_COMPRESSED_LEN +
+        outlen;
+    origlen = inlen;
+
+    xdrmem_create(&xdr, buffer,
+                  VIR_NET_MESSAGE_PAYLOAD_OFFSET + VIR_NET_MESSAGE_COMPRESSED_LEN,
+                  XDR_ENCODE);
+    if (!xdr_u_int(&xdr, &msglen) ||
+        !xdr_virNetMessageHeader(&xdr, &msg->header) ||
+        !xdr_u_int(&xdr, &origlen)) {
+        virReportError(VIR_ERR_RPC, "%s",
+                       _("Unable to encode compressed message header"));
+        xdr_destroy(&xdr);
+        msg->header.type = VIR_NET_REPLY;
+        goto cleanup;
+    }
+    xdr_destroy(&xdr);
+
+    VIR_DEBUG("Compressed payload of msg=%p from %zu to %d bytes",
+              msg, inlen, outlen);
+
+    virNetMessagePoolPutBuffer(msg->buffer, msg->bufferAlloc);
+    msg->buffer = buffer;
+    msg->bufferAlloc = alloc;
+    msg->bufferLength = msglen;
+    buffer = NULL;
+    compressed = true;
+    ret = 0;
+
+ cleanup:
+    virNetMessagePoolPutBuffer(buffer, alloc);
+
+    virMutexLock(&virNetMessageCompressionLock);
+    if (compressed) {
+        virNetMessageCompression.messages++;
+        virNetMessageCompression.bytesIn += inlen;
+        virNetMessageCompression.bytesOut += outlen +
+            VIR_NET_MESSAGE_COMPRESSED_LEN;
+    } else if (ret == 0) {
+        virNetMessageCompression.skipped++;
+    }
+    virNetMessageCompression.time += virNetMessageCPUTime() - start;
+    virMutexUnlock(&virNetMessageCompressionLock);
+
+    return ret;
+#else /* !WITH_LZ4 */
+    return 0;
+#endif /* !WITH_LZ4 */
+}
+
+
+/*
+ * @msg: an incoming VIR_NET_REPLY_COMPRESSED message with its
+ * header already decoded
+ *
+ * Decompresses the payload of @msg in place and turns the message
+ * into the VIR_NET_REPLY it was originally, ready for decoding of
+ * the payload.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virNetMessageDecompressPayload(virNetMessagePtr msg)
+{
+#if WITH_LZ4
+    XDR xdr;
+    char *buffer;
+    size_t alloc;
+    size_t offset;
+    unsigned int origlen;
+    int rc;
+
+    if (msg->header.type != VIR_NET_REPLY_COMPRESSED) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected message type %d"), msg->header.type);
+        return -1;
+    }
+
+    xdrmem_create(&xdr, msg->buffer + msg->bufferOffset,
+                  msg->bufferLength - msg->bufferOffset, XDR_DECODE);
+    if (!xdr_u_int(&xdr, &origlen)) {
+        virReportError(VIR_ERR_RPC, "%s",
+                       _("Unable to decode compressed payload length"));
+        xdr_destroy(&xdr);
+        return -1;
+    }
+    offset = msg->bufferOffset + xdr_getpos(&xdr);
+    xdr_destroy(&xdr);
+
+    if (origlen > VIR_NET_MESSAGE_PAYLOAD_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("compressed payload of %u bytes too large, want %d"),
+                       origlen, VIR_NET_MESSAGE_PAYLOAD_MAX);
+        return -1;
+    }
+
+    if (!(buffer = virNetMessagePoolGetBuffer(msg->bufferOffset + origlen,
+                                              &alloc)))
+        return -1;
+
+    memcpy(buffer, msg->buffer, msg->bufferOffset);
+    rc = LZ4_decompress_safe(msg->buffer + offset,
+                             buffer + msg->bufferOffset,
+                             msg->bufferLength - offset,
+                             origlen);
+    if (rc < 0 || (unsigned int) rc != origlen) {
+        virReportError(VIR_ERR_RPC, "%s",
+                       _("Unable to decompress message payload"));
+        virNetMessagePoolPutBuffer(buffer, alloc);
+        return -1;
+    }
+
+    VIR_DEBUG("Decompressed payload of msg=%p from %zu to %u bytes",
+              msg, msg->bufferLength - offset, origlen);
+
+    virNetMessagePoolPutBuffer(msg->buffer, msg->bufferAlloc);
+    msg->buffer = buffer;
+    msg->bufferAlloc = alloc;
+    msg->bufferLength = msg->bufferOffset + origlen;
+    msg->header.type = VIR_NET_REPLY;
+    return 0;
+#else /* !WITH_LZ4 */
+    virReportError(VIR_ERR_RPC, "%s",
+                   _("received compressed payload, but compression "
+                     "is not supported"));
+    return -1;
+#endif /* !WITH_LZ4 */
+}
+
+
 void virNetMessageSaveError(virNetMessageErrorPtr rerr)
 {
     /* This func may be called several times & the first
@@ -21,6 +21,8 @@
 #ifndef __VIR_NET_MESSAGE_H__
 # define __VIR_NET_MESSAGE_H__
 
+# include <sys/uio.h>
+
 # include "virnetprotocol.h"
 
 typedef struct virNetMessageHeader *virNetMessageHeaderPtr;
@@ -38,9 +40,25 @@ struct _virNetMessage {
                   /* Maximum   VIR_NET_MESSAGE_MAX     + VIR_NET_MESSAGE_LEN_MAX */
     size_t bufferLength;
     size_t bufferOffset;
+    size_t bufferAlloc; /* Allocated size of buffer, 0 if not known */
+
+    /* Stream data transmitted straight after buffer, without
+     * being copied into it. Freed along with the message unless
+     * it was only borrowed from the sender */
+    char *payload;
+    size_t payloadLength;
+    size_t payloadOffset;
+    bool payloadBorrowed;
 
     virNetMessageHeader header;
 
+    /* When the message was completely read, from virNetMessageTimestamp */
+    unsigned long long received;
+
+    /* Async events queued for a client with the same key supersede
+     * each other when the client falls behind, NULL if they don't */
+    char *coalesceKey;
+
     virNetMessageFreeCallback cb;
     void *opaque;
 
@@ -52,14 +70,60 @@ struct _virNetMessage {
 };
 
 
+typedef struct _virNetMessagePoolStats virNetMessagePoolStats;
+typedef virNetMessagePoolStats *virNetMessagePoolStatsPtr;
+
+struct _virNetMessagePoolStats {
+    unsigned long long maxBytes;    /* limit on cached buffer memory */
+    unsigned long long bytes;       /* buffer memory currently cached */
+    unsigned int maxMessages;       /* limit on cached message objects */
+    unsigned int messages;          /* message objects currently cached */
+    unsigned long long bufferHits;
+    unsigned long long bufferMisses;
+    unsigned long long messageHits;
+    unsigned long long messageMisses;
+};
+
+void virNetMessagePoolSetLimits(unsigned long long maxBytes,
+                                unsigned int maxMessages);
+void virNetMessagePoolGetStats(virNetMessagePoolStatsPtr stats)
+    ATTRIBUTE_NONNULL(1);
+
+
+typedef struct _virNetMessageCompressionStats virNetMessageCompressionStats;
+typedef virNetMessageCompressionStats *virNetMessageCompressionStatsPtr;
+
+struct _virNetMessageCompressionStats {
+    unsigned int threshold;         /* smallest payload compressed, 0 = off */
+    unsigned long long messages;    /* payloads sent compressed */
+    unsigned long long skipped;     /* payloads not worth compressing */
+    unsigned long long bytesIn;     /* compressed payloads, original size */
+    unsigned long long bytesOut;    /* compressed payloads, size on wire */
+    unsigned long long time;        /* CPU time spent compressing, in ns */
+};
+
+bool virNetMessageCompressionIsSupported(void);
+void virNetMessageCompressionSetThreshold(unsigned int threshold);
+void virNetMessageCompressionGetStats(virNetMessageCompressionStatsPtr stats)
+    ATTRIBUTE_NONNULL(1);
+
 virNetMessagePtr virNetMessageNew(bool tracked);
 
+int virNetMessageAllocBuffer(virNetMessagePtr msg,
+                             size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+void virNetMessageTakeBuffer(virNetMessagePtr msg,
+                             virNetMessagePtr from)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
 void virNetMessageClearPayload(virNetMessagePtr msg);
 
 void virNetMessageClear(virNetMessagePtr);
 
 void virNetMessageFree(virNetMessagePtr msg);
 
+unsigned long long virNetMessageTimestamp(void);
+
 virNetMessagePtr virNetMessageQueueServe(virNetMessagePtr *queue)
     ATTRIBUTE_NONNULL(1);
 void virNetMessageQueuePush(virNetMessagePtr *queue,
@@ -91,6 +155,40 @@ int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
 int virNetMessageEncodePayloadEmpty(virNetMessagePtr msg)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+int virNetMessageEncodePayloadRef(virNetMessagePtr msg,
+                                  char **data,
+                                  size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
+int virNetMessageEncodePayloadBorrow(virNetMessagePtr msg,
+                                     const char *data,
+                                     size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+
+size_t virNetMessageGetTXIOV(virNetMessagePtr msg,
+                             struct iovec *iov)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+void virNetMessageAdvanceTX(virNetMessagePtr msg,
+                            size_t len)
+    ATTRIBUTE_NONNULL(1);
+bool virNetMessageIsTXComplete(virNetMessagePtr msg)
+    ATTRIBUTE_NONNULL(1);
+
+int virNetMessageEncodeData(xdrproc_t filter,
+                            void *data,
+                            char **buf,
+                            size_t *buflen)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(3) ATTRIBUTE_NONNULL(4)
+    ATTRIBUTE_RETURN_CHECK;
+int virNetMessageDecodeData(xdrproc_t filter,
+                            void *data,
+                            char *buf,
+                            size_t buflen)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+
+int virNetMessageCompressPayload(virNetMessagePtr msg)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+int virNetMessageDecompressPayload(virNetMessagePtr msg)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
 
 void virNetMessageSaveError(virNetMessageErrorPtr rerr)
     ATTRIBUTE_NONNULL(1);
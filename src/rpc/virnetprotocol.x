@@ -151,6 +151,12 @@ const VIR_NET_MESSAGE_NUM_FDS_MAX = 32;
  *     * status == VIR_NET_OK
  *          <empty>
  *
+ *  - type == VIR_NET_REPLY_COMPRESSED
+ *          uint32  - length of the uncompressed payload
+ *          byte[]  - LZ4 compressed payload of a VIR_NET_REPLY
+ *     Only sent to clients which enabled it through
+ *     VIR_DRV_FEATURE_PROGRAM_COMPRESSION.
+ *
  */
 enum virNetMessageType {
     /* client -> server. args from a method call */
@@ -166,7 +172,9 @@ enum virNetMessageType {
     /* server -> client. reply/error from a method call, with passed FDs */
     VIR_NET_REPLY_WITH_FDS = 5,
     /* either direction, stream hole data packet */
-    VIR_NET_STREAM_HOLE = 6
+    VIR_NET_STREAM_HOLE = 6,
+    /* server -> client. reply/error from a method call, compressed payload */
+    VIR_NET_REPLY_COMPRESSED = 7
 };
 
 enum virNetMessageStatus {
@@ -40,10 +40,29 @@ VIR_LOG_INIT("rpc.netserver");
 typedef struct _virNetServerJob virNetServerJob;
 typedef virNetServerJob *virNetServerJobPtr;
 
+typedef struct _virNetServerParallel virNetServerParallel;
+typedef virNetServerParallel *virNetServerParallelPtr;
+
+/* Items of a virNetServerRunParallel call. Shared by the caller and
+ * the helper jobs it queued, the last one to let go frees it */
+struct _virNetServerParallel {
+    virMutex lock;
+    virCond cond;
+    size_t refs;
+
+    size_t nitems;
+    size_t next;                        /* First item not claimed yet */
+    size_t ndone;                       /* Items finished */
+
+    virNetServerParallelFunc func;
+    void *opaque;
+};
+
 struct _virNetServerJob {
     virNetServerClientPtr client;
     virNetMessagePtr msg;
     virNetServerProgramPtr prog;
+    virNetServerParallelPtr parallel;
 };
 
 struct _virNetServer {
@@ -73,6 +92,14 @@ struct _virNetServer {
     int keepaliveInterval;
     unsigned int keepaliveCount;
 
+    /* Shares of worker time of clients */
+    unsigned int clientWeight;
+    unsigned int readonlyClientWeight;
+
+    /* Limits on messages waiting for transmit to each client */
+    size_t clientTxMaxMessages;
+    size_t clientTxMaxBytes;
+
 #ifdef WITH_GNUTLS
     virNetTLSContextPtr tls;
 #endif
@@ -158,13 +185,59 @@ static int virNetServerProcessMsg(virNetServerPtr srv,
     return ret;
 }
 
+static void
+virNetServerParallelUnref(virNetServerParallelPtr par)
+{
+    bool last;
+
+    virMutexLock(&par->lock);
+    last = --par->refs == 0;
+    virMutexUnlock(&par->lock);
+
+    if (!last)
+        return;
+
+    virCondDestroy(&par->cond);
+    virMutexDestroy(&par->lock);
+    VIR_FREE(par);
+}
+
+/* Keep running items until there are none left to claim. The
+ * caller of virNetServerRunParallel waits for all claimed items
+ * to finish, so func and opaque are valid for as long as there
+ * is an item to run. */
+static void
+virNetServerParallelWork(virNetServerParallelPtr par)
+{
+    virMutexLock(&par->lock);
+    while (par->next < par->nitems) {
+        size_t item = par->next++;
+
+        virMutexUnlock(&par->lock);
+        par->func(item, par->opaque);
+        virMutexLock(&par->lock);
+
+        if (++par->ndone == par->nitems)
+            virCondBroadcast(&par->cond);
+    }
+    virMutexUnlock(&par->lock);
+}
+
 static void virNetServerHandleJob(void *jobOpaque, void *opaque)
 {
     virNetServerPtr srv = opaque;
     virNetServerJobPtr job = jobOpaque;
 
-    VIR_DEBUG("server=%p client=%p message=%p prog=%p",
-              srv, job->client, job->msg, job->prog);
+    VIR_DEBUG("server=%p client=%p message=%p prog=%p parallel=%p",
+              srv, job->client, job->msg, job->prog, job->parallel);
+
+    if (job->parallel) {
+        virNetServerParallelWork(job->parallel);
+        virNetServerParallelUnref(job->parallel);
+        virObjectUnref(job->client);
+        VIR_FREE(job);
+        return;
+    }
 
     if (virNetServerProcessMsg(srv, job->client, job->prog, job->msg) < 0)
         goto error;
@@ -217,7 +290,7 @@ static int virNetServerDispatchNewMessage(virNetServerClientPtr client,
             priority = virNetServerProgramGetPriority(prog, msg->header.proc);
         }
 
-        ret = virThreadPoolSendJob(srv->workers, priority, job);
+        ret = virThreadPoolSendJobFull(srv->workers, priority, client, job);
 
         if (ret < 0) {
             VIR_FREE(job);
@@ -233,6 +306,100 @@ static int virNetServerDispatchNewMessage(virNetServerClientPtr client,
     return ret;
 }
 
+/**
+ * virNetServerRunParallel:
+ * @srv: server whose workers to use
+ * @client: client the work is done for
+ * @nitems: number of items
+ * @func: callback to run each item
+ * @opaque: data for @func
+ *
+ * Call @func once for every item from 0 to @nitems - 1, spreading
+ * the items across the worker pool of @srv. The calling thread,
+ * usually a worker itself, runs items too rather than just waiting
+ * for the helpers, so all items get done even if no other worker
+ * is free. @func must be safe to call from several threads at once.
+ *
+ * Returns 0 once all items are done, -1 on error, in which case
+ * none of them has been run.
+ */
+int
+virNetServerRunParallel(virNetServerPtr srv,
+                        virNetServerClientPtr client,
+                        size_t nitems,
+                        virNetServerParallelFunc func,
+                        void *opaque)
+{
+    virNetServerParallelPtr par;
+    size_t nhelpers = 0;
+    size_t i;
+
+    if (nitems == 0)
+        return 0;
+
+    if (VIR_ALLOC(par) < 0)
+        return -1;
+
+    if (virMutexInit(&par->lock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        VIR_FREE(par);
+        return -1;
+    }
+
+    if (virCondInit(&par->cond) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init condition variable"));
+        virMutexDestroy(&par->lock);
+        VIR_FREE(par);
+        return -1;
+    }
+
+    par->refs = 1;
+    par->nitems = nitems;
+    par->func = func;
+    par->opaque = opaque;
+
+    virObjectLock(srv);
+    if (srv->workers)
+        nhelpers = MIN(nitems - 1, virThreadPoolGetMaxWorkers(srv->workers));
+
+    for (i = 0; i < nhelpers; i++) {
+        virNetServerJobPtr job;
+
+        /* Not being able to queue a helper only costs parallelism */
+        if (VIR_ALLOC_QUIET(job) < 0)
+            break;
+
+        job->client = virObjectRef(client);
+        job->parallel = par;
+
+        virMutexLock(&par->lock);
+        par->refs++;
+        virMutexUnlock(&par->lock);
+
+        if (virThreadPoolSendJobFull(srv->workers, 0, client, job) < 0) {
+            virResetLastError();
+            virNetServerParallelUnref(par);
+            virObjectUnref(client);
+            VIR_FREE(job);
+            break;
+        }
+    }
+    virObjectUnlock(srv);
+
+    VIR_DEBUG("server=%p client=%p nitems=%zu nhelpers=%zu",
+              srv, client, nitems, i);
+
+    virNetServerParallelWork(par);
+
+    virMutexLock(&par->lock);
+    while (par->ndone < par->nitems)
+        ignore_value(virCondWait(&par->cond, &par->lock));
+    virMutexUnlock(&par->lock);
+
+    virNetServerParallelUnref(par);
+    return 0;
+}
+
 /**
  * virNetServerCheckLimits:
  * @srv: server to check limits on
@@ -281,6 +448,16 @@ int virNetServerAddClient(virNetServerPtr srv,
     if (virNetServerClientInit(client) < 0)
         goto error;
 
+    if (srv->workers &&
+        virThreadPoolSetOwnerWeight(srv->workers, client,
+                                    virNetServerClientGetReadonly(client) ?
+                                    srv->readonlyClientWeight :
+                                    srv->clientWeight) < 0)
+        goto error;
+
+    virNetServerClientSetTxLimits(client, srv->clientTxMaxMessages,
+                                  srv->clientTxMaxBytes);
+
     if (VIR_EXPAND_N(srv->clients, srv->nclients, 1) < 0)
         goto error;
     srv->clients[srv->nclients-1] = virObjectRef(client);
@@ -376,6 +553,8 @@ virNetServerPtr virNetServerNew(const char *name,
     srv->nclients_unauth_max = max_anonymous_clients;
     srv->keepaliveInterval = keepaliveInterval;
     srv->keepaliveCount = keepaliveCount;
+    srv->clientWeight = 1;
+    srv->readonlyClientWeight = 1;
     srv->clientPrivNew = clientPrivNew;
     srv->clientPrivPreExecRestart = clientPrivPreExecRestart;
     srv->clientPrivFree = clientPrivFree;
@@ -414,6 +593,7 @@ virNetServerPtr virNetServerNewPostExecRestart(virJSONValuePtr object,
     unsigned int min_workers;
     unsigned int max_workers;
     unsigned int priority_workers;
+    unsigned int target_latency = 0;
     unsigned int max_clients;
     unsigned int max_anonymous_clients;
     unsigned int keepaliveInterval;
@@ -436,6 +616,13 @@ virNetServerPtr virNetServerNewPostExecRestart(virJSONValuePtr object,
                        _("Missing priority_workers data in JSON document"));
         goto error;
     }
+    if (virJSONValueObjectHasKey(object, "target_latency") &&
+        virJSONValueObjectGetNumberUint(object, "target_latency",
+                                        &target_latency) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Malformed target_latency data in JSON document"));
+        goto error;
+    }
     if (virJSONValueObjectGetNumberUint(object, "max_clients", &max_clients) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Missing max_clients data in JSON document"));
@@ -485,6 +672,11 @@ virNetServerPtr virNetServerNewPostExecRestart(virJSONValuePtr object,
                                 clientPrivFree, clientPrivOpaque)))
         goto error;
 
+    if (target_latency &&
+        virNetServerSetThreadPoolParameters(srv, -1, -1, -1,
+                                            target_latency) < 0)
+        goto error;
+
     if (!(services = virJSONValueObjectGet(object, "services"))) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Missing services data in JSON document"));
@@ -593,6 +785,14 @@ virJSONValuePtr virNetServerPreExecRestart(virNetServerPtr srv)
                        _("Cannot set priority_workers data in JSON document"));
         goto error;
     }
+    /* Only saved when set, for the sake of older daemons */
+    if (virThreadPoolGetTargetLatency(srv->workers) &&
+        virJSONValueObjectAppendNumberUint(object, "target_latency",
+                                           virThreadPoolGetTargetLatency(srv->workers)) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Cannot set target_latency data in JSON document"));
+        goto error;
+    }
     if (virJSONValueObjectAppendNumberUint(object, "max_clients", srv->nclients_max) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Cannot set max_clients data in JSON document"));
@@ -734,6 +934,53 @@ int virNetServerSetTLSContext(virNetServerPtr srv,
     srv->tls = virObjectRef(tls);
     return 0;
 }
+
+
+/**
+ * virNetServerGetTLSHandshakeStats:
+ * @srv: server
+ * @full: filled with the number of full handshakes
+ * @resumed: filled with the number of handshakes resuming a session
+ *
+ * Sum up the TLS handshakes completed by clients of all the services
+ * of @srv.
+ *
+ * Returns true if any of the services uses TLS, false otherwise.
+ */
+bool virNetServerGetTLSHandshakeStats(virNetServerPtr srv,
+                                      unsigned long long *full,
+                                      unsigned long long *resumed)
+{
+    bool ret = false;
+    size_t i, j;
+
+    *full = *resumed = 0;
+
+    virObjectLock(srv);
+    for (i = 0; i < srv->nservices; i++) {
+        virNetTLSContextPtr tls;
+        unsigned long long f, r;
+
+        if (!(tls = virNetServerServiceGetTLSContext(srv->services[i])))
+            continue;
+
+        /* Services may share a context */
+        for (j = 0; j < i; j++) {
+            if (virNetServerServiceGetTLSContext(srv->services[j]) == tls)
+                break;
+        }
+        if (j < i)
+            continue;
+
+        virNetTLSContextGetHandshakeStats(tls, &f, &r);
+        *full += f;
+        *resumed += r;
+        ret = true;
+    }
+    virObjectUnlock(srv);
+
+    return ret;
+}
 #endif
 
 
@@ -892,6 +1139,9 @@ virNetServerProcessClients(virNetServerPtr srv)
             virNetServerSetClientAuthCompletedLocked(srv, client);
             virObjectUnlock(client);
 
+            if (srv->workers)
+                virThreadPoolForgetOwner(srv->workers, client);
+
             virNetServerCheckLimits(srv);
 
             virObjectUnlock(srv);
@@ -925,6 +1175,68 @@ virNetServerGetName(virNetServerPtr srv)
     return srv->name;
 }
 
+/**
+ * virNetServerGetProcStats:
+ * @srv: the server
+ * @stats: filled with the statistics
+ * @nstats: filled with the number of elements in @stats
+ *
+ * Collect the call counts and latency histograms of all procedures of
+ * all programs of @srv which have been called at least once since the
+ * statistics were last reset.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetServerGetProcStats(virNetServerPtr srv,
+                         virNetServerProgramProcStatsPtr *stats,
+                         size_t *nstats)
+{
+    size_t i;
+    int ret = -1;
+
+    *stats = NULL;
+    *nstats = 0;
+
+    virObjectLock(srv);
+    for (i = 0; i < srv->nprograms; i++) {
+        if (virNetServerProgramGetProcStats(srv->programs[i],
+                                            stats, nstats) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virObjectUnlock(srv);
+    if (ret < 0) {
+        VIR_FREE(*stats);
+        *nstats = 0;
+    }
+    return ret;
+}
+
+/**
+ * virNetServerResetProcStats:
+ * @srv: the server
+ * @stats: statistics read by virNetServerGetProcStats()
+ * @nstats: number of elements in @stats
+ *
+ * Clear the statistics of @srv by subtracting @stats from them, so
+ * that calls which finished after they were read are kept.
+ */
+void
+virNetServerResetProcStats(virNetServerPtr srv,
+                           virNetServerProgramProcStatsPtr stats,
+                           size_t nstats)
+{
+    size_t i;
+
+    virObjectLock(srv);
+    for (i = 0; i < srv->nprograms; i++)
+        virNetServerProgramResetProcStats(srv->programs[i], stats, nstats);
+    virObjectUnlock(srv);
+}
+
 int
 virNetServerGetThreadPoolParameters(virNetServerPtr srv,
                                     size_t *minWorkers,
@@ -932,7 +1244,11 @@ virNetServerGetThreadPoolParameters(virNetServerPtr srv,
                                     size_t *nWorkers,
                                     size_t *freeWorkers,
                                     size_t *nPrioWorkers,
-                                    size_t *jobQueueDepth)
+                                    size_t *jobQueueDepth,
+                                    unsigned long long *targetLatency,
+                                    unsigned long long *latency,
+                                    size_t *workersAdded,
+                                    size_t *workersRemoved)
 {
     virObjectLock(srv);
 
@@ -942,6 +1258,10 @@ virNetServerGetThreadPoolParameters(virNetServerPtr srv,
     *nWorkers = virThreadPoolGetCurrentWorkers(srv->workers);
     *nPrioWorkers = virThreadPoolGetPriorityWorkers(srv->workers);
     *jobQueueDepth = virThreadPoolGetJobQueueDepth(srv->workers);
+    *targetLatency = virThreadPoolGetTargetLatency(srv->workers);
+    *latency = virThreadPoolGetLatency(srv->workers);
+    *workersAdded = virThreadPoolGetWorkersAdded(srv->workers);
+    *workersRemoved = virThreadPoolGetWorkersRemoved(srv->workers);
 
     virObjectUnlock(srv);
     return 0;
@@ -951,13 +1271,15 @@ int
 virNetServerSetThreadPoolParameters(virNetServerPtr srv,
                                     long long int minWorkers,
                                     long long int maxWorkers,
-                                    long long int prioWorkers)
+                                    long long int prioWorkers,
+                                    long long int targetLatency)
 {
     int ret;
 
     virObjectLock(srv);
     ret = virThreadPoolSetParameters(srv->workers, minWorkers,
-                                     maxWorkers, prioWorkers);
+                                     maxWorkers, prioWorkers,
+                                     targetLatency);
     virObjectUnlock(srv);
 
     return ret;
@@ -1098,3 +1420,111 @@ virNetServerSetClientLimits(virNetServerPtr srv,
     virObjectUnlock(srv);
     return ret;
 }
+
+/**
+ * virNetServerSetClientWeights:
+ * @srv: the server
+ * @weight: share of worker time of clients
+ * @readonlyWeight: share of worker time of read-only clients
+ *
+ * When several clients have calls waiting for a worker, each of them
+ * gets worker time in proportion to its weight. The weights apply to
+ * clients connecting from now on.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetServerSetClientWeights(virNetServerPtr srv,
+                             unsigned int weight,
+                             unsigned int readonlyWeight)
+{
+    if (weight == 0 || readonlyWeight == 0) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("client weights must be greater than zero"));
+        return -1;
+    }
+
+    virObjectLock(srv);
+    srv->clientWeight = weight;
+    srv->readonlyClientWeight = readonlyWeight;
+    virObjectUnlock(srv);
+
+    return 0;
+}
+
+/**
+ * virNetServerGetClientTxLimits:
+ * @srv: the server
+ * @maxMessages: filled with the limit on queued messages per client
+ * @maxBytes: filled with the limit on their size
+ *
+ * Report the limits set by virNetServerSetClientTxLimits.
+ */
+void
+virNetServerGetClientTxLimits(virNetServerPtr srv,
+                              size_t *maxMessages,
+                              size_t *maxBytes)
+{
+    virObjectLock(srv);
+    *maxMessages = srv->clientTxMaxMessages;
+    *maxBytes = srv->clientTxMaxBytes;
+    virObjectUnlock(srv);
+}
+
+/**
+ * virNetServerSetClientTxLimits:
+ * @srv: the server
+ * @maxMessages: limit on queued messages per client, -1 to keep it
+ * @maxBytes: limit on their size, -1 to keep it
+ *
+ * Bound the queue of messages waiting to be sent to each client of
+ * @srv, 0 meaning no limit. Once a client reaches a limit, the high
+ * rate events sent to it are coalesced or dropped, and it gets
+ * disconnected if that's not enough. The limits apply to existing
+ * clients too.
+ */
+void
+virNetServerSetClientTxLimits(virNetServerPtr srv,
+                              long long int maxMessages,
+                              long long int maxBytes)
+{
+    size_t i;
+
+    virObjectLock(srv);
+
+    if (maxMessages >= 0)
+        srv->clientTxMaxMessages = maxMessages;
+    if (maxBytes >= 0)
+        srv->clientTxMaxBytes = maxBytes;
+
+    for (i = 0; i < srv->nclients; i++)
+        virNetServerClientSetTxLimits(srv->clients[i],
+                                      srv->clientTxMaxMessages,
+                                      srv->clientTxMaxBytes);
+
+    virObjectUnlock(srv);
+}
+
+/**
+ * virNetServerGetClientJobStats:
+ * @srv: the server
+ * @client: one of the clients of @srv
+ * @stats: filled with the statistics of the calls of @client
+ *
+ * Report the weight of @client along with how many of its calls are
+ * waiting for a worker or being run, and how long they waited.
+ */
+void
+virNetServerGetClientJobStats(virNetServerPtr srv,
+                              virNetServerClientPtr client,
+                              virThreadPoolOwnerStatsPtr stats)
+{
+    virObjectLock(srv);
+    if (srv->workers) {
+        virThreadPoolGetOwnerStats(srv->workers, client, stats);
+    } else {
+        memset(stats, 0, sizeof(*stats));
+        stats->weight = 1;
+    }
+    virObjectUnlock(srv);
+}
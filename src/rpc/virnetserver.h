@@ -32,6 +32,7 @@
 # include "virnetserverservice.h"
 # include "virobject.h"
 # include "virjson.h"
+# include "virthreadpool.h"
 
 
 virNetServerPtr virNetServerNew(const char *name,
@@ -74,6 +75,9 @@ int virNetServerAddProgram(virNetServerPtr srv,
 # if WITH_GNUTLS
 int virNetServerSetTLSContext(virNetServerPtr srv,
                               virNetTLSContextPtr tls);
+bool virNetServerGetTLSHandshakeStats(virNetServerPtr srv,
+                                      unsigned long long *full,
+                                      unsigned long long *resumed);
 # endif
 
 
@@ -89,18 +93,30 @@ int virNetServerStart(virNetServerPtr srv);
 
 const char *virNetServerGetName(virNetServerPtr srv);
 
+int virNetServerGetProcStats(virNetServerPtr srv,
+                             virNetServerProgramProcStatsPtr *stats,
+                             size_t *nstats);
+void virNetServerResetProcStats(virNetServerPtr srv,
+                                virNetServerProgramProcStatsPtr stats,
+                                size_t nstats);
+
 int virNetServerGetThreadPoolParameters(virNetServerPtr srv,
                                         size_t *minWorkers,
                                         size_t *maxWorkers,
                                         size_t *nWorkers,
                                         size_t *freeWorkers,
                                         size_t *nPrioWorkers,
-                                        size_t *jobQueueDepth);
+                                        size_t *jobQueueDepth,
+                                        unsigned long long *targetLatency,
+                                        unsigned long long *latency,
+                                        size_t *workersAdded,
+                                        size_t *workersRemoved);
 
 int virNetServerSetThreadPoolParameters(virNetServerPtr srv,
                                         long long int minWorkers,
                                         long long int maxWorkers,
-                                        long long int prioWorkers);
+                                        long long int prioWorkers,
+                                        long long int targetLatency);
 
 unsigned long long virNetServerNextClientID(virNetServerPtr srv);
 
@@ -119,4 +135,28 @@ int virNetServerSetClientLimits(virNetServerPtr srv,
                                 long long int maxClients,
                                 long long int maxClientsUnauth);
 
+int virNetServerSetClientWeights(virNetServerPtr srv,
+                                 unsigned int weight,
+                                 unsigned int readonlyWeight);
+
+void virNetServerGetClientTxLimits(virNetServerPtr srv,
+                                   size_t *maxMessages,
+                                   size_t *maxBytes);
+void virNetServerSetClientTxLimits(virNetServerPtr srv,
+                                   long long int maxMessages,
+                                   long long int maxBytes);
+
+void virNetServerGetClientJobStats(virNetServerPtr srv,
+                                   virNetServerClientPtr client,
+                                   virThreadPoolOwnerStatsPtr stats);
+
+typedef void (*virNetServerParallelFunc)(size_t item,
+                                         void *opaque);
+
+int virNetServerRunParallel(virNetServerPtr srv,
+                            virNetServerClientPtr client,
+                            size_t nitems,
+                            virNetServerParallelFunc func,
+                            void *opaque);
+
 #endif /* __VIR_NET_SERVER_H__ */
@@ -36,6 +36,7 @@
 #include "viralloc.h"
 #include "virthread.h"
 #include "virkeepalive.h"
+#include "virkeepaliveprotocol.h"
 #include "virprobe.h"
 #include "virstring.h"
 #include "virutil.h"
@@ -106,6 +107,16 @@ struct _virNetServerClient
     /* Zero or many messages waiting for transmit
      * back to client, including async events */
     virNetMessagePtr tx;
+    size_t txMessages;
+    size_t txBytes;
+
+    /* Limits on the 'tx' queue enforced when queueing
+     * async events, 0 if unlimited, along with what was
+     * done to keep within them */
+    size_t txMaxMessages;
+    size_t txMaxBytes;
+    unsigned long long txCoalesced;
+    unsigned long long txDropped;
 
     /* Filters to capture messages that would otherwise
      * end up on the 'dx' queue */
@@ -121,6 +132,14 @@ struct _virNetServerClient
     virNetServerClientCloseFunc privateDataCloseFunc;
 
     virKeepAlivePtr keepalive;
+
+    /* Whether the client accepts VIR_NET_REPLY_COMPRESSED */
+    bool compression;
+
+    /* Shared memory channel to switch to once the successful
+     * reply to the call identified by shmHeader was sent */
+    virNetShmChannelPtr shm;
+    virNetMessageHeader shmHeader;
 };
 
 
@@ -147,6 +166,40 @@ static void virNetServerClientDispatchRead(virNetServerClientPtr client);
 static int virNetServerClientSendMessageLocked(virNetServerClientPtr client,
                                                virNetMessagePtr msg);
 
+
+static size_t
+virNetServerClientTxSize(virNetMessagePtr msg)
+{
+    return msg->bufferLength + msg->payloadLength;
+}
+
+
+/*
+ * @client: a locked client object
+ */
+static void
+virNetServerClientQueueTx(virNetServerClientPtr client,
+                          virNetMessagePtr msg)
+{
+    virNetMessageQueuePush(&client->tx, msg);
+    client->txMessages++;
+    client->txBytes += virNetServerClientTxSize(msg);
+}
+
+
+/*
+ * @client: a locked client object
+ */
+static virNetMessagePtr
+virNetServerClientServeTx(virNetServerClientPtr client)
+{
+    virNetMessagePtr msg = virNetMessageQueueServe(&client->tx);
+
+    client->txMessages--;
+    client->txBytes -= virNetServerClientTxSize(msg);
+    return msg;
+}
+
 /*
  * @client: a locked client object
  */
@@ -216,11 +269,12 @@ static int virNetServerClientRegisterEvent(virNetServerClientPtr client)
 
     virObjectRef(client);
     VIR_DEBUG("Registering client event callback %d", mode);
-    if (virNetSocketAddIOCallback(client->sock,
-                                  mode,
-                                  virNetServerClientDispatchEvent,
-                                  client,
-                                  virObjectFreeCallback) < 0) {
+    if (virNetSocketAddIOCallbackFull(client->sock,
+                                      mode,
+                                      virNetServerClientDispatchEvent,
+                                      client,
+                                      virObjectFreeCallback,
+                                      true) < 0) {
         virObjectUnref(client);
         return -1;
     }
@@ -326,15 +380,13 @@ virNetServerClientCheckAccess(virNetServerClientPtr client)
      * indicate this (otherwise the socket is abruptly closed).
      * (NB. The '\1' byte is sent in an encrypted record).
      */
-    confirm->bufferLength = 1;
-    if (VIR_ALLOC_N(confirm->buffer, confirm->bufferLength) < 0) {
+    if (virNetMessageAllocBuffer(confirm, 1) < 0) {
         virNetMessageFree(confirm);
         return -1;
     }
-    confirm->bufferOffset = 0;
     confirm->buffer[0] = '\1';
 
-    client->tx = confirm;
+    virNetServerClientQueueTx(client, confirm);
 
     return 0;
 }
@@ -411,8 +463,7 @@ virNetServerClientNewInternal(unsigned long long id,
     /* Prepare one for packet receive */
     if (!(client->rx = virNetMessageNew(true)))
         goto error;
-    client->rx->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-    if (VIR_ALLOC_N(client->rx->buffer, client->rx->bufferLength) < 0)
+    if (virNetMessageAllocBuffer(client->rx, VIR_NET_MESSAGE_LEN_MAX) < 0)
         goto error;
     client->nrequests = 1;
 
@@ -999,6 +1050,7 @@ void virNetServerClientDispose(void *obj)
     virObjectUnref(client->tls);
     virObjectUnref(client->tlsCtxt);
 #endif
+    virObjectUnref(client->shm);
     virObjectUnref(client->sock);
 }
 
@@ -1062,7 +1114,7 @@ virNetServerClientCloseLocked(virNetServerClientPtr client)
     }
     while (client->tx) {
         virNetMessagePtr msg
-            = virNetMessageQueueServe(&client->tx);
+            = virNetServerClientServeTx(client);
         virNetMessageFree(msg);
     }
 
@@ -1276,6 +1328,7 @@ static void virNetServerClientDispatchRead(virNetServerClientPtr client)
 
         /* Definitely finished reading, so remove from queue */
         virNetMessageQueueServe(&client->rx);
+        msg->received = virNetMessageTimestamp();
         PROBE(RPC_SERVER_CLIENT_MSG_RX,
               "client=%p len=%zu prog=%u vers=%u proc=%u type=%u status=%u serial=%u",
               client, msg->bufferLength,
@@ -1330,9 +1383,8 @@ static void virNetServerClientDispatchRead(virNetServerClientPtr client)
             if (!(client->rx = virNetMessageNew(true))) {
                 client->wantClose = true;
             } else {
-                client->rx->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-                if (VIR_ALLOC_N(client->rx->buffer,
-                                client->rx->bufferLength) < 0) {
+                if (virNetMessageAllocBuffer(client->rx,
+                                             VIR_NET_MESSAGE_LEN_MAX) < 0) {
                     client->wantClose = true;
                 } else {
                     client->nrequests++;
@@ -1355,8 +1407,11 @@ static void virNetServerClientDispatchRead(virNetServerClientPtr client)
 static ssize_t virNetServerClientWrite(virNetServerClientPtr client)
 {
     ssize_t ret;
+    struct iovec iov[2];
+    size_t niov;
 
-    if (client->tx->bufferLength < client->tx->bufferOffset) {
+    if (client->tx->bufferLength < client->tx->bufferOffset ||
+        client->tx->payloadLength < client->tx->payloadOffset) {
         virReportError(VIR_ERR_RPC,
                        _("unexpected zero/negative length request %lld"),
                        (long long int)(client->tx->bufferLength - client->tx->bufferOffset));
@@ -1364,16 +1419,61 @@ static ssize_t virNetServerClientWrite(virNetServerClientPtr client)
         return -1;
     }
 
-    if (client->tx->bufferLength == client->tx->bufferOffset)
+    if (!(niov = virNetMessageGetTXIOV(client->tx, iov)))
         return 1;
 
-    ret = virNetSocketWrite(client->sock,
-                            client->tx->buffer + client->tx->bufferOffset,
-                            client->tx->bufferLength - client->tx->bufferOffset);
+    ret = virNetSocketWritev(client->sock, iov, niov);
     if (ret <= 0)
         return ret; /* -1 error, 0 = egain */
 
-    client->tx->bufferOffset += ret;
+    virNetMessageAdvanceTX(client->tx, ret);
+    return ret;
+}
+
+
+/*
+ * Switch to the pending shared memory channel if client->tx, which
+ * was just sent, is the reply handing it out.
+ *
+ * @client: a locked client object
+ *
+ * Returns 0 on success, -1 if the client must be closed.
+ */
+static int
+virNetServerClientSwitchToShm(virNetServerClientPtr client)
+{
+    virNetMessageHeaderPtr hdr = &client->tx->header;
+    int ret = -1;
+
+    if (hdr->prog != client->shmHeader.prog ||
+        hdr->vers != client->shmHeader.vers ||
+        hdr->proc != client->shmHeader.proc ||
+        hdr->serial != client->shmHeader.serial ||
+        (hdr->type != VIR_NET_REPLY && hdr->type != VIR_NET_REPLY_WITH_FDS))
+        return 0;
+
+    if (hdr->status != VIR_NET_OK) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    /* The client must not send anything until it got the reply */
+    if (client->rx && client->rx->bufferOffset != 0) {
+        virReportError(VIR_ERR_RPC, "%s",
+                       _("client sent data while switching to shared memory"));
+        goto cleanup;
+    }
+
+    if (virNetSocketSetShmChannel(client->sock, client->shm) < 0)
+        goto cleanup;
+
+    VIR_DEBUG("client=%p switched to shared memory channel %p",
+              client, client->shm);
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(client->shm);
+    client->shm = NULL;
     return ret;
 }
 
@@ -1386,7 +1486,7 @@ static void
 virNetServerClientDispatchWrite(virNetServerClientPtr client)
 {
     while (client->tx) {
-        if (client->tx->bufferOffset < client->tx->bufferLength) {
+        if (!virNetMessageIsTXComplete(client->tx)) {
             ssize_t ret;
             ret = virNetServerClientWrite(client);
             if (ret < 0) {
@@ -1397,7 +1497,7 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
                 return; /* Would block on write EAGAIN */
         }
 
-        if (client->tx->bufferOffset == client->tx->bufferLength) {
+        if (virNetMessageIsTXComplete(client->tx)) {
             virNetMessagePtr msg;
             size_t i;
 
@@ -1412,6 +1512,14 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
                 client->tx->donefds++;
             }
 
+            /* Completed the reply handing out the shared memory
+             * channel, so everything else goes through it */
+            if (client->shm &&
+                virNetServerClientSwitchToShm(client) < 0) {
+                client->wantClose = true;
+                return;
+            }
+
 #if WITH_SASL
             /* Completed this 'tx' operation, so now read for all
              * future rx/tx to be under a SASL SSF layer
@@ -1424,7 +1532,7 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
 #endif
 
             /* Get finished msg from head of tx queue */
-            msg = virNetMessageQueueServe(&client->tx);
+            msg = virNetServerClientServeTx(client);
 
             if (msg->tracked) {
                 client->nrequests--;
@@ -1433,8 +1541,8 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
                     client->nrequests < client->nrequests_max) {
                     /* Ready to recv more messages */
                     virNetMessageClear(msg);
-                    msg->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-                    if (VIR_ALLOC_N(msg->buffer, msg->bufferLength) < 0) {
+                    if (virNetMessageAllocBuffer(msg,
+                                                 VIR_NET_MESSAGE_LEN_MAX) < 0) {
                         virNetMessageFree(msg);
                         return;
                     }
@@ -1522,23 +1630,112 @@ virNetServerClientDispatchEvent(virNetSocketPtr sock, int events, void *opaque)
 }
 
 
+/*
+ * Look for a queued message superseded by @msg, skipping the one
+ * being sent, and take it off the 'tx' queue.
+ *
+ * @client: a locked client object
+ */
+static virNetMessagePtr
+virNetServerClientTakeSuperseded(virNetServerClientPtr client,
+                                 virNetMessagePtr msg)
+{
+    virNetMessagePtr prev;
+    virNetMessagePtr tmp;
+
+    if (!msg->coalesceKey || !client->tx)
+        return NULL;
+
+    for (prev = client->tx, tmp = prev->next; tmp;
+         prev = tmp, tmp = tmp->next) {
+        if (STREQ_NULLABLE(tmp->coalesceKey, msg->coalesceKey)) {
+            prev->next = tmp->next;
+            tmp->next = NULL;
+            client->txMessages--;
+            client->txBytes -= virNetServerClientTxSize(tmp);
+            return tmp;
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Keep the 'tx' queue within its limits when @msg is about to be
+ * queued. Only async events are held to the limits, as replies are
+ * throttled by nrequests_max already. An event replaces a queued
+ * one it supersedes, or is dropped if it could have been superseded
+ * itself. Any other event means the client fell too far behind to
+ * be of any use, and it gets disconnected.
+ *
+ * @client: a locked client object
+ *
+ * Returns 1 if @msg can be queued, 0 if it was dropped and -1 if
+ * the client is going to be closed.
+ */
+static int
+virNetServerClientCheckTxLimits(virNetServerClientPtr client,
+                                virNetMessagePtr msg)
+{
+    virNetMessagePtr old;
+
+    if (msg->tracked ||
+        msg->header.type != VIR_NET_MESSAGE ||
+        msg->header.prog == KEEPALIVE_PROGRAM)
+        return 1;
+
+    if ((!client->txMaxMessages ||
+         client->txMessages < client->txMaxMessages) &&
+        (!client->txMaxBytes ||
+         client->txBytes + virNetServerClientTxSize(msg) <= client->txMaxBytes))
+        return 1;
+
+    if ((old = virNetServerClientTakeSuperseded(client, msg))) {
+        VIR_DEBUG("client=%p msg=%p supersedes msg=%p key=%s",
+                  client, msg, old, msg->coalesceKey);
+        virNetMessageFree(old);
+        client->txCoalesced++;
+        return 1;
+    }
+
+    if (msg->coalesceKey) {
+        VIR_DEBUG("client=%p dropping msg=%p key=%s",
+                  client, msg, msg->coalesceKey);
+        virNetMessageFree(msg);
+        client->txDropped++;
+        return 0;
+    }
+
+    VIR_WARN("Closing client %llu which has %zu messages and %zu bytes "
+             "waiting for transmit", client->id,
+             client->txMessages, client->txBytes);
+    client->wantClose = true;
+    return -1;
+}
+
+
 static int
 virNetServerClientSendMessageLocked(virNetServerClientPtr client,
                                     virNetMessagePtr msg)
 {
     int ret = -1;
+    int rc;
     VIR_DEBUG("msg=%p proc=%d len=%zu offset=%zu",
               msg, msg->header.proc,
               msg->bufferLength, msg->bufferOffset);
 
     msg->donefds = 0;
     if (client->sock && !client->wantClose) {
+        if ((rc = virNetServerClientCheckTxLimits(client, msg)) <= 0)
+            return rc;
+
         PROBE(RPC_SERVER_CLIENT_MSG_TX_QUEUE,
               "client=%p len=%zu prog=%u vers=%u proc=%u type=%u status=%u serial=%u",
               client, msg->bufferLength,
               msg->header.prog, msg->header.vers, msg->header.proc,
               msg->header.type, msg->header.status, msg->header.serial);
-        virNetMessageQueuePush(&client->tx, msg);
+        virNetServerClientQueueTx(client, msg);
 
         virNetServerClientUpdateEvent(client);
         ret = 0;
@@ -1552,6 +1749,19 @@ int virNetServerClientSendMessage(virNetServerClientPtr client,
 {
     int ret;
 
+    /* Compress outside of the lock, as large replies take a while */
+    if (msg->header.type == VIR_NET_REPLY) {
+        bool compression;
+
+        virObjectLock(client);
+        compression = client->compression;
+        virObjectUnlock(client);
+
+        if (compression &&
+            virNetMessageCompressPayload(msg) < 0)
+            VIR_WARN("Unable to compress reply, sending it uncompressed");
+    }
+
     virObjectLock(client);
     ret = virNetServerClientSendMessageLocked(client, msg);
     virObjectUnlock(client);
@@ -1651,6 +1861,80 @@ virNetServerClientStartKeepAlive(virNetServerClientPtr client)
     return ret;
 }
 
+/*
+ * Make the server send compressed replies to @client from now on,
+ * if the daemon supports it.
+ *
+ * Returns true if compression was enabled, false otherwise.
+ */
+bool
+virNetServerClientEnableCompression(virNetServerClientPtr client)
+{
+    if (!virNetMessageCompressionIsSupported())
+        return false;
+
+    virObjectLock(client);
+    client->compression = true;
+    virObjectUnlock(client);
+
+    return true;
+}
+
+/*
+ * Whether @client could switch to a shared memory channel.
+ */
+bool
+virNetServerClientCanUseShm(virNetServerClientPtr client)
+{
+    bool ret = false;
+
+    virObjectLock(client);
+    if (client->sock && !client->shm &&
+#if WITH_GNUTLS
+        !client->tls &&
+#endif
+#if WITH_SASL
+        !client->sasl &&
+#endif
+        virNetSocketCanUseShm(client->sock))
+        ret = true;
+    virObjectUnlock(client);
+
+    return ret;
+}
+
+
+/**
+ * virNetServerClientSetShmChannel:
+ * @client: the client
+ * @msg: the call handing out @chan
+ * @chan: the shared memory channel
+ *
+ * Make @client switch to @chan as soon as a successful reply
+ * to @msg was sent. Nothing changes if the call fails.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetServerClientSetShmChannel(virNetServerClientPtr client,
+                                virNetMessagePtr msg,
+                                virNetShmChannelPtr chan)
+{
+    if (!virNetServerClientCanUseShm(client)) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("client cannot use a shared memory channel"));
+        return -1;
+    }
+
+    virObjectLock(client);
+    client->shm = virObjectRef(chan);
+    client->shmHeader = msg->header;
+    virObjectUnlock(client);
+
+    return 0;
+}
+
+
 int
 virNetServerClientGetTransport(virNetServerClientPtr client)
 {
@@ -1719,3 +2003,45 @@ virNetServerClientSetQuietEOF(virNetServerClientPtr client)
 {
     virNetSocketSetQuietEOF(client->sock);
 }
+
+
+/**
+ * virNetServerClientSetTxLimits:
+ * @client: the client
+ * @maxMessages: upper limit on queued messages, 0 if unlimited
+ * @maxBytes: upper limit on the size of queued messages, 0 if unlimited
+ *
+ * Bound the queue of messages waiting to be sent to @client, in case
+ * it doesn't keep up with the async events it asked for.
+ */
+void
+virNetServerClientSetTxLimits(virNetServerClientPtr client,
+                              size_t maxMessages,
+                              size_t maxBytes)
+{
+    virObjectLock(client);
+    client->txMaxMessages = maxMessages;
+    client->txMaxBytes = maxBytes;
+    virObjectUnlock(client);
+}
+
+
+/**
+ * virNetServerClientGetTxStats:
+ * @client: the client
+ * @stats: filled with the statistics of @client
+ *
+ * Report what is waiting to be sent to @client and how many events
+ * were coalesced or dropped to keep within its limits.
+ */
+void
+virNetServerClientGetTxStats(virNetServerClientPtr client,
+                             virNetServerClientTxStatsPtr stats)
+{
+    virObjectLock(client);
+    stats->messages = client->txMessages;
+    stats->bytes = client->txBytes;
+    stats->coalesced = client->txCoalesced;
+    stats->dropped = client->txDropped;
+    virObjectUnlock(client);
+}
@@ -36,6 +36,16 @@ typedef virNetServer *virNetServerPtr;
 typedef struct _virNetServerClient virNetServerClient;
 typedef virNetServerClient *virNetServerClientPtr;
 
+typedef struct _virNetServerClientTxStats virNetServerClientTxStats;
+typedef virNetServerClientTxStats *virNetServerClientTxStatsPtr;
+
+struct _virNetServerClientTxStats {
+    size_t messages;                /* Messages waiting for transmit */
+    size_t bytes;                   /* Their total size */
+    unsigned long long coalesced;   /* Events superseded by newer ones */
+    unsigned long long dropped;     /* Events dropped at the limits */
+};
+
 typedef int (*virNetServerClientDispatchFunc)(virNetServerClientPtr client,
                                               virNetMessagePtr msg,
                                               void *opaque);
@@ -158,6 +168,12 @@ int virNetServerClientInitKeepAlive(virNetServerClientPtr client,
 bool virNetServerClientCheckKeepAlive(virNetServerClientPtr client,
                                       virNetMessagePtr msg);
 int virNetServerClientStartKeepAlive(virNetServerClientPtr client);
+bool virNetServerClientEnableCompression(virNetServerClientPtr client);
+
+bool virNetServerClientCanUseShm(virNetServerClientPtr client);
+int virNetServerClientSetShmChannel(virNetServerClientPtr client,
+                                    virNetMessagePtr msg,
+                                    virNetShmChannelPtr chan);
 
 const char *virNetServerClientLocalAddrStringSASL(virNetServerClientPtr client);
 const char *virNetServerClientRemoteAddrStringSASL(virNetServerClientPtr client);
@@ -177,4 +193,10 @@ int virNetServerClientGetInfo(virNetServerClientPtr client,
 
 void virNetServerClientSetQuietEOF(virNetServerClientPtr client);
 
+void virNetServerClientSetTxLimits(virNetServerClientPtr client,
+                                   size_t maxMessages,
+                                   size_t maxBytes);
+void virNetServerClientGetTxStats(virNetServerClientPtr client,
+                                  virNetServerClientTxStatsPtr stats);
+
 #endif /* __VIR_NET_SERVER_CLIENT_H__ */
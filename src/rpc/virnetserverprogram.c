@@ -23,8 +23,9 @@
 
 #include <config.h>
 
-#include "virnetserverprogram.h"
+#include "virnetserverprogrampriv.h"
 #include "virnetserverclient.h"
+#include "virnetserverreplycache.h"
 
 #include "viralloc.h"
 #include "virerror.h"
@@ -43,6 +44,12 @@ struct _virNetServerProgram {
     unsigned version;
     virNetServerProgramProcPtr procs;
     size_t nprocs;
+
+    virNetServerReplyCachePtr replyCache;
+
+    /* Updated by every worker finishing a call, so the counters are
+     * only ever accessed atomically rather than under a lock */
+    virNetServerProgramProcStatsPtr stats;  /* Indexed like procs */
 };
 
 
@@ -76,6 +83,11 @@ virNetServerProgramPtr virNetServerProgramNew(unsigned program,
     if (!(prog = virObjectNew(virNetServerProgramClass)))
         return NULL;
 
+    if (VIR_ALLOC_N(prog->stats, nprocs) < 0) {
+        virObjectUnref(prog);
+        return NULL;
+    }
+
     prog->program = program;
     prog->version = version;
     prog->procs = procs;
@@ -87,6 +99,23 @@ virNetServerProgramPtr virNetServerProgramNew(unsigned program,
 }
 
 
+/**
+ * virNetServerProgramSetReplyCache:
+ * @prog: the program
+ * @cache: the reply cache to use, or NULL
+ *
+ * Make the replies of procedures marked cacheable be served from, and
+ * stored into, @cache. Must be called before the program is added to
+ * a server.
+ */
+void virNetServerProgramSetReplyCache(virNetServerProgramPtr prog,
+                                      virNetServerReplyCachePtr cache)
+{
+    virObjectUnref(prog->replyCache);
+    prog->replyCache = virObjectRef(cache);
+}
+
+
 int virNetServerProgramGetID(virNetServerProgramPtr prog)
 {
     return prog->program;
@@ -139,6 +168,168 @@ virNetServerProgramGetPriority(virNetServerProgramPtr prog,
     return proc->priority;
 }
 
+
+size_t
+virNetServerProgramLatencyBucket(unsigned long long latency)
+{
+    size_t bucket = 0;
+
+    while (latency && bucket < VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS - 1) {
+        latency >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+
+static void
+virNetServerProgramStatsAdd(unsigned long long *counter,
+                            unsigned long long val)
+{
+    ignore_value(__sync_fetch_and_add(counter, val));
+}
+
+
+static void
+virNetServerProgramStatsSub(unsigned long long *counter,
+                            unsigned long long val)
+{
+    ignore_value(__sync_fetch_and_sub(counter, val));
+}
+
+
+static unsigned long long
+virNetServerProgramStatsGet(unsigned long long *counter)
+{
+    return __sync_fetch_and_add(counter, 0);
+}
+
+
+/*
+ * Account a call of @procedure which was read at @received, picked
+ * up by a worker at @start and finished at @end.
+ */
+void
+virNetServerProgramRecordCall(virNetServerProgramPtr prog,
+                              int procedure,
+                              unsigned long long received,
+                              unsigned long long start,
+                              unsigned long long end)
+{
+    virNetServerProgramProcStatsPtr stats;
+    unsigned long long wait = 0;
+    unsigned long long exec = 0;
+    size_t waitBucket;
+    size_t execBucket;
+
+    if (procedure < 0 || procedure >= prog->nprocs)
+        return;
+
+    /* The clock is not supposed to go backwards, but be careful
+     * not to account a huge latency if it ever does */
+    if (received && start > received)
+        wait = start - received;
+    if (end > start)
+        exec = end - start;
+
+    waitBucket = virNetServerProgramLatencyBucket(wait);
+    execBucket = virNetServerProgramLatencyBucket(exec);
+
+    stats = &prog->stats[procedure];
+    virNetServerProgramStatsAdd(&stats->waitTotal, wait);
+    virNetServerProgramStatsAdd(&stats->execTotal, exec);
+    virNetServerProgramStatsAdd(&stats->wait[waitBucket], 1);
+    virNetServerProgramStatsAdd(&stats->exec[execBucket], 1);
+    virNetServerProgramStatsAdd(&stats->calls, 1);
+}
+
+
+/**
+ * virNetServerProgramGetProcStats:
+ * @prog: the program
+ * @stats: array to append the statistics to
+ * @nstats: number of elements in @stats
+ *
+ * Append the call counts and latency histograms of every procedure
+ * of @prog which has been called at least once to @stats.
+ *
+ * The counters are read one by one while calls keep finishing, so
+ * the histograms may already account a few calls more than @calls.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetServerProgramGetProcStats(virNetServerProgramPtr prog,
+                                virNetServerProgramProcStatsPtr *stats,
+                                size_t *nstats)
+{
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < prog->nprocs; i++) {
+        virNetServerProgramProcStatsPtr cur = &prog->stats[i];
+        virNetServerProgramProcStats tmp;
+
+        memset(&tmp, 0, sizeof(tmp));
+        if (!(tmp.calls = virNetServerProgramStatsGet(&cur->calls)))
+            continue;
+
+        tmp.program = prog->program;
+        tmp.procedure = i;
+        tmp.name = prog->procs[i].name;
+        tmp.waitTotal = virNetServerProgramStatsGet(&cur->waitTotal);
+        tmp.execTotal = virNetServerProgramStatsGet(&cur->execTotal);
+        for (j = 0; j < VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS; j++) {
+            tmp.wait[j] = virNetServerProgramStatsGet(&cur->wait[j]);
+            tmp.exec[j] = virNetServerProgramStatsGet(&cur->exec[j]);
+        }
+
+        if (VIR_APPEND_ELEMENT(*stats, *nstats, tmp) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virNetServerProgramResetProcStats:
+ * @prog: the program
+ * @stats: statistics read by virNetServerProgramGetProcStats()
+ * @nstats: number of elements in @stats
+ *
+ * Subtract the elements of @stats which belong to @prog from its
+ * statistics, so that they start over from zero without missing
+ * any call finishing since they were read.
+ */
+void
+virNetServerProgramResetProcStats(virNetServerProgramPtr prog,
+                                  virNetServerProgramProcStatsPtr stats,
+                                  size_t nstats)
+{
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < nstats; i++) {
+        virNetServerProgramProcStatsPtr cur;
+
+        if (stats[i].program != prog->program ||
+            stats[i].procedure < 0 ||
+            stats[i].procedure >= prog->nprocs)
+            continue;
+
+        cur = &prog->stats[stats[i].procedure];
+        virNetServerProgramStatsSub(&cur->calls, stats[i].calls);
+        virNetServerProgramStatsSub(&cur->waitTotal, stats[i].waitTotal);
+        virNetServerProgramStatsSub(&cur->execTotal, stats[i].execTotal);
+        for (j = 0; j < VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS; j++) {
+            virNetServerProgramStatsSub(&cur->wait[j], stats[i].wait[j]);
+            virNetServerProgramStatsSub(&cur->exec[j], stats[i].exec[j]);
+        }
+    }
+}
+
 static int
 virNetServerProgramSendError(unsigned program,
                              unsigned version,
@@ -279,6 +470,9 @@ int virNetServerProgramDispatch(virNetServerProgramPtr prog,
 {
     int ret = -1;
     virNetMessageError rerr;
+    int procedure;
+    unsigned long long received;
+    unsigned long long start;
 
     memset(&rerr, 0, sizeof(rerr));
 
@@ -304,7 +498,13 @@ int virNetServerProgramDispatch(virNetServerProgramPtr prog,
     switch (msg->header.type) {
     case VIR_NET_CALL:
     case VIR_NET_CALL_WITH_FDS:
+        /* @msg is gone once the call is dispatched */
+        procedure = msg->header.proc;
+        received = msg->received;
+        start = virNetMessageTimestamp();
         ret = virNetServerProgramDispatchCall(prog, server, client, msg);
+        virNetServerProgramRecordCall(prog, procedure, received, start,
+                                      virNetMessageTimestamp());
         break;
 
     case VIR_NET_STREAM:
@@ -378,6 +578,10 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
     virNetMessageError rerr;
     size_t i;
     virIdentityPtr identity = NULL;
+    char *cacheKey = NULL;
+    unsigned long long cacheGeneration = 0;
+    size_t argsOffset;
+    size_t replyOffset;
 
     memset(&rerr, 0, sizeof(rerr));
 
@@ -414,6 +618,7 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
     if (VIR_ALLOC_N(ret, dispatcher->ret_len) < 0)
         goto error;
 
+    argsOffset = msg->bufferOffset;
     if (virNetMessageDecodePayload(msg, dispatcher->arg_filter, arg) < 0)
         goto error;
 
@@ -423,6 +628,32 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
     if (virIdentitySetCurrent(identity) < 0)
         goto error;
 
+    /* The encoded arguments are still in the buffer, so
+     * they can be used to look up a cached reply */
+    if (dispatcher->cacheable && prog->replyCache && msg->nfds == 0) {
+        rv = virNetServerReplyCacheGetKey(prog->replyCache, client,
+                                          msg->header.proc,
+                                          msg->buffer + argsOffset,
+                                          msg->bufferLength - argsOffset,
+                                          &cacheKey, &cacheGeneration);
+        if (rv > 0)
+            rv = virNetServerReplyCacheLookup(prog->replyCache, cacheKey,
+                                              cacheGeneration, msg);
+
+        if (rv != 0) {
+            ignore_value(virIdentitySetCurrent(NULL));
+            xdr_free(dispatcher->arg_filter, arg);
+            if (rv < 0)
+                goto error;
+
+            VIR_FREE(arg);
+            VIR_FREE(ret);
+            VIR_FREE(cacheKey);
+            virObjectUnref(identity);
+            return virNetServerClientSendMessage(client, msg);
+        }
+    }
+
     /*
      * When the RPC handler is called:
      *
@@ -479,14 +710,24 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
         goto error;
     }
 
+    replyOffset = msg->bufferOffset;
     if (virNetMessageEncodePayload(msg, dispatcher->ret_filter, ret) < 0) {
         xdr_free(dispatcher->ret_filter, ret);
         goto error;
     }
 
+    /* Failing to cache the reply only costs performance */
+    if (cacheKey && msg->nfds == 0 &&
+        virNetServerReplyCacheStore(prog->replyCache, cacheKey,
+                                    cacheGeneration,
+                                    msg->buffer + replyOffset,
+                                    msg->bufferLength - replyOffset) < 0)
+        virResetLastError();
+
     xdr_free(dispatcher->ret_filter, ret);
     VIR_FREE(arg);
     VIR_FREE(ret);
+    VIR_FREE(cacheKey);
 
     virObjectUnref(identity);
     /* Put reply on end of tx queue to send out  */
@@ -499,22 +740,156 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
 
     VIR_FREE(arg);
     VIR_FREE(ret);
+    VIR_FREE(cacheKey);
     virObjectUnref(identity);
 
     return rv;
 }
 
 
-int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
-                                      virNetServerClientPtr client,
+/*
+ * @server: the unlocked server object
+ * @client: the unlocked client object
+ * @procedure: the procedure to invoke
+ * @args: the XDR encoded procedure arguments
+ * @nargs: length of @args
+ * @maxdata: upper limit on the length of encoded return values
+ * @data: filled with the XDR encoded result
+ * @ndata: filled with the length of @data
+ *
+ * Invoke a single call of a batch on behalf of @client. Unlike
+ * virNetServerProgramDispatchCall, there is no message to reply
+ * with, so the return values, or the error in case the call
+ * failed, are encoded into @data for the caller to embed in
+ * the reply to the whole batch. Only procedures marked for use
+ * in batches can be invoked this way.
+ *
+ * Returns VIR_NET_OK if the call succeeded, VIR_NET_ERROR if it
+ * failed and @data holds the error, or -1 upon fatal error
+ */
+int
+virNetServerProgramDispatchBatchCall(virNetServerProgramPtr prog,
+                                     virNetServerPtr server,
+                                     virNetServerClientPtr client,
+                                     int procedure,
+                                     char *args,
+                                     size_t nargs,
+                                     size_t maxdata,
+                                     char **data,
+                                     size_t *ndata)
+{
+    char *arg = NULL;
+    char *ret = NULL;
+    int rv = -1;
+    virNetServerProgramProcPtr dispatcher;
+    virNetMessageError rerr;
+    virIdentityPtr identity = NULL;
+
+    memset(&rerr, 0, sizeof(rerr));
+
+    VIR_DEBUG("prog=%d ver=%d proc=%d nargs=%zu",
+              prog->program, prog->version, procedure, nargs);
+
+    dispatcher = virNetServerProgramGetProc(prog, procedure);
+
+    if (!dispatcher) {
+        virReportError(VIR_ERR_RPC,
+                       _("unknown procedure: %d"),
+                       procedure);
+        goto error;
+    }
+
+    if (!dispatcher->batch) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                       _("procedure %d cannot be part of a batch"),
+                       procedure);
+        goto error;
+    }
+
+    if (dispatcher->needAuth &&
+        !virNetServerClientIsAuthenticated(client)) {
+        virReportError(VIR_ERR_RPC,
+                       "%s", _("authentication required"));
+        goto error;
+    }
+
+    if (VIR_ALLOC_N(arg, dispatcher->arg_len) < 0)
+        goto error;
+    if (VIR_ALLOC_N(ret, dispatcher->ret_len) < 0)
+        goto error;
+
+    if (virNetMessageDecodeData(dispatcher->arg_filter, arg, args, nargs) < 0)
+        goto error;
+
+    if (!(identity = virNetServerClientGetIdentity(client)) ||
+        virIdentitySetCurrent(identity) < 0) {
+        xdr_free(dispatcher->arg_filter, arg);
+        goto error;
+    }
+
+    /* Batchable procedures never look at the message */
+    rv = (dispatcher->func)(server, client, NULL, &rerr, arg, ret);
+
+    xdr_free(dispatcher->arg_filter, arg);
+
+    if (rv < 0) {
+        ignore_value(virIdentitySetCurrent(NULL));
+        goto error;
+    }
+
+    if (virIdentitySetCurrent(NULL) < 0) {
+        xdr_free(dispatcher->ret_filter, ret);
+        goto error;
+    }
+
+    if (virNetMessageEncodeData(dispatcher->ret_filter, ret, data, ndata) < 0) {
+        xdr_free(dispatcher->ret_filter, ret);
+        goto error;
+    }
+
+    xdr_free(dispatcher->ret_filter, ret);
+
+    if (*ndata > maxdata) {
+        virReportError(VIR_ERR_RPC,
+                       _("result of procedure %d is too large: %zu bytes, "
+                         "expected %zu maximum"),
+                       procedure, *ndata, maxdata);
+        VIR_FREE(*data);
+        goto error;
+    }
+    VIR_FREE(arg);
+    VIR_FREE(ret);
+    virObjectUnref(identity);
+
+    return VIR_NET_OK;
+
+ error:
+    virNetMessageSaveError(&rerr);
+
+    if (virNetMessageEncodeData((xdrproc_t)xdr_virNetMessageError, &rerr,
+                                data, ndata) < 0) {
+        VIR_WARN("Failed to serialize remote error '%p'", &rerr);
+        rv = -1;
+    } else {
+        rv = VIR_NET_ERROR;
+    }
+    xdr_free((xdrproc_t)xdr_virNetMessageError, (void*)&rerr);
+
+    VIR_FREE(arg);
+    VIR_FREE(ret);
+    virObjectUnref(identity);
+
+    return rv;
+}
+
+
+static int
+virNetServerProgramEncodeStreamHeader(virNetServerProgramPtr prog,
                                       virNetMessagePtr msg,
                                       int procedure,
                                       unsigned int serial,
-                                      const char *data,
-                                      size_t len)
+                                      int status)
 {
-    VIR_DEBUG("client=%p msg=%p data=%p len=%zu", client, msg, data, len);
-
     /* Return header. We're reusing same message object, so
      * only need to tweak type/status fields */
     msg->header.prog = prog->program;
@@ -522,15 +897,31 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
     msg->header.proc = procedure;
     msg->header.type = VIR_NET_STREAM;
     msg->header.serial = serial;
+    msg->header.status = status;
+
+    return virNetMessageEncodeHeader(msg);
+}
+
+
+int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
+                                      virNetServerClientPtr client,
+                                      virNetMessagePtr msg,
+                                      int procedure,
+                                      unsigned int serial,
+                                      const char *data,
+                                      size_t len)
+{
+    VIR_DEBUG("client=%p msg=%p data=%p len=%zu", client, msg, data, len);
+
     /*
      * NB
      *   data != NULL + len > 0    => VIR_NET_CONTINUE   (Sending back data)
      *   data != NULL + len == 0   => VIR_NET_CONTINUE   (Sending read EOF)
      *   data == NULL              => VIR_NET_OK         (Sending finish handshake confirmation)
      */
-    msg->header.status = data ? VIR_NET_CONTINUE : VIR_NET_OK;
-
-    if (virNetMessageEncodeHeader(msg) < 0)
+    if (virNetServerProgramEncodeStreamHeader(prog, msg, procedure, serial,
+                                              data ? VIR_NET_CONTINUE :
+                                              VIR_NET_OK) < 0)
         return -1;
 
     if (data && len) {
@@ -547,6 +938,38 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
 }
 
 
+/*
+ * Like virNetServerProgramSendStreamData with data != NULL, but
+ * @data is handed over to @msg and goes out on the wire without
+ * being copied. On success *data is set to NULL.
+ */
+int virNetServerProgramSendStreamBuffer(virNetServerProgramPtr prog,
+                                        virNetServerClientPtr client,
+                                        virNetMessagePtr msg,
+                                        int procedure,
+                                        unsigned int serial,
+                                        char **data,
+                                        size_t len)
+{
+    VIR_DEBUG("client=%p msg=%p data=%p len=%zu", client, msg, *data, len);
+
+    if (virNetServerProgramEncodeStreamHeader(prog, msg, procedure, serial,
+                                              VIR_NET_CONTINUE) < 0)
+        return -1;
+
+    if (len) {
+        if (virNetMessageEncodePayloadRef(msg, data, len) < 0)
+            return -1;
+    } else {
+        if (virNetMessageEncodePayloadEmpty(msg) < 0)
+            return -1;
+    }
+    VIR_DEBUG("Total %zu", msg->bufferLength + msg->payloadLength);
+
+    return virNetServerClientSendMessage(client, msg);
+}
+
+
 int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
                                       virNetServerClientPtr client,
                                       virNetMessagePtr msg,
@@ -582,6 +1005,10 @@ int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
 }
 
 
-void virNetServerProgramDispose(void *obj ATTRIBUTE_UNUSED)
+void virNetServerProgramDispose(void *obj)
 {
+    virNetServerProgramPtr prog = obj;
+
+    virObjectUnref(prog->replyCache);
+    VIR_FREE(prog->stats);
 }
@@ -26,6 +26,7 @@
 
 # include "virnetmessage.h"
 # include "virnetserverclient.h"
+# include "virnetserverreplycache.h"
 # include "virobject.h"
 
 typedef struct _virNetDaemon virNetDaemon;
@@ -55,6 +56,32 @@ struct _virNetServerProgramProc {
     xdrproc_t ret_filter;
     bool needAuth;
     unsigned int priority;
+    bool batch; /* Can run as part of a batch, without a message of its own */
+    bool cacheable; /* Reply can be served from the program's reply cache */
+    const char *name; /* Name of the procedure, for statistics */
+};
+
+/* Number of buckets of the latency histograms */
+# define VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS 32
+
+typedef struct _virNetServerProgramProcStats virNetServerProgramProcStats;
+typedef virNetServerProgramProcStats *virNetServerProgramProcStatsPtr;
+
+/*
+ * Latencies are in microseconds. The first bucket of a histogram counts
+ * calls which took less than 1us, bucket i those which took between
+ * 2^(i-1) and 2^i - 1us, and the last one all calls taking longer.
+ */
+struct _virNetServerProgramProcStats {
+    unsigned program;
+    int procedure;
+    const char *name;
+
+    unsigned long long calls;
+    unsigned long long waitTotal;   /* Queued before a worker picked it */
+    unsigned long long execTotal;   /* Spent dispatching the call */
+    unsigned long long wait[VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS];
+    unsigned long long exec[VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS];
 };
 
 virNetServerProgramPtr virNetServerProgramNew(unsigned program,
@@ -62,12 +89,22 @@ virNetServerProgramPtr virNetServerProgramNew(unsigned program,
                                               virNetServerProgramProcPtr procs,
                                               size_t nprocs);
 
+void virNetServerProgramSetReplyCache(virNetServerProgramPtr prog,
+                                      virNetServerReplyCachePtr cache);
+
 int virNetServerProgramGetID(virNetServerProgramPtr prog);
 int virNetServerProgramGetVersion(virNetServerProgramPtr prog);
 
 unsigned int virNetServerProgramGetPriority(virNetServerProgramPtr prog,
                                             int procedure);
 
+int virNetServerProgramGetProcStats(virNetServerProgramPtr prog,
+                                    virNetServerProgramProcStatsPtr *stats,
+                                    size_t *nstats);
+void virNetServerProgramResetProcStats(virNetServerProgramPtr prog,
+                                       virNetServerProgramProcStatsPtr stats,
+                                       size_t nstats);
+
 int virNetServerProgramMatches(virNetServerProgramPtr prog,
                                virNetMessagePtr msg);
 
@@ -76,6 +113,16 @@ int virNetServerProgramDispatch(virNetServerProgramPtr prog,
                                 virNetServerClientPtr client,
                                 virNetMessagePtr msg);
 
+int virNetServerProgramDispatchBatchCall(virNetServerProgramPtr prog,
+                                         virNetServerPtr server,
+                                         virNetServerClientPtr client,
+                                         int procedure,
+                                         char *args,
+                                         size_t nargs,
+                                         size_t maxdata,
+                                         char **data,
+                                         size_t *ndata);
+
 int virNetServerProgramSendReplyError(virNetServerProgramPtr prog,
                                       virNetServerClientPtr client,
                                       virNetMessagePtr msg,
@@ -101,6 +148,14 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
                                       const char *data,
                                       size_t len);
 
+int virNetServerProgramSendStreamBuffer(virNetServerProgramPtr prog,
+                                        virNetServerClientPtr client,
+                                        virNetMessagePtr msg,
+                                        int procedure,
+                                        unsigned int serial,
+                                        char **data,
+                                        size_t len);
+
 int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
                                       virNetServerClientPtr client,
                                       virNetMessagePtr msg,
@@ -0,0 +1,33 @@
+/*
+ * virnetserverprogrampriv.h: generic network RPC server program internals
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __VIR_NET_SERVER_PROGRAM_PRIV_H__
+# define __VIR_NET_SERVER_PROGRAM_PRIV_H__
+
+# include "virnetserverprogram.h"
+
+size_t virNetServerProgramLatencyBucket(unsigned long long latency);
+
+void virNetServerProgramRecordCall(virNetServerProgramPtr prog,
+                                   int procedure,
+                                   unsigned long long received,
+                                   unsigned long long start,
+                                   unsigned long long end);
+
+#endif /* __VIR_NET_SERVER_PROGRAM_PRIV_H__ */
@@ -0,0 +1,356 @@
+/*
+ * virnetserverreplycache.c: cache of encoded RPC replies
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "virnetserverreplycache.h"
+
+#include "viralloc.h"
+#include "virbuffer.h"
+#include "virerror.h"
+#include "virhash.h"
+#include "virlog.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+VIR_LOG_INIT("rpc.netserverreplycache");
+
+/*
+ * Replies of procedures whose result only depends on their arguments
+ * and on some slowly changing state, e.g. the capabilities XML, are
+ * kept here already XDR encoded, so that repeating such a call costs
+ * a copy of the payload rather than rebuilding it.
+ *
+ * An entry is keyed by the scope reported by the owner's callback,
+ * the procedure number and the encoded arguments. It is ignored once
+ * the generation reported by the callback moves on, or when it is
+ * older than @timeout seconds, whichever comes first. The latter
+ * bounds how long changes nobody tells us about can go unnoticed.
+ */
+
+typedef struct _virNetServerReplyCacheEntry virNetServerReplyCacheEntry;
+typedef virNetServerReplyCacheEntry *virNetServerReplyCacheEntryPtr;
+
+struct _virNetServerReplyCacheEntry {
+    char *data;
+    size_t len;
+    unsigned long long generation;
+    unsigned long long expires;
+};
+
+struct _virNetServerReplyCache {
+    virObjectLockable parent;
+
+    virHashTablePtr entries;
+    size_t maxEntries;
+    unsigned long long timeout;
+
+    virNetServerReplyCacheScopeFunc scopeFunc;
+    void *opaque;
+    virFreeCallback opaqueFree;
+
+    unsigned long long hits;
+    unsigned long long misses;
+};
+
+
+static virClassPtr virNetServerReplyCacheClass;
+static void virNetServerReplyCacheDispose(void *obj);
+
+static int virNetServerReplyCacheOnceInit(void)
+{
+    if (!(virNetServerReplyCacheClass = virClassNew(virClassForObjectLockable(),
+                                                    "virNetServerReplyCache",
+                                                    sizeof(virNetServerReplyCache),
+                                                    virNetServerReplyCacheDispose)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virNetServerReplyCache)
+
+
+static void
+virNetServerReplyCacheEntryFree(void *payload,
+                                const void *name ATTRIBUTE_UNUSED)
+{
+    virNetServerReplyCacheEntryPtr entry = payload;
+
+    if (!entry)
+        return;
+
+    VIR_FREE(entry->data);
+    VIR_FREE(entry);
+}
+
+
+/**
+ * virNetServerReplyCacheNew:
+ * @maxEntries: upper limit on the number of cached replies
+ * @timeout: how many seconds a cached reply is used for at most
+ * @scopeFunc: callback deciding which calls can use the cache
+ * @opaque: data for @scopeFunc
+ * @opaqueFree: callback to free @opaque along with the cache
+ *
+ * Returns a new reply cache or NULL on error.
+ */
+virNetServerReplyCachePtr
+virNetServerReplyCacheNew(size_t maxEntries,
+                          unsigned int timeout,
+                          virNetServerReplyCacheScopeFunc scopeFunc,
+                          void *opaque,
+                          virFreeCallback opaqueFree)
+{
+    virNetServerReplyCachePtr cache;
+
+    if (virNetServerReplyCacheInitialize() < 0)
+        return NULL;
+
+    if (!(cache = virObjectLockableNew(virNetServerReplyCacheClass)))
+        return NULL;
+
+    if (!(cache->entries = virHashCreate(maxEntries,
+                                         virNetServerReplyCacheEntryFree))) {
+        virObjectUnref(cache);
+        return NULL;
+    }
+
+    cache->maxEntries = maxEntries;
+    cache->timeout = timeout * 1000ULL;
+    cache->scopeFunc = scopeFunc;
+    cache->opaque = opaque;
+    cache->opaqueFree = opaqueFree;
+
+    return cache;
+}
+
+
+static void
+virNetServerReplyCacheDispose(void *obj)
+{
+    virNetServerReplyCachePtr cache = obj;
+
+    VIR_DEBUG("cache=%p hits=%llu misses=%llu",
+              cache, cache->hits, cache->misses);
+
+    virHashFree(cache->entries);
+    if (cache->opaqueFree)
+        cache->opaqueFree(cache->opaque);
+}
+
+
+/**
+ * virNetServerReplyCacheGetKey:
+ * @cache: the reply cache
+ * @client: the client making the call
+ * @procedure: the procedure being called
+ * @args: the XDR encoded arguments of the call
+ * @nargs: length of @args
+ * @key: filled with the key of the reply
+ * @generation: filled with the generation the reply must have
+ *
+ * Must be called with the identity of @client set, as it runs
+ * the scope callback of @cache.
+ *
+ * Returns 1 if @key and @generation were filled, 0 if the reply
+ * of this call must not be cached, or -1 on error.
+ */
+int
+virNetServerReplyCacheGetKey(virNetServerReplyCachePtr cache,
+                             virNetServerClientPtr client,
+                             int procedure,
+                             const char *args,
+                             size_t nargs,
+                             char **key,
+                             unsigned long long *generation)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *scope = NULL;
+    size_t i;
+    int rc;
+
+    *key = NULL;
+
+    if ((rc = cache->scopeFunc(client, procedure, &scope,
+                               generation, cache->opaque)) <= 0)
+        return rc;
+
+    virBufferAsprintf(&buf, "%s:%d:", scope, procedure);
+    for (i = 0; i < nargs; i++)
+        virBufferAsprintf(&buf, "%02x", (unsigned char) args[i]);
+    VIR_FREE(scope);
+
+    if (virBufferCheckError(&buf) < 0)
+        return -1;
+
+    *key = virBufferContentAndReset(&buf);
+    return 1;
+}
+
+
+/**
+ * virNetServerReplyCacheLookup:
+ * @cache: the reply cache
+ * @key: the key from virNetServerReplyCacheGetKey
+ * @generation: the generation from virNetServerReplyCacheGetKey
+ * @msg: the message to reply with
+ *
+ * Look for a cached reply matching @key and @generation and, if
+ * there is one, turn @msg into a successful reply carrying it. The
+ * header of @msg must still describe the call being replied to.
+ *
+ * Returns 1 if @msg is ready to be sent, 0 if there is no usable
+ * reply cached, or -1 on error.
+ */
+int
+virNetServerReplyCacheLookup(virNetServerReplyCachePtr cache,
+                             const char *key,
+                             unsigned long long generation,
+                             virNetMessagePtr msg)
+{
+    virNetServerReplyCacheEntryPtr entry;
+    unsigned long long now;
+    int ret = -1;
+
+    if (virTimeMillisNow(&now) < 0)
+        return -1;
+
+    virObjectLock(cache);
+
+    if (!(entry = virHashLookup(cache->entries, key)) ||
+        entry->generation != generation ||
+        entry->expires <= now) {
+        cache->misses++;
+        ret = 0;
+        goto cleanup;
+    }
+
+    msg->header.type = VIR_NET_REPLY;
+    msg->header.status = VIR_NET_OK;
+
+    if (virNetMessageEncodeHeader(msg) < 0 ||
+        virNetMessageEncodePayloadRaw(msg, entry->data, entry->len) < 0)
+        goto cleanup;
+
+    cache->hits++;
+    ret = 1;
+
+ cleanup:
+    virObjectUnlock(cache);
+    return ret;
+}
+
+
+static int
+virNetServerReplyCacheEntryIsStale(const void *payload,
+                                   const void *name ATTRIBUTE_UNUSED,
+                                   const void *opaque)
+{
+    const virNetServerReplyCacheEntry *entry = payload;
+    const virNetServerReplyCacheEntry *current = opaque;
+
+    return entry->generation != current->generation ||
+        entry->expires <= current->expires;
+}
+
+
+/**
+ * virNetServerReplyCacheStore:
+ * @cache: the reply cache
+ * @key: the key from virNetServerReplyCacheGetKey
+ * @generation: the generation from virNetServerReplyCacheGetKey
+ * @data: the XDR encoded reply payload
+ * @len: length of @data
+ *
+ * Remember @data as the reply for @key. Nothing is stored if the
+ * cache is full of replies which are all still usable.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetServerReplyCacheStore(virNetServerReplyCachePtr cache,
+                            const char *key,
+                            unsigned long long generation,
+                            const char *data,
+                            size_t len)
+{
+    virNetServerReplyCacheEntryPtr entry = NULL;
+    virNetServerReplyCacheEntry current;
+    unsigned long long now;
+    int ret = -1;
+
+    if (virTimeMillisNow(&now) < 0)
+        return -1;
+
+    if (VIR_ALLOC(entry) < 0 ||
+        VIR_ALLOC_N(entry->data, len) < 0)
+        goto cleanup;
+
+    memcpy(entry->data, data, len);
+    entry->len = len;
+    entry->generation = generation;
+    entry->expires = now + cache->timeout;
+
+    virObjectLock(cache);
+
+    if (!virHashLookup(cache->entries, key) &&
+        virHashSize(cache->entries) >= cache->maxEntries) {
+        current.generation = generation;
+        current.expires = now;
+        virHashRemoveSet(cache->entries,
+                         virNetServerReplyCacheEntryIsStale, &current);
+
+        if (virHashSize(cache->entries) >= cache->maxEntries) {
+            VIR_DEBUG("Reply cache %p is full, not storing %s", cache, key);
+            virObjectUnlock(cache);
+            ret = 0;
+            goto cleanup;
+        }
+    }
+
+    if (virHashUpdateEntry(cache->entries, key, entry) < 0) {
+        virObjectUnlock(cache);
+        goto cleanup;
+    }
+    entry = NULL;
+    virObjectUnlock(cache);
+
+    ret = 0;
+ cleanup:
+    virNetServerReplyCacheEntryFree(entry, NULL);
+    return ret;
+}
+
+
+/**
+ * virNetServerReplyCacheFlush:
+ * @cache: the reply cache
+ *
+ * Drop all cached replies.
+ */
+void
+virNetServerReplyCacheFlush(virNetServerReplyCachePtr cache)
+{
+    virObjectLock(cache);
+    virHashRemoveAll(cache->entries);
+    virObjectUnlock(cache);
+}
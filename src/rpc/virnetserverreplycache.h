@@ -0,0 +1,81 @@
+/*
+ * virnetserverreplycache.h: cache of encoded RPC replies
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VIR_NET_SERVER_REPLY_CACHE_H__
+# define __VIR_NET_SERVER_REPLY_CACHE_H__
+
+# include "virnetmessage.h"
+# include "virnetserverclient.h"
+# include "virobject.h"
+
+typedef struct _virNetServerReplyCache virNetServerReplyCache;
+typedef virNetServerReplyCache *virNetServerReplyCachePtr;
+
+/*
+ * @client: the client making the call
+ * @procedure: the procedure being called
+ * @scope: filled with the name of the state the reply is built from
+ * @generation: filled with the current generation of that state
+ * @opaque: data passed to virNetServerReplyCacheNew
+ *
+ * Called with the client identity set, before a reply of @procedure
+ * is looked up in the cache. Replies are only shared between calls
+ * with the same @scope, and cached ones are only used while
+ * @generation stays the same. The callback is responsible for doing
+ * any access control check the procedure itself would have done.
+ *
+ * Returns 1 if the cache can be used, 0 if the call has to be
+ * dispatched as usual and -1 with an error reported otherwise.
+ */
+typedef int (*virNetServerReplyCacheScopeFunc)(virNetServerClientPtr client,
+                                               int procedure,
+                                               char **scope,
+                                               unsigned long long *generation,
+                                               void *opaque);
+
+virNetServerReplyCachePtr
+virNetServerReplyCacheNew(size_t maxEntries,
+                          unsigned int timeout,
+                          virNetServerReplyCacheScopeFunc scopeFunc,
+                          void *opaque,
+                          virFreeCallback opaqueFree);
+
+int virNetServerReplyCacheGetKey(virNetServerReplyCachePtr cache,
+                                 virNetServerClientPtr client,
+                                 int procedure,
+                                 const char *args,
+                                 size_t nargs,
+                                 char **key,
+                                 unsigned long long *generation);
+
+int virNetServerReplyCacheLookup(virNetServerReplyCachePtr cache,
+                                 const char *key,
+                                 unsigned long long generation,
+                                 virNetMessagePtr msg);
+
+int virNetServerReplyCacheStore(virNetServerReplyCachePtr cache,
+                                const char *key,
+                                unsigned long long generation,
+                                const char *data,
+                                size_t len);
+
+void virNetServerReplyCacheFlush(virNetServerReplyCachePtr cache);
+
+#endif /* __VIR_NET_SERVER_REPLY_CACHE_H__ */
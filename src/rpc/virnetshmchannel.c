@@ -0,0 +1,613 @@
+/*
+ * virnetshmchannel.c: shared memory transport for local clients
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "virnetshmchannel.h"
+
+#include "viralloc.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virlog.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+VIR_LOG_INIT("rpc.netshmchannel");
+
+#if defined(HAVE_MEMFD_CREATE) && defined(MFD_ALLOW_SEALING) && \
+    defined(F_ADD_SEALS)
+# define VIR_NET_SHM_CHANNEL_SUPPORTED 1
+#endif
+
+/*
+ * A channel is a memfd holding two single producer, single consumer
+ * ring buffers, one for each direction. The process creating it
+ * writes to the first ring and reads from the second, the one opening
+ * it does the opposite.
+ *
+ * Positions are free running counters, so the amount of data in a
+ * ring is simply head - tail, and the size being a power of two keeps
+ * that true when they wrap around. Either side only trusts its own
+ * copy of the position it owns, the shared one is there for the peer,
+ * which can't make us read or write outside of the rings no matter
+ * what it stores there.
+ *
+ * Neither side ever sleeps on the memory itself. A consumer finding
+ * the ring empty sets wantData before giving up, and the producer
+ * clears it after adding data, telling its caller to ring the peer's
+ * doorbell, i.e. to poke it through the socket the channel comes
+ * with. wantSpace does the same for a producer facing a full ring.
+ */
+
+#define VIR_NET_SHM_CHANNEL_MAGIC 0x4c565348 /* "LVSH" */
+#define VIR_NET_SHM_CHANNEL_VERSION 1
+#define VIR_NET_SHM_CHANNEL_DATA_OFFSET 4096
+
+typedef struct _virNetShmRing virNetShmRing;
+typedef virNetShmRing *virNetShmRingPtr;
+
+struct _virNetShmRing {
+    /* Updated by the producer */
+    int head;
+    int wantSpace;
+    char padProducer[56];
+
+    /* Updated by the consumer */
+    int tail;
+    int wantData;
+    char padConsumer[56];
+};
+
+typedef struct _virNetShmHeader virNetShmHeader;
+typedef virNetShmHeader *virNetShmHeaderPtr;
+
+struct _virNetShmHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int size;
+    char pad[52];
+
+    virNetShmRing rings[2];
+};
+
+verify(sizeof(virNetShmHeader) <= VIR_NET_SHM_CHANNEL_DATA_OFFSET);
+
+struct _virNetShmChannel {
+    virObject parent;
+
+    int fd;
+    char *base;
+    size_t mapLength;
+    unsigned int size;
+
+    virNetShmRingPtr tx;
+    char *txData;
+    unsigned int txPos;
+
+    virNetShmRingPtr rx;
+    char *rxData;
+    unsigned int rxPos;
+};
+
+static size_t virNetShmChannelDefaultSize;
+
+static virClassPtr virNetShmChannelClass;
+static void virNetShmChannelDispose(void *obj);
+
+static int virNetShmChannelOnceInit(void)
+{
+    if (!(virNetShmChannelClass = virClassNew(virClassForObject(),
+                                              "virNetShmChannel",
+                                              sizeof(virNetShmChannel),
+                                              virNetShmChannelDispose)))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virNetShmChannel)
+
+
+/* Full barriers around every access to the shared positions and
+ * flags, this is all about ordering them against the data copies */
+static unsigned int
+virNetShmLoad(int *ptr)
+{
+    unsigned int val;
+
+    __sync_synchronize();
+    val = *(volatile int *)ptr;
+    __sync_synchronize();
+    return val;
+}
+
+
+static void
+virNetShmStore(int *ptr, unsigned int val)
+{
+    __sync_synchronize();
+    *(volatile int *)ptr = val;
+    __sync_synchronize();
+}
+
+
+static bool
+virNetShmTestAndClear(int *ptr)
+{
+    return __sync_bool_compare_and_swap(ptr, 1, 0);
+}
+
+
+bool
+virNetShmChannelIsSupported(void)
+{
+#ifdef VIR_NET_SHM_CHANNEL_SUPPORTED
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+/**
+ * virNetShmChannelSetDefaultSize:
+ * @size: size of each ring in bytes, 0 to disable channels
+ *
+ * Set the size of the channels this process offers to its clients.
+ * It is rounded up to a power of two within the supported range.
+ */
+void
+virNetShmChannelSetDefaultSize(size_t size)
+{
+    size_t rounded = VIR_NET_SHM_CHANNEL_SIZE_MIN;
+
+    if (size == 0 || !virNetShmChannelIsSupported()) {
+        virNetShmChannelDefaultSize = 0;
+        return;
+    }
+
+    while (rounded < size && rounded < VIR_NET_SHM_CHANNEL_SIZE_MAX)
+        rounded *= 2;
+
+    virNetShmChannelDefaultSize = rounded;
+}
+
+
+size_t
+virNetShmChannelGetDefaultSize(void)
+{
+    return virNetShmChannelDefaultSize;
+}
+
+
+static bool
+virNetShmChannelSizeIsValid(size_t size)
+{
+    return size >= VIR_NET_SHM_CHANNEL_SIZE_MIN &&
+        size <= VIR_NET_SHM_CHANNEL_SIZE_MAX &&
+        (size & (size - 1)) == 0;
+}
+
+
+#ifdef VIR_NET_SHM_CHANNEL_SUPPORTED
+static virNetShmChannelPtr
+virNetShmChannelMap(int fd,
+                    size_t size,
+                    bool creator)
+{
+    virNetShmChannelPtr chan;
+    virNetShmHeaderPtr header;
+
+    if (virNetShmChannelInitialize() < 0)
+        return NULL;
+
+    if (!(chan = virObjectNew(virNetShmChannelClass)))
+        return NULL;
+
+    chan->fd = -1;
+    chan->size = size;
+    chan->mapLength = VIR_NET_SHM_CHANNEL_DATA_OFFSET + 2 * size;
+
+    if ((chan->base = mmap(NULL, chan->mapLength, PROT_READ | PROT_WRITE,
+                           MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        chan->base = NULL;
+        virReportSystemError(errno, "%s",
+                             _("Unable to map shared memory channel"));
+        virObjectUnref(chan);
+        return NULL;
+    }
+    chan->fd = fd;
+
+    header = (virNetShmHeaderPtr) chan->base;
+    if (creator) {
+        header->magic = VIR_NET_SHM_CHANNEL_MAGIC;
+        header->version = VIR_NET_SHM_CHANNEL_VERSION;
+        header->size = size;
+    }
+
+    chan->tx = &header->rings[creator ? 0 : 1];
+    chan->txData = chan->base + VIR_NET_SHM_CHANNEL_DATA_OFFSET +
+        (creator ? 0 : size);
+    chan->rx = &header->rings[creator ? 1 : 0];
+    chan->rxData = chan->base + VIR_NET_SHM_CHANNEL_DATA_OFFSET +
+        (creator ? size : 0);
+
+    return chan;
+}
+
+
+/**
+ * virNetShmChannelNew:
+ * @size: size of each ring in bytes, a power of two
+ *
+ * Create a channel, to be handed to the peer with virNetShmChannelGetFD.
+ * The memory is sealed, so that the peer can't shrink it under our feet.
+ *
+ * Returns the channel or NULL on error.
+ */
+virNetShmChannelPtr
+virNetShmChannelNew(size_t size)
+{
+    virNetShmChannelPtr chan;
+    int fd;
+
+    if (!virNetShmChannelSizeIsValid(size)) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("invalid shared memory channel size %zu"), size);
+        return NULL;
+    }
+
+    if ((fd = memfd_create("libvirt-rpc", MFD_CLOEXEC | MFD_ALLOW_SEALING)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create shared memory channel"));
+        return NULL;
+    }
+
+    if (ftruncate(fd, VIR_NET_SHM_CHANNEL_DATA_OFFSET + 2 * size) < 0 ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to size shared memory channel"));
+        VIR_FORCE_CLOSE(fd);
+        return NULL;
+    }
+
+    if (!(chan = virNetShmChannelMap(fd, size, true))) {
+        VIR_FORCE_CLOSE(fd);
+        return NULL;
+    }
+
+    VIR_DEBUG("chan=%p fd=%d size=%zu", chan, fd, size);
+    return chan;
+}
+
+
+/**
+ * virNetShmChannelOpen:
+ * @fd: file descriptor of a channel created by the peer
+ *
+ * Map the channel the peer created with virNetShmChannelNew. The
+ * channel takes ownership of @fd, which is closed on error.
+ *
+ * Returns the channel or NULL on error.
+ */
+virNetShmChannelPtr
+virNetShmChannelOpen(int fd)
+{
+    virNetShmChannelPtr chan;
+    virNetShmHeaderPtr header;
+    struct stat sb;
+    int seals;
+    size_t size;
+
+    if (fstat(fd, &sb) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to stat shared memory channel"));
+        goto error;
+    }
+
+    if ((seals = fcntl(fd, F_GET_SEALS)) < 0 ||
+        !(seals & F_SEAL_SHRINK)) {
+        virReportError(VIR_ERR_RPC, "%s",
+                       _("shared memory channel is not sealed"));
+        goto error;
+    }
+
+    size = (sb.st_size - VIR_NET_SHM_CHANNEL_DATA_OFFSET) / 2;
+    if (sb.st_size < VIR_NET_SHM_CHANNEL_DATA_OFFSET ||
+        !virNetShmChannelSizeIsValid(size) ||
+        sb.st_size != VIR_NET_SHM_CHANNEL_DATA_OFFSET + 2 * size) {
+        virReportError(VIR_ERR_RPC,
+                       _("unexpected shared memory channel size %lld"),
+                       (long long) sb.st_size);
+        goto error;
+    }
+
+    if (!(chan = virNetShmChannelMap(fd, size, false)))
+        goto error;
+
+    header = (virNetShmHeaderPtr) chan->base;
+    if (header->magic != VIR_NET_SHM_CHANNEL_MAGIC ||
+        header->version != VIR_NET_SHM_CHANNEL_VERSION ||
+        header->size != size) {
+        virReportError(VIR_ERR_RPC, "%s",
+                       _("unexpected shared memory channel header"));
+        virObjectUnref(chan);
+        return NULL;
+    }
+
+    /* Whatever the peer did so far is ours to consume */
+    chan->txPos = virNetShmLoad(&chan->tx->tail);
+    chan->rxPos = virNetShmLoad(&chan->rx->tail);
+
+    VIR_DEBUG("chan=%p fd=%d size=%zu", chan, fd, size);
+    return chan;
+
+ error:
+    VIR_FORCE_CLOSE(fd);
+    return NULL;
+}
+#else /* !VIR_NET_SHM_CHANNEL_SUPPORTED */
+virNetShmChannelPtr
+virNetShmChannelNew(size_t size ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("shared memory channels are not supported "
+                     "on this platform"));
+    return NULL;
+}
+
+
+virNetShmChannelPtr
+virNetShmChannelOpen(int fd)
+{
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("shared memory channels are not supported "
+                     "on this platform"));
+    VIR_FORCE_CLOSE(fd);
+    return NULL;
+}
+#endif /* !VIR_NET_SHM_CHANNEL_SUPPORTED */
+
+
+static void
+virNetShmChannelDispose(void *obj)
+{
+    virNetShmChannelPtr chan = obj;
+
+    if (chan->base)
+        munmap(chan->base, chan->mapLength);
+    VIR_FORCE_CLOSE(chan->fd);
+}
+
+
+int
+virNetShmChannelGetFD(virNetShmChannelPtr chan)
+{
+    return chan->fd;
+}
+
+
+size_t
+virNetShmChannelGetSize(virNetShmChannelPtr chan)
+{
+    return chan->size;
+}
+
+
+/*
+ * Returns how much data is in a ring with @head and @tail, or -1 if
+ * the peer stored positions that make no sense.
+ */
+static ssize_t
+virNetShmChannelUsed(virNetShmChannelPtr chan,
+                     unsigned int head,
+                     unsigned int tail)
+{
+    if (head - tail > chan->size) {
+        virReportError(VIR_ERR_RPC, "%s",
+                       _("shared memory channel is corrupted"));
+        return -1;
+    }
+
+    return head - tail;
+}
+
+
+/**
+ * virNetShmChannelRead:
+ * @chan: the channel
+ * @buf: buffer to fill
+ * @len: size of @buf
+ * @wake: set to true if the peer must be told about the space freed
+ *
+ * Copy up to @len bytes sent by the peer to @buf. If there is nothing
+ * to read, the peer is asked to ring the doorbell once there is.
+ *
+ * Returns the number of bytes read, 0 if there was nothing to read,
+ * or -1 on error.
+ */
+ssize_t
+virNetShmChannelRead(virNetShmChannelPtr chan,
+                     char *buf,
+                     size_t len,
+                     bool *wake)
+{
+    unsigned int mask = chan->size - 1;
+    unsigned int offset;
+    ssize_t avail;
+    size_t first;
+
+    *wake = false;
+
+    if ((avail = virNetShmChannelUsed(chan, virNetShmLoad(&chan->rx->head),
+                                      chan->rxPos)) < 0)
+        return -1;
+
+    if (avail == 0) {
+        virNetShmStore(&chan->rx->wantData, 1);
+        if ((avail = virNetShmChannelUsed(chan, virNetShmLoad(&chan->rx->head),
+                                          chan->rxPos)) <= 0)
+            return avail;
+    }
+
+    if (len > (size_t)avail)
+        len = avail;
+
+    offset = chan->rxPos & mask;
+    first = MIN(len, chan->size - offset);
+    memcpy(buf, chan->rxData + offset, first);
+    memcpy(buf + first, chan->rxData, len - first);
+
+    chan->rxPos += len;
+    virNetShmStore(&chan->rx->tail, chan->rxPos);
+    *wake = virNetShmTestAndClear(&chan->rx->wantSpace);
+
+    return len;
+}
+
+
+/**
+ * virNetShmChannelWrite:
+ * @chan: the channel
+ * @buf: data to send
+ * @len: length of @buf
+ * @wake: set to true if the peer must be told about the data
+ *
+ * Copy up to @len bytes from @buf for the peer to read. If there is
+ * no room at all, the peer is asked to ring the doorbell once there is.
+ *
+ * Returns the number of bytes written, 0 if the channel was full, or
+ * -1 on error.
+ */
+ssize_t
+virNetShmChannelWrite(virNetShmChannelPtr chan,
+                      const char *buf,
+                      size_t len,
+                      bool *wake)
+{
+    unsigned int mask = chan->size - 1;
+    unsigned int offset;
+    ssize_t used;
+    size_t space;
+    size_t first;
+
+    *wake = false;
+
+    if ((used = virNetShmChannelUsed(chan, chan->txPos,
+                                     virNetShmLoad(&chan->tx->tail))) < 0)
+        return -1;
+
+    if ((size_t)used == chan->size) {
+        virNetShmStore(&chan->tx->wantSpace, 1);
+        if ((used = virNetShmChannelUsed(chan, chan->txPos,
+                                         virNetShmLoad(&chan->tx->tail))) < 0)
+            return -1;
+        if ((size_t)used == chan->size)
+            return 0;
+    }
+
+    space = chan->size - used;
+    if (len > space)
+        len = space;
+
+    offset = chan->txPos & mask;
+    first = MIN(len, chan->size - offset);
+    memcpy(chan->txData + offset, buf, first);
+    memcpy(chan->txData, buf + first, len - first);
+
+    chan->txPos += len;
+    virNetShmStore(&chan->tx->head, chan->txPos);
+    *wake = virNetShmTestAndClear(&chan->tx->wantData);
+
+    return len;
+}
+
+
+/**
+ * virNetShmChannelHasData:
+ * @chan: the channel
+ *
+ * Returns true if the peer sent data which wasn't read yet.
+ */
+bool
+virNetShmChannelHasData(virNetShmChannelPtr chan)
+{
+    return virNetShmLoad(&chan->rx->head) != chan->rxPos;
+}
+
+
+/**
+ * virNetShmChannelHasSpace:
+ * @chan: the channel
+ *
+ * Returns true if there is room for writing to the peer.
+ */
+bool
+virNetShmChannelHasSpace(virNetShmChannelPtr chan)
+{
+    return chan->txPos - virNetShmLoad(&chan->tx->tail) < chan->size;
+}
+
+
+/**
+ * virNetShmChannelWaitData:
+ * @chan: the channel
+ *
+ * To be called before sleeping until the doorbell rings, so that
+ * the peer rings it as soon as it sends some data.
+ *
+ * Returns true if there is data to read already, and the caller
+ * must not sleep.
+ */
+bool
+virNetShmChannelWaitData(virNetShmChannelPtr chan)
+{
+    if (virNetShmChannelHasData(chan))
+        return true;
+
+    virNetShmStore(&chan->rx->wantData, 1);
+    return virNetShmChannelHasData(chan);
+}
+
+
+/**
+ * virNetShmChannelWaitSpace:
+ * @chan: the channel
+ *
+ * To be called before sleeping until the doorbell rings, so that
+ * the peer rings it as soon as it reads some data.
+ *
+ * Returns true if there is room for writing already, and the caller
+ * must not sleep.
+ */
+bool
+virNetShmChannelWaitSpace(virNetShmChannelPtr chan)
+{
+    if (virNetShmChannelHasSpace(chan))
+        return true;
+
+    virNetShmStore(&chan->tx->wantSpace, 1);
+    return virNetShmChannelHasSpace(chan);
+}
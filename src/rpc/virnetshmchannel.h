@@ -0,0 +1,59 @@
+/*
+ * virnetshmchannel.h: shared memory transport for local clients
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VIR_NET_SHM_CHANNEL_H__
+# define __VIR_NET_SHM_CHANNEL_H__
+
+# include "internal.h"
+# include "virobject.h"
+
+typedef struct _virNetShmChannel virNetShmChannel;
+typedef virNetShmChannel *virNetShmChannelPtr;
+
+# define VIR_NET_SHM_CHANNEL_SIZE_MIN (64 * 1024)
+# define VIR_NET_SHM_CHANNEL_SIZE_MAX (256 * 1024 * 1024)
+
+bool virNetShmChannelIsSupported(void);
+
+void virNetShmChannelSetDefaultSize(size_t size);
+size_t virNetShmChannelGetDefaultSize(void);
+
+virNetShmChannelPtr virNetShmChannelNew(size_t size);
+virNetShmChannelPtr virNetShmChannelOpen(int fd);
+
+int virNetShmChannelGetFD(virNetShmChannelPtr chan);
+size_t virNetShmChannelGetSize(virNetShmChannelPtr chan);
+
+ssize_t virNetShmChannelRead(virNetShmChannelPtr chan,
+                             char *buf,
+                             size_t len,
+                             bool *wake);
+ssize_t virNetShmChannelWrite(virNetShmChannelPtr chan,
+                              const char *buf,
+                              size_t len,
+                              bool *wake);
+
+bool virNetShmChannelHasData(virNetShmChannelPtr chan);
+bool virNetShmChannelHasSpace(virNetShmChannelPtr chan);
+
+bool virNetShmChannelWaitData(virNetShmChannelPtr chan);
+bool virNetShmChannelWaitSpace(virNetShmChannelPtr chan);
+
+#endif /* __VIR_NET_SHM_CHANNEL_H__ */
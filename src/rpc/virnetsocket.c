@@ -25,6 +25,7 @@
 
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <signal.h>
@@ -51,6 +52,7 @@
 #include "virutil.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "virevent.h"
 #include "virlog.h"
 #include "virfile.h"
 #include "virthread.h"
@@ -58,6 +60,8 @@
 #include "virprobe.h"
 #include "virprocess.h"
 #include "virstring.h"
+#include "virnetshmchannel.h"
+#include "virnetprotocol.h"
 #include "dirname.h"
 #include "passfd.h"
 
@@ -73,6 +77,18 @@
 
 VIR_LOG_INIT("rpc.netsocket");
 
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+#ifndef MSG_CMSG_CLOEXEC
+# define MSG_CMSG_CLOEXEC 0
+#endif
+
+/* Upper limit on the FDs picked up by a single recvmsg() while
+ * draining the doorbells of a shared memory channel */
+#define VIR_NET_SOCKET_SHM_MAX_FDS 16
+
 struct _virNetSocket {
     virObjectLockable parent;
 
@@ -85,6 +101,7 @@ struct _virNetSocket {
     bool quietEOF;
 
     /* Event callback fields */
+    int events;
     virNetSocketIOFunc func;
     void *opaque;
     virFreeCallback ff;
@@ -116,6 +133,14 @@ struct _virNetSocket {
 #if WITH_LIBSSH
     virNetLibsshSessionPtr libsshSession;
 #endif
+
+    /* With a shared memory channel, data goes through its rings
+     * and the socket only carries doorbells and FDs */
+    virNetShmChannelPtr shm;
+    int *shmFDs;
+    size_t nshmFDs;
+    bool shmEOF;
+    int shmErrno;
 };
 
 
@@ -1276,6 +1301,11 @@ virJSONValuePtr virNetSocketPreExecRestart(virNetSocketPtr sock)
         goto error;
     }
 #endif
+    if (sock->shm) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("Unable to save socket state when shared memory channel is active"));
+        goto error;
+    }
 
     if (!(object = virJSONValueNewObject()))
         goto error;
@@ -1319,6 +1349,7 @@ virJSONValuePtr virNetSocketPreExecRestart(virNetSocketPtr sock)
 void virNetSocketDispose(void *obj)
 {
     virNetSocketPtr sock = obj;
+    size_t i;
 
     PROBE(RPC_SOCKET_DISPOSE,
           "sock=%p", sock);
@@ -1354,6 +1385,11 @@ void virNetSocketDispose(void *obj)
     virObjectUnref(sock->libsshSession);
 #endif
 
+    virObjectUnref(sock->shm);
+    for (i = 0; i < sock->nshmFDs; i++)
+        VIR_FORCE_CLOSE(sock->shmFDs[i]);
+    VIR_FREE(sock->shmFDs);
+
     if (sock->ownsFd)
         VIR_FORCE_CLOSE(sock->fd);
     VIR_FORCE_CLOSE(sock->errfd);
@@ -1674,6 +1710,372 @@ void virNetSocketSetSASLSession(virNetSocketPtr sock,
 #endif
 
 
+/*
+ * Whether @sock is a plain local socket a shared memory channel
+ * can be set on.
+ *
+ * @sock: a locked socket object
+ */
+static bool virNetSocketCanUseShmLocked(virNetSocketPtr sock)
+{
+    if (!virNetShmChannelIsSupported() ||
+        sock->shm ||
+        sock->localAddr.data.sa.sa_family != AF_UNIX)
+        return false;
+
+#if WITH_GNUTLS
+    if (sock->tlsSession)
+        return false;
+#endif
+#if WITH_SASL
+    if (sock->saslSession)
+        return false;
+#endif
+#if WITH_SSH2
+    if (sock->sshSession)
+        return false;
+#endif
+#if WITH_LIBSSH
+    if (sock->libsshSession)
+        return false;
+#endif
+
+    return true;
+}
+
+
+bool virNetSocketCanUseShm(virNetSocketPtr sock)
+{
+    bool ret;
+
+    virObjectLock(sock);
+    ret = virNetSocketCanUseShmLocked(sock);
+    virObjectUnlock(sock);
+    return ret;
+}
+
+
+/*
+ * Pick up whatever the peer sent on the socket itself, which is
+ * doorbells, FDs and possibly EOF. Errors and EOF are remembered
+ * for the next read or write to report.
+ *
+ * FDs are only sent after the message announcing them, and all of
+ * them are picked up before the next message is read. So draining
+ * stops after the first FDs, leaving those of any later message in
+ * the socket, and a peer queueing more FDs than a single message
+ * can carry is sending them unasked and gets cut off.
+ *
+ * @sock: a locked socket object
+ */
+static int virNetSocketShmDrain(virNetSocketPtr sock)
+{
+    char buf[64];
+    char control[CMSG_SPACE(sizeof(int) * VIR_NET_SOCKET_SHM_MAX_FDS)];
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    ssize_t ret;
+    size_t nfds;
+    size_t i;
+    bool gotFDs = false;
+
+    while (!gotFDs && !sock->shmEOF && !sock->shmErrno) {
+        memset(&msg, 0, sizeof(msg));
+        iov.iov_base = buf;
+        iov.iov_len = sizeof(buf);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if ((ret = recvmsg(sock->fd, &msg,
+                           MSG_DONTWAIT | MSG_CMSG_CLOEXEC)) < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                sock->shmErrno = errno;
+            break;
+        }
+
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            int *fds = (int *) CMSG_DATA(cmsg);
+
+            if (cmsg->cmsg_level != SOL_SOCKET ||
+                cmsg->cmsg_type != SCM_RIGHTS)
+                continue;
+
+            nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (i = 0; i < nfds; i++) {
+                int fd = fds[i];
+
+                PROBE(RPC_SOCKET_RECV_FD,
+                      "sock=%p fd=%d", sock, fd);
+                gotFDs = true;
+                if (sock->nshmFDs >= VIR_NET_MESSAGE_NUM_FDS_MAX) {
+                    VIR_FORCE_CLOSE(fd);
+                    sock->shmErrno = EPROTO;
+                } else if (virSetCloseExec(fd) < 0 ||
+                           VIR_APPEND_ELEMENT(sock->shmFDs,
+                                              sock->nshmFDs, fd) < 0) {
+                    VIR_FORCE_CLOSE(fd);
+                    sock->shmErrno = ENOMEM;
+                }
+            }
+        }
+
+        if (msg.msg_flags & MSG_CTRUNC)
+            sock->shmErrno = EMSGSIZE;
+
+        if (ret == 0)
+            sock->shmEOF = true;
+    }
+
+    return sock->shmErrno ? -1 : 0;
+}
+
+
+/*
+ * Tell the peer about data or space in the channel.
+ *
+ * @sock: a locked socket object
+ */
+static void virNetSocketShmRing(virNetSocketPtr sock)
+{
+    char bell = 0;
+
+    /* A full socket buffer has doorbells in it already */
+    while (send(sock->fd, &bell, 1, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN)
+            sock->shmErrno = errno;
+        break;
+    }
+}
+
+
+static ssize_t virNetSocketShmRead(virNetSocketPtr sock, char *buf, size_t len)
+{
+    ssize_t ret;
+    bool wake;
+    bool wakeAgain = false;
+
+    if ((ret = virNetShmChannelRead(sock->shm, buf, len, &wake)) < 0)
+        return -1;
+
+    if (ret == 0) {
+        /* Data may have come along with the last doorbells */
+        ignore_value(virNetSocketShmDrain(sock));
+        if ((ret = virNetShmChannelRead(sock->shm, buf, len, &wakeAgain)) < 0)
+            return -1;
+    }
+
+    if (wake || wakeAgain)
+        virNetSocketShmRing(sock);
+
+    if (ret > 0)
+        return ret;
+
+    if (sock->shmErrno) {
+        virReportSystemError(sock->shmErrno, "%s",
+                             _("Cannot recv data"));
+        return -1;
+    }
+
+    if (sock->shmEOF) {
+        if (sock->quietEOF) {
+            VIR_DEBUG("socket='%p' EOF while reading", sock);
+            return -2;
+        }
+        virReportSystemError(EIO, "%s",
+                             _("End of file while reading data"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static ssize_t virNetSocketShmWrite(virNetSocketPtr sock, const char *buf, size_t len)
+{
+    ssize_t ret;
+    bool wake;
+
+    if (sock->shmErrno) {
+        virReportSystemError(sock->shmErrno, "%s",
+                             _("Cannot write data"));
+        return -1;
+    }
+
+    if (sock->shmEOF) {
+        virReportSystemError(EIO, "%s",
+                             _("End of file while writing data"));
+        return -1;
+    }
+
+    if ((ret = virNetShmChannelWrite(sock->shm, buf, len, &wake)) < 0)
+        return -1;
+
+    if (wake)
+        virNetSocketShmRing(sock);
+
+    return ret;
+}
+
+
+/*
+ * Translate the events the owner of @sock is interested in to
+ * those to watch on its file descriptor. With a shared memory
+ * channel, the descriptor turns readable when the peer rings the
+ * doorbell, and watching it for writability as well makes sure
+ * data already sitting in the channel is noticed straight away.
+ *
+ * @sock: a locked socket object
+ */
+static int virNetSocketGetWireEventsLocked(virNetSocketPtr sock,
+                                           int events)
+{
+    int wire = 0;
+
+    if (!sock->shm)
+        return events;
+
+    if (events & VIR_EVENT_HANDLE_READABLE) {
+        wire |= VIR_EVENT_HANDLE_READABLE;
+        if (virNetShmChannelWaitData(sock->shm) ||
+            sock->shmEOF || sock->shmErrno)
+            wire |= VIR_EVENT_HANDLE_WRITABLE;
+    }
+
+    if (events & VIR_EVENT_HANDLE_WRITABLE) {
+        if (virNetShmChannelWaitSpace(sock->shm))
+            wire |= VIR_EVENT_HANDLE_WRITABLE;
+        else
+            wire |= VIR_EVENT_HANDLE_READABLE;
+    }
+
+    return wire;
+}
+
+
+/*
+ * Translate the events reported for the file descriptor of @sock
+ * to those its owner, interested in @events, is to act on.
+ *
+ * @sock: a locked socket object
+ */
+static int virNetSocketGetReadyEventsLocked(virNetSocketPtr sock,
+                                            int events,
+                                            int revents)
+{
+    int ready;
+
+    if (!sock->shm)
+        return revents;
+
+    if (revents & (VIR_EVENT_HANDLE_READABLE |
+                   VIR_EVENT_HANDLE_HANGUP |
+                   VIR_EVENT_HANDLE_ERROR))
+        ignore_value(virNetSocketShmDrain(sock));
+
+    ready = revents & (VIR_EVENT_HANDLE_HANGUP | VIR_EVENT_HANDLE_ERROR);
+
+    if ((events & VIR_EVENT_HANDLE_READABLE) &&
+        (virNetShmChannelHasData(sock->shm) ||
+         sock->shmEOF || sock->shmErrno))
+        ready |= VIR_EVENT_HANDLE_READABLE;
+
+    if ((events & VIR_EVENT_HANDLE_WRITABLE) &&
+        (virNetShmChannelHasSpace(sock->shm) ||
+         sock->shmEOF || sock->shmErrno))
+        ready |= VIR_EVENT_HANDLE_WRITABLE;
+
+    return ready;
+}
+
+
+/**
+ * virNetSocketGetWireEvents:
+ * @sock: the socket
+ * @events: the VIR_EVENT_HANDLE_* events the caller waits for
+ *
+ * For callers polling the file descriptor of @sock themselves,
+ * returns the events to poll it for.
+ */
+int virNetSocketGetWireEvents(virNetSocketPtr sock,
+                              int events)
+{
+    int ret;
+
+    virObjectLock(sock);
+    ret = virNetSocketGetWireEventsLocked(sock, events);
+    virObjectUnlock(sock);
+    return ret;
+}
+
+
+/**
+ * virNetSocketGetReadyEvents:
+ * @sock: the socket
+ * @events: the VIR_EVENT_HANDLE_* events the caller waits for
+ * @revents: the events reported for the file descriptor
+ *
+ * For callers polling the file descriptor of @sock themselves,
+ * returns the events which actually occurred.
+ */
+int virNetSocketGetReadyEvents(virNetSocketPtr sock,
+                               int events,
+                               int revents)
+{
+    int ret;
+
+    virObjectLock(sock);
+    ret = virNetSocketGetReadyEventsLocked(sock, events, revents);
+    virObjectUnlock(sock);
+    return ret;
+}
+
+
+/**
+ * virNetSocketSetShmChannel:
+ * @sock: the socket
+ * @chan: the shared memory channel
+ *
+ * Send and receive all further data through @chan, leaving @sock
+ * for waking up the peer and passing FDs. This must happen at the
+ * same point of the data stream on both ends, i.e. when neither of
+ * them has anything left to read from @sock.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int virNetSocketSetShmChannel(virNetSocketPtr sock,
+                              virNetShmChannelPtr chan)
+{
+    int ret = -1;
+
+    virObjectLock(sock);
+
+    if (!virNetSocketCanUseShmLocked(sock)) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("shared memory channels need a plain local socket"));
+        goto cleanup;
+    }
+
+    VIR_DEBUG("sock=%p chan=%p", sock, chan);
+    sock->shm = virObjectRef(chan);
+
+    if (sock->watch >= 0)
+        virEventUpdateHandle(sock->watch,
+                             virNetSocketGetWireEventsLocked(sock, sock->events));
+
+    ret = 0;
+ cleanup:
+    virObjectUnlock(sock);
+    return ret;
+}
+
+
 bool virNetSocketHasCachedData(virNetSocketPtr sock ATTRIBUTE_UNUSED)
 {
     bool hasCached = false;
@@ -1693,6 +2095,11 @@ bool virNetSocketHasCachedData(virNetSocketPtr sock ATTRIBUTE_UNUSED)
     if (sock->saslDecoded)
         hasCached = true;
 #endif
+
+    if (sock->shm &&
+        (virNetShmChannelHasData(sock->shm) ||
+         sock->shmEOF || sock->shmErrno))
+        hasCached = true;
     virObjectUnlock(sock);
     return hasCached;
 }
@@ -1747,6 +2154,9 @@ static ssize_t virNetSocketReadWire(virNetSocketPtr sock, char *buf, size_t len)
     char *errout = NULL;
     ssize_t ret;
 
+    if (sock->shm)
+        return virNetSocketShmRead(sock, buf, len);
+
 #if WITH_SSH2
     if (sock->sshSession)
         return virNetSocketLibSSH2Read(sock, buf, len);
@@ -1820,6 +2230,9 @@ static ssize_t virNetSocketWriteWire(virNetSocketPtr sock, const char *buf, size
 {
     ssize_t ret;
 
+    if (sock->shm)
+        return virNetSocketShmWrite(sock, buf, len);
+
 #if WITH_SSH2
     if (sock->sshSession)
         return virNetSocketLibSSH2Write(sock, buf, len);
@@ -1863,6 +2276,81 @@ static ssize_t virNetSocketWriteWire(virNetSocketPtr sock, const char *buf, size
 }
 
 
+/*
+ * Only a plain file descriptor can take a whole vector in one
+ * go, anything layered on top of it is fed one element at a time.
+ */
+static bool virNetSocketIsPlainWire(virNetSocketPtr sock)
+{
+    if (sock->shm)
+        return false;
+
+#if WITH_SSH2
+    if (sock->sshSession)
+        return false;
+#endif
+
+#if WITH_LIBSSH
+    if (sock->libsshSession)
+        return false;
+#endif
+
+#if WITH_GNUTLS
+    if (sock->tlsSession &&
+        virNetTLSSessionGetHandshakeStatus(sock->tlsSession) ==
+        VIR_NET_TLS_HANDSHAKE_COMPLETE)
+        return false;
+#endif
+
+    return true;
+}
+
+
+static ssize_t virNetSocketWritevWire(virNetSocketPtr sock,
+                                      const struct iovec *iov,
+                                      size_t niov)
+{
+    ssize_t ret;
+    size_t done = 0;
+    size_t i;
+
+    if (!virNetSocketIsPlainWire(sock)) {
+        /* Stop at the first short write, so a session which
+         * returned EAGAIN is retried with the very same data */
+        for (i = 0; i < niov; i++) {
+            ret = virNetSocketWriteWire(sock, iov[i].iov_base, iov[i].iov_len);
+            if (ret < 0)
+                return -1;
+            done += ret;
+            if ((size_t)ret < iov[i].iov_len)
+                break;
+        }
+        return done;
+    }
+
+ rewrite:
+    ret = writev(sock->fd, iov, niov);
+
+    if (ret < 0) {
+        if (errno == EINTR)
+            goto rewrite;
+        if (errno == EAGAIN)
+            return 0;
+
+        virReportSystemError(errno, "%s",
+                             _("Cannot write data"));
+        return -1;
+    }
+    if (ret == 0) {
+        virReportSystemError(EIO, "%s",
+                             _("End of file while writing data"));
+        return -1;
+    }
+
+    return ret;
+}
+
+
 #if WITH_SASL
 static ssize_t virNetSocketReadSASL(virNetSocketPtr sock, char *buf, size_t len)
 {
@@ -2000,6 +2488,32 @@ ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len)
 }
 
 
+/*
+ * Write out the contents of @iov, in order. Like virNetSocketWrite
+ * this may write less than requested, returning 0 on EAGAIN.
+ */
+ssize_t virNetSocketWritev(virNetSocketPtr sock,
+                           const struct iovec *iov,
+                           size_t niov)
+{
+    ssize_t ret;
+
+    if (niov == 0)
+        return 0;
+
+    virObjectLock(sock);
+#if WITH_SASL
+    /* SASL encodes a bounded amount of data at a time anyway */
+    if (sock->saslSession)
+        ret = virNetSocketWriteSASL(sock, iov[0].iov_base, iov[0].iov_len);
+    else
+#endif
+        ret = virNetSocketWritevWire(sock, iov, niov);
+    virObjectUnlock(sock);
+    return ret;
+}
+
+
 /*
  * Returns 1 if an FD was sent, 0 if it would block, -1 on error
  */
@@ -2047,6 +2561,31 @@ int virNetSocketRecvFD(virNetSocketPtr sock, int *fd)
     }
     virObjectLock(sock);
 
+    /* FDs come along with the doorbells, which may have been drained
+     * already while waiting for the message announcing them */
+    if (sock->shm) {
+        if (sock->nshmFDs == 0)
+            ignore_value(virNetSocketShmDrain(sock));
+        if (sock->shmErrno) {
+            virReportSystemError(sock->shmErrno, "%s",
+                                 _("Failed to recv file descriptor"));
+            goto cleanup;
+        }
+        if (sock->nshmFDs == 0) {
+            if (sock->shmEOF) {
+                virReportSystemError(EIO, "%s",
+                                     _("Failed to recv file descriptor"));
+                goto cleanup;
+            }
+            ret = 0;
+            goto cleanup;
+        }
+        *fd = sock->shmFDs[0];
+        VIR_DELETE_ELEMENT(sock->shmFDs, 0, sock->nshmFDs);
+        ret = 1;
+        goto cleanup;
+    }
+
     if ((*fd = recvfd(sock->fd, O_CLOEXEC)) < 0) {
         if (errno == EAGAIN)
             ret = 0;
@@ -2138,10 +2677,28 @@ static void virNetSocketEventHandle(int watch ATTRIBUTE_UNUSED,
     virObjectLock(sock);
     func = sock->func;
     eopaque = sock->opaque;
+    if (!sock->shm) {
+        virObjectUnlock(sock);
+        if (func)
+            func(sock, events, eopaque);
+        return;
+    }
+
+    events = virNetSocketGetReadyEventsLocked(sock, sock->events, events);
+    virObjectRef(sock);
     virObjectUnlock(sock);
 
-    if (func)
+    if (func && events)
         func(sock, events, eopaque);
+
+    /* Whether the channel has data or space may have changed
+     * without anyone updating the watch */
+    virObjectLock(sock);
+    if (sock->watch >= 0)
+        virEventUpdateHandle(sock->watch,
+                             virNetSocketGetWireEventsLocked(sock, sock->events));
+    virObjectUnlock(sock);
+    virObjectUnref(sock);
 }
 
 
@@ -2165,11 +2722,16 @@ static void virNetSocketEventFree(void *opaque)
     virObjectUnref(sock);
 }
 
-int virNetSocketAddIOCallback(virNetSocketPtr sock,
-                              int events,
-                              virNetSocketIOFunc func,
-                              void *opaque,
-                              virFreeCallback ff)
+/*
+ * @ioLoop: the socket carries a client connection, so the event
+ * loop may serve it from one of its dedicated I/O loops
+ */
+int virNetSocketAddIOCallbackFull(virNetSocketPtr sock,
+                                  int events,
+                                  virNetSocketIOFunc func,
+                                  void *opaque,
+                                  virFreeCallback ff,
+                                  bool ioLoop)
 {
     int ret = -1;
 
@@ -2180,11 +2742,22 @@ int virNetSocketAddIOCallback(virNetSocketPtr sock,
         goto cleanup;
     }
 
-    if ((sock->watch = virEventAddHandle(sock->fd,
-                                         events,
-                                         virNetSocketEventHandle,
-                                         sock,
-                                         virNetSocketEventFree)) < 0) {
+    sock->events = events;
+    events = virNetSocketGetWireEventsLocked(sock, events);
+
+    if (ioLoop)
+        sock->watch = virEventAddIOHandle(sock->fd,
+                                          events,
+                                          virNetSocketEventHandle,
+                                          sock,
+                                          virNetSocketEventFree);
+    else
+        sock->watch = virEventAddHandle(sock->fd,
+                                        events,
+                                        virNetSocketEventHandle,
+                                        sock,
+                                        virNetSocketEventFree);
+    if (sock->watch < 0) {
         VIR_DEBUG("Failed to register watch on socket %p", sock);
         goto cleanup;
     }
@@ -2201,6 +2774,16 @@ int virNetSocketAddIOCallback(virNetSocketPtr sock,
     return ret;
 }
 
+int virNetSocketAddIOCallback(virNetSocketPtr sock,
+                              int events,
+                              virNetSocketIOFunc func,
+                              void *opaque,
+                              virFreeCallback ff)
+{
+    return virNetSocketAddIOCallbackFull(sock, events, func,
+                                         opaque, ff, false);
+}
+
 void virNetSocketUpdateIOCallback(virNetSocketPtr sock,
                                   int events)
 {
@@ -2211,7 +2794,9 @@ void virNetSocketUpdateIOCallback(virNetSocketPtr sock,
         return;
     }
 
-    virEventUpdateHandle(sock->watch, events);
+    sock->events = events;
+    virEventUpdateHandle(sock->watch,
+                         virNetSocketGetWireEventsLocked(sock, events));
 
     virObjectUnlock(sock);
 }
@@ -24,6 +24,8 @@
 #ifndef __VIR_NET_SOCKET_H__
 # define __VIR_NET_SOCKET_H__
 
+# include <sys/uio.h>
+
 # include "virsocketaddr.h"
 # include "vircommand.h"
 # ifdef WITH_GNUTLS
@@ -35,6 +37,7 @@
 # endif
 # include "virjson.h"
 # include "viruri.h"
+# include "virnetshmchannel.h"
 
 typedef struct _virNetSocket virNetSocket;
 typedef virNetSocket *virNetSocketPtr;
@@ -149,6 +152,9 @@ void virNetSocketSetQuietEOF(virNetSocketPtr sock);
 
 ssize_t virNetSocketRead(virNetSocketPtr sock, char *buf, size_t len);
 ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len);
+ssize_t virNetSocketWritev(virNetSocketPtr sock,
+                           const struct iovec *iov,
+                           size_t niov);
 
 int virNetSocketSendFD(virNetSocketPtr sock, int fd);
 int virNetSocketRecvFD(virNetSocketPtr sock, int *fd);
@@ -165,6 +171,16 @@ void virNetSocketSetSASLSession(virNetSocketPtr sock,
 bool virNetSocketHasCachedData(virNetSocketPtr sock);
 bool virNetSocketHasPendingData(virNetSocketPtr sock);
 
+bool virNetSocketCanUseShm(virNetSocketPtr sock);
+int virNetSocketSetShmChannel(virNetSocketPtr sock,
+                              virNetShmChannelPtr chan);
+
+int virNetSocketGetWireEvents(virNetSocketPtr sock,
+                              int events);
+int virNetSocketGetReadyEvents(virNetSocketPtr sock,
+                               int events,
+                               int revents);
+
 const char *virNetSocketLocalAddrStringSASL(virNetSocketPtr sock);
 const char *virNetSocketRemoteAddrStringSASL(virNetSocketPtr sock);
 const char *virNetSocketRemoteAddrStringURI(virNetSocketPtr sock);
@@ -178,6 +194,12 @@ int virNetSocketAddIOCallback(virNetSocketPtr sock,
                               virNetSocketIOFunc func,
                               void *opaque,
                               virFreeCallback ff);
+int virNetSocketAddIOCallbackFull(virNetSocketPtr sock,
+                                  int events,
+                                  virNetSocketIOFunc func,
+                                  void *opaque,
+                                  virFreeCallback ff,
+                                  bool ioLoop);
 
 void virNetSocketUpdateIOCallback(virNetSocketPtr sock,
                                   int events);
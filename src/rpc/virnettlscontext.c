@@ -36,6 +36,7 @@
 #include "viralloc.h"
 #include "virerror.h"
 #include "virfile.h"
+#include "virhash.h"
 #include "virutil.h"
 #include "virlog.h"
 #include "virprobe.h"
@@ -44,6 +45,15 @@
 
 #define DH_BITS 2048
 
+/* Session resumption needs the NewSessionTicket hook for TLS 1.3,
+ * where tickets only arrive once the handshake completed */
+#ifdef HAVE_GNUTLS_HANDSHAKE_SET_HOOK_FUNCTION
+# define VIR_NET_TLS_RESUMPTION 1
+#endif
+
+/* How many sessions a client process remembers for resuming */
+#define VIR_NET_TLS_SESSION_CACHE_MAX 256
+
 #define LIBVIRT_PKI_DIR SYSCONFDIR "/pki"
 #define LIBVIRT_CACERT LIBVIRT_PKI_DIR "/CA/cacert.pem"
 #define LIBVIRT_CACRL LIBVIRT_PKI_DIR "/CA/cacrl.pem"
@@ -66,15 +76,30 @@ struct _virNetTLSContext {
     bool requireValidCert;
     const char *const*x509dnWhitelist;
     char *priority;
+
+    /* Server side session tickets, disabled if ticketLifetime is 0 */
+    unsigned int ticketLifetime;
+    gnutls_datum_t ticketKey;
+    time_t ticketKeyCreated;
+
+    /* Client side prefix of session cache keys */
+    char *cacheKey;
+
+    unsigned long long handshakesFull;
+    unsigned long long handshakesResumed;
 };
 
 struct _virNetTLSSession {
     virObjectLockable parent;
 
     bool handshakeComplete;
+    bool resumed;
 
+    virNetTLSContextPtr ctxt;
     bool isServer;
     char *hostname;
+    char *cacheKey;
+    bool ticketPending;
     gnutls_session_t session;
     virNetTLSSessionWriteFunc writeFunc;
     virNetTLSSessionReadFunc readFunc;
@@ -87,9 +112,42 @@ static virClassPtr virNetTLSSessionClass;
 static void virNetTLSContextDispose(void *obj);
 static void virNetTLSSessionDispose(void *obj);
 
+#ifdef VIR_NET_TLS_RESUMPTION
+typedef struct _virNetTLSSessionCacheEntry virNetTLSSessionCacheEntry;
+typedef virNetTLSSessionCacheEntry *virNetTLSSessionCacheEntryPtr;
+struct _virNetTLSSessionCacheEntry {
+    gnutls_datum_t data;
+    time_t stored;
+};
+
+static virMutex virNetTLSSessionCacheLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virNetTLSSessionCache;
+
+
+static void
+virNetTLSSessionCacheEntryFree(void *payload,
+                               const void *name ATTRIBUTE_UNUSED)
+{
+    virNetTLSSessionCacheEntryPtr entry = payload;
+
+    if (!entry)
+        return;
+
+    memset(entry->data.data, 0, entry->data.size);
+    gnutls_free(entry->data.data);
+    VIR_FREE(entry);
+}
+#endif /* VIR_NET_TLS_RESUMPTION */
+
 
 static int virNetTLSContextOnceInit(void)
 {
+#ifdef VIR_NET_TLS_RESUMPTION
+    if (!(virNetTLSSessionCache = virHashCreate(32,
+                                                virNetTLSSessionCacheEntryFree)))
+        return -1;
+#endif
+
     if (!(virNetTLSContextClass = virClassNew(virClassForObjectLockable(),
                                               "virNetTLSContext",
                                               sizeof(virNetTLSContext),
@@ -754,6 +812,11 @@ static virNetTLSContextPtr virNetTLSContextNew(const char *cacert,
                                          ctxt->dhParams);
     }
 
+    /* Sessions are only resumed with the same credentials */
+    if (!isServer &&
+        virAsprintf(&ctxt->cacheKey, "%s\n%s", cacert, NULLSTR(cert)) < 0)
+        goto error;
+
     ctxt->requireValidCert = requireValidCert;
     ctxt->x509dnWhitelist = x509dnWhitelist;
     ctxt->isServer = isServer;
@@ -768,6 +831,7 @@ static virNetTLSContextPtr virNetTLSContextNew(const char *cacert,
     if (isServer)
         gnutls_dh_params_deinit(ctxt->dhParams);
     gnutls_certificate_free_credentials(ctxt->x509cred);
+    VIR_FREE(ctxt->cacheKey);
     VIR_FREE(ctxt);
     return NULL;
 }
@@ -988,7 +1052,14 @@ static int virNetTLSContextValidCertificate(virNetTLSContextPtr ctxt,
 
     memset(dname, 0, dnamesize);
 
-    if ((ret = gnutls_certificate_verify_peers2(sess->session, &status)) < 0) {
+    /* The chain was verified when the session was first established and
+     * the peer couldn't have resumed it without knowing its secrets.
+     * Only the cheap checks below are repeated. */
+    if (sess->resumed) {
+        VIR_DEBUG("Not verifying the chain of resumed session %p", sess);
+        status = 0;
+    } else if ((ret = gnutls_certificate_verify_peers2(sess->session,
+                                                       &status)) < 0) {
         virReportError(VIR_ERR_SYSTEM_ERROR,
                        _("Unable to verify TLS peer: %s"),
                        gnutls_strerror(ret));
@@ -1149,11 +1220,197 @@ void virNetTLSContextDispose(void *obj)
           "ctxt=%p", ctxt);
 
     VIR_FREE(ctxt->priority);
+    VIR_FREE(ctxt->cacheKey);
+    if (ctxt->ticketKey.data) {
+        memset(ctxt->ticketKey.data, 0, ctxt->ticketKey.size);
+        gnutls_free(ctxt->ticketKey.data);
+    }
     gnutls_dh_params_deinit(ctxt->dhParams);
     gnutls_certificate_free_credentials(ctxt->x509cred);
 }
 
 
+/**
+ * virNetTLSContextSetSessionTickets:
+ * @ctxt: server TLS context
+ * @lifetime: lifetime of session tickets in seconds, 0 to disable them
+ *
+ * Let clients resume their TLS sessions, saving the key exchange and
+ * the verification of their certificate chain when they reconnect.
+ * The key protecting the tickets is replaced once it is @lifetime
+ * seconds old, which invalidates all the tickets it protected.
+ */
+void virNetTLSContextSetSessionTickets(virNetTLSContextPtr ctxt,
+                                       unsigned int lifetime)
+{
+    virObjectLock(ctxt);
+    ctxt->ticketLifetime = lifetime;
+    virObjectUnlock(ctxt);
+}
+
+
+/**
+ * virNetTLSContextGetHandshakeStats:
+ * @ctxt: TLS context
+ * @full: filled with the number of full handshakes
+ * @resumed: filled with the number of handshakes resuming a session
+ *
+ * Report how many handshakes completed on sessions of @ctxt.
+ */
+void virNetTLSContextGetHandshakeStats(virNetTLSContextPtr ctxt,
+                                       unsigned long long *full,
+                                       unsigned long long *resumed)
+{
+    virObjectLock(ctxt);
+    *full = ctxt->handshakesFull;
+    *resumed = ctxt->handshakesResumed;
+    virObjectUnlock(ctxt);
+}
+
+
+#ifdef VIR_NET_TLS_RESUMPTION
+/* Must be called with @ctxt locked */
+static int
+virNetTLSContextEnableTickets(virNetTLSContextPtr ctxt,
+                              virNetTLSSessionPtr sess)
+{
+    time_t now = time(NULL);
+    int err;
+
+    if (!ctxt->ticketKey.data ||
+        now - ctxt->ticketKeyCreated >= ctxt->ticketLifetime) {
+        gnutls_datum_t key;
+
+        if ((err = gnutls_session_ticket_key_generate(&key)) < 0) {
+            virReportError(VIR_ERR_SYSTEM_ERROR,
+                           _("Unable to generate TLS session ticket key: %s"),
+                           gnutls_strerror(err));
+            return -1;
+        }
+
+        if (ctxt->ticketKey.data) {
+            memset(ctxt->ticketKey.data, 0, ctxt->ticketKey.size);
+            gnutls_free(ctxt->ticketKey.data);
+        }
+        ctxt->ticketKey = key;
+        ctxt->ticketKeyCreated = now;
+        VIR_DEBUG("Generated new session ticket key for ctxt=%p", ctxt);
+    }
+
+    if ((err = gnutls_session_ticket_enable_server(sess->session,
+                                                   &ctxt->ticketKey)) < 0) {
+        virReportError(VIR_ERR_SYSTEM_ERROR,
+                       _("Unable to enable TLS session tickets: %s"),
+                       gnutls_strerror(err));
+        return -1;
+    }
+
+    gnutls_db_set_cache_expiration(sess->session, ctxt->ticketLifetime);
+
+    return 0;
+}
+
+
+/* Must be called with @sess locked */
+static void
+virNetTLSSessionCacheStore(virNetTLSSessionPtr sess)
+{
+    virNetTLSSessionCacheEntryPtr entry = NULL;
+    int err;
+
+    sess->ticketPending = false;
+
+    if (VIR_ALLOC(entry) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    if ((err = gnutls_session_get_data2(sess->session, &entry->data)) < 0) {
+        VIR_DEBUG("Unable to get TLS session data: %s", gnutls_strerror(err));
+        VIR_FREE(entry);
+        return;
+    }
+    entry->stored = time(NULL);
+
+    virMutexLock(&virNetTLSSessionCacheLock);
+
+    /* Make room by forgetting about the oldest session */
+    if (!virHashLookup(virNetTLSSessionCache, sess->cacheKey) &&
+        virHashSize(virNetTLSSessionCache) >= VIR_NET_TLS_SESSION_CACHE_MAX) {
+        virHashKeyValuePairPtr items = virHashGetItems(virNetTLSSessionCache,
+                                                       NULL);
+        const void *oldest = NULL;
+        time_t oldestStored = 0;
+        size_t i;
+
+        for (i = 0; items && items[i].key; i++) {
+            virNetTLSSessionCacheEntryPtr tmp = (void *) items[i].value;
+
+            if (!oldest || tmp->stored < oldestStored) {
+                oldest = items[i].key;
+                oldestStored = tmp->stored;
+            }
+        }
+        if (oldest)
+            virHashRemoveEntry(virNetTLSSessionCache, oldest);
+        VIR_FREE(items);
+    }
+
+    if (virHashUpdateEntry(virNetTLSSessionCache, sess->cacheKey, entry) < 0) {
+        virResetLastError();
+        virNetTLSSessionCacheEntryFree(entry, NULL);
+    } else {
+        VIR_DEBUG("Stored TLS session for %s", sess->hostname);
+    }
+
+    virMutexUnlock(&virNetTLSSessionCacheLock);
+}
+
+
+/* Must be called with @sess locked */
+static void
+virNetTLSSessionCacheRestore(virNetTLSSessionPtr sess)
+{
+    virNetTLSSessionCacheEntryPtr entry;
+    int err;
+
+    virMutexLock(&virNetTLSSessionCacheLock);
+
+    /* Tickets are used only once, a fresh one replaces it if the
+     * server still accepts it */
+    if ((entry = virHashLookup(virNetTLSSessionCache, sess->cacheKey))) {
+        if ((err = gnutls_session_set_data(sess->session,
+                                           entry->data.data,
+                                           entry->data.size)) < 0)
+            VIR_DEBUG("Unable to restore TLS session: %s",
+                      gnutls_strerror(err));
+        else
+            VIR_DEBUG("Trying to resume TLS session for %s", sess->hostname);
+        virHashRemoveEntry(virNetTLSSessionCache, sess->cacheKey);
+    }
+
+    virMutexUnlock(&virNetTLSSessionCacheLock);
+}
+
+
+static int
+virNetTLSSessionTicketHook(gnutls_session_t session,
+                           unsigned int htype ATTRIBUTE_UNUSED,
+                           unsigned int when ATTRIBUTE_UNUSED,
+                           unsigned int incoming ATTRIBUTE_UNUSED,
+                           const gnutls_datum_t *msg ATTRIBUTE_UNUSED)
+{
+    virNetTLSSessionPtr sess = gnutls_session_get_ptr(session);
+
+    /* With TLS 1.2 the ticket is part of the handshake and the session
+     * data is only complete once it is over, with TLS 1.3 it arrives
+     * with application data later on. */
+    sess->ticketPending = true;
+    return 0;
+}
+#endif /* VIR_NET_TLS_RESUMPTION */
+
+
 static ssize_t
 virNetTLSSessionPush(void *opaque, const void *buf, size_t len)
 {
@@ -1237,6 +1494,29 @@ virNetTLSSessionPtr virNetTLSSessionNew(virNetTLSContextPtr ctxt,
         gnutls_dh_set_prime_bits(sess->session, DH_BITS);
     }
 
+#ifdef VIR_NET_TLS_RESUMPTION
+    if (ctxt->isServer) {
+        virObjectLock(ctxt);
+        if (ctxt->ticketLifetime > 0 &&
+            virNetTLSContextEnableTickets(ctxt, sess) < 0) {
+            virObjectUnlock(ctxt);
+            goto error;
+        }
+        virObjectUnlock(ctxt);
+    } else if (hostname) {
+        if (virAsprintf(&sess->cacheKey, "%s\n%s",
+                        ctxt->cacheKey, hostname) < 0)
+            goto error;
+
+        gnutls_session_set_ptr(sess->session, sess);
+        gnutls_handshake_set_hook_function(sess->session,
+                                           GNUTLS_HANDSHAKE_NEW_SESSION_TICKET,
+                                           GNUTLS_HOOK_POST,
+                                           virNetTLSSessionTicketHook);
+        virNetTLSSessionCacheRestore(sess);
+    }
+#endif
+
     gnutls_transport_set_ptr(sess->session, sess);
     gnutls_transport_set_push_function(sess->session,
                                        virNetTLSSessionPush);
@@ -1244,6 +1524,7 @@ virNetTLSSessionPtr virNetTLSSessionNew(virNetTLSContextPtr ctxt,
                                        virNetTLSSessionPull);
 
     sess->isServer = ctxt->isServer;
+    sess->ctxt = virObjectRef(ctxt);
 
     PROBE(RPC_TLS_SESSION_NEW,
           "sess=%p ctxt=%p hostname=%s isServer=%d",
@@ -1311,6 +1592,11 @@ ssize_t virNetTLSSessionRead(virNetTLSSessionPtr sess,
     virObjectLock(sess);
     ret = gnutls_record_recv(sess->session, buf, len);
 
+#ifdef VIR_NET_TLS_RESUMPTION
+    if (sess->ticketPending && sess->handshakeComplete)
+        virNetTLSSessionCacheStore(sess);
+#endif
+
     if (ret >= 0)
         goto cleanup;
 
@@ -1342,7 +1628,12 @@ int virNetTLSSessionHandshake(virNetTLSSessionPtr sess)
     VIR_DEBUG("Ret=%d", ret);
     if (ret == 0) {
         sess->handshakeComplete = true;
-        VIR_DEBUG("Handshake is complete");
+        sess->resumed = gnutls_session_is_resumed(sess->session) != 0;
+        VIR_DEBUG("Handshake is complete, resumed=%d", sess->resumed);
+#ifdef VIR_NET_TLS_RESUMPTION
+        if (sess->ticketPending)
+            virNetTLSSessionCacheStore(sess);
+#endif
         goto cleanup;
     }
     if (ret == GNUTLS_E_INTERRUPTED || ret == GNUTLS_E_AGAIN) {
@@ -1362,6 +1653,17 @@ int virNetTLSSessionHandshake(virNetTLSSessionPtr sess)
 
  cleanup:
     virObjectUnlock(sess);
+
+    /* The context is locked before sessions elsewhere */
+    if (ret == 0) {
+        virObjectLock(sess->ctxt);
+        if (sess->resumed)
+            sess->ctxt->handshakesResumed++;
+        else
+            sess->ctxt->handshakesFull++;
+        virObjectUnlock(sess->ctxt);
+    }
+
     return ret;
 }
 
@@ -1398,6 +1700,17 @@ int virNetTLSSessionGetKeySize(virNetTLSSessionPtr sess)
     return ssf;
 }
 
+bool virNetTLSSessionIsResumed(virNetTLSSessionPtr sess)
+{
+    bool ret;
+
+    virObjectLock(sess);
+    ret = sess->resumed;
+    virObjectUnlock(sess);
+
+    return ret;
+}
+
 const char *virNetTLSSessionGetX509DName(virNetTLSSessionPtr sess)
 {
     const char *ret = NULL;
@@ -1420,7 +1733,9 @@ void virNetTLSSessionDispose(void *obj)
 
     VIR_FREE(sess->x509dname);
     VIR_FREE(sess->hostname);
+    VIR_FREE(sess->cacheKey);
     gnutls_deinit(sess->session);
+    virObjectUnref(sess->ctxt);
 }
 
 /*
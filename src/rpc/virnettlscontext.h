@@ -66,6 +66,13 @@ virNetTLSContextPtr virNetTLSContextNewClient(const char *cacert,
 int virNetTLSContextCheckCertificate(virNetTLSContextPtr ctxt,
                                      virNetTLSSessionPtr sess);
 
+void virNetTLSContextSetSessionTickets(virNetTLSContextPtr ctxt,
+                                       unsigned int lifetime);
+
+void virNetTLSContextGetHandshakeStats(virNetTLSContextPtr ctxt,
+                                       unsigned long long *full,
+                                       unsigned long long *resumed);
+
 
 typedef ssize_t (*virNetTLSSessionWriteFunc)(const char *buf, size_t len,
                                              void *opaque);
@@ -98,6 +105,8 @@ virNetTLSSessionGetHandshakeStatus(virNetTLSSessionPtr sess);
 
 int virNetTLSSessionGetKeySize(virNetTLSSessionPtr sess);
 
+bool virNetTLSSessionIsResumed(virNetTLSSessionPtr sess);
+
 const char *virNetTLSSessionGetX509DName(virNetTLSSessionPtr sess);
 
 #endif
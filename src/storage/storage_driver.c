@@ -2364,7 +2364,8 @@ storageVolUpload(virStorageVolPtr vol,
     virStorageVolStreamInfoPtr cbdata = NULL;
     int ret = -1;
 
-    virCheckFlags(VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM, -1);
+    virCheckFlags(VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM |
+                  VIR_STORAGE_VOL_UPLOAD_RANGE, -1);
 
     if (!(voldef = virStorageVolDefFromVol(vol, &obj, &backend)))
         return -1;
@@ -2509,8 +2509,10 @@ virStorageBackendVolUploadLocal(virStoragePoolObjPtr pool ATTRIBUTE_UNUSED,
     int ret = -1;
     int has_snap = 0;
     bool sparse = flags & VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM;
+    bool partial = flags & VIR_STORAGE_VOL_UPLOAD_RANGE;
 
-    virCheckFlags(VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM, -1);
+    virCheckFlags(VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM |
+                  VIR_STORAGE_VOL_UPLOAD_RANGE, -1);
     /* if volume has target format VIR_STORAGE_FILE_PLOOP
      * we need to restore DiskDescriptor.xml, according to
      * new contents of volume. This operation will be perfomed
@@ -2535,7 +2537,8 @@ virStorageBackendVolUploadLocal(virStoragePoolObjPtr pool ATTRIBUTE_UNUSED,
     /* Not using O_CREAT because the file is required to already exist at
      * this point */
     ret = virFDStreamOpenBlockDevice(stream, target_path,
-                                     offset, len, sparse, O_WRONLY);
+                                     offset, len, sparse, partial,
+                                     O_WRONLY);
 
  cleanup:
     VIR_FREE(path);
@@ -2573,7 +2576,8 @@ virStorageBackendVolDownloadLocal(virStoragePoolObjPtr pool ATTRIBUTE_UNUSED,
     }
 
     ret = virFDStreamOpenBlockDevice(stream, target_path,
-                                     offset, len, sparse, O_RDONLY);
+                                     offset, len, sparse, false,
+                                     O_RDONLY);
 
  cleanup:
     VIR_FREE(path);
@@ -589,6 +589,25 @@ testDomObjFromDomain(virDomainPtr domain)
     return vm;
 }
 
+static int
+testDomainSummaryFromDomain(virDomainPtr domain,
+                            virDomainObjSummaryPtr summary)
+{
+    testDriverPtr driver = domain->conn->privateData;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    int rc;
+
+    rc = virDomainObjListGetSummary(driver->domains, domain->uuid, summary);
+    if (rc == 0) {
+        virUUIDFormat(domain->uuid, uuidstr);
+        virReportError(VIR_ERR_NO_DOMAIN,
+                       _("no domain with matching uuid '%s' (%s)"),
+                       uuidstr, domain->name);
+    }
+
+    return rc > 0 ? 0 : -1;
+}
+
 static char *
 testDomainGenerateIfname(virDomainDefPtr domdef)
 {
@@ -1967,10 +1986,10 @@ static int testDomainGetInfo(virDomainPtr domain,
                              virDomainInfoPtr info)
 {
     struct timeval tv;
-    virDomainObjPtr privdom;
+    virDomainObjSummary summary;
     int ret = -1;
 
-    if (!(privdom = testDomObjFromDomain(domain)))
+    if (testDomainSummaryFromDomain(domain, &summary) < 0)
         return -1;
 
     if (gettimeofday(&tv, NULL) < 0) {
@@ -1979,15 +1998,15 @@ static int testDomainGetInfo(virDomainPtr domain,
         goto cleanup;
     }
 
-    info->state = virDomainObjGetState(privdom, NULL);
-    info->memory = privdom->def->mem.cur_balloon;
-    info->maxMem = virDomainDefGetMemoryTotal(privdom->def);
-    info->nrVirtCpu = virDomainDefGetVcpus(privdom->def);
+    info->state = summary.state.state;
+    info->memory = summary.memory;
+    info->maxMem = summary.maxMem;
+    info->nrVirtCpu = summary.vcpus;
     info->cpuTime = ((tv.tv_sec * 1000ll * 1000ll  * 1000ll) + (tv.tv_usec * 1000ll));
     ret = 0;
 
  cleanup:
-    virDomainObjEndAPI(&privdom);
+    virDomainObjSummaryClear(&summary);
     return ret;
 }
 
@@ -1997,16 +2016,18 @@ testDomainGetState(virDomainPtr domain,
                    int *reason,
                    unsigned int flags)
 {
-    virDomainObjPtr privdom;
+    virDomainObjSummary summary;
 
     virCheckFlags(0, -1);
 
-    if (!(privdom = testDomObjFromDomain(domain)))
+    if (testDomainSummaryFromDomain(domain, &summary) < 0)
         return -1;
 
-    *state = virDomainObjGetState(privdom, reason);
+    *state = summary.state.state;
+    if (reason)
+        *reason = summary.state.reason;
 
-    virDomainObjEndAPI(&privdom);
+    virDomainObjSummaryClear(&summary);
 
     return 0;
 }
@@ -5870,6 +5891,22 @@ static int testConnectListAllDomains(virConnectPtr conn,
                                   NULL, flags);
 }
 
+static int
+testConnectListDomainChanges(virConnectPtr conn,
+                             unsigned long long *generation,
+                             unsigned int maxitems,
+                             virDomainPtr **domains,
+                             char ***removed,
+                             unsigned int flags)
+{
+    testDriverPtr privconn = conn->privateData;
+
+    virCheckFlags(0, -1);
+
+    return virDomainObjListExportChanges(privconn->domains, conn, generation,
+                                         maxitems, domains, removed, NULL);
+}
+
 static int
 testNodeGetCPUMap(virConnectPtr conn ATTRIBUTE_UNUSED,
                   unsigned char **cpumap,
@@ -6933,6 +6970,7 @@ static virHypervisorDriver testHypervisorDriver = {
     .domainSnapshotDelete = testDomainSnapshotDelete, /* 1.1.4 */
 
     .connectBaselineCPU = testConnectBaselineCPU, /* 1.2.0 */
+    .connectListDomainChanges = testConnectListDomainChanges, /* 4.1.0 */
 };
 
 static virNetworkDriver testNetworkDriver = {
@@ -43,6 +43,34 @@
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
+/*
+ * Move all the data from @fdin to @fdout within the kernel, as
+ * stdin or stdout is usually a pipe.
+ *
+ * Returns 1 once all the data was moved, 0 if the files don't allow
+ * it and the rest of the data has to be copied, -1 on error.
+ */
+static int
+runIOSplice(int fdin, const char *fdinname,
+            int fdout, const char *fdoutname,
+            size_t buflen)
+{
+    ssize_t got;
+
+    while ((got = virFileSplice(fdin, fdout, buflen)) > 0)
+        ;
+
+    if (got == 0)
+        return 1;
+
+    if (errno == ENOSYS)
+        return 0;
+
+    virReportSystemError(errno, _("Unable to move data from %s to %s"),
+                         fdinname, fdoutname);
+    return -1;
+}
+
 static int
 runIO(const char *path, int fd, int oflags)
 {
@@ -56,6 +84,7 @@ runIO(const char *path, int fd, int oflags)
     unsigned long long total = 0;
     bool direct = O_DIRECT && ((oflags & O_DIRECT) != 0);
     off_t end = 0;
+    int done = 0;
 
 #if HAVE_POSIX_MEMALIGN
     if (posix_memalign(&base, alignMask + 1, buflen)) {
@@ -106,7 +135,12 @@ runIO(const char *path, int fd, int oflags)
         goto cleanup;
     }
 
-    while (1) {
+    /* O_DIRECT needs the data aligned, which only copying can do */
+    if (!direct &&
+        (done = runIOSplice(fdin, fdinname, fdout, fdoutname, buflen)) < 0)
+        goto cleanup;
+
+    while (!done) {
         ssize_t got;
 
         /* If we read with O_DIRECT from file we can't use saferead as
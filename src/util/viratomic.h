@@ -152,6 +152,27 @@ VIR_STATIC unsigned int virAtomicIntXor(volatile unsigned int *atomic,
                                         unsigned int val)
     ATTRIBUTE_NONNULL(1);
 
+/**
+ * virAtomicPtrGet:
+ * Gets the current value of the pointer atomic.
+ *
+ * This call acts as a full compiler and hardware memory barrier
+ * (before the get)
+ */
+VIR_STATIC void *virAtomicPtrGet(void *volatile *atomic)
+    ATTRIBUTE_NONNULL(1);
+
+/**
+ * virAtomicPtrSet:
+ * Sets the value of the pointer atomic to newval.
+ *
+ * This call acts as a full compiler and hardware memory barrier
+ * (after the set)
+ */
+VIR_STATIC void virAtomicPtrSet(void *volatile *atomic,
+                                void *newval)
+    ATTRIBUTE_NONNULL(1);
+
 # undef VIR_STATIC
 
 # ifdef VIR_ATOMIC_OPS_GCC
@@ -213,6 +234,18 @@ VIR_STATIC unsigned int virAtomicIntXor(volatile unsigned int *atomic,
             (void) (0 ? *(atomic) ^ (val) : 0); \
             (unsigned int) __sync_fetch_and_xor((atomic), (val)); \
         }))
+#  define virAtomicPtrGet(atomic) \
+    (__extension__ ({ \
+            (void)verify_true(sizeof(*(atomic)) == sizeof(void *)); \
+            __sync_synchronize(); \
+            (void *)*(atomic); \
+        }))
+#  define virAtomicPtrSet(atomic, newval) \
+    (__extension__ ({ \
+            (void)verify_true(sizeof(*(atomic)) == sizeof(void *)); \
+            *(atomic) = (newval); \
+            __sync_synchronize(); \
+        }))
 
 
 # else
@@ -294,6 +327,21 @@ virAtomicIntXor(volatile unsigned int *atomic,
     return InterlockedXor((volatile LONG *)atomic, val);
 }
 
+static inline void *
+virAtomicPtrGet(void *volatile *atomic)
+{
+    MemoryBarrier();
+    return *atomic;
+}
+
+static inline void
+virAtomicPtrSet(void *volatile *atomic,
+                void *newval)
+{
+    *atomic = newval;
+    MemoryBarrier();
+}
+
 
 #  else
 #   ifdef VIR_ATOMIC_OPS_PTHREAD
@@ -419,6 +467,27 @@ virAtomicIntXor(volatile unsigned int *atomic,
     return oldval;
 }
 
+static inline void *
+virAtomicPtrGet(void *volatile *atomic)
+{
+    void *value;
+
+    pthread_mutex_lock(&virAtomicLock);
+    value = *atomic;
+    pthread_mutex_unlock(&virAtomicLock);
+
+    return value;
+}
+
+static inline void
+virAtomicPtrSet(void *volatile *atomic,
+                void *value)
+{
+    pthread_mutex_lock(&virAtomicLock);
+    *atomic = value;
+    pthread_mutex_unlock(&virAtomicLock);
+}
+
 
 #   else
 #    error "No atomic integer impl for this platform"
@@ -448,6 +517,10 @@ virAtomicIntXor(volatile unsigned int *atomic,
     virAtomicIntOr((unsigned int *)atomic, val)
 #  define virAtomicIntXor(atomic, val) \
     virAtomicIntXor((unsigned int *)atomic, val)
+#  define virAtomicPtrGet(atomic) \
+    virAtomicPtrGet((void *volatile *)atomic)
+#  define virAtomicPtrSet(atomic, val) \
+    virAtomicPtrSet((void *volatile *)atomic, val)
 
 # endif
 
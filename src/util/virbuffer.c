@@ -24,9 +24,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdarg.h>
 #include "c-ctype.h"
+#include "intprops.h"
 
 #define __VIR_BUFFER_C__
 
@@ -137,7 +139,7 @@ virBufferGetIndent(const virBuffer *buf, bool dynamic)
 static int
 virBufferGrow(virBufferPtr buf, unsigned int len)
 {
-    int size;
+    size_t size;
 
     if (buf->error)
         return -1;
@@ -145,7 +147,17 @@ virBufferGrow(virBufferPtr buf, unsigned int len)
     if ((len + buf->use) < buf->size)
         return 0;
 
-    size = buf->use + len + 1000;
+    /* Grow at least geometrically so that formatting a large document
+     * through many small appends doesn't reallocate for every 1000
+     * bytes written. */
+    size = (size_t) buf->use + len + 1000;
+    if (size < (size_t) buf->size * 2)
+        size = (size_t) buf->size * 2;
+
+    if (size > UINT_MAX) {
+        virBufferSetError(buf, ENOMEM);
+        return -1;
+    }
 
     if (VIR_REALLOC_N_QUIET(buf->content, size) < 0) {
         virBufferSetError(buf, errno);
@@ -155,6 +167,25 @@ virBufferGrow(virBufferPtr buf, unsigned int len)
     return 0;
 }
 
+/**
+ * virBufferSizeHint:
+ * @buf: the buffer
+ * @len: expected number of bytes still to be added
+ *
+ * Preallocate space for @len more bytes so that a formatter that can
+ * estimate the size of its output up front doesn't have to grow the
+ * buffer repeatedly.  This is purely an optimization, the buffer still
+ * grows past @len as needed.
+ */
+void
+virBufferSizeHint(virBufferPtr buf, unsigned int len)
+{
+    if (!buf || buf->error)
+        return;
+
+    ignore_value(virBufferGrow(buf, len));
+}
+
 /**
  * virBufferAdd:
  * @buf: the buffer to append to
@@ -242,6 +273,52 @@ virBufferAddChar(virBufferPtr buf, char c)
     virBufferAdd(buf, &c, 1);
 }
 
+/**
+ * virBufferAddInt:
+ * @buf: the buffer to append to
+ * @val: the number to add
+ *
+ * Add the decimal representation of @val to a buffer.  This is
+ * equivalent to virBufferAsprintf(buf, "%lld", val) without the cost
+ * of parsing a format string.  Auto indentation may be applied.
+ */
+void
+virBufferAddInt(virBufferPtr buf, long long val)
+{
+    unsigned long long uval = val;
+
+    if (val >= 0) {
+        virBufferAddUInt(buf, uval);
+        return;
+    }
+
+    virBufferAddChar(buf, '-');
+    virBufferAddUInt(buf, -uval);
+}
+
+/**
+ * virBufferAddUInt:
+ * @buf: the buffer to append to
+ * @val: the number to add
+ *
+ * Add the decimal representation of @val to a buffer.  This is
+ * equivalent to virBufferAsprintf(buf, "%llu", val) without the cost
+ * of parsing a format string.  Auto indentation may be applied.
+ */
+void
+virBufferAddUInt(virBufferPtr buf, unsigned long long val)
+{
+    char str[INT_BUFSIZE_BOUND(val)];
+    char *p = str + sizeof(str);
+
+    do {
+        *--p = '0' + val % 10;
+        val /= 10;
+    } while (val);
+
+    virBufferAdd(buf, p, str + sizeof(str) - p);
+}
+
 /**
  * virBufferCurrentContent:
  * @buf: Buffer
@@ -365,6 +442,9 @@ virBufferUse(const virBuffer *buf)
     return buf->use;
 }
 
+VIR_WARNINGS_NO_WLOGICALOP_STRCHR
+
+
 /**
  * virBufferAsprintf:
  * @buf: the buffer to append to
@@ -395,6 +475,7 @@ virBufferVasprintf(virBufferPtr buf, const char *format, va_list argptr)
 {
     int size, count, grow_size;
     va_list copy;
+    const char *str;
 
     if ((format == NULL) || (buf == NULL))
         return;
@@ -402,6 +483,25 @@ virBufferVasprintf(virBufferPtr buf, const char *format, va_list argptr)
     if (buf->error)
         return;
 
+    /* Formats without any conversion and plain "%s" are common enough
+     * to skip vsnprintf for them. */
+    if (!strchr(format, '%')) {
+        virBufferAdd(buf, format, -1);
+        return;
+    }
+
+    if (STREQ(format, "%s")) {
+        va_copy(copy, argptr);
+        str = va_arg(copy, const char *);
+        va_end(copy);
+
+        /* leave NULL to vsnprintf to keep its "(null)" */
+        if (str) {
+            virBufferAdd(buf, str, -1);
+            return;
+        }
+    }
+
     virBufferAddLit(buf, ""); /* auto-indent */
 
     if (buf->size == 0 &&
@@ -438,8 +538,141 @@ virBufferVasprintf(virBufferPtr buf, const char *format, va_list argptr)
 }
 
 
-VIR_WARNINGS_NO_WLOGICALOP_STRCHR
 
+/*
+ * Characters virBufferEscapeString can't copy verbatim: the five XML
+ * metacharacters and the control characters below 0x1A apart from
+ * tab, newline and carriage return.
+ */
+static inline bool
+virBufferEscapeXMLChar(unsigned char c)
+{
+    switch (c) {
+    case '<':
+    case '>':
+    case '&':
+    case '"':
+    case '\'':
+        return true;
+    case '\t':
+    case '\n':
+    case '\r':
+        return false;
+    default:
+        return c < 0x1A;
+    }
+}
+
+#define VIR_BUFFER_ONES 0x0101010101010101ULL
+#define VIR_BUFFER_HIGHS 0x8080808080808080ULL
+
+/* Non-zero if any byte of @word is less than @n (@n <= 0x80) */
+#define VIR_BUFFER_HAS_LESS(word, n) \
+    (((word) - VIR_BUFFER_ONES * (n)) & ~(word) & VIR_BUFFER_HIGHS)
+
+/* Non-zero if any byte of @word equals @c */
+#define VIR_BUFFER_HAS_BYTE(word, c) \
+    VIR_BUFFER_HAS_LESS((word) ^ (VIR_BUFFER_ONES * (unsigned char) (c)), 1)
+
+/**
+ * virBufferEscapeXMLSpan:
+ * @str: the string to scan
+ * @len: length of @str
+ *
+ * Returns the length of the initial part of @str that can be copied
+ * without escaping.  The string is checked eight bytes at a time; only
+ * words that may contain a character to escape are looked at byte by
+ * byte, as tab, newline and carriage return give false positives.
+ */
+static size_t
+virBufferEscapeXMLSpan(const char *str, size_t len)
+{
+    uint64_t word;
+    size_t i = 0;
+    size_t j;
+
+    while (len - i >= sizeof(word)) {
+        memcpy(&word, str + i, sizeof(word));
+
+        if (VIR_BUFFER_HAS_LESS(word, 0x1A) ||
+            VIR_BUFFER_HAS_BYTE(word, '<') ||
+            VIR_BUFFER_HAS_BYTE(word, '>') ||
+            VIR_BUFFER_HAS_BYTE(word, '&') ||
+            VIR_BUFFER_HAS_BYTE(word, '"') ||
+            VIR_BUFFER_HAS_BYTE(word, '\'')) {
+            for (j = 0; j < sizeof(word); j++) {
+                if (virBufferEscapeXMLChar(str[i + j]))
+                    return i + j;
+            }
+        }
+
+        i += sizeof(word);
+    }
+
+    while (i < len && !virBufferEscapeXMLChar(str[i]))
+        i++;
+
+    return i;
+}
+
+/**
+ * virBufferEscapeXML:
+ * @out: where to store the escaped string, at least 6 * @len bytes
+ * @str: the string to escape
+ * @len: length of @str
+ *
+ * Escape @str for use in XML, copying runs of characters which don't
+ * need escaping in one go.  Control characters are silently dropped.
+ *
+ * Returns pointer past the last byte written, the output is not NUL
+ * terminated.
+ */
+static char *
+virBufferEscapeXML(char *out, const char *str, size_t len)
+{
+    size_t span;
+
+    while (len) {
+        span = virBufferEscapeXMLSpan(str, len);
+        memcpy(out, str, span);
+        out += span;
+        str += span;
+        len -= span;
+
+        if (!len)
+            break;
+
+        switch (*str) {
+        case '<':
+            memcpy(out, "&lt;", 4);
+            out += 4;
+            break;
+        case '>':
+            memcpy(out, "&gt;", 4);
+            out += 4;
+            break;
+        case '&':
+            memcpy(out, "&amp;", 5);
+            out += 5;
+            break;
+        case '"':
+            memcpy(out, "&quot;", 6);
+            out += 6;
+            break;
+        case '\'':
+            memcpy(out, "&apos;", 6);
+            out += 6;
+            break;
+        default:
+            /* silently ignore control characters */
+            break;
+        }
+        str++;
+        len--;
+    }
+
+    return out;
+}
 
 /**
  * virBufferEscapeString:
@@ -451,20 +684,19 @@ VIR_WARNINGS_NO_WLOGICALOP_STRCHR
  * string is escaped for use in XML.  If @str is NULL, nothing is
  * added (not even the rest of @format).  Auto indentation may be
  * applied.
+ *
+ * Note that character over 0x80 are likely to give problem with UTF-8
+ * XML, but since our string don't have an encoding it's hard to handle
+ * properly we have to assume it's UTF-8 too.
  */
 void
 virBufferEscapeString(virBufferPtr buf, const char *format, const char *str)
 {
-    int len;
+    size_t len;
+    size_t suffixlen;
+    const char *conv;
+    const char *suffix;
     char *escaped, *out;
-    const char *cur;
-    const char forbidden_characters[] = {
-        0x01,   0x02,   0x03,   0x04,   0x05,   0x06,   0x07,   0x08,
-        /*\t*/  /*\n*/  0x0B,   0x0C,   /*\r*/  0x0E,   0x0F,   0x10,
-        0x11,   0x12,   0x13,   0x14,   0x15,   0x16,   0x17,   0x18,
-        0x19,   '"',    '&',    '\'',   '<',    '>',
-        '\0'
-    };
 
     if ((format == NULL) || (buf == NULL) || (str == NULL))
         return;
@@ -473,7 +705,34 @@ virBufferEscapeString(virBufferPtr buf, const char *format, const char *str)
         return;
 
     len = strlen(str);
-    if (strcspn(str, forbidden_characters) == len) {
+
+    /* The usual format is a constant with just the one %s in it, in
+     * which case the surrounding text and the escaped string are
+     * written straight into the buffer instead of through vsnprintf. */
+    conv = strchr(format, '%');
+    if (conv && conv[1] == 's' && !strchr(conv + 2, '%')) {
+        suffix = conv + 2;
+        suffixlen = strlen(suffix);
+
+        if (len > UINT_MAX / 8 ||
+            suffixlen > UINT_MAX / 8) {
+            virBufferSetError(buf, ENOMEM);
+            return;
+        }
+
+        virBufferAdd(buf, format, conv - format);
+        if (virBufferGrow(buf, 6 * len + suffixlen + 1) < 0)
+            return;
+
+        out = virBufferEscapeXML(buf->content + buf->use, str, len);
+        memcpy(out, suffix, suffixlen);
+        out += suffixlen;
+        *out = '\0';
+        buf->use = out - buf->content;
+        return;
+    }
+
+    if (virBufferEscapeXMLSpan(str, len) == len) {
         virBufferAsprintf(buf, format, str);
         return;
     }
@@ -484,52 +743,7 @@ virBufferEscapeString(virBufferPtr buf, const char *format, const char *str)
         return;
     }
 
-    cur = str;
-    out = escaped;
-    while (*cur != 0) {
-        if (*cur == '<') {
-            *out++ = '&';
-            *out++ = 'l';
-            *out++ = 't';
-            *out++ = ';';
-        } else if (*cur == '>') {
-            *out++ = '&';
-            *out++ = 'g';
-            *out++ = 't';
-            *out++ = ';';
-        } else if (*cur == '&') {
-            *out++ = '&';
-            *out++ = 'a';
-            *out++ = 'm';
-            *out++ = 'p';
-            *out++ = ';';
-        } else if (*cur == '"') {
-            *out++ = '&';
-            *out++ = 'q';
-            *out++ = 'u';
-            *out++ = 'o';
-            *out++ = 't';
-            *out++ = ';';
-        } else if (*cur == '\'') {
-            *out++ = '&';
-            *out++ = 'a';
-            *out++ = 'p';
-            *out++ = 'o';
-            *out++ = 's';
-            *out++ = ';';
-        } else if (!strchr(forbidden_characters, *cur)) {
-            /*
-             * default case, just copy !
-             * Note that character over 0x80 are likely to give problem
-             * with UTF-8 XML, but since our string don't have an encoding
-             * it's hard to handle properly we have to assume it's UTF-8 too
-             */
-            *out++ = *cur;
-        } else {
-            /* silently ignore control characters */
-        }
-        cur++;
-    }
+    out = virBufferEscapeXML(escaped, str, len);
     *out = 0;
 
     virBufferAsprintf(buf, format, escaped);
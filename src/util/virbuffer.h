@@ -74,6 +74,9 @@ unsigned int virBufferUse(const virBuffer *buf);
 void virBufferAdd(virBufferPtr buf, const char *str, int len);
 void virBufferAddBuffer(virBufferPtr buf, virBufferPtr toadd);
 void virBufferAddChar(virBufferPtr buf, char c);
+void virBufferAddInt(virBufferPtr buf, long long val);
+void virBufferAddUInt(virBufferPtr buf, unsigned long long val);
+void virBufferSizeHint(virBufferPtr buf, unsigned int len);
 void virBufferAsprintf(virBufferPtr buf, const char *format, ...)
   ATTRIBUTE_FMT_PRINTF(2, 3);
 void virBufferVasprintf(virBufferPtr buf, const char *format, va_list ap)
@@ -331,3 +331,43 @@ int virEventRunDefaultImpl(void)
 
     return 0;
 }
+
+
+/*****************************************************
+ *
+ * Below this point are internal helpers which are
+ * not part of the public API.
+ *
+ *****************************************************/
+
+
+/**
+ * virEventAddIOHandle:
+ *
+ * @fd: file handle to monitor for events
+ * @events: bitset of events to watch from virEventHandleType constants
+ * @cb: callback to invoke when an event occurs
+ * @opaque: user data to pass to callback
+ * @ff: callback to free opaque when handle is removed
+ *
+ * Register a callback for monitoring events on a connection. When
+ * the default event loop implementation is in use the handle may
+ * be served by one of its dedicated I/O loops, so @cb must not
+ * assume it runs in the thread calling virEventRunDefaultImpl().
+ * With any other implementation this is virEventAddHandle().
+ *
+ * Returns -1 if the file handle cannot be registered, otherwise a handle
+ * watch number to be used for updating and unregistering for events.
+ */
+int
+virEventAddIOHandle(int fd,
+                    int events,
+                    virEventHandleCallback cb,
+                    void *opaque,
+                    virFreeCallback ff)
+{
+    if (addHandleImpl == virEventPollAddHandle)
+        return virEventPollAddIOHandle(fd, events, cb, opaque, ff);
+
+    return virEventAddHandle(fd, events, cb, opaque, ff);
+}
@@ -30,6 +30,9 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#if WITH_EPOLL
+# include <sys/epoll.h>
+#endif
 
 #include "virthread.h"
 #include "virlog.h"
@@ -40,6 +43,9 @@
 #include "virerror.h"
 #include "virprobe.h"
 #include "virtime.h"
+#include "virhash.h"
+#include "virhashcode.h"
+#include "viratomic.h"
 
 #define EVENT_DEBUG(fmt, ...) VIR_DEBUG(fmt, __VA_ARGS__)
 
@@ -47,7 +53,23 @@
 
 VIR_LOG_INIT("util.eventpoll");
 
-static int virEventPollInterruptLocked(void);
+struct virEventPollLoop;
+
+static int virEventPollInterruptLocked(struct virEventPollLoop *loop);
+
+typedef enum {
+    VIR_EVENT_POLL_BACKEND_POLL,
+    VIR_EVENT_POLL_BACKEND_EPOLL,
+
+    VIR_EVENT_POLL_BACKEND_LAST
+} virEventPollBackend;
+
+VIR_ENUM_DECL(virEventPollBackend)
+VIR_ENUM_IMPL(virEventPollBackend, VIR_EVENT_POLL_BACKEND_LAST,
+              "poll",
+              "epoll");
+
+typedef struct virEventPollFD virEventPollFD;
 
 /* State for a single file handle being monitored */
 struct virEventPollHandle {
@@ -58,6 +80,19 @@ struct virEventPollHandle {
     virFreeCallback ff;
     void *opaque;
     int deleted;
+    size_t idx; /* position in loop->handles */
+    struct virEventPollHandle *nextDeleted;
+};
+
+/* Per file descriptor state used by the epoll backend. Several
+ * watches may be registered against the same fd, so the epoll
+ * registration carries the union of their events. */
+struct virEventPollFD {
+    int fd;
+    int events;       /* events currently registered with the kernel */
+    bool unpollable;  /* kernel refused fd, e.g. a regular file */
+    size_t nhandles;
+    struct virEventPollHandle **handles;
 };
 
 /* State for a single timer being generated */
@@ -69,35 +104,468 @@ struct virEventPollTimeout {
     virFreeCallback ff;
     void *opaque;
     int deleted;
+    ssize_t heapIdx; /* position in loop->timeouts, -1 if disarmed */
+    unsigned long long dispatchAt; /* expiresAt when re-armed by dispatch */
+    struct virEventPollTimeout *nextDeleted;
 };
 
 /* Allocate extra slots for virEventPollHandle/virEventPollTimeout
    records in this multiple */
 #define EVENT_ALLOC_EXTENT 10
 
+/* Maximum number of ready fds collected by a single epoll_wait.
+ * The epoll set is level triggered, so anything beyond this is
+ * simply reported on the next iteration */
+#define EVENT_EPOLL_MAX_EVENTS 128
+
 /* State for the main event loop */
 struct virEventPollLoop {
     virMutex lock;
     int running;
     virThread leader;
     int wakeupfd[2];
+    virEventPollBackend backend;
     size_t handlesCount;
     size_t handlesAlloc;
-    struct virEventPollHandle *handles;
+    struct virEventPollHandle **handles;
+    virHashTablePtr watches; /* watch -> struct virEventPollHandle */
+    struct virEventPollHandle *deletedHandles;
+    /* epoll backend only */
+    int epollfd;
+    size_t fdinfoCount;
+    virEventPollFD **fdinfo; /* indexed by fd */
+    size_t unpollableActive; /* unpollable fds with events enabled */
+    /* Armed timers, kept as a binary min-heap on expiresAt */
     size_t timeoutsCount;
     size_t timeoutsAlloc;
-    struct virEventPollTimeout *timeouts;
+    struct virEventPollTimeout **timeouts;
+    virHashTablePtr timers; /* timer -> struct virEventPollTimeout */
+    struct virEventPollTimeout *deletedTimeouts;
+    /* Scratch list of timers expiring in the current iteration */
+    size_t expiredCount;
+    size_t expiredAlloc;
+    struct virEventPollTimeout **expired;
 };
 
-/* Only have one event loop */
+/* The default event loop, which owns all timers */
 static struct virEventPollLoop eventLoop;
 
-/* Unique ID for the next FD watch to be registered */
-static int nextWatch = 1;
+/* Optional extra loops, each running in a thread of its own,
+ * which connection handles are spread across. They are created
+ * once at startup and never go away again. */
+static struct {
+    virRWLock lock;
+    int nloops;
+    struct virEventPollLoop **loops;
+    int next;
+    virHashTablePtr watches; /* watch -> struct virEventPollLoop */
+} ioLoops;
+
+/* Last FD watch ID handed out, shared by all loops */
+static int lastWatch;
 
 /* Unique ID for the next timer to be registered */
 static int nextTimer = 1;
 
+static uint32_t
+virEventPollIDCode(const void *name, uint32_t seed)
+{
+    int id = (int)(intptr_t)name;
+    return virHashCodeGen(&id, sizeof(id), seed);
+}
+
+
+static bool
+virEventPollIDEqual(const void *namea, const void *nameb)
+{
+    return namea == nameb;
+}
+
+
+static void *
+virEventPollIDCopy(const void *name)
+{
+    return (void *)name;
+}
+
+
+static struct virEventPollHandle *
+virEventPollLookupHandle(struct virEventPollLoop *loop, int watch)
+{
+    return virHashLookup(loop->watches, (void *)(intptr_t)watch);
+}
+
+
+static struct virEventPollTimeout *
+virEventPollLookupTimeout(struct virEventPollLoop *loop, int timer)
+{
+    return virHashLookup(loop->timers, (void *)(intptr_t)timer);
+}
+
+
+/* Drop the routing entry of an I/O loop handle */
+static void
+virEventPollIOLoopForget(int watch)
+{
+    virRWLockWrite(&ioLoops.lock);
+    ignore_value(virHashSteal(ioLoops.watches, (void *)(intptr_t)watch));
+    virRWLockUnlock(&ioLoops.lock);
+}
+
+
+/* Heap ordering of timers, ties are broken by registration order */
+static bool
+virEventPollTimeoutBefore(const struct virEventPollTimeout *a,
+                          const struct virEventPollTimeout *b)
+{
+    if (a->expiresAt != b->expiresAt)
+        return a->expiresAt < b->expiresAt;
+    return a->timer < b->timer;
+}
+
+
+static void
+virEventPollTimeoutHeapSet(struct virEventPollLoop *loop,
+                           size_t idx,
+                           struct virEventPollTimeout *t)
+{
+    loop->timeouts[idx] = t;
+    t->heapIdx = idx;
+}
+
+
+static void
+virEventPollTimeoutHeapSiftUp(struct virEventPollLoop *loop, size_t idx)
+{
+    struct virEventPollTimeout *t = loop->timeouts[idx];
+
+    while (idx > 0) {
+        size_t parent = (idx - 1) / 2;
+        if (!virEventPollTimeoutBefore(t, loop->timeouts[parent]))
+            break;
+        virEventPollTimeoutHeapSet(loop, idx, loop->timeouts[parent]);
+        idx = parent;
+    }
+    virEventPollTimeoutHeapSet(loop, idx, t);
+}
+
+
+static void
+virEventPollTimeoutHeapSiftDown(struct virEventPollLoop *loop, size_t idx)
+{
+    struct virEventPollTimeout *t = loop->timeouts[idx];
+
+    for (;;) {
+        size_t child = idx * 2 + 1;
+        if (child >= loop->timeoutsCount)
+            break;
+        if (child + 1 < loop->timeoutsCount &&
+            virEventPollTimeoutBefore(loop->timeouts[child + 1],
+                                      loop->timeouts[child]))
+            child++;
+        if (!virEventPollTimeoutBefore(loop->timeouts[child], t))
+            break;
+        virEventPollTimeoutHeapSet(loop, idx, loop->timeouts[child]);
+        idx = child;
+    }
+    virEventPollTimeoutHeapSet(loop, idx, t);
+}
+
+
+/* Insert @t into the heap, or move it after its expiry changed */
+static int
+virEventPollTimeoutHeapArm(struct virEventPollLoop *loop,
+                           struct virEventPollTimeout *t)
+{
+    if (t->heapIdx < 0) {
+        if (VIR_RESIZE_N(loop->timeouts, loop->timeoutsAlloc,
+                         loop->timeoutsCount, 1) < 0)
+            return -1;
+        t->heapIdx = loop->timeoutsCount++;
+        loop->timeouts[t->heapIdx] = t;
+        virEventPollTimeoutHeapSiftUp(loop, t->heapIdx);
+        return 0;
+    }
+
+    virEventPollTimeoutHeapSiftUp(loop, t->heapIdx);
+    virEventPollTimeoutHeapSiftDown(loop, t->heapIdx);
+    return 0;
+}
+
+
+static void
+virEventPollTimeoutHeapDisarm(struct virEventPollLoop *loop,
+                              struct virEventPollTimeout *t)
+{
+    size_t idx = t->heapIdx;
+    struct virEventPollTimeout *last;
+
+    if (t->heapIdx < 0)
+        return;
+
+    t->heapIdx = -1;
+    last = loop->timeouts[--loop->timeoutsCount];
+    loop->timeouts[loop->timeoutsCount] = NULL;
+    if (last == t)
+        return;
+
+    virEventPollTimeoutHeapSet(loop, idx, last);
+    virEventPollTimeoutHeapSiftUp(loop, idx);
+    virEventPollTimeoutHeapSiftDown(loop, last->heapIdx);
+}
+
+
+#if WITH_EPOLL
+/* Record @events on an fd epoll refused. Only those with some
+ * events enabled are emulated as ready, just like poll() leaves
+ * handles without events out of its set.
+ */
+static void
+virEventPollEpollSetUnpollable(struct virEventPollLoop *loop,
+                               virEventPollFD *info,
+                               int events)
+{
+    if (info->events && !events)
+        loop->unpollableActive--;
+    else if (!info->events && events)
+        loop->unpollableActive++;
+    info->events = events;
+}
+
+
+/* Sync the epoll registration of @info with the union of the
+ * events requested by its live watches. A MOD is forced when
+ * @force is set, so that an fd number which was closed and
+ * reused behind our back gets re-added to the epoll set.
+ */
+static int
+virEventPollEpollSyncFD(struct virEventPollLoop *loop,
+                        virEventPollFD *info,
+                        bool force)
+{
+    struct epoll_event ev;
+    int events = 0;
+    int op;
+    size_t i;
+
+    for (i = 0; i < info->nhandles; i++) {
+        if (!info->handles[i]->deleted)
+            events |= info->handles[i]->events;
+    }
+
+    if (info->unpollable) {
+        virEventPollEpollSetUnpollable(loop, info, events);
+        return 0;
+    }
+
+    if (events == 0) {
+        if (info->events != 0 &&
+            epoll_ctl(loop->epollfd, EPOLL_CTL_DEL, info->fd, NULL) < 0 &&
+            errno != ENOENT && errno != EBADF)
+            VIR_WARN("Unable to remove fd %d from epoll set: %s",
+                     info->fd, virStrerror(errno, NULL, 0));
+        info->events = 0;
+        return 0;
+    }
+
+    if (info->events == events && !force)
+        return 0;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = info->fd;
+
+    op = info->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(loop->epollfd, op, info->fd, &ev) < 0) {
+        if (op == EPOLL_CTL_MOD && errno == ENOENT)
+            op = EPOLL_CTL_ADD;
+        else if (op == EPOLL_CTL_ADD && errno == EEXIST)
+            op = EPOLL_CTL_MOD;
+        else
+            op = -1;
+
+        if (op == -1 ||
+            epoll_ctl(loop->epollfd, op, info->fd, &ev) < 0) {
+            /* epoll refuses fds which don't support polling, such as
+             * regular files. poll() reports those as always ready, so
+             * emulate that in virEventPollDispatchHandles */
+            if (errno == EPERM) {
+                EVENT_DEBUG("fd %d cannot be polled, emulating", info->fd);
+                info->unpollable = true;
+                info->events = 0;
+                virEventPollEpollSetUnpollable(loop, info, events);
+                return 0;
+            }
+            virReportSystemError(errno,
+                                 _("Unable to add fd %d to epoll set"),
+                                 info->fd);
+            return -1;
+        }
+    }
+
+    info->events = events;
+    return 0;
+}
+
+
+static void
+virEventPollEpollPurgeHandle(struct virEventPollLoop *loop,
+                             struct virEventPollHandle *handle)
+{
+    virEventPollFD *info;
+    size_t i;
+
+    if (handle->fd < 0 ||
+        handle->fd >= loop->fdinfoCount ||
+        !(info = loop->fdinfo[handle->fd]))
+        return;
+
+    for (i = 0; i < info->nhandles; i++) {
+        if (info->handles[i] == handle) {
+            VIR_DELETE_ELEMENT(info->handles, i, info->nhandles);
+            break;
+        }
+    }
+
+    if (info->nhandles)
+        return;
+
+    if (info->events && !info->unpollable)
+        ignore_value(epoll_ctl(loop->epollfd, EPOLL_CTL_DEL,
+                               info->fd, NULL));
+    if (info->unpollable)
+        virEventPollEpollSetUnpollable(loop, info, 0);
+    loop->fdinfo[info->fd] = NULL;
+    VIR_FREE(info->handles);
+    VIR_FREE(info);
+}
+
+
+static int
+virEventPollEpollAddHandle(struct virEventPollLoop *loop,
+                           struct virEventPollHandle *handle)
+{
+    virEventPollFD *info;
+
+    if (handle->fd < 0)
+        return 0;
+
+    if (handle->fd >= loop->fdinfoCount &&
+        VIR_EXPAND_N(loop->fdinfo, loop->fdinfoCount,
+                     handle->fd + 1 - loop->fdinfoCount) < 0)
+        return -1;
+
+    if (!(info = loop->fdinfo[handle->fd])) {
+        if (VIR_ALLOC(info) < 0)
+            return -1;
+        info->fd = handle->fd;
+        loop->fdinfo[handle->fd] = info;
+    }
+
+    if (VIR_APPEND_ELEMENT_COPY(info->handles, info->nhandles, handle) < 0 ||
+        virEventPollEpollSyncFD(loop, info, true) < 0) {
+        virEventPollEpollPurgeHandle(loop, handle);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static virEventPollFD *
+virEventPollEpollLookupFD(struct virEventPollLoop *loop, int fd)
+{
+    if (fd < 0 || fd >= loop->fdinfoCount)
+        return NULL;
+    return loop->fdinfo[fd];
+}
+#endif /* WITH_EPOLL */
+
+
+/* Propagate a change in the event set of @handle to the backend */
+static void
+virEventPollSyncHandle(struct virEventPollLoop *loop ATTRIBUTE_UNUSED,
+                       struct virEventPollHandle *handle ATTRIBUTE_UNUSED)
+{
+#if WITH_EPOLL
+    virEventPollFD *info;
+
+    if (loop->backend != VIR_EVENT_POLL_BACKEND_EPOLL ||
+        !(info = virEventPollEpollLookupFD(loop, handle->fd)))
+        return;
+
+    if (virEventPollEpollSyncFD(loop, info, false) < 0) {
+        VIR_WARN("Unable to update events for watch %d: %s",
+                 handle->watch, virGetLastErrorMessage());
+        virResetLastError();
+    }
+#endif
+}
+
+
+/* Register @watch against @loop. The watch id is allocated by the
+ * caller since handles on the I/O loops must be routable before the
+ * loop gets a chance to dispatch them.
+ */
+static int
+virEventPollAddHandleInternal(struct virEventPollLoop *loop,
+                              int watch, int fd, int events,
+                              virEventHandleCallback cb,
+                              void *opaque,
+                              virFreeCallback ff)
+{
+    struct virEventPollHandle *handle = NULL;
+    virMutexLock(&loop->lock);
+    if (loop->handlesCount == loop->handlesAlloc) {
+        EVENT_DEBUG("Used %zu handle slots, adding at least %d more",
+                    loop->handlesAlloc, EVENT_ALLOC_EXTENT);
+        if (VIR_RESIZE_N(loop->handles, loop->handlesAlloc,
+                         loop->handlesCount, EVENT_ALLOC_EXTENT) < 0)
+            goto error;
+    }
+
+    if (VIR_ALLOC(handle) < 0)
+        goto error;
+
+    handle->watch = watch;
+    handle->fd = fd;
+    handle->events = virEventPollToNativeEvents(events);
+    handle->cb = cb;
+    handle->ff = ff;
+    handle->opaque = opaque;
+    handle->deleted = 0;
+    handle->idx = loop->handlesCount;
+
+    if (virHashAddEntry(loop->watches,
+                        (void *)(intptr_t)watch, handle) < 0)
+        goto error;
+
+#if WITH_EPOLL
+    if (loop->backend == VIR_EVENT_POLL_BACKEND_EPOLL &&
+        virEventPollEpollAddHandle(loop, handle) < 0) {
+        ignore_value(virHashSteal(loop->watches, (void *)(intptr_t)watch));
+        goto error;
+    }
+#endif
+
+    loop->handles[loop->handlesCount++] = handle;
+
+    virEventPollInterruptLocked(loop);
+
+    PROBE(EVENT_POLL_ADD_HANDLE,
+          "watch=%d fd=%d events=%d cb=%p opaque=%p ff=%p",
+          watch, fd, events, cb, opaque, ff);
+    virMutexUnlock(&loop->lock);
+
+    return watch;
+
+ error:
+    virMutexUnlock(&loop->lock);
+    VIR_FREE(handle);
+    return -1;
+}
+
+
 /*
  * Register a callback for monitoring file handle events.
  * NB, it *must* be safe to call this from within a callback
@@ -108,45 +576,72 @@ int virEventPollAddHandle(int fd, int events,
                           void *opaque,
                           virFreeCallback ff)
 {
+    return virEventPollAddHandleInternal(&eventLoop,
+                                         virAtomicIntInc(&lastWatch),
+                                         fd, events, cb, opaque, ff);
+}
+
+
+/*
+ * Register a callback for monitoring events on a connection
+ * handle. With I/O loops configured the handle is assigned to
+ * one of them in a round robin fashion, otherwise it behaves
+ * exactly like virEventPollAddHandle.
+ */
+int virEventPollAddIOHandle(int fd, int events,
+                            virEventHandleCallback cb,
+                            void *opaque,
+                            virFreeCallback ff)
+{
+    struct virEventPollLoop *loop;
+    size_t nloops = virAtomicIntGet(&ioLoops.nloops);
     int watch;
-    virMutexLock(&eventLoop.lock);
-    if (eventLoop.handlesCount == eventLoop.handlesAlloc) {
-        EVENT_DEBUG("Used %zu handle slots, adding at least %d more",
-                    eventLoop.handlesAlloc, EVENT_ALLOC_EXTENT);
-        if (VIR_RESIZE_N(eventLoop.handles, eventLoop.handlesAlloc,
-                         eventLoop.handlesCount, EVENT_ALLOC_EXTENT) < 0) {
-            virMutexUnlock(&eventLoop.lock);
-            return -1;
-        }
+
+    if (nloops == 0)
+        return virEventPollAddHandle(fd, events, cb, opaque, ff);
+
+    loop = ioLoops.loops[(unsigned int)virAtomicIntInc(&ioLoops.next) % nloops];
+    watch = virAtomicIntInc(&lastWatch);
+
+    virRWLockWrite(&ioLoops.lock);
+    if (virHashAddEntry(ioLoops.watches,
+                        (void *)(intptr_t)watch, loop) < 0) {
+        virRWLockUnlock(&ioLoops.lock);
+        return -1;
     }
+    virRWLockUnlock(&ioLoops.lock);
 
-    watch = nextWatch++;
+    if (virEventPollAddHandleInternal(loop, watch, fd, events,
+                                      cb, opaque, ff) < 0) {
+        virEventPollIOLoopForget(watch);
+        return -1;
+    }
 
-    eventLoop.handles[eventLoop.handlesCount].watch = watch;
-    eventLoop.handles[eventLoop.handlesCount].fd = fd;
-    eventLoop.handles[eventLoop.handlesCount].events =
-                                         virEventPollToNativeEvents(events);
-    eventLoop.handles[eventLoop.handlesCount].cb = cb;
-    eventLoop.handles[eventLoop.handlesCount].ff = ff;
-    eventLoop.handles[eventLoop.handlesCount].opaque = opaque;
-    eventLoop.handles[eventLoop.handlesCount].deleted = 0;
+    return watch;
+}
 
-    eventLoop.handlesCount++;
 
-    virEventPollInterruptLocked();
+/* Find the loop which owns @watch */
+static struct virEventPollLoop *
+virEventPollLoopForWatch(int watch)
+{
+    struct virEventPollLoop *loop = NULL;
 
-    PROBE(EVENT_POLL_ADD_HANDLE,
-          "watch=%d fd=%d events=%d cb=%p opaque=%p ff=%p",
-          watch, fd, events, cb, opaque, ff);
-    virMutexUnlock(&eventLoop.lock);
+    if (virAtomicIntGet(&ioLoops.nloops) == 0)
+        return &eventLoop;
 
-    return watch;
+    virRWLockRead(&ioLoops.lock);
+    loop = virHashLookup(ioLoops.watches, (void *)(intptr_t)watch);
+    virRWLockUnlock(&ioLoops.lock);
+
+    return loop ? loop : &eventLoop;
 }
 
+
 void virEventPollUpdateHandle(int watch, int events)
 {
-    size_t i;
-    bool found = false;
+    struct virEventPollLoop *loop;
+    struct virEventPollHandle *handle;
     PROBE(EVENT_POLL_UPDATE_HANDLE,
           "watch=%d events=%d",
           watch, events);
@@ -156,19 +651,16 @@ void virEventPollUpdateHandle(int watch, int events)
         return;
     }
 
-    virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.handlesCount; i++) {
-        if (eventLoop.handles[i].watch == watch) {
-            eventLoop.handles[i].events =
-                    virEventPollToNativeEvents(events);
-            virEventPollInterruptLocked();
-            found = true;
-            break;
-        }
+    loop = virEventPollLoopForWatch(watch);
+    virMutexLock(&loop->lock);
+    if ((handle = virEventPollLookupHandle(loop, watch))) {
+        handle->events = virEventPollToNativeEvents(events);
+        virEventPollSyncHandle(loop, handle);
+        virEventPollInterruptLocked(loop);
     }
-    virMutexUnlock(&eventLoop.lock);
+    virMutexUnlock(&loop->lock);
 
-    if (!found)
+    if (!handle)
         VIR_WARN("Got update for non-existent handle watch %d", watch);
 }
 
@@ -180,7 +672,8 @@ void virEventPollUpdateHandle(int watch, int events)
  */
 int virEventPollRemoveHandle(int watch)
 {
-    size_t i;
+    struct virEventPollLoop *loop;
+    struct virEventPollHandle *handle;
     PROBE(EVENT_POLL_REMOVE_HANDLE,
           "watch=%d",
           watch);
@@ -190,21 +683,22 @@ int virEventPollRemoveHandle(int watch)
         return -1;
     }
 
-    virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.handlesCount; i++) {
-        if (eventLoop.handles[i].deleted)
-            continue;
-
-        if (eventLoop.handles[i].watch == watch) {
-            EVENT_DEBUG("mark delete %zu %d", i, eventLoop.handles[i].fd);
-            eventLoop.handles[i].deleted = 1;
-            virEventPollInterruptLocked();
-            virMutexUnlock(&eventLoop.lock);
-            return 0;
-        }
+    loop = virEventPollLoopForWatch(watch);
+    virMutexLock(&loop->lock);
+    if (!(handle = virEventPollLookupHandle(loop, watch)) ||
+        handle->deleted) {
+        virMutexUnlock(&loop->lock);
+        return -1;
     }
-    virMutexUnlock(&eventLoop.lock);
-    return -1;
+
+    EVENT_DEBUG("mark delete %zu %d", handle->idx, handle->fd);
+    handle->deleted = 1;
+    handle->nextDeleted = loop->deletedHandles;
+    loop->deletedHandles = handle;
+    virEventPollSyncHandle(loop, handle);
+    virEventPollInterruptLocked(loop);
+    virMutexUnlock(&loop->lock);
+    return 0;
 }
 
 
@@ -218,48 +712,58 @@ int virEventPollAddTimeout(int frequency,
                            void *opaque,
                            virFreeCallback ff)
 {
+    struct virEventPollLoop *loop = &eventLoop;
+    struct virEventPollTimeout *t;
     unsigned long long now;
     int ret;
 
     if (virTimeMillisNow(&now) < 0)
         return -1;
 
-    virMutexLock(&eventLoop.lock);
-    if (eventLoop.timeoutsCount == eventLoop.timeoutsAlloc) {
-        EVENT_DEBUG("Used %zu timeout slots, adding at least %d more",
-                    eventLoop.timeoutsAlloc, EVENT_ALLOC_EXTENT);
-        if (VIR_RESIZE_N(eventLoop.timeouts, eventLoop.timeoutsAlloc,
-                         eventLoop.timeoutsCount, EVENT_ALLOC_EXTENT) < 0) {
-            virMutexUnlock(&eventLoop.lock);
-            return -1;
-        }
-    }
+    if (VIR_ALLOC(t) < 0)
+        return -1;
 
-    eventLoop.timeouts[eventLoop.timeoutsCount].timer = nextTimer++;
-    eventLoop.timeouts[eventLoop.timeoutsCount].frequency = frequency;
-    eventLoop.timeouts[eventLoop.timeoutsCount].cb = cb;
-    eventLoop.timeouts[eventLoop.timeoutsCount].ff = ff;
-    eventLoop.timeouts[eventLoop.timeoutsCount].opaque = opaque;
-    eventLoop.timeouts[eventLoop.timeoutsCount].deleted = 0;
-    eventLoop.timeouts[eventLoop.timeoutsCount].expiresAt =
-        frequency >= 0 ? frequency + now : 0;
+    virMutexLock(&loop->lock);
+    t->timer = nextTimer++;
+    t->frequency = frequency;
+    t->cb = cb;
+    t->ff = ff;
+    t->opaque = opaque;
+    t->deleted = 0;
+    t->heapIdx = -1;
+    t->expiresAt = frequency >= 0 ? frequency + now : 0;
+
+    if (virHashAddEntry(loop->timers,
+                        (void *)(intptr_t)t->timer, t) < 0)
+        goto error;
+
+    if (frequency >= 0 &&
+        virEventPollTimeoutHeapArm(loop, t) < 0) {
+        ignore_value(virHashSteal(loop->timers,
+                                  (void *)(intptr_t)t->timer));
+        goto error;
+    }
 
-    eventLoop.timeoutsCount++;
-    ret = nextTimer-1;
-    virEventPollInterruptLocked();
+    ret = t->timer;
+    virEventPollInterruptLocked(loop);
 
     PROBE(EVENT_POLL_ADD_TIMEOUT,
           "timer=%d frequency=%d cb=%p opaque=%p ff=%p",
           ret, frequency, cb, opaque, ff);
-    virMutexUnlock(&eventLoop.lock);
+    virMutexUnlock(&loop->lock);
     return ret;
+
+ error:
+    virMutexUnlock(&loop->lock);
+    VIR_FREE(t);
+    return -1;
 }
 
 void virEventPollUpdateTimeout(int timer, int frequency)
 {
+    struct virEventPollLoop *loop = &eventLoop;
+    struct virEventPollTimeout *t;
     unsigned long long now;
-    size_t i;
-    bool found = false;
     PROBE(EVENT_POLL_UPDATE_TIMEOUT,
           "timer=%d frequency=%d",
           timer, frequency);
@@ -272,22 +776,24 @@ void virEventPollUpdateTimeout(int timer, int frequency)
     if (virTimeMillisNow(&now) < 0)
         return;
 
-    virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.timeoutsCount; i++) {
-        if (eventLoop.timeouts[i].timer == timer) {
-            eventLoop.timeouts[i].frequency = frequency;
-            eventLoop.timeouts[i].expiresAt =
-                frequency >= 0 ? frequency + now : 0;
-            VIR_DEBUG("Set timer freq=%d expires=%llu", frequency,
-                      eventLoop.timeouts[i].expiresAt);
-            virEventPollInterruptLocked();
-            found = true;
-            break;
+    virMutexLock(&loop->lock);
+    if ((t = virEventPollLookupTimeout(loop, timer))) {
+        t->frequency = frequency;
+        t->expiresAt = frequency >= 0 ? frequency + now : 0;
+        VIR_DEBUG("Set timer freq=%d expires=%llu", frequency,
+                  t->expiresAt);
+        if (frequency < 0 || t->deleted) {
+            virEventPollTimeoutHeapDisarm(loop, t);
+        } else if (virEventPollTimeoutHeapArm(loop, t) < 0) {
+            VIR_WARN("Unable to arm timer %d: %s",
+                     timer, virGetLastErrorMessage());
+            virResetLastError();
         }
+        virEventPollInterruptLocked(loop);
     }
-    virMutexUnlock(&eventLoop.lock);
+    virMutexUnlock(&loop->lock);
 
-    if (!found)
+    if (!t)
         VIR_WARN("Got update for non-existent timer %d", timer);
 }
 
@@ -299,7 +805,8 @@ void virEventPollUpdateTimeout(int timer, int frequency)
  */
 int virEventPollRemoveTimeout(int timer)
 {
-    size_t i;
+    struct virEventPollLoop *loop = &eventLoop;
+    struct virEventPollTimeout *t;
     PROBE(EVENT_POLL_REMOVE_TIMEOUT,
           "timer=%d",
           timer);
@@ -309,48 +816,40 @@ int virEventPollRemoveTimeout(int timer)
         return -1;
     }
 
-    virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.timeoutsCount; i++) {
-        if (eventLoop.timeouts[i].deleted)
-            continue;
-
-        if (eventLoop.timeouts[i].timer == timer) {
-            eventLoop.timeouts[i].deleted = 1;
-            virEventPollInterruptLocked();
-            virMutexUnlock(&eventLoop.lock);
-            return 0;
-        }
+    virMutexLock(&loop->lock);
+    if (!(t = virEventPollLookupTimeout(loop, timer)) ||
+        t->deleted) {
+        virMutexUnlock(&loop->lock);
+        return -1;
     }
-    virMutexUnlock(&eventLoop.lock);
-    return -1;
+
+    t->deleted = 1;
+    t->nextDeleted = loop->deletedTimeouts;
+    loop->deletedTimeouts = t;
+    virEventPollTimeoutHeapDisarm(loop, t);
+    virEventPollInterruptLocked(loop);
+    virMutexUnlock(&loop->lock);
+    return 0;
 }
 
-/* Iterates over all registered timeouts and determine which
- * will be the first to expire.
+/* Determine which of the armed timers will be the first to
+ * expire, which is always the root of the heap.
  * @timeout: filled with expiry time of soonest timer, or -1 if
  *           no timeout is pending
  * returns: 0 on success, -1 on error
  */
-static int virEventPollCalculateTimeout(int *timeout)
+static int virEventPollCalculateTimeout(struct virEventPollLoop *loop, int *timeout)
 {
     unsigned long long then = 0;
-    size_t i;
-    EVENT_DEBUG("Calculate expiry of %zu timers", eventLoop.timeoutsCount);
+    EVENT_DEBUG("Calculate expiry of %zu timers", loop->timeoutsCount);
     /* Figure out if we need a timeout */
-    for (i = 0; i < eventLoop.timeoutsCount; i++) {
-        if (eventLoop.timeouts[i].deleted)
-            continue;
-        if (eventLoop.timeouts[i].frequency < 0)
-            continue;
-
-        EVENT_DEBUG("Got a timeout scheduled for %llu", eventLoop.timeouts[i].expiresAt);
-        if (then == 0 ||
-            eventLoop.timeouts[i].expiresAt < then)
-            then = eventLoop.timeouts[i].expiresAt;
+    if (loop->timeoutsCount > 0) {
+        then = loop->timeouts[0]->expiresAt;
+        EVENT_DEBUG("Got a timeout scheduled for %llu", then);
     }
 
     /* Calculate how long we should wait for a timeout if needed */
-    if (then > 0) {
+    if (loop->timeoutsCount > 0) {
         unsigned long long now;
 
         if (virTimeMillisNow(&now) < 0)
@@ -378,13 +877,14 @@ static int virEventPollCalculateTimeout(int *timeout)
  * file handles. The caller must free the returned data struct
  * returns: the pollfd array, or NULL on error
  */
-static struct pollfd *virEventPollMakePollFDs(int *nfds) {
+static struct pollfd *virEventPollMakePollFDs(struct virEventPollLoop *loop, int *nfds)
+{
     struct pollfd *fds;
     size_t i;
 
     *nfds = 0;
-    for (i = 0; i < eventLoop.handlesCount; i++) {
-        if (eventLoop.handles[i].events && !eventLoop.handles[i].deleted)
+    for (i = 0; i < loop->handlesCount; i++) {
+        if (loop->handles[i]->events && !loop->handles[i]->deleted)
             (*nfds)++;
     }
 
@@ -393,16 +893,16 @@ static struct pollfd *virEventPollMakePollFDs(int *nfds) {
         return NULL;
 
     *nfds = 0;
-    for (i = 0; i < eventLoop.handlesCount; i++) {
+    for (i = 0; i < loop->handlesCount; i++) {
         EVENT_DEBUG("Prepare n=%zu w=%d, f=%d e=%d d=%d", i,
-                    eventLoop.handles[i].watch,
-                    eventLoop.handles[i].fd,
-                    eventLoop.handles[i].events,
-                    eventLoop.handles[i].deleted);
-        if (!eventLoop.handles[i].events || eventLoop.handles[i].deleted)
+                    loop->handles[i]->watch,
+                    loop->handles[i]->fd,
+                    loop->handles[i]->events,
+                    loop->handles[i]->deleted);
+        if (!loop->handles[i]->events || loop->handles[i]->deleted)
             continue;
-        fds[*nfds].fd = eventLoop.handles[i].fd;
-        fds[*nfds].events = eventLoop.handles[i].events;
+        fds[*nfds].fd = loop->handles[i]->fd;
+        fds[*nfds].events = loop->handles[i]->events;
         fds[*nfds].revents = 0;
         (*nfds)++;
     }
@@ -412,52 +912,70 @@ static struct pollfd *virEventPollMakePollFDs(int *nfds) {
 
 
 /*
- * Iterate over all timers and determine if any have expired.
- * Invoke the user supplied callback for each timer whose
- * expiry time is met, and schedule the next timeout. Does
- * not try to 'catch up' on time if the actual expiry time
- * was later than the requested time.
+ * Pop all timers which have expired off the heap, then invoke
+ * the user supplied callback for each of them and schedule the
+ * next timeout. Does not try to 'catch up' on time if the actual
+ * expiry time was later than the requested time.
  *
- * This method must cope with new timers being registered
- * by a callback, and must skip any timers marked as deleted.
+ * The expired timers are collected before any callback runs, so
+ * that timers registered or re-armed by a callback don't fire
+ * until the next iteration. Callbacks may delete or update timers
+ * which are still pending dispatch, so those are skipped.
  *
  * Returns 0 upon success, -1 if an error occurred
  */
-static int virEventPollDispatchTimeouts(void)
+static int virEventPollDispatchTimeouts(struct virEventPollLoop *loop)
 {
     unsigned long long now;
     size_t i;
-    /* Save this now - it may be changed during dispatch */
-    int ntimeouts = eventLoop.timeoutsCount;
-    VIR_DEBUG("Dispatch %d", ntimeouts);
+    VIR_DEBUG("Dispatch %zu", loop->timeoutsCount);
 
     if (virTimeMillisNow(&now) < 0)
         return -1;
 
-    for (i = 0; i < ntimeouts; i++) {
-        if (eventLoop.timeouts[i].deleted || eventLoop.timeouts[i].frequency < 0)
+    loop->expiredCount = 0;
+    /* Add 20ms fuzz so we don't pointlessly spin doing
+     * <10ms sleeps, particularly on kernels with low HZ
+     * it is fine that a timer expires 20ms earlier than
+     * requested
+     */
+    while (loop->timeoutsCount > 0 &&
+           loop->timeouts[0]->expiresAt <= (now+20)) {
+        struct virEventPollTimeout *t = loop->timeouts[0];
+
+        if (VIR_RESIZE_N(loop->expired, loop->expiredAlloc,
+                         loop->expiredCount, 1) < 0)
+            return -1;
+
+        virEventPollTimeoutHeapDisarm(loop, t);
+        loop->expired[loop->expiredCount++] = t;
+    }
+
+    for (i = 0; i < loop->expiredCount; i++) {
+        struct virEventPollTimeout *t = loop->expired[i];
+        t->expiresAt = now + t->frequency;
+        t->dispatchAt = t->expiresAt;
+        ignore_value(virEventPollTimeoutHeapArm(loop, t));
+    }
+
+    for (i = 0; i < loop->expiredCount; i++) {
+        struct virEventPollTimeout *t = loop->expired[i];
+        virEventTimeoutCallback cb = t->cb;
+        int timer = t->timer;
+        void *opaque = t->opaque;
+
+        if (t->deleted || t->frequency < 0 ||
+            t->expiresAt != t->dispatchAt)
             continue;
 
-        /* Add 20ms fuzz so we don't pointlessly spin doing
-         * <10ms sleeps, particularly on kernels with low HZ
-         * it is fine that a timer expires 20ms earlier than
-         * requested
-         */
-        if (eventLoop.timeouts[i].expiresAt <= (now+20)) {
-            virEventTimeoutCallback cb = eventLoop.timeouts[i].cb;
-            int timer = eventLoop.timeouts[i].timer;
-            void *opaque = eventLoop.timeouts[i].opaque;
-            eventLoop.timeouts[i].expiresAt =
-                now + eventLoop.timeouts[i].frequency;
-
-            PROBE(EVENT_POLL_DISPATCH_TIMEOUT,
-                  "timer=%d",
-                  timer);
-            virMutexUnlock(&eventLoop.lock);
-            (cb)(timer, opaque);
-            virMutexLock(&eventLoop.lock);
-        }
+        PROBE(EVENT_POLL_DISPATCH_TIMEOUT,
+              "timer=%d",
+              timer);
+        virMutexUnlock(&loop->lock);
+        (cb)(timer, opaque);
+        virMutexLock(&loop->lock);
     }
+    loop->expiredCount = 0;
     return 0;
 }
 
@@ -472,94 +990,168 @@ static int virEventPollDispatchTimeouts(void)
  *
  * Returns 0 upon success, -1 if an error occurred
  */
-static int virEventPollDispatchHandles(int nfds, struct pollfd *fds)
+static int virEventPollDispatchHandles(struct virEventPollLoop *loop,
+                                       int nfds, struct pollfd *fds)
 {
     size_t i, n;
     VIR_DEBUG("Dispatch %d", nfds);
 
-    /* NB, use nfds not eventLoop.handlesCount, because new
+    /* NB, use nfds not loop->handlesCount, because new
      * fds might be added on end of list, and they're not
      * in the fds array we've got */
-    for (i = 0, n = 0; n < nfds && i < eventLoop.handlesCount; n++) {
-        while (i < eventLoop.handlesCount &&
-               (eventLoop.handles[i].fd != fds[n].fd ||
-                eventLoop.handles[i].events == 0)) {
+    for (i = 0, n = 0; n < nfds && i < loop->handlesCount; n++) {
+        while (i < loop->handlesCount &&
+               (loop->handles[i]->fd != fds[n].fd ||
+                loop->handles[i]->events == 0)) {
             i++;
         }
-        if (i == eventLoop.handlesCount)
+        if (i == loop->handlesCount)
             break;
 
-        VIR_DEBUG("i=%zu w=%d", i, eventLoop.handles[i].watch);
-        if (eventLoop.handles[i].deleted) {
+        VIR_DEBUG("i=%zu w=%d", i, loop->handles[i]->watch);
+        if (loop->handles[i]->deleted) {
             EVENT_DEBUG("Skip deleted n=%zu w=%d f=%d", i,
-                        eventLoop.handles[i].watch, eventLoop.handles[i].fd);
+                        loop->handles[i]->watch, loop->handles[i]->fd);
             continue;
         }
 
         if (fds[n].revents) {
-            virEventHandleCallback cb = eventLoop.handles[i].cb;
-            int watch = eventLoop.handles[i].watch;
-            void *opaque = eventLoop.handles[i].opaque;
+            virEventHandleCallback cb = loop->handles[i]->cb;
+            int watch = loop->handles[i]->watch;
+            void *opaque = loop->handles[i]->opaque;
             int hEvents = virEventPollFromNativeEvents(fds[n].revents);
             PROBE(EVENT_POLL_DISPATCH_HANDLE,
                   "watch=%d events=%d",
                   watch, hEvents);
-            virMutexUnlock(&eventLoop.lock);
+            virMutexUnlock(&loop->lock);
             (cb)(watch, fds[n].fd, hEvents, opaque);
-            virMutexLock(&eventLoop.lock);
+            virMutexLock(&loop->lock);
+        }
+    }
+
+    return 0;
+}
+
+
+#if WITH_EPOLL
+/* Invoke the callbacks of all live watches on @info which asked
+ * for any of the events in @revents. Mirrors poll() semantics in
+ * always reporting errors and hangups to watches with a non-empty
+ * event set.
+ */
+static void virEventPollDispatchFD(struct virEventPollLoop *loop,
+                                   virEventPollFD *info,
+                                   int revents)
+{
+    /* Watches added during dispatch weren't part of this wait */
+    size_t nhandles = info->nhandles;
+    size_t i;
+
+    for (i = 0; i < nhandles; i++) {
+        struct virEventPollHandle *handle = info->handles[i];
+        virEventHandleCallback cb;
+        void *opaque;
+        int watch;
+        int hEvents;
+
+        if (handle->deleted || !handle->events)
+            continue;
+
+        if (!(hEvents = revents & (handle->events | POLLERR | POLLHUP)))
+            continue;
+
+        cb = handle->cb;
+        watch = handle->watch;
+        opaque = handle->opaque;
+        hEvents = virEventPollFromNativeEvents(hEvents);
+        PROBE(EVENT_POLL_DISPATCH_HANDLE,
+              "watch=%d events=%d",
+              watch, hEvents);
+        virMutexUnlock(&loop->lock);
+        (cb)(watch, info->fd, hEvents, opaque);
+        virMutexLock(&loop->lock);
+    }
+}
+
+
+/* Dispatch the ready list returned by epoll_wait(). Only the
+ * fds which actually have pending events are visited, so the
+ * cost is independent of the number of registered handles.
+ *
+ * Returns 0 upon success, -1 if an error occurred
+ */
+static int virEventPollDispatchHandlesEpoll(struct virEventPollLoop *loop,
+                                            int nevents,
+                                            struct epoll_event *events)
+{
+    virEventPollFD *info;
+    size_t i;
+    VIR_DEBUG("Dispatch %d", nevents);
+
+    for (i = 0; i < nevents; i++) {
+        /* The fd may have been purged while an earlier
+         * callback in this batch was running */
+        if (!(info = virEventPollEpollLookupFD(loop, events[i].data.fd)))
+            continue;
+        virEventPollDispatchFD(loop, info, events[i].events);
+    }
+
+    /* Regular files can't be added to an epoll set, but poll()
+     * always reports them as readable and writable */
+    if (loop->unpollableActive) {
+        size_t nfdinfo = loop->fdinfoCount;
+        for (i = 0; i < nfdinfo && i < loop->fdinfoCount; i++) {
+            if (!(info = loop->fdinfo[i]) || !info->unpollable ||
+                !info->events)
+                continue;
+            virEventPollDispatchFD(loop, info, POLLIN | POLLOUT);
         }
     }
 
     return 0;
 }
+#endif /* WITH_EPOLL */
 
 
 /* Used post dispatch to actually remove any timers that
  * were previously marked as deleted. This asynchronous
  * cleanup is needed to make dispatch re-entrant safe.
  */
-static void virEventPollCleanupTimeouts(void)
+static void virEventPollCleanupTimeouts(struct virEventPollLoop *loop)
 {
-    size_t i;
+    struct virEventPollTimeout *t;
     size_t gap;
-    VIR_DEBUG("Cleanup %zu", eventLoop.timeoutsCount);
+    VIR_DEBUG("Cleanup %zu", loop->timeoutsCount);
 
-    /* Remove deleted entries, shuffling down remaining
-     * entries as needed to form contiguous series
+    /* Deleted timers were already taken off the heap when
+     * they were marked, only their memory is left to release
      */
-    for (i = 0; i < eventLoop.timeoutsCount;) {
-        if (!eventLoop.timeouts[i].deleted) {
-            i++;
-            continue;
-        }
+    while ((t = loop->deletedTimeouts)) {
+        loop->deletedTimeouts = t->nextDeleted;
 
         PROBE(EVENT_POLL_PURGE_TIMEOUT,
               "timer=%d",
-              eventLoop.timeouts[i].timer);
-        if (eventLoop.timeouts[i].ff) {
-            virFreeCallback ff = eventLoop.timeouts[i].ff;
-            void *opaque = eventLoop.timeouts[i].opaque;
-            virMutexUnlock(&eventLoop.lock);
+              t->timer);
+        if (t->ff) {
+            virFreeCallback ff = t->ff;
+            void *opaque = t->opaque;
+            virMutexUnlock(&loop->lock);
             ff(opaque);
-            virMutexLock(&eventLoop.lock);
+            virMutexLock(&loop->lock);
         }
 
-        if ((i+1) < eventLoop.timeoutsCount) {
-            memmove(eventLoop.timeouts+i,
-                    eventLoop.timeouts+i+1,
-                    sizeof(struct virEventPollTimeout)*(eventLoop.timeoutsCount
-                                                    -(i+1)));
-        }
-        eventLoop.timeoutsCount--;
+        ignore_value(virHashSteal(loop->timers,
+                                  (void *)(intptr_t)t->timer));
+        VIR_FREE(t);
     }
 
     /* Release some memory if we've got a big chunk free */
-    gap = eventLoop.timeoutsAlloc - eventLoop.timeoutsCount;
-    if (eventLoop.timeoutsCount == 0 ||
-        (gap > eventLoop.timeoutsCount && gap > EVENT_ALLOC_EXTENT)) {
+    gap = loop->timeoutsAlloc - loop->timeoutsCount;
+    if (loop->timeoutsCount == 0 ||
+        (gap > loop->timeoutsCount && gap > EVENT_ALLOC_EXTENT)) {
         EVENT_DEBUG("Found %zu out of %zu timeout slots used, releasing %zu",
-                    eventLoop.timeoutsCount, eventLoop.timeoutsAlloc, gap);
-        VIR_SHRINK_N(eventLoop.timeouts, eventLoop.timeoutsAlloc, gap);
+                    loop->timeoutsCount, loop->timeoutsAlloc, gap);
+        VIR_SHRINK_N(loop->timeouts, loop->timeoutsAlloc, gap);
     }
 }
 
@@ -567,72 +1159,81 @@ static void virEventPollCleanupTimeouts(void)
  * were previously marked as deleted. This asynchronous
  * cleanup is needed to make dispatch re-entrant safe.
  */
-static void virEventPollCleanupHandles(void)
+static void virEventPollCleanupHandles(struct virEventPollLoop *loop)
 {
-    size_t i;
+    struct virEventPollHandle *handle;
     size_t gap;
-    VIR_DEBUG("Cleanup %zu", eventLoop.handlesCount);
+    VIR_DEBUG("Cleanup %zu", loop->handlesCount);
 
-    /* Remove deleted entries, shuffling down remaining
-     * entries as needed to form contiguous series
+    /* Deleted handles are chained together when they are marked,
+     * so purging them never needs to look at live ones. The array
+     * is kept dense by moving the last entry into the freed slot
      */
-    for (i = 0; i < eventLoop.handlesCount;) {
-        if (!eventLoop.handles[i].deleted) {
-            i++;
-            continue;
-        }
+    while ((handle = loop->deletedHandles)) {
+        loop->deletedHandles = handle->nextDeleted;
 
         PROBE(EVENT_POLL_PURGE_HANDLE,
               "watch=%d",
-              eventLoop.handles[i].watch);
-        if (eventLoop.handles[i].ff) {
-            virFreeCallback ff = eventLoop.handles[i].ff;
-            void *opaque = eventLoop.handles[i].opaque;
-            virMutexUnlock(&eventLoop.lock);
+              handle->watch);
+        if (handle->ff) {
+            virFreeCallback ff = handle->ff;
+            void *opaque = handle->opaque;
+            virMutexUnlock(&loop->lock);
             ff(opaque);
-            virMutexLock(&eventLoop.lock);
+            virMutexLock(&loop->lock);
         }
 
-        if ((i+1) < eventLoop.handlesCount) {
-            memmove(eventLoop.handles+i,
-                    eventLoop.handles+i+1,
-                    sizeof(struct virEventPollHandle)*(eventLoop.handlesCount
-                                                   -(i+1)));
+#if WITH_EPOLL
+        if (loop->backend == VIR_EVENT_POLL_BACKEND_EPOLL)
+            virEventPollEpollPurgeHandle(loop, handle);
+#endif
+        ignore_value(virHashSteal(loop->watches,
+                                  (void *)(intptr_t)handle->watch));
+        if (loop != &eventLoop)
+            virEventPollIOLoopForget(handle->watch);
+
+        loop->handlesCount--;
+        if (handle->idx < loop->handlesCount) {
+            loop->handles[handle->idx] =
+                loop->handles[loop->handlesCount];
+            loop->handles[handle->idx]->idx = handle->idx;
         }
-        eventLoop.handlesCount--;
+        loop->handles[loop->handlesCount] = NULL;
+        VIR_FREE(handle);
     }
 
     /* Release some memory if we've got a big chunk free */
-    gap = eventLoop.handlesAlloc - eventLoop.handlesCount;
-    if (eventLoop.handlesCount == 0 ||
-        (gap > eventLoop.handlesCount && gap > EVENT_ALLOC_EXTENT)) {
+    gap = loop->handlesAlloc - loop->handlesCount;
+    if (loop->handlesCount == 0 ||
+        (gap > loop->handlesCount && gap > EVENT_ALLOC_EXTENT)) {
         EVENT_DEBUG("Found %zu out of %zu handles slots used, releasing %zu",
-                    eventLoop.handlesCount, eventLoop.handlesAlloc, gap);
-        VIR_SHRINK_N(eventLoop.handles, eventLoop.handlesAlloc, gap);
+                    loop->handlesCount, loop->handlesAlloc, gap);
+        VIR_SHRINK_N(loop->handles, loop->handlesAlloc, gap);
     }
 }
 
 /*
- * Run a single iteration of the event loop, blocking until
- * at least one file handle has an event, or a timer expires
+ * Run a single iteration of the event loop using poll(),
+ * blocking until at least one file handle has an event,
+ * or a timer expires
  */
-int virEventPollRunOnce(void)
+static int virEventPollRunOncePoll(struct virEventPollLoop *loop)
 {
     struct pollfd *fds = NULL;
     int ret, timeout, nfds;
 
-    virMutexLock(&eventLoop.lock);
-    eventLoop.running = 1;
-    virThreadSelf(&eventLoop.leader);
+    virMutexLock(&loop->lock);
+    loop->running = 1;
+    virThreadSelf(&loop->leader);
 
-    virEventPollCleanupTimeouts();
-    virEventPollCleanupHandles();
+    virEventPollCleanupTimeouts(loop);
+    virEventPollCleanupHandles(loop);
 
-    if (!(fds = virEventPollMakePollFDs(&nfds)) ||
-        virEventPollCalculateTimeout(&timeout) < 0)
+    if (!(fds = virEventPollMakePollFDs(loop, &nfds)) ||
+        virEventPollCalculateTimeout(loop, &timeout) < 0)
         goto error;
 
-    virMutexUnlock(&eventLoop.lock);
+    virMutexUnlock(&loop->lock);
 
  retry:
     PROBE(EVENT_POLL_RUN,
@@ -649,82 +1250,321 @@ int virEventPollRunOnce(void)
     }
     EVENT_DEBUG("Poll got %d event(s)", ret);
 
-    virMutexLock(&eventLoop.lock);
-    if (virEventPollDispatchTimeouts() < 0)
+    virMutexLock(&loop->lock);
+    if (virEventPollDispatchTimeouts(loop) < 0)
         goto error;
 
     if (ret > 0 &&
-        virEventPollDispatchHandles(nfds, fds) < 0)
+        virEventPollDispatchHandles(loop, nfds, fds) < 0)
         goto error;
 
-    virEventPollCleanupTimeouts();
-    virEventPollCleanupHandles();
+    virEventPollCleanupTimeouts(loop);
+    virEventPollCleanupHandles(loop);
 
-    eventLoop.running = 0;
-    virMutexUnlock(&eventLoop.lock);
+    loop->running = 0;
+    virMutexUnlock(&loop->lock);
     VIR_FREE(fds);
     return 0;
 
  error:
-    virMutexUnlock(&eventLoop.lock);
+    virMutexUnlock(&loop->lock);
  error_unlocked:
     VIR_FREE(fds);
     return -1;
 }
 
 
+#if WITH_EPOLL
+/*
+ * Run a single iteration of the event loop using epoll. The
+ * kernel keeps the interest list, so nothing proportional to
+ * the number of registered handles is done per iteration.
+ */
+static int virEventPollRunOnceEpoll(struct virEventPollLoop *loop)
+{
+    struct epoll_event events[EVENT_EPOLL_MAX_EVENTS];
+    int ret, timeout;
+
+    virMutexLock(&loop->lock);
+    loop->running = 1;
+    virThreadSelf(&loop->leader);
+
+    virEventPollCleanupTimeouts(loop);
+    virEventPollCleanupHandles(loop);
+
+    if (virEventPollCalculateTimeout(loop, &timeout) < 0)
+        goto error;
+
+    if (loop->unpollableActive)
+        timeout = 0;
+
+    virMutexUnlock(&loop->lock);
+
+ retry:
+    PROBE(EVENT_POLL_RUN,
+          "nhandles=%d timeout=%d",
+          (int)loop->handlesCount, timeout);
+    ret = epoll_wait(loop->epollfd, events,
+                     EVENT_EPOLL_MAX_EVENTS, timeout);
+    if (ret < 0) {
+        EVENT_DEBUG("Poll got error event %d", errno);
+        if (errno == EINTR || errno == EAGAIN)
+            goto retry;
+        virReportSystemError(errno, "%s",
+                             _("Unable to poll on file handles"));
+        return -1;
+    }
+    EVENT_DEBUG("Poll got %d event(s)", ret);
+
+    virMutexLock(&loop->lock);
+    if (virEventPollDispatchTimeouts(loop) < 0)
+        goto error;
+
+    if ((ret > 0 || loop->unpollableActive) &&
+        virEventPollDispatchHandlesEpoll(loop, ret, events) < 0)
+        goto error;
+
+    virEventPollCleanupTimeouts(loop);
+    virEventPollCleanupHandles(loop);
+
+    loop->running = 0;
+    virMutexUnlock(&loop->lock);
+    return 0;
+
+ error:
+    virMutexUnlock(&loop->lock);
+    return -1;
+}
+#endif /* WITH_EPOLL */
+
+
+static int virEventPollRunOnceLoop(struct virEventPollLoop *loop)
+{
+#if WITH_EPOLL
+    if (loop->backend == VIR_EVENT_POLL_BACKEND_EPOLL)
+        return virEventPollRunOnceEpoll(loop);
+#endif
+    return virEventPollRunOncePoll(loop);
+}
+
+/*
+ * Run a single iteration of the event loop, blocking until
+ * at least one file handle has an event, or a timer expires
+ */
+int virEventPollRunOnce(void)
+{
+    return virEventPollRunOnceLoop(&eventLoop);
+}
+
+
 static void virEventPollHandleWakeup(int watch ATTRIBUTE_UNUSED,
                                      int fd,
                                      int events ATTRIBUTE_UNUSED,
-                                     void *opaque ATTRIBUTE_UNUSED)
+                                     void *opaque)
 {
+    struct virEventPollLoop *loop = opaque;
     char c;
-    virMutexLock(&eventLoop.lock);
+    virMutexLock(&loop->lock);
     ignore_value(saferead(fd, &c, sizeof(c)));
-    virMutexUnlock(&eventLoop.lock);
+    virMutexUnlock(&loop->lock);
 }
 
-int virEventPollInit(void)
+/*
+ * Pick the backend used to wait for file handle events. epoll is
+ * preferred when it was enabled at build time, but the choice can
+ * be overridden by setting LIBVIRT_EVENT_POLL to "poll" or "epoll"
+ */
+static int virEventPollInitBackend(struct virEventPollLoop *loop)
 {
-    if (virMutexInit(&eventLoop.lock) < 0) {
+    const char *backend = virGetEnvBlockSUID("LIBVIRT_EVENT_POLL");
+
+#if WITH_EPOLL
+    loop->backend = VIR_EVENT_POLL_BACKEND_EPOLL;
+#else
+    loop->backend = VIR_EVENT_POLL_BACKEND_POLL;
+#endif
+    loop->epollfd = -1;
+
+    if (backend && *backend) {
+        int val;
+        if ((val = virEventPollBackendTypeFromString(backend)) < 0) {
+            VIR_WARN("Unknown event loop backend '%s', using '%s'",
+                     backend,
+                     virEventPollBackendTypeToString(loop->backend));
+        } else {
+            loop->backend = val;
+        }
+    }
+
+#if WITH_EPOLL
+    if (loop->backend == VIR_EVENT_POLL_BACKEND_EPOLL &&
+        (loop->epollfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create epoll instance"));
+        return -1;
+    }
+#else
+    if (loop->backend == VIR_EVENT_POLL_BACKEND_EPOLL) {
+        VIR_WARN("epoll support is not compiled in, using poll");
+        loop->backend = VIR_EVENT_POLL_BACKEND_POLL;
+    }
+#endif
+
+    VIR_DEBUG("Using %s event loop backend",
+              virEventPollBackendTypeToString(loop->backend));
+    return 0;
+}
+
+static int virEventPollLoopInit(struct virEventPollLoop *loop)
+{
+    if (virMutexInit(&loop->lock) < 0) {
         virReportSystemError(errno, "%s",
                              _("Unable to initialize mutex"));
         return -1;
     }
 
-    if (pipe2(eventLoop.wakeupfd, O_CLOEXEC | O_NONBLOCK) < 0) {
+    if (!(loop->watches = virHashCreateFull(EVENT_ALLOC_EXTENT,
+                                            NULL,
+                                            virEventPollIDCode,
+                                            virEventPollIDEqual,
+                                            virEventPollIDCopy,
+                                            NULL)) ||
+        !(loop->timers = virHashCreateFull(EVENT_ALLOC_EXTENT,
+                                           NULL,
+                                           virEventPollIDCode,
+                                           virEventPollIDEqual,
+                                           virEventPollIDCopy,
+                                           NULL)))
+        return -1;
+
+    if (virEventPollInitBackend(loop) < 0)
+        return -1;
+
+    if (pipe2(loop->wakeupfd, O_CLOEXEC | O_NONBLOCK) < 0) {
         virReportSystemError(errno, "%s",
                              _("Unable to setup wakeup pipe"));
         return -1;
     }
 
-    if (virEventPollAddHandle(eventLoop.wakeupfd[0],
-                              VIR_EVENT_HANDLE_READABLE,
-                              virEventPollHandleWakeup, NULL, NULL) < 0) {
+    if (virEventPollAddHandleInternal(loop, virAtomicIntInc(&lastWatch),
+                                      loop->wakeupfd[0],
+                                      VIR_EVENT_HANDLE_READABLE,
+                                      virEventPollHandleWakeup,
+                                      loop, NULL) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Unable to add handle %d to event loop"),
-                       eventLoop.wakeupfd[0]);
-        VIR_FORCE_CLOSE(eventLoop.wakeupfd[0]);
-        VIR_FORCE_CLOSE(eventLoop.wakeupfd[1]);
+                       loop->wakeupfd[0]);
+        VIR_FORCE_CLOSE(loop->wakeupfd[0]);
+        VIR_FORCE_CLOSE(loop->wakeupfd[1]);
         return -1;
     }
 
     return 0;
 }
 
-static int virEventPollInterruptLocked(void)
+int virEventPollInit(void)
+{
+    return virEventPollLoopInit(&eventLoop);
+}
+
+
+static void virEventPollIOLoopRun(void *opaque)
+{
+    struct virEventPollLoop *loop = opaque;
+
+    for (;;) {
+        if (virEventPollRunOnceLoop(loop) < 0) {
+            VIR_ERROR(_("I/O event loop iteration failed: %s"),
+                      virGetLastErrorMessage());
+            virResetLastError();
+        }
+    }
+}
+
+/*
+ * Start @nloops extra event loops, each in a thread of its own,
+ * to spread connection handles across. Timers and handles added
+ * with virEventPollAddHandle stay on the default loop. This can
+ * only be done once, before any I/O handle is registered.
+ */
+int virEventPollSetIOLoops(size_t nloops)
+{
+    struct virEventPollLoop **loops = NULL;
+    size_t i;
+
+    if (nloops == 0)
+        return 0;
+
+    if (virAtomicIntGet(&ioLoops.nloops) > 0) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("I/O event loops are already running"));
+        return -1;
+    }
+
+    if (nloops > INT_MAX) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("Too many I/O event loops: %zu"), nloops);
+        return -1;
+    }
+
+    if (virRWLockInit(&ioLoops.lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize mutex"));
+        return -1;
+    }
+
+    if (!(ioLoops.watches = virHashCreateFull(EVENT_ALLOC_EXTENT,
+                                              NULL,
+                                              virEventPollIDCode,
+                                              virEventPollIDEqual,
+                                              virEventPollIDCopy,
+                                              NULL)))
+        return -1;
+
+    if (VIR_ALLOC_N(loops, nloops) < 0)
+        return -1;
+
+    /* Loops are never torn down, their threads run until exit */
+    for (i = 0; i < nloops; i++) {
+        virThread thread;
+
+        if (VIR_ALLOC(loops[i]) < 0 ||
+            virEventPollLoopInit(loops[i]) < 0)
+            goto error;
+
+        if (virThreadCreate(&thread, false,
+                            virEventPollIOLoopRun, loops[i]) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create I/O event loop thread"));
+            goto error;
+        }
+    }
+
+    VIR_DEBUG("Started %zu I/O event loops", nloops);
+    ioLoops.loops = loops;
+    virAtomicIntSet(&ioLoops.nloops, nloops);
+    return 0;
+
+ error:
+    /* Loops that already have a thread are leaked on purpose, they
+     * are idle without any handles to wait on */
+    VIR_FREE(loops);
+    return -1;
+}
+
+static int virEventPollInterruptLocked(struct virEventPollLoop *loop)
 {
     char c = '\0';
 
-    if (!eventLoop.running ||
-        virThreadIsSelf(&eventLoop.leader)) {
-        VIR_DEBUG("Skip interrupt, %d %llu", eventLoop.running,
-                  virThreadID(&eventLoop.leader));
+    if (!loop->running ||
+        virThreadIsSelf(&loop->leader)) {
+        VIR_DEBUG("Skip interrupt, %d %llu", loop->running,
+                  virThreadID(&loop->leader));
         return 0;
     }
 
     VIR_DEBUG("Interrupting");
-    if (safewrite(eventLoop.wakeupfd[1], &c, sizeof(c)) != sizeof(c))
+    if (safewrite(loop->wakeupfd[1], &c, sizeof(c)) != sizeof(c))
         return -1;
     return 0;
 }
@@ -733,11 +1573,19 @@ int virEventPollInterrupt(void)
 {
     int ret;
     virMutexLock(&eventLoop.lock);
-    ret = virEventPollInterruptLocked();
+    ret = virEventPollInterruptLocked(&eventLoop);
     virMutexUnlock(&eventLoop.lock);
     return ret;
 }
 
+#if WITH_EPOLL
+/* The native event bits are handed to epoll unchanged */
+verify(POLLIN == EPOLLIN);
+verify(POLLOUT == EPOLLOUT);
+verify(POLLERR == EPOLLERR);
+verify(POLLHUP == EPOLLHUP);
+#endif
+
 int
 virEventPollToNativeEvents(int events)
 {
@@ -41,6 +41,25 @@ int virEventPollAddHandle(int fd, int events,
                           void *opaque,
                           virFreeCallback ff);
 
+/**
+ * virEventPollAddIOHandle: register a callback for monitoring connection events
+ *
+ * @fd: file handle to monitor for events
+ * @events: bitset of events to watch from POLLnnn constants
+ * @cb: callback to invoke when an event occurs
+ * @opaque: user data to pass to callback
+ *
+ * Like virEventPollAddHandle, but the handle is placed on one of
+ * the loops started by virEventPollSetIOLoops, if there are any.
+ * The callback may then run concurrently with the default loop.
+ *
+ * returns -1 if the file handle cannot be registered, 0 upon success
+ */
+int virEventPollAddIOHandle(int fd, int events,
+                            virEventHandleCallback cb,
+                            void *opaque,
+                            virFreeCallback ff);
+
 /**
  * virEventPollUpdateHandle: change event set for a monitored file handle
  *
@@ -107,6 +126,18 @@ int virEventPollRemoveTimeout(int timer);
  */
 int virEventPollInit(void);
 
+/**
+ * virEventPollSetIOLoops: start dedicated loops for connection handles
+ *
+ * @nloops: number of loops to start, each in a thread of its own
+ *
+ * May only be called once, before any handle is registered with
+ * virEventPollAddIOHandle.
+ *
+ * returns -1 if the loops could not be started
+ */
+int virEventPollSetIOLoops(size_t nloops);
+
 /**
  * virEventPollRunOnce: run a single iteration of the event loop.
  *
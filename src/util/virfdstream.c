@@ -32,6 +32,7 @@
 #endif
 #include <netinet/in.h>
 #include <termios.h>
+#include <signal.h>
 
 #include "virfdstream.h"
 #include "virerror.h"
@@ -83,6 +84,7 @@ struct virFDStreamData {
     int fd;
     unsigned long long offset;
     unsigned long long length;
+    bool partial;       /* only a range of the file is written */
 
     int watch;
     int events;         /* events the stream callback is subscribed for */
@@ -110,6 +112,7 @@ struct virFDStreamData {
     bool threadQuit;
     bool threadAbort;
     bool threadDoRead;
+    bool threadPump;    /* data goes through the pipe, see virFDStreamPump */
     virFDStreamMsgPtr msg;
 };
 
@@ -399,6 +402,8 @@ struct _virFDStreamThreadData {
     size_t length;
     bool doRead;
     bool sparse;
+    bool partial;
+    bool pump;
     int fdin;
     char *fdinname;
     int fdout;
@@ -505,9 +510,59 @@ virFDStreamThreadDoRead(virFDStreamDataPtr fdst,
 }
 
 
+/*
+ * Skip a hole of @len bytes at the current position of @fd. When the
+ * whole file is written, seeking past the hole and truncating there
+ * also gets rid of any old data past the end of the stream. When
+ * only a range of it is, other streams may be writing past the hole,
+ * so it is zeroed in place instead.
+ */
+static int
+virFDStreamWriteHole(int fd,
+                     const char *fdname,
+                     off_t len,
+                     bool partial)
+{
+    off_t off;
+
+    if ((off = lseek(fd, 0, SEEK_CUR)) == (off_t) -1) {
+        virReportSystemError(errno,
+                             _("unable to seek in %s"),
+                             fdname);
+        return -1;
+    }
+
+    if (partial &&
+        virFileZeroRange(fd, off, len) < 0) {
+        virReportSystemError(errno,
+                             _("unable to zero range in %s"),
+                             fdname);
+        return -1;
+    }
+
+    if (lseek(fd, off + len, SEEK_SET) == (off_t) -1) {
+        virReportSystemError(errno,
+                             _("unable to seek in %s"),
+                             fdname);
+        return -1;
+    }
+
+    if (!partial &&
+        ftruncate(fd, off + len) < 0) {
+        virReportSystemError(errno,
+                             _("unable to truncate %s"),
+                             fdname);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static ssize_t
 virFDStreamThreadDoWrite(virFDStreamDataPtr fdst,
                          bool sparse,
+                         bool partial,
                          const int fdin,
                          const int fdout,
                          const char *fdinname,
@@ -515,7 +570,6 @@ virFDStreamThreadDoWrite(virFDStreamDataPtr fdst,
 {
     ssize_t got = 0;
     virFDStreamMsgPtr msg = fdst->msg;
-    off_t off;
     bool pop = false;
 
     switch (msg->type) {
@@ -543,20 +597,8 @@ virFDStreamThreadDoWrite(virFDStreamDataPtr fdst,
         }
 
         got = msg->stream.hole.len;
-        off = lseek(fdout, got, SEEK_CUR);
-        if (off == (off_t) -1) {
-            virReportSystemError(errno,
-                                 _("unable to seek in %s"),
-                                 fdoutname);
+        if (virFDStreamWriteHole(fdout, fdoutname, got, partial) < 0)
             return -1;
-        }
-
-        if (ftruncate(fdout, off) < 0) {
-            virReportSystemError(errno,
-                                 _("unable to truncate %s"),
-                                 fdoutname);
-            return -1;
-        }
 
         pop = true;
         break;
@@ -578,6 +620,7 @@ virFDStreamThread(void *opaque)
     virStreamPtr st = data->st;
     size_t length = data->length;
     bool sparse = data->sparse;
+    bool partial = data->partial;
     int fdin = data->fdin;
     char *fdinname = data->fdinname;
     int fdout = data->fdout;
@@ -620,7 +663,7 @@ virFDStreamThread(void *opaque)
                                           length, total,
                                           &dataLen, buflen);
         else
-            got = virFDStreamThreadDoWrite(fdst, sparse,
+            got = virFDStreamThreadDoWrite(fdst, sparse, partial,
                                            fdin, fdout,
                                            fdinname, fdoutname);
 
@@ -649,6 +692,99 @@ virFDStreamThread(void *opaque)
 }
 
 
+#if HAVE_SPLICE
+/*
+ * Streams which don't care about holes need no messages: the thread
+ * pumps the data between the file and the pipe, the other end of
+ * which is the stream's fd, so that reads and writes of the stream
+ * just go to the pipe. The data is spliced within the kernel unless
+ * the file doesn't allow it, in which case it is copied through a
+ * buffer. The thread doesn't look at threadQuit while moving data,
+ * the stream's end of the pipe being closed is what stops it.
+ */
+static void
+virFDStreamPump(void *opaque)
+{
+    virFDStreamThreadDataPtr data = opaque;
+    virStreamPtr st = data->st;
+    virFDStreamDataPtr fdst = st->privateData;
+    size_t length = data->length;
+    size_t buflen = 256 * 1024;
+    size_t total = 0;
+    char *buf = NULL;
+    bool splice = true;
+    sigset_t sigs;
+
+    virObjectRef(fdst);
+
+    /* Writing to the pipe once the stream is closed must just fail
+     * with EPIPE, without the signal killing the process */
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+    while (!length || total < length) {
+        size_t want = buflen;
+        ssize_t got;
+
+        if (length && want > length - total)
+            want = length - total;
+
+        if (splice) {
+            if ((got = virFileSplice(data->fdin, data->fdout, want)) < 0) {
+                if (errno == ENOSYS) {
+                    VIR_DEBUG("Cannot splice %s to %s, copying instead",
+                              data->fdinname, data->fdoutname);
+                    splice = false;
+                    continue;
+                }
+                goto ioerror;
+            }
+        } else {
+            if (!buf &&
+                VIR_ALLOC_N(buf, buflen) < 0)
+                goto error;
+
+            if ((got = saferead(data->fdin, buf, want)) < 0 ||
+                (got > 0 && safewrite(data->fdout, buf, got) < 0))
+                goto ioerror;
+        }
+
+        if (got == 0)
+            break;
+
+        total += got;
+    }
+
+ cleanup:
+    virObjectLock(fdst);
+    fdst->threadQuit = true;
+    virObjectUnlock(fdst);
+    if (!virObjectUnref(fdst))
+        st->privateData = NULL;
+    VIR_FREE(buf);
+    VIR_FORCE_CLOSE(data->fdin);
+    VIR_FORCE_CLOSE(data->fdout);
+    virFDStreamThreadDataFree(data);
+    return;
+
+ ioerror:
+    /* Nobody is left to get the data of a stream closed early */
+    if (errno == EPIPE)
+        goto cleanup;
+
+    virReportSystemError(errno,
+                         _("Unable to move data from %s to %s"),
+                         data->fdinname, data->fdoutname);
+ error:
+    virObjectLock(fdst);
+    fdst->threadErr = virSaveLastError();
+    virObjectUnlock(fdst);
+    goto cleanup;
+}
+#endif /* HAVE_SPLICE */
+
+
 static int
 virFDStreamJoinWorker(virFDStreamDataPtr fdst,
                       bool streamAbort)
@@ -661,6 +797,11 @@ virFDStreamJoinWorker(virFDStreamDataPtr fdst,
     fdst->threadQuit = true;
     virCondSignal(&fdst->threadCond);
 
+    /* The pump stops once it sees our end of the pipe is closed,
+     * which for writes also means all the data was sent */
+    if (fdst->threadPump)
+        VIR_FORCE_CLOSE(fdst->fd);
+
     /* Give the thread a chance to lock the FD stream object. */
     virObjectUnlock(fdst);
     virThreadJoin(fdst->thread);
@@ -668,6 +809,7 @@ virFDStreamJoinWorker(virFDStreamDataPtr fdst,
 
     if (fdst->threadErr && !streamAbort) {
         /* errors are expected on streamAbort */
+        virSetError(fdst->threadErr);
         goto cleanup;
     }
 
@@ -721,13 +863,14 @@ virFDStreamCloseInt(virStreamPtr st, bool streamAbort)
         fdst->abortCallbackDispatching = false;
     }
 
-    if (virFDStreamJoinWorker(fdst, streamAbort) < 0)
-        ret = -1;
+    ret = virFDStreamJoinWorker(fdst, streamAbort);
 
     /* mutex locked */
-    if ((ret = VIR_CLOSE(fdst->fd)) < 0)
+    if (VIR_CLOSE(fdst->fd) < 0) {
         virReportSystemError(errno, "%s",
                              _("Unable to close"));
+        ret = -1;
+    }
 
     st->privateData = NULL;
 
@@ -794,7 +937,7 @@ static int virFDStreamWrite(virStreamPtr st, const char *bytes, size_t nbytes)
             nbytes = fdst->length - fdst->offset;
     }
 
-    if (fdst->thread) {
+    if (fdst->thread && !fdst->threadPump) {
         char *buf;
 
         if (fdst->threadQuit || fdst->threadErr) {
@@ -816,6 +959,13 @@ static int virFDStreamWrite(virStreamPtr st, const char *bytes, size_t nbytes)
         msg = NULL;
         ret = nbytes;
     } else {
+        if (fdst->threadPump &&
+            (fdst->threadQuit || fdst->threadErr)) {
+            virReportSystemError(EBADF, "%s",
+                                 _("cannot write to stream"));
+            goto cleanup;
+        }
+
      retry:
         ret = write(fdst->fd, bytes, nbytes);
         if (ret < 0) {
@@ -830,6 +980,7 @@ static int virFDStreamWrite(virStreamPtr st, const char *bytes, size_t nbytes)
                 virReportSystemError(errno, "%s",
                                      _("cannot write to stream"));
             }
+            goto cleanup;
         }
     }
 
@@ -872,7 +1023,7 @@ static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
             nbytes = fdst->length - fdst->offset;
     }
 
-    if (fdst->thread) {
+    if (fdst->thread && !fdst->threadPump) {
         virFDStreamMsgPtr msg = NULL;
 
         while (!(msg = fdst->msg)) {
@@ -938,6 +1089,13 @@ static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
             }
             goto cleanup;
         }
+
+        /* The pump closes the pipe on errors too */
+        if (ret == 0 && fdst->threadPump && fdst->threadErr) {
+            virSetError(fdst->threadErr);
+            ret = -1;
+            goto cleanup;
+        }
     }
 
     if (fdst->length)
@@ -956,7 +1114,6 @@ virFDStreamSendHole(virStreamPtr st,
 {
     virFDStreamDataPtr fdst = st->privateData;
     virFDStreamMsgPtr msg = NULL;
-    off_t off;
     int ret = -1;
 
     virCheckFlags(0, -1);
@@ -969,7 +1126,7 @@ virFDStreamSendHole(virStreamPtr st,
         fdst->offset += length;
     }
 
-    if (fdst->thread) {
+    if (fdst->thread && !fdst->threadPump) {
         /* Things are a bit complicated here. If FDStream is in a
          * read mode, then if the message at the queue head is
          * HOLE, just pop it. The thread has lseek()-ed anyway.
@@ -1003,18 +1160,9 @@ virFDStreamSendHole(virStreamPtr st,
             msg = NULL;
         }
     } else {
-        off = lseek(fdst->fd, length, SEEK_CUR);
-        if (off == (off_t) -1) {
-            virReportSystemError(errno, "%s",
-                                 _("unable to seek"));
-            goto cleanup;
-        }
-
-        if (ftruncate(fdst->fd, off) < 0) {
-            virReportSystemError(errno, "%s",
-                                 _("unable to truncate"));
+        if (virFDStreamWriteHole(fdst->fd, "stream",
+                                 length, fdst->partial) < 0)
             goto cleanup;
-        }
     }
 
     ret = 0;
@@ -1035,7 +1183,7 @@ virFDStreamInData(virStreamPtr st,
 
     virObjectLock(fdst);
 
-    if (fdst->thread) {
+    if (fdst->thread && !fdst->threadPump) {
         virFDStreamMsgPtr msg;
 
         if (fdst->threadErr)
@@ -1113,6 +1261,7 @@ static int virFDStreamOpenInternal(virStreamPtr st,
 
     if (threadData) {
         fdst->threadDoRead = threadData->doRead;
+        fdst->threadPump = threadData->pump;
 
         /* Create the thread after fdst and st were initialized.
          * The thread worker expects them to be that way. */
@@ -1127,6 +1276,9 @@ static int virFDStreamOpenInternal(virStreamPtr st,
 
         if (virThreadCreate(fdst->thread,
                             true,
+#if HAVE_SPLICE
+                            threadData->pump ? virFDStreamPump :
+#endif
                             virFDStreamThread,
                             threadData) < 0)
             goto error;
@@ -1219,7 +1371,8 @@ virFDStreamOpenFileInternal(virStreamPtr st,
                             int oflags,
                             int mode,
                             bool forceIOHelper,
-                            bool sparse)
+                            bool sparse,
+                            bool partial)
 {
     int fd = -1;
     int pipefds[2] = { -1, -1 };
@@ -1227,8 +1380,8 @@ virFDStreamOpenFileInternal(virStreamPtr st,
     struct stat sb;
     virFDStreamThreadDataPtr threadData = NULL;
 
-    VIR_DEBUG("st=%p path=%s oflags=0x%x offset=%llu length=%llu mode=0%o",
-              st, path, oflags, offset, length, mode);
+    VIR_DEBUG("st=%p path=%s oflags=0x%x offset=%llu length=%llu mode=0%o "
+              "partial=%d", st, path, oflags, offset, length, mode, partial);
 
     oflags |= O_NOCTTY | O_BINARY;
 
@@ -1287,6 +1440,12 @@ virFDStreamOpenFileInternal(virStreamPtr st,
         threadData->st = virObjectRef(st);
         threadData->length = length;
         threadData->sparse = sparse;
+        threadData->partial = partial;
+#if HAVE_SPLICE
+        /* Only messages can carry holes, and O_DIRECT needs
+         * aligned buffers */
+        threadData->pump = !sparse && !(oflags & O_DIRECT);
+#endif
 
         if ((oflags & O_ACCMODE) == O_RDONLY) {
             threadData->fdin = fd;
@@ -1310,6 +1469,8 @@ virFDStreamOpenFileInternal(virStreamPtr st,
     if (virFDStreamOpenInternal(st, tmpfd, threadData, length) < 0)
         goto error;
 
+    ((virFDStreamDataPtr) st->privateData)->partial = partial;
+
     return 0;
 
  error:
@@ -1336,7 +1497,7 @@ int virFDStreamOpenFile(virStreamPtr st,
     }
     return virFDStreamOpenFileInternal(st, path,
                                        offset, length,
-                                       oflags, 0, false, false);
+                                       oflags, 0, false, false, false);
 }
 
 int virFDStreamCreateFile(virStreamPtr st,
@@ -1349,7 +1510,7 @@ int virFDStreamCreateFile(virStreamPtr st,
     return virFDStreamOpenFileInternal(st, path,
                                        offset, length,
                                        oflags | O_CREAT, mode,
-                                       false, false);
+                                       false, false, false);
 }
 
 #ifdef HAVE_CFMAKERAW
@@ -1365,7 +1526,7 @@ int virFDStreamOpenPTY(virStreamPtr st,
     if (virFDStreamOpenFileInternal(st, path,
                                     offset, length,
                                     oflags | O_CREAT, 0,
-                                    false, false) < 0)
+                                    false, false, false) < 0)
         return -1;
 
     fdst = st->privateData;
@@ -1402,7 +1563,7 @@ int virFDStreamOpenPTY(virStreamPtr st,
     return virFDStreamOpenFileInternal(st, path,
                                        offset, length,
                                        oflags | O_CREAT, 0,
-                                       false, false);
+                                       false, false, false);
 }
 #endif /* !HAVE_CFMAKERAW */
 
@@ -1411,11 +1572,12 @@ int virFDStreamOpenBlockDevice(virStreamPtr st,
                                unsigned long long offset,
                                unsigned long long length,
                                bool sparse,
+                               bool partial,
                                int oflags)
 {
     return virFDStreamOpenFileInternal(st, path,
                                        offset, length,
-                                       oflags, 0, true, sparse);
+                                       oflags, 0, true, sparse, partial);
 }
 
 int virFDStreamSetInternalCloseCb(virStreamPtr st,
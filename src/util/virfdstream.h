@@ -60,6 +60,7 @@ int virFDStreamOpenBlockDevice(virStreamPtr st,
                                unsigned long long offset,
                                unsigned long long length,
                                bool sparse,
+                               bool partial,
                                int oflags);
 
 int virFDStreamSetInternalCloseCb(virStreamPtr st,
@@ -1227,6 +1227,112 @@ int virFileAllocate(int fd, off_t offset, off_t len)
     return safezero_sys_fallocate(fd, offset, len);
 }
 
+#if HAVE_SYS_SYSCALL_H && defined(SYS_fallocate) && \
+    defined(FALLOC_FL_PUNCH_HOLE) && defined(FALLOC_FL_KEEP_SIZE)
+static int
+virFilePunchHole(int fd,
+                 off_t offset,
+                 off_t len)
+{
+    return syscall(SYS_fallocate, fd,
+                   FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                   offset, len);
+}
+#else /* !HAVE_SYS_SYSCALL_H || !defined(SYS_fallocate) || ... */
+static int
+virFilePunchHole(int fd ATTRIBUTE_UNUSED,
+                 off_t offset ATTRIBUTE_UNUSED,
+                 off_t len ATTRIBUTE_UNUSED)
+{
+    errno = ENOSYS;
+    return -1;
+}
+#endif /* !HAVE_SYS_SYSCALL_H || !defined(SYS_fallocate) || ... */
+
+/**
+ * virFileZeroRange:
+ * @fd: file descriptor to write to
+ * @offset: start of the range
+ * @len: length of the range
+ *
+ * Make @len bytes of @fd starting at @offset read back as zeros,
+ * deallocating them if the file system can. The file grows if it
+ * ends before the range does, but unlike seeking and truncating it
+ * never shrinks, so this is safe while other parts of the file are
+ * being written to. The file offset is undefined afterwards.
+ *
+ * Returns 0 on success, -1 on error with errno set.
+ */
+int
+virFileZeroRange(int fd,
+                 off_t offset,
+                 off_t len)
+{
+    char zero = 0;
+
+    if (len <= 0)
+        return 0;
+
+    if (lseek(fd, offset + len - 1, SEEK_SET) < 0 ||
+        safewrite(fd, &zero, 1) != 1)
+        return -1;
+
+    if (len == 1 ||
+        virFilePunchHole(fd, offset, len) == 0)
+        return 0;
+
+    if (errno != EOPNOTSUPP && errno != ENOSYS)
+        return -1;
+
+    return safezero_slow(fd, offset, len - 1);
+}
+
+/**
+ * virFileSplice:
+ * @fdin: file descriptor to read from
+ * @fdout: file descriptor to write to
+ * @len: maximum number of bytes to move
+ *
+ * Move up to @len bytes from the current position of @fdin to the
+ * one of @fdout without copying them through user space. At least
+ * one of the descriptors must be a pipe. Blocks until some data can
+ * be moved, unless the descriptors are non-blocking.
+ *
+ * Returns the number of bytes moved, 0 at the end of @fdin, or -1 on
+ * error with errno set. errno is ENOSYS if the platform or either of
+ * the files can't do this, in which case the data has to be copied
+ * instead.
+ */
+#if HAVE_SPLICE
+ssize_t
+virFileSplice(int fdin,
+              int fdout,
+              size_t len)
+{
+    ssize_t ret;
+
+    do {
+        ret = splice(fdin, NULL, fdout, NULL, len, SPLICE_F_MOVE);
+    } while (ret < 0 && errno == EINTR);
+
+    /* Files opened for appending, and file systems which don't
+     * implement splicing, are refused with EINVAL */
+    if (ret < 0 && errno == EINVAL)
+        errno = ENOSYS;
+
+    return ret;
+}
+#else /* !HAVE_SPLICE */
+ssize_t
+virFileSplice(int fdin ATTRIBUTE_UNUSED,
+              int fdout ATTRIBUTE_UNUSED,
+              size_t len ATTRIBUTE_UNUSED)
+{
+    errno = ENOSYS;
+    return -1;
+}
+#endif /* !HAVE_SPLICE */
+
 #if defined HAVE_MNTENT_H && defined HAVE_GETMNTENT_R
 /* search /proc/mounts for mount point of *type; return pointer to
  * malloc'ed string of the path if found, otherwise return NULL
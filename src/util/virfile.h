@@ -46,6 +46,10 @@ int safezero(int fd, off_t offset, off_t len)
     ATTRIBUTE_RETURN_CHECK;
 int virFileAllocate(int fd, off_t offset, off_t len)
     ATTRIBUTE_RETURN_CHECK;
+int virFileZeroRange(int fd, off_t offset, off_t len)
+    ATTRIBUTE_RETURN_CHECK;
+ssize_t virFileSplice(int fdin, int fdout, size_t len)
+    ATTRIBUTE_RETURN_CHECK;
 
 /* Don't call these directly - use the macros below */
 int virFileClose(int *fdptr, virFileCloseFlags flags)
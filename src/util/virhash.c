@@ -1,5 +1,5 @@
 /*
- * virhash.c: chained hash tables
+ * virhash.c: open addressing hash tables
  *
  * Reference: Your favorite introductory book on algorithms
  *
@@ -37,9 +37,15 @@
 
 VIR_LOG_INIT("util.hash");
 
-#define MAX_HASH_LEN 8
+/* Number of slots the table starts with if no size is given */
+#define VIR_HASH_DEFAULT_SIZE 32
 
-/* #define DEBUG_GROW */
+/* The table is grown once more than 3/4 of the slots are used */
+#define VIR_HASH_MAX_LOAD(size) ((size) / 4 * 3)
+
+/* Number of slots moved from the old to the new array of slots by
+ * every change of the table while it is being grown */
+#define VIR_HASH_MIGRATE_STEP 16
 
 #define virHashIterationError(ret) \
     do { \
@@ -48,24 +54,48 @@ VIR_LOG_INIT("util.hash");
     } while (0)
 
 /*
- * A single entry in the hash table
+ * A single slot of the hash table. Empty slots have @name set to NULL.
+ * Slots whose entry was removed during an iteration have @name set to
+ * VIR_HASH_DELETED until the iteration is over, so that nothing else
+ * moves while the iterator is walking the table.
  */
 typedef struct _virHashEntry virHashEntry;
 typedef virHashEntry *virHashEntryPtr;
 struct _virHashEntry {
-    struct _virHashEntry *next;
     void *name;
     void *payload;
+    uint32_t code;
 };
 
+static char virHashDeletedKey;
+#define VIR_HASH_DELETED ((void *) &virHashDeletedKey)
+
 /*
  * The entire hash table
+ *
+ * Entries live directly in a power of two sized array of slots, using
+ * linear probing with Robin Hood ordering: an entry is never further
+ * from its home slot than the entries it passes, which keeps probe
+ * sequences short and lets lookups of missing keys stop early. Removal
+ * shifts the following entries back instead of leaving tombstones.
+ *
+ * Growing the table allocates an array twice the size and moves the
+ * entries over a few slots at a time with every following change of
+ * the table, rather than all at once. Until that is done, @oldTable
+ * holds the entries that were not moved yet, all of them at or after
+ * @oldNext. Lookups never move anything, so concurrent lookups are as
+ * safe as they were with the chained implementation.
  */
 struct _virHashTable {
-    virHashEntryPtr *table;
-    uint32_t seed;
+    virHashEntryPtr table;
     size_t size;
+    virHashEntryPtr oldTable;
+    size_t oldSize;
+    size_t oldNext;
+    uint32_t seed;
     size_t nbElems;
+    /* Number of VIR_HASH_DELETED slots. */
+    size_t nbDeleted;
     /* True iff we are iterating over hash entries. */
     bool iterating;
     /* Pointer to the current entry during iteration. */
@@ -129,16 +159,241 @@ virHashValueFree(void *value, const void *name ATTRIBUTE_UNUSED)
 }
 
 
+/*
+ * Number of slots needed to hold @size entries without growing, or the
+ * default if no size was given.
+ */
 static size_t
-virHashComputeKey(const virHashTable *table, const void *name)
+virHashRoundSize(ssize_t size)
+{
+    size_t ret = 8;
+
+    if (size <= 0)
+        return VIR_HASH_DEFAULT_SIZE;
+
+    while (VIR_HASH_MAX_LOAD(ret) < (size_t) size)
+        ret *= 2;
+
+    return ret;
+}
+
+
+/* Distance of the entry in slot @pos from its home slot */
+static inline size_t
+virHashEntryDistance(const virHashEntry *entry, size_t pos, size_t size)
+{
+    return (pos - (entry->code & (size - 1))) & (size - 1);
+}
+
+
+/**
+ * virHashFindSlot:
+ * @slots: array of slots
+ * @size: number of @slots
+ * @skip: index of the first slot that wasn't moved away yet
+ * @table: the hash table
+ * @name: the key to look for
+ * @code: hash code of @name
+ *
+ * Look @name up in @slots. Slots below @skip were emptied by moving their
+ * entries to the new array while growing, but the entries that follow
+ * were left where they were, so probing just continues behind them.
+ *
+ * Returns the slot holding @name or NULL if it is not there.
+ */
+static virHashEntryPtr
+virHashFindSlot(virHashEntryPtr slots,
+                size_t size,
+                size_t skip,
+                const virHashTable *table,
+                const void *name,
+                uint32_t code)
+{
+    size_t mask = size - 1;
+    size_t pos = code & mask;
+    size_t dist = 0;
+
+    while (dist < size) {
+        virHashEntryPtr entry;
+
+        if (pos < skip) {
+            dist += skip - pos;
+            pos = skip;
+            if (pos == size)
+                break;
+        }
+
+        entry = &slots[pos];
+        if (!entry->name ||
+            virHashEntryDistance(entry, pos, size) < dist)
+            break;
+
+        if (entry->code == code &&
+            entry->name != VIR_HASH_DELETED &&
+            table->keyEqual(entry->name, name))
+            return entry;
+
+        pos = (pos + 1) & mask;
+        dist++;
+    }
+
+    return NULL;
+}
+
+
+static virHashEntryPtr
+virHashFind(const virHashTable *table,
+            const void *name,
+            uint32_t code,
+            bool *old)
+{
+    virHashEntryPtr entry;
+
+    *old = false;
+    if ((entry = virHashFindSlot(table->table, table->size, 0,
+                                 table, name, code)))
+        return entry;
+
+    if (!table->oldTable)
+        return NULL;
+
+    *old = true;
+    return virHashFindSlot(table->oldTable, table->oldSize, table->oldNext,
+                           table, name, code);
+}
+
+
+/*
+ * Put @entry into @slots, which must have a free slot and mustn't
+ * contain the key already.
+ */
+static void
+virHashInsertSlot(virHashEntryPtr slots,
+                  size_t size,
+                  virHashEntry entry)
+{
+    size_t mask = size - 1;
+    size_t pos = entry.code & mask;
+    size_t dist = 0;
+
+    for (;; pos = (pos + 1) & mask, dist++) {
+        virHashEntryPtr slot = &slots[pos];
+        virHashEntry tmp;
+        size_t slotdist;
+
+        if (!slot->name) {
+            *slot = entry;
+            return;
+        }
+
+        /* Robin Hood: take the slot from an entry closer to its home */
+        slotdist = virHashEntryDistance(slot, pos, size);
+        if (slotdist < dist) {
+            tmp = *slot;
+            *slot = entry;
+            entry = tmp;
+            dist = slotdist;
+        }
+    }
+}
+
+
+/*
+ * Empty the slot at @pos, moving the entries that follow it one slot
+ * back towards their home so that no gap breaks their probe sequence.
+ */
+static void
+virHashRemoveSlot(virHashEntryPtr slots,
+                  size_t size,
+                  size_t pos)
+{
+    size_t mask = size - 1;
+    size_t next;
+
+    for (;;) {
+        next = (pos + 1) & mask;
+        if (!slots[next].name ||
+            virHashEntryDistance(&slots[next], next, size) == 0)
+            break;
+
+        slots[pos] = slots[next];
+        pos = next;
+    }
+
+    memset(&slots[pos], 0, sizeof(slots[pos]));
+}
+
+
+/*
+ * Move up to @count slots of the old array over to the new one and free
+ * the old array once it's empty.
+ */
+static void
+virHashMigrate(virHashTablePtr table, size_t count)
 {
-    uint32_t value = table->keyCode(name, table->seed);
-    return value % table->size;
+    while (table->oldTable && count--) {
+        virHashEntryPtr entry = &table->oldTable[table->oldNext];
+
+        if (entry->name) {
+            virHashInsertSlot(table->table, table->size, *entry);
+            memset(entry, 0, sizeof(*entry));
+        }
+
+        if (++table->oldNext == table->oldSize) {
+            VIR_FREE(table->oldTable);
+            table->oldSize = 0;
+            table->oldNext = 0;
+        }
+    }
 }
 
+
+/*
+ * Remove the VIR_HASH_DELETED slots left behind by removals during
+ * an iteration.
+ */
+static void
+virHashPurgeSlots(virHashEntryPtr slots, size_t size, size_t *count)
+{
+    size_t pos = 0;
+
+    /* Shifting entries back may move a deleted slot from the start
+     * of the array to its end, hence going round more than once */
+    while (*count) {
+        while (slots[pos].name == VIR_HASH_DELETED) {
+            virHashRemoveSlot(slots, size, pos);
+            (*count)--;
+        }
+        pos = (pos + 1) & (size - 1);
+    }
+}
+
+
+static void
+virHashPurge(virHashTablePtr table)
+{
+    size_t count = 0;
+    size_t i;
+
+    if (!table->nbDeleted)
+        return;
+
+    if (table->oldTable) {
+        for (i = table->oldNext; i < table->oldSize; i++) {
+            if (table->oldTable[i].name == VIR_HASH_DELETED)
+                count++;
+        }
+        table->nbDeleted -= count;
+        virHashPurgeSlots(table->oldTable, table->oldSize, &count);
+    }
+
+    virHashPurgeSlots(table->table, table->size, &table->nbDeleted);
+}
+
+
 /**
  * virHashCreateFull:
- * @size: the size of the hash table
+ * @size: number of entries to make room for, or 0 for the default
  * @dataFree: callback to free data
  * @keyCode: callback to compute hash code
  * @keyEqual: callback to compare hash keys
@@ -158,14 +413,11 @@ virHashTablePtr virHashCreateFull(ssize_t size,
 {
     virHashTablePtr table = NULL;
 
-    if (size <= 0)
-        size = 256;
-
     if (VIR_ALLOC(table) < 0)
         return NULL;
 
     table->seed = virRandomBits(32);
-    table->size = size;
+    table->size = virHashRoundSize(size);
     table->nbElems = 0;
     table->dataFree = dataFree;
     table->keyCode = keyCode;
@@ -173,7 +425,7 @@ virHashTablePtr virHashCreateFull(ssize_t size,
     table->keyCopy = keyCopy;
     table->keyFree = keyFree;
 
-    if (VIR_ALLOC_N(table->table, size) < 0) {
+    if (VIR_ALLOC_N(table->table, table->size) < 0) {
         VIR_FREE(table);
         return NULL;
     }
@@ -184,7 +436,7 @@ virHashTablePtr virHashCreateFull(ssize_t size,
 
 /**
  * virHashCreate:
- * @size: the size of the hash table
+ * @size: number of entries to make room for, or 0 for the default
  * @dataFree: callback to free data
  *
  * Create a new virHashTablePtr.
@@ -234,62 +486,27 @@ virHashAtomicDispose(void *obj)
 /**
  * virHashGrow:
  * @table: the hash table
- * @size: the new size of the hash table
  *
- * resize the hash table
+ * Start moving the entries of the hash table to an array of slots twice
+ * the size. Any growth still in progress is finished first.
  *
  * Returns 0 in case of success, -1 in case of failure
  */
 static int
-virHashGrow(virHashTablePtr table, size_t size)
+virHashGrow(virHashTablePtr table)
 {
-    size_t oldsize, i;
-    virHashEntryPtr *oldtable;
+    virHashEntryPtr slots;
 
-#ifdef DEBUG_GROW
-    size_t nbElem = 0;
-#endif
+    virHashMigrate(table, SIZE_MAX);
 
-    if (table == NULL)
-        return -1;
-    if (size < 8)
-        return -1;
-    if (size > 8 * 2048)
-        return -1;
-
-    oldsize = table->size;
-    oldtable = table->table;
-    if (oldtable == NULL)
-        return -1;
-
-    if (VIR_ALLOC_N(table->table, size) < 0) {
-        table->table = oldtable;
+    if (VIR_ALLOC_N(slots, table->size * 2) < 0)
         return -1;
-    }
-    table->size = size;
-
-    for (i = 0; i < oldsize; i++) {
-        virHashEntryPtr iter = oldtable[i];
-        while (iter) {
-            virHashEntryPtr next = iter->next;
-            size_t key = virHashComputeKey(table, iter->name);
-
-            iter->next = table->table[key];
-            table->table[key] = iter;
-
-#ifdef DEBUG_GROW
-            nbElem++;
-#endif
-            iter = next;
-        }
-    }
-
-    VIR_FREE(oldtable);
 
-#ifdef DEBUG_GROW
-    VIR_DEBUG("virHashGrow : from %d to %d, %ld elems", oldsize,
-              size, nbElem);
-#endif
+    table->oldTable = table->table;
+    table->oldSize = table->size;
+    table->oldNext = 0;
+    table->table = slots;
+    table->size *= 2;
 
     return 0;
 }
@@ -301,29 +518,37 @@ virHashGrow(virHashTablePtr table, size_t size)
  * Free the hash @table and its contents. The userdata is
  * deallocated with function provided at creation time.
  */
-void
-virHashFree(virHashTablePtr table)
+static void
+virHashFreeSlots(virHashTablePtr table,
+                 virHashEntryPtr slots,
+                 size_t start,
+                 size_t size)
 {
     size_t i;
 
-    if (table == NULL)
-        return;
+    for (i = start; i < size; i++) {
+        virHashEntryPtr entry = &slots[i];
 
-    for (i = 0; i < table->size; i++) {
-        virHashEntryPtr iter = table->table[i];
-        while (iter) {
-            virHashEntryPtr next = iter->next;
+        if (!entry->name || entry->name == VIR_HASH_DELETED)
+            continue;
 
-            if (table->dataFree)
-                table->dataFree(iter->payload, iter->name);
-            if (table->keyFree)
-                table->keyFree(iter->name);
-            VIR_FREE(iter);
-            iter = next;
-        }
+        if (table->dataFree)
+            table->dataFree(entry->payload, entry->name);
+        if (table->keyFree)
+            table->keyFree(entry->name);
     }
 
-    VIR_FREE(table->table);
+    VIR_FREE(slots);
+}
+
+void
+virHashFree(virHashTablePtr table)
+{
+    if (table == NULL)
+        return;
+
+    virHashFreeSlots(table, table->table, 0, table->size);
+    virHashFreeSlots(table, table->oldTable, table->oldNext, table->oldSize);
     VIR_FREE(table);
 }
 
@@ -332,9 +557,10 @@ virHashAddOrUpdateEntry(virHashTablePtr table, const void *name,
                         void *userdata,
                         bool is_update)
 {
-    size_t key, len = 0;
-    virHashEntryPtr entry;
-    void *new_name;
+    virHashEntry entry;
+    virHashEntryPtr found;
+    uint32_t code;
+    bool old;
 
     if ((table == NULL) || (name == NULL))
         return -1;
@@ -342,40 +568,37 @@ virHashAddOrUpdateEntry(virHashTablePtr table, const void *name,
     if (table->iterating)
         virHashIterationError(-1);
 
-    key = virHashComputeKey(table, name);
+    code = table->keyCode(name, table->seed);
 
     /* Check for duplicate entry */
-    for (entry = table->table[key]; entry; entry = entry->next) {
-        if (table->keyEqual(entry->name, name)) {
-            if (is_update) {
-                if (table->dataFree)
-                    table->dataFree(entry->payload, entry->name);
-                entry->payload = userdata;
-                return 0;
-            } else {
-                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                               _("Duplicate key"));
-                return -1;
-            }
+    if ((found = virHashFind(table, name, code, &old))) {
+        if (is_update) {
+            if (table->dataFree)
+                table->dataFree(found->payload, found->name);
+            found->payload = userdata;
+            return 0;
+        } else {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Duplicate key"));
+            return -1;
         }
-        len++;
     }
 
-    if (VIR_ALLOC(entry) < 0 || !(new_name = table->keyCopy(name))) {
-        VIR_FREE(entry);
+    /* A failure to grow is fine as long as there is a free slot left */
+    if (table->nbElems >= VIR_HASH_MAX_LOAD(table->size) &&
+        virHashGrow(table) < 0 &&
+        table->nbElems + 1 >= table->size)
         return -1;
-    }
 
-    entry->name = new_name;
-    entry->payload = userdata;
-    entry->next = table->table[key];
-    table->table[key] = entry;
+    if (!(entry.name = table->keyCopy(name)))
+        return -1;
+    entry.payload = userdata;
+    entry.code = code;
 
+    virHashMigrate(table, VIR_HASH_MIGRATE_STEP);
+    virHashInsertSlot(table->table, table->size, entry);
     table->nbElems++;
 
-    if (len > MAX_HASH_LEN)
-        virHashGrow(table, MAX_HASH_LEN * table->size);
-
     return 0;
 }
 
@@ -435,25 +658,25 @@ virHashAtomicUpdate(virHashAtomicPtr table,
  * @table: the hash table
  * @name: the name of the userdata
  *
- * Find the userdata specified by @name
+ * Find the userdata specified by @name. This never modifies @table,
+ * not even while it is being grown.
  *
  * Returns a pointer to the userdata
  */
 void *
 virHashLookup(const virHashTable *table, const void *name)
 {
-    size_t key;
     virHashEntryPtr entry;
+    bool old;
 
     if (!table || !name)
         return NULL;
 
-    key = virHashComputeKey(table, name);
-    for (entry = table->table[key]; entry; entry = entry->next) {
-        if (table->keyEqual(entry->name, name))
-            return entry->payload;
-    }
-    return NULL;
+    if (!(entry = virHashFind(table, name,
+                              table->keyCode(name, table->seed), &old)))
+        return NULL;
+
+    return entry->payload;
 }
 
 
@@ -514,7 +737,7 @@ virHashSize(const virHashTable *table)
  * virHashTableSize:
  * @table: the hash table
  *
- * Query the size of the hash @table, i.e., number of buckets in the table.
+ * Query the size of the hash @table, i.e., number of slots in the table.
  *
  * Returns the number of keys in the hash table or
  * -1 in case of error
@@ -528,6 +751,34 @@ virHashTableSize(const virHashTable *table)
 }
 
 
+/*
+ * Free the entry in @slot, which is in the old array of slots if @old
+ * is true. While iterating, the slot is only marked as deleted.
+ */
+static void
+virHashRemoveFound(virHashTablePtr table,
+                   virHashEntryPtr slot,
+                   bool old)
+{
+    if (table->dataFree)
+        table->dataFree(slot->payload, slot->name);
+    if (table->keyFree)
+        table->keyFree(slot->name);
+    table->nbElems--;
+
+    if (table->iterating) {
+        slot->name = VIR_HASH_DELETED;
+        slot->payload = NULL;
+        table->nbDeleted++;
+    } else if (old) {
+        virHashRemoveSlot(table->oldTable, table->oldSize,
+                          slot - table->oldTable);
+    } else {
+        virHashRemoveSlot(table->table, table->size, slot - table->table);
+    }
+}
+
+
 /**
  * virHashRemoveEntry:
  * @table: the hash table
@@ -543,30 +794,88 @@ int
 virHashRemoveEntry(virHashTablePtr table, const void *name)
 {
     virHashEntryPtr entry;
-    virHashEntryPtr *nextptr;
+    bool old;
 
     if (table == NULL || name == NULL)
         return -1;
 
-    nextptr = table->table + virHashComputeKey(table, name);
-    for (entry = *nextptr; entry; entry = entry->next) {
-        if (table->keyEqual(entry->name, name)) {
-            if (table->iterating && table->current != entry)
-                virHashIterationError(-1);
+    if (!(entry = virHashFind(table, name,
+                              table->keyCode(name, table->seed), &old)))
+        return -1;
 
-            if (table->dataFree)
-                table->dataFree(entry->payload, entry->name);
-            if (table->keyFree)
-                table->keyFree(entry->name);
-            *nextptr = entry->next;
-            VIR_FREE(entry);
-            table->nbElems--;
-            return 0;
-        }
-        nextptr = &entry->next;
+    if (table->iterating && table->current != entry)
+        virHashIterationError(-1);
+
+    virHashRemoveFound(table, entry, old);
+
+    if (!table->iterating)
+        virHashMigrate(table, VIR_HASH_MIGRATE_STEP);
+
+    return 0;
+}
+
+
+/*
+ * Call @iter on every entry of the table until it returns non-zero.
+ * Entries removed by @iter are only marked as deleted, so nothing moves
+ * under the loops. The deleted slots are purged once all is done.
+ *
+ * Returns the last return value of @iter or 0.
+ */
+static int
+virHashIterate(virHashTablePtr table,
+               int (*iter)(virHashTablePtr table,
+                           virHashEntryPtr entry,
+                           bool old,
+                           void *opaque),
+               void *opaque)
+{
+    size_t i;
+    int ret = 0;
+
+    table->iterating = true;
+    table->current = NULL;
+
+    for (i = 0; ret == 0 && i < table->size; i++) {
+        if (table->table[i].name &&
+            table->table[i].name != VIR_HASH_DELETED)
+            ret = iter(table, &table->table[i], false, opaque);
     }
 
-    return -1;
+    for (i = table->oldNext; ret == 0 && i < table->oldSize; i++) {
+        if (table->oldTable[i].name &&
+            table->oldTable[i].name != VIR_HASH_DELETED)
+            ret = iter(table, &table->oldTable[i], true, opaque);
+    }
+
+    table->current = NULL;
+    table->iterating = false;
+
+    virHashPurge(table);
+
+    return ret;
+}
+
+
+struct virHashForEachData {
+    virHashIterator iter;
+    void *data;
+};
+
+static int
+virHashForEachEntry(virHashTablePtr table,
+                    virHashEntryPtr entry,
+                    bool old ATTRIBUTE_UNUSED,
+                    void *opaque)
+{
+    struct virHashForEachData *data = opaque;
+    int ret;
+
+    table->current = entry;
+    ret = data->iter(entry->payload, entry->name, data->data);
+    table->current = NULL;
+
+    return ret < 0 ? -1 : 0;
 }
 
 
@@ -587,8 +896,7 @@ virHashRemoveEntry(virHashTablePtr table, const void *name)
 int
 virHashForEach(virHashTablePtr table, virHashIterator iter, void *data)
 {
-    size_t i;
-    int ret = -1;
+    struct virHashForEachData fedata = { iter, data };
 
     if (table == NULL || iter == NULL)
         return -1;
@@ -596,27 +904,30 @@ virHashForEach(virHashTablePtr table, virHashIterator iter, void *data)
     if (table->iterating)
         virHashIterationError(-1);
 
-    table->iterating = true;
-    table->current = NULL;
-    for (i = 0; i < table->size; i++) {
-        virHashEntryPtr entry = table->table[i];
-        while (entry) {
-            virHashEntryPtr next = entry->next;
-            table->current = entry;
-            ret = iter(entry->payload, entry->name, data);
-            table->current = NULL;
-
-            if (ret < 0)
-                goto cleanup;
-
-            entry = next;
-        }
+    return virHashIterate(table, virHashForEachEntry, &fedata);
+}
+
+
+struct virHashRemoveSetData {
+    virHashSearcher iter;
+    const void *data;
+    size_t count;
+};
+
+static int
+virHashRemoveSetEntry(virHashTablePtr table,
+                      virHashEntryPtr entry,
+                      bool old,
+                      void *opaque)
+{
+    struct virHashRemoveSetData *data = opaque;
+
+    if (data->iter(entry->payload, entry->name, data->data)) {
+        virHashRemoveFound(table, entry, old);
+        data->count++;
     }
 
-    ret = 0;
- cleanup:
-    table->iterating = false;
-    return ret;
+    return 0;
 }
 
 
@@ -638,7 +949,7 @@ virHashRemoveSet(virHashTablePtr table,
                  virHashSearcher iter,
                  const void *data)
 {
-    size_t i, count = 0;
+    struct virHashRemoveSetData rsdata = { iter, data, 0 };
 
     if (table == NULL || iter == NULL)
         return -1;
@@ -646,30 +957,9 @@ virHashRemoveSet(virHashTablePtr table,
     if (table->iterating)
         virHashIterationError(-1);
 
-    table->iterating = true;
-    table->current = NULL;
-    for (i = 0; i < table->size; i++) {
-        virHashEntryPtr *nextptr = table->table + i;
-
-        while (*nextptr) {
-            virHashEntryPtr entry = *nextptr;
-            if (!iter(entry->payload, entry->name, data)) {
-                nextptr = &entry->next;
-            } else {
-                count++;
-                if (table->dataFree)
-                    table->dataFree(entry->payload, entry->name);
-                if (table->keyFree)
-                    table->keyFree(entry->name);
-                *nextptr = entry->next;
-                VIR_FREE(entry);
-                table->nbElems--;
-            }
-        }
-    }
-    table->iterating = false;
+    virHashIterate(table, virHashRemoveSetEntry, &rsdata);
 
-    return count;
+    return rsdata.count;
 }
 
 static int
@@ -697,6 +987,29 @@ virHashRemoveAll(virHashTablePtr table)
                             NULL);
 }
 
+
+struct virHashSearchData {
+    virHashSearcher iter;
+    const void *data;
+    virHashEntryPtr found;
+};
+
+static int
+virHashSearchEntry(virHashTablePtr table ATTRIBUTE_UNUSED,
+                   virHashEntryPtr entry,
+                   bool old ATTRIBUTE_UNUSED,
+                   void *opaque)
+{
+    struct virHashSearchData *data = opaque;
+
+    if (!data->iter(entry->payload, entry->name, data->data))
+        return 0;
+
+    data->found = entry;
+    return 1;
+}
+
+
 /**
  * virHashSearch:
  * @table: the hash table to search
@@ -715,7 +1028,7 @@ void *virHashSearch(const virHashTable *ctable,
                     const void *data,
                     void **name)
 {
-    size_t i;
+    struct virHashSearchData sdata = { iter, data, NULL };
 
     /* Cast away const for internal detection of misuse.  */
     virHashTablePtr table = (virHashTablePtr)ctable;
@@ -726,22 +1039,14 @@ void *virHashSearch(const virHashTable *ctable,
     if (table->iterating)
         virHashIterationError(NULL);
 
-    table->iterating = true;
-    table->current = NULL;
-    for (i = 0; i < table->size; i++) {
-        virHashEntryPtr entry;
-        for (entry = table->table[i]; entry; entry = entry->next) {
-            if (iter(entry->payload, entry->name, data)) {
-                table->iterating = false;
-                if (name)
-                    *name = table->keyCopy(entry->name);
-                return entry->payload;
-            }
-        }
-    }
-    table->iterating = false;
+    virHashIterate(table, virHashSearchEntry, &sdata);
 
-    return NULL;
+    if (!sdata.found)
+        return NULL;
+
+    if (name)
+        *name = table->keyCopy(sdata.found->name);
+    return sdata.found->payload;
 }
 
 struct getKeysIter
@@ -0,0 +1,650 @@
+/*
+ * virshardedhash.c: hash tables of objects shared between threads
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <sched.h>
+
+#include "virshardedhash.h"
+
+#include "viralloc.h"
+#include "viratomic.h"
+#include "virerror.h"
+#include "virhashcode.h"
+#include "virobject.h"
+#include "virrandom.h"
+#include "virstring.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/*
+ * The table maps strings to virObjects and is split into shards by the
+ * top bits of the hash code of the key. Each shard has a mutex
+ * serializing the changes of the shard, so that only changes hitting
+ * the same shard wait for each other.
+ *
+ * Readers take no lock at all. The entries of a shard live in an
+ * immutable version of the shard, which a change replaces by a
+ * modified copy. A reader announces itself in one of the two reader
+ * counters of the shard, selected by the current epoch, before it
+ * loads the version, and withdraws once it is done with it. After
+ * publishing a new version, the writer flips the epoch and waits for
+ * the readers counted by the other counter to go away, twice, which
+ * covers any reader that might still see the old version. Only then
+ * the old version is freed and the reference on a removed object is
+ * dropped. As readers only ever look up an entry and take a reference
+ * on it, the wait is very short.
+ *
+ * Copying a shard on every change makes changes O(n / shards), which
+ * is fine for registries of domains or pools, which change rarely
+ * compared to how often they are looked up.
+ */
+
+#define VIR_SHARDED_HASH_SHARD_BITS 5
+#define VIR_SHARDED_HASH_SHARDS (1 << VIR_SHARDED_HASH_SHARD_BITS)
+
+/* Smallest number of slots of a version of a shard */
+#define VIR_SHARDED_HASH_MIN_SIZE 8
+
+typedef struct _virShardedHashEntry virShardedHashEntry;
+typedef virShardedHashEntry *virShardedHashEntryPtr;
+struct _virShardedHashEntry {
+    char *name; /* NULL for empty slots */
+    void *payload;
+    uint32_t code;
+};
+
+/* Open addressing table with linear probing which is never changed
+ * once published. At most 3/4 of the slots are used, so a lookup
+ * always ends at an empty slot. */
+typedef struct _virShardedHashVersion virShardedHashVersion;
+typedef virShardedHashVersion *virShardedHashVersionPtr;
+struct _virShardedHashVersion {
+    size_t size; /* a power of two */
+    size_t nentries;
+    virShardedHashEntry slots[0];
+};
+
+typedef struct _virShardedHashShard virShardedHashShard;
+typedef virShardedHashShard *virShardedHashShardPtr;
+struct _virShardedHashShard {
+    virMutex lock;
+    virShardedHashVersionPtr version; /* NULL while empty */
+    int epoch; /* 0 or 1, only changed with @lock held */
+    int readers[2];
+};
+
+struct _virShardedHash {
+    virShardedHashShard shards[VIR_SHARDED_HASH_SHARDS];
+    uint32_t seed;
+    int nentries;
+};
+
+
+static uint32_t
+virShardedHashCode(virShardedHashPtr hash,
+                   const char *name)
+{
+    return virHashCodeGen(name, strlen(name), hash->seed);
+}
+
+
+static virShardedHashShardPtr
+virShardedHashGetShard(virShardedHashPtr hash,
+                       uint32_t code)
+{
+    return &hash->shards[code >> (32 - VIR_SHARDED_HASH_SHARD_BITS)];
+}
+
+
+static virShardedHashEntryPtr
+virShardedHashVersionFind(virShardedHashVersionPtr version,
+                          const char *name,
+                          uint32_t code)
+{
+    size_t mask;
+    size_t i;
+
+    if (!version)
+        return NULL;
+
+    mask = version->size - 1;
+    for (i = code & mask; version->slots[i].name; i = (i + 1) & mask) {
+        if (version->slots[i].code == code &&
+            STREQ(version->slots[i].name, name))
+            return &version->slots[i];
+    }
+
+    return NULL;
+}
+
+
+static void
+virShardedHashVersionInsert(virShardedHashVersionPtr version,
+                            const virShardedHashEntry *entry)
+{
+    size_t mask = version->size - 1;
+    size_t i;
+
+    for (i = entry->code & mask; version->slots[i].name; i = (i + 1) & mask)
+        ;
+
+    version->slots[i] = *entry;
+    version->nentries++;
+}
+
+
+/*
+ * Build a copy of @version with @add added and @skip left out, both
+ * of which are optional.
+ *
+ * Returns 0 on success, -1 on error. @copy is set to NULL if the copy
+ * would be empty.
+ */
+static int
+virShardedHashVersionCopy(virShardedHashVersionPtr version,
+                          const virShardedHashEntry *add,
+                          const virShardedHashEntry *skip,
+                          virShardedHashVersionPtr *copy)
+{
+    size_t nentries = version ? version->nentries : 0;
+    size_t size = VIR_SHARDED_HASH_MIN_SIZE;
+    size_t i;
+
+    *copy = NULL;
+
+    if (add)
+        nentries++;
+    if (skip)
+        nentries--;
+
+    if (nentries == 0)
+        return 0;
+
+    while (size / 4 * 3 < nentries)
+        size *= 2;
+
+    if (VIR_ALLOC_VAR(*copy, virShardedHashEntry, size) < 0)
+        return -1;
+    (*copy)->size = size;
+
+    for (i = 0; version && i < version->size; i++) {
+        if (version->slots[i].name && &version->slots[i] != skip)
+            virShardedHashVersionInsert(*copy, &version->slots[i]);
+    }
+
+    if (add)
+        virShardedHashVersionInsert(*copy, add);
+
+    return 0;
+}
+
+
+static void
+virShardedHashVersionFree(virShardedHashVersionPtr version)
+{
+    size_t i;
+
+    if (!version)
+        return;
+
+    for (i = 0; i < version->size; i++) {
+        if (version->slots[i].name) {
+            VIR_FREE(version->slots[i].name);
+            virObjectUnref(version->slots[i].payload);
+        }
+    }
+
+    VIR_FREE(version);
+}
+
+
+/*
+ * Enter a read side critical section of @shard and return its
+ * current version, which stays valid until virShardedHashReadEnd()
+ * is called with @epoch.
+ */
+static virShardedHashVersionPtr
+virShardedHashReadBegin(virShardedHashShardPtr shard,
+                        int *epoch)
+{
+    *epoch = virAtomicIntGet(&shard->epoch);
+    virAtomicIntInc(&shard->readers[*epoch]);
+    return virAtomicPtrGet(&shard->version);
+}
+
+
+static void
+virShardedHashReadEnd(virShardedHashShardPtr shard,
+                      int epoch)
+{
+    virAtomicIntAdd(&shard->readers[epoch], -1);
+}
+
+
+/*
+ * Replace the version of @shard, which the caller must hold the lock
+ * of, with @version, and wait until no reader can see the previous
+ * one anymore. A reader which picked the epoch before it was flipped
+ * might still register with the counter we are not waiting for, hence
+ * both counters are drained in turn.
+ */
+static void
+virShardedHashPublish(virShardedHashShardPtr shard,
+                      virShardedHashVersionPtr version)
+{
+    size_t i;
+    int epoch;
+
+    virAtomicPtrSet(&shard->version, version);
+
+    for (i = 0; i < 2; i++) {
+        epoch = shard->epoch;
+        virAtomicIntSet(&shard->epoch, !epoch);
+
+        while (virAtomicIntGet(&shard->readers[epoch]) > 0)
+            sched_yield();
+    }
+}
+
+
+/**
+ * virShardedHashNew:
+ *
+ * Create a new hash table mapping strings to virObjects, which can
+ * be looked up from any number of threads without taking a lock,
+ * while other threads change it.
+ *
+ * Returns the newly created table, or NULL on error.
+ */
+virShardedHashPtr
+virShardedHashNew(void)
+{
+    virShardedHashPtr hash;
+    size_t i;
+
+    if (VIR_ALLOC(hash) < 0)
+        return NULL;
+
+    for (i = 0; i < VIR_SHARDED_HASH_SHARDS; i++) {
+        if (virMutexInit(&hash->shards[i].lock) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("cannot initialize mutex"));
+            while (i--)
+                virMutexDestroy(&hash->shards[i].lock);
+            VIR_FREE(hash);
+            return NULL;
+        }
+    }
+
+    hash->seed = virRandomBits(32);
+
+    return hash;
+}
+
+
+/**
+ * virShardedHashFree:
+ * @hash: the hash table
+ *
+ * Free the hash @hash and drop its references on the objects in it.
+ * Nobody else may be using the table anymore.
+ */
+void
+virShardedHashFree(virShardedHashPtr hash)
+{
+    size_t i;
+
+    if (!hash)
+        return;
+
+    for (i = 0; i < VIR_SHARDED_HASH_SHARDS; i++) {
+        virShardedHashVersionFree(hash->shards[i].version);
+        virMutexDestroy(&hash->shards[i].lock);
+    }
+
+    VIR_FREE(hash);
+}
+
+
+/**
+ * virShardedHashSize:
+ * @hash: the hash table
+ *
+ * Query the number of objects in the hash table. Without any
+ * external locking, the number may be stale by the time it is used.
+ *
+ * Returns the number of objects in the table, or -1 in case of error
+ */
+ssize_t
+virShardedHashSize(virShardedHashPtr hash)
+{
+    if (!hash)
+        return -1;
+
+    return virAtomicIntGet(&hash->nentries);
+}
+
+
+/**
+ * virShardedHashAdd:
+ * @hash: the hash table
+ * @name: the name of the object
+ * @payload: the virObject to add
+ *
+ * Add @payload to the hash table under @name, taking a reference on
+ * it. Adding the same name twice is an error.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virShardedHashAdd(virShardedHashPtr hash,
+                  const char *name,
+                  void *payload)
+{
+    virShardedHashEntry entry = { NULL, payload, 0 };
+    virShardedHashVersionPtr version = NULL;
+    virShardedHashVersionPtr old;
+    virShardedHashShardPtr shard;
+    int ret = -1;
+
+    if (!hash)
+        return -1;
+
+    entry.code = virShardedHashCode(hash, name);
+    shard = virShardedHashGetShard(hash, entry.code);
+
+    virMutexLock(&shard->lock);
+    old = shard->version;
+
+    if (virShardedHashVersionFind(old, name, entry.code)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Duplicate key"));
+        goto cleanup;
+    }
+
+    if (VIR_STRDUP(entry.name, name) < 0 ||
+        virShardedHashVersionCopy(old, &entry, NULL, &version) < 0) {
+        VIR_FREE(entry.name);
+        goto cleanup;
+    }
+
+    virObjectRef(payload);
+    virShardedHashPublish(shard, version);
+    virAtomicIntInc(&hash->nentries);
+    VIR_FREE(old);
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&shard->lock);
+    return ret;
+}
+
+
+/**
+ * virShardedHashRemove:
+ * @hash: the hash table
+ * @name: the name of the object
+ *
+ * Remove the object @name from the hash table and drop the reference
+ * the table holds on it. Lookups which found it before still hold
+ * their own references.
+ *
+ * Returns 0 if the object was removed, -1 if it was not found or in
+ * case of an error, without reporting it.
+ */
+int
+virShardedHashRemove(virShardedHashPtr hash,
+                     const char *name)
+{
+    virShardedHashVersionPtr version = NULL;
+    virShardedHashVersionPtr old;
+    virShardedHashEntryPtr found;
+    virShardedHashEntry removed;
+    virShardedHashShardPtr shard;
+    uint32_t code;
+
+    if (!hash)
+        return -1;
+
+    code = virShardedHashCode(hash, name);
+    shard = virShardedHashGetShard(hash, code);
+
+    virMutexLock(&shard->lock);
+    old = shard->version;
+
+    if (!(found = virShardedHashVersionFind(old, name, code)) ||
+        virShardedHashVersionCopy(old, NULL, found, &version) < 0) {
+        virMutexUnlock(&shard->lock);
+        return -1;
+    }
+
+    removed = *found;
+    virShardedHashPublish(shard, version);
+    virAtomicIntAdd(&hash->nentries, -1);
+    virMutexUnlock(&shard->lock);
+
+    VIR_FREE(old);
+    VIR_FREE(removed.name);
+    virObjectUnref(removed.payload);
+    return 0;
+}
+
+
+/**
+ * virShardedHashRemoveAll:
+ * @hash: the hash table
+ *
+ * Remove all objects from the hash table and drop the references the
+ * table holds on them.
+ */
+void
+virShardedHashRemoveAll(virShardedHashPtr hash)
+{
+    virShardedHashVersionPtr old;
+    virShardedHashShardPtr shard;
+    size_t i;
+
+    if (!hash)
+        return;
+
+    for (i = 0; i < VIR_SHARDED_HASH_SHARDS; i++) {
+        shard = &hash->shards[i];
+
+        virMutexLock(&shard->lock);
+        if (!(old = shard->version)) {
+            virMutexUnlock(&shard->lock);
+            continue;
+        }
+        virShardedHashPublish(shard, NULL);
+        virAtomicIntAdd(&hash->nentries, -(int) old->nentries);
+        virMutexUnlock(&shard->lock);
+
+        virShardedHashVersionFree(old);
+    }
+}
+
+
+/**
+ * virShardedHashLookupRef:
+ * @hash: the hash table
+ * @name: the name of the object
+ *
+ * Find the object @name in the hash table without taking any lock.
+ *
+ * Returns a new reference on the object, which the caller has to drop
+ * with virObjectUnref(), or NULL if it was not found.
+ */
+void *
+virShardedHashLookupRef(virShardedHashPtr hash,
+                        const char *name)
+{
+    virShardedHashVersionPtr version;
+    virShardedHashEntryPtr found;
+    virShardedHashShardPtr shard;
+    void *ret = NULL;
+    uint32_t code;
+    int epoch;
+
+    if (!hash)
+        return NULL;
+
+    code = virShardedHashCode(hash, name);
+    shard = virShardedHashGetShard(hash, code);
+
+    version = virShardedHashReadBegin(shard, &epoch);
+    if ((found = virShardedHashVersionFind(version, name, code)))
+        ret = virObjectRef(found->payload);
+    virShardedHashReadEnd(shard, epoch);
+
+    return ret;
+}
+
+
+/**
+ * virShardedHashGetValues:
+ * @hash: the hash table
+ * @payloads: filled with the objects in the table
+ *
+ * Collect the objects in the hash table without taking any lock.
+ * Objects added or removed concurrently may or may not be included.
+ * The caller has to free the list with virObjectListFreeCount().
+ *
+ * Returns the number of objects in @payloads, or -1 on error.
+ */
+ssize_t
+virShardedHashGetValues(virShardedHashPtr hash,
+                        void ***payloads)
+{
+    virShardedHashVersionPtr version;
+    virShardedHashShardPtr shard;
+    void **list = NULL;
+    size_t nlist = 0;
+    size_t alloc = 0;
+    size_t i;
+    size_t j;
+    int epoch;
+
+    *payloads = NULL;
+
+    if (!hash)
+        return -1;
+
+    for (i = 0; i < VIR_SHARDED_HASH_SHARDS; i++) {
+        shard = &hash->shards[i];
+
+        version = virShardedHashReadBegin(shard, &epoch);
+        if (!version) {
+            virShardedHashReadEnd(shard, epoch);
+            continue;
+        }
+
+        if (VIR_RESIZE_N(list, alloc, nlist, version->nentries) < 0) {
+            virShardedHashReadEnd(shard, epoch);
+            virObjectListFreeCount(list, nlist);
+            return -1;
+        }
+
+        for (j = 0; j < version->size; j++) {
+            if (version->slots[j].name)
+                list[nlist++] = virObjectRef(version->slots[j].payload);
+        }
+        virShardedHashReadEnd(shard, epoch);
+    }
+
+    *payloads = list;
+    return nlist;
+}
+
+
+/**
+ * virShardedHashForEach:
+ * @hash: the hash table
+ * @iter: callback to process each object
+ * @opaque: opaque data to pass to the iterator
+ *
+ * Iterate over the objects in the hash table, as collected by
+ * virShardedHashGetValues(). The iterator runs without any lock held
+ * and may change the table.
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+int
+virShardedHashForEach(virShardedHashPtr hash,
+                      virShardedHashIterator iter,
+                      void *opaque)
+{
+    void **list;
+    ssize_t nlist;
+    ssize_t i;
+    int ret = 0;
+
+    if (!iter || (nlist = virShardedHashGetValues(hash, &list)) < 0)
+        return -1;
+
+    for (i = 0; i < nlist; i++) {
+        if (iter(list[i], opaque) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+
+    virObjectListFreeCount(list, nlist);
+    return ret;
+}
+
+
+/**
+ * virShardedHashSearchRef:
+ * @hash: the hash table
+ * @searcher: callback to identify the object desired
+ * @opaque: opaque data to pass to the searcher
+ *
+ * Search the objects in the hash table, as collected by
+ * virShardedHashGetValues(), for the first one @searcher accepts.
+ * The searcher runs without any lock held.
+ *
+ * Returns a new reference on the object found, which the caller has
+ * to drop with virObjectUnref(), or NULL if there was none.
+ */
+void *
+virShardedHashSearchRef(virShardedHashPtr hash,
+                        virShardedHashSearcher searcher,
+                        const void *opaque)
+{
+    void **list;
+    ssize_t nlist;
+    ssize_t i;
+    void *ret = NULL;
+
+    if (!searcher || (nlist = virShardedHashGetValues(hash, &list)) < 0)
+        return NULL;
+
+    for (i = 0; i < nlist; i++) {
+        if (searcher(list[i], opaque)) {
+            ret = virObjectRef(list[i]);
+            break;
+        }
+    }
+
+    virObjectListFreeCount(list, nlist);
+    return ret;
+}
@@ -0,0 +1,79 @@
+/*
+ * virshardedhash.h: hash tables of objects shared between threads
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VIR_SHARDED_HASH_H__
+# define __VIR_SHARDED_HASH_H__
+
+# include "internal.h"
+
+typedef struct _virShardedHash virShardedHash;
+typedef virShardedHash *virShardedHashPtr;
+
+/**
+ * virShardedHashIterator:
+ * @payload: the object in the table
+ * @opaque: user supplied data blob
+ *
+ * Callback to process an object during iteration
+ *
+ * Returns -1 to stop the iteration, e.g. in case of an error
+ */
+typedef int (*virShardedHashIterator)(void *payload, void *opaque);
+
+/**
+ * virShardedHashSearcher:
+ * @payload: the object in the table
+ * @opaque: user supplied data blob
+ *
+ * Callback to identify the object desired
+ *
+ * Returns 1 if the object is desired, 0 to move to the next one
+ */
+typedef int (*virShardedHashSearcher)(const void *payload,
+                                      const void *opaque);
+
+virShardedHashPtr virShardedHashNew(void);
+void virShardedHashFree(virShardedHashPtr hash);
+
+ssize_t virShardedHashSize(virShardedHashPtr hash);
+
+int virShardedHashAdd(virShardedHashPtr hash,
+                      const char *name,
+                      void *payload)
+    ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+int virShardedHashRemove(virShardedHashPtr hash,
+                         const char *name)
+    ATTRIBUTE_NONNULL(2);
+void virShardedHashRemoveAll(virShardedHashPtr hash);
+
+void *virShardedHashLookupRef(virShardedHashPtr hash,
+                              const char *name)
+    ATTRIBUTE_NONNULL(2);
+
+ssize_t virShardedHashGetValues(virShardedHashPtr hash,
+                                void ***payloads);
+int virShardedHashForEach(virShardedHashPtr hash,
+                          virShardedHashIterator iter,
+                          void *opaque);
+void *virShardedHashSearchRef(virShardedHashPtr hash,
+                              virShardedHashSearcher searcher,
+                              const void *opaque);
+
+#endif /* __VIR_SHARDED_HASH_H__ */
@@ -2049,6 +2049,10 @@ virStorageSourceCopy(const virStorageSource *src,
     ret->type = src->type;
     ret->protocol = src->protocol;
     ret->format = src->format;
+    ret->authInherited = src->authInherited;
+    ret->encryptionInherited = src->encryptionInherited;
+    ret->nocow = src->nocow;
+    ret->sparse = src->sparse;
     ret->capacity = src->capacity;
     ret->allocation = src->allocation;
     ret->has_allocation = src->has_allocation;
@@ -26,31 +26,88 @@
 
 #include <config.h>
 
+#include <time.h>
+
 #include "virthreadpool.h"
 #include "viralloc.h"
 #include "virthread.h"
 #include "virerror.h"
+#include "virhash.h"
+#include "virhashcode.h"
+#include "virtime.h"
+#include "virutil.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
+/*
+ * Jobs are queued per owner, and normal workers serve the owners
+ * with queued jobs fairly rather than in plain FIFO order. Each owner
+ * accumulates a virtual time, which is the worker time its jobs used
+ * divided by its weight, and the owner with the lowest virtual time is
+ * served next. When a job is picked, its owner is charged the average
+ * cost of its recent jobs straight away, so that an owner flooding the
+ * pool with slow jobs cannot grab all idle workers at once, and the
+ * charge is corrected once the job is done.
+ *
+ * An owner whose queue was empty starts from the virtual time of the
+ * owner served last, rather than with the credit it may have saved
+ * while idle. Jobs of a single owner always run in the order they were
+ * sent, and jobs without an owner share a default queue.
+ *
+ * Priority workers ignore all of this and only run priority jobs in
+ * the order they were sent, just like before.
+ *
+ * The pool normally adds a worker whenever a job is sent while none
+ * is free, and never gets rid of them. When a target latency is set,
+ * workers are added only once jobs wait for a worker longer than that,
+ * and a worker which stayed idle for VIR_THREAD_POOL_IDLE_TIMEOUT quits
+ * as long as jobs wait less than half the target and no worker was
+ * added in that time. The gap between the two thresholds keeps the
+ * pool from growing and shrinking back and forth under steady load.
+ */
+
+/* Cost of a job of an owner with no history yet, in nanoseconds */
+#define VIR_THREAD_POOL_INITIAL_COST 100000ULL
+
+/* How long a worker of an adaptive pool stays idle before quitting, in ms */
+#define VIR_THREAD_POOL_IDLE_TIMEOUT 10000ULL
+
 typedef struct _virThreadPoolJob virThreadPoolJob;
 typedef virThreadPoolJob *virThreadPoolJobPtr;
 
+typedef struct _virThreadPoolQueue virThreadPoolQueue;
+typedef virThreadPoolQueue *virThreadPoolQueuePtr;
+
 struct _virThreadPoolJob {
+    /* Within the queue of the owner */
     virThreadPoolJobPtr prev;
     virThreadPoolJobPtr next;
+    /* Within the list of priority jobs */
+    virThreadPoolJobPtr prioPrev;
+    virThreadPoolJobPtr prioNext;
     unsigned int priority;
 
+    virThreadPoolQueuePtr queue;
+    unsigned long long queued;
+
     void *data;
 };
 
-typedef struct _virThreadPoolJobList virThreadPoolJobList;
-typedef virThreadPoolJobList *virThreadPoolJobListPtr;
+struct _virThreadPoolQueue {
+    unsigned int weight;
+    unsigned long long vtime;   /* Worker time used in ns, divided by weight */
+    unsigned long long cost;    /* Average cost of a job in ns */
+    size_t refs;                /* Jobs queued or running, plus the owner */
 
-struct _virThreadPoolJobList {
     virThreadPoolJobPtr head;
     virThreadPoolJobPtr tail;
-    virThreadPoolJobPtr firstPrio;
+
+    /* Within the list of queues which have jobs */
+    bool active;
+    virThreadPoolQueuePtr activePrev;
+    virThreadPoolQueuePtr activeNext;
+
+    virThreadPoolOwnerStats stats;
 };
 
 
@@ -60,9 +117,23 @@ struct _virThreadPool {
     virThreadPoolJobFunc jobFunc;
     const char *jobFuncName;
     void *jobOpaque;
-    virThreadPoolJobList jobList;
     size_t jobQueueDepth;
 
+    virHashTablePtr queues;             /* owner -> virThreadPoolQueue */
+    virThreadPoolQueuePtr defaultQueue; /* For jobs without an owner */
+    virThreadPoolQueuePtr activeHead;
+    virThreadPoolQueuePtr activeTail;
+    unsigned long long vclock;          /* Virtual time of the last owner served */
+
+    virThreadPoolJobPtr prioHead;
+    virThreadPoolJobPtr prioTail;
+
+    unsigned long long targetLatency;   /* In ns, 0 disables adaptive sizing */
+    unsigned long long latency;         /* Average wait of recent jobs, in ns */
+    unsigned long long lastGrow;
+    size_t workersAdded;
+    size_t workersRemoved;
+
     virMutex mutex;
     virCond cond;
     virCond quit_cond;
@@ -93,6 +164,295 @@ static inline bool virThreadPoolWorkerQuitHelper(size_t count, size_t limit)
     return count > limit;
 }
 
+static unsigned long long
+virThreadPoolNow(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+    return 0;
+}
+
+static uint32_t
+virThreadPoolOwnerCode(const void *name, uint32_t seed)
+{
+    return virHashCodeGen(&name, sizeof(name), seed);
+}
+
+static bool
+virThreadPoolOwnerEqual(const void *namea, const void *nameb)
+{
+    return namea == nameb;
+}
+
+static void *
+virThreadPoolOwnerCopy(const void *name)
+{
+    return (void *)name;
+}
+
+static virThreadPoolQueuePtr
+virThreadPoolQueueNew(void)
+{
+    virThreadPoolQueuePtr queue;
+
+    if (VIR_ALLOC(queue) < 0)
+        return NULL;
+
+    queue->weight = 1;
+    queue->cost = VIR_THREAD_POOL_INITIAL_COST;
+    queue->refs = 1;
+
+    return queue;
+}
+
+static void
+virThreadPoolQueueUnref(virThreadPoolQueuePtr queue)
+{
+    if (queue && --queue->refs == 0)
+        VIR_FREE(queue);
+}
+
+static void
+virThreadPoolQueueHashFree(void *payload,
+                           const void *name ATTRIBUTE_UNUSED)
+{
+    virThreadPoolQueueUnref(payload);
+}
+
+/* Look up the queue of @owner, creating it if needed */
+static virThreadPoolQueuePtr
+virThreadPoolGetQueue(virThreadPoolPtr pool,
+                      const void *owner)
+{
+    virThreadPoolQueuePtr queue;
+
+    if (!owner)
+        return pool->defaultQueue;
+
+    if ((queue = virHashLookup(pool->queues, owner)))
+        return queue;
+
+    if (!(queue = virThreadPoolQueueNew()))
+        return NULL;
+
+    if (virHashAddEntry(pool->queues, owner, queue) < 0) {
+        VIR_FREE(queue);
+        return NULL;
+    }
+
+    return queue;
+}
+
+static void
+virThreadPoolPushJob(virThreadPoolPtr pool,
+                     virThreadPoolQueuePtr queue,
+                     virThreadPoolJobPtr job)
+{
+    job->queue = queue;
+    queue->refs++;
+
+    job->prev = queue->tail;
+    if (queue->tail)
+        queue->tail->next = job;
+    else
+        queue->head = job;
+    queue->tail = job;
+    queue->stats.queued++;
+
+    if (!queue->active) {
+        /* No credit for the time the queue was idle */
+        if (queue->vtime < pool->vclock)
+            queue->vtime = pool->vclock;
+
+        queue->active = true;
+        queue->activePrev = pool->activeTail;
+        if (pool->activeTail)
+            pool->activeTail->activeNext = queue;
+        else
+            pool->activeHead = queue;
+        pool->activeTail = queue;
+    }
+
+    if (job->priority) {
+        job->prioPrev = pool->prioTail;
+        if (pool->prioTail)
+            pool->prioTail->prioNext = job;
+        else
+            pool->prioHead = job;
+        pool->prioTail = job;
+    }
+
+    pool->jobQueueDepth++;
+}
+
+static void
+virThreadPoolUnlinkJob(virThreadPoolPtr pool,
+                       virThreadPoolJobPtr job)
+{
+    virThreadPoolQueuePtr queue = job->queue;
+
+    if (job->prev)
+        job->prev->next = job->next;
+    else
+        queue->head = job->next;
+    if (job->next)
+        job->next->prev = job->prev;
+    else
+        queue->tail = job->prev;
+    queue->stats.queued--;
+
+    if (!queue->head) {
+        if (queue->activePrev)
+            queue->activePrev->activeNext = queue->activeNext;
+        else
+            pool->activeHead = queue->activeNext;
+        if (queue->activeNext)
+            queue->activeNext->activePrev = queue->activePrev;
+        else
+            pool->activeTail = queue->activePrev;
+        queue->activePrev = queue->activeNext = NULL;
+        queue->active = false;
+    }
+
+    if (job->priority) {
+        if (job->prioPrev)
+            job->prioPrev->prioNext = job->prioNext;
+        else
+            pool->prioHead = job->prioNext;
+        if (job->prioNext)
+            job->prioNext->prioPrev = job->prioPrev;
+        else
+            pool->prioTail = job->prioPrev;
+    }
+
+    pool->jobQueueDepth--;
+}
+
+/* Pick the first job of the owner which used the least time so far */
+static virThreadPoolJobPtr
+virThreadPoolNextJob(virThreadPoolPtr pool)
+{
+    virThreadPoolQueuePtr best = pool->activeHead;
+    virThreadPoolQueuePtr queue;
+
+    for (queue = best->activeNext; queue; queue = queue->activeNext) {
+        if (queue->vtime < best->vtime)
+            best = queue;
+    }
+
+    return best->head;
+}
+
+/* How long the job which has been waiting the longest has waited */
+static unsigned long long
+virThreadPoolOldestWait(virThreadPoolPtr pool,
+                        unsigned long long now)
+{
+    virThreadPoolQueuePtr queue;
+    unsigned long long oldest = now;
+
+    for (queue = pool->activeHead; queue; queue = queue->activeNext) {
+        if (queue->head->queued < oldest)
+            oldest = queue->head->queued;
+    }
+
+    return now - oldest;
+}
+
+static int virThreadPoolExpand(virThreadPoolPtr pool, size_t gain,
+                               bool priority);
+
+/*
+ * Add workers to an adaptive pool if jobs wait for one longer than the
+ * target latency. New workers get a target latency worth of time to
+ * make a difference before any more are added.
+ */
+static int
+virThreadPoolAdaptGrow(virThreadPoolPtr pool)
+{
+    unsigned long long now;
+    size_t gain;
+
+    if (!pool->targetLatency || pool->quit ||
+        pool->nWorkers >= pool->maxWorkers ||
+        pool->jobQueueDepth <= pool->freeWorkers)
+        return 0;
+
+    now = virThreadPoolNow();
+
+    /* Somebody has to run the jobs no matter what */
+    if (pool->nWorkers > 0) {
+        if (now - pool->lastGrow < pool->targetLatency)
+            return 0;
+
+        if (pool->latency <= pool->targetLatency &&
+            virThreadPoolOldestWait(pool, now) <= pool->targetLatency)
+            return 0;
+    }
+
+    gain = MAX(pool->nWorkers / 4, 1);
+    gain = MIN(gain, pool->jobQueueDepth - pool->freeWorkers);
+    gain = MIN(gain, pool->maxWorkers - pool->nWorkers);
+
+    if (virThreadPoolExpand(pool, gain, false) < 0)
+        return -1;
+
+    pool->lastGrow = now;
+    pool->workersAdded += gain;
+    return 0;
+}
+
+/*
+ * Decide whether a worker of an adaptive pool which has been idle for
+ * VIR_THREAD_POOL_IDLE_TIMEOUT should quit.
+ */
+static bool
+virThreadPoolAdaptShrink(virThreadPoolPtr pool)
+{
+    if (!pool->targetLatency || pool->activeHead ||
+        pool->nWorkers <= pool->minWorkers)
+        return false;
+
+    /* Nothing was queued for a while, forget about the old jobs */
+    pool->latency /= 2;
+
+    if (pool->latency >= pool->targetLatency / 2 ||
+        virThreadPoolNow() - pool->lastGrow <
+        VIR_THREAD_POOL_IDLE_TIMEOUT * 1000000ULL)
+        return false;
+
+    pool->workersRemoved++;
+    return true;
+}
+
+static int
+virThreadPoolWait(virThreadPoolPtr pool,
+                  virCondPtr cond,
+                  bool priority,
+                  bool *idle)
+{
+    unsigned long long now;
+
+    *idle = false;
+
+    if (priority || !pool->targetLatency ||
+        virTimeMillisNow(&now) < 0)
+        return virCondWait(cond, &pool->mutex);
+
+    if (virCondWaitUntil(cond, &pool->mutex,
+                         now + VIR_THREAD_POOL_IDLE_TIMEOUT) < 0) {
+        if (errno != ETIMEDOUT)
+            return -1;
+        *idle = true;
+    }
+
+    return 0;
+}
+
 static void virThreadPoolWorker(void *opaque)
 {
     struct virThreadPoolWorkerData *data = opaque;
@@ -102,6 +462,12 @@ static void virThreadPoolWorker(void *opaque)
     size_t *curWorkers = priority ? &pool->nPrioWorkers : &pool->nWorkers;
     size_t *maxLimit = priority ? &pool->maxPrioWorkers : &pool->maxWorkers;
     virThreadPoolJobPtr job = NULL;
+    virThreadPoolQueuePtr queue;
+    unsigned long long start;
+    unsigned long long end;
+    unsigned long long cost;
+    unsigned long long charge;
+    bool idle;
 
     VIR_FREE(data);
 
@@ -117,11 +483,11 @@ static void virThreadPoolWorker(void *opaque)
         if (virThreadPoolWorkerQuitHelper(*curWorkers, *maxLimit))
             goto out;
         while (!pool->quit &&
-               ((!priority && !pool->jobList.head) ||
-                (priority && !pool->jobList.firstPrio))) {
+               ((!priority && !pool->activeHead) ||
+                (priority && !pool->prioHead))) {
             if (!priority)
                 pool->freeWorkers++;
-            if (virCondWait(cond, &pool->mutex) < 0) {
+            if (virThreadPoolWait(pool, cond, priority, &idle) < 0) {
                 if (!priority)
                     pool->freeWorkers--;
                 goto out;
@@ -131,42 +497,54 @@ static void virThreadPoolWorker(void *opaque)
 
             if (virThreadPoolWorkerQuitHelper(*curWorkers, *maxLimit))
                 goto out;
+
+            if (idle && virThreadPoolAdaptShrink(pool))
+                goto out;
         }
 
         if (pool->quit)
             break;
 
-        if (priority) {
-            job = pool->jobList.firstPrio;
-        } else {
-            job = pool->jobList.head;
-        }
+        if (priority)
+            job = pool->prioHead;
+        else
+            job = virThreadPoolNextJob(pool);
 
-        if (job == pool->jobList.firstPrio) {
-            virThreadPoolJobPtr tmp = job->next;
-            while (tmp) {
-                if (tmp->priority)
-                    break;
-                tmp = tmp->next;
-            }
-            pool->jobList.firstPrio = tmp;
-        }
+        queue = job->queue;
+        virThreadPoolUnlinkJob(pool, job);
 
-        if (job->prev)
-            job->prev->next = job->next;
-        else
-            pool->jobList.head = job->next;
-        if (job->next)
-            job->next->prev = job->prev;
-        else
-            pool->jobList.tail = job->prev;
+        start = virThreadPoolNow();
+        if (start > job->queued) {
+            queue->stats.waitTime += (start - job->queued) / 1000;
+            if (!priority)
+                pool->latency = (pool->latency * 7 +
+                                 start - job->queued) / 8;
+        }
+        queue->stats.jobs++;
+        queue->stats.running++;
 
-        pool->jobQueueDepth--;
+        /* Charge the expected cost up front and the real one once
+         * the job is done */
+        pool->vclock = queue->vtime;
+        charge = queue->cost / queue->weight;
+        queue->vtime += charge;
 
         virMutexUnlock(&pool->mutex);
         (pool->jobFunc)(job->data, pool->jobOpaque);
         VIR_FREE(job);
+        end = virThreadPoolNow();
         virMutexLock(&pool->mutex);
+
+        cost = end > start ? end - start : 0;
+        queue->vtime += cost / queue->weight;
+        queue->vtime -= charge;
+        queue->cost = (queue->cost * 7 + cost) / 8;
+        queue->stats.running--;
+        virThreadPoolQueueUnref(queue);
+
+        /* Jobs may be stuck behind slow ones with nobody sending more */
+        if (virThreadPoolAdaptGrow(pool) < 0)
+            virResetLastError();
     }
 
  out:
@@ -233,8 +611,6 @@ virThreadPoolNewFull(size_t minWorkers,
     if (VIR_ALLOC(pool) < 0)
         return NULL;
 
-    pool->jobList.tail = pool->jobList.head = NULL;
-
     pool->jobFunc = func;
     pool->jobFuncName = funcName;
     pool->jobOpaque = opaque;
@@ -246,6 +622,15 @@ virThreadPoolNewFull(size_t minWorkers,
     if (virCondInit(&pool->quit_cond) < 0)
         goto error;
 
+    if (!(pool->queues = virHashCreateFull(32,
+                                           virThreadPoolQueueHashFree,
+                                           virThreadPoolOwnerCode,
+                                           virThreadPoolOwnerEqual,
+                                           virThreadPoolOwnerCopy,
+                                           NULL)) ||
+        !(pool->defaultQueue = virThreadPoolQueueNew()))
+        goto error;
+
     pool->minWorkers = minWorkers;
     pool->maxWorkers = maxWorkers;
     pool->maxPrioWorkers = prioWorkers;
@@ -272,6 +657,7 @@ virThreadPoolNewFull(size_t minWorkers,
 void virThreadPoolFree(virThreadPoolPtr pool)
 {
     virThreadPoolJobPtr job;
+    virThreadPoolQueuePtr queue;
     bool priority = false;
 
     if (!pool)
@@ -289,10 +675,15 @@ void virThreadPoolFree(virThreadPoolPtr pool)
     while (pool->nWorkers > 0 || pool->nPrioWorkers > 0)
         ignore_value(virCondWait(&pool->quit_cond, &pool->mutex));
 
-    while ((job = pool->jobList.head)) {
-        pool->jobList.head = pool->jobList.head->next;
+    while (pool->activeHead) {
+        job = pool->activeHead->head;
+        queue = job->queue;
+        virThreadPoolUnlinkJob(pool, job);
         VIR_FREE(job);
+        virThreadPoolQueueUnref(queue);
     }
+    virHashFree(pool->queues);
+    virThreadPoolQueueUnref(pool->defaultQueue);
 
     VIR_FREE(pool->workers);
     virMutexUnlock(&pool->mutex);
@@ -362,6 +753,50 @@ size_t virThreadPoolGetFreeWorkers(virThreadPoolPtr pool)
     return ret;
 }
 
+unsigned long long virThreadPoolGetTargetLatency(virThreadPoolPtr pool)
+{
+    unsigned long long ret;
+
+    virMutexLock(&pool->mutex);
+    ret = pool->targetLatency / 1000;
+    virMutexUnlock(&pool->mutex);
+
+    return ret;
+}
+
+unsigned long long virThreadPoolGetLatency(virThreadPoolPtr pool)
+{
+    unsigned long long ret;
+
+    virMutexLock(&pool->mutex);
+    ret = pool->latency / 1000;
+    virMutexUnlock(&pool->mutex);
+
+    return ret;
+}
+
+size_t virThreadPoolGetWorkersAdded(virThreadPoolPtr pool)
+{
+    size_t ret;
+
+    virMutexLock(&pool->mutex);
+    ret = pool->workersAdded;
+    virMutexUnlock(&pool->mutex);
+
+    return ret;
+}
+
+size_t virThreadPoolGetWorkersRemoved(virThreadPoolPtr pool)
+{
+    size_t ret;
+
+    virMutexLock(&pool->mutex);
+    ret = pool->workersRemoved;
+    virMutexUnlock(&pool->mutex);
+
+    return ret;
+}
+
 size_t virThreadPoolGetJobQueueDepth(virThreadPoolPtr pool)
 {
     size_t ret;
@@ -380,36 +815,58 @@ size_t virThreadPoolGetJobQueueDepth(virThreadPoolPtr pool)
 int virThreadPoolSendJob(virThreadPoolPtr pool,
                          unsigned int priority,
                          void *jobData)
+{
+    return virThreadPoolSendJobFull(pool, priority, NULL, jobData);
+}
+
+/**
+ * virThreadPoolSendJobFull:
+ * @pool: the thread pool
+ * @priority: whether priority workers may run the job
+ * @owner: who the job is run for, or NULL
+ * @jobData: data to pass to the job function
+ *
+ * Queue a job on behalf of @owner. Workers share their time between
+ * owners according to their weights, see virThreadPoolSetOwnerWeight.
+ * Jobs sent without an owner are treated as if they all had the same
+ * one. The pool keeps track of @owner until virThreadPoolForgetOwner
+ * is called.
+ *
+ * Returns 0 on success, -1 otherwise
+ */
+int virThreadPoolSendJobFull(virThreadPoolPtr pool,
+                             unsigned int priority,
+                             const void *owner,
+                             void *jobData)
 {
     virThreadPoolJobPtr job;
+    virThreadPoolQueuePtr queue;
 
     virMutexLock(&pool->mutex);
     if (pool->quit)
         goto error;
 
-    if (pool->freeWorkers - pool->jobQueueDepth <= 0 &&
+    if (!pool->targetLatency &&
+        pool->freeWorkers - pool->jobQueueDepth <= 0 &&
         pool->nWorkers < pool->maxWorkers &&
         virThreadPoolExpand(pool, 1, false) < 0)
         goto error;
 
+    if (!(queue = virThreadPoolGetQueue(pool, owner)))
+        goto error;
+
     if (VIR_ALLOC(job) < 0)
         goto error;
 
     job->data = jobData;
     job->priority = priority;
+    job->queued = virThreadPoolNow();
 
-    job->prev = pool->jobList.tail;
-    if (pool->jobList.tail)
-        pool->jobList.tail->next = job;
-    pool->jobList.tail = job;
-
-    if (!pool->jobList.head)
-        pool->jobList.head = job;
+    virThreadPoolPushJob(pool, queue, job);
 
-    if (priority && !pool->jobList.firstPrio)
-        pool->jobList.firstPrio = job;
-
-    pool->jobQueueDepth++;
+    /* The job is queued already, the current workers will get to it */
+    if (virThreadPoolAdaptGrow(pool) < 0)
+        virResetLastError();
 
     virCondSignal(&pool->cond);
     if (priority)
@@ -423,11 +880,112 @@ int virThreadPoolSendJob(virThreadPoolPtr pool,
     return -1;
 }
 
+/**
+ * virThreadPoolSetOwnerWeight:
+ * @pool: the thread pool
+ * @owner: owner of jobs
+ * @weight: the share of worker time of @owner
+ *
+ * When several owners have jobs queued, each of them gets worker time
+ * proportional to its weight. Owners start with a weight of 1.
+ *
+ * Returns 0 on success, -1 otherwise
+ */
+int virThreadPoolSetOwnerWeight(virThreadPoolPtr pool,
+                                const void *owner,
+                                unsigned int weight)
+{
+    virThreadPoolQueuePtr queue;
+    int ret = -1;
+
+    if (weight == 0) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("weight must be greater than zero"));
+        return -1;
+    }
+
+    virMutexLock(&pool->mutex);
+    if (!(queue = virThreadPoolGetQueue(pool, owner)))
+        goto cleanup;
+
+    queue->weight = weight;
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&pool->mutex);
+    return ret;
+}
+
+/**
+ * virThreadPoolGetOwnerStats:
+ * @pool: the thread pool
+ * @owner: owner of jobs
+ * @stats: filled with the statistics of @owner
+ *
+ * Report the weight of @owner and the statistics of its jobs.
+ */
+void virThreadPoolGetOwnerStats(virThreadPoolPtr pool,
+                                const void *owner,
+                                virThreadPoolOwnerStatsPtr stats)
+{
+    virThreadPoolQueuePtr queue;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->weight = 1;
+
+    virMutexLock(&pool->mutex);
+    if (owner)
+        queue = virHashLookup(pool->queues, owner);
+    else
+        queue = pool->defaultQueue;
+
+    if (queue) {
+        *stats = queue->stats;
+        stats->weight = queue->weight;
+    }
+    virMutexUnlock(&pool->mutex);
+}
+
+/**
+ * virThreadPoolForgetOwner:
+ * @pool: the thread pool
+ * @owner: owner of jobs
+ *
+ * Drop the weight and statistics of @owner, which is not going to send
+ * any more jobs. Jobs it already sent are still run.
+ */
+void virThreadPoolForgetOwner(virThreadPoolPtr pool,
+                              const void *owner)
+{
+    if (!owner)
+        return;
+
+    virMutexLock(&pool->mutex);
+    ignore_value(virHashRemoveEntry(pool->queues, owner));
+    virMutexUnlock(&pool->mutex);
+}
+
+/**
+ * virThreadPoolSetParameters:
+ * @pool: the thread pool
+ * @minWorkers: lower limit on the number of workers
+ * @maxWorkers: upper limit on the number of workers
+ * @prioWorkers: number of priority workers
+ * @targetLatency: how long jobs may wait for a worker, in microseconds
+ *
+ * Change the parameters of @pool, leaving those passed as -1 alone.
+ * A non-zero @targetLatency makes the pool add and remove workers
+ * between the limits based on how long jobs wait, see the top of this
+ * file; otherwise workers are added whenever none is free.
+ *
+ * Returns 0 on success, -1 otherwise
+ */
 int
 virThreadPoolSetParameters(virThreadPoolPtr pool,
                            long long int minWorkers,
                            long long int maxWorkers,
-                           long long int prioWorkers)
+                           long long int prioWorkers,
+                           long long int targetLatency)
 {
     size_t max;
     size_t min;
@@ -466,6 +1024,12 @@ virThreadPoolSetParameters(virThreadPoolPtr pool,
         pool->maxPrioWorkers = prioWorkers;
     }
 
+    if (targetLatency >= 0) {
+        pool->targetLatency = targetLatency * 1000ULL;
+        /* Let idle workers notice */
+        virCondBroadcast(&pool->cond);
+    }
+
     virMutexUnlock(&pool->mutex);
     return 0;
 
@@ -33,6 +33,17 @@ typedef virThreadPool *virThreadPoolPtr;
 
 typedef void (*virThreadPoolJobFunc)(void *jobdata, void *opaque);
 
+typedef struct _virThreadPoolOwnerStats virThreadPoolOwnerStats;
+typedef virThreadPoolOwnerStats *virThreadPoolOwnerStatsPtr;
+
+struct _virThreadPoolOwnerStats {
+    unsigned int weight;
+    size_t queued;                  /* Jobs waiting for a worker */
+    size_t running;                 /* Jobs being run by a worker */
+    unsigned long long jobs;        /* Jobs picked up by a worker so far */
+    unsigned long long waitTime;    /* Time those waited in total, in us */
+};
+
 # define virThreadPoolNew(min, max, prio, func, opaque) \
     virThreadPoolNewFull(min, max, prio, func, #func, opaque)
 
@@ -49,6 +60,10 @@ size_t virThreadPoolGetPriorityWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetCurrentWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetFreeWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetJobQueueDepth(virThreadPoolPtr pool);
+unsigned long long virThreadPoolGetTargetLatency(virThreadPoolPtr pool);
+unsigned long long virThreadPoolGetLatency(virThreadPoolPtr pool);
+size_t virThreadPoolGetWorkersAdded(virThreadPoolPtr pool);
+size_t virThreadPoolGetWorkersRemoved(virThreadPoolPtr pool);
 
 void virThreadPoolFree(virThreadPoolPtr pool);
 
@@ -57,9 +72,28 @@ int virThreadPoolSendJob(virThreadPoolPtr pool,
                          void *jobdata) ATTRIBUTE_NONNULL(1)
                                         ATTRIBUTE_RETURN_CHECK;
 
+int virThreadPoolSendJobFull(virThreadPoolPtr pool,
+                             unsigned int priority,
+                             const void *owner,
+                             void *jobdata) ATTRIBUTE_NONNULL(1)
+                                            ATTRIBUTE_RETURN_CHECK;
+
+int virThreadPoolSetOwnerWeight(virThreadPoolPtr pool,
+                                const void *owner,
+                                unsigned int weight) ATTRIBUTE_NONNULL(1);
+
+void virThreadPoolGetOwnerStats(virThreadPoolPtr pool,
+                                const void *owner,
+                                virThreadPoolOwnerStatsPtr stats)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(3);
+
+void virThreadPoolForgetOwner(virThreadPoolPtr pool,
+                              const void *owner) ATTRIBUTE_NONNULL(1);
+
 int virThreadPoolSetParameters(virThreadPoolPtr pool,
                                long long int minWorkers,
                                long long int maxWorkers,
-                               long long int prioWorkers);
+                               long long int prioWorkers,
+                               long long int targetLatency);
 
 #endif
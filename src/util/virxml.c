@@ -36,7 +36,9 @@
 #include "virutil.h"
 #include "viralloc.h"
 #include "virfile.h"
+#include "virhash.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_XML
 
@@ -50,6 +52,122 @@ struct virParserData {
 };
 
 
+/*
+ * The parsers evaluate the same few hundred constant expressions over
+ * and over, and compiling an expression is usually more expensive
+ * than evaluating it. Compiled expressions are therefore kept in a
+ * per thread table keyed by the expression string, which needs no
+ * locking and keeps libxml2 from sharing a compiled expression
+ * between threads. Expressions built at runtime, e.g. with an index
+ * in them, could grow the table without bounds, so once it's full
+ * new expressions are compiled for a single use.
+ */
+#define VIR_XPATH_CACHE_MAX 2048
+
+static virThreadLocal virXPathCache;
+static bool virXPathCacheEnabled = true;
+
+
+static void
+virXPathCacheDataFree(void *payload,
+                      const void *name ATTRIBUTE_UNUSED)
+{
+    xmlXPathFreeCompExpr(payload);
+}
+
+
+static void
+virXPathCacheFree(void *cache)
+{
+    virHashFree(cache);
+}
+
+
+static int
+virXPathCacheOnceInit(void)
+{
+    if (virThreadLocalInit(&virXPathCache, virXPathCacheFree) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize XPath cache"));
+        return -1;
+    }
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virXPathCache)
+
+
+/**
+ * virXPathCacheSetEnabled:
+ * @enabled: whether to use cached compiled expressions
+ *
+ * Allows turning the XPath expression cache off, which is only
+ * useful for comparing the results of both ways of evaluation.
+ */
+void
+virXPathCacheSetEnabled(bool enabled)
+{
+    virXPathCacheEnabled = enabled;
+}
+
+
+static virHashTablePtr
+virXPathCacheGet(void)
+{
+    virHashTablePtr cache;
+
+    if (!virXPathCacheEnabled ||
+        virXPathCacheInitialize() < 0)
+        return NULL;
+
+    if ((cache = virThreadLocalGet(&virXPathCache)))
+        return cache;
+
+    if (!(cache = virHashCreate(256, virXPathCacheDataFree)))
+        return NULL;
+
+    if (virThreadLocalSet(&virXPathCache, cache) < 0) {
+        virHashFree(cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+
+/*
+ * Evaluates @xpath like xmlXPathEval() does, only reusing the
+ * compiled expression if this thread evaluated @xpath before.
+ */
+static xmlXPathObjectPtr
+virXPathEval(const char *xpath,
+             xmlXPathContextPtr ctxt)
+{
+    virHashTablePtr cache;
+    xmlXPathCompExprPtr comp;
+    xmlXPathObjectPtr obj;
+
+    if (!(cache = virXPathCacheGet()))
+        return xmlXPathEval(BAD_CAST xpath, ctxt);
+
+    if ((comp = virHashLookup(cache, xpath)))
+        return xmlXPathCompiledEval(comp, ctxt);
+
+    /* Let xmlXPathEval() report the error for invalid expressions */
+    if (!(comp = xmlXPathCompile(BAD_CAST xpath)))
+        return xmlXPathEval(BAD_CAST xpath, ctxt);
+
+    obj = xmlXPathCompiledEval(comp, ctxt);
+
+    if (virHashSize(cache) >= VIR_XPATH_CACHE_MAX ||
+        virHashAddEntry(cache, xpath, comp) < 0)
+        xmlXPathFreeCompExpr(comp);
+
+    return obj;
+}
+
+
 /**
  * virXPathString:
  * @xpath: the XPath string to evaluate
@@ -74,7 +192,7 @@ virXPathString(const char *xpath,
         return NULL;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_STRING) ||
         (obj->stringval == NULL) || (obj->stringval[0] == 0)) {
@@ -151,7 +269,7 @@ virXPathNumber(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_NUMBER) ||
         (isnan(obj->floatval))) {
@@ -180,7 +298,7 @@ virXPathLongBase(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -285,7 +403,7 @@ virXPathULongBase(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -401,7 +519,7 @@ virXPathULongLong(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -447,7 +565,7 @@ virXPathLongLong(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -573,7 +691,7 @@ virXPathBoolean(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_BOOLEAN) ||
         (obj->boolval < 0) || (obj->boolval > 1)) {
@@ -610,7 +728,7 @@ virXPathNode(const char *xpath,
         return NULL;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_NODESET) ||
         (obj->nodesetval == NULL) || (obj->nodesetval->nodeNr <= 0) ||
@@ -654,7 +772,7 @@ virXPathNodeSet(const char *xpath,
         *list = NULL;
 
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if (obj == NULL)
         return 0;
@@ -32,6 +32,8 @@
 
 # include "virbuffer.h"
 
+void     virXPathCacheSetEnabled(bool enabled);
+
 int              virXPathBoolean(const char *xpath,
                                  xmlXPathContextPtr ctxt);
 char *            virXPathString(const char *xpath,
@@ -0,0 +1,255 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "testutils.h"
+#include "internal.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virstring.h"
+#include "virxml.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+static virCapsPtr caps;
+static virDomainXMLOptionPtr xmlopt;
+
+/*
+ * Every domain XML from the corpora below is parsed with the XPath
+ * expression cache turned off and on, and both results have to
+ * format the same, or fail with the same error.
+ */
+
+struct testFile {
+    char *name;
+    char *xml;
+};
+
+struct testData {
+    struct testFile *files;
+    size_t nfiles;
+};
+
+static const unsigned int parseFlags =
+    VIR_DOMAIN_DEF_PARSE_INACTIVE |
+    VIR_DOMAIN_DEF_PARSE_SKIP_OSTYPE_CHECKS |
+    VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
+
+
+static char *
+testParseFormat(const char *xml,
+                bool cache)
+{
+    virDomainDefPtr def;
+    char *ret = NULL;
+    size_t i;
+
+    virXPathCacheSetEnabled(cache);
+
+    if ((def = virDomainDefParseString(xml, caps, xmlopt, NULL, parseFlags))) {
+        /* Generated MAC addresses differ on every parse */
+        for (i = 0; i < def->nnets; i++) {
+            if (def->nets[i]->mac_generated)
+                memset(&def->nets[i]->mac, 0, sizeof(def->nets[i]->mac));
+        }
+
+        ret = virDomainDefFormat(def, caps, VIR_DOMAIN_DEF_FORMAT_SECURE);
+        virDomainDefFree(def);
+    } else {
+        ignore_value(virAsprintf(&ret, "error: %s",
+                                 virGetLastErrorMessage()));
+        virResetLastError();
+    }
+
+    return ret;
+}
+
+
+static int
+testCompare(const void *opaque)
+{
+    const struct testFile *file = opaque;
+    char *expect = NULL;
+    char *actual = NULL;
+    int ret = -1;
+
+    if (!(expect = testParseFormat(file->xml, false)) ||
+        !(actual = testParseFormat(file->xml, true)))
+        goto cleanup;
+
+    if (STRNEQ(expect, actual)) {
+        virTestDifference(stderr, expect, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(expect);
+    VIR_FREE(actual);
+    return ret;
+}
+
+
+static unsigned long long
+testNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static unsigned long long
+testBenchParse(const struct testData *data,
+               size_t iterations,
+               bool cache)
+{
+    unsigned long long start;
+    size_t i;
+    size_t j;
+
+    virXPathCacheSetEnabled(cache);
+
+    start = testNow();
+    for (i = 0; i < iterations; i++) {
+        for (j = 0; j < data->nfiles; j++) {
+            virDomainDefFree(virDomainDefParseString(data->files[j].xml,
+                                                     caps, xmlopt, NULL,
+                                                     parseFlags));
+            virResetLastError();
+        }
+    }
+
+    return testNow() - start;
+}
+
+
+/*
+ * Parses the whole corpus @iterations times each way and reports
+ * the time per file.
+ */
+static int
+testBench(const void *opaque)
+{
+    const struct testData *data = opaque;
+    size_t iterations = virTestGetExpensive() ? 100 : 2;
+    unsigned long long uncached;
+    unsigned long long cached;
+
+    if (!data->nfiles)
+        return 0;
+
+    uncached = testBenchParse(data, iterations, false);
+    cached = testBenchParse(data, iterations, true);
+
+    VIR_TEST_VERBOSE("\n%zu files, %zu parses each: "
+                     "uncached %llu ns/parse, cached %llu ns/parse\n",
+                     data->nfiles, iterations,
+                     uncached / (data->nfiles * iterations),
+                     cached / (data->nfiles * iterations));
+
+    return 0;
+}
+
+
+static int
+testLoadDir(struct testData *data,
+            const char *subdir)
+{
+    DIR *dir = NULL;
+    struct dirent *ent;
+    char *dirname = NULL;
+    char *path = NULL;
+    struct testFile file = { NULL, NULL };
+    int rc;
+    int ret = -1;
+
+    if (virAsprintf(&dirname, "%s/%s", abs_srcdir, subdir) < 0 ||
+        virDirOpen(&dir, dirname) < 0)
+        goto cleanup;
+
+    while ((rc = virDirRead(dir, &ent, dirname)) > 0) {
+        if (!virFileHasSuffix(ent->d_name, ".xml"))
+            continue;
+
+        if (virAsprintf(&file.name, "%s/%s", subdir, ent->d_name) < 0 ||
+            virAsprintf(&path, "%s/%s", dirname, ent->d_name) < 0 ||
+            virTestLoadFile(path, &file.xml) < 0 ||
+            VIR_APPEND_ELEMENT(data->files, data->nfiles, file) < 0)
+            goto cleanup;
+
+        VIR_FREE(path);
+    }
+    if (rc < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(file.name);
+    VIR_FREE(file.xml);
+    VIR_FREE(path);
+    VIR_FREE(dirname);
+    VIR_DIR_CLOSE(dir);
+    return ret;
+}
+
+
+static int
+testSortFiles(const void *a,
+              const void *b)
+{
+    const struct testFile *fa = a;
+    const struct testFile *fb = b;
+
+    return strcmp(fa->name, fb->name);
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    struct testData data = { NULL, 0 };
+    size_t i;
+
+    if (!(caps = virTestGenericCapsInit()) ||
+        !(xmlopt = virTestGenericDomainXMLConfInit())) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (testLoadDir(&data, "domainschemadata") < 0 ||
+        testLoadDir(&data, "qemuxml2xmloutdata") < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    qsort(data.files, data.nfiles, sizeof(*data.files), testSortFiles);
+
+    for (i = 0; i < data.nfiles; i++) {
+        if (virTestRun(data.files[i].name, testCompare, &data.files[i]) < 0)
+            ret = -1;
+    }
+
+    if (virTestRun("Benchmark", testBench, &data) < 0)
+        ret = -1;
+
+ cleanup:
+    for (i = 0; i < data.nfiles; i++) {
+        VIR_FREE(data.files[i].name);
+        VIR_FREE(data.files[i].xml);
+    }
+    VIR_FREE(data.files);
+    virObjectUnref(caps);
+    virObjectUnref(xmlopt);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Instance IDs of virtual ports are generated when missing */
+VIR_TEST_MAIN_PRELOAD(mymain, abs_builddir "/.libs/virrandommock.so")
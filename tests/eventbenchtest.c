@@ -0,0 +1,236 @@
+/*
+ * eventbenchtest.c: Measure dispatch cost of the event loop backends
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "testutils.h"
+#include "internal.h"
+#include "virfile.h"
+#include "virthread.h"
+#include "vireventpoll.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/*
+ * Each benchmark registers @nhandles watches on fds which never
+ * become ready, plus one watch on a pipe which is written to
+ * before every iteration. The reported figure is the average
+ * wall clock time of virEventPollRunOnce, which is dominated by
+ * the per-iteration overhead of the backend once @nhandles grows.
+ *
+ * The event loop is a process wide singleton, so every
+ * measurement runs in a child process of its own.
+ */
+
+struct testBenchData {
+    const char *backend;
+    size_t nhandles;
+    size_t iterations;
+};
+
+
+static void
+testBenchReader(int watch ATTRIBUTE_UNUSED,
+                int fd,
+                int events ATTRIBUTE_UNUSED,
+                void *opaque)
+{
+    size_t *fired = opaque;
+    char c;
+
+    if (saferead(fd, &c, 1) == 1)
+        (*fired)++;
+}
+
+
+static void
+testBenchIdle(int watch ATTRIBUTE_UNUSED,
+              int fd ATTRIBUTE_UNUSED,
+              int events ATTRIBUTE_UNUSED,
+              void *opaque ATTRIBUTE_UNUSED)
+{
+    abort();
+}
+
+
+static unsigned long long
+testBenchNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static int
+testBenchChild(const struct testBenchData *data,
+               unsigned long long *nsPerIteration)
+{
+    int idle[2] = { -1, -1 };
+    int active[2] = { -1, -1 };
+    unsigned long long start, end;
+    size_t fired = 0;
+    size_t i;
+    char c = '1';
+
+    if (setenv("LIBVIRT_EVENT_POLL", data->backend, 1) < 0 ||
+        virEventPollInit() < 0)
+        return -1;
+
+    if (pipe(idle) < 0 || pipe(active) < 0)
+        return -1;
+
+    /* Duplicates of a pipe nobody writes to are cheap idle fds */
+    for (i = 0; i < data->nhandles; i++) {
+        int fd = dup(idle[0]);
+        if (fd < 0 ||
+            virEventPollAddHandle(fd, VIR_EVENT_HANDLE_READABLE,
+                                  testBenchIdle, NULL, NULL) < 0)
+            return -1;
+    }
+
+    if (virEventPollAddHandle(active[0], VIR_EVENT_HANDLE_READABLE,
+                              testBenchReader, &fired, NULL) < 0)
+        return -1;
+
+    /* Let the loop purge and settle before measuring */
+    if (safewrite(active[1], &c, 1) != 1 ||
+        virEventPollRunOnce() < 0)
+        return -1;
+
+    start = testBenchNow();
+
+    for (i = 0; i < data->iterations; i++) {
+        if (safewrite(active[1], &c, 1) != 1 ||
+            virEventPollRunOnce() < 0)
+            return -1;
+    }
+
+    end = testBenchNow();
+
+    if (fired != data->iterations + 1)
+        return -1;
+
+    *nsPerIteration = (end - start) / data->iterations;
+    return 0;
+}
+
+
+static int
+testBench(const void *opaque)
+{
+    const struct testBenchData *data = opaque;
+    unsigned long long ns = 0;
+    int status;
+    int fds[2];
+    pid_t pid;
+
+    if (pipe(fds) < 0)
+        return -1;
+
+    if ((pid = fork()) < 0) {
+        VIR_FORCE_CLOSE(fds[0]);
+        VIR_FORCE_CLOSE(fds[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        VIR_FORCE_CLOSE(fds[0]);
+        if (testBenchChild(data, &ns) < 0 ||
+            safewrite(fds[1], &ns, sizeof(ns)) != sizeof(ns))
+            _exit(EXIT_FAILURE);
+        _exit(EXIT_SUCCESS);
+    }
+
+    VIR_FORCE_CLOSE(fds[1]);
+    if (saferead(fds[0], &ns, sizeof(ns)) != sizeof(ns))
+        ns = 0;
+    VIR_FORCE_CLOSE(fds[0]);
+
+    if (waitpid(pid, &status, 0) < 0 ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+        return -1;
+
+    VIR_TEST_VERBOSE("\n%6s %6zu handles: %8llu ns/iteration\n",
+                     data->backend, data->nhandles, ns);
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    const char *backends[] = { "poll", "epoll" };
+    size_t sizes[] = { 10, 1000, 10000 };
+    struct rlimit lim;
+    size_t i, j;
+
+    if (virThreadInitialize() < 0)
+        return EXIT_FAILURE;
+
+    /* Try to make room for the largest run */
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 &&
+        lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        ignore_value(setrlimit(RLIMIT_NOFILE, &lim));
+    }
+    if (getrlimit(RLIMIT_NOFILE, &lim) < 0)
+        return EXIT_FAILURE;
+
+    for (i = 0; i < ARRAY_CARDINALITY(sizes); i++) {
+        /* The large runs only make sense as a benchmark */
+        if (sizes[i] > 10 && !virTestGetExpensive())
+            continue;
+
+        if (sizes[i] + 32 > lim.rlim_cur) {
+            VIR_TEST_VERBOSE("Skipping %zu handles, fd limit is %llu\n",
+                             sizes[i], (unsigned long long)lim.rlim_cur);
+            continue;
+        }
+
+        for (j = 0; j < ARRAY_CARDINALITY(backends); j++) {
+            struct testBenchData data = {
+                .backend = backends[j],
+                .nhandles = sizes[i],
+                .iterations = 1000,
+            };
+            char *name = NULL;
+
+            if (virAsprintf(&name, "%s with %zu handles",
+                            backends[j], sizes[i]) < 0)
+                return EXIT_FAILURE;
+
+            if (virTestRun(name, testBench, &data) < 0)
+                ret = -1;
+            VIR_FREE(name);
+        }
+    }
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -24,6 +24,7 @@
 
 #include <stdlib.h>
 #include <signal.h>
+#include <fcntl.h>
 #include <time.h>
 
 #if HAVE_MACH_CLOCK_ROUTINES
@@ -58,6 +59,7 @@ static struct timerInfo {
     int fired;
     int error;
     int delete;
+    int update;     /* timer to postpone when firing */
 } timers[NUM_TIME];
 
 enum {
@@ -152,6 +154,8 @@ testTimer(int timer, void *data)
 
     if (info->delete != -1)
         virEventPollRemoveTimeout(info->delete);
+    if (info->update != -1)
+        virEventPollUpdateTimeout(info->update, 5000);
 }
 
 static pthread_mutex_t eventThreadMutex = PTHREAD_MUTEX_INITIALIZER;
@@ -310,12 +314,58 @@ resetAll(void)
     }
 }
 
+static pthread_mutex_t ioLoopMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ioLoopCond = PTHREAD_COND_INITIALIZER;
+
+/* Handles on the I/O loops are dispatched by threads this
+ * test does not control, so let the waiter know about them */
+static void
+testIOLoopReader(int watch, int fd, int events, void *data)
+{
+    pthread_mutex_lock(&ioLoopMutex);
+    testPipeReader(watch, fd, events, data);
+    pthread_cond_signal(&ioLoopCond);
+    pthread_mutex_unlock(&ioLoopMutex);
+}
+
+static int
+waitIOLoop(const char *name, int handle, int timeoutMS)
+{
+    struct timespec waitTime;
+    int rc = 0;
+
+    clock_gettime(CLOCK_REALTIME, &waitTime);
+    waitTime.tv_sec += timeoutMS / 1000;
+    waitTime.tv_nsec += (timeoutMS % 1000) * 1000000L;
+    if (waitTime.tv_nsec >= 1000000000L) {
+        waitTime.tv_sec++;
+        waitTime.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&ioLoopMutex);
+    while ((handle == -1 || !handles[handle].fired) && rc == 0)
+        rc = pthread_cond_timedwait(&ioLoopCond, &ioLoopMutex, &waitTime);
+    pthread_mutex_unlock(&ioLoopMutex);
+
+    if (rc != 0 && handle != -1) {
+        testEventReport(name, 1, "Timed out waiting for pipe event\n");
+        return EXIT_FAILURE;
+    }
+
+    if (verifyFired(name, handle, -1) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    testEventReport(name, 0, NULL);
+    return EXIT_SUCCESS;
+}
+
 static int
 mymain(void)
 {
     size_t i;
     pthread_t eventThread;
     char one = '1';
+    struct handleInfo fileInfo = { .fired = 0 };
 
     for (i = 0; i < NUM_FDS; i++) {
         if (pipe(handles[i].pipeFD) < 0) {
@@ -346,6 +396,7 @@ mymain(void)
 
     for (i = 0; i < NUM_TIME; i++) {
         timers[i].delete = -1;
+        timers[i].update = -1;
         timers[i].timeout = -1;
         timers[i].timer =
             virEventPollAddTimeout(timers[i].timeout,
@@ -433,6 +484,18 @@ mymain(void)
 
     resetAll();
 
+    /* Arm two timers, the later registered one expiring first,
+     * and make sure only the earliest deadline fires */
+    virEventPollUpdateTimeout(timers[4].timer, 1000);
+    virEventPollUpdateTimeout(timers[5].timer, 100);
+    startJob();
+    if (finishJob("Earliest timer first", -1, 5) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    virEventPollUpdateTimeout(timers[4].timer, -1);
+    virEventPollUpdateTimeout(timers[5].timer, -1);
+
+    resetAll();
+
     /* Now lets delete one before starting poll(), and
      * try triggering another timer */
     virEventPollUpdateTimeout(timers[1].timer, 100);
@@ -478,6 +541,20 @@ mymain(void)
 
     resetAll();
 
+    /* A timer postponed by an earlier callback in the same iteration
+     * must not fire */
+    virEventPollUpdateTimeout(timers[2].timer, 100);
+    virEventPollUpdateTimeout(timers[4].timer, 100);
+    startJob();
+    timers[2].update = timers[4].timer;
+    if (finishJob("Updated during dispatch", -1, 2) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    timers[2].update = -1;
+    virEventPollUpdateTimeout(timers[2].timer, -1);
+    virEventPollUpdateTimeout(timers[4].timer, -1);
+
+    resetAll();
+
     /* Extreme fun, lets delete ourselves during dispatch */
     virEventPollUpdateTimeout(timers[2].timer, 100);
     startJob();
@@ -523,6 +600,87 @@ mymain(void)
     if (finishJob("Write duplicate", 1, -1) != EXIT_SUCCESS)
         return EXIT_FAILURE;
 
+    virEventPollRemoveHandle(handles[0].watch);
+    virEventPollRemoveHandle(handles[1].watch);
+    resetAll();
+
+    /* A regular file with its events disabled must not keep the
+     * loop from sleeping until the next timer is due */
+    fileInfo.delete = -1;
+    if ((fileInfo.pipeFD[0] = open(abs_srcdir "/eventtest.c",
+                                   O_RDONLY)) < 0)
+        return EXIT_FAILURE;
+    fileInfo.watch = virEventPollAddHandle(fileInfo.pipeFD[0],
+                                           VIR_EVENT_HANDLE_READABLE,
+                                           testPipeReader,
+                                           &fileInfo, NULL);
+    if (fileInfo.watch < 0)
+        return EXIT_FAILURE;
+    virEventPollUpdateHandle(fileInfo.watch, 0);
+    virEventPollUpdateTimeout(timers[NUM_TIME - 1].timer, 100);
+    startJob();
+    if (finishJob("Regular file without events", -1,
+                  NUM_TIME - 1) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    if (fileInfo.fired) {
+        testEventReport("Regular file without events", 1,
+                        "Handle on regular file fired\n");
+        return EXIT_FAILURE;
+    }
+    virEventPollUpdateTimeout(timers[NUM_TIME - 1].timer, -1);
+    virEventPollRemoveHandle(fileInfo.watch);
+    VIR_FORCE_CLOSE(fileInfo.pipeFD[0]);
+    resetAll();
+
+    /* Spread a few handles across dedicated I/O loops, which
+     * dispatch them without the default loop running at all */
+    if (virEventPollSetIOLoops(2) < 0)
+        return EXIT_FAILURE;
+
+    for (i = 2; i < 6; i++) {
+        /* Earlier cases may have left data behind in the pipes */
+        VIR_FORCE_CLOSE(handles[i].pipeFD[0]);
+        VIR_FORCE_CLOSE(handles[i].pipeFD[1]);
+        if (pipe(handles[i].pipeFD) < 0)
+            return EXIT_FAILURE;
+
+        handles[i].delete = -1;
+        handles[i].watch = virEventPollAddIOHandle(handles[i].pipeFD[0],
+                                                   VIR_EVENT_HANDLE_READABLE,
+                                                   testIOLoopReader,
+                                                   &handles[i], NULL);
+        if (handles[i].watch == -1)
+            return EXIT_FAILURE;
+    }
+
+    for (i = 2; i < 6; i++) {
+        if (safewrite(handles[i].pipeFD[1], &one, 1) != 1)
+            return EXIT_FAILURE;
+        if (waitIOLoop("I/O loop write", i, 5000) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+        resetAll();
+    }
+
+    /* Updates must reach whichever loop owns the watch */
+    virEventPollUpdateHandle(handles[3].watch, 0);
+    if (safewrite(handles[3].pipeFD[1], &one, 1) != 1)
+        return EXIT_FAILURE;
+    if (waitIOLoop("I/O loop disabled", -1, 100) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    virEventPollUpdateHandle(handles[3].watch, VIR_EVENT_HANDLE_READABLE);
+    if (waitIOLoop("I/O loop re-enabled", 3, 5000) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    resetAll();
+
+    if (virEventPollRemoveHandle(handles[4].watch) < 0 ||
+        virEventPollRemoveHandle(handles[4].watch) == 0)
+        return EXIT_FAILURE;
+    if (safewrite(handles[4].pipeFD[1], &one, 1) != 1)
+        return EXIT_FAILURE;
+    if (waitIOLoop("I/O loop removed", -1, 100) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
     /* pthread_kill(eventThread, SIGTERM); */
 
     return EXIT_SUCCESS;
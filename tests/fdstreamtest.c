@@ -22,6 +22,7 @@
 
 #include <stdlib.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include "testutils.h"
 
@@ -316,6 +317,374 @@ static int testFDStreamWriteNonblock(const void *data)
     return testFDStreamWriteCommon(data, false);
 }
 
+static int
+testFDStreamSendAll(virStreamPtr st,
+                    const char *buf,
+                    size_t len,
+                    bool blocking)
+{
+    while (len > 0) {
+        int got = st->driver->streamSend(st, buf, len);
+
+        if (got == -2 && !blocking) {
+            usleep(20 * 1000);
+            continue;
+        }
+        if (got < 0) {
+            virFilePrintf(stderr, "Failed to write stream: %s\n",
+                          virGetLastErrorMessage());
+            return -1;
+        }
+        buf += got;
+        len -= got;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Upload two adjacent ranges of a file over two streams, the second
+ * one first. The first range ends with a hole, which must be zeroed
+ * in place instead of truncating the file and losing the second
+ * range. The second range starts with a hole past the end of the
+ * file, which must grow.
+ */
+static int testFDStreamWriteRangesCommon(const char *scratchdir, bool blocking)
+{
+    int fd = -1;
+    char *file = NULL;
+    int ret = -1;
+    char *pattern = NULL;
+    char *buf = NULL;
+    virStreamPtr st[2] = { NULL, NULL };
+    size_t i;
+    virConnectPtr conn = NULL;
+    int flags = 0;
+
+    if (!blocking)
+        flags |= VIR_STREAM_NONBLOCK;
+
+    if (!(conn = virConnectOpen("test:///default")))
+        goto cleanup;
+
+    if (VIR_ALLOC_N(pattern, PATTERN_LEN) < 0 ||
+        VIR_ALLOC_N(buf, PATTERN_LEN * 4 + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < PATTERN_LEN; i++)
+        pattern[i] = i;
+
+    if (virAsprintf(&file, "%s/ranges.data", scratchdir) < 0)
+        goto cleanup;
+
+    memset(buf, 0xff, PATTERN_LEN * 2);
+    if (virFileWriteStr(file, "", 0600) < 0 ||
+        (fd = open(file, O_WRONLY)) < 0 ||
+        safewrite(fd, buf, PATTERN_LEN * 2) != PATTERN_LEN * 2 ||
+        VIR_CLOSE(fd) < 0)
+        goto cleanup;
+
+    for (i = 0; i < 2; i++) {
+        if (!(st[i] = virStreamNew(conn, flags)) ||
+            virFDStreamOpenBlockDevice(st[i], file,
+                                       PATTERN_LEN * 2 * i, PATTERN_LEN * 2,
+                                       true, true, O_WRONLY) < 0)
+            goto cleanup;
+    }
+
+    if (st[1]->driver->streamSendHole(st[1], PATTERN_LEN, 0) < 0 ||
+        testFDStreamSendAll(st[1], pattern, PATTERN_LEN, blocking) < 0 ||
+        st[1]->driver->streamFinish(st[1]) < 0)
+        goto cleanup;
+
+    if (testFDStreamSendAll(st[0], pattern, PATTERN_LEN, blocking) < 0 ||
+        st[0]->driver->streamSendHole(st[0], PATTERN_LEN, 0) < 0 ||
+        st[0]->driver->streamFinish(st[0]) < 0) {
+        virFilePrintf(stderr, "Failed to finish stream: %s\n",
+                      virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    if ((fd = open(file, O_RDONLY)) < 0)
+        goto cleanup;
+
+    if (saferead(fd, buf, PATTERN_LEN * 4 + 1) != PATTERN_LEN * 4) {
+        virFilePrintf(stderr, "File has the wrong size\n");
+        goto cleanup;
+    }
+
+    for (i = 0; i < 4; i++) {
+        char *chunk = buf + PATTERN_LEN * i;
+
+        /* Only the outer chunks were sent as data */
+        if (i == 0 || i == 3) {
+            if (memcmp(chunk, pattern, PATTERN_LEN) != 0) {
+                virFilePrintf(stderr, "Mismatched pattern data chunk %zu\n", i);
+                goto cleanup;
+            }
+        } else {
+            size_t j;
+            for (j = 0; j < PATTERN_LEN; j++) {
+                if (chunk[j] != 0) {
+                    virFilePrintf(stderr, "Hole not zeroed in chunk %zu\n", i);
+                    goto cleanup;
+                }
+            }
+        }
+    }
+
+    if (VIR_CLOSE(fd) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    for (i = 0; i < 2; i++) {
+        if (st[i])
+            virStreamFree(st[i]);
+    }
+    VIR_FORCE_CLOSE(fd);
+    if (file != NULL)
+        unlink(file);
+    if (conn)
+        virConnectClose(conn);
+    VIR_FREE(file);
+    VIR_FREE(pattern);
+    VIR_FREE(buf);
+    return ret;
+}
+
+
+static int testFDStreamWriteRangesBlock(const void *data)
+{
+    return testFDStreamWriteRangesCommon(data, true);
+}
+static int testFDStreamWriteRangesNonblock(const void *data)
+{
+    return testFDStreamWriteRangesCommon(data, false);
+}
+
+/*
+ * Appending rules out splicing into the file, so this checks the
+ * fallback to copying the data.
+ */
+static int testFDStreamWriteAppend(const void *data)
+{
+    const char *scratchdir = data;
+    int fd = -1;
+    char *file = NULL;
+    int ret = -1;
+    char *pattern = NULL;
+    char *buf = NULL;
+    virStreamPtr st = NULL;
+    size_t i;
+    virConnectPtr conn = NULL;
+
+    if (!(conn = virConnectOpen("test:///default")))
+        goto cleanup;
+
+    if (VIR_ALLOC_N(pattern, PATTERN_LEN) < 0 ||
+        VIR_ALLOC_N(buf, PATTERN_LEN * 10 + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < PATTERN_LEN; i++)
+        pattern[i] = i;
+
+    if (virAsprintf(&file, "%s/append.data", scratchdir) < 0)
+        goto cleanup;
+
+    if (virFileWriteStr(file, "", 0600) < 0)
+        goto cleanup;
+
+    if (!(st = virStreamNew(conn, VIR_STREAM_NONBLOCK)) ||
+        virFDStreamOpenFile(st, file, 0, 0, O_WRONLY | O_APPEND) < 0)
+        goto cleanup;
+
+    for (i = 0; i < 10; i++) {
+        if (testFDStreamSendAll(st, pattern, PATTERN_LEN, false) < 0)
+            goto cleanup;
+    }
+
+    if (st->driver->streamFinish(st) != 0) {
+        virFilePrintf(stderr, "Failed to finish stream: %s\n",
+                      virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    if ((fd = open(file, O_RDONLY)) < 0)
+        goto cleanup;
+
+    if (saferead(fd, buf, PATTERN_LEN * 10 + 1) != PATTERN_LEN * 10) {
+        virFilePrintf(stderr, "File has the wrong size\n");
+        goto cleanup;
+    }
+
+    for (i = 0; i < 10; i++) {
+        if (memcmp(buf + PATTERN_LEN * i, pattern, PATTERN_LEN) != 0) {
+            virFilePrintf(stderr, "Mismatched pattern data iteration %zu\n", i);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    if (st)
+        virStreamFree(st);
+    VIR_FORCE_CLOSE(fd);
+    if (file != NULL)
+        unlink(file);
+    if (conn)
+        virConnectClose(conn);
+    VIR_FREE(file);
+    VIR_FREE(pattern);
+    VIR_FREE(buf);
+    return ret;
+}
+
+
+/*
+ * Read a file through the event loop, like the daemon does, either
+ * through the pipe, or as messages, which sparse streams always use.
+ */
+struct testThroughputData {
+    const char *scratchdir;
+    bool sparse;
+    size_t size;
+};
+
+struct testThroughputState {
+    char *buf;
+    char *expect; /* buflen + PATTERN_LEN bytes of the pattern */
+    size_t buflen;
+    size_t received;
+    bool done;
+    bool failed;
+};
+
+
+static void
+testFDStreamThroughputEvent(virStreamPtr st,
+                            int events ATTRIBUTE_UNUSED,
+                            void *opaque)
+{
+    struct testThroughputState *state = opaque;
+    int got;
+
+    while ((got = st->driver->streamRecv(st, state->buf,
+                                         state->buflen)) > 0) {
+        if (memcmp(state->buf,
+                   state->expect + state->received % PATTERN_LEN,
+                   got) != 0) {
+            virFilePrintf(stderr, "Mismatched data after %zu bytes\n",
+                          state->received);
+            got = -1;
+            break;
+        }
+        state->received += got;
+    }
+
+    if (got == -2)
+        return;
+
+    if (got < 0)
+        state->failed = true;
+    state->done = true;
+    virStreamEventUpdateCallback(st, 0);
+}
+
+
+static int testFDStreamThroughput(const void *opaque)
+{
+    const struct testThroughputData *data = opaque;
+    struct testThroughputState state = { NULL, NULL, 256 * 1024,
+                                         0, false, false };
+    struct timespec start, end;
+    unsigned long long ns;
+    int fd = -1;
+    char *file = NULL;
+    int ret = -1;
+    virStreamPtr st = NULL;
+    bool callback = false;
+    size_t i;
+    virConnectPtr conn = NULL;
+
+    if (!(conn = virConnectOpen("test:///default")))
+        goto cleanup;
+
+    if (VIR_ALLOC_N(state.buf, state.buflen) < 0 ||
+        VIR_ALLOC_N(state.expect, state.buflen + PATTERN_LEN) < 0)
+        goto cleanup;
+
+    for (i = 0; i < state.buflen + PATTERN_LEN; i++)
+        state.expect[i] = i;
+
+    if (virAsprintf(&file, "%s/throughput.data", data->scratchdir) < 0)
+        goto cleanup;
+
+    if ((fd = open(file, O_CREAT|O_WRONLY|O_EXCL, 0600)) < 0)
+        goto cleanup;
+
+    for (i = 0; i < data->size; i += state.buflen) {
+        if (safewrite(fd, state.expect, state.buflen) != state.buflen)
+            goto cleanup;
+    }
+
+    if (VIR_CLOSE(fd) < 0)
+        goto cleanup;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (!(st = virStreamNew(conn, VIR_STREAM_NONBLOCK)) ||
+        virFDStreamOpenBlockDevice(st, file, 0, 0, data->sparse,
+                                   false, O_RDONLY) < 0)
+        goto cleanup;
+
+    if (virStreamEventAddCallback(st, VIR_STREAM_EVENT_READABLE,
+                                  testFDStreamThroughputEvent,
+                                  &state, NULL) < 0)
+        goto cleanup;
+    callback = true;
+
+    while (!state.done) {
+        if (virEventRunDefaultImpl() < 0)
+            goto cleanup;
+    }
+
+    if (state.failed || state.received != data->size) {
+        virFilePrintf(stderr, "Failed to read stream, got %zu bytes: %s\n",
+                      state.received, virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ns = (end.tv_sec - start.tv_sec) * 1000000000ULL +
+         end.tv_nsec - start.tv_nsec;
+
+    VIR_TEST_VERBOSE("\n%8s: %6llu MiB/s\n",
+                     data->sparse ? "messages" : "pipe",
+                     data->size * 1000000000ULL / (ns ? ns : 1) / (1024 * 1024));
+
+    ret = 0;
+ cleanup:
+    if (callback)
+        virStreamEventRemoveCallback(st);
+    if (st) {
+        if (st->driver)
+            st->driver->streamFinish(st);
+        virStreamFree(st);
+    }
+    VIR_FORCE_CLOSE(fd);
+    if (file != NULL)
+        unlink(file);
+    if (conn)
+        virConnectClose(conn);
+    VIR_FREE(file);
+    VIR_FREE(state.buf);
+    VIR_FREE(state.expect);
+    return ret;
+}
+
+
 #define SCRATCHDIRTEMPLATE abs_builddir "/fdstreamdir-XXXXXX"
 
 static int
@@ -323,6 +692,7 @@ mymain(void)
 {
     char scratchdir[] = SCRATCHDIRTEMPLATE;
     int ret = 0;
+    size_t i;
 
     if (!mkdtemp(scratchdir)) {
         virFilePrintf(stderr, "Cannot create fdstreamdir");
@@ -337,6 +707,28 @@ mymain(void)
         ret = -1;
     if (virTestRun("Stream write non-blocking ", testFDStreamWriteNonblock, scratchdir) < 0)
         ret = -1;
+    if (virTestRun("Stream write ranges blocking ", testFDStreamWriteRangesBlock, scratchdir) < 0)
+        ret = -1;
+    if (virTestRun("Stream write ranges non-blocking ", testFDStreamWriteRangesNonblock, scratchdir) < 0)
+        ret = -1;
+    if (virTestRun("Stream write append non-blocking ", testFDStreamWriteAppend, scratchdir) < 0)
+        ret = -1;
+
+    virEventRegisterDefaultImpl();
+
+    for (i = 0; i < 2; i++) {
+        struct testThroughputData data = {
+            .scratchdir = scratchdir,
+            .sparse = i,
+            .size = (virTestGetExpensive() ? 1024 : 64) * 1024 * 1024,
+        };
+
+        if (virTestRun(data.sparse ?
+                       "Stream read throughput messages " :
+                       "Stream read throughput pipe ",
+                       testFDStreamThroughput, &data) < 0)
+            ret = -1;
+    }
 
     if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
         virFileDeleteTree(scratchdir);
@@ -0,0 +1,290 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "testutils.h"
+
+#ifdef WITH_QEMU
+
+# include "internal.h"
+# include "qemu/qemu_domain.h"
+# include "testutilsqemu.h"
+# include "virfile.h"
+# include "virstring.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+static virQEMUDriver driver;
+
+/*
+ * Every definition from qemuxml2argvdata the direct copy supports is
+ * copied and the copy has to format exactly like the original. The
+ * XML round trip can't serve as the reference as parsing its own
+ * output again is not always idempotent, e.g. implicit controllers
+ * get sorted. The original is freed before the copy is formatted so
+ * that anything it still shares with the original shows up.
+ */
+
+static virDomainDefPtr
+testParseDef(const char *name)
+{
+    char *file = NULL;
+    virDomainDefPtr def = NULL;
+
+    if (virAsprintf(&file, "%s/qemuxml2argvdata/%s", abs_srcdir, name) < 0)
+        return NULL;
+
+    /* Files for negative tests are expected to fail */
+    if (!(def = virDomainDefParseFile(file, driver.caps, driver.xmlopt, NULL,
+                                      VIR_DOMAIN_DEF_PARSE_INACTIVE)))
+        virResetLastError();
+
+    VIR_FREE(file);
+    return def;
+}
+
+
+static virDomainDefPtr
+testCopyXML(virDomainDefPtr def)
+{
+    char *xml;
+    virDomainDefPtr ret;
+
+    if (!(xml = virDomainDefFormat(def, driver.caps,
+                                   VIR_DOMAIN_DEF_FORMAT_SECURE)))
+        return NULL;
+
+    ret = virDomainDefParseString(xml, driver.caps, driver.xmlopt, NULL,
+                                  VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                                  VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE);
+    VIR_FREE(xml);
+    return ret;
+}
+
+
+static int
+testCopy(const void *opaque)
+{
+    const char *name = opaque;
+    virDomainDefPtr def = NULL;
+    virDomainDefPtr copy = NULL;
+    char *expect = NULL;
+    char *actual = NULL;
+    int rc;
+    int ret = -1;
+
+    if (!(def = testParseDef(name)))
+        return EXIT_AM_SKIP;
+
+    if ((rc = virDomainDefCopyNative(def, driver.xmlopt, &copy)) < 0)
+        goto cleanup;
+
+    if (rc == 0) {
+        ret = EXIT_AM_SKIP;
+        goto cleanup;
+    }
+
+    if (!virDomainDefCheckABIStability(def, copy, driver.xmlopt))
+        goto cleanup;
+
+    if (!(expect = virDomainDefFormat(def, driver.caps,
+                                      VIR_DOMAIN_DEF_FORMAT_SECURE)))
+        goto cleanup;
+
+    virDomainDefFree(def);
+    def = NULL;
+
+    if (!(actual = virDomainDefFormat(copy, driver.caps,
+                                      VIR_DOMAIN_DEF_FORMAT_SECURE)))
+        goto cleanup;
+
+    if (STRNEQ(expect, actual)) {
+        virTestDifference(stderr, expect, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(expect);
+    VIR_FREE(actual);
+    virDomainDefFree(def);
+    virDomainDefFree(copy);
+    return ret;
+}
+
+
+static unsigned long long
+testNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+struct testBenchData {
+    char **names;
+    size_t nnames;
+};
+
+/*
+ * Copies every supported definition @iterations times each way and
+ * reports how long that took.
+ */
+static int
+testBench(const void *opaque)
+{
+    const struct testBenchData *data = opaque;
+    size_t iterations = virTestGetExpensive() ? 1000 : 10;
+    unsigned long long native = 0;
+    unsigned long long xml = 0;
+    unsigned long long start;
+    size_t ndefs = 0;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    for (i = 0; i < data->nnames; i++) {
+        virDomainDefPtr def;
+        virDomainDefPtr copy = NULL;
+        int rc;
+
+        if (!(def = testParseDef(data->names[i])))
+            continue;
+
+        if ((rc = virDomainDefCopyNative(def, driver.xmlopt, &copy)) <= 0) {
+            virDomainDefFree(def);
+            if (rc < 0)
+                goto cleanup;
+            continue;
+        }
+        virDomainDefFree(copy);
+        ndefs++;
+
+        start = testNow();
+        for (j = 0; j < iterations; j++) {
+            if (virDomainDefCopyNative(def, driver.xmlopt, &copy) < 0) {
+                virDomainDefFree(def);
+                goto cleanup;
+            }
+            virDomainDefFree(copy);
+        }
+        native += testNow() - start;
+
+        start = testNow();
+        for (j = 0; j < iterations; j++) {
+            if (!(copy = testCopyXML(def))) {
+                virDomainDefFree(def);
+                goto cleanup;
+            }
+            virDomainDefFree(copy);
+        }
+        xml += testNow() - start;
+
+        virDomainDefFree(def);
+    }
+
+    if (ndefs) {
+        VIR_TEST_VERBOSE("\n%zu definitions, %zu copies each: "
+                         "native %llu ns/copy, XML %llu ns/copy\n",
+                         ndefs, iterations,
+                         native / (ndefs * iterations),
+                         xml / (ndefs * iterations));
+    }
+
+    ret = 0;
+ cleanup:
+    return ret;
+}
+
+
+static int
+testSortNames(const void *a,
+              const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    struct testBenchData data = { NULL, 0 };
+    virQEMUCapsPtr qemuCaps = NULL;
+    DIR *dir = NULL;
+    struct dirent *ent;
+    char *dirname = NULL;
+    size_t i;
+    int rc;
+
+    if (qemuTestDriverInit(&driver) < 0)
+        return EXIT_FAILURE;
+
+    if (!(qemuCaps = virQEMUCapsNew()) ||
+        qemuTestCapsCacheInsert(driver.qemuCapsCache, qemuCaps) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (virAsprintf(&dirname, "%s/qemuxml2argvdata", abs_srcdir) < 0 ||
+        virDirOpen(&dir, dirname) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    while ((rc = virDirRead(dir, &ent, dirname)) > 0) {
+        char *name;
+
+        if (!virFileHasSuffix(ent->d_name, ".xml"))
+            continue;
+
+        if (VIR_STRDUP(name, ent->d_name) < 0 ||
+            VIR_APPEND_ELEMENT(data.names, data.nnames, name) < 0) {
+            VIR_FREE(name);
+            ret = -1;
+            goto cleanup;
+        }
+    }
+    if (rc < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    qsort(data.names, data.nnames, sizeof(*data.names), testSortNames);
+
+    for (i = 0; i < data.nnames; i++) {
+        if (virTestRun(data.names[i], testCopy, data.names[i]) < 0)
+            ret = -1;
+    }
+
+    if (virTestRun("Benchmark", testBench, &data) < 0)
+        ret = -1;
+
+ cleanup:
+    VIR_DIR_CLOSE(dir);
+    VIR_FREE(dirname);
+    for (i = 0; i < data.nnames; i++)
+        VIR_FREE(data.names[i]);
+    VIR_FREE(data.names);
+    virObjectUnref(qemuCaps);
+    qemuTestDriverFree(&driver);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+
+#else
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* WITH_QEMU */
@@ -33,6 +33,7 @@ testTypes(const void *data ATTRIBUTE_UNUSED)
 {
     unsigned int u, u2;
     int s, s2;
+    int *p;
     bool res;
 
 #define testAssertEq(a, b) \
@@ -102,6 +103,9 @@ testTypes(const void *data ATTRIBUTE_UNUSED)
     testAssertEq(s2, 12);
     testAssertEq(s, 8);
 
+    virAtomicPtrSet(&p, &s);
+    testAssertEq(virAtomicPtrGet(&p), &s);
+
     return 0;
 }
 
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "internal.h"
 #include "testutils.h"
@@ -461,6 +462,231 @@ testBufSetIndent(const void *opaque ATTRIBUTE_UNUSED)
 }
 
 
+static int
+testBufEscapeFormat(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *actual;
+    const char *expect =
+        "<a>\n"
+        "  &lt;b&gt;\n"
+        "  x<c d='&apos;'/>\n"
+        "  <e>%&amp;</e>\n"
+        "  long: 0123456789abcde&quot;&quot;0123456789abcdef&amp;\t\n"
+        "</a>\n";
+    int ret = -1;
+
+    virBufferAddLit(&buf, "<a>\n");
+    virBufferAdjustIndent(&buf, 2);
+    virBufferEscapeString(&buf, "%s", "<b>");
+    virBufferEscapeString(&buf, "%s", "\n");
+    virBufferEscapeString(&buf, "%s", "x");
+    virBufferEscapeString(&buf, "<c d='%s'/>\n", "'");
+    virBufferEscapeString(&buf, "<e>%%%s</e>\n", "&");
+    virBufferEscapeString(&buf, "should not appear %s\n", NULL);
+    virBufferEscapeString(&buf, "long: %s\n",
+                          "0123456789abcde\"\"\x01\x19"
+                          "0123456789abcdef&\t");
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</a>\n");
+
+    if (!(actual = virBufferContentAndReset(&buf)))
+        goto cleanup;
+
+    if (STRNEQ(actual, expect)) {
+        virTestDifference(stderr, expect, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(actual);
+    return ret;
+}
+
+
+static int
+testBufAddInt(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *actual;
+    const char *expect =
+        "<n>\n"
+        "  0 -1 42 -9223372036854775808 9223372036854775807\n"
+        "  0 18446744073709551615\n"
+        "</n>\n";
+    int ret = -1;
+
+    virBufferAddLit(&buf, "<n>\n");
+    virBufferAdjustIndent(&buf, 2);
+    virBufferAddInt(&buf, 0);
+    virBufferAddChar(&buf, ' ');
+    virBufferAddInt(&buf, -1);
+    virBufferAddChar(&buf, ' ');
+    virBufferAddInt(&buf, 42);
+    virBufferAddChar(&buf, ' ');
+    virBufferAddInt(&buf, LLONG_MIN);
+    virBufferAddChar(&buf, ' ');
+    virBufferAddInt(&buf, LLONG_MAX);
+    virBufferAddChar(&buf, '\n');
+    virBufferAddUInt(&buf, 0);
+    virBufferAddChar(&buf, ' ');
+    virBufferAddUInt(&buf, ULLONG_MAX);
+    virBufferAddChar(&buf, '\n');
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</n>\n");
+
+    if (!(actual = virBufferContentAndReset(&buf)))
+        goto cleanup;
+
+    if (STRNEQ(actual, expect)) {
+        virTestDifference(stderr, expect, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(actual);
+    return ret;
+}
+
+
+static int
+testBufSizeHint(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *actual;
+    int ret = -1;
+
+    virBufferSizeHint(&buf, 10000);
+    if (virBufferUse(&buf) != 0 ||
+        virBufferCurrentContent(&buf)[0] != '\0') {
+        VIR_TEST_DEBUG("size hint must not add content");
+        goto cleanup;
+    }
+
+    virBufferAddLit(&buf, "test");
+
+    if (!(actual = virBufferContentAndReset(&buf)))
+        goto cleanup;
+
+    if (STRNEQ(actual, "test")) {
+        VIR_TEST_DEBUG("unexpected content '%s'", actual);
+        VIR_FREE(actual);
+        goto cleanup;
+    }
+
+    VIR_FREE(actual);
+    ret = 0;
+
+ cleanup:
+    virBufferFreeAndReset(&buf);
+    return ret;
+}
+
+
+static unsigned long long
+testNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+typedef void (*testBufBenchFunc)(virBufferPtr buf, size_t i);
+
+static void
+testBufBenchAsprintfInt(virBufferPtr buf, size_t i)
+{
+    virBufferAsprintf(buf, "<memory unit='KiB'>%zu</memory>\n", i);
+}
+
+static void
+testBufBenchAddInt(virBufferPtr buf, size_t i)
+{
+    virBufferAddLit(buf, "<memory unit='KiB'>");
+    virBufferAddUInt(buf, i);
+    virBufferAddLit(buf, "</memory>\n");
+}
+
+static void
+testBufBenchAsprintfStr(virBufferPtr buf, size_t i ATTRIBUTE_UNUSED)
+{
+    virBufferAsprintf(buf, "<source file='%s'/>\n",
+                      "/var/lib/libvirt/images/guest-disk-0.qcow2");
+}
+
+static void
+testBufBenchEscapeClean(virBufferPtr buf, size_t i ATTRIBUTE_UNUSED)
+{
+    virBufferEscapeString(buf, "<source file='%s'/>\n",
+                          "/var/lib/libvirt/images/guest-disk-0.qcow2");
+}
+
+static void
+testBufBenchEscapeDirty(virBufferPtr buf, size_t i ATTRIBUTE_UNUSED)
+{
+    virBufferEscapeString(buf, "<description>%s</description>\n",
+                          "Guest <test> & 'friends' with \"quotes\"");
+}
+
+struct testBufBench {
+    const char *name;
+    testBufBenchFunc func;
+};
+
+/*
+ * Formats the same element many times into one buffer with each of the
+ * functions below and reports the time per element, so that the cost of
+ * the printf and the escaping paths can be compared.
+ */
+static int
+testBufBenchmark(const void *opaque ATTRIBUTE_UNUSED)
+{
+    static const struct testBufBench benches[] = {
+        { "asprintf %zu", testBufBenchAsprintfInt },
+        { "add lit+uint", testBufBenchAddInt },
+        { "asprintf %s", testBufBenchAsprintfStr },
+        { "escape clean", testBufBenchEscapeClean },
+        { "escape dirty", testBufBenchEscapeDirty },
+    };
+    size_t iterations = virTestGetExpensive() ? 10000000 : 100000;
+    unsigned long long start;
+    unsigned long long elapsed;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < ARRAY_CARDINALITY(benches); i++) {
+        virBuffer buf = VIR_BUFFER_INITIALIZER;
+
+        virBufferAdjustIndent(&buf, 4);
+
+        start = testNow();
+        for (j = 0; j < iterations; j++) {
+            /* keep the buffer from growing without limit */
+            if (virBufferUse(&buf) > 1024 * 1024)
+                virBufferFreeAndReset(&buf);
+            benches[i].func(&buf, j);
+        }
+        elapsed = testNow() - start;
+
+        if (virBufferCheckError(&buf) < 0)
+            return -1;
+        virBufferFreeAndReset(&buf);
+
+        VIR_TEST_VERBOSE("\n%-14s %llu ns/element", benches[i].name,
+                         elapsed / iterations);
+    }
+    VIR_TEST_VERBOSE("\n");
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -480,6 +706,9 @@ mymain(void)
     DO_TEST("Trim", testBufTrim, 0);
     DO_TEST("AddBuffer", testBufAddBuffer, 0);
     DO_TEST("set indent", testBufSetIndent, 0);
+    DO_TEST("EscapeString formats", testBufEscapeFormat, 0);
+    DO_TEST("AddInt", testBufAddInt, 0);
+    DO_TEST("SizeHint", testBufSizeHint, 0);
 
 #define DO_TEST_ADD_STR(DATA, EXPECT) \
     do { \
@@ -532,6 +761,8 @@ mymain(void)
     DO_TEST_ESCAPE_REGEX("^$.|?*+()[]{}\\",
                          "\\^\\$\\.\\|\\?\\*\\+\\(\\)\\[\\]\\{\\}\\\\");
 
+    DO_TEST("Benchmark", testBufBenchmark, 0);
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,577 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include "testutils.h"
+#include "virerror.h"
+#include "viralloc.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virstring.h"
+#include "viruuid.h"
+
+#include "datatypes.h"
+#include "virdomainobjlist.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.domainobjlisttest");
+
+static virDomainXMLOptionPtr xmlopt;
+
+static const unsigned char uuids[][VIR_UUID_BUFLEN] = {
+    { 0xc7, 0xa5, 0xfd, 0xbd, 0xed, 0xaf, 0x94, 0x55,
+      0x92, 0x6a, 0xd6, 0x5c, 0x16, 0xdb, 0x18, 0x09 },
+    { 0xc7, 0xa5, 0xfd, 0xbd, 0xed, 0xaf, 0x94, 0x55,
+      0x92, 0x6a, 0xd6, 0x5c, 0x16, 0xdb, 0x18, 0x10 },
+};
+
+
+/*
+ * Create a list with the domains "one" and "two", the latter of which
+ * is running with ID 7.
+ */
+static virDomainObjListPtr
+testCreateList(void)
+{
+    virDomainObjListPtr doms;
+    virDomainDefPtr def = NULL;
+    virDomainObjPtr vm;
+
+    if (!(doms = virDomainObjListNew()))
+        return NULL;
+
+    if (!(def = virDomainDefNewFull("one", uuids[0], -1)) ||
+        !(vm = virDomainObjListAdd(doms, def, xmlopt, 0, NULL)))
+        goto error;
+    virObjectUnlock(vm);
+
+    if (!(def = virDomainDefNewFull("two", uuids[1], 7)) ||
+        !(vm = virDomainObjListAdd(doms, def, xmlopt, 0, NULL)))
+        goto error;
+    virDomainObjSetState(vm, VIR_DOMAIN_RUNNING, VIR_DOMAIN_RUNNING_BOOTED);
+    virObjectUnlock(vm);
+
+    return doms;
+
+ error:
+    virDomainDefFree(def);
+    virObjectUnref(doms);
+    return NULL;
+}
+
+
+static int
+testCheckSummary(virDomainObjListPtr doms,
+                 const unsigned char *uuid,
+                 const char *name,
+                 int id,
+                 int state)
+{
+    virDomainObjSummary summary;
+    int rc;
+    int ret = -1;
+
+    if ((rc = virDomainObjListGetSummary(doms, uuid, &summary)) < 0)
+        return -1;
+
+    if (!name) {
+        if (rc != 0) {
+            VIR_TEST_DEBUG("Unexpected summary of '%s'\n", summary.def->name);
+            goto cleanup;
+        }
+        return 0;
+    }
+
+    if (rc != 1) {
+        VIR_TEST_DEBUG("No summary of '%s'\n", name);
+        return -1;
+    }
+
+    if (STRNEQ(summary.def->name, name) ||
+        memcmp(summary.def->uuid, uuid, VIR_UUID_BUFLEN) != 0 ||
+        summary.def->id != id ||
+        summary.state.state != state) {
+        VIR_TEST_DEBUG("Unexpected summary: name=%s id=%d state=%d\n",
+                       summary.def->name, summary.def->id,
+                       summary.state.state);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virDomainObjSummaryClear(&summary);
+    return ret;
+}
+
+
+/*
+ * The summary can be read while the domain object is locked, e.g. by a
+ * job, and the running domains can be found by ID without locking the
+ * others.
+ */
+static int
+testSummaryLocked(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainObjListPtr doms;
+    virDomainObjPtr one = NULL;
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+
+    if (!(doms = testCreateList()))
+        return -1;
+
+    if (testCheckSummary(doms, uuids[0], "one", -1, VIR_DOMAIN_SHUTOFF) < 0 ||
+        testCheckSummary(doms, uuids[1], "two", 7, VIR_DOMAIN_RUNNING) < 0)
+        goto cleanup;
+
+    if (!(one = virDomainObjListFindByUUIDRef(doms, uuids[0])))
+        goto cleanup;
+
+    /* The state is published as soon as it is set */
+    one->def->id = 3;
+    virDomainObjSetState(one, VIR_DOMAIN_PAUSED, VIR_DOMAIN_PAUSED_USER);
+
+    if (testCheckSummary(doms, uuids[0], "one", 3, VIR_DOMAIN_PAUSED) < 0)
+        goto cleanup;
+
+    if (!(vm = virDomainObjListFindByIDRef(doms, 7)) ||
+        vm == one ||
+        STRNEQ(vm->def->name, "two")) {
+        VIR_TEST_DEBUG("Domain with ID 7 was not found\n");
+        goto cleanup;
+    }
+    virDomainObjEndAPI(&vm);
+
+    virDomainObjSetState(one, VIR_DOMAIN_SHUTOFF, VIR_DOMAIN_SHUTOFF_SHUTDOWN);
+    one->def->id = -1;
+    virDomainObjEndAPI(&one);
+
+    if (testCheckSummary(doms, uuids[0], "one", -1, VIR_DOMAIN_SHUTOFF) < 0)
+        goto cleanup;
+
+    if ((vm = virDomainObjListFindByIDRef(doms, 3))) {
+        VIR_TEST_DEBUG("Inactive domain was found by ID\n");
+        goto cleanup;
+    }
+
+    /* A stale summary ID is rechecked against the locked definition */
+    if (!(one = virDomainObjListFindByUUIDRef(doms, uuids[0])))
+        goto cleanup;
+
+    one->def->id = 5;
+    virDomainObjSetState(one, VIR_DOMAIN_RUNNING, VIR_DOMAIN_RUNNING_BOOTED);
+    one->def->id = 6;
+
+    /* Unlike virDomainObjEndAPI(), don't publish the summary again */
+    virObjectUnlock(one);
+    virObjectUnref(one);
+    one = NULL;
+
+    if ((vm = virDomainObjListFindByIDRef(doms, 5))) {
+        VIR_TEST_DEBUG("Domain was found by its stale summary ID\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    virDomainObjEndAPI(&one);
+    virObjectUnref(doms);
+    return ret;
+}
+
+
+static int
+testRenameCallback(virDomainObjPtr dom,
+                   const char *new_name,
+                   unsigned int flags ATTRIBUTE_UNUSED,
+                   void *opaque)
+{
+    virDomainObjListPtr doms = opaque;
+    virDomainObjPtr vm;
+    char *name = NULL;
+
+    /* We hold the list lock for writing here, yet lookups still work */
+    if (!(vm = virDomainObjListFindByName(doms, "two"))) {
+        VIR_TEST_DEBUG("Lookup blocked by a rename failed\n");
+        return -1;
+    }
+    virDomainObjEndAPI(&vm);
+
+    if (testCheckSummary(doms, uuids[0], "one", -1, VIR_DOMAIN_SHUTOFF) < 0 ||
+        VIR_STRDUP(name, new_name) < 0)
+        return -1;
+
+    VIR_FREE(dom->def->name);
+    dom->def->name = name;
+    return 0;
+}
+
+
+static int
+testLookupWriteLocked(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainObjListPtr doms;
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+
+    if (!(doms = testCreateList()))
+        return -1;
+
+    if (!(vm = virDomainObjListFindByName(doms, "one")))
+        goto cleanup;
+
+    if (virDomainObjListRename(doms, vm, "three", 0,
+                               testRenameCallback, doms) < 0)
+        goto cleanup;
+
+    virDomainObjEndAPI(&vm);
+
+    if (testCheckSummary(doms, uuids[0], "three", -1, VIR_DOMAIN_SHUTOFF) < 0)
+        goto cleanup;
+
+    if ((vm = virDomainObjListFindByName(doms, "one"))) {
+        VIR_TEST_DEBUG("Domain was found by its old name\n");
+        goto cleanup;
+    }
+
+    if (!(vm = virDomainObjListFindByName(doms, "three")))
+        goto cleanup;
+
+    /* Removed domains are gone for the next lookup */
+    virDomainObjListRemove(doms, vm);
+    virObjectUnref(vm);
+    vm = NULL;
+
+    if (testCheckSummary(doms, uuids[0], NULL, -1, -1) < 0)
+        goto cleanup;
+
+    if ((vm = virDomainObjListFindByUUIDRef(doms, uuids[0]))) {
+        VIR_TEST_DEBUG("Removed domain was found\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    virObjectUnref(doms);
+    return ret;
+}
+
+
+/*
+ * List the changes since *@generation, at most @maxitems of them, and
+ * check they are the domains in the comma separated @names and the
+ * removal of the domain with @removed UUID, if any.
+ */
+static int
+testCheckChanges(virDomainObjListPtr doms,
+                 virConnectPtr conn,
+                 unsigned long long *generation,
+                 unsigned int maxitems,
+                 const char *names,
+                 const unsigned char *removed)
+{
+    virDomainPtr *domains = NULL;
+    char **removedUUIDs = NULL;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    char *got = NULL;
+    int n;
+    size_t i;
+    int ret = -1;
+
+    if ((n = virDomainObjListExportChanges(doms, conn, generation, maxitems,
+                                           &domains, &removedUUIDs,
+                                           NULL)) < 0)
+        return -1;
+
+    for (i = 0; i < n; i++)
+        virBufferAsprintf(&buf, "%s%s", i ? "," : "", domains[i]->name);
+    if (virBufferCheckError(&buf) < 0)
+        goto cleanup;
+    if (!(got = virBufferContentAndReset(&buf)) && VIR_STRDUP(got, "") < 0)
+        goto cleanup;
+
+    if (STRNEQ(got, names)) {
+        VIR_TEST_DEBUG("Expected changed domains '%s', got '%s'\n",
+                       names, got);
+        goto cleanup;
+    }
+
+    if (removed) {
+        virUUIDFormat(removed, uuidstr);
+        if (virStringListLength((const char * const *) removedUUIDs) != 1 ||
+            STRNEQ(removedUUIDs[0], uuidstr)) {
+            VIR_TEST_DEBUG("Removal of '%s' was not listed\n", uuidstr);
+            goto cleanup;
+        }
+    } else if (removedUUIDs[0]) {
+        VIR_TEST_DEBUG("Unexpected removal of '%s'\n", removedUUIDs[0]);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(got);
+    virObjectListFreeCount(domains, n);
+    virStringListFree(removedUUIDs);
+    return ret;
+}
+
+
+static int
+testSetState(virDomainObjListPtr doms,
+             const unsigned char *uuid,
+             int state,
+             int reason)
+{
+    virDomainObjPtr vm;
+
+    if (!(vm = virDomainObjListFindByUUIDRef(doms, uuid)))
+        return -1;
+    virDomainObjSetState(vm, state, reason);
+    virDomainObjEndAPI(&vm);
+    return 0;
+}
+
+
+static int
+testListChanges(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainObjListPtr doms;
+    virConnectPtr conn = NULL;
+    virDomainObjPtr vm = NULL;
+    unsigned long long generation = 0;
+    unsigned long long old;
+    int ret = -1;
+
+    if (!(doms = testCreateList()) ||
+        !(conn = virGetConnect()))
+        goto cleanup;
+
+    /* Generation 0 lists everything */
+    if (testCheckChanges(doms, conn, &generation, 0, "one,two", NULL) < 0 ||
+        testCheckChanges(doms, conn, &generation, 0, "", NULL) < 0)
+        goto cleanup;
+    old = generation;
+
+    /* Changes are listed in the order they happened, page by page */
+    if (testSetState(doms, uuids[1], VIR_DOMAIN_PAUSED,
+                     VIR_DOMAIN_PAUSED_USER) < 0 ||
+        testSetState(doms, uuids[0], VIR_DOMAIN_PAUSED,
+                     VIR_DOMAIN_PAUSED_USER) < 0)
+        goto cleanup;
+
+    if (testCheckChanges(doms, conn, &generation, 1, "two", NULL) < 0 ||
+        testCheckChanges(doms, conn, &generation, 1, "one", NULL) < 0 ||
+        testCheckChanges(doms, conn, &generation, 1, "", NULL) < 0)
+        goto cleanup;
+
+    /* Only the latest change of a domain counts */
+    generation = old;
+    if (testSetState(doms, uuids[1], VIR_DOMAIN_RUNNING,
+                     VIR_DOMAIN_RUNNING_UNPAUSED) < 0 ||
+        testCheckChanges(doms, conn, &generation, 0, "one,two", NULL) < 0)
+        goto cleanup;
+    old = generation;
+
+    if (!(vm = virDomainObjListFindByUUIDRef(doms, uuids[1])))
+        goto cleanup;
+    virDomainObjListRemove(doms, vm);
+    virObjectUnref(vm);
+    vm = NULL;
+
+    if (testCheckChanges(doms, conn, &generation, 0, "", uuids[1]) < 0)
+        goto cleanup;
+
+    /* A full listing does not report removals */
+    generation = 0;
+    if (testCheckChanges(doms, conn, &generation, 0, "one", NULL) < 0)
+        goto cleanup;
+
+    /* Generations the list doesn't know about are rejected */
+    generation = 1;
+    if (testCheckChanges(doms, conn, &generation, 0, "", NULL) == 0) {
+        VIR_TEST_DEBUG("Changes since a forgotten generation were listed\n");
+        goto cleanup;
+    }
+
+    generation = virDomainObjCurrentGeneration() + 1;
+    if (testCheckChanges(doms, conn, &generation, 0, "", NULL) == 0) {
+        VIR_TEST_DEBUG("Changes since a future generation were listed\n");
+        goto cleanup;
+    }
+
+    generation = old;
+    if (testCheckChanges(doms, conn, &generation, 0, "", uuids[1]) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    virObjectUnref(conn);
+    virObjectUnref(doms);
+    return ret;
+}
+
+
+#define TEST_LOAD_DOMAINS 40
+
+struct testLoadData {
+    const char *scratchdir;
+    size_t nnotified;
+    char *last;
+    bool unordered;
+};
+
+
+static void
+testLoadNotify(virDomainObjPtr vm,
+               int newVM ATTRIBUTE_UNUSED,
+               void *opaque)
+{
+    struct testLoadData *data = opaque;
+
+    if (data->last && strcmp(data->last, vm->def->name) >= 0)
+        data->unordered = true;
+    VIR_FREE(data->last);
+    ignore_value(VIR_STRDUP(data->last, vm->def->name));
+    data->nnotified++;
+}
+
+
+/*
+ * Configs are parsed in parallel, yet the domains are added in the
+ * order of their names and a broken config doesn't stop the others
+ * from loading.
+ */
+static int
+testLoadAllConfigs(const void *opaque)
+{
+    struct testLoadData data = { opaque, 0, NULL, false };
+    virDomainObjListPtr doms = NULL;
+    virCapsPtr caps = NULL;
+    virDomainObjPtr vm = NULL;
+    char *configDir = NULL;
+    char *autostartDir = NULL;
+    char *path = NULL;
+    char *xml = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (virAsprintf(&configDir, "%s/qemu", data.scratchdir) < 0 ||
+        virAsprintf(&autostartDir, "%s/autostart", configDir) < 0 ||
+        virFileMakePath(autostartDir) < 0)
+        goto cleanup;
+
+    /* Written backwards so that the directory order is not sorted */
+    for (i = TEST_LOAD_DOMAINS; i > 0; i--) {
+        if (virAsprintf(&path, "%s/dom%02zu.xml", configDir, i - 1) < 0 ||
+            virAsprintf(&xml,
+                        "<domain type='test'>\n"
+                        "  <name>dom%02zu</name>\n"
+                        "  <uuid>c7a5fdbd-edaf-9455-926a-d65c16db18%02zu</uuid>\n"
+                        "  <memory>1024</memory>\n"
+                        "  <os><type>hvm</type></os>\n"
+                        "</domain>\n", i - 1, i - 1) < 0 ||
+            virFileWriteStr(path, xml, 0600) < 0)
+            goto cleanup;
+        VIR_FREE(path);
+        VIR_FREE(xml);
+    }
+
+    if (virAsprintf(&path, "%s/broken.xml", configDir) < 0 ||
+        virFileWriteStr(path, "<domain type='test'>", 0600) < 0)
+        goto cleanup;
+
+    if (!(caps = virTestGenericCapsInit()) ||
+        !(doms = virDomainObjListNew()))
+        goto cleanup;
+
+    if (virDomainObjListLoadAllConfigs(doms, configDir, autostartDir, false,
+                                       caps, xmlopt, testLoadNotify,
+                                       &data) < 0)
+        goto cleanup;
+
+    if (data.nnotified != TEST_LOAD_DOMAINS || data.unordered ||
+        virDomainObjListNumOfDomains(doms, false, NULL, NULL) !=
+        TEST_LOAD_DOMAINS) {
+        VIR_TEST_DEBUG("Loaded %zu domains, %s\n", data.nnotified,
+                       data.unordered ? "unordered" : "ordered");
+        goto cleanup;
+    }
+
+    if (!(vm = virDomainObjListFindByName(doms, "dom17")) ||
+        !vm->persistent) {
+        VIR_TEST_DEBUG("Loaded domain is missing or not persistent\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    virObjectUnref(doms);
+    virObjectUnref(caps);
+    VIR_FREE(data.last);
+    VIR_FREE(configDir);
+    VIR_FREE(autostartDir);
+    VIR_FREE(path);
+    VIR_FREE(xml);
+    return ret;
+}
+
+
+#define SCRATCHDIRTEMPLATE abs_builddir "/virdomainobjlistdir-XXXXXX"
+
+static int
+mymain(void)
+{
+    char scratchdir[] = SCRATCHDIRTEMPLATE;
+    int ret = 0;
+
+    if (!mkdtemp(scratchdir)) {
+        virFilePrintf(stderr, "Cannot create virdomainobjlistdir");
+        abort();
+    }
+
+    if (!(xmlopt = virTestGenericDomainXMLConfInit()))
+        return EXIT_FAILURE;
+
+    if (virTestRun("Summary of locked domain", testSummaryLocked, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Lookup with list locked", testLookupWriteLocked, NULL) < 0)
+        ret = -1;
+    if (virTestRun("List changes", testListChanges, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Load all configs", testLoadAllConfigs, scratchdir) < 0)
+        ret = -1;
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+
+    virObjectUnref(xmlopt);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
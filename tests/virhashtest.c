@@ -597,6 +597,282 @@ testHashEqual(const void *data ATTRIBUTE_UNUSED)
 }
 
 
+#define TEST_HASH_CHURN_KEYS 5000
+
+struct testHashChurnData {
+    virHashTablePtr hash;
+    char **keys;
+    bool *present;
+    size_t removed;
+};
+
+static int
+testHashChurnRemoveIter(void *payload,
+                        const void *name,
+                        void *opaque)
+{
+    struct testHashChurnData *data = opaque;
+    size_t i = (size_t) payload;
+
+    if (STRNEQ(name, data->keys[i]) || !data->present[i]) {
+        VIR_TEST_VERBOSE("\nunexpected entry '%s' in ForEach",
+                         (const char *) name);
+        return -1;
+    }
+
+    /* Removed entries don't move anything else, so every remaining
+     * entry has to be seen exactly once */
+    if (i % 3 == 0) {
+        if (virHashRemoveEntry(data->hash, name) < 0)
+            return -1;
+        data->present[i] = false;
+        data->removed++;
+    }
+
+    return 0;
+}
+
+static int
+testHashChurnRemoveSetIter(const void *payload,
+                           const void *name ATTRIBUTE_UNUSED,
+                           const void *opaque)
+{
+    struct testHashChurnData *data = (struct testHashChurnData *) opaque;
+    size_t i = (size_t) payload;
+
+    if (i % 5 != 1)
+        return 0;
+
+    data->present[i] = false;
+    return 1;
+}
+
+static int
+testHashChurnCheck(virHashTablePtr hash,
+                   struct testHashChurnData *data,
+                   size_t nkeys)
+{
+    size_t count = 0;
+    size_t i;
+
+    for (i = 0; i < nkeys; i++) {
+        void *payload = virHashLookup(hash, data->keys[i]);
+
+        if (data->present[i]) {
+            count++;
+            if (payload != (void *) i) {
+                VIR_TEST_VERBOSE("\nentry '%s' not found", data->keys[i]);
+                return -1;
+            }
+        } else if (payload) {
+            VIR_TEST_VERBOSE("\nremoved entry '%s' found", data->keys[i]);
+            return -1;
+        }
+    }
+
+    return testHashCheckCount(hash, count);
+}
+
+/*
+ * Adds and removes lots of entries in all the ways there are, checking
+ * the whole table in between, so that all of it happens both while the
+ * table is being grown and while it is not.
+ */
+static int
+testHashChurn(const void *data ATTRIBUTE_UNUSED)
+{
+    struct testHashChurnData cdata = { NULL, NULL, NULL, 0 };
+    virHashTablePtr hash = NULL;
+    ssize_t size = 0;
+    size_t grown = 0;
+    bool foreach;
+    bool removeset;
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(cdata.keys, TEST_HASH_CHURN_KEYS) < 0 ||
+        VIR_ALLOC_N(cdata.present, TEST_HASH_CHURN_KEYS) < 0)
+        goto cleanup;
+
+    for (i = 0; i < TEST_HASH_CHURN_KEYS; i++) {
+        if (virAsprintf(&cdata.keys[i], "key-%zu", i) < 0)
+            goto cleanup;
+    }
+
+    if (!(hash = virHashCreate(0, NULL)))
+        goto cleanup;
+    cdata.hash = hash;
+
+    for (i = 0; i < TEST_HASH_CHURN_KEYS; i++) {
+        if (virHashAddEntry(hash, cdata.keys[i], (void *) i) < 0)
+            goto cleanup;
+        cdata.present[i] = true;
+
+        /* remove every other entry once in a while, so that removals
+         * hit both the old and new slots */
+        if (i % 97 == 96) {
+            size_t j;
+
+            for (j = i - 96; j <= i; j += 2) {
+                if (virHashRemoveEntry(hash, cdata.keys[j]) < 0) {
+                    if (cdata.present[j]) {
+                        VIR_TEST_VERBOSE("\nentry '%s' could not be removed",
+                                         cdata.keys[j]);
+                        goto cleanup;
+                    }
+                    continue;
+                }
+                if (!cdata.present[j]) {
+                    VIR_TEST_VERBOSE("\nremoved entry '%s' removed again",
+                                     cdata.keys[j]);
+                    goto cleanup;
+                }
+                cdata.present[j] = false;
+            }
+        }
+
+        if (i % 499 == 0 && testHashChurnCheck(hash, &cdata, i + 1) < 0)
+            goto cleanup;
+
+        /* Right after the table started growing, most of the entries
+         * are still in the old slots */
+        if (virHashTableSize(hash) != size) {
+            size = virHashTableSize(hash);
+            foreach = grown++ % 2 == 0;
+            removeset = !foreach;
+        } else {
+            foreach = i % 1000 == 500;
+            removeset = i % 1000 == 800;
+        }
+
+        if (foreach &&
+            virHashForEach(hash, testHashChurnRemoveIter, &cdata) < 0)
+            goto cleanup;
+
+        if (removeset &&
+            virHashRemoveSet(hash, testHashChurnRemoveSetIter, &cdata) < 0)
+            goto cleanup;
+    }
+
+    if (testHashChurnCheck(hash, &cdata, TEST_HASH_CHURN_KEYS) < 0)
+        goto cleanup;
+
+    /* put everything back in */
+    for (i = 0; i < TEST_HASH_CHURN_KEYS; i++) {
+        if (virHashUpdateEntry(hash, cdata.keys[i], (void *) i) < 0)
+            goto cleanup;
+        cdata.present[i] = true;
+    }
+
+    if (testHashChurnCheck(hash, &cdata, TEST_HASH_CHURN_KEYS) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virHashFree(hash);
+    if (cdata.keys) {
+        for (i = 0; i < TEST_HASH_CHURN_KEYS; i++)
+            VIR_FREE(cdata.keys[i]);
+    }
+    VIR_FREE(cdata.keys);
+    VIR_FREE(cdata.present);
+    return ret;
+}
+
+
+static unsigned long long
+testNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/*
+ * Times adding, looking up and removing a growing number of keys. The
+ * slowest single addition shows how long growing the table stalls its
+ * user.
+ */
+static int
+testHashBenchmark(const void *data ATTRIBUTE_UNUSED)
+{
+    size_t nkeys = virTestGetExpensive() ? 1000000 : 20000;
+    char **keys = NULL;
+    virHashTablePtr hash = NULL;
+    unsigned long long start;
+    unsigned long long now;
+    unsigned long long worst = 0;
+    unsigned long long add;
+    unsigned long long hit;
+    unsigned long long miss;
+    unsigned long long del;
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(keys, nkeys * 2) < 0)
+        return -1;
+
+    for (i = 0; i < nkeys * 2; i++) {
+        if (virAsprintf(&keys[i], "%08zx-7d41-4100-8907-9b9209e7954a", i) < 0)
+            goto cleanup;
+    }
+
+    if (!(hash = virHashCreate(0, NULL)))
+        goto cleanup;
+
+    start = now = testNow();
+    for (i = 0; i < nkeys; i++) {
+        unsigned long long prev = now;
+
+        if (virHashAddEntry(hash, keys[i], keys[i]) < 0)
+            goto cleanup;
+
+        now = testNow();
+        if (now - prev > worst)
+            worst = now - prev;
+    }
+    add = now - start;
+
+    start = testNow();
+    for (i = 0; i < nkeys; i++) {
+        if (!virHashLookup(hash, keys[i]))
+            goto cleanup;
+    }
+    hit = testNow() - start;
+
+    start = testNow();
+    for (i = nkeys; i < nkeys * 2; i++) {
+        if (virHashLookup(hash, keys[i]))
+            goto cleanup;
+    }
+    miss = testNow() - start;
+
+    start = testNow();
+    for (i = 0; i < nkeys; i++) {
+        if (virHashRemoveEntry(hash, keys[i]) < 0)
+            goto cleanup;
+    }
+    del = testNow() - start;
+
+    VIR_TEST_VERBOSE("\n%zu keys: add %llu ns (worst %llu ns), "
+                     "hit %llu ns, miss %llu ns, remove %llu ns\n",
+                     nkeys, add / nkeys, worst, hit / nkeys,
+                     miss / nkeys, del / nkeys);
+
+    ret = 0;
+
+ cleanup:
+    virHashFree(hash);
+    for (i = 0; i < nkeys * 2; i++)
+        VIR_FREE(keys[i]);
+    VIR_FREE(keys);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -635,6 +911,8 @@ mymain(void)
     DO_TEST("Search", Search);
     DO_TEST("GetItems", GetItems);
     DO_TEST("Equal", Equal);
+    DO_TEST("Churn", Churn);
+    DO_TEST("Benchmark", Benchmark);
 
     return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,527 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <signal.h>
+#include <sys/socket.h>
+
+#include "testutils.h"
+#include "virerror.h"
+#include "viralloc.h"
+#include "viratomic.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virthread.h"
+#include "rpc/virnetclient.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+VIR_LOG_INIT("tests.netclienttest");
+
+#ifdef HAVE_SOCKETPAIR
+
+/*
+ * The client talks over a socket pair to a stub server, which is
+ * just the test itself reading calls from and writing replies to
+ * the other end. The event loop is run by the test too, only when
+ * it waits for asynchronous calls to complete.
+ */
+
+# define TEST_PROGRAM 0x11223344
+# define TEST_VERSION 1
+# define TEST_PROC 1
+
+/* Length word plus header: prog, vers, proc, type, serial, status */
+# define TEST_HEADER_LEN (4 * 7)
+
+/* Iterations of the event loop to wait for callbacks, each taking
+ * at most as long as the interval of the guard timer */
+# define TEST_WAIT_ITERATIONS 50
+# define TEST_GUARD_INTERVAL 100
+
+struct testAsyncCall {
+    unsigned int serial;
+    int fired;                  /* How many times the callback ran */
+    bool gotReply;
+    unsigned int replySerial;
+};
+
+
+static void
+testGuardTimer(int timer ATTRIBUTE_UNUSED,
+               void *opaque ATTRIBUTE_UNUSED)
+{
+}
+
+
+static void
+testAsyncReply(virNetClientPtr client ATTRIBUTE_UNUSED,
+               virNetMessagePtr msg,
+               void *opaque)
+{
+    struct testAsyncCall *call = opaque;
+
+    call->fired++;
+    if (msg) {
+        call->gotReply = true;
+        call->replySerial = msg->header.serial;
+        virNetMessageFree(msg);
+    }
+}
+
+
+static virNetMessagePtr
+testCallNew(unsigned int serial)
+{
+    virNetMessagePtr msg;
+
+    if (!(msg = virNetMessageNew(false)))
+        return NULL;
+
+    msg->header.prog = TEST_PROGRAM;
+    msg->header.vers = TEST_VERSION;
+    msg->header.proc = TEST_PROC;
+    msg->header.type = VIR_NET_CALL;
+    msg->header.serial = serial;
+    msg->header.status = VIR_NET_OK;
+
+    if (virNetMessageEncodeHeader(msg) < 0 ||
+        virNetMessageEncodePayloadEmpty(msg) < 0) {
+        virNetMessageFree(msg);
+        return NULL;
+    }
+
+    return msg;
+}
+
+
+static int
+testSendAsync(virNetClientPtr client,
+              struct testAsyncCall *call)
+{
+    virNetMessagePtr msg;
+
+    if (!(msg = testCallNew(call->serial)))
+        return -1;
+
+    if (virNetClientSendWithReplyAsync(client, msg,
+                                       testAsyncReply, call) < 0) {
+        virNetMessageFree(msg);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static unsigned int
+testGetWord(const unsigned char *buf)
+{
+    return (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+}
+
+
+static void
+testPutWord(unsigned char *buf,
+            unsigned int word)
+{
+    buf[0] = word >> 24;
+    buf[1] = word >> 16;
+    buf[2] = word >> 8;
+    buf[3] = word;
+}
+
+
+/* Read a call from the server end of the socket pair */
+static int
+testServerRecvCall(int fd,
+                   unsigned int serial)
+{
+    unsigned char buf[1024];
+    size_t len;
+
+    if (saferead(fd, buf, 4) != 4)
+        return -1;
+
+    len = testGetWord(buf);
+    if (len < TEST_HEADER_LEN || len > sizeof(buf) ||
+        saferead(fd, buf + 4, len - 4) != len - 4)
+        return -1;
+
+    if (testGetWord(buf + 20) != serial) {
+        VIR_TEST_DEBUG("Expected call %u, got %u\n",
+                       serial, testGetWord(buf + 20));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Write an empty reply from the server end of the socket pair */
+static int
+testServerSendReply(int fd,
+                    unsigned int serial)
+{
+    unsigned char buf[TEST_HEADER_LEN];
+
+    testPutWord(buf, TEST_HEADER_LEN);
+    testPutWord(buf + 4, TEST_PROGRAM);
+    testPutWord(buf + 8, TEST_VERSION);
+    testPutWord(buf + 12, TEST_PROC);
+    testPutWord(buf + 16, VIR_NET_REPLY);
+    testPutWord(buf + 20, serial);
+    testPutWord(buf + 24, VIR_NET_OK);
+
+    if (safewrite(fd, buf, sizeof(buf)) != sizeof(buf))
+        return -1;
+
+    return 0;
+}
+
+
+/*
+ * Run the event loop until the callbacks of all @ncalls @calls
+ * ran, then check each of them ran exactly once, and got a reply
+ * only if @reply is true.
+ */
+static int
+testWaitAsync(struct testAsyncCall *calls,
+              size_t ncalls,
+              bool reply)
+{
+    size_t iter;
+    size_t i;
+
+    for (iter = 0; iter < TEST_WAIT_ITERATIONS; iter++) {
+        for (i = 0; i < ncalls; i++) {
+            if (!calls[i].fired)
+                break;
+        }
+        if (i == ncalls)
+            break;
+
+        if (virEventRunDefaultImpl() < 0)
+            return -1;
+    }
+
+    /* Give any callback running twice a chance to do so */
+    if (virEventRunDefaultImpl() < 0)
+        return -1;
+
+    for (i = 0; i < ncalls; i++) {
+        if (calls[i].fired != 1) {
+            VIR_TEST_DEBUG("Callback of call %u ran %d times\n",
+                           calls[i].serial, calls[i].fired);
+            return -1;
+        }
+        if (calls[i].gotReply != reply) {
+            VIR_TEST_DEBUG("Callback of call %u %s a reply\n",
+                           calls[i].serial,
+                           calls[i].gotReply ? "got" : "didn't get");
+            return -1;
+        }
+        if (reply && calls[i].replySerial != calls[i].serial) {
+            VIR_TEST_DEBUG("Callback of call %u got reply %u\n",
+                           calls[i].serial, calls[i].replySerial);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static virNetClientPtr
+testClientNew(int *serverfd)
+{
+    int sv[2];
+    virNetClientPtr client;
+
+    if (socketpair(PF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        virReportSystemError(errno, "%s", "Cannot create socket pair");
+        return NULL;
+    }
+
+    if (!(client = virNetClientNewSockFD(sv[0]))) {
+        VIR_FORCE_CLOSE(sv[0]);
+        VIR_FORCE_CLOSE(sv[1]);
+        return NULL;
+    }
+
+    if (virNetClientRegisterAsyncIO(client) < 0) {
+        virObjectUnref(client);
+        VIR_FORCE_CLOSE(sv[1]);
+        return NULL;
+    }
+
+    *serverfd = sv[1];
+    return client;
+}
+
+
+static void
+testClientFree(virNetClientPtr client,
+               int serverfd)
+{
+    if (!client)
+        return;
+
+    virNetClientClose(client);
+
+    /* Let the event loop drop the references it holds */
+    ignore_value(virEventRunDefaultImpl());
+    ignore_value(virEventRunDefaultImpl());
+
+    virObjectUnref(client);
+    VIR_FORCE_CLOSE(serverfd);
+}
+
+
+struct testSyncCall {
+    virNetClientPtr client;
+    unsigned int serial;
+    int rv;
+    int done;
+};
+
+
+static void
+testSyncCallThread(void *opaque)
+{
+    struct testSyncCall *sync = opaque;
+    virNetMessagePtr msg;
+
+    sync->rv = -1;
+    if ((msg = testCallNew(sync->serial))) {
+        sync->rv = virNetClientSendWithReply(sync->client, msg);
+        virNetMessageFree(msg);
+    }
+
+    virAtomicIntSet(&sync->done, 1);
+}
+
+
+/*
+ * An asynchronous call made while another thread is waiting for its
+ * own reply has to be completed by that thread.
+ */
+static int
+testAsyncOtherThread(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virNetClientPtr client;
+    int serverfd = -1;
+    struct testSyncCall sync = { NULL, 1, -1, 0 };
+    struct testAsyncCall call = { 2, 0, false, 0 };
+    virThread thread;
+    bool joined = true;
+    int ret = -1;
+
+    if (!(client = testClientNew(&serverfd)))
+        return -1;
+
+    sync.client = client;
+    if (virThreadCreate(&thread, true, testSyncCallThread, &sync) < 0)
+        goto cleanup;
+    joined = false;
+
+    /* Once the call was sent, its thread sits in the I/O loop
+     * until the reply arrives */
+    if (testServerRecvCall(serverfd, sync.serial) < 0)
+        goto cleanup;
+
+    if (testSendAsync(client, &call) < 0 ||
+        testServerRecvCall(serverfd, call.serial) < 0 ||
+        testServerSendReply(serverfd, call.serial) < 0 ||
+        testWaitAsync(&call, 1, true) < 0)
+        goto cleanup;
+
+    if (virAtomicIntGet(&sync.done)) {
+        VIR_TEST_DEBUG("Synchronous call finished before its reply\n");
+        goto cleanup;
+    }
+
+    if (testServerSendReply(serverfd, sync.serial) < 0)
+        goto cleanup;
+
+    virThreadJoin(&thread);
+    joined = true;
+
+    if (sync.rv < 0) {
+        VIR_TEST_DEBUG("Synchronous call failed\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (!joined) {
+        /* Closing the server end makes the other thread give up */
+        VIR_FORCE_CLOSE(serverfd);
+        virThreadJoin(&thread);
+    }
+    testClientFree(client, serverfd);
+    return ret;
+}
+
+
+/*
+ * The reply of an asynchronous call may be read already by the
+ * thread sending the call. It's then still handed to the callback
+ * from the event loop, and so are replies arriving later.
+ */
+static int
+testAsyncImmediate(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virNetClientPtr client;
+    int serverfd = -1;
+    struct testAsyncCall pending = { 3, 0, false, 0 };
+    struct testAsyncCall call = { 4, 0, false, 0 };
+    char c;
+    int ret = -1;
+
+    if (!(client = testClientNew(&serverfd)))
+        return -1;
+
+    /* The pending call makes the sending thread look for incoming
+     * data as well, and the event loop doesn't run until we wait for
+     * the callbacks, so nobody but that thread reads the reply */
+    if (testSendAsync(client, &pending) < 0 ||
+        testServerRecvCall(serverfd, pending.serial) < 0 ||
+        testServerSendReply(serverfd, call.serial) < 0 ||
+        testSendAsync(client, &call) < 0)
+        goto cleanup;
+
+    if (recv(virNetClientGetFD(client), &c, 1, MSG_PEEK | MSG_DONTWAIT) >= 0 ||
+        errno != EAGAIN) {
+        VIR_TEST_DEBUG("Reply not read while sending the call\n");
+        goto cleanup;
+    }
+
+    if (call.fired) {
+        VIR_TEST_DEBUG("Callback ran outside of the event loop\n");
+        goto cleanup;
+    }
+
+    if (testServerRecvCall(serverfd, call.serial) < 0 ||
+        testWaitAsync(&call, 1, true) < 0)
+        goto cleanup;
+
+    if (pending.fired) {
+        VIR_TEST_DEBUG("Callback of pending call ran without reply\n");
+        goto cleanup;
+    }
+
+    if (testServerSendReply(serverfd, pending.serial) < 0 ||
+        testWaitAsync(&pending, 1, true) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    testClientFree(client, serverfd);
+    return ret;
+}
+
+
+/*
+ * Calls still waiting for their reply when the connection goes
+ * away have their callbacks run exactly once, without a reply.
+ */
+static int
+testAsyncClose(const void *opaque)
+{
+    bool serverClose = *(const bool *)opaque;
+    virNetClientPtr client;
+    int serverfd = -1;
+    struct testAsyncCall calls[] = {
+        { 5, 0, false, 0 },
+        { 6, 0, false, 0 },
+        { 7, 0, false, 0 },
+    };
+    size_t i;
+    int ret = -1;
+
+    if (!(client = testClientNew(&serverfd)))
+        return -1;
+
+    for (i = 0; i < ARRAY_CARDINALITY(calls); i++) {
+        if (testSendAsync(client, &calls[i]) < 0 ||
+            testServerRecvCall(serverfd, calls[i].serial) < 0)
+            goto cleanup;
+    }
+
+    if (serverClose)
+        VIR_FORCE_CLOSE(serverfd);
+    else
+        virNetClientClose(client);
+
+    if (testWaitAsync(calls, ARRAY_CARDINALITY(calls), false) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    testClientFree(client, serverfd);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    bool serverClose = true;
+    bool clientClose = false;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (virEventRegisterDefaultImpl() < 0 ||
+        virEventAddTimeout(TEST_GUARD_INTERVAL, testGuardTimer,
+                           NULL, NULL) < 0)
+        return EXIT_FAILURE;
+
+    if (virTestRun("Async reply read by other thread",
+                   testAsyncOtherThread, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Async reply read while sending",
+                   testAsyncImmediate, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Async calls pending on server close",
+                   testAsyncClose, &serverClose) < 0)
+        ret = -1;
+
+    if (virTestRun("Async calls pending on client close",
+                   testAsyncClose, &clientClose) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#else
+static int
+mymain(void)
+{
+    return EXIT_AM_SKIP;
+}
+#endif
+
+VIR_TEST_MAIN(mymain)
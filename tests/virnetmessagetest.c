@@ -521,6 +521,246 @@ static int testMessagePayloadStreamEncode(const void *args ATTRIBUTE_UNUSED)
     return ret;
 }
 
+static int testMessagePayloadStreamEncodeRef(const void *args ATTRIBUTE_UNUSED)
+{
+    char *stream = NULL;
+    virNetMessagePtr msg = virNetMessageNew(true);
+    static const char expect[] = {
+        0x00, 0x00, 0x00, 0x47,  /* Length */
+        0x11, 0x22, 0x33, 0x44,  /* Program */
+        0x00, 0x00, 0x00, 0x01,  /* Version */
+        0x00, 0x00, 0x06, 0x66,  /* Procedure */
+        0x00, 0x00, 0x00, 0x03,  /* Type */
+        0x00, 0x00, 0x00, 0x99,  /* Serial */
+        0x00, 0x00, 0x00, 0x02,  /* Status */
+
+        'T', 'h', 'e', ' ',
+        'q', 'u', 'i', 'c',
+        'k', ' ', 'b', 'r',
+        'o', 'w', 'n', ' ',
+        'f', 'o', 'x', ' ',
+        'j', 'u', 'm', 'p',
+        's', ' ', 'o', 'v',
+        'e', 'r', ' ', 't',
+        'h', 'e', ' ', 'l',
+        'a', 'z', 'y', ' ',
+        'd', 'o', 'g',
+    };
+    /* Transmit in chunks which straddle the header/payload boundary */
+    static const size_t chunks[] = { 3, 26, 10, 32 };
+    char sent[sizeof(expect)];
+    size_t nsent = 0;
+    struct iovec iov[2];
+    size_t niov;
+    size_t i, j;
+    int ret = -1;
+
+    if (!msg)
+        return -1;
+
+    if (VIR_STRDUP(stream, "The quick brown fox jumps over the lazy dog") < 0)
+        goto cleanup;
+
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 0x01;
+    msg->header.proc = 0x666;
+    msg->header.type = VIR_NET_STREAM;
+    msg->header.serial = 0x99;
+    msg->header.status = VIR_NET_CONTINUE;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    if (virNetMessageEncodePayloadRef(msg, &stream, strlen(stream)) < 0)
+        goto cleanup;
+
+    if (stream) {
+        VIR_DEBUG("Expected payload to be taken over by the message");
+        goto cleanup;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(chunks); i++) {
+        size_t want = chunks[i];
+
+        if (virNetMessageIsTXComplete(msg)) {
+            VIR_DEBUG("Message complete after %zu bytes", nsent);
+            goto cleanup;
+        }
+
+        niov = virNetMessageGetTXIOV(msg, iov);
+        for (j = 0; j < niov && want; j++) {
+            size_t len = MIN(want, iov[j].iov_len);
+            memcpy(sent + nsent, iov[j].iov_base, len);
+            nsent += len;
+            want -= len;
+        }
+        virNetMessageAdvanceTX(msg, chunks[i]);
+    }
+
+    if (!virNetMessageIsTXComplete(msg) ||
+        virNetMessageGetTXIOV(msg, iov) != 0) {
+        VIR_DEBUG("Expected message to be complete");
+        goto cleanup;
+    }
+
+    if (nsent != sizeof(expect)) {
+        VIR_DEBUG("Expect message length %zu got %zu",
+                  sizeof(expect), nsent);
+        goto cleanup;
+    }
+
+    if (memcmp(expect, sent, sizeof(expect)) != 0) {
+        virTestDifferenceBin(stderr, expect, sent, sizeof(expect));
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(stream);
+    virNetMessageFree(msg);
+    return ret;
+}
+
+
+static int testMessagePool(const void *args ATTRIBUTE_UNUSED)
+{
+    virNetMessagePoolStats before, after;
+    virNetMessagePtr msg = NULL;
+    char *buffer;
+    int ret = -1;
+
+    virNetMessagePoolSetLimits(1024 * 1024 * 16, 1024);
+
+    /* Make sure there is one pooled message and buffer to reuse */
+    if (!(msg = virNetMessageNew(true)) ||
+        virNetMessageAllocBuffer(msg, VIR_NET_MESSAGE_LEN_MAX) < 0 ||
+        virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+    buffer = msg->buffer;
+    virNetMessageFree(msg);
+
+    virNetMessagePoolGetStats(&before);
+
+    if (!(msg = virNetMessageNew(true)) ||
+        virNetMessageAllocBuffer(msg, VIR_NET_MESSAGE_LEN_MAX) < 0 ||
+        virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    virNetMessagePoolGetStats(&after);
+
+    if (msg->buffer != buffer) {
+        VIR_DEBUG("Expected pooled buffer %p got %p", buffer, msg->buffer);
+        goto cleanup;
+    }
+
+    if (after.messageHits != before.messageHits + 1 ||
+        after.messageMisses != before.messageMisses ||
+        after.bufferHits != before.bufferHits + 1 ||
+        after.bufferMisses != before.bufferMisses) {
+        VIR_DEBUG("Expected one message and one buffer hit, got "
+                  "%llu/%llu message and %llu/%llu buffer hits/misses",
+                  after.messageHits - before.messageHits,
+                  after.messageMisses - before.messageMisses,
+                  after.bufferHits - before.bufferHits,
+                  after.bufferMisses - before.bufferMisses);
+        goto cleanup;
+    }
+
+    virNetMessageFree(msg);
+    msg = NULL;
+
+    /* Lowering the limits must drop everything cached */
+    virNetMessagePoolSetLimits(0, 0);
+    virNetMessagePoolGetStats(&after);
+
+    if (after.bytes != 0 || after.messages != 0) {
+        VIR_DEBUG("Expected empty pool, got %llu bytes and %u messages",
+                  after.bytes, after.messages);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virNetMessageFree(msg);
+    virNetMessagePoolSetLimits(1024 * 1024 * 16, 1024);
+    return ret;
+}
+
+#if WITH_LZ4
+static int testMessageCompression(const void *args ATTRIBUTE_UNUSED)
+{
+    virNetMessagePtr msg = virNetMessageNew(true);
+    virNetMessagePtr rx = virNetMessageNew(true);
+    char *data = NULL;
+    size_t datalen = 64 * 1024;
+    size_t i;
+    int ret = -1;
+
+    if (!msg || !rx)
+        goto cleanup;
+
+    if (VIR_ALLOC_N(data, datalen) < 0)
+        goto cleanup;
+    for (i = 0; i < datalen; i++)
+        data[i] = 'a' + (i % 7);
+
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 0x01;
+    msg->header.proc = 0x666;
+    msg->header.type = VIR_NET_REPLY;
+    msg->header.serial = 0x99;
+    msg->header.status = VIR_NET_OK;
+
+    virNetMessageCompressionSetThreshold(1024);
+
+    if (virNetMessageEncodeHeader(msg) < 0 ||
+        virNetMessageEncodePayloadRaw(msg, data, datalen) < 0 ||
+        virNetMessageCompressPayload(msg) < 0)
+        goto cleanup;
+
+    if (msg->header.type != VIR_NET_REPLY_COMPRESSED) {
+        VIR_DEBUG("Expected compressed reply, got type %d", msg->header.type);
+        goto cleanup;
+    }
+
+    if (msg->bufferLength >= datalen) {
+        VIR_DEBUG("Compressed message of %zu bytes is not smaller",
+                  msg->bufferLength);
+        goto cleanup;
+    }
+
+    /* Receive it the way virNetClient does */
+    rx->bufferLength = 4;
+    if (VIR_ALLOC_N(rx->buffer, rx->bufferLength) < 0)
+        goto cleanup;
+    memcpy(rx->buffer, msg->buffer, rx->bufferLength);
+
+    if (virNetMessageDecodeLength(rx) < 0)
+        goto cleanup;
+    memcpy(rx->buffer, msg->buffer, rx->bufferLength);
+
+    if (virNetMessageDecodeHeader(rx) < 0 ||
+        virNetMessageDecompressPayload(rx) < 0)
+        goto cleanup;
+
+    if (rx->header.type != VIR_NET_REPLY ||
+        rx->header.serial != 0x99 ||
+        rx->bufferLength - rx->bufferOffset != datalen ||
+        memcmp(rx->buffer + rx->bufferOffset, data, datalen) != 0) {
+        VIR_DEBUG("Decompressed payload does not match");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virNetMessageCompressionSetThreshold(0);
+    virNetMessageFree(msg);
+    virNetMessageFree(rx);
+    VIR_FREE(data);
+    return ret;
+}
+#endif /* WITH_LZ4 */
+
 
 static int
 mymain(void)
@@ -544,6 +784,17 @@ mymain(void)
     if (virTestRun("Message Payload Stream Encode", testMessagePayloadStreamEncode, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Message Payload Stream Encode Ref", testMessagePayloadStreamEncodeRef, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Message Pool", testMessagePool, NULL) < 0)
+        ret = -1;
+
+#if WITH_LZ4
+    if (virTestRun("Message Compression", testMessageCompression, NULL) < 0)
+        ret = -1;
+#endif
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
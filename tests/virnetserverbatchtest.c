@@ -0,0 +1,433 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include "testutils.h"
+#include "virerror.h"
+#include "viralloc.h"
+#include "virlog.h"
+#include "virthread.h"
+#include "rpc/virnetserver.h"
+#include "rpc/virnetserverprogram.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+VIR_LOG_INIT("tests.netserverbatchtest");
+
+#ifdef HAVE_SOCKETPAIR
+
+# define TEST_WORKERS 2
+
+static virNetServerPtr srv;
+static virNetServerClientPtr client;
+
+
+static void *
+testClientNew(virNetServerClientPtr c ATTRIBUTE_UNUSED,
+              void *opaque ATTRIBUTE_UNUSED)
+{
+    char *dummy;
+
+    if (VIR_ALLOC(dummy) < 0)
+        return NULL;
+
+    return dummy;
+}
+
+
+static void
+testClientFree(void *opaque)
+{
+    VIR_FREE(opaque);
+}
+
+
+struct testParallelData {
+    virMutex lock;
+    virCond cond;
+    bool block;         /* Items wait for this to be cleared */
+    size_t nrunning;    /* Items which have started */
+    size_t nitems;
+    size_t *runs;       /* How many times each item ran */
+};
+
+
+static int
+testParallelDataInit(struct testParallelData *data,
+                     size_t nitems,
+                     bool block)
+{
+    memset(data, 0, sizeof(*data));
+
+    if (virMutexInit(&data->lock) < 0)
+        return -1;
+    if (virCondInit(&data->cond) < 0) {
+        virMutexDestroy(&data->lock);
+        return -1;
+    }
+    if (VIR_ALLOC_N(data->runs, nitems) < 0) {
+        virCondDestroy(&data->cond);
+        virMutexDestroy(&data->lock);
+        return -1;
+    }
+
+    data->nitems = nitems;
+    data->block = block;
+    return 0;
+}
+
+
+static void
+testParallelDataClear(struct testParallelData *data)
+{
+    VIR_FREE(data->runs);
+    virCondDestroy(&data->cond);
+    virMutexDestroy(&data->lock);
+}
+
+
+static void
+testParallelItem(size_t item,
+                 void *opaque)
+{
+    struct testParallelData *data = opaque;
+
+    virMutexLock(&data->lock);
+    data->runs[item]++;
+    data->nrunning++;
+    virCondBroadcast(&data->cond);
+    while (data->block)
+        ignore_value(virCondWait(&data->cond, &data->lock));
+    virMutexUnlock(&data->lock);
+}
+
+
+/* Every item has to be run exactly once */
+static int
+testParallelCheck(struct testParallelData *data)
+{
+    size_t i;
+
+    for (i = 0; i < data->nitems; i++) {
+        if (data->runs[i] != 1) {
+            VIR_TEST_DEBUG("Item %zu ran %zu times\n", i, data->runs[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+testParallelManyItems(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testParallelData data;
+    int ret = -1;
+
+    if (testParallelDataInit(&data, TEST_WORKERS * 25, false) < 0)
+        return -1;
+
+    if (virNetServerRunParallel(srv, client, data.nitems,
+                                testParallelItem, &data) < 0)
+        goto cleanup;
+
+    ret = testParallelCheck(&data);
+
+ cleanup:
+    testParallelDataClear(&data);
+    return ret;
+}
+
+
+static void
+testParallelBlockerThread(void *opaque)
+{
+    struct testParallelData *data = opaque;
+
+    ignore_value(virNetServerRunParallel(srv, client, data->nitems,
+                                         testParallelItem, data));
+}
+
+
+/*
+ * Occupy all the workers with items which don't finish until told
+ * so, and check that another caller still gets all its items done.
+ */
+static int
+testParallelBusyPool(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testParallelData blocker;
+    struct testParallelData data;
+    virThread thread;
+    int ret = -1;
+
+    if (testParallelDataInit(&blocker, TEST_WORKERS + 1, true) < 0)
+        return -1;
+    if (testParallelDataInit(&data, TEST_WORKERS * 5, false) < 0) {
+        testParallelDataClear(&blocker);
+        return -1;
+    }
+
+    if (virThreadCreate(&thread, true, testParallelBlockerThread,
+                        &blocker) < 0)
+        goto cleanup;
+
+    /* One item is run by the thread itself, the others by workers */
+    virMutexLock(&blocker.lock);
+    while (blocker.nrunning < blocker.nitems)
+        ignore_value(virCondWait(&blocker.cond, &blocker.lock));
+    virMutexUnlock(&blocker.lock);
+
+    if (virNetServerRunParallel(srv, client, data.nitems,
+                                testParallelItem, &data) == 0)
+        ret = testParallelCheck(&data);
+
+    virMutexLock(&blocker.lock);
+    blocker.block = false;
+    virCondBroadcast(&blocker.cond);
+    virMutexUnlock(&blocker.lock);
+    virThreadJoin(&thread);
+
+    if (testParallelCheck(&blocker) < 0)
+        ret = -1;
+
+ cleanup:
+    testParallelDataClear(&data);
+    testParallelDataClear(&blocker);
+    return ret;
+}
+
+
+enum {
+    TEST_PROC_DOUBLE = 1,
+    TEST_PROC_FAIL = 2,
+    TEST_PROC_NO_BATCH = 3,
+    TEST_PROC_UNKNOWN = 4,
+};
+
+static int
+testProcDouble(virNetServerPtr server ATTRIBUTE_UNUSED,
+               virNetServerClientPtr c ATTRIBUTE_UNUSED,
+               virNetMessagePtr msg ATTRIBUTE_UNUSED,
+               virNetMessageErrorPtr rerr ATTRIBUTE_UNUSED,
+               void *args,
+               void *ret)
+{
+    *(int *)ret = *(int *)args * 2;
+    return 0;
+}
+
+
+static int
+testProcFail(virNetServerPtr server ATTRIBUTE_UNUSED,
+             virNetServerClientPtr c ATTRIBUTE_UNUSED,
+             virNetMessagePtr msg ATTRIBUTE_UNUSED,
+             virNetMessageErrorPtr rerr,
+             void *args ATTRIBUTE_UNUSED,
+             void *ret ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_NO_DOMAIN, "%s",
+                   _("no domain with matching id"));
+    virNetMessageSaveError(rerr);
+    return -1;
+}
+
+
+static virNetServerProgramProc testProcs[] = {
+    [TEST_PROC_DOUBLE] = {
+        .func = testProcDouble,
+        .arg_len = sizeof(int), .arg_filter = (xdrproc_t)xdr_int,
+        .ret_len = sizeof(int), .ret_filter = (xdrproc_t)xdr_int,
+        .needAuth = true, .batch = true,
+    },
+    [TEST_PROC_FAIL] = {
+        .func = testProcFail,
+        .arg_len = sizeof(int), .arg_filter = (xdrproc_t)xdr_int,
+        .ret_len = sizeof(int), .ret_filter = (xdrproc_t)xdr_int,
+        .needAuth = true, .batch = true,
+    },
+    [TEST_PROC_NO_BATCH] = {
+        .func = testProcDouble,
+        .arg_len = sizeof(int), .arg_filter = (xdrproc_t)xdr_int,
+        .ret_len = sizeof(int), .ret_filter = (xdrproc_t)xdr_int,
+        .needAuth = true, .batch = false,
+    },
+};
+
+
+struct testBatchCallData {
+    int procedure;
+    int arg;
+    size_t maxdata;
+    int status;         /* Expected status */
+    int result;         /* Expected result or error code */
+};
+
+
+static int
+testBatchCall(const void *opaque)
+{
+    const struct testBatchCallData *data = opaque;
+    virNetServerProgramPtr prog;
+    char *args = NULL;
+    size_t nargs = 0;
+    char *result = NULL;
+    size_t nresult = 0;
+    int value = 0;
+    virNetMessageError rerr;
+    int rc;
+    int ret = -1;
+
+    memset(&rerr, 0, sizeof(rerr));
+
+    if (!(prog = virNetServerProgramNew(0x11223344, 1, testProcs,
+                                        ARRAY_CARDINALITY(testProcs))))
+        return -1;
+
+    if (virNetMessageEncodeData((xdrproc_t)xdr_int, (void *)&data->arg,
+                                &args, &nargs) < 0)
+        goto cleanup;
+
+    rc = virNetServerProgramDispatchBatchCall(prog, srv, client,
+                                              data->procedure,
+                                              args, nargs,
+                                              data->maxdata,
+                                              &result, &nresult);
+    virResetLastError();
+
+    if (rc != data->status) {
+        VIR_TEST_DEBUG("Expected status %d, got %d\n", data->status, rc);
+        goto cleanup;
+    }
+
+    if (rc == VIR_NET_OK) {
+        if (virNetMessageDecodeData((xdrproc_t)xdr_int, &value,
+                                    result, nresult) < 0)
+            goto cleanup;
+        if (value != data->result) {
+            VIR_TEST_DEBUG("Expected result %d, got %d\n",
+                           data->result, value);
+            goto cleanup;
+        }
+    } else {
+        if (virNetMessageDecodeData((xdrproc_t)xdr_virNetMessageError, &rerr,
+                                    result, nresult) < 0)
+            goto cleanup;
+        if (rerr.code != data->result) {
+            VIR_TEST_DEBUG("Expected error %d, got %d\n",
+                           data->result, rerr.code);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    xdr_free((xdrproc_t)xdr_virNetMessageError, (void *)&rerr);
+    VIR_FREE(args);
+    VIR_FREE(result);
+    virObjectUnref(prog);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    int sv[2] = { -1, -1 };
+    virNetSocketPtr sock = NULL;
+
+    virEventRegisterDefaultImpl();
+
+    if (!(srv = virNetServerNew("test", 1, TEST_WORKERS, TEST_WORKERS, 0,
+                                10, 10, -1, 0, NULL,
+                                testClientNew, NULL, testClientFree, NULL)))
+        return EXIT_FAILURE;
+
+    if (socketpair(PF_UNIX, SOCK_STREAM, 0, sv) < 0 ||
+        virNetSocketNewConnectSockFD(sv[0], &sock) < 0) {
+        VIR_FORCE_CLOSE(sv[0]);
+        ret = -1;
+        goto cleanup;
+    }
+    sv[0] = -1;
+
+    if (!(client = virNetServerClientNew(1, sock, 0, false, 1,
+# ifdef WITH_GNUTLS
+                                         NULL,
+# endif
+                                         testClientNew,
+                                         NULL,
+                                         testClientFree,
+                                         NULL))) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (virTestRun("Parallel more items than workers",
+                   testParallelManyItems, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Parallel without free workers",
+                   testParallelBusyPool, NULL) < 0)
+        ret = -1;
+
+# define DO_TEST_BATCH_CALL(name, procedure, arg, maxdata, status, result) \
+    do { \
+        struct testBatchCallData data = { \
+            procedure, arg, maxdata, status, result \
+        }; \
+        if (virTestRun("Batch call " name, testBatchCall, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_BATCH_CALL("ok", TEST_PROC_DOUBLE, 21, 1024,
+                       VIR_NET_OK, 42);
+    DO_TEST_BATCH_CALL("error", TEST_PROC_FAIL, 21, 1024,
+                       VIR_NET_ERROR, VIR_ERR_NO_DOMAIN);
+    DO_TEST_BATCH_CALL("not batchable", TEST_PROC_NO_BATCH, 21, 1024,
+                       VIR_NET_ERROR, VIR_ERR_OPERATION_UNSUPPORTED);
+    DO_TEST_BATCH_CALL("unknown", TEST_PROC_UNKNOWN, 21, 1024,
+                       VIR_NET_ERROR, VIR_ERR_RPC);
+    DO_TEST_BATCH_CALL("reply too large", TEST_PROC_DOUBLE, 21, 2,
+                       VIR_NET_ERROR, VIR_ERR_RPC);
+
+ cleanup:
+    if (ret < 0)
+        virDispatchError(NULL);
+    virNetServerClientClose(client);
+    virObjectUnref(client);
+    virObjectUnref(sock);
+    virObjectUnref(srv);
+    VIR_FORCE_CLOSE(sv[1]);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#else
+static int
+mymain(void)
+{
+    return EXIT_AM_SKIP;
+}
+#endif
+
+VIR_TEST_MAIN(mymain)
@@ -161,6 +161,146 @@ static int testIdentity(const void *opaque ATTRIBUTE_UNUSED)
 }
 
 
+/*
+ * Queue a message of @type for @client, which is never drained as
+ * nothing runs the event loop, and check what became of it.
+ *
+ * Returns the result of virNetServerClientSendMessage.
+ */
+static int
+testTxSend(virNetServerClientPtr client,
+           virNetMessageType type,
+           const char *coalesceKey)
+{
+    virNetMessagePtr msg;
+    int rc;
+
+    if (!(msg = virNetMessageNew(false)))
+        return -2;
+
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 1;
+    msg->header.proc = 7;
+    msg->header.type = type;
+    msg->header.serial = 1;
+    msg->header.status = VIR_NET_OK;
+
+    if (VIR_STRDUP(msg->coalesceKey, coalesceKey) < 0 ||
+        virNetMessageEncodeHeader(msg) < 0) {
+        virNetMessageFree(msg);
+        return -2;
+    }
+
+    if ((rc = virNetServerClientSendMessage(client, msg)) < 0)
+        virNetMessageFree(msg);
+
+    return rc;
+}
+
+
+static int
+testTxStats(virNetServerClientPtr client,
+            size_t messages,
+            unsigned long long coalesced,
+            unsigned long long dropped)
+{
+    virNetServerClientTxStats stats;
+
+    virNetServerClientGetTxStats(client, &stats);
+    if (stats.messages != messages ||
+        stats.coalesced != coalesced ||
+        stats.dropped != dropped) {
+        VIR_TEST_DEBUG("Expected messages=%zu coalesced=%llu dropped=%llu, "
+                       "got messages=%zu coalesced=%llu dropped=%llu\n",
+                       messages, coalesced, dropped,
+                       stats.messages, stats.coalesced, stats.dropped);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int testTxLimits(const void *opaque ATTRIBUTE_UNUSED)
+{
+    int sv[2];
+    int ret = -1;
+    virNetSocketPtr sock = NULL;
+    virNetServerClientPtr client = NULL;
+    bool wantClose;
+
+    if (socketpair(PF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        virReportSystemError(errno, "%s",
+                             "Cannot create socket pair");
+        return -1;
+    }
+
+    if (virNetSocketNewConnectSockFD(sv[0], &sock) < 0) {
+        virDispatchError(NULL);
+        goto cleanup;
+    }
+    sv[0] = -1;
+
+    if (!(client = virNetServerClientNew(1, sock, 0, false, 1,
+# ifdef WITH_GNUTLS
+                                         NULL,
+# endif
+                                         testClientNew,
+                                         NULL,
+                                         testClientFree,
+                                         NULL))) {
+        virDispatchError(NULL);
+        goto cleanup;
+    }
+
+    virNetServerClientSetTxLimits(client, 2, 0);
+
+    if (testTxSend(client, VIR_NET_MESSAGE, "one") != 0 ||
+        testTxSend(client, VIR_NET_MESSAGE, "two") != 0 ||
+        testTxStats(client, 2, 0, 0) < 0)
+        goto cleanup;
+
+    /* A newer event replaces the queued one with the same key */
+    if (testTxSend(client, VIR_NET_MESSAGE, "two") != 0 ||
+        testTxStats(client, 2, 1, 0) < 0)
+        goto cleanup;
+
+    /* The head of the queue may be partially sent already, so an
+     * event superseding it is dropped instead */
+    if (testTxSend(client, VIR_NET_MESSAGE, "one") != 0 ||
+        testTxSend(client, VIR_NET_MESSAGE, "three") != 0 ||
+        testTxStats(client, 2, 1, 2) < 0)
+        goto cleanup;
+
+    /* Replies are not subject to the limits */
+    if (testTxSend(client, VIR_NET_REPLY, NULL) != 0 ||
+        testTxStats(client, 3, 1, 2) < 0)
+        goto cleanup;
+
+    /* Other events get the client closed */
+    if (testTxSend(client, VIR_NET_MESSAGE, NULL) != -1)
+        goto cleanup;
+
+    virObjectLock(client);
+    wantClose = virNetServerClientWantCloseLocked(client);
+    virObjectUnlock(client);
+    if (!wantClose) {
+        VIR_TEST_DEBUG("Client was not marked for closing\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(sock);
+    if (client)
+        virNetServerClientClose(client);
+    virObjectUnref(client);
+    VIR_FORCE_CLOSE(sv[0]);
+    VIR_FORCE_CLOSE(sv[1]);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -171,6 +311,10 @@ mymain(void)
                    testIdentity, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Transmit limits",
+                   testTxLimits, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 VIR_TEST_MAIN_PRELOAD(mymain, abs_builddir "/.libs/virnetserverclientmock.so")
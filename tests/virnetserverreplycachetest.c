@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include "testutils.h"
+#include "virerror.h"
+#include "viralloc.h"
+#include "virlog.h"
+#include "virstring.h"
+#include "rpc/virnetserverreplycache.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+VIR_LOG_INIT("tests.netserverreplycachetest");
+
+struct testScope {
+    const char *scope;
+    unsigned long long generation;
+    int procedure;
+};
+
+
+static int
+testScopeFunc(virNetServerClientPtr client ATTRIBUTE_UNUSED,
+              int procedure,
+              char **scope,
+              unsigned long long *generation,
+              void *opaque)
+{
+    struct testScope *data = opaque;
+
+    if (procedure != data->procedure)
+        return 0;
+
+    *generation = data->generation;
+    return VIR_STRDUP(*scope, data->scope) < 0 ? -1 : 1;
+}
+
+
+/*
+ * Look up the reply of a call with @args, expecting it to be
+ * @expect or a miss if that is NULL.
+ */
+static int
+testLookup(virNetServerReplyCachePtr cache,
+           int procedure,
+           const char *args,
+           const char *expect)
+{
+    virNetMessagePtr msg = NULL;
+    char *key = NULL;
+    unsigned long long generation;
+    int rc;
+    int ret = -1;
+
+    if (virNetServerReplyCacheGetKey(cache, NULL, procedure,
+                                     args, strlen(args),
+                                     &key, &generation) != 1)
+        goto cleanup;
+
+    if (!(msg = virNetMessageNew(false)))
+        goto cleanup;
+
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 0x01;
+    msg->header.proc = procedure;
+    msg->header.type = VIR_NET_CALL;
+    msg->header.serial = 0x99;
+    msg->header.status = VIR_NET_OK;
+
+    if ((rc = virNetServerReplyCacheLookup(cache, key, generation, msg)) < 0)
+        goto cleanup;
+
+    if (!expect) {
+        if (rc != 0) {
+            VIR_DEBUG("Expected a miss for '%s'", args);
+            goto cleanup;
+        }
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (rc != 1) {
+        VIR_DEBUG("Expected a hit for '%s'", args);
+        goto cleanup;
+    }
+
+    if (msg->header.type != VIR_NET_REPLY ||
+        msg->bufferLength != VIR_NET_MESSAGE_HEADER_XDR_LEN +
+                             VIR_NET_MESSAGE_HEADER_MAX + strlen(expect) ||
+        memcmp(msg->buffer + msg->bufferLength - strlen(expect),
+               expect, strlen(expect)) != 0) {
+        VIR_DEBUG("Unexpected reply for '%s'", args);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(key);
+    virNetMessageFree(msg);
+    return ret;
+}
+
+
+static int
+testStore(virNetServerReplyCachePtr cache,
+          int procedure,
+          const char *args,
+          const char *reply)
+{
+    char *key = NULL;
+    unsigned long long generation;
+    int ret = -1;
+
+    if (virNetServerReplyCacheGetKey(cache, NULL, procedure,
+                                     args, strlen(args),
+                                     &key, &generation) != 1)
+        goto cleanup;
+
+    ret = virNetServerReplyCacheStore(cache, key, generation,
+                                      reply, strlen(reply));
+
+ cleanup:
+    VIR_FREE(key);
+    return ret;
+}
+
+
+static int
+testReplyCache(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testScope data = { "test:///default", 1, 7 };
+    virNetServerReplyCachePtr cache;
+    char *key = NULL;
+    unsigned long long generation;
+    int ret = -1;
+
+    if (!(cache = virNetServerReplyCacheNew(2, 60, testScopeFunc,
+                                            &data, NULL)))
+        return -1;
+
+    /* Other procedures never get a key */
+    if (virNetServerReplyCacheGetKey(cache, NULL, 8, "", 0,
+                                     &key, &generation) != 0 || key)
+        goto cleanup;
+
+    if (testLookup(cache, 7, "one", NULL) < 0 ||
+        testStore(cache, 7, "one", "reply-one") < 0 ||
+        testLookup(cache, 7, "one", "reply-one") < 0 ||
+        testLookup(cache, 7, "two", NULL) < 0)
+        goto cleanup;
+
+    /* Replies are not shared between scopes */
+    data.scope = "test:///other";
+    if (testLookup(cache, 7, "one", NULL) < 0)
+        goto cleanup;
+    data.scope = "test:///default";
+
+    /* The cache is full, and everything in it is still valid */
+    if (testStore(cache, 7, "two", "reply-two") < 0 ||
+        testStore(cache, 7, "three", "reply-three") < 0 ||
+        testLookup(cache, 7, "three", NULL) < 0 ||
+        testLookup(cache, 7, "two", "reply-two") < 0)
+        goto cleanup;
+
+    /* Moving to the next generation makes old replies useless,
+     * and lets new ones replace them */
+    data.generation++;
+    if (testLookup(cache, 7, "one", NULL) < 0 ||
+        testStore(cache, 7, "three", "reply-three") < 0 ||
+        testLookup(cache, 7, "three", "reply-three") < 0)
+        goto cleanup;
+
+    virNetServerReplyCacheFlush(cache);
+    if (testLookup(cache, 7, "three", NULL) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(key);
+    virObjectUnref(cache);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("Reply Cache", testReplyCache, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+
+#include "testutils.h"
+#include "virerror.h"
+#include "viralloc.h"
+#include "virlog.h"
+#include "virtypedparam.h"
+#include "rpc/virnetserver.h"
+#include "rpc/virnetserverprogrampriv.h"
+#include "admin/admin_server.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+VIR_LOG_INIT("tests.netserverstatstest");
+
+#define TEST_PROGRAM 0x11223344
+#define TEST_BUCKETS VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS
+
+static virNetServerProgramProc testProcs[] = {
+    { .name = "first" },
+    { .name = "second" },
+    { .name = NULL },
+};
+
+
+static virNetServerProgramPtr
+testProgramNew(void)
+{
+    return virNetServerProgramNew(TEST_PROGRAM, 1, testProcs,
+                                  ARRAY_CARDINALITY(testProcs));
+}
+
+
+static int
+testCheckBucket(unsigned long long latency,
+                size_t expect)
+{
+    size_t bucket = virNetServerProgramLatencyBucket(latency);
+
+    if (bucket != expect) {
+        VIR_TEST_DEBUG("Expected latency %llu in bucket %zu, got %zu\n",
+                       latency, expect, bucket);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testLatencyBucket(const void *opaque ATTRIBUTE_UNUSED)
+{
+    size_t i;
+
+    if (testCheckBucket(0, 0) < 0)
+        return -1;
+
+    for (i = 1; i < TEST_BUCKETS - 1; i++) {
+        if (testCheckBucket(1ULL << (i - 1), i) < 0 ||
+            testCheckBucket((1ULL << i) - 1, i) < 0)
+            return -1;
+    }
+
+    if (testCheckBucket(1ULL << (TEST_BUCKETS - 2), TEST_BUCKETS - 1) < 0 ||
+        testCheckBucket(1ULL << (TEST_BUCKETS - 1), TEST_BUCKETS - 1) < 0 ||
+        testCheckBucket(ULLONG_MAX, TEST_BUCKETS - 1) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+struct testStatsData {
+    int procedure;
+    const char *name;
+    unsigned long long calls;
+    unsigned long long waitTotal;
+    unsigned long long execTotal;
+    /* Buckets which aren't listed must be empty */
+    unsigned long long wait[TEST_BUCKETS];
+    unsigned long long exec[TEST_BUCKETS];
+};
+
+
+static int
+testCheckStats(virNetServerProgramProcStatsPtr stats,
+               size_t nstats,
+               const struct testStatsData *expect,
+               size_t nexpect)
+{
+    size_t i;
+    size_t j;
+
+    if (nstats != nexpect) {
+        VIR_TEST_DEBUG("Expected %zu procedures, got %zu\n", nexpect, nstats);
+        return -1;
+    }
+
+    for (i = 0; i < nstats; i++) {
+        if (stats[i].program != TEST_PROGRAM ||
+            stats[i].procedure != expect[i].procedure ||
+            STRNEQ_NULLABLE(stats[i].name, expect[i].name)) {
+            VIR_TEST_DEBUG("Expected procedure %d '%s', got %x:%d '%s'\n",
+                           expect[i].procedure, NULLSTR(expect[i].name),
+                           stats[i].program, stats[i].procedure,
+                           NULLSTR(stats[i].name));
+            return -1;
+        }
+
+        if (stats[i].calls != expect[i].calls ||
+            stats[i].waitTotal != expect[i].waitTotal ||
+            stats[i].execTotal != expect[i].execTotal) {
+            VIR_TEST_DEBUG("Expected %llu calls waiting %llu and running "
+                           "%llu, got %llu calls waiting %llu and running "
+                           "%llu\n", expect[i].calls, expect[i].waitTotal,
+                           expect[i].execTotal, stats[i].calls,
+                           stats[i].waitTotal, stats[i].execTotal);
+            return -1;
+        }
+
+        for (j = 0; j < TEST_BUCKETS; j++) {
+            if (stats[i].wait[j] != expect[i].wait[j] ||
+                stats[i].exec[j] != expect[i].exec[j]) {
+                VIR_TEST_DEBUG("Expected bucket %zu of procedure %d to be "
+                               "%llu/%llu, got %llu/%llu\n",
+                               j, expect[i].procedure,
+                               expect[i].wait[j], expect[i].exec[j],
+                               stats[i].wait[j], stats[i].exec[j]);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+testRecordCall(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virNetServerProgramPtr prog;
+    virNetServerProgramProcStatsPtr stats = NULL;
+    size_t nstats = 0;
+    struct testStatsData expect[] = {
+        { .procedure = 0, .name = "first",
+          .calls = 3, .waitTotal = 10, .execTotal = 40,
+          .wait = { [0] = 2, [4] = 1 }, .exec = { [0] = 2, [6] = 1 } },
+        { .procedure = 1, .name = "second",
+          .calls = 1, .waitTotal = 1, .execTotal = 1,
+          .wait = { [1] = 1 }, .exec = { [1] = 1 } },
+    };
+    int ret = -1;
+
+    if (!(prog = testProgramNew()))
+        return -1;
+
+    virNetServerProgramRecordCall(prog, 0, 100, 110, 150);
+    /* Calls not read from a client have no receive time */
+    virNetServerProgramRecordCall(prog, 0, 0, 200, 200);
+    /* The clock went backwards */
+    virNetServerProgramRecordCall(prog, 0, 300, 250, 240);
+    virNetServerProgramRecordCall(prog, 1, 1, 2, 3);
+    /* Unknown procedures are ignored */
+    virNetServerProgramRecordCall(prog, -1, 1, 2, 3);
+    virNetServerProgramRecordCall(prog, ARRAY_CARDINALITY(testProcs), 1, 2, 3);
+
+    if (virNetServerProgramGetProcStats(prog, &stats, &nstats) < 0)
+        goto cleanup;
+
+    if (testCheckStats(stats, nstats, expect, ARRAY_CARDINALITY(expect)) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(stats);
+    virObjectUnref(prog);
+    return ret;
+}
+
+
+static virNetServerPtr
+testServerNew(virNetServerProgramPtr *prog)
+{
+    virNetServerPtr srv;
+
+    if (!(*prog = testProgramNew()))
+        return NULL;
+
+    if (!(srv = virNetServerNew("test", 1, 1, 1, 0, 10, 10, -1, 0, NULL,
+                                NULL, NULL, NULL, NULL)))
+        return NULL;
+
+    if (virNetServerAddProgram(srv, *prog) < 0) {
+        virObjectUnref(srv);
+        return NULL;
+    }
+
+    return srv;
+}
+
+
+static int
+testResetStats(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virNetServerPtr srv = NULL;
+    virNetServerProgramPtr prog = NULL;
+    virNetServerProgramProcStatsPtr stats = NULL;
+    size_t nstats = 0;
+    virNetServerProgramProcStatsPtr after = NULL;
+    size_t nafter = 0;
+    struct testStatsData expect[] = {
+        { .procedure = 1, .name = "second",
+          .calls = 1, .waitTotal = 10, .execTotal = 40,
+          .wait = { [4] = 1 }, .exec = { [6] = 1 } },
+    };
+    int ret = -1;
+
+    if (!(srv = testServerNew(&prog)))
+        goto cleanup;
+
+    virNetServerProgramRecordCall(prog, 0, 1, 2, 3);
+    virNetServerProgramRecordCall(prog, 1, 1, 2, 3);
+
+    if (virNetServerGetProcStats(srv, &stats, &nstats) < 0)
+        goto cleanup;
+
+    if (nstats != 2) {
+        VIR_TEST_DEBUG("Expected 2 procedures, got %zu\n", nstats);
+        goto cleanup;
+    }
+
+    /* A call finishing between reading and resetting must be kept */
+    virNetServerProgramRecordCall(prog, 1, 100, 110, 150);
+    virNetServerResetProcStats(srv, stats, nstats);
+
+    if (virNetServerGetProcStats(srv, &after, &nafter) < 0)
+        goto cleanup;
+
+    if (testCheckStats(after, nafter, expect, ARRAY_CARDINALITY(expect)) < 0)
+        goto cleanup;
+
+    virNetServerResetProcStats(srv, after, nafter);
+    VIR_FREE(after);
+
+    if (virNetServerGetProcStats(srv, &after, &nafter) < 0)
+        goto cleanup;
+
+    if (nafter != 0) {
+        VIR_TEST_DEBUG("Expected cleared statistics, got %zu procedures\n",
+                       nafter);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(stats);
+    VIR_FREE(after);
+    virObjectUnref(prog);
+    virObjectUnref(srv);
+    return ret;
+}
+
+
+struct testParamData {
+    const char *field;
+    int type;
+    unsigned long long value;
+    const char *str;
+};
+
+
+static int
+testAdminCallStats(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virNetServerPtr srv = NULL;
+    virNetServerProgramPtr prog = NULL;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    virNetServerProgramProcStatsPtr stats = NULL;
+    size_t nstats = 0;
+    struct testParamData expect[] = {
+        { VIR_CALL_STATS_COUNT, VIR_TYPED_PARAM_UINT, 2, NULL },
+        { VIR_CALL_STATS_BUCKETS, VIR_TYPED_PARAM_UINT, TEST_BUCKETS, NULL },
+        { "call.0.program", VIR_TYPED_PARAM_UINT, TEST_PROGRAM, NULL },
+        { "call.0.procedure", VIR_TYPED_PARAM_UINT, 0, NULL },
+        { "call.0.name", VIR_TYPED_PARAM_STRING, 0, "first" },
+        { "call.0.calls", VIR_TYPED_PARAM_ULLONG, 1, NULL },
+        { "call.0.wait.total", VIR_TYPED_PARAM_ULLONG, 10, NULL },
+        { "call.0.wait.bucket.4", VIR_TYPED_PARAM_ULLONG, 1, NULL },
+        { "call.0.exec.total", VIR_TYPED_PARAM_ULLONG, 40, NULL },
+        { "call.0.exec.bucket.6", VIR_TYPED_PARAM_ULLONG, 1, NULL },
+        { "call.1.program", VIR_TYPED_PARAM_UINT, TEST_PROGRAM, NULL },
+        { "call.1.procedure", VIR_TYPED_PARAM_UINT, 2, NULL },
+        { "call.1.calls", VIR_TYPED_PARAM_ULLONG, 2, NULL },
+        { "call.1.wait.total", VIR_TYPED_PARAM_ULLONG, 0, NULL },
+        { "call.1.wait.bucket.0", VIR_TYPED_PARAM_ULLONG, 2, NULL },
+        { "call.1.exec.total", VIR_TYPED_PARAM_ULLONG, 1, NULL },
+        { "call.1.exec.bucket.0", VIR_TYPED_PARAM_ULLONG, 1, NULL },
+        { "call.1.exec.bucket.1", VIR_TYPED_PARAM_ULLONG, 1, NULL },
+    };
+    size_t i;
+    int ret = -1;
+
+    if (!(srv = testServerNew(&prog)))
+        goto cleanup;
+
+    virNetServerProgramRecordCall(prog, 0, 100, 110, 150);
+    virNetServerProgramRecordCall(prog, 2, 0, 5, 5);
+    virNetServerProgramRecordCall(prog, 2, 0, 5, 6);
+
+    if (adminServerGetCallStats(srv, &params, &nparams,
+                                &stats, &nstats, 0) < 0)
+        goto cleanup;
+
+    if (nstats != 2) {
+        VIR_TEST_DEBUG("Expected 2 procedures, got %zu\n", nstats);
+        goto cleanup;
+    }
+
+    if (nparams != ARRAY_CARDINALITY(expect)) {
+        VIR_TEST_DEBUG("Expected %zu parameters, got %d\n",
+                       ARRAY_CARDINALITY(expect), nparams);
+        goto cleanup;
+    }
+
+    for (i = 0; i < nparams; i++) {
+        virTypedParameterPtr param = &params[i];
+        unsigned long long value = 0;
+
+        if (STRNEQ(param->field, expect[i].field) ||
+            param->type != expect[i].type) {
+            VIR_TEST_DEBUG("Expected parameter '%s' of type %d, "
+                           "got '%s' of type %d\n",
+                           expect[i].field, expect[i].type,
+                           param->field, param->type);
+            goto cleanup;
+        }
+
+        if (param->type == VIR_TYPED_PARAM_STRING) {
+            if (STRNEQ(param->value.s, expect[i].str)) {
+                VIR_TEST_DEBUG("Expected '%s' = '%s', got '%s'\n",
+                               param->field, expect[i].str, param->value.s);
+                goto cleanup;
+            }
+            continue;
+        }
+
+        if (param->type == VIR_TYPED_PARAM_UINT)
+            value = param->value.ui;
+        else
+            value = param->value.ul;
+
+        if (value != expect[i].value) {
+            VIR_TEST_DEBUG("Expected '%s' = %llu, got %llu\n",
+                           param->field, expect[i].value, value);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    VIR_FREE(stats);
+    virObjectUnref(prog);
+    virObjectUnref(srv);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("Latency buckets", testLatencyBucket, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Record calls", testRecordCall, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Reset statistics", testResetStats, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Admin call statistics", testAdminCallStats, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
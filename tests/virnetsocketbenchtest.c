@@ -0,0 +1,310 @@
+/*
+ * virnetsocketbenchtest.c: Compare plain and shared memory socket I/O
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <poll.h>
+#include <time.h>
+
+#include "testutils.h"
+#include "internal.h"
+#include "viralloc.h"
+#include "virfile.h"
+#include "virthread.h"
+#include "vireventpoll.h"
+#include "rpc/virnetsocket.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+/*
+ * Each benchmark connects two sockets, optionally switched to a
+ * shared memory channel, and has a thread at each end.
+ *
+ * The throughput run streams @total bytes one way in chunks of
+ * @chunk bytes and reports MiB/s. The latency run bounces @chunk
+ * bytes back and forth @iterations times and reports the average
+ * round trip time. Both sides sleep in poll() when they can't make
+ * progress, like virNetClient and the event loop do, so doorbells
+ * are part of the measurement.
+ */
+
+struct testBenchData {
+    bool shm;
+    bool pingpong;
+    size_t chunk;
+    size_t total;
+    size_t iterations;
+};
+
+struct testBenchPeer {
+    virNetSocketPtr sock;
+    const struct testBenchData *data;
+    char *buf;
+    int ret;
+};
+
+
+static unsigned long long
+testBenchNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static int
+testBenchWait(virNetSocketPtr sock,
+              int events)
+{
+    struct pollfd fd;
+    int revents;
+
+    fd.fd = virNetSocketGetFD(sock);
+
+    for (;;) {
+        revents = virNetSocketGetWireEvents(sock, events);
+        fd.events = virEventPollToNativeEvents(revents);
+        fd.revents = 0;
+
+        if (poll(&fd, 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        revents = virEventPollFromNativeEvents(fd.revents);
+        if ((revents = virNetSocketGetReadyEvents(sock, events, revents)))
+            return revents;
+    }
+}
+
+
+static int
+testBenchWrite(virNetSocketPtr sock,
+               const char *buf,
+               size_t len)
+{
+    ssize_t rv;
+
+    while (len) {
+        if ((rv = virNetSocketWrite(sock, buf, len)) < 0)
+            return -1;
+        if (rv == 0 &&
+            testBenchWait(sock, VIR_EVENT_HANDLE_WRITABLE) < 0)
+            return -1;
+        buf += rv;
+        len -= rv;
+    }
+
+    return 0;
+}
+
+
+static int
+testBenchRead(virNetSocketPtr sock,
+              char *buf,
+              size_t len)
+{
+    ssize_t rv;
+
+    while (len) {
+        if ((rv = virNetSocketRead(sock, buf, len)) < 0)
+            return -1;
+        if (rv == 0 &&
+            testBenchWait(sock, VIR_EVENT_HANDLE_READABLE) < 0)
+            return -1;
+        buf += rv;
+        len -= rv;
+    }
+
+    return 0;
+}
+
+
+static void
+testBenchServer(void *opaque)
+{
+    struct testBenchPeer *peer = opaque;
+    const struct testBenchData *data = peer->data;
+    size_t i;
+
+    peer->ret = -1;
+
+    if (data->pingpong) {
+        for (i = 0; i < data->iterations; i++) {
+            if (testBenchRead(peer->sock, peer->buf, data->chunk) < 0 ||
+                testBenchWrite(peer->sock, peer->buf, data->chunk) < 0)
+                return;
+        }
+    } else {
+        for (i = 0; i < data->total; i += data->chunk) {
+            if (testBenchRead(peer->sock, peer->buf, data->chunk) < 0)
+                return;
+        }
+        /* Let the client know all data arrived */
+        if (testBenchWrite(peer->sock, peer->buf, 1) < 0)
+            return;
+    }
+
+    peer->ret = 0;
+}
+
+
+static int
+testBench(const void *opaque)
+{
+    const struct testBenchData *data = opaque;
+    struct testBenchPeer server = { NULL, data, NULL, -1 };
+    virNetSocketPtr csock = NULL;
+    virNetShmChannelPtr schan = NULL;
+    virNetShmChannelPtr cchan = NULL;
+    virThread thread;
+    bool haveThread = false;
+    unsigned long long start, end;
+    char *buf = NULL;
+    int sv[2] = { -1, -1 };
+    size_t i;
+    int fd;
+    int ret = -1;
+
+    if (data->shm && !virNetShmChannelIsSupported())
+        return EXIT_AM_SKIP;
+
+    if (VIR_ALLOC_N(buf, data->chunk) < 0 ||
+        VIR_ALLOC_N(server.buf, data->chunk) < 0)
+        goto cleanup;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0 ||
+        virNetSocketNewConnectSockFD(sv[0], &server.sock) < 0)
+        goto cleanup;
+    sv[0] = -1;
+    if (virNetSocketNewConnectSockFD(sv[1], &csock) < 0)
+        goto cleanup;
+    sv[1] = -1;
+
+    if (data->shm) {
+        if (!(schan = virNetShmChannelNew(1024 * 1024)) ||
+            (fd = dup(virNetShmChannelGetFD(schan))) < 0 ||
+            !(cchan = virNetShmChannelOpen(fd)) ||
+            virNetSocketSetShmChannel(server.sock, schan) < 0 ||
+            virNetSocketSetShmChannel(csock, cchan) < 0)
+            goto cleanup;
+    }
+
+    if (virThreadCreate(&thread, true, testBenchServer, &server) < 0)
+        goto cleanup;
+    haveThread = true;
+
+    start = testBenchNow();
+
+    if (data->pingpong) {
+        for (i = 0; i < data->iterations; i++) {
+            if (testBenchWrite(csock, buf, data->chunk) < 0 ||
+                testBenchRead(csock, buf, data->chunk) < 0)
+                goto cleanup;
+        }
+    } else {
+        for (i = 0; i < data->total; i += data->chunk) {
+            if (testBenchWrite(csock, buf, data->chunk) < 0)
+                goto cleanup;
+        }
+        if (testBenchRead(csock, buf, 1) < 0)
+            goto cleanup;
+    }
+
+    end = testBenchNow();
+
+    virThreadJoin(&thread);
+    haveThread = false;
+    if (server.ret < 0)
+        goto cleanup;
+
+    if (data->pingpong)
+        VIR_TEST_VERBOSE("\n%5s %7zu bytes: %8llu ns/round trip\n",
+                         data->shm ? "shm" : "plain", data->chunk,
+                         (end - start) / data->iterations);
+    else
+        VIR_TEST_VERBOSE("\n%5s %7zu bytes: %8llu MiB/s\n",
+                         data->shm ? "shm" : "plain", data->chunk,
+                         data->total * 1000000000ULL /
+                         ((end - start) ? (end - start) : 1) / (1024 * 1024));
+
+    ret = 0;
+ cleanup:
+    /* Closing the client socket makes the server thread fail */
+    virObjectUnref(csock);
+    if (haveThread)
+        virThreadJoin(&thread);
+    virObjectUnref(server.sock);
+    virObjectUnref(schan);
+    virObjectUnref(cchan);
+    VIR_FORCE_CLOSE(sv[0]);
+    VIR_FORCE_CLOSE(sv[1]);
+    VIR_FREE(server.buf);
+    VIR_FREE(buf);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    size_t chunks[] = { 64, 4096, 65536 };
+    size_t i, j;
+    bool expensive = virTestGetExpensive();
+
+    if (virThreadInitialize() < 0)
+        return EXIT_FAILURE;
+
+    for (i = 0; i < ARRAY_CARDINALITY(chunks); i++) {
+        for (j = 0; j < 4; j++) {
+            struct testBenchData data = {
+                .shm = j % 2,
+                .pingpong = j / 2,
+                .chunk = chunks[i],
+                .total = (expensive ? 1024 : 16) * 1024 * 1024,
+                .iterations = expensive ? 100000 : 1000,
+            };
+            char *name = NULL;
+
+            /* Small chunks would only measure the syscall rate */
+            if (!data.pingpong && chunks[i] < 4096)
+                continue;
+
+            if (virAsprintf(&name, "%s %s with %zu bytes",
+                            data.shm ? "shm" : "plain",
+                            data.pingpong ? "latency" : "throughput",
+                            chunks[i]) < 0)
+                return EXIT_FAILURE;
+
+            if (virTestRun(name, testBench, &data) < 0)
+                ret = -1;
+            VIR_FREE(name);
+        }
+    }
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
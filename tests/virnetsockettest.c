@@ -26,6 +26,7 @@
 # include <ifaddrs.h>
 #endif
 #include <netdb.h>
+#include <poll.h>
 
 #include "testutils.h"
 #include "virutil.h"
@@ -36,6 +37,7 @@
 #include "virstring.h"
 
 #include "rpc/virnetsocket.h"
+#include "rpc/virnetprotocol.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -435,6 +437,303 @@ static int testSocketSSH(const void *opaque)
     return ret;
 }
 
+
+static bool
+testSocketShmHasDoorbell(virNetSocketPtr sock)
+{
+    struct pollfd fd = { virNetSocketGetFD(sock), POLLIN, 0 };
+
+    return poll(&fd, 1, 0) == 1 && (fd.revents & POLLIN);
+}
+
+
+/*
+ * Pass data both ways through a shared memory channel set up on a
+ * pair of sockets, filling it and wrapping around, and check the
+ * events the sockets ask to be watched for and report as ready.
+ */
+static int testSocketShm(const void *data ATTRIBUTE_UNUSED)
+{
+    virNetSocketPtr ssock = NULL;
+    virNetSocketPtr csock = NULL;
+    virNetShmChannelPtr schan = NULL;
+    virNetShmChannelPtr cchan = NULL;
+    int sv[2] = { -1, -1 };
+    int pipefd[2] = { -1, -1 };
+    char *in = NULL;
+    char *out = NULL;
+    size_t size = VIR_NET_SHM_CHANNEL_SIZE_MIN;
+    size_t total = size * 2 + size / 3;
+    size_t sent = 0;
+    size_t got = 0;
+    char buf[16];
+    ssize_t rv;
+    size_t i;
+    int fd = -1;
+    int ret = -1;
+
+    if (!virNetShmChannelIsSupported())
+        return EXIT_AM_SKIP;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0 ||
+        pipe(pipefd) < 0)
+        goto cleanup;
+
+    if (virNetSocketNewConnectSockFD(sv[0], &ssock) < 0)
+        goto cleanup;
+    sv[0] = -1;
+    if (virNetSocketNewConnectSockFD(sv[1], &csock) < 0)
+        goto cleanup;
+    sv[1] = -1;
+
+    if (!(schan = virNetShmChannelNew(size)))
+        goto cleanup;
+    if ((fd = dup(virNetShmChannelGetFD(schan))) < 0)
+        goto cleanup;
+    cchan = virNetShmChannelOpen(fd);
+    fd = -1;
+    if (!cchan)
+        goto cleanup;
+
+    if (virNetSocketSetShmChannel(ssock, schan) < 0 ||
+        virNetSocketSetShmChannel(csock, cchan) < 0)
+        goto cleanup;
+
+    /* Setting another channel is refused */
+    if (virNetSocketSetShmChannel(csock, cchan) == 0) {
+        VIR_DEBUG("Second channel was accepted");
+        goto cleanup;
+    }
+
+    /* Nothing to read yet, so only doorbells are waited for */
+    if (virNetSocketGetWireEvents(csock, VIR_EVENT_HANDLE_READABLE) !=
+        VIR_EVENT_HANDLE_READABLE ||
+        virNetSocketRead(csock, buf, sizeof(buf)) != 0) {
+        VIR_DEBUG("Empty channel is not idle");
+        goto cleanup;
+    }
+
+    if (virNetSocketWrite(ssock, "hello", 5) != 5)
+        goto cleanup;
+
+    if (!testSocketShmHasDoorbell(csock) ||
+        virNetSocketGetReadyEvents(csock, VIR_EVENT_HANDLE_READABLE,
+                                   VIR_EVENT_HANDLE_READABLE) !=
+        VIR_EVENT_HANDLE_READABLE) {
+        VIR_DEBUG("Reader was not woken up");
+        goto cleanup;
+    }
+
+    /* Doorbells were drained, but the data is still there */
+    if (testSocketShmHasDoorbell(csock) ||
+        !(virNetSocketGetWireEvents(csock, VIR_EVENT_HANDLE_READABLE) &
+          VIR_EVENT_HANDLE_WRITABLE) ||
+        !virNetSocketHasCachedData(csock)) {
+        VIR_DEBUG("Pending data was not noticed");
+        goto cleanup;
+    }
+
+    if (virNetSocketRead(csock, buf, sizeof(buf)) != 5 ||
+        memcmp(buf, "hello", 5) != 0 ||
+        virNetSocketHasCachedData(csock)) {
+        VIR_DEBUG("Unexpected data read");
+        goto cleanup;
+    }
+
+    /* Push more than fits, in the other direction */
+    if (VIR_ALLOC_N(out, total) < 0 ||
+        VIR_ALLOC_N(in, total) < 0)
+        goto cleanup;
+    for (i = 0; i < total; i++)
+        out[i] = i % 251;
+
+    while (got < total) {
+        if (sent < total) {
+            if ((rv = virNetSocketWrite(csock, out + sent, total - sent)) < 0)
+                goto cleanup;
+            sent += rv;
+
+            if (rv == 0 &&
+                virNetSocketGetWireEvents(csock, VIR_EVENT_HANDLE_WRITABLE) !=
+                VIR_EVENT_HANDLE_READABLE) {
+                VIR_DEBUG("Full channel is not waited for");
+                goto cleanup;
+            }
+        }
+
+        if ((rv = virNetSocketRead(ssock, in + got, 1000)) < 0)
+            goto cleanup;
+        got += rv;
+
+        if (sent < total &&
+            got == sent) {
+            VIR_DEBUG("Writer could not make progress");
+            goto cleanup;
+        }
+    }
+
+    if (memcmp(in, out, total) != 0) {
+        VIR_DEBUG("Data was corrupted");
+        goto cleanup;
+    }
+
+    /* The writer was woken up once there was space again */
+    if (virNetSocketGetReadyEvents(csock, VIR_EVENT_HANDLE_WRITABLE,
+                                   VIR_EVENT_HANDLE_READABLE) !=
+        VIR_EVENT_HANDLE_WRITABLE) {
+        VIR_DEBUG("Writer was not woken up");
+        goto cleanup;
+    }
+
+    /* FDs still go through the socket */
+    if (virNetSocketSendFD(ssock, pipefd[0]) != 1 ||
+        virNetSocketWrite(ssock, "x", 1) != 1)
+        goto cleanup;
+
+    if (virNetSocketRead(csock, buf, sizeof(buf)) != 1 ||
+        virNetSocketRecvFD(csock, &fd) != 1 ||
+        fd < 0) {
+        VIR_DEBUG("FD was not received");
+        goto cleanup;
+    }
+    VIR_FORCE_CLOSE(fd);
+
+    /* Closing the peer is reported once everything was read */
+    if (virNetSocketWrite(ssock, "bye", 3) != 3)
+        goto cleanup;
+    virObjectUnref(ssock);
+    ssock = NULL;
+    virNetSocketSetQuietEOF(csock);
+
+    if (virNetSocketRead(csock, buf, sizeof(buf)) != 3 ||
+        virNetSocketRead(csock, buf, sizeof(buf)) != -2) {
+        VIR_DEBUG("EOF was not reported");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(in);
+    VIR_FREE(out);
+    VIR_FORCE_CLOSE(fd);
+    VIR_FORCE_CLOSE(sv[0]);
+    VIR_FORCE_CLOSE(sv[1]);
+    VIR_FORCE_CLOSE(pipefd[0]);
+    VIR_FORCE_CLOSE(pipefd[1]);
+    virObjectUnref(schan);
+    virObjectUnref(cchan);
+    virObjectUnref(ssock);
+    virObjectUnref(csock);
+    return ret;
+}
+
+
+/*
+ * FDs sent alongside a shared memory channel are handed out one
+ * message at a time, and a peer flooding FDs nobody asked for is
+ * cut off instead of having them queued without limit.
+ */
+static int testSocketShmFDs(const void *data ATTRIBUTE_UNUSED)
+{
+    virNetSocketPtr ssock = NULL;
+    virNetSocketPtr csock = NULL;
+    virNetShmChannelPtr schan = NULL;
+    virNetShmChannelPtr cchan = NULL;
+    int sv[2] = { -1, -1 };
+    int pipefd[2] = { -1, -1 };
+    char buf[16];
+    size_t i;
+    int fd = -1;
+    int ret = -1;
+
+    if (!virNetShmChannelIsSupported())
+        return EXIT_AM_SKIP;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0 ||
+        pipe(pipefd) < 0)
+        goto cleanup;
+
+    if (virNetSocketNewConnectSockFD(sv[0], &ssock) < 0)
+        goto cleanup;
+    sv[0] = -1;
+    if (virNetSocketNewConnectSockFD(sv[1], &csock) < 0)
+        goto cleanup;
+    sv[1] = -1;
+
+    if (!(schan = virNetShmChannelNew(VIR_NET_SHM_CHANNEL_SIZE_MIN)))
+        goto cleanup;
+    if ((fd = dup(virNetShmChannelGetFD(schan))) < 0)
+        goto cleanup;
+    cchan = virNetShmChannelOpen(fd);
+    fd = -1;
+    if (!cchan)
+        goto cleanup;
+
+    if (virNetSocketSetShmChannel(ssock, schan) < 0 ||
+        virNetSocketSetShmChannel(csock, cchan) < 0)
+        goto cleanup;
+
+    /* All FDs of a message are received, even if drained early */
+    for (i = 0; i < 3; i++) {
+        if (virNetSocketSendFD(ssock, pipefd[0]) != 1)
+            goto cleanup;
+    }
+    if (virNetSocketWrite(ssock, "x", 1) != 1)
+        goto cleanup;
+
+    if (virNetSocketRead(csock, buf, sizeof(buf)) != 1 ||
+        virNetSocketRead(csock, buf, sizeof(buf)) != 0)
+        goto cleanup;
+
+    for (i = 0; i < 3; i++) {
+        if (virNetSocketRecvFD(csock, &fd) != 1 ||
+            fd < 0) {
+            VIR_DEBUG("FD %zu was not received", i);
+            goto cleanup;
+        }
+        VIR_FORCE_CLOSE(fd);
+    }
+
+    if (virNetSocketRecvFD(csock, &fd) != 0) {
+        VIR_DEBUG("Unexpected FD received");
+        goto cleanup;
+    }
+
+    /* More FDs than a message can carry are refused */
+    for (i = 0; i <= VIR_NET_MESSAGE_NUM_FDS_MAX; i++) {
+        if (virNetSocketSendFD(ssock, pipefd[0]) != 1)
+            goto cleanup;
+    }
+
+    for (i = 0; i <= VIR_NET_MESSAGE_NUM_FDS_MAX; i++) {
+        if (virNetSocketRead(csock, buf, sizeof(buf)) != 0)
+            break;
+    }
+
+    if (i != VIR_NET_MESSAGE_NUM_FDS_MAX ||
+        virNetSocketRead(csock, buf, sizeof(buf)) != -1 ||
+        virNetSocketRecvFD(csock, &fd) != -1) {
+        VIR_DEBUG("Flooding FDs was not refused");
+        goto cleanup;
+    }
+    virResetLastError();
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    VIR_FORCE_CLOSE(sv[0]);
+    VIR_FORCE_CLOSE(sv[1]);
+    VIR_FORCE_CLOSE(pipefd[0]);
+    VIR_FORCE_CLOSE(pipefd[1]);
+    virObjectUnref(schan);
+    virObjectUnref(cchan);
+    virObjectUnref(ssock);
+    virObjectUnref(csock);
+    return ret;
+}
+
 #endif
 
 
@@ -483,6 +782,12 @@ mymain(void)
     if (virTestRun("Socket UNIX Addrs", testSocketUNIXAddrs, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Socket shared memory channel", testSocketShm, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Socket shared memory channel FDs",
+                   testSocketShmFDs, NULL) < 0)
+        ret = -1;
+
     if (virTestRun("Socket External Command /dev/zero", testSocketCommandNormal, NULL) < 0)
         ret = -1;
     if (virTestRun("Socket External Command /dev/does-not-exist", testSocketCommandFail, NULL) < 0)
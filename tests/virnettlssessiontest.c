@@ -237,6 +237,134 @@ static int testTLSSessionInit(const void *opaque)
 }
 
 
+/*
+ * Connect a client of @clientCtxt to a server of @serverCtxt, and
+ * check whether the session was resumed as @expectResumed says.
+ */
+static int testTLSSessionConnect(virNetTLSContextPtr serverCtxt,
+                                 virNetTLSContextPtr clientCtxt,
+                                 const char *hostname,
+                                 bool expectResumed)
+{
+    virNetTLSSessionPtr clientSess = NULL;
+    virNetTLSSessionPtr serverSess = NULL;
+    int channel[2] = { -1, -1 };
+    bool clientShake = false;
+    bool serverShake = false;
+    char buf[1] = { '\1' };
+    ssize_t len;
+    int ret = -1;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, channel) < 0)
+        abort();
+
+    ignore_value(virSetNonBlock(channel[0]));
+    ignore_value(virSetNonBlock(channel[1]));
+
+    if (!(serverSess = virNetTLSSessionNew(serverCtxt, NULL)) ||
+        !(clientSess = virNetTLSSessionNew(clientCtxt, hostname)))
+        goto cleanup;
+
+    virNetTLSSessionSetIOCallbacks(serverSess, testWrite, testRead, &channel[0]);
+    virNetTLSSessionSetIOCallbacks(clientSess, testWrite, testRead, &channel[1]);
+
+    while (!serverShake || !clientShake) {
+        int rv;
+        if (!serverShake) {
+            if ((rv = virNetTLSSessionHandshake(serverSess)) < 0)
+                goto cleanup;
+            serverShake = rv == VIR_NET_TLS_HANDSHAKE_COMPLETE;
+        }
+        if (!clientShake) {
+            if ((rv = virNetTLSSessionHandshake(clientSess)) < 0)
+                goto cleanup;
+            clientShake = rv == VIR_NET_TLS_HANDSHAKE_COMPLETE;
+        }
+    }
+
+    if (virNetTLSContextCheckCertificate(serverCtxt, serverSess) < 0 ||
+        virNetTLSContextCheckCertificate(clientCtxt, clientSess) < 0)
+        goto cleanup;
+
+    /* Like the daemon confirming the access check, which lets the
+     * client receive its ticket if it is sent after the handshake */
+    if (virNetTLSSessionWrite(serverSess, buf, 1) != 1)
+        goto cleanup;
+    buf[0] = 0;
+    do {
+        len = virNetTLSSessionRead(clientSess, buf, 1);
+    } while (len < 0 && errno == EAGAIN);
+    if (len != 1 || buf[0] != '\1') {
+        VIR_WARN("Unexpected confirmation from the server");
+        goto cleanup;
+    }
+
+    if (virNetTLSSessionIsResumed(serverSess) != expectResumed ||
+        virNetTLSSessionIsResumed(clientSess) != expectResumed) {
+        VIR_WARN("Expected the session %sto be resumed",
+                 expectResumed ? "" : "not ");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(serverSess);
+    virObjectUnref(clientSess);
+    VIR_FORCE_CLOSE(channel[0]);
+    VIR_FORCE_CLOSE(channel[1]);
+    return ret;
+}
+
+
+static int testTLSSessionResume(const void *opaque)
+{
+    struct testTLSSessionData *data = (struct testTLSSessionData *)opaque;
+    virNetTLSContextPtr clientCtxt = NULL;
+    virNetTLSContextPtr serverCtxt = NULL;
+    unsigned long long full, resumed;
+    int ret = -1;
+
+    if (!(serverCtxt = virNetTLSContextNewServer(data->servercacrt, NULL,
+                                                 data->servercrt, KEYFILE,
+                                                 NULL, NULL, false, true)) ||
+        !(clientCtxt = virNetTLSContextNewClient(data->clientcacrt, NULL,
+                                                 data->clientcrt, KEYFILE,
+                                                 NULL, false, true)))
+        goto cleanup;
+
+    /* Without tickets, every handshake is a full one */
+    if (testTLSSessionConnect(serverCtxt, clientCtxt, data->hostname, false) < 0 ||
+        testTLSSessionConnect(serverCtxt, clientCtxt, data->hostname, false) < 0)
+        goto cleanup;
+
+    virNetTLSContextSetSessionTickets(serverCtxt, 3600);
+
+    if (testTLSSessionConnect(serverCtxt, clientCtxt, data->hostname, false) < 0 ||
+        testTLSSessionConnect(serverCtxt, clientCtxt, data->hostname, true) < 0 ||
+        testTLSSessionConnect(serverCtxt, clientCtxt, data->hostname, true) < 0)
+        goto cleanup;
+
+    /* Sessions are not shared between servers */
+    if (testTLSSessionConnect(serverCtxt, clientCtxt, "www.libvirt.org", false) < 0)
+        goto cleanup;
+
+    virNetTLSContextGetHandshakeStats(serverCtxt, &full, &resumed);
+    if (full != 4 || resumed != 2) {
+        VIR_WARN("Unexpected handshake counts full=%llu resumed=%llu",
+                 full, resumed);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(serverCtxt);
+    virObjectUnref(clientCtxt);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -364,6 +492,18 @@ mymain(void)
                  false, false, "libvirt.org", NULL);
     DO_SESS_TEST(cacertreq.filename, servercertalt1req.filename, clientcertreq.filename,
                  false, false, "www.libvirt.org", NULL);
+
+    do {
+        static struct testTLSSessionData data;
+        data.servercacrt = cacertreq.filename;
+        data.clientcacrt = cacertreq.filename;
+        data.servercrt = servercertalt1req.filename;
+        data.clientcrt = clientcertreq.filename;
+        data.hostname = "libvirt.org";
+        if (virTestRun("TLS Session resumption", testTLSSessionResume,
+                       &data) < 0)
+            ret = -1;
+    } while (0);
     DO_SESS_TEST(cacertreq.filename, servercertalt1req.filename, clientcertreq.filename,
                  false, true, "wiki.libvirt.org", NULL);
 
@@ -0,0 +1,691 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "testutils.h"
+#include "viralloc.h"
+#include "viratomic.h"
+#include "virhash.h"
+#include "virlog.h"
+#include "virobject.h"
+#include "virrandom.h"
+#include "virshardedhash.h"
+#include "virstring.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.shardedhashtest");
+
+typedef struct _testObject testObject;
+typedef testObject *testObjectPtr;
+struct _testObject {
+    virObject parent;
+
+    size_t id;
+};
+
+static virClassPtr testObjectClass;
+
+/* Number of test objects not yet disposed of */
+static int testObjectCount;
+
+static void
+testObjectDispose(void *obj ATTRIBUTE_UNUSED)
+{
+    virAtomicIntAdd(&testObjectCount, -1);
+}
+
+
+static testObjectPtr
+testObjectNew(size_t id)
+{
+    testObjectPtr obj;
+
+    if (!(obj = virObjectNew(testObjectClass)))
+        return NULL;
+
+    virAtomicIntInc(&testObjectCount);
+    obj->id = id;
+    return obj;
+}
+
+
+static char **
+testKeysNew(size_t nkeys)
+{
+    char **keys;
+    size_t i;
+
+    if (VIR_ALLOC_N(keys, nkeys + 1) < 0)
+        return NULL;
+
+    for (i = 0; i < nkeys; i++) {
+        if (virAsprintf(&keys[i], "%08zx-7d41-4100-8907-9b9209e7954a", i) < 0) {
+            virStringListFree(keys);
+            return NULL;
+        }
+    }
+
+    return keys;
+}
+
+
+/*
+ * Fill a table with @nkeys objects whose id is their index in @keys.
+ */
+static virShardedHashPtr
+testHashNew(char **keys,
+            size_t nkeys)
+{
+    virShardedHashPtr hash;
+    testObjectPtr obj;
+    size_t i;
+
+    if (!(hash = virShardedHashNew()))
+        return NULL;
+
+    for (i = 0; i < nkeys; i++) {
+        if (!(obj = testObjectNew(i)) ||
+            virShardedHashAdd(hash, keys[i], obj) < 0) {
+            virObjectUnref(obj);
+            virShardedHashFree(hash);
+            return NULL;
+        }
+        virObjectUnref(obj);
+    }
+
+    return hash;
+}
+
+
+static int
+testCheckObjectCount(int expected)
+{
+    int count = virAtomicIntGet(&testObjectCount);
+
+    if (count != expected) {
+        VIR_TEST_VERBOSE("\n%d objects left, expected %d\n", count, expected);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+#define TEST_BASIC_KEYS 1000
+
+static int
+testBasic(const void *data ATTRIBUTE_UNUSED)
+{
+    virShardedHashPtr hash = NULL;
+    char **keys = NULL;
+    testObjectPtr obj = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (!(keys = testKeysNew(TEST_BASIC_KEYS)) ||
+        !(hash = testHashNew(keys, TEST_BASIC_KEYS / 2)))
+        goto cleanup;
+
+    if (virShardedHashSize(hash) != TEST_BASIC_KEYS / 2) {
+        VIR_TEST_VERBOSE("\nwrong size %zd\n", virShardedHashSize(hash));
+        goto cleanup;
+    }
+
+    for (i = 0; i < TEST_BASIC_KEYS; i++) {
+        obj = virShardedHashLookupRef(hash, keys[i]);
+        if (!!obj != (i < TEST_BASIC_KEYS / 2) || (obj && obj->id != i)) {
+            VIR_TEST_VERBOSE("\nwrong lookup result for '%s'\n", keys[i]);
+            goto cleanup;
+        }
+        virObjectUnref(obj);
+        obj = NULL;
+    }
+
+    if (!(obj = testObjectNew(0)))
+        goto cleanup;
+
+    if (virShardedHashAdd(hash, keys[0], obj) == 0) {
+        VIR_TEST_VERBOSE("\nduplicate key '%s' was added\n", keys[0]);
+        goto cleanup;
+    }
+    virResetLastError();
+
+    virObjectUnref(obj);
+    obj = NULL;
+
+    /* The table holds the only references left */
+    if (testCheckObjectCount(TEST_BASIC_KEYS / 2) < 0)
+        goto cleanup;
+
+    for (i = 0; i < TEST_BASIC_KEYS; i += 2) {
+        if ((virShardedHashRemove(hash, keys[i]) == 0) !=
+            (i < TEST_BASIC_KEYS / 2)) {
+            VIR_TEST_VERBOSE("\nwrong remove result for '%s'\n", keys[i]);
+            goto cleanup;
+        }
+    }
+
+    if (virShardedHashSize(hash) != TEST_BASIC_KEYS / 4 ||
+        testCheckObjectCount(TEST_BASIC_KEYS / 4) < 0)
+        goto cleanup;
+
+    for (i = 0; i < TEST_BASIC_KEYS / 2; i++) {
+        obj = virShardedHashLookupRef(hash, keys[i]);
+        if (!!obj != (i % 2 == 1)) {
+            VIR_TEST_VERBOSE("\nwrong lookup result for '%s'\n", keys[i]);
+            goto cleanup;
+        }
+        virObjectUnref(obj);
+        obj = NULL;
+    }
+
+    virShardedHashRemoveAll(hash);
+
+    if (virShardedHashSize(hash) != 0 ||
+        testCheckObjectCount(0) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(obj);
+    virShardedHashFree(hash);
+    virStringListFree(keys);
+    return ret;
+}
+
+
+static int
+testIterateCount(void *payload,
+                 void *opaque)
+{
+    testObjectPtr obj = payload;
+    size_t *sum = opaque;
+
+    *sum += obj->id;
+    return 0;
+}
+
+
+static int
+testIterateStop(void *payload ATTRIBUTE_UNUSED,
+                void *opaque)
+{
+    size_t *count = opaque;
+
+    return ++(*count) == 3 ? -1 : 0;
+}
+
+
+static int
+testSearchID(const void *payload,
+             const void *opaque)
+{
+    const testObject *obj = payload;
+    const size_t *id = opaque;
+
+    return obj->id == *id;
+}
+
+
+static int
+testIterate(const void *data ATTRIBUTE_UNUSED)
+{
+    virShardedHashPtr hash = NULL;
+    char **keys = NULL;
+    testObjectPtr obj = NULL;
+    void **list = NULL;
+    ssize_t nlist = 0;
+    size_t sum = 0;
+    size_t count = 0;
+    size_t id;
+    int ret = -1;
+
+    if (!(keys = testKeysNew(TEST_BASIC_KEYS)) ||
+        !(hash = testHashNew(keys, TEST_BASIC_KEYS)))
+        goto cleanup;
+
+    if ((nlist = virShardedHashGetValues(hash, &list)) != TEST_BASIC_KEYS) {
+        VIR_TEST_VERBOSE("\n%zd values collected\n", nlist);
+        goto cleanup;
+    }
+
+    if (virShardedHashForEach(hash, testIterateCount, &sum) < 0 ||
+        sum != TEST_BASIC_KEYS * (TEST_BASIC_KEYS - 1) / 2) {
+        VIR_TEST_VERBOSE("\nwrong sum of ids %zu\n", sum);
+        goto cleanup;
+    }
+
+    if (virShardedHashForEach(hash, testIterateStop, &count) == 0 ||
+        count != 3) {
+        VIR_TEST_VERBOSE("\niteration was not stopped\n");
+        goto cleanup;
+    }
+
+    id = TEST_BASIC_KEYS / 3;
+    if (!(obj = virShardedHashSearchRef(hash, testSearchID, &id)) ||
+        obj->id != id) {
+        VIR_TEST_VERBOSE("\nobject %zu was not found\n", id);
+        goto cleanup;
+    }
+    virObjectUnref(obj);
+    obj = NULL;
+
+    id = TEST_BASIC_KEYS;
+    if ((obj = virShardedHashSearchRef(hash, testSearchID, &id))) {
+        VIR_TEST_VERBOSE("\nnon existent object was found\n");
+        goto cleanup;
+    }
+
+    /* The collected values outlive the table */
+    virShardedHashFree(hash);
+    hash = NULL;
+
+    if (testCheckObjectCount(TEST_BASIC_KEYS) < 0)
+        goto cleanup;
+
+    virObjectListFreeCount(list, nlist);
+    list = NULL;
+
+    if (testCheckObjectCount(0) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(obj);
+    virObjectListFreeCount(list, nlist);
+    virShardedHashFree(hash);
+    virStringListFree(keys);
+    return ret;
+}
+
+
+/*
+ * Readers keep looking up the first half of the keys, which are never
+ * removed, while a writer keeps adding and removing the second half.
+ * The objects of the latter have to stay valid for as long as readers
+ * hold references on them.
+ */
+
+#define TEST_CONCURRENT_KEYS 512
+#define TEST_CONCURRENT_READERS 4
+
+struct testConcurrentData {
+    virShardedHashPtr hash;
+    char **keys;
+    int done;
+    int failed;
+};
+
+
+static void
+testConcurrentReader(void *opaque)
+{
+    struct testConcurrentData *data = opaque;
+    testObjectPtr obj;
+    size_t i = 0;
+
+    while (!virAtomicIntGet(&data->done)) {
+        i = (i + 7) % TEST_CONCURRENT_KEYS;
+
+        obj = virShardedHashLookupRef(data->hash, data->keys[i]);
+        if (obj ? obj->id != i : i < TEST_CONCURRENT_KEYS / 2)
+            virAtomicIntSet(&data->failed, 1);
+        virObjectUnref(obj);
+
+        if (i % 64 == 0) {
+            size_t id = TEST_CONCURRENT_KEYS / 2 - 1;
+
+            obj = virShardedHashSearchRef(data->hash, testSearchID, &id);
+            if (!obj)
+                virAtomicIntSet(&data->failed, 1);
+            virObjectUnref(obj);
+        }
+    }
+}
+
+
+static int
+testConcurrent(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testConcurrentData data = { NULL, NULL, 0, 0 };
+    virThread threads[TEST_CONCURRENT_READERS];
+    size_t nthreads = 0;
+    size_t rounds = virTestGetExpensive() ? 200 : 20;
+    testObjectPtr obj;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    if (!(data.keys = testKeysNew(TEST_CONCURRENT_KEYS)) ||
+        !(data.hash = testHashNew(data.keys, TEST_CONCURRENT_KEYS / 2)))
+        goto cleanup;
+
+    for (i = 0; i < TEST_CONCURRENT_READERS; i++) {
+        if (virThreadCreate(&threads[i], true,
+                            testConcurrentReader, &data) < 0)
+            goto cleanup;
+        nthreads++;
+    }
+
+    for (i = 0; i < rounds; i++) {
+        for (j = TEST_CONCURRENT_KEYS / 2; j < TEST_CONCURRENT_KEYS; j++) {
+            if (!(obj = testObjectNew(j)) ||
+                virShardedHashAdd(data.hash, data.keys[j], obj) < 0) {
+                virObjectUnref(obj);
+                goto cleanup;
+            }
+            virObjectUnref(obj);
+        }
+
+        for (j = TEST_CONCURRENT_KEYS / 2; j < TEST_CONCURRENT_KEYS; j++) {
+            if (virShardedHashRemove(data.hash, data.keys[j]) < 0)
+                goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virAtomicIntSet(&data.done, 1);
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    if (data.failed) {
+        VIR_TEST_VERBOSE("\nreaders got wrong results\n");
+        ret = -1;
+    }
+
+    virShardedHashFree(data.hash);
+    virStringListFree(data.keys);
+
+    if (testCheckObjectCount(0) < 0)
+        ret = -1;
+
+    return ret;
+}
+
+
+/*
+ * The contention benchmark runs the same load on the sharded table
+ * and on a virHashTable guarded by a single RW lock, the way object
+ * lists used to be: readers hammer lookups of existing keys while one
+ * writer keeps adding and removing other keys.
+ */
+
+#define TEST_BENCH_KEYS 4096
+
+typedef struct _testBenchMap testBenchMap;
+typedef testBenchMap *testBenchMapPtr;
+struct _testBenchMap {
+    virShardedHashPtr sharded;
+
+    virRWLock lock;
+    virHashTablePtr hash;
+};
+
+struct testBenchData {
+    testBenchMapPtr map;
+    char **keys;
+    size_t lookups;
+    int done;
+    int failed;
+};
+
+
+static void *
+testBenchLookup(testBenchMapPtr map,
+                const char *key)
+{
+    void *obj;
+
+    if (map->sharded)
+        return virShardedHashLookupRef(map->sharded, key);
+
+    virRWLockRead(&map->lock);
+    obj = virObjectRef(virHashLookup(map->hash, key));
+    virRWLockUnlock(&map->lock);
+    return obj;
+}
+
+
+static int
+testBenchAdd(testBenchMapPtr map,
+             const char *key,
+             void *obj)
+{
+    int ret;
+
+    if (map->sharded)
+        return virShardedHashAdd(map->sharded, key, obj);
+
+    virRWLockWrite(&map->lock);
+    if ((ret = virHashAddEntry(map->hash, key, obj)) == 0)
+        virObjectRef(obj);
+    virRWLockUnlock(&map->lock);
+    return ret;
+}
+
+
+static int
+testBenchRemove(testBenchMapPtr map,
+                const char *key)
+{
+    int ret;
+
+    if (map->sharded)
+        return virShardedHashRemove(map->sharded, key);
+
+    virRWLockWrite(&map->lock);
+    ret = virHashRemoveEntry(map->hash, key);
+    virRWLockUnlock(&map->lock);
+    return ret;
+}
+
+
+static void
+testBenchReader(void *opaque)
+{
+    struct testBenchData *data = opaque;
+    testObjectPtr obj;
+    size_t i;
+    size_t key = virRandomBits(16);
+
+    for (i = 0; i < data->lookups; i++) {
+        key = (key + 11) % (TEST_BENCH_KEYS / 2);
+        if (!(obj = testBenchLookup(data->map, data->keys[key])))
+            virAtomicIntSet(&data->failed, 1);
+        virObjectUnref(obj);
+    }
+}
+
+
+static void
+testBenchWriter(void *opaque)
+{
+    struct testBenchData *data = opaque;
+    testObjectPtr obj;
+    size_t i = TEST_BENCH_KEYS / 2;
+
+    while (!virAtomicIntGet(&data->done)) {
+        if (!(obj = testObjectNew(i)) ||
+            testBenchAdd(data->map, data->keys[i], obj) < 0 ||
+            testBenchRemove(data->map, data->keys[i]) < 0)
+            virAtomicIntSet(&data->failed, 1);
+        virObjectUnref(obj);
+
+        if (++i == TEST_BENCH_KEYS)
+            i = TEST_BENCH_KEYS / 2;
+    }
+}
+
+
+static unsigned long long
+testNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/*
+ * Run @nreaders readers against @map, with a writer running
+ * concurrently if @writer is true, and store the wall clock time
+ * per lookup in @ns.
+ */
+static int
+testBenchRun(testBenchMapPtr map,
+             char **keys,
+             size_t nreaders,
+             size_t lookups,
+             bool writer,
+             unsigned long long *ns)
+{
+    struct testBenchData data = { map, keys, lookups, 0, 0 };
+    virThread readers[16];
+    virThread writerThread;
+    unsigned long long start;
+    unsigned long long elapsed;
+    size_t n = 0;
+    size_t i;
+
+    if (writer &&
+        virThreadCreate(&writerThread, true, testBenchWriter, &data) < 0)
+        return -1;
+
+    start = testNow();
+    for (i = 0; i < nreaders; i++) {
+        if (virThreadCreate(&readers[i], true, testBenchReader, &data) < 0) {
+            data.failed = 1;
+            break;
+        }
+        n++;
+    }
+    for (i = 0; i < n; i++)
+        virThreadJoin(&readers[i]);
+    elapsed = testNow() - start;
+
+    virAtomicIntSet(&data.done, 1);
+    if (writer)
+        virThreadJoin(&writerThread);
+
+    if (data.failed)
+        return -1;
+
+    *ns = elapsed / (nreaders * lookups);
+    return 0;
+}
+
+
+static int
+testBenchmark(const void *opaque ATTRIBUTE_UNUSED)
+{
+    testBenchMap sharded;
+    testBenchMap locked;
+    size_t lookups = virTestGetExpensive() ? 2000000 : 100000;
+    size_t nreaders[] = { 1, 4, 16 };
+    char **keys = NULL;
+    testObjectPtr obj;
+    size_t i;
+    int ret = -1;
+
+    memset(&sharded, 0, sizeof(sharded));
+    memset(&locked, 0, sizeof(locked));
+
+    if (virRWLockInit(&locked.lock) < 0)
+        return -1;
+
+    if (!(keys = testKeysNew(TEST_BENCH_KEYS)) ||
+        !(sharded.sharded = testHashNew(keys, TEST_BENCH_KEYS / 2)) ||
+        !(locked.hash = virHashCreate(0, virObjectFreeHashData)))
+        goto cleanup;
+
+    for (i = 0; i < TEST_BENCH_KEYS / 2; i++) {
+        if (!(obj = testObjectNew(i)) ||
+            virHashAddEntry(locked.hash, keys[i], obj) < 0) {
+            virObjectUnref(obj);
+            goto cleanup;
+        }
+    }
+
+    VIR_TEST_VERBOSE("\n%zu lookups per reader, ns per lookup:\n", lookups);
+
+    for (i = 0; i < ARRAY_CARDINALITY(nreaders); i++) {
+        unsigned long long res[4];
+
+        if (testBenchRun(&locked, keys, nreaders[i],
+                         lookups, false, &res[0]) < 0 ||
+            testBenchRun(&locked, keys, nreaders[i],
+                         lookups, true, &res[1]) < 0 ||
+            testBenchRun(&sharded, keys, nreaders[i],
+                         lookups, false, &res[2]) < 0 ||
+            testBenchRun(&sharded, keys, nreaders[i],
+                         lookups, true, &res[3]) < 0)
+            goto cleanup;
+
+        VIR_TEST_VERBOSE("%2zu readers: RW lock %llu, with writer %llu; "
+                         "sharded %llu, with writer %llu\n",
+                         nreaders[i], res[0], res[1], res[2], res[3]);
+    }
+
+    ret = 0;
+
+ cleanup:
+    virShardedHashFree(sharded.sharded);
+    virHashFree(locked.hash);
+    virRWLockDestroy(&locked.lock);
+    virStringListFree(keys);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (!(testObjectClass = virClassNew(virClassForObject(),
+                                        "testObject",
+                                        sizeof(testObject),
+                                        testObjectDispose)))
+        return EXIT_FAILURE;
+
+    if (virTestRun("Basic", testBasic, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Iterate", testIterate, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Concurrent", testConcurrent, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Benchmark", testBenchmark, NULL) < 0)
+        ret = -1;
+
+    virObjectUnref(testObjectClass);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
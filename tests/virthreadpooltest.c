@@ -0,0 +1,342 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "testutils.h"
+#include "virerror.h"
+#include "viralloc.h"
+#include "virlog.h"
+#include "virthread.h"
+#include "virthreadpool.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.threadpooltest");
+
+#define TEST_MAX_JOBS 16
+
+/*
+ * All tests use a pool with a single worker, which is kept busy by
+ * a blocking job while the interesting ones are queued, so that the
+ * order in which they run only depends on the scheduling.
+ */
+
+struct testPool {
+    virMutex lock;
+    virCond cond;
+    bool started;
+    bool release;
+
+    char order[TEST_MAX_JOBS + 1];
+    size_t norder;
+    size_t njobs;
+};
+
+
+static void
+testJob(void *jobdata, void *opaque)
+{
+    struct testPool *data = opaque;
+    char name = *(char *) jobdata;
+
+    virMutexLock(&data->lock);
+    if (name == '*') {
+        data->started = true;
+        virCondBroadcast(&data->cond);
+        while (!data->release)
+            ignore_value(virCondWait(&data->cond, &data->lock));
+    } else if (data->norder < TEST_MAX_JOBS) {
+        data->order[data->norder++] = name;
+    }
+    data->njobs++;
+    virCondBroadcast(&data->cond);
+    virMutexUnlock(&data->lock);
+}
+
+
+/*
+ * Run the jobs in @names, the i-th of which is sent on behalf of the
+ * owner @owners[i], and check they ran in the order of @expect.
+ */
+static int
+testOrder(const char *names,
+          const char *owners,
+          const char *expect)
+{
+    struct testPool data;
+    virThreadPoolPtr pool = NULL;
+    static const char block = '*';
+    size_t n = strlen(names);
+    size_t i;
+    int ret = -1;
+
+    memset(&data, 0, sizeof(data));
+    if (virMutexInit(&data.lock) < 0)
+        return -1;
+    if (virCondInit(&data.cond) < 0) {
+        virMutexDestroy(&data.lock);
+        return -1;
+    }
+
+    if (!(pool = virThreadPoolNew(1, 1, 0, testJob, &data)))
+        goto cleanup;
+
+    if (virThreadPoolSendJobFull(pool, 0, &owners[0], (void *) &block) < 0)
+        goto cleanup;
+
+    virMutexLock(&data.lock);
+    while (!data.started)
+        ignore_value(virCondWait(&data.cond, &data.lock));
+    virMutexUnlock(&data.lock);
+
+    for (i = 0; i < n; i++) {
+        const void *owner = NULL;
+
+        /* Jobs of the same owner share the same pointer */
+        if (owners[i] != ' ')
+            owner = strchr(owners, owners[i]);
+
+        if (virThreadPoolSendJobFull(pool, 0, owner,
+                                     (void *) &names[i]) < 0)
+            goto cleanup;
+    }
+
+    virMutexLock(&data.lock);
+    data.release = true;
+    virCondBroadcast(&data.cond);
+    while (data.njobs < n + 1)
+        ignore_value(virCondWait(&data.cond, &data.lock));
+    virMutexUnlock(&data.lock);
+
+    if (STRNEQ(data.order, expect)) {
+        VIR_TEST_DEBUG("Expected order '%s', got '%s'\n", expect, data.order);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virThreadPoolFree(pool);
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
+
+struct testOrderData {
+    const char *names;
+    const char *owners;
+    const char *expect;
+};
+
+
+static int
+testOrderHelper(const void *opaque)
+{
+    const struct testOrderData *data = opaque;
+
+    return testOrder(data->names, data->owners, data->expect);
+}
+
+
+static int
+testOwnerStats(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testPool data;
+    virThreadPoolPtr pool = NULL;
+    virThreadPoolOwnerStats stats;
+    static const char block = '*';
+    static const char job = 'a';
+    int owner;
+    int ret = -1;
+
+    memset(&data, 0, sizeof(data));
+    if (virMutexInit(&data.lock) < 0)
+        return -1;
+    if (virCondInit(&data.cond) < 0) {
+        virMutexDestroy(&data.lock);
+        return -1;
+    }
+
+    if (!(pool = virThreadPoolNew(1, 1, 0, testJob, &data)))
+        goto cleanup;
+
+    if (virThreadPoolSetOwnerWeight(pool, &owner, 0) == 0 ||
+        virThreadPoolSetOwnerWeight(pool, &owner, 3) < 0)
+        goto cleanup;
+
+    if (virThreadPoolSendJobFull(pool, 0, &owner, (void *) &block) < 0)
+        goto cleanup;
+
+    virMutexLock(&data.lock);
+    while (!data.started)
+        ignore_value(virCondWait(&data.cond, &data.lock));
+    virMutexUnlock(&data.lock);
+
+    if (virThreadPoolSendJobFull(pool, 0, &owner, (void *) &job) < 0 ||
+        virThreadPoolSendJobFull(pool, 0, &owner, (void *) &job) < 0)
+        goto cleanup;
+
+    virThreadPoolGetOwnerStats(pool, &owner, &stats);
+    if (stats.weight != 3 || stats.queued != 2 ||
+        stats.running != 1 || stats.jobs != 1) {
+        VIR_TEST_DEBUG("Unexpected stats while blocked: weight=%u "
+                       "queued=%zu running=%zu jobs=%llu\n",
+                       stats.weight, stats.queued, stats.running, stats.jobs);
+        goto cleanup;
+    }
+
+    virMutexLock(&data.lock);
+    data.release = true;
+    virCondBroadcast(&data.cond);
+    while (data.njobs < 3)
+        ignore_value(virCondWait(&data.cond, &data.lock));
+    virMutexUnlock(&data.lock);
+
+    /* The worker may still be finishing the last job */
+    do {
+        virThreadPoolGetOwnerStats(pool, &owner, &stats);
+    } while (stats.running);
+
+    if (stats.queued != 0 || stats.jobs != 3) {
+        VIR_TEST_DEBUG("Unexpected stats when done: queued=%zu jobs=%llu\n",
+                       stats.queued, stats.jobs);
+        goto cleanup;
+    }
+
+    virThreadPoolForgetOwner(pool, &owner);
+    virThreadPoolGetOwnerStats(pool, &owner, &stats);
+    if (stats.weight != 1 || stats.jobs != 0) {
+        VIR_TEST_DEBUG("Owner was not forgotten\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virThreadPoolFree(pool);
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
+
+/*
+ * With a target latency, a busy pool grows only once a job has waited
+ * longer than that.
+ */
+static int
+testAdaptiveGrow(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testPool data;
+    virThreadPoolPtr pool = NULL;
+    static const char block = '*';
+    static const char job = 'a';
+    int ret = -1;
+
+    memset(&data, 0, sizeof(data));
+    if (virMutexInit(&data.lock) < 0)
+        return -1;
+    if (virCondInit(&data.cond) < 0) {
+        virMutexDestroy(&data.lock);
+        return -1;
+    }
+
+    if (!(pool = virThreadPoolNew(1, 4, 0, testJob, &data)) ||
+        virThreadPoolSetParameters(pool, -1, -1, -1, 1000) < 0)
+        goto cleanup;
+
+    if (virThreadPoolSendJob(pool, 0, (void *) &block) < 0)
+        goto cleanup;
+
+    virMutexLock(&data.lock);
+    while (!data.started)
+        ignore_value(virCondWait(&data.cond, &data.lock));
+    virMutexUnlock(&data.lock);
+
+    if (virThreadPoolSendJob(pool, 0, (void *) &job) < 0)
+        goto cleanup;
+
+    if (virThreadPoolGetCurrentWorkers(pool) != 1) {
+        VIR_TEST_DEBUG("Pool grew before the target latency was exceeded\n");
+        goto cleanup;
+    }
+
+    usleep(10 * 1000);
+
+    if (virThreadPoolSendJob(pool, 0, (void *) &job) < 0)
+        goto cleanup;
+
+    if (virThreadPoolGetCurrentWorkers(pool) != 2 ||
+        virThreadPoolGetWorkersAdded(pool) != 1) {
+        VIR_TEST_DEBUG("Pool did not grow: workers=%zu added=%zu\n",
+                       virThreadPoolGetCurrentWorkers(pool),
+                       virThreadPoolGetWorkersAdded(pool));
+        goto cleanup;
+    }
+
+    /* The new worker runs the queued jobs despite the blocked one */
+    virMutexLock(&data.lock);
+    while (data.norder < 2)
+        ignore_value(virCondWait(&data.cond, &data.lock));
+    data.release = true;
+    virCondBroadcast(&data.cond);
+    virMutexUnlock(&data.lock);
+
+    ret = 0;
+ cleanup:
+    virThreadPoolFree(pool);
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+#define DO_TEST_ORDER(desc, names, owners, expect) \
+    do { \
+        struct testOrderData data = { names, owners, expect }; \
+        if (virTestRun("Order " desc, testOrderHelper, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    /* Without owners, jobs run in the order they were sent */
+    DO_TEST_ORDER("no owner", "abcdef", "      ", "abcdef");
+    DO_TEST_ORDER("single owner", "abcdef", "AAAAAA", "abcdef");
+
+    /* The blocking job was charged to A, so the others go first,
+     * taking turns, while jobs of each owner still keep their order */
+    DO_TEST_ORDER("two owners", "abcdeXY", "AAAAABB", "XYabcde");
+    DO_TEST_ORDER("late owner", "abcdeXYZ", "AAAAABBC", "XZYabcde");
+
+    if (virTestRun("Owner stats", testOwnerStats, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Adaptive grow", testAdaptiveGrow, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -506,6 +506,11 @@ static const vshCmdOptDef opts_srv_threadpool_set[] = {
      .type = VSH_OT_INT,
      .help = N_("Change the current number of priority workers"),
     },
+    {.name = "target-latency",
+     .type = VSH_OT_INT,
+     .help = N_("Change how long jobs may wait for a worker before adding "
+                "workers, in microseconds, or 0 to always add them"),
+    },
     {.name = NULL}
 };
 
@@ -538,13 +543,14 @@ cmdSrvThreadpoolSet(vshControl *ctl, const vshCmd *cmd)
     PARSE_CMD_TYPED_PARAM("max-workers", VIR_THREADPOOL_WORKERS_MAX);
     PARSE_CMD_TYPED_PARAM("min-workers", VIR_THREADPOOL_WORKERS_MIN);
     PARSE_CMD_TYPED_PARAM("priority-workers", VIR_THREADPOOL_WORKERS_PRIORITY);
+    PARSE_CMD_TYPED_PARAM("target-latency", VIR_THREADPOOL_TARGET_LATENCY);
 
 #undef PARSE_CMD_TYPED_PARAM
 
     if (!nparams) {
         vshError(ctl, "%s",
                  _("At least one of options --min-workers, --max-workers, "
-                   "--priority-workers is mandatory "));
+                   "--priority-workers, --target-latency is mandatory "));
             goto cleanup;
     }
 
@@ -863,8 +869,11 @@ cmdSrvClientsInfo(vshControl *ctl, const vshCmd *cmd)
         goto cleanup;
     }
 
-    for (i = 0; i < nparams; i++)
-        vshPrint(ctl, "%-20s: %u\n", params[i].field, params[i].value.ui);
+    for (i = 0; i < nparams; i++) {
+        char *str = vshGetTypedParamValue(ctl, &params[i]);
+        vshPrint(ctl, "%-22s: %s\n", params[i].field, str);
+        VIR_FREE(str);
+    }
 
     ret = true;
 
@@ -907,6 +916,16 @@ static const vshCmdOptDef opts_srv_clients_set[] = {
      .help = N_("Change the upper limit to number of clients waiting for "
                 "authentication to be connected to the server"),
     },
+    {.name = "max-tx-messages",
+     .type = VSH_OT_INT,
+     .help = N_("Change the upper limit to number of messages waiting to "
+                "be sent to each client, 0 for no limit"),
+    },
+    {.name = "max-tx-bytes",
+     .type = VSH_OT_INT,
+     .help = N_("Change the upper limit to size of messages waiting to "
+                "be sent to each client, 0 for no limit"),
+    },
     {.name = NULL}
 };
 
@@ -938,12 +957,15 @@ cmdSrvClientsSet(vshControl *ctl, const vshCmd *cmd)
 
     PARSE_CMD_TYPED_PARAM("max-clients", VIR_SERVER_CLIENTS_MAX);
     PARSE_CMD_TYPED_PARAM("max-unauth-clients", VIR_SERVER_CLIENTS_UNAUTH_MAX);
+    PARSE_CMD_TYPED_PARAM("max-tx-messages", VIR_SERVER_CLIENTS_TX_MESSAGES_MAX);
+    PARSE_CMD_TYPED_PARAM("max-tx-bytes", VIR_SERVER_CLIENTS_TX_BYTES_MAX);
 
 #undef PARSE_CMD_TYPED_PARAM
 
     if (!nparams) {
         vshError(ctl, "%s", _("At least one of options --max-clients, "
-                              "--max-unauth-clients is mandatory"));
+                              "--max-unauth-clients, --max-tx-messages, "
+                              "--max-tx-bytes is mandatory"));
         goto cleanup;
     }
 
@@ -979,6 +1001,502 @@ cmdSrvClientsSet(vshControl *ctl, const vshCmd *cmd)
     goto cleanup;
 }
 
+/* ------------------------------
+ * Command srv-message-pool-info
+ * ------------------------------
+ */
+
+static const vshCmdInfo info_srv_message_pool_info[] = {
+    {.name = "help",
+     .data = N_("get daemon's RPC message pool limits and statistics")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve limits and hit/miss counters of the pool of RPC "
+                "messages shared by the daemon's servers.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_srv_message_pool_info[] = {
+    {.name = "server",
+     .type = VSH_OT_DATA,
+     .flags = VSH_OFLAG_REQ,
+     .completer = vshAdmServerCompleter,
+     .help = N_("Server to retrieve the message pool statistics from."),
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdSrvMessagePoolInfo(vshControl *ctl, const vshCmd *cmd)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    size_t i;
+    const char *srvname = NULL;
+    virAdmServerPtr srv = NULL;
+    vshAdmControlPtr priv = ctl->privData;
+
+    if (vshCommandOptStringReq(ctl, cmd, "server", &srvname) < 0)
+        return false;
+
+    if (!(srv = virAdmConnectLookupServer(priv->conn, srvname, 0)))
+        goto cleanup;
+
+    if (virAdmServerGetMessagePoolParameters(srv, &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to retrieve message pool statistics"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < nparams; i++) {
+        char *str = vshGetTypedParamValue(ctl, &params[i]);
+        vshPrint(ctl, "%-15s: %s\n", params[i].field, str);
+        VIR_FREE(str);
+    }
+
+    ret = true;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    virAdmServerFree(srv);
+    return ret;
+}
+
+/* -----------------------------
+ * Command srv-message-pool-set
+ * -----------------------------
+ */
+
+static const vshCmdInfo info_srv_message_pool_set[] = {
+    {.name = "help",
+     .data = N_("set daemon's RPC message pool limits")
+    },
+    {.name = "desc",
+     .data = N_("Tune limits of the pool of RPC messages shared by the "
+                "daemon's servers. See OPTIONS for currently supported "
+                "attributes.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_srv_message_pool_set[] = {
+    {.name = "server",
+     .type = VSH_OT_DATA,
+     .flags = VSH_OFLAG_REQ,
+     .completer = vshAdmServerCompleter,
+     .help = N_("Server to alter the message pool limits on."),
+    },
+    {.name = "max-bytes",
+     .type = VSH_OT_INT,
+     .help = N_("Change the upper limit to memory held by cached buffers."),
+    },
+    {.name = "max-messages",
+     .type = VSH_OT_INT,
+     .help = N_("Change the upper limit to number of cached messages."),
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdSrvMessagePoolSet(vshControl *ctl, const vshCmd *cmd)
+{
+    bool ret = false;
+    int rv = 0;
+    unsigned long long bytes;
+    unsigned int messages;
+    int maxparams = 0;
+    int nparams = 0;
+    const char *srvname = NULL;
+    virAdmServerPtr srv = NULL;
+    virTypedParameterPtr params = NULL;
+    vshAdmControlPtr priv = ctl->privData;
+
+    if (vshCommandOptStringReq(ctl, cmd, "server", &srvname) < 0)
+        return false;
+
+    if ((rv = vshCommandOptULongLong(ctl, cmd, "max-bytes", &bytes)) < 0) {
+        goto cleanup;
+    } else if (rv > 0) {
+        if (virTypedParamsAddULLong(&params, &nparams, &maxparams,
+                                    VIR_MESSAGE_POOL_BYTES_MAX, bytes) < 0)
+            goto save_error;
+    }
+
+    if ((rv = vshCommandOptUInt(ctl, cmd, "max-messages", &messages)) < 0) {
+        goto cleanup;
+    } else if (rv > 0) {
+        if (virTypedParamsAddUInt(&params, &nparams, &maxparams,
+                                  VIR_MESSAGE_POOL_MESSAGES_MAX, messages) < 0)
+            goto save_error;
+    }
+
+    if (!nparams) {
+        vshError(ctl, "%s", _("At least one of options --max-bytes, "
+                              "--max-messages is mandatory"));
+        goto cleanup;
+    }
+
+    if (!(srv = virAdmConnectLookupServer(priv->conn, srvname, 0)))
+        goto cleanup;
+
+    if (virAdmServerSetMessagePoolParameters(srv, params, nparams, 0) < 0)
+        goto error;
+
+    ret = true;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    virAdmServerFree(srv);
+    return ret;
+
+ save_error:
+    vshSaveLibvirtError();
+
+ error:
+    vshError(ctl, "%s", _("Unable to change message pool limits"));
+    goto cleanup;
+}
+
+/* -----------------------------
+ * Command srv-compression-info
+ * -----------------------------
+ */
+
+static const vshCmdInfo info_srv_compression_info[] = {
+    {.name = "help",
+     .data = N_("get daemon's RPC reply compression settings and statistics")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve the threshold and counters of compression of RPC "
+                "replies shared by the daemon's servers.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_srv_compression_info[] = {
+    {.name = "server",
+     .type = VSH_OT_DATA,
+     .flags = VSH_OFLAG_REQ,
+     .completer = vshAdmServerCompleter,
+     .help = N_("Server to retrieve the compression statistics from."),
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdSrvCompressionInfo(vshControl *ctl, const vshCmd *cmd)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    size_t i;
+    unsigned long long bytesIn = 0;
+    unsigned long long bytesOut = 0;
+    const char *srvname = NULL;
+    virAdmServerPtr srv = NULL;
+    vshAdmControlPtr priv = ctl->privData;
+
+    if (vshCommandOptStringReq(ctl, cmd, "server", &srvname) < 0)
+        return false;
+
+    if (!(srv = virAdmConnectLookupServer(priv->conn, srvname, 0)))
+        goto cleanup;
+
+    if (virAdmServerGetCompressionParameters(srv, &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to retrieve compression statistics"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < nparams; i++) {
+        char *str = vshGetTypedParamValue(ctl, &params[i]);
+        vshPrint(ctl, "%-15s: %s\n", params[i].field, str);
+        VIR_FREE(str);
+    }
+
+    if (virTypedParamsGetULLong(params, nparams,
+                                VIR_COMPRESSION_BYTES_IN, &bytesIn) > 0 &&
+        virTypedParamsGetULLong(params, nparams,
+                                VIR_COMPRESSION_BYTES_OUT, &bytesOut) > 0 &&
+        bytesOut > 0)
+        vshPrint(ctl, "%-15s: %.2f\n", "ratio",
+                 (double) bytesIn / bytesOut);
+
+    ret = true;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    virAdmServerFree(srv);
+    return ret;
+}
+
+/* ----------------------------
+ * Command srv-compression-set
+ * ----------------------------
+ */
+
+static const vshCmdInfo info_srv_compression_set[] = {
+    {.name = "help",
+     .data = N_("set daemon's RPC reply compression settings")
+    },
+    {.name = "desc",
+     .data = N_("Tune compression of RPC replies shared by the daemon's "
+                "servers. See OPTIONS for currently supported attributes.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_srv_compression_set[] = {
+    {.name = "server",
+     .type = VSH_OT_DATA,
+     .flags = VSH_OFLAG_REQ,
+     .completer = vshAdmServerCompleter,
+     .help = N_("Server to alter the compression settings on."),
+    },
+    {.name = "threshold",
+     .type = VSH_OT_INT,
+     .help = N_("Change the smallest reply payload sent compressed, "
+                "0 disables compression."),
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdSrvCompressionSet(vshControl *ctl, const vshCmd *cmd)
+{
+    bool ret = false;
+    int rv = 0;
+    unsigned int threshold;
+    int maxparams = 0;
+    int nparams = 0;
+    const char *srvname = NULL;
+    virAdmServerPtr srv = NULL;
+    virTypedParameterPtr params = NULL;
+    vshAdmControlPtr priv = ctl->privData;
+
+    if (vshCommandOptStringReq(ctl, cmd, "server", &srvname) < 0)
+        return false;
+
+    if ((rv = vshCommandOptUInt(ctl, cmd, "threshold", &threshold)) < 0) {
+        goto cleanup;
+    } else if (rv > 0) {
+        if (virTypedParamsAddUInt(&params, &nparams, &maxparams,
+                                  VIR_COMPRESSION_THRESHOLD, threshold) < 0)
+            goto save_error;
+    }
+
+    if (!nparams) {
+        vshError(ctl, "%s", _("Option --threshold is mandatory"));
+        goto cleanup;
+    }
+
+    if (!(srv = virAdmConnectLookupServer(priv->conn, srvname, 0)))
+        goto cleanup;
+
+    if (virAdmServerSetCompressionParameters(srv, params, nparams, 0) < 0)
+        goto error;
+
+    ret = true;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    virAdmServerFree(srv);
+    return ret;
+
+ save_error:
+    vshSaveLibvirtError();
+
+ error:
+    vshError(ctl, "%s", _("Unable to change compression settings"));
+    goto cleanup;
+}
+
+/* -----------------------
+ * Command srv-call-stats
+ * -----------------------
+ */
+
+static const vshCmdInfo info_srv_call_stats[] = {
+    {.name = "help",
+     .data = N_("get server's RPC call statistics")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve the number of calls and the latencies of the "
+                "RPC procedures handled by a server.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_srv_call_stats[] = {
+    {.name = "server",
+     .type = VSH_OT_DATA,
+     .flags = VSH_OFLAG_REQ,
+     .completer = vshAdmServerCompleter,
+     .help = N_("Server to retrieve the call statistics from."),
+    },
+    {.name = "histogram",
+     .type = VSH_OT_BOOL,
+     .help = N_("print the latency histograms too"),
+    },
+    {.name = "reset",
+     .type = VSH_OT_BOOL,
+     .help = N_("clear the statistics after retrieving them"),
+    },
+    {.name = NULL}
+};
+
+/* Upper bound in microseconds of the histogram bucket containing the
+ * call at @percent of all @calls, or 0 if the last bucket is reached */
+static unsigned long long
+vshAdmCallStatsPercentile(virTypedParameterPtr params,
+                          int nparams,
+                          size_t num,
+                          const char *kind,
+                          unsigned int nbuckets,
+                          unsigned long long calls,
+                          unsigned int percent)
+{
+    char name[VIR_TYPED_PARAM_FIELD_LENGTH];
+    unsigned long long seen = 0;
+    unsigned long long count;
+    size_t i;
+
+    for (i = 0; i + 1 < nbuckets; i++) {
+        snprintf(name, sizeof(name), "call.%zu.%s.bucket.%zu", num, kind, i);
+        if (virTypedParamsGetULLong(params, nparams, name, &count) > 0)
+            seen += count;
+        if (seen * 100 >= calls * percent)
+            return 1ULL << i;
+    }
+
+    return 0;
+}
+
+static void
+vshAdmCallStatsPrintHistogram(vshControl *ctl,
+                              virTypedParameterPtr params,
+                              int nparams,
+                              size_t num,
+                              const char *kind,
+                              unsigned int nbuckets)
+{
+    char name[VIR_TYPED_PARAM_FIELD_LENGTH];
+    unsigned long long count;
+    size_t i;
+
+    for (i = 0; i < nbuckets; i++) {
+        snprintf(name, sizeof(name), "call.%zu.%s.bucket.%zu", num, kind, i);
+        if (virTypedParamsGetULLong(params, nparams, name, &count) <= 0)
+            continue;
+
+        if (i + 1 == nbuckets)
+            vshPrint(ctl, "      %s >= %llu us: %llu\n",
+                     kind, 1ULL << (i - 1), count);
+        else
+            vshPrint(ctl, "      %s < %llu us: %llu\n",
+                     kind, 1ULL << i, count);
+    }
+}
+
+static bool
+cmdSrvCallStats(vshControl *ctl, const vshCmd *cmd)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int ncalls = 0;
+    unsigned int nbuckets = 0;
+    unsigned int flags = 0;
+    bool histogram = vshCommandOptBool(cmd, "histogram");
+    char name[VIR_TYPED_PARAM_FIELD_LENGTH];
+    size_t i;
+    const char *srvname = NULL;
+    virAdmServerPtr srv = NULL;
+    vshAdmControlPtr priv = ctl->privData;
+
+    if (vshCommandOptBool(cmd, "reset"))
+        flags |= VIR_ADMIN_SERVER_CALL_STATS_RESET;
+
+    if (vshCommandOptStringReq(ctl, cmd, "server", &srvname) < 0)
+        return false;
+
+    if (!(srv = virAdmConnectLookupServer(priv->conn, srvname, 0)))
+        goto cleanup;
+
+    if (virAdmServerGetCallStats(srv, &params, &nparams, flags) < 0 ||
+        virTypedParamsGetUInt(params, nparams,
+                              VIR_CALL_STATS_COUNT, &ncalls) < 0 ||
+        virTypedParamsGetUInt(params, nparams,
+                              VIR_CALL_STATS_BUCKETS, &nbuckets) < 0) {
+        vshError(ctl, "%s", _("Unable to retrieve call statistics"));
+        goto cleanup;
+    }
+
+    vshPrintExtra(ctl, " %-40s %10s %12s %12s %12s\n%s\n",
+                  _("Procedure"), _("Calls"), _("Wait (us)"),
+                  _("Exec (us)"), _("Exec p99"),
+                  "-----------------------------------------"
+                  "-----------------------------------------"
+                  "-------------");
+
+    for (i = 0; i < ncalls; i++) {
+        const char *procname = NULL;
+        char *label = NULL;
+        unsigned int program = 0;
+        unsigned int procedure = 0;
+        unsigned long long calls = 0;
+        unsigned long long wait = 0;
+        unsigned long long exec = 0;
+        unsigned long long p99;
+
+        snprintf(name, sizeof(name), "call.%zu.program", i);
+        ignore_value(virTypedParamsGetUInt(params, nparams, name, &program));
+        snprintf(name, sizeof(name), "call.%zu.procedure", i);
+        ignore_value(virTypedParamsGetUInt(params, nparams, name, &procedure));
+        snprintf(name, sizeof(name), "call.%zu.name", i);
+        ignore_value(virTypedParamsGetString(params, nparams, name, &procname));
+        snprintf(name, sizeof(name), "call.%zu.calls", i);
+        ignore_value(virTypedParamsGetULLong(params, nparams, name, &calls));
+        snprintf(name, sizeof(name), "call.%zu.wait.total", i);
+        ignore_value(virTypedParamsGetULLong(params, nparams, name, &wait));
+        snprintf(name, sizeof(name), "call.%zu.exec.total", i);
+        ignore_value(virTypedParamsGetULLong(params, nparams, name, &exec));
+
+        if (!calls)
+            continue;
+
+        if (procname)
+            label = vshStrdup(ctl, procname);
+        else if (virAsprintf(&label, "%x:%u", program, procedure) < 0)
+            goto cleanup;
+
+        p99 = vshAdmCallStatsPercentile(params, nparams, i, "exec",
+                                        nbuckets, calls, 99);
+
+        if (p99)
+            vshPrint(ctl, " %-40s %10llu %12llu %12llu %12llu\n",
+                     label, calls, wait / calls, exec / calls, p99);
+        else
+            vshPrint(ctl, " %-40s %10llu %12llu %12llu %12s\n",
+                     label, calls, wait / calls, exec / calls, _("more"));
+        VIR_FREE(label);
+
+        if (histogram) {
+            vshAdmCallStatsPrintHistogram(ctl, params, nparams, i,
+                                          "wait", nbuckets);
+            vshAdmCallStatsPrintHistogram(ctl, params, nparams, i,
+                                          "exec", nbuckets);
+        }
+    }
+
+    ret = true;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    virAdmServerFree(srv);
+    return ret;
+}
+
 /* --------------------------
  * Command daemon-log-filters
  * --------------------------
@@ -1428,6 +1946,36 @@ static const vshCmdDef monitoringCmds[] = {
      .info = info_srv_clients_info,
      .flags = 0
     },
+    {.name = "srv-message-pool-info",
+     .flags = VSH_CMD_FLAG_ALIAS,
+     .alias = "server-message-pool-info"
+    },
+    {.name = "server-message-pool-info",
+     .handler = cmdSrvMessagePoolInfo,
+     .opts = opts_srv_message_pool_info,
+     .info = info_srv_message_pool_info,
+     .flags = 0
+    },
+    {.name = "srv-compression-info",
+     .flags = VSH_CMD_FLAG_ALIAS,
+     .alias = "server-compression-info"
+    },
+    {.name = "server-compression-info",
+     .handler = cmdSrvCompressionInfo,
+     .opts = opts_srv_compression_info,
+     .info = info_srv_compression_info,
+     .flags = 0
+    },
+    {.name = "srv-call-stats",
+     .flags = VSH_CMD_FLAG_ALIAS,
+     .alias = "server-call-stats"
+    },
+    {.name = "server-call-stats",
+     .handler = cmdSrvCallStats,
+     .opts = opts_srv_call_stats,
+     .info = info_srv_call_stats,
+     .flags = 0
+    },
     {.name = NULL}
 };
 
@@ -1458,6 +2006,26 @@ static const vshCmdDef managementCmds[] = {
      .info = info_srv_clients_set,
      .flags = 0
     },
+    {.name = "srv-message-pool-set",
+     .flags = VSH_CMD_FLAG_ALIAS,
+     .alias = "server-message-pool-set"
+    },
+    {.name = "server-message-pool-set",
+     .handler = cmdSrvMessagePoolSet,
+     .opts = opts_srv_message_pool_set,
+     .info = info_srv_message_pool_set,
+     .flags = 0
+    },
+    {.name = "srv-compression-set",
+     .flags = VSH_CMD_FLAG_ALIAS,
+     .alias = "server-compression-set"
+    },
+    {.name = "server-compression-set",
+     .handler = cmdSrvCompressionSet,
+     .opts = opts_srv_compression_set,
+     .info = info_srv_compression_set,
+     .flags = 0
+    },
     {.name = "daemon-log-filters",
      .handler = cmdDaemonLogFilters,
      .opts = opts_daemon_log_filters,
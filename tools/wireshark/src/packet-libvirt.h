@@ -54,6 +54,7 @@ enum vir_net_message_type {
     VIR_NET_CALL_WITH_FDS  = 4,
     VIR_NET_REPLY_WITH_FDS = 5,
     VIR_NET_STREAM_HOLE    = 6,
+    VIR_NET_REPLY_COMPRESSED = 7,
 };
 
 enum vir_net_message_status {
@@ -78,6 +79,7 @@ static const value_string type_strings[] = {
     { VIR_NET_CALL_WITH_FDS,  "CALL_WITH_FDS"  },
     { VIR_NET_REPLY_WITH_FDS, "REPLY_WITH_FDS" },
     { VIR_NET_STREAM_HOLE,    "STREAM_HOLE"    },
+    { VIR_NET_REPLY_COMPRESSED, "REPLY_COMPRESSED" },
     { -1, NULL }
 };
 